@@ -0,0 +1,121 @@
+#include "ABuffer.h"
+
+#include <cmath>
+#include <cstddef>
+
+void GetDefaultABufferSettings(ABufferSettings *pSettings)
+{
+   pSettings->headroom = 1.5f;
+   pSettings->shrinkFraction = 0.25f;
+   pSettings->granularity = 64 * 1024;
+}
+
+unsigned int ChooseABufferCapacity(const ABufferSettings &settings, unsigned int measuredFragments,
+   unsigned int capacity, unsigned int width, unsigned int height)
+{
+   unsigned long long maxNodes = (unsigned long long)width * height * MAX_OIT_FRAGMENTS_PER_PIXEL;
+   unsigned long long granularity = settings.granularity;
+   maxNodes = (maxNodes + granularity - 1) / granularity * granularity;
+
+   // Enough room is kept until the fragments fall well below it
+   bool fits = measuredFragments <= capacity && capacity >= granularity && capacity <= maxNodes;
+   if (fits && measuredFragments >= (unsigned long long)(capacity * settings.shrinkFraction)) return capacity;
+
+   unsigned long long wanted = (unsigned long long)ceil(measuredFragments * (double)settings.headroom);
+   wanted = (wanted + granularity - 1) / granularity * granularity;
+   if (wanted < granularity) wanted = granularity;
+   if (wanted > maxNodes) wanted = maxNodes;
+   return (unsigned int)wanted;
+}
+
+unsigned int PackOitColor(const float color[4])
+{
+   unsigned int packed = 0;
+   for (unsigned int c = 0; c < 4; c++)
+   {
+      float value = color[c];
+      if (value < 0.0f) value = 0.0f;
+      if (value > 1.0f) value = 1.0f;
+      packed |= (unsigned int)(value * 255.0f + 0.5f) << (c * 8);
+   }
+   return packed;
+}
+
+void UnpackOitColor(unsigned int packed, float color[4])
+{
+   for (unsigned int c = 0; c < 4; c++) color[c] = ((packed >> (c * 8)) & 0xff) / 255.0f;
+}
+
+unsigned long long GetABufferBytes(unsigned int width, unsigned int height, unsigned int capacity)
+{
+   return (unsigned long long)capacity * sizeof(OitNode) + (unsigned long long)width * height * sizeof(unsigned int);
+}
+
+unsigned long long GetColorBufferBytes(unsigned int width, unsigned int height, unsigned int depth)
+{
+   // RGBA8 color per layer and an R32 count per pixel
+   return (unsigned long long)width * height * (depth * 4 + sizeof(unsigned int));
+}
+
+ABuffer::ABuffer() :
+   m_width(0), m_height(0), m_nodeCount(0)
+{
+}
+
+void ABuffer::Begin(unsigned int width, unsigned int height, unsigned int capacity)
+{
+   m_width = width;
+   m_height = height;
+   m_nodeCount = 0;
+   m_heads.assign(width * height, 0);
+   m_nodes.resize(capacity);
+}
+
+bool ABuffer::Insert(unsigned int x, unsigned int y, const float color[4], float depth)
+{
+   unsigned int node = m_nodeCount++;
+   if (node >= m_nodes.size()) return false;
+
+   unsigned int &head = m_heads[y * m_width + x];
+   m_nodes[node].color = PackOitColor(color);
+   m_nodes[node].depth = depth;
+   m_nodes[node].next = head;
+   head = node + 1;
+   return true;
+}
+
+void ABuffer::Resolve(unsigned int x, unsigned int y, float color[3], float *pTransmittance) const
+{
+   // The nearest fragments sorted front to back, a nearer one pushes the
+   // farthest out once the list is full
+   OitNode nearest[MAX_OIT_FRAGMENTS_PER_PIXEL];
+   unsigned int numNearest = 0;
+   for (unsigned int node = m_heads[y * m_width + x]; node != 0; node = m_nodes[node - 1].next)
+   {
+      const OitNode &fragment = m_nodes[node - 1];
+      if (numNearest == MAX_OIT_FRAGMENTS_PER_PIXEL && fragment.depth >= nearest[numNearest - 1].depth) continue;
+
+      unsigned int i = numNearest < MAX_OIT_FRAGMENTS_PER_PIXEL ? numNearest++ : numNearest - 1;
+      for (; i > 0 && nearest[i - 1].depth > fragment.depth; i--) nearest[i] = nearest[i - 1];
+      nearest[i] = fragment;
+   }
+
+   color[0] = color[1] = color[2] = 0.0f;
+   float transmittance = 1.0f;
+   for (unsigned int i = numNearest; i > 0; i--)
+   {
+      float fragmentColor[4];
+      UnpackOitColor(nearest[i - 1].color, fragmentColor);
+      float alpha = fragmentColor[3];
+      for (unsigned int c = 0; c < 3; c++) color[c] = fragmentColor[c] * alpha + color[c] * (1.0f - alpha);
+      transmittance *= 1.0f - alpha;
+   }
+   *pTransmittance = transmittance;
+}
+
+unsigned int ABuffer::GetFragmentCount(unsigned int x, unsigned int y) const
+{
+   unsigned int count = 0;
+   for (unsigned int node = m_heads[y * m_width + x]; node != 0; node = m_nodes[node - 1].next) count++;
+   return count;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <vector>
+
+#include "ShaderDefines.h"
+
+// One transparent fragment in a pixel's list. Must match OitNode in
+// PlainPixel.hlsl and OitResolvePS.hlsl.
+struct OitNode
+{
+   // RGBA8 with alpha in the top byte, not premultiplied
+   unsigned int color;
+   float depth;
+
+   // Index + 1 of the pixel's previous fragment, 0 ends the list
+   unsigned int next;
+};
+
+struct ABufferSettings
+{
+   // Nodes allocated per measured fragment, the headroom covers the frames
+   // between the measurement and the resize
+   float headroom;
+
+   // The buffer only shrinks once the measured fragments fill less than
+   // this fraction of it, so a view close to a size does not resize every
+   // frame
+   float shrinkFraction;
+
+   // Capacities are multiples of this many nodes, and never less
+   unsigned int granularity;
+};
+
+void GetDefaultABufferSettings(ABufferSettings *pSettings);
+
+// Node capacity for the fragments measured on a recent frame, capacity is
+// the current one. At most MAX_OIT_FRAGMENTS_PER_PIXEL nodes per pixel,
+// the resolve never blends more than that many.
+unsigned int ChooseABufferCapacity(const ABufferSettings &settings, unsigned int measuredFragments,
+   unsigned int capacity, unsigned int width, unsigned int height);
+
+unsigned int PackOitColor(const float color[4]);
+void UnpackOitColor(unsigned int packed, float color[4]);
+
+// Bytes of the per-pixel lists at a node capacity, head texture included
+unsigned long long GetABufferBytes(unsigned int width, unsigned int height, unsigned int capacity);
+
+// Bytes of a fixed depth per-pixel color buffer and its fragment counts
+unsigned long long GetColorBufferBytes(unsigned int width, unsigned int height, unsigned int depth);
+
+// What the transparent pass and OitResolvePS.hlsl do on the GPU. Inserted
+// fragments take the next node from a shared counter and link themselves in
+// front of their pixel's list. Past the capacity they are dropped but still
+// counted, so the count says how large the buffer has to be.
+class ABuffer
+{
+public:
+   ABuffer();
+
+   // Empties every list, the nodes are kept allocated
+   void Begin(unsigned int width, unsigned int height, unsigned int capacity);
+
+   // False when the fragment was dropped for lack of nodes
+   bool Insert(unsigned int x, unsigned int y, const float color[4], float depth);
+
+   // Blends the pixel's MAX_OIT_FRAGMENTS_PER_PIXEL nearest fragments back
+   // to front. Returns the premultiplied color and the transmittance the
+   // background is scaled by, what the resolve's blend state adds to the
+   // target.
+   void Resolve(unsigned int x, unsigned int y, float color[3], float *pTransmittance) const;
+
+   // Fragments in the pixel's list
+   unsigned int GetFragmentCount(unsigned int x, unsigned int y) const;
+
+   // Fragments inserted since Begin, dropped ones included
+   unsigned int GetNodeCount() const { return m_nodeCount; }
+
+   unsigned int GetCapacity() const { return (unsigned int)m_nodes.size(); }
+
+private:
+   unsigned int m_width;
+   unsigned int m_height;
+   unsigned int m_nodeCount;
+   std::vector<unsigned int> m_heads;
+   std::vector<OitNode> m_nodes;
+};
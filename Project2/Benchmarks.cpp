@@ -0,0 +1,4046 @@
+#include "Benchmarks.h"
+
+#include "ABuffer.h"
+#include "ClusteredLighting.h"
+#include "CoarseVpl.h"
+#include "CpuTimer.h"
+#include "Deferred.h"
+#include "DepthPrepass.h"
+#include "DynamicResolution.h"
+#include "Evsm.h"
+#include "GaussianBlur.h"
+#include "GpuCulling.h"
+#include "IrradianceProbes.h"
+#include "LightBinning.h"
+#include "MeshInstancing.h"
+#include "NullCommandBackend.h"
+#include "ParallelRecorder.h"
+#include "ScenePasses.h"
+#include "ShadowCache.h"
+#include "ShadowCascades.h"
+#include "ShadowFilter.h"
+#include "Ssao.h"
+#include "Taa.h"
+#include "VplSampling.h"
+#include "WeightedOit.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <vector>
+
+using std::vector;
+using std::string;
+using std::ostream;
+
+namespace
+{
+   const unsigned int NUM_BENCHMARK_FRAMES = 64;
+
+   // Counts the expectations of a benchmark that doubles as a test, failures
+   // are named in the output
+   struct CheckResults
+   {
+      unsigned int numChecks;
+      unsigned int numFailed;
+   };
+
+   void Check(bool passed, const char *pName, CheckResults *pResults, ostream &out)
+   {
+      pResults->numChecks++;
+      if (passed) return;
+      pResults->numFailed++;
+      out << "  FAILED: " << pName << "\n";
+   }
+
+   // Records each worker's chunk into its own command buffer and replays it
+   // on a null backend, mirroring the deferred context path
+   class NullChunkRecorder : public IChunkRecorder
+   {
+   public:
+      NullChunkRecorder(const ScenePassResources &res, const vector<SceneDrawItem> &items, unsigned int numWorkers) :
+         m_res(res), m_items(items), m_commands(numWorkers * NUM_SCENE_PASSES), m_backends(numWorkers) {}
+
+      void RecordChunk(unsigned int worker, unsigned int pass, const DrawChunk &chunk)
+      {
+         CommandBuffer *pCmds = &m_commands[worker * NUM_SCENE_PASSES + pass];
+         pCmds->Reset();
+         RecordScenePass(pCmds, m_res, m_items, pass, chunk);
+         m_backends[worker].Execute(*pCmds);
+      }
+
+      void ExecuteChunk(unsigned int /*worker*/, unsigned int /*pass*/)
+      {
+      }
+
+      unsigned long long GetNumCommands() const
+      {
+         unsigned long long numCommands = 0;
+         for (size_t i = 0; i < m_commands.size(); i++)
+         {
+            numCommands += m_commands[i].GetCommands().size();
+         }
+         return numCommands;
+      }
+
+   private:
+      const ScenePassResources &m_res;
+      const vector<SceneDrawItem> &m_items;
+      vector<CommandBuffer> m_commands;
+      vector<NullCommandBackend> m_backends;
+   };
+
+   void SetSyntheticResolution(unsigned int width, unsigned int height, ScenePassResources *pRes)
+   {
+      Viewport viewport = { 0.0f, 0.0f, (float)width, (float)height, 0.0f, 1.0f };
+      pRes->mainViewport = viewport;
+      pRes->outputViewport = viewport;
+   }
+
+   // The light map and the cascades are sized independently of the back
+   // buffer, like the renderer's runtime settings
+   void SetSyntheticShadowSizes(unsigned int shadowMapWidth, unsigned int shadowMapHeight, unsigned int cascadeSize,
+      ScenePassResources *pRes)
+   {
+      Viewport viewport = { 0.0f, 0.0f, (float)shadowMapWidth, (float)shadowMapHeight, 0.0f, 1.0f };
+      pRes->shadowViewport = viewport;
+      pRes->shadowMapWidth = shadowMapWidth;
+      pRes->shadowMapHeight = shadowMapHeight;
+      pRes->cascadeSize = cascadeSize;
+   }
+
+   // Gives every physical texture of a compiled graph its own views
+   void AssignSyntheticViews(RenderGraph *pGraph, ResourceHandle firstHandle)
+   {
+      for (unsigned int i = 0; i < pGraph->GetNumPhysicalTextures(); i++)
+      {
+         ResourceHandle handle = firstHandle + 4 * i;
+         RenderGraphViews views = { handle, handle + 1, handle + 2, handle + 3 };
+         pGraph->SetPhysicalTextureViews(i, views);
+      }
+   }
+
+   void CreateSyntheticScene(unsigned int numItems, ScenePassResources *pRes, vector<SceneDrawItem> *pItems)
+   {
+      // Every object gets a unique handle, the values only matter to the
+      // null backend's redundant bind tracking
+      ResourceHandle nextHandle = 1;
+      pRes->inputLayout = nextHandle++;
+      pRes->rasterState = nextHandle++;
+      pRes->vertexShader = nextHandle++;
+      pRes->solidColorPS = nextHandle++;
+      pRes->texturePS = nextHandle++;
+      pRes->textureNoShadingPS = nextHandle++;
+      pRes->blurCS = nextHandle++;
+      pRes->lightBinCS = nextHandle++;
+      pRes->vplFluxCS = nextHandle++;
+      pRes->gaussianBlurCS = nextHandle++;
+      pRes->clusterAssignCS = nextHandle++;
+      pRes->colorSampler = nextHandle++;
+      pRes->shadowSampler = nextHandle++;
+      pRes->lightConstants = nextHandle++;
+      pRes->cameraTransformConstants = nextHandle++;
+      pRes->lightTransformConstants = nextHandle++;
+      pRes->instanceBuffer = nextHandle++;
+      pRes->vplConstants = nextHandle++;
+      pRes->vplCount = nextHandle++;
+      pRes->blurConstants = nextHandle++;
+      for (unsigned int cascade = 0; cascade < NUM_SHADOW_CASCADES; cascade++)
+      {
+         pRes->cascadeTransformConstants[cascade] = nextHandle++;
+      }
+      pRes->cascadeConstants = nextHandle++;
+      pRes->evsmMomentsCS = nextHandle++;
+      pRes->momentsSampler = nextHandle++;
+      pRes->shadowMomentsSrv = nextHandle++;
+      pRes->shadowMomentsUav = nextHandle++;
+      pRes->planeVS = nextHandle++;
+      pRes->shadowClearPS = nextHandle++;
+      pRes->scissorRasterState = nextHandle++;
+      pRes->clearDepthState = nextHandle++;
+      pRes->normalDepthPS = nextHandle++;
+      pRes->ssaoCS = nextHandle++;
+      pRes->ssaoTemporalCS = nextHandle++;
+      pRes->ssaoUpsampleCS = nextHandle++;
+      pRes->ssaoConstants = nextHandle++;
+      pRes->ssaoHistorySrv = nextHandle++;
+      pRes->ssaoResolvedSrv = nextHandle++;
+      pRes->ssaoResolvedUav = nextHandle++;
+      pRes->gbufferPS = nextHandle++;
+      pRes->gbufferTexturePS = nextHandle++;
+      pRes->deferredLightingCS = nextHandle++;
+      pRes->deferredCompositePS = nextHandle++;
+      pRes->deferredConstants = nextHandle++;
+      pRes->depthOnlyVS = nextHandle++;
+      pRes->equalDepthState = nextHandle++;
+      pRes->oitPS = nextHandle++;
+      pRes->oitTexturePS = nextHandle++;
+      pRes->oitResolvePS = nextHandle++;
+      pRes->testDepthState = nextHandle++;
+      pRes->oitBlendState = nextHandle++;
+      pRes->oitNodesSrv = nextHandle++;
+      pRes->oitNodesUav = nextHandle++;
+      pRes->oitNodeCountUav = nextHandle++;
+      pRes->weightedOitPS = nextHandle++;
+      pRes->weightedOitTexturePS = nextHandle++;
+      pRes->weightedOitCompositePS = nextHandle++;
+      pRes->weightedOitBlendState = nextHandle++;
+      pRes->taaMotionCS = nextHandle++;
+      pRes->taaResolveCS = nextHandle++;
+      pRes->taaSharpenPS = nextHandle++;
+      pRes->taaConstants = nextHandle++;
+      pRes->taaHistorySrv = nextHandle++;
+      pRes->taaResolvedSrv = nextHandle++;
+      pRes->taaResolvedUav = nextHandle++;
+      pRes->upscalePS = nextHandle++;
+      pRes->upscaleConstants = nextHandle++;
+      pRes->coarseVplCS = nextHandle++;
+      pRes->vplUpsampleCS = nextHandle++;
+      pRes->coarseVplTexturePS = nextHandle++;
+      pRes->coarseVplConstants = nextHandle++;
+      pRes->irradianceProbesSrv = nextHandle++;
+      pRes->irradianceProbeConstants = nextHandle++;
+      pRes->backBufferTarget = nextHandle++;
+      pRes->depthView = nextHandle++;
+      pRes->lightBufferUav = nextHandle++;
+      pRes->lightBufferSrv = nextHandle++;
+      pRes->lightTilesUav = nextHandle++;
+      pRes->lightTilesSrv = nextHandle++;
+      pRes->lightIndicesUav = nextHandle++;
+      pRes->lightIndicesSrv = nextHandle++;
+      pRes->totalFluxUav = nextHandle++;
+      pRes->totalFluxSrv = nextHandle++;
+      pRes->clusterConstants = nextHandle++;
+      pRes->clusterLights = nextHandle++;
+      pRes->clusterLightsSrv = nextHandle++;
+      pRes->clusters = nextHandle++;
+      pRes->clustersSrv = nextHandle++;
+      pRes->clustersUav = nextHandle++;
+      pRes->clusterLightIndices = nextHandle++;
+      pRes->clusterLightIndicesSrv = nextHandle++;
+      pRes->clusterLightIndicesUav = nextHandle++;
+      pRes->clusterIndexCounterUav = nextHandle++;
+      pRes->cullCS = nextHandle++;
+      pRes->cullConstants = nextHandle++;
+      pRes->cullInstancesSrv = nextHandle++;
+      for (unsigned int pass = 0; pass < NUM_SCENE_PASSES; pass++)
+      {
+         pRes->drawArgs[pass] = nextHandle++;
+         pRes->drawArgsTemplate[pass] = nextHandle++;
+         pRes->drawArgsUav[pass] = nextHandle++;
+         pRes->visibleInstances[pass] = nextHandle++;
+         pRes->visibleInstancesUav[pass] = nextHandle++;
+      }
+
+      SetSyntheticResolution(1024, 768, pRes);
+      SetSyntheticShadowSizes(REFERENCE_RSM_WIDTH, REFERENCE_RSM_HEIGHT, DEFAULT_SHADOW_CASCADE_SIZE, pRes);
+      pRes->vertexStride = 40;
+      pRes->instanceStride = sizeof(InstanceTransform);
+      pRes->numInstances = numItems;
+      pRes->gpuCulling = true;
+      pRes->gpuClusterAssignment = true;
+      pRes->shadowFilter = SHADOW_FILTER_EVSM;
+      pRes->deferredShading = false;
+      pRes->depthPrepass = false;
+      pRes->drawTransparent = false;
+      pRes->temporalAA = false;
+      pRes->dynamicResolution = false;
+      pRes->coarseVpl = false;
+      pRes->coarseVplFactor = 2;
+      pRes->irradianceProbes = false;
+
+      const unsigned int NUM_MATERIALS = 32;
+      pItems->resize(numItems);
+      for (unsigned int i = 0; i < numItems; i++)
+      {
+         SceneDrawItem &item = (*pItems)[i];
+         item.vertexBuffer = nextHandle++;
+         item.indexBuffer = nextHandle++;
+         item.materialConstants = 100000 + i % NUM_MATERIALS;
+         item.texture = (i % 3) ? 200000 + i % NUM_MATERIALS : NULL_HANDLE;
+         item.numIndices = 300 + (i * 7919) % 3000;
+         item.firstInstance = i;
+         item.numInstances = 1;
+         item.transparent = false;
+         item.opacityTexture = NULL_HANDLE;
+      }
+   }
+
+   void RunCommandStreamBenchmark(ostream &out)
+   {
+      out << "command_stream: CPU cost of recording both scene passes into command buffers\n";
+
+      const unsigned int drawCounts[] = { 256, 1024, 4096, 16384 };
+      const unsigned int workerCounts[] = { 1, 2, 4, 8 };
+
+      for (unsigned int d = 0; d < sizeof(drawCounts) / sizeof(drawCounts[0]); d++)
+      {
+         ScenePassResources res;
+         vector<SceneDrawItem> items;
+         CreateSyntheticScene(drawCounts[d], &res, &items);
+
+         vector<unsigned int> drawCosts(items.size());
+         for (size_t i = 0; i < items.size(); i++) drawCosts[i] = items[i].numIndices * items[i].numInstances;
+
+         for (unsigned int w = 0; w < sizeof(workerCounts) / sizeof(workerCounts[0]); w++)
+         {
+            ParallelRecorder recorder(workerCounts[w]);
+            NullChunkRecorder chunkRecorder(res, items, workerCounts[w]);
+
+            CpuTimer timer;
+            for (unsigned int frame = 0; frame < NUM_BENCHMARK_FRAMES; frame++)
+            {
+               recorder.Record(&chunkRecorder, NUM_SCENE_PASSES, drawCosts);
+            }
+            double msPerFrame = timer.GetElapsedMs() / NUM_BENCHMARK_FRAMES;
+
+            out << "  draws=" << drawCounts[d] << " workers=" << workerCounts[w]
+                << " commands=" << chunkRecorder.GetNumCommands()
+                << " ms/frame=" << msPerFrame
+                << " us/draw=" << 1000.0 * msPerFrame / (drawCounts[d] * NUM_SCENE_PASSES) << "\n";
+         }
+      }
+   }
+
+   // ParallelRecorder driven by the logging stub: every pass must record
+   // each draw exactly once and execute its chunks in draw order, for
+   // worker counts above and below the number of draws and for costs that
+   // change every frame
+   void RunParallelRecorderBenchmark(ostream &out)
+   {
+      out << "parallel_recorder: partitioning and execute order checked with a recording stub\n";
+
+      CheckResults results = { 0, 0 };
+      const unsigned int NUM_FRAMES = 8;
+      const unsigned int drawCounts[] = { 1, 3, 17, 1024 };
+      const unsigned int workerCounts[] = { 1, 2, 3, 4, 8 };
+
+      for (unsigned int w = 0; w < sizeof(workerCounts) / sizeof(workerCounts[0]); w++)
+      {
+         ParallelRecorder recorder(workerCounts[w]);
+         RecordingChunkRecorder stub;
+
+         bool valid = true, chunkCounts = true, balanced = true;
+         for (unsigned int d = 0; d < sizeof(drawCounts) / sizeof(drawCounts[0]); d++)
+         {
+            unsigned int numDraws = drawCounts[d];
+            for (unsigned int frame = 0; frame < NUM_FRAMES; frame++)
+            {
+               vector<unsigned int> drawCosts(numDraws);
+               unsigned long long totalCost = 0, maxCost = 0;
+               for (unsigned int i = 0; i < numDraws; i++)
+               {
+                  // Some zero cost draws, PartitionDraws counts them as 1
+                  drawCosts[i] = (i * 7919 + frame * 104729) % 3000;
+                  totalCost += std::max(drawCosts[i], 1u);
+                  maxCost = std::max<unsigned long long>(maxCost, std::max(drawCosts[i], 1u));
+               }
+
+               stub.Clear();
+               recorder.Record(&stub, NUM_SCENE_PASSES, drawCosts);
+               for (unsigned int pass = 0; pass < NUM_SCENE_PASSES; pass++)
+               {
+                  recorder.ExecutePass(&stub, pass);
+               }
+               valid = valid && stub.Validate(NUM_SCENE_PASSES, numDraws);
+
+               const vector<DrawChunk> &chunks = recorder.GetChunks();
+               chunkCounts = chunkCounts && chunks.size() == std::min(workerCounts[w], numDraws);
+
+               // A chunk closes as soon as it reaches its share, so it can
+               // only overshoot by the draw that crossed it
+               for (size_t c = 0; c < chunks.size(); c++)
+               {
+                  unsigned long long chunkCost = 0;
+                  for (unsigned int i = 0; i < chunks[c].numDraws; i++)
+                  {
+                     chunkCost += std::max(drawCosts[chunks[c].firstDraw + i], 1u);
+                  }
+                  balanced = balanced && chunks[c].numDraws > 0 && chunkCost <= totalCost / chunks.size() + 2 * maxCost;
+               }
+            }
+         }
+
+         out << "  workers=" << workerCounts[w] << " frames=" << NUM_FRAMES * sizeof(drawCounts) / sizeof(drawCounts[0])
+             << " valid=" << (valid ? "yes" : "no") << "\n";
+         Check(valid, "every pass records each draw once and executes its chunks in draw order", &results, out);
+         Check(chunkCounts, "there is one chunk per worker unless there are fewer draws", &results, out);
+         Check(balanced, "chunks are non-empty and close to an equal share of the cost", &results, out);
+      }
+
+      // Validate has to catch a stub that saw the passes out of order or a
+      // draw twice, or passing it means nothing
+      {
+         ParallelRecorder recorder(4);
+         RecordingChunkRecorder stub;
+         vector<unsigned int> drawCosts(64, 100);
+
+         recorder.Record(&stub, NUM_SCENE_PASSES, drawCosts);
+         for (unsigned int pass = NUM_SCENE_PASSES; pass > 0; pass--)
+         {
+            recorder.ExecutePass(&stub, pass - 1);
+         }
+         Check(!stub.Validate(NUM_SCENE_PASSES, 64), "passes executed in reverse fail validation", &results, out);
+
+         stub.Clear();
+         recorder.Record(&stub, NUM_SCENE_PASSES, drawCosts);
+         recorder.Record(&stub, NUM_SCENE_PASSES, drawCosts);
+         Check(!stub.Validate(NUM_SCENE_PASSES, 64), "a frame recorded twice without Clear fails validation", &results,
+            out);
+      }
+
+      out << "  checks passed=" << results.numChecks - results.numFailed << " of " << results.numChecks << "\n";
+   }
+
+   void RunRenderGraphBenchmark(ostream &out)
+   {
+      out << "render_graph: CPU cost of compiling the frame graph and recording it\n";
+
+      ScenePassResources res;
+      vector<SceneDrawItem> items;
+      CreateSyntheticScene(1024, &res, &items);
+
+      RenderGraph graph;
+      SceneGraphPasses passes;
+      DeclareSceneGraph(&graph, res, &passes);
+
+      // A pass nothing consumes, this one has to be culled
+      RenderGraphViews unusedViews = { 400001, 400002, NULL_HANDLE, NULL_HANDLE };
+      RenderGraphResource unused = graph.ImportResource("UnusedBlur", unusedViews);
+      RenderGraphPass unusedPass = graph.AddPass("UnusedBlur");
+      graph.WriteRenderTarget(unusedPass, unused, 0);
+
+      DrawChunk allDraws = { 0, (unsigned int)items.size() };
+      for (unsigned int pass = 0; pass < NUM_SCENE_PASSES; pass++)
+      {
+         graph.SetPassCallback(passes.scenePasses[pass], [&res, &items, pass, allDraws](CommandBuffer *pCmds)
+         {
+            RecordScenePass(pCmds, res, items, pass, allDraws);
+         });
+      }
+      vector<unsigned int> cascadeDrawMasks(items.size(), (1 << NUM_SHADOW_CASCADES) - 1);
+      graph.SetPassCallback(passes.shadowCascades, [&res, &items, &cascadeDrawMasks](CommandBuffer *pCmds)
+      {
+         RecordShadowCascades(pCmds, res, items, cascadeDrawMasks);
+      });
+      graph.SetPassCallback(passes.evsmMoments, [&res](CommandBuffer *pCmds)
+      {
+         RecordEvsmMoments(pCmds, res);
+      });
+      BlurConstants evsmBlurConstants;
+      SetupBlurConstants(res.cascadeSize * NUM_SHADOW_CASCADES, res.cascadeSize, DEFAULT_EVSM_BLUR_RADIUS, 1.0f,
+         false, 1.0f, &evsmBlurConstants);
+      evsmBlurConstants.tileWidth = res.cascadeSize;
+      graph.SetPassCallback(passes.evsmBlur.horizontal, [&res, evsmBlurConstants](CommandBuffer *pCmds)
+      {
+         RecordBlurPass(pCmds, res, evsmBlurConstants);
+      });
+      graph.SetPassCallback(passes.evsmBlur.vertical, [&res, evsmBlurConstants](CommandBuffer *pCmds)
+      {
+         BlurConstants constants = evsmBlurConstants;
+         constants.horizontal = 0;
+         RecordBlurPass(pCmds, res, constants);
+      });
+      graph.SetPassCallback(passes.evsmMips, [&res](CommandBuffer *pCmds)
+      {
+         RecordEvsmMips(pCmds, res);
+      });
+      VplConstants vplConstants;
+      SetupVplConstants(res.shadowMapWidth, res.shadowMapHeight, DEFAULT_VPLS, 0, &vplConstants);
+      graph.SetPassCallback(passes.vplFlux, [&res, &vplConstants](CommandBuffer *pCmds)
+      {
+         RecordVplFlux(pCmds, res, vplConstants);
+      });
+      graph.SetPassCallback(passes.lightBuffer, [&res, &vplConstants](CommandBuffer *pCmds)
+      {
+         RecordLightBufferGeneration(pCmds, res, vplConstants);
+      });
+      graph.SetPassCallback(passes.lightBinning, [&res](CommandBuffer *pCmds)
+      {
+         RecordLightBinning(pCmds, res);
+      });
+      ClusterConstants clusterConstants;
+      memset(&clusterConstants, 0, sizeof(clusterConstants));
+      vector<ClusterLight> noLights;
+      ClusterAssignment noAssignment;
+      graph.SetPassCallback(passes.clusterAssignment,
+         [&res, &clusterConstants, &noLights, &noAssignment](CommandBuffer *pCmds)
+      {
+         RecordClusterAssignment(pCmds, res, clusterConstants, noLights, noAssignment);
+      });
+      CullConstants cullConstants;
+      memset(&cullConstants, 0, sizeof(cullConstants));
+      cullConstants.numInstances = res.numInstances;
+      for (unsigned int pass = 0; pass < NUM_SCENE_PASSES; pass++)
+      {
+         graph.SetPassCallback(passes.culling[pass], [&res, pass, cullConstants](CommandBuffer *pCmds)
+         {
+            RecordInstanceCulling(pCmds, res, pass, cullConstants);
+         });
+      }
+      graph.SetPassCallback(passes.normalDepth, [&res, &items, allDraws](CommandBuffer *pCmds)
+      {
+         RecordNormalDepthPass(pCmds, res, items, allDraws);
+      });
+      graph.SetPassCallback(passes.ssao, [&res](CommandBuffer *pCmds)
+      {
+         RecordSsao(pCmds, res);
+      });
+      graph.SetPassCallback(passes.ssaoTemporal, [&res](CommandBuffer *pCmds)
+      {
+         RecordSsaoTemporal(pCmds, res);
+      });
+      graph.SetPassCallback(passes.ssaoUpsample, [&res](CommandBuffer *pCmds)
+      {
+         RecordSsaoUpsample(pCmds, res);
+      });
+      graph.SetPassCallback(passes.transparent, [&res, &items, allDraws](CommandBuffer *pCmds)
+      {
+         RecordTransparentPass(pCmds, res, items, allDraws);
+      });
+      graph.SetPassCallback(passes.oitResolve, [&res](CommandBuffer *pCmds)
+      {
+         RecordOitResolve(pCmds, res);
+      });
+      graph.SetPassCallback(passes.weightedTransparent, [&res, &items, allDraws](CommandBuffer *pCmds)
+      {
+         RecordWeightedTransparentPass(pCmds, res, items, allDraws);
+      });
+      graph.SetPassCallback(passes.weightedComposite, [&res](CommandBuffer *pCmds)
+      {
+         RecordWeightedOitComposite(pCmds, res);
+      });
+
+      string errors;
+      CpuTimer compileTimer;
+      for (unsigned int frame = 0; frame < NUM_BENCHMARK_FRAMES; frame++)
+      {
+         graph.Compile(&errors);
+      }
+      double compileMs = compileTimer.GetElapsedMs() / NUM_BENCHMARK_FRAMES;
+      AssignSyntheticViews(&graph, 500000);
+
+      CommandBuffer cmds;
+      NullCommandBackend backend;
+      CpuTimer executeTimer;
+      for (unsigned int frame = 0; frame < NUM_BENCHMARK_FRAMES; frame++)
+      {
+         cmds.Reset();
+         graph.Execute(&cmds);
+         backend.Execute(cmds);
+      }
+      double executeMs = executeTimer.GetElapsedMs() / NUM_BENCHMARK_FRAMES;
+
+      out << graph.GetScheduleReport() << errors;
+      out << "  compile ms=" << compileMs << " execute ms/frame=" << executeMs
+          << " commands=" << cmds.GetCommands().size()
+          << " redundant binds=" << backend.GetStats().redundantBinds / NUM_BENCHMARK_FRAMES << "\n";
+   }
+
+   // The frame graph at a few resolutions, once with every transient
+   // committed and once with the color transients on a tile pool. The tiled
+   // graph is checked for transients that live together sharing tiles and
+   // for the barriers in front of reused tiles.
+   void RunTransientMemoryBenchmark(ostream &out)
+   {
+      out << "transient_memory: render target memory of the frame graph, committed or aliased in a tile pool\n";
+
+      CheckResults results = { 0, 0 };
+      bool allCompiled = true, onlyColorTiled = true, withinPool = true, disjointTiles = true, barriersMatch = true;
+      const unsigned int resolutions[][2] = { { 1024, 768 }, { 1920, 1080 }, { 3840, 2160 } };
+      for (unsigned int i = 0; i < sizeof(resolutions) / sizeof(resolutions[0]); i++)
+      {
+         ScenePassResources res;
+         vector<SceneDrawItem> items;
+         CreateSyntheticScene(1, &res, &items);
+         SetSyntheticResolution(resolutions[i][0], resolutions[i][1], &res);
+
+         RenderGraphMemoryStats stats[2];
+         unsigned int numBarriers[2];
+         for (unsigned int tiled = 0; tiled < 2; tiled++)
+         {
+            RenderGraph graph;
+            graph.SetTiledTransients(tiled == 1);
+            SceneGraphPasses passes;
+            DeclareSceneGraph(&graph, res, &passes);
+
+            string errors;
+            allCompiled = graph.Compile(&errors) && allCompiled;
+            out << errors;
+            stats[tiled] = graph.GetMemoryStats();
+
+            CommandBuffer cmds;
+            graph.Execute(&cmds);
+            NullCommandBackend backend;
+            backend.Execute(cmds);
+            numBarriers[tiled] = backend.GetStats().commandCounts[CMD_TILED_RESOURCE_BARRIER];
+
+            unsigned int poolTiles = (unsigned int)(stats[tiled].tilePoolBytes / GRAPH_TILE_SIZE);
+            unsigned int expectedBarriers = 0;
+            for (RenderGraphResource r = 0; r < graph.GetNumResources(); r++)
+            {
+               unsigned int first, last, firstTile, numTiles;
+               unsigned int texture = graph.GetPhysicalTexture(r);
+               if (texture == (unsigned int)-1 || !graph.GetResourceLifetime(r, &first, &last)) continue;
+               graph.GetPhysicalTextureTiles(texture, &firstTile, &numTiles);
+               if (numTiles == 0) continue;
+
+               const RenderGraphTextureDesc &desc = graph.GetPhysicalTextureDesc(texture);
+               onlyColorTiled = onlyColorTiled && desc.depth == 1 &&
+                  !(graph.GetPhysicalTextureBindFlags(texture) & GRAPH_BIND_DSV);
+               withinPool = withinPool && numTiles == GetTextureTileCount(desc) && firstTile + numTiles <= poolTiles;
+
+               bool reusesTiles = false;
+               for (RenderGraphResource other = 0; other < graph.GetNumResources(); other++)
+               {
+                  unsigned int otherFirst, otherLast, otherFirstTile, otherNumTiles;
+                  unsigned int otherTexture = graph.GetPhysicalTexture(other);
+                  if (other == r || otherTexture == (unsigned int)-1) continue;
+                  if (!graph.GetResourceLifetime(other, &otherFirst, &otherLast)) continue;
+                  graph.GetPhysicalTextureTiles(otherTexture, &otherFirstTile, &otherNumTiles);
+
+                  bool overlaps = otherFirstTile < firstTile + numTiles && firstTile < otherFirstTile + otherNumTiles;
+                  bool liveTogether = otherFirst <= last && first <= otherLast;
+                  if (otherNumTiles > 0 && overlaps && liveTogether) disjointTiles = false;
+                  if (otherNumTiles > 0 && overlaps && otherFirst < first) reusesTiles = true;
+               }
+               if (reusesTiles) expectedBarriers++;
+            }
+            barriersMatch = barriersMatch && numBarriers[tiled] == expectedBarriers;
+         }
+
+         const double MB = 1024.0 * 1024.0;
+         unsigned long long tiledBytes = stats[1].committedBytes + stats[1].tilePoolBytes;
+         out << "  " << resolutions[i][0] << "x" << resolutions[i][1]
+             << " transients=" << stats[0].numTransients << " declared MB=" << stats[0].declaredBytes / MB
+             << " committed MB=" << stats[0].committedBytes / MB
+             << " saved=" << 100.0 * (1.0 - (double)stats[0].committedBytes / stats[0].declaredBytes) << "%\n";
+         out << "    tiled: committed MB=" << stats[1].committedBytes / MB << " tile pool MB=" << stats[1].tilePoolBytes / MB
+             << " saved=" << 100.0 * (1.0 - (double)tiledBytes / stats[0].declaredBytes) << "%"
+             << " barriers=" << numBarriers[1] << "\n";
+      }
+      Check(allCompiled, "the frame graph compiles committed and tiled", &results, out);
+      Check(onlyColorTiled, "depth and volume transients stay committed", &results, out);
+      Check(withinPool, "every tiled texture is mapped whole inside the pool", &results, out);
+      Check(disjointTiles, "transients that live at the same time never share tiles", &results, out);
+      Check(barriersMatch, "a barrier goes in front of every texture reusing tiles, none without tiling", &results, out);
+      out << "  checks passed=" << results.numChecks - results.numFailed << " of " << results.numChecks << "\n";
+   }
+
+   // Test scene in the spirit of an atrium: a few meshes repeated along
+   // the walls. Every source mesh after the first NUM_SHAPES is an exporter
+   // copy of one of the shapes, and nodes reference meshes several times.
+   void RunInstancingBenchmark(ostream &out)
+   {
+      out << "instancing: deduplicated meshes drawn with DrawIndexedInstanced\n";
+
+      const unsigned int NUM_SHAPES = 6;
+      const unsigned int NUM_SOURCE_MESHES = 48;
+      const unsigned int INSTANCES_PER_MESH = 8;
+      const unsigned int FLOATS_PER_VERTEX = 10;
+
+      vector<vector<float> > shapeVertices(NUM_SHAPES);
+      vector<vector<unsigned int> > shapeIndices(NUM_SHAPES);
+      for (unsigned int shape = 0; shape < NUM_SHAPES; shape++)
+      {
+         unsigned int numVertices = 500 + 1500 * shape;
+         shapeVertices[shape].resize(numVertices * FLOATS_PER_VERTEX);
+         for (size_t v = 0; v < shapeVertices[shape].size(); v++)
+         {
+            shapeVertices[shape][v] = (float)((v * 31 + shape * 7) % 1000) * 0.01f;
+         }
+         shapeIndices[shape].resize(numVertices * 3);
+         for (size_t i = 0; i < shapeIndices[shape].size(); i++)
+         {
+            shapeIndices[shape][i] = (unsigned int)((i * 17) % numVertices);
+         }
+      }
+
+      MeshDeduplicator meshes;
+      vector<MeshInstance> instances;
+      for (unsigned int source = 0; source < NUM_SOURCE_MESHES; source++)
+      {
+         unsigned int shape = source % NUM_SHAPES;
+         bool isNew = false;
+         unsigned int mesh = meshes.Add(&shapeVertices[shape][0], (unsigned int)(shapeVertices[shape].size() * sizeof(float)),
+            &shapeIndices[shape][0], (unsigned int)shapeIndices[shape].size(), shape % 2, &isNew);
+
+         for (unsigned int i = 0; i < INSTANCES_PER_MESH; i++)
+         {
+            MeshInstance instance;
+            memset(&instance.world, 0, sizeof(instance.world));
+            instance.world.m[0] = instance.world.m[5] = instance.world.m[10] = instance.world.m[15] = 1.0f;
+            instance.world.m[12] = (float)(source * INSTANCES_PER_MESH + i);
+            instance.mesh = mesh;
+            instances.push_back(instance);
+         }
+      }
+
+      CpuTimer batchTimer;
+      vector<InstanceTransform> transforms;
+      vector<InstanceBatch> batches;
+      BuildInstanceBatches(instances, &transforms, &batches);
+      double batchMs = batchTimer.GetElapsedMs();
+
+      InstancingStats stats = GetInstancingStats(meshes, instances);
+      const double MB = 1024.0 * 1024.0;
+      out << "  source meshes=" << stats.numSourceMeshes << " unique meshes=" << stats.numUniqueMeshes
+          << " instances=" << stats.numInstances << " batch ms=" << batchMs << "\n";
+      out << "  vertex MB pretransformed=" << stats.pretransformedVertexBytes / MB
+          << " instanced=" << stats.instancedVertexBytes / MB
+          << " saved=" << (stats.pretransformedVertexBytes - stats.instancedVertexBytes) / MB << "\n";
+      out << "  draw calls per pass pretransformed=" << stats.numInstances << " instanced=" << batches.size()
+          << " eliminated=" << stats.numInstances - batches.size() << "\n";
+   }
+
+   // Grid of instances around a camera at the origin looking down +z with a
+   // 90 degree field of view. The reference culling is checked against a
+   // direct count of the instances inside the frustum.
+   void RunGpuCullingBenchmark(ostream &out)
+   {
+      out << "gpu_culling: CPU reference of CullCS.hlsl\n";
+
+      const unsigned int NUM_MESHES = 16;
+      const unsigned int GRID_SIZE = 64;
+      const float SPACING = 4.0f;
+      const float NEAR_Z = 1.0f;
+      const float FAR_Z = 200.0f;
+
+      vector<BoundingSphere> meshBounds(NUM_MESHES);
+      for (unsigned int mesh = 0; mesh < NUM_MESHES; mesh++)
+      {
+         BoundingSphere bounds = { { 0.0f, 0.0f, 0.0f }, 0.5f + 0.1f * mesh };
+         meshBounds[mesh] = bounds;
+      }
+
+      vector<MeshInstance> instances;
+      for (unsigned int z = 0; z < GRID_SIZE; z++)
+      {
+         for (unsigned int x = 0; x < GRID_SIZE; x++)
+         {
+            MeshInstance instance;
+            memset(&instance.world, 0, sizeof(instance.world));
+            instance.world.m[0] = instance.world.m[5] = instance.world.m[10] = instance.world.m[15] = 1.0f;
+            instance.world.m[12] = ((float)x - GRID_SIZE * 0.5f) * SPACING;
+            instance.world.m[13] = (float)((x * 7 + z * 3) % 9) - 4.0f;
+            instance.world.m[14] = ((float)z - GRID_SIZE * 0.5f) * SPACING;
+            instance.mesh = (x + z * 5) % NUM_MESHES;
+            instances.push_back(instance);
+         }
+      }
+
+      vector<InstanceTransform> transforms;
+      vector<InstanceBatch> batches;
+      BuildInstanceBatches(instances, &transforms, &batches);
+      vector<CullInstance> cullInstances;
+      BuildCullInstances(batches, transforms, meshBounds, &cullInstances);
+
+      // Row vector perspective projection, D3D's 0 to 1 depth range
+      float viewProj[16] = { 0 };
+      viewProj[0] = 1.0f;
+      viewProj[5] = 1.0f;
+      viewProj[10] = FAR_Z / (FAR_Z - NEAR_Z);
+      viewProj[11] = 1.0f;
+      viewProj[14] = -NEAR_Z * FAR_Z / (FAR_Z - NEAR_Z);
+      FrustumPlanes frustum;
+      ExtractFrustumPlanes(viewProj, &frustum);
+
+      vector<IndirectDrawArgs> argsTemplate(batches.size());
+      for (size_t draw = 0; draw < batches.size(); draw++)
+      {
+         IndirectDrawArgs args = { 36, 0, 0, 0, batches[draw].firstInstance };
+         argsTemplate[draw] = args;
+      }
+
+      vector<IndirectDrawArgs> args;
+      vector<InstanceTransform> visible;
+      CpuTimer timer;
+      for (unsigned int frame = 0; frame < NUM_BENCHMARK_FRAMES; frame++)
+      {
+         args = argsTemplate;
+         CullInstancesReference(cullInstances, frustum, &args, &visible);
+      }
+      double cullMs = timer.GetElapsedMs() / NUM_BENCHMARK_FRAMES;
+
+      unsigned int numVisible = 0;
+      unsigned int numMismatches = 0;
+      for (size_t draw = 0; draw < batches.size(); draw++)
+      {
+         const InstanceBatch &batch = batches[draw];
+         unsigned int expected = 0;
+         for (unsigned int i = batch.firstInstance; i < batch.firstInstance + batch.numInstances; i++)
+         {
+            // The side planes are at 45 degrees, a sphere is outside once
+            // its center is further than radius * sqrt(2) past |x| = z
+            const float *t = transforms[i].m;
+            float radius = meshBounds[batch.mesh].radius;
+            float slack = radius * sqrtf(2.0f);
+            bool inside = t[14] + radius >= NEAR_Z && t[14] - radius <= FAR_Z &&
+               t[12] - t[14] <= slack && -t[12] - t[14] <= slack &&
+               t[13] - t[14] <= slack && -t[13] - t[14] <= slack;
+            if (inside) expected++;
+         }
+         if (args[draw].instanceCount != expected) numMismatches++;
+         numVisible += args[draw].instanceCount;
+      }
+
+      out << "  instances=" << cullInstances.size() << " draws=" << batches.size()
+          << " visible=" << numVisible << " (" << 100.0 * numVisible / cullInstances.size() << "%)"
+          << " ms/frame=" << cullMs << " mismatched draws=" << numMismatches << "\n";
+   }
+
+   // texMain's light loop, lights contribute in the order they are visited
+   void AccumulateLight(const VirtualPointLight &light, const float pos[3], float color[3])
+   {
+      const float radius = (float)MAX_LIGHT_RADIUS;
+      float dx = pos[0] - light.position[0];
+      float dy = pos[1] - light.position[1];
+      float dz = pos[2] - light.position[2];
+      float dist = sqrtf(dx * dx + dy * dy + dz * dz);
+      if (dist < radius)
+      {
+         float lightFactor = (radius - dist) / radius;
+         for (unsigned int c = 0; c < 3; c++) color[c] += lightFactor * lightFactor * lightFactor * light.color[c];
+      }
+   }
+
+   // VPLs in BlurCS.hlsl's reference layout, one per block of the shadow map with the depth of a tilted floor and a box in the middle.
+   // Pixels are shaded with every VPL and with their tile's list only, the
+   // two have to agree exactly.
+   void RunLightBinningBenchmark(ostream &out)
+   {
+      out << "light_binning: CPU reference of LightBinCS.hlsl\n";
+
+      const unsigned int VPLS_X = REFERENCE_RSM_WIDTH / TILE_WIDTH;
+      const unsigned int VPLS_Y = REFERENCE_RSM_HEIGHT / TILE_HEIGHT;
+      vector<VirtualPointLight> lights(VPLS_X * VPLS_Y);
+      for (unsigned int y = 0; y < VPLS_Y; y++)
+      {
+         for (unsigned int x = 0; x < VPLS_X; x++)
+         {
+            VirtualPointLight &light = lights[y * VPLS_X + x];
+            float u = (x + 0.5f) / VPLS_X;
+            float v = (y + 0.5f) / VPLS_Y;
+            bool onBox = u > 0.35f && u < 0.65f && v > 0.35f && v < 0.65f;
+            light.position[0] = u;
+            light.position[1] = v;
+            light.position[2] = onBox ? 0.3f : 0.5f + 0.4f * v;
+            light.position[3] = 1.0f;
+            light.color[0] = 0.2f + 0.6f * u;
+            light.color[1] = 0.5f;
+            light.color[2] = 0.2f + 0.6f * v;
+            light.color[3] = 1.0f;
+         }
+      }
+
+      vector<LightGridTile> tiles;
+      vector<unsigned int> indices;
+      CpuTimer timer;
+      for (unsigned int frame = 0; frame < NUM_BENCHMARK_FRAMES; frame++)
+      {
+         BinLightsReference(lights, &tiles, &indices);
+      }
+      double binMs = timer.GetElapsedMs() / NUM_BENCHMARK_FRAMES;
+
+      // Pixels cover a margin around the shadow map so the edge tiles'
+      // unbounded sides are exercised too
+      const unsigned int PIXELS_X = 256;
+      const unsigned int PIXELS_Y = 192;
+      unsigned long long bruteForceLights = 0;
+      unsigned long long tiledLights = 0;
+      unsigned int numMismatches = 0;
+      for (unsigned int py = 0; py < PIXELS_Y; py++)
+      {
+         for (unsigned int px = 0; px < PIXELS_X; px++)
+         {
+            float pos[3];
+            pos[0] = -0.1f + 1.2f * (px + 0.5f) / PIXELS_X;
+            pos[1] = -0.1f + 1.2f * (py + 0.5f) / PIXELS_Y;
+            pos[2] = 0.5f + 0.4f * pos[1] + ((px * 13 + py * 7) % 5) * 0.05f - 0.1f;
+
+            float bruteForce[3] = { 0.0f, 0.0f, 0.0f };
+            for (unsigned int light = 0; light < lights.size(); light++)
+            {
+               AccumulateLight(lights[light], pos, bruteForce);
+            }
+            bruteForceLights += lights.size();
+
+            float tiled[3] = { 0.0f, 0.0f, 0.0f };
+            unsigned int tile = GetLightTile(pos[0], pos[1]);
+            const LightGridTile &header = tiles[tile];
+            if (pos[2] >= header.minDepth && pos[2] <= header.maxDepth)
+            {
+               for (unsigned int i = 0; i < header.numLights; i++)
+               {
+                  AccumulateLight(lights[indices[tile * MAX_LIGHTS_PER_TILE + i]], pos, tiled);
+               }
+               tiledLights += header.numLights;
+            }
+
+            if (memcmp(bruteForce, tiled, sizeof(tiled)) != 0) numMismatches++;
+         }
+      }
+
+      unsigned int maxLights = 0;
+      unsigned int totalLights = 0;
+      for (size_t tile = 0; tile < tiles.size(); tile++)
+      {
+         totalLights += tiles[tile].numLights;
+         if (tiles[tile].numLights > maxLights) maxLights = tiles[tile].numLights;
+      }
+
+      const unsigned int numPixels = PIXELS_X * PIXELS_Y;
+      out << "  vpls=" << lights.size() << " tiles=" << LIGHT_GRID_WIDTH << "x" << LIGHT_GRID_HEIGHT
+          << " bin ms=" << binMs << " mismatched pixels=" << numMismatches << "\n";
+      out << "  lights per tile avg=" << (double)totalLights / tiles.size() << " max=" << maxLights
+          << " lights per pixel brute force=" << (double)bruteForceLights / numPixels
+          << " tiled=" << (double)tiledLights / numPixels << "\n";
+
+      const unsigned int BUCKET_SIZE = 16;
+      vector<unsigned int> histogram;
+      BuildLightCountHistogram(tiles, BUCKET_SIZE, &histogram);
+      out << "  lights per tile histogram:\n";
+      for (unsigned int bucket = 0; bucket < histogram.size(); bucket++)
+      {
+         if (histogram[bucket] == 0) continue;
+         out << "    " << bucket * BUCKET_SIZE << "-" << (bucket + 1) * BUCKET_SIZE - 1 << ": "
+             << string(histogram[bucket], '#') << " " << histogram[bucket] << "\n";
+      }
+   }
+
+   // Lights scattered through a 200 unit box in front of a camera at the
+   // origin looking down +z. The SIMD path has to produce exactly the
+   // brute force lists.
+   void RunClusteredLightingBenchmark(ostream &out)
+   {
+      out << "clustered_lighting: CPU light to cluster assignment\n";
+
+      const float identity[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+      ClusterConstants constants;
+      SetupClusterConstants(identity, 3.14159265f / 3.0f, 4.0f / 3.0f, 0.5f, 400.0f, 1024, 768, 0, &constants);
+      ClusterBounds bounds;
+      ComputeClusterBounds(constants, &bounds);
+
+      const float boundsMin[3] = { -100.0f, -100.0f, 0.0f };
+      const float boundsMax[3] = { 100.0f, 100.0f, 200.0f };
+      const unsigned int lightCounts[] = { 256, 1024, 4096, 10000 };
+      const unsigned int NUM_FRAMES = 8;
+
+      for (unsigned int i = 0; i < sizeof(lightCounts) / sizeof(lightCounts[0]); i++)
+      {
+         vector<ClusterLight> lights;
+         CreateRandomLights(boundsMin, boundsMax, lightCounts[i], 8.0f, 7, &lights);
+         vector<ClusterLight> viewLights;
+         TransformLightsToView(lights, lightCounts[i], identity, &viewLights);
+
+         // Large enough that no list is cut short by the budget
+         const unsigned int maxIndices = NUM_CLUSTERS * MAX_LIGHTS_PER_CLUSTER;
+
+         ClusterAssignment assignment;
+         CpuTimer timer;
+         for (unsigned int frame = 0; frame < NUM_FRAMES; frame++)
+         {
+            AssignLightsToClusters(bounds, constants, viewLights, maxIndices, &assignment);
+         }
+         double assignMs = timer.GetElapsedMs() / NUM_FRAMES;
+
+         ClusterAssignment reference;
+         CpuTimer bruteForceTimer;
+         AssignLightsToClustersBruteForce(bounds, viewLights, maxIndices, &reference);
+         double bruteForceMs = bruteForceTimer.GetElapsedMs();
+
+         bool matches = assignment.lightIndices == reference.lightIndices &&
+            assignment.numDroppedLights == reference.numDroppedLights;
+         unsigned int maxLights = 0;
+         unsigned int numOccupied = 0;
+         for (unsigned int cluster = 0; cluster < NUM_CLUSTERS; cluster++)
+         {
+            const ClusterHeader &header = assignment.clusters[cluster];
+            const ClusterHeader &expected = reference.clusters[cluster];
+            matches = matches && header.offset == expected.offset && header.numLights == expected.numLights;
+            if (header.numLights > maxLights) maxLights = header.numLights;
+            if (header.numLights > 0) numOccupied++;
+         }
+
+         out << "  lights=" << lightCounts[i] << " assign ms=" << assignMs << " brute force ms=" << bruteForceMs
+             << " indices=" << assignment.lightIndices.size()
+             << " occupied clusters=" << numOccupied << "/" << NUM_CLUSTERS
+             << " max per cluster=" << maxLights << " dropped=" << assignment.numDroppedLights
+             << (matches ? " matches" : " MISMATCH") << "\n";
+      }
+   }
+
+   // Relative RMS error of the VPLs' lighting at the receivers against the
+   // reference, luminance only
+   double GetLightingError(const vector<VirtualPointLight> &lights, const vector<VirtualPointLight> &receivers,
+      const vector<double> &reference)
+   {
+      double squaredError = 0.0;
+      double referenceSum = 0.0;
+      for (size_t r = 0; r < receivers.size(); r++)
+      {
+         float color[3] = { 0.0f, 0.0f, 0.0f };
+         for (size_t light = 0; light < lights.size(); light++)
+         {
+            AccumulateLight(lights[light], receivers[r].position, color);
+         }
+         double luminance = 0.2126 * color[0] + 0.7152 * color[1] + 0.0722 * color[2];
+         squaredError += (luminance - reference[r]) * (luminance - reference[r]);
+         referenceSum += reference[r];
+      }
+      return referenceSum > 0.0 ? sqrt(squaredError / receivers.size()) / (referenceSum / receivers.size()) : 0.0;
+   }
+
+   // Lighting error of importance sampled and uniformly placed VPLs at
+   // several counts. The reference treats every texel of the map as a VPL,
+   // which is what both estimate. Runs on RSM_CAPTURE_FILE if the renderer
+   // captured one, a made up scene otherwise.
+   void RunVplSamplingBenchmark(ostream &out)
+   {
+      out << "vpl_sampling: importance sampled VPLs against a uniform grid\n";
+
+      ReflectiveShadowMap rsm;
+      bool captured = LoadReflectiveShadowMap(RSM_CAPTURE_FILE, &rsm);
+      if (!captured) CreateSyntheticReflectiveShadowMap(512, 384, &rsm);
+      out << "  rsm=" << (captured ? RSM_CAPTURE_FILE : "synthetic") << " " << rsm.width << "x" << rsm.height
+          << " total flux=" << ComputeTotalFlux(rsm) << "\n";
+
+      vector<VirtualPointLight> texels;
+      SampleVplsUniform(rsm, 1, &texels);
+
+      // Receivers on a grid of the map's own surface, lit by the texels
+      // within MAX_LIGHT_RADIUS in UV
+      const unsigned int RECEIVERS_X = 32;
+      const unsigned int RECEIVERS_Y = 24;
+      const float radius = (float)MAX_LIGHT_RADIUS;
+      vector<VirtualPointLight> receivers;
+      vector<double> reference;
+      for (unsigned int ry = 0; ry < RECEIVERS_Y; ry++)
+      {
+         for (unsigned int rx = 0; rx < RECEIVERS_X; rx++)
+         {
+            unsigned int x = (rx * 2 + 1) * rsm.width / (RECEIVERS_X * 2);
+            unsigned int y = (ry * 2 + 1) * rsm.height / (RECEIVERS_Y * 2);
+            const VirtualPointLight &receiver = texels[y * rsm.width + x];
+
+            int minX = (int)((receiver.position[0] - radius) * rsm.width) - 1;
+            int maxX = (int)((receiver.position[0] + radius) * rsm.width) + 1;
+            int minY = (int)((receiver.position[1] - radius) * rsm.height) - 1;
+            int maxY = (int)((receiver.position[1] + radius) * rsm.height) + 1;
+            if (minX < 0) minX = 0;
+            if (minY < 0) minY = 0;
+            if (maxX > (int)rsm.width - 1) maxX = (int)rsm.width - 1;
+            if (maxY > (int)rsm.height - 1) maxY = (int)rsm.height - 1;
+
+            float color[3] = { 0.0f, 0.0f, 0.0f };
+            for (int ty = minY; ty <= maxY; ty++)
+            {
+               for (int tx = minX; tx <= maxX; tx++)
+               {
+                  AccumulateLight(texels[ty * rsm.width + tx], receiver.position, color);
+               }
+            }
+            receivers.push_back(receiver);
+            reference.push_back(0.2126 * color[0] + 0.7152 * color[1] + 0.0722 * color[2]);
+         }
+      }
+
+      const unsigned int targetCounts[] = { 256, 768, 2048, MAX_VPLS };
+      const unsigned int NUM_SEEDS = 4;
+      unsigned int numTexels = rsm.width * rsm.height;
+      for (unsigned int i = 0; i < sizeof(targetCounts) / sizeof(targetCounts[0]); i++)
+      {
+         unsigned int blockSize = (unsigned int)(sqrt((double)numTexels / targetCounts[i]) + 0.5);
+         if (blockSize == 0) blockSize = 1;
+         vector<VirtualPointLight> uniform;
+         SampleVplsUniform(rsm, blockSize, &uniform);
+         double uniformError = GetLightingError(uniform, receivers, reference);
+
+         double importanceError = 0.0;
+         double sampleMs = 0.0;
+         size_t numImportance = 0;
+         for (unsigned int seed = 0; seed < NUM_SEEDS; seed++)
+         {
+            vector<VirtualPointLight> lights;
+            CpuTimer timer;
+            SampleVplsReference(rsm, targetCounts[i], seed, &lights);
+            sampleMs += timer.GetElapsedMs();
+            importanceError += GetLightingError(lights, receivers, reference);
+            numImportance += lights.size();
+         }
+
+         out << "  target=" << targetCounts[i] << " uniform vpls=" << uniform.size()
+             << " error=" << 100.0 * uniformError << "%"
+             << " importance vpls=" << numImportance / NUM_SEEDS
+             << " error=" << 100.0 * importanceError / NUM_SEEDS << "%"
+             << " sample ms=" << sampleMs / NUM_SEEDS << "\n";
+      }
+   }
+
+   // GaussianBlurCS.hlsl's passes on the light map of the captured or
+   // synthetic reflective shadow map, as a light map would be filtered
+   // offline. The SIMD passes have to match the reference exactly. A graph
+   // with one bilateral blur checks the passes' declaration and dispatches.
+   void RunSeparableBlurBenchmark(ostream &out)
+   {
+      out << "separable_blur: CPU versions of GaussianBlurCS.hlsl\n";
+
+      ReflectiveShadowMap rsm;
+      bool captured = LoadReflectiveShadowMap(RSM_CAPTURE_FILE, &rsm);
+      if (!captured) CreateSyntheticReflectiveShadowMap(REFERENCE_RSM_WIDTH, REFERENCE_RSM_HEIGHT, &rsm);
+      RgbaImage lightMap;
+      lightMap.width = rsm.width;
+      lightMap.height = rsm.height;
+      lightMap.texels = rsm.flux;
+      out << "  rsm=" << (captured ? RSM_CAPTURE_FILE : "synthetic") << " " << rsm.width << "x" << rsm.height << "\n";
+
+      struct BlurSetup
+      {
+         unsigned int radius;
+         float sigma;
+         bool bilateral;
+      };
+      const BlurSetup setups[] = { { 4, 2.0f, false }, { 8, 4.0f, false }, { 8, 4.0f, true }, { MAX_BLUR_RADIUS, 8.0f, true } };
+      const float DEPTH_SIGMA = 0.02f;
+      const unsigned int NUM_FRAMES = 4;
+
+      for (unsigned int i = 0; i < sizeof(setups) / sizeof(setups[0]); i++)
+      {
+         BlurConstants constants;
+         SetupBlurConstants(rsm.width, rsm.height, setups[i].radius, setups[i].sigma, setups[i].bilateral, DEPTH_SIGMA,
+            &constants);
+         BlurConstants verticalConstants = constants;
+         verticalConstants.horizontal = 0;
+
+         RgbaImage rows, reference;
+         CpuTimer referenceTimer;
+         for (unsigned int frame = 0; frame < NUM_FRAMES; frame++)
+         {
+            BlurPassReference(lightMap, rsm.depth, constants, &rows);
+            BlurPassReference(rows, rsm.depth, verticalConstants, &reference);
+         }
+         double referenceMs = referenceTimer.GetElapsedMs() / NUM_FRAMES;
+
+         RgbaImage blurred;
+         CpuTimer simdTimer;
+         for (unsigned int frame = 0; frame < NUM_FRAMES; frame++)
+         {
+            SeparableBlur(lightMap, rsm.depth, setups[i].radius, setups[i].sigma, setups[i].bilateral, DEPTH_SIGMA,
+               &blurred);
+         }
+         double simdMs = simdTimer.GetElapsedMs() / NUM_FRAMES;
+
+         unsigned int numMismatches = 0;
+         for (size_t t = 0; t < reference.texels.size(); t++)
+         {
+            if (blurred.texels[t] != reference.texels[t]) numMismatches++;
+         }
+
+         out << "  radius=" << setups[i].radius << " sigma=" << setups[i].sigma
+             << (setups[i].bilateral ? " bilateral" : "") << " reference ms=" << referenceMs
+             << " simd ms=" << simdMs << " mismatched values=" << numMismatches << "\n";
+      }
+
+      ScenePassResources res;
+      vector<SceneDrawItem> items;
+      CreateSyntheticScene(1, &res, &items);
+
+      RenderGraph graph;
+      RenderGraphViews sourceViews = { 600001, NULL_HANDLE, NULL_HANDLE, NULL_HANDLE };
+      RenderGraphViews depthViews = { 600002, NULL_HANDLE, NULL_HANDLE, NULL_HANDLE };
+      RenderGraphViews destViews = { NULL_HANDLE, NULL_HANDLE, NULL_HANDLE, 600003 };
+      RenderGraphResource source = graph.ImportResource("LightMap", sourceViews);
+      RenderGraphResource depth = graph.ImportResource("Depth", depthViews);
+      RenderGraphResource dest = graph.ImportResource("BlurredLightMap", destViews);
+      graph.MarkOutput(dest);
+
+      RenderGraphTextureDesc desc = { rsm.width, rsm.height, 1, GRAPH_FORMAT_RGBA32_FLOAT };
+      SeparableBlurPasses blurPasses;
+      DeclareSeparableBlur(&graph, "LightMap", source, &depth, dest, desc, &blurPasses);
+
+      BlurConstants constants;
+      SetupBlurConstants(rsm.width, rsm.height, 8, 4.0f, true, DEPTH_SIGMA, &constants);
+      BlurConstants verticalConstants = constants;
+      verticalConstants.horizontal = 0;
+      graph.SetPassCallback(blurPasses.horizontal, [&res, &constants](CommandBuffer *pCmds)
+      {
+         RecordBlurPass(pCmds, res, constants);
+      });
+      graph.SetPassCallback(blurPasses.vertical, [&res, &verticalConstants](CommandBuffer *pCmds)
+      {
+         RecordBlurPass(pCmds, res, verticalConstants);
+      });
+
+      string errors;
+      bool compiled = graph.Compile(&errors);
+      AssignSyntheticViews(&graph, 700000);
+      CommandBuffer cmds;
+      graph.Execute(&cmds);
+      NullCommandBackend backend;
+      backend.Execute(cmds);
+
+      out << "  graph " << (compiled ? "compiled" : errors) << ", " << graph.GetSchedule().size() << " passes, "
+          << backend.GetStats().numThreadGroups << " thread groups of " << BLUR_PASS_GROUP_SIZE << "\n";
+   }
+
+   // Row vector view to world matrix of a camera at position turned by yaw
+   // around y
+   void SetCameraToWorld(float yaw, const float position[3], float invView[16])
+   {
+      memset(invView, 0, 16 * sizeof(float));
+      invView[0] = cosf(yaw);
+      invView[2] = -sinf(yaw);
+      invView[5] = 1.0f;
+      invView[8] = sinf(yaw);
+      invView[10] = cosf(yaw);
+      for (unsigned int i = 0; i < 3; i++) invView[12 + i] = position[i];
+      invView[15] = 1.0f;
+   }
+
+   void TransformPoint(const float m[16], const float p[3], float result[3])
+   {
+      for (unsigned int c = 0; c < 3; c++)
+      {
+         result[c] = p[0] * m[c] + p[1] * m[4 + c] + p[2] * m[8 + c] + m[12 + c];
+      }
+   }
+
+   // ShadowCascades' split and fit math. The checks stand in for unit tests:
+   // every slice has to be inside its cascade, cascades keep their size while
+   // the camera turns and move in whole texels while it moves, and the
+   // per-cascade culling must keep every draw a cascade needs.
+   void RunShadowCascadesBenchmark(ostream &out)
+   {
+      out << "shadow_cascades: split and fit of ShadowCascades.h\n";
+
+      const float FOV_Y = 3.14f / 2.0f;
+      const float ASPECT = 4.0f / 3.0f;
+      const float NEAR_Z = 1.0f;
+      const float SHADOW_DISTANCE = 400.0f;
+      const float CASTER_DISTANCE = 400.0f;
+      const float LAMBDA = 0.75f;
+      float lightDir[3] = { 0.3f, 0.9f, 0.3f };
+      float length = sqrtf(lightDir[0] * lightDir[0] + lightDir[1] * lightDir[1] + lightDir[2] * lightDir[2]);
+      for (unsigned int i = 0; i < 3; i++) lightDir[i] /= length;
+
+      float splits[NUM_SHADOW_CASCADES];
+      ComputeCascadeSplits(NEAR_Z, SHADOW_DISTANCE, LAMBDA, splits);
+      out << "  splits";
+      for (unsigned int c = 0; c < NUM_SHADOW_CASCADES; c++) out << " " << splits[c];
+      out << "\n";
+
+      float tanHalfFovY = tanf(FOV_Y * 0.5f);
+      float tanHalfFovX = tanHalfFovY * ASPECT;
+      const unsigned int NUM_STEPS = 256;
+      unsigned int numCornersOutside = 0;
+      float minTexelSize[NUM_SHADOW_CASCADES];
+      float maxTexelSize[NUM_SHADOW_CASCADES];
+      float maxTexelError = 0.0f;
+      float previousTexel[NUM_SHADOW_CASCADES][2];
+      const float probe[3] = { 3.0f, 0.0f, 40.0f };
+
+      CpuTimer timer;
+      for (unsigned int step = 0; step < NUM_STEPS; step++)
+      {
+         // Turns for the first half, then walks forward by a fraction of a
+         // texel per step
+         float yaw = step < NUM_STEPS / 2 ? 0.05f * step : 0.0f;
+         float position[3] = { 0.0f, 2.0f, step < NUM_STEPS / 2 ? 0.0f : 0.037f * (step - NUM_STEPS / 2) };
+         float invView[16];
+         SetCameraToWorld(yaw, position, invView);
+
+         ShadowCascade cascades[NUM_SHADOW_CASCADES];
+         FitShadowCascades(invView, FOV_Y, ASPECT, NEAR_Z, SHADOW_DISTANCE, LAMBDA, lightDir, CASTER_DISTANCE,
+            DEFAULT_SHADOW_CASCADE_SIZE, cascades);
+
+         for (unsigned int c = 0; c < NUM_SHADOW_CASCADES; c++)
+         {
+            const ShadowCascade &cascade = cascades[c];
+            if (step == 0 || cascade.texelSize < minTexelSize[c]) minTexelSize[c] = cascade.texelSize;
+            if (step == 0 || cascade.texelSize > maxTexelSize[c]) maxTexelSize[c] = cascade.texelSize;
+
+            float splitZ[2] = { cascade.nearSplit, cascade.farSplit };
+            for (unsigned int corner = 0; corner < 8; corner++)
+            {
+               float z = splitZ[corner >> 2];
+               float viewPos[3] = { (corner & 1 ? 1.0f : -1.0f) * tanHalfFovX * z,
+                                    (corner & 2 ? 1.0f : -1.0f) * tanHalfFovY * z, z };
+               float worldPos[3], clip[3];
+               TransformPoint(invView, viewPos, worldPos);
+               TransformPoint(cascade.viewProj, worldPos, clip);
+               const float EPSILON = 1e-4f;
+               if (fabsf(clip[0]) > 1.0f + EPSILON || fabsf(clip[1]) > 1.0f + EPSILON ||
+                   clip[2] < -EPSILON || clip[2] > 1.0f + EPSILON)
+               {
+                  numCornersOutside++;
+               }
+            }
+
+            // A fixed point has to land on the same spot within its texel
+            // every frame the camera only moved
+            float clip[3];
+            TransformPoint(cascade.viewProj, probe, clip);
+            float texel[2] = { (clip[0] * 0.5f + 0.5f) * cascade.resolution,
+               (clip[1] * 0.5f + 0.5f) * cascade.resolution };
+            if (step > NUM_STEPS / 2)
+            {
+               for (unsigned int i = 0; i < 2; i++)
+               {
+                  float moved = texel[i] - previousTexel[c][i];
+                  float error = fabsf(moved - floorf(moved + 0.5f));
+                  if (error > maxTexelError) maxTexelError = error;
+               }
+            }
+            previousTexel[c][0] = texel[0];
+            previousTexel[c][1] = texel[1];
+         }
+      }
+      double fitMs = timer.GetElapsedMs() / NUM_STEPS;
+
+      // The single map it replaces, a 90 degree perspective from 2000 units
+      // away over 1024 texels
+      float singleMapTexel = 2.0f * 2000.0f / 1024.0f;
+      out << "  fit ms=" << fitMs << " slice corners outside=" << numCornersOutside
+          << " max texel snap error=" << maxTexelError << "\n";
+      for (unsigned int c = 0; c < NUM_SHADOW_CASCADES; c++)
+      {
+         out << "  cascade " << c << " texel=" << minTexelSize[c] << " (varies by "
+             << maxTexelSize[c] - minTexelSize[c] << ", " << singleMapTexel / minTexelSize[c]
+             << "x the single map's density)\n";
+      }
+
+      // Grid of objects around the camera, each cascade should only draw
+      // what falls into its slice or shadows it
+      const unsigned int NUM_MESHES = 16;
+      const unsigned int GRID_SIZE = 64;
+      const float SPACING = 12.0f;
+      vector<BoundingSphere> meshBounds(NUM_MESHES);
+      for (unsigned int mesh = 0; mesh < NUM_MESHES; mesh++)
+      {
+         BoundingSphere bounds = { { 0.0f, 0.0f, 0.0f }, 1.0f + 0.2f * mesh };
+         meshBounds[mesh] = bounds;
+      }
+      vector<MeshInstance> instances;
+      for (unsigned int z = 0; z < GRID_SIZE; z++)
+      {
+         for (unsigned int x = 0; x < GRID_SIZE; x++)
+         {
+            MeshInstance instance;
+            memset(&instance.world, 0, sizeof(instance.world));
+            instance.world.m[0] = instance.world.m[5] = instance.world.m[10] = instance.world.m[15] = 1.0f;
+            instance.world.m[12] = ((float)x - GRID_SIZE * 0.5f) * SPACING;
+            instance.world.m[13] = (float)((x * 7 + z * 3) % 9);
+            instance.world.m[14] = ((float)z - GRID_SIZE * 0.5f) * SPACING;
+            instance.mesh = (x + z * 5) % NUM_MESHES;
+            instances.push_back(instance);
+         }
+      }
+      vector<InstanceTransform> transforms;
+      vector<InstanceBatch> batches;
+      BuildInstanceBatches(instances, &transforms, &batches);
+      vector<CullInstance> cullInstances;
+      BuildCullInstances(batches, transforms, meshBounds, &cullInstances);
+
+      float invView[16];
+      float position[3] = { 0.0f, 2.0f, 0.0f };
+      SetCameraToWorld(0.3f, position, invView);
+      ShadowCascade cascades[NUM_SHADOW_CASCADES];
+      FitShadowCascades(invView, FOV_Y, ASPECT, NEAR_Z, SHADOW_DISTANCE, LAMBDA, lightDir, CASTER_DISTANCE,
+         DEFAULT_SHADOW_CASCADE_SIZE, cascades);
+
+      vector<unsigned int> drawMasks;
+      CpuTimer cullTimer;
+      for (unsigned int frame = 0; frame < NUM_BENCHMARK_FRAMES; frame++)
+      {
+         CullCascadeDraws(cullInstances, cascades, (unsigned int)batches.size(), &drawMasks);
+      }
+      double cullMs = cullTimer.GetElapsedMs() / NUM_BENCHMARK_FRAMES;
+
+      // Brute force check, an instance touching a cascade has to have its
+      // draw's bit set
+      unsigned int numMissed = 0;
+      for (size_t i = 0; i < cullInstances.size(); i++)
+      {
+         for (unsigned int c = 0; c < NUM_SHADOW_CASCADES; c++)
+         {
+            if (SphereInFrustum(cascades[c].frustum, cullInstances[i].bounds) &&
+                !(drawMasks[cullInstances[i].drawIndex] & (1 << c)))
+            {
+               numMissed++;
+            }
+         }
+      }
+
+      out << "  culling ms=" << cullMs << " draws=" << batches.size() << " missed=" << numMissed << ", per cascade";
+      for (unsigned int c = 0; c < NUM_SHADOW_CASCADES; c++)
+      {
+         unsigned int numDraws = 0;
+         unsigned int numInstances = 0;
+         for (size_t i = 0; i < cullInstances.size(); i++)
+         {
+            if (SphereInFrustum(cascades[c].frustum, cullInstances[i].bounds)) numInstances++;
+         }
+         for (size_t draw = 0; draw < drawMasks.size(); draw++)
+         {
+            if (drawMasks[draw] & (1 << c)) numDraws++;
+         }
+         out << " " << numDraws << " draws/" << numInstances << " instances";
+      }
+      out << " of " << cullInstances.size() << "\n";
+   }
+
+   // Cascade shaped like a lit floor with a rotated box and a pole in
+   // front of it, depth 1 where nothing is in the way
+   void CreateSyntheticShadowMap(unsigned int size, ShadowDepthMap *pMap)
+   {
+      pMap->width = pMap->height = size;
+      pMap->depth.resize(size * size);
+      for (unsigned int y = 0; y < size; y++)
+      {
+         for (unsigned int x = 0; x < size; x++)
+         {
+            float u = (x + 0.5f) / size - 0.5f;
+            float v = (y + 0.5f) / size - 0.5f;
+            float boxU = 0.8f * u + 0.6f * v;
+            float boxV = -0.6f * u + 0.8f * v;
+            float depth = 1.0f;
+            if (fabsf(boxU) < 0.2f && fabsf(boxV) < 0.12f) depth = 0.3f;
+            if ((u - 0.3f) * (u - 0.3f) + (v + 0.3f) * (v + 0.3f) < 0.0025f) depth = 0.2f;
+            pMap->depth[y * size + x] = depth;
+         }
+      }
+   }
+
+   // ShadowFilter.h's CPU versions of the cascade filtering on a receiver
+   // magnified so a texel covers several pixels, where the old point taps
+   // step. The PCF taps have to add up to the brute force filter within the
+   // hardware's weight precision, which is also the tolerance GPU captures
+   // are diffed with.
+   void RunShadowFilterBenchmark(ostream &out)
+   {
+      out << "shadow_filter: PCF of PlainPixel.hlsl against the point taps it replaced\n";
+
+      const unsigned int MAP_SIZE = 1024;
+      const unsigned int IMAGE_SIZE = 512;
+      const float TEXELS_PER_PIXEL = 0.3f;
+      const float RECEIVER_DEPTH = 0.5f;
+      const float DIFF_TOLERANCE = 4.0f / 256.0f;
+
+      ShadowDepthMap map;
+      CreateSyntheticShadowMap(MAP_SIZE, &map);
+      // Centered on an edge of the box
+      float originX = 0.66f * MAP_SIZE - 0.5f * IMAGE_SIZE * TEXELS_PER_PIXEL;
+      float originY = 0.62f * MAP_SIZE - 0.5f * IMAGE_SIZE * TEXELS_PER_PIXEL;
+
+      for (unsigned int filter = 0; filter <= MAX_SHADOW_PCF_TAPS_SQRT; filter++)
+      {
+         vector<float> image(IMAGE_SIZE * IMAGE_SIZE);
+         vector<float> bruteForce;
+         if (filter > 0) bruteForce.resize(image.size());
+
+         CpuTimer timer;
+         for (unsigned int y = 0; y < IMAGE_SIZE; y++)
+         {
+            for (unsigned int x = 0; x < IMAGE_SIZE; x++)
+            {
+               float texelX = originX + (x + 0.5f) * TEXELS_PER_PIXEL;
+               float texelY = originY + (y + 0.5f) * TEXELS_PER_PIXEL;
+               image[y * IMAGE_SIZE + x] = filter == 0 ?
+                  FilterShadowPointTaps(map, texelX, texelY, RECEIVER_DEPTH, 3) :
+                  FilterShadowPcf(map, texelX, texelY, RECEIVER_DEPTH, filter);
+            }
+         }
+         double filterMs = timer.GetElapsedMs();
+
+         for (size_t i = 0; i < bruteForce.size(); i++)
+         {
+            float texelX = originX + (i % IMAGE_SIZE + 0.5f) * TEXELS_PER_PIXEL;
+            float texelY = originY + (i / IMAGE_SIZE + 0.5f) * TEXELS_PER_PIXEL;
+            bruteForce[i] = FilterShadowPcfBruteForce(map, texelX, texelY, RECEIVER_DEPTH, filter);
+         }
+
+         // Largest change between neighboring pixels, the point taps jump by
+         // a ninth wherever a texel boundary passes
+         float maxStep = 0.0f;
+         for (unsigned int y = 0; y < IMAGE_SIZE; y++)
+         {
+            for (unsigned int x = 1; x < IMAGE_SIZE; x++)
+            {
+               float step = fabsf(image[y * IMAGE_SIZE + x] - image[y * IMAGE_SIZE + x - 1]);
+               if (step > maxStep) maxStep = step;
+            }
+         }
+
+         if (filter == 0)
+         {
+            out << "  3x3 point taps: taps=9 ms=" << filterMs << " max step=" << maxStep << "\n";
+         }
+         else
+         {
+            out << "  pcf " << filter << "x" << filter << ": taps=" << filter * filter << " footprint=" << 2 * filter
+                << " texels ms=" << filterMs << " max step=" << maxStep << " differing from brute force="
+                << 100.0f * CompareShadowImages(image, bruteForce, DIFF_TOLERANCE) << "%\n";
+         }
+      }
+   }
+
+   float ComputeMean(const RgbaImage &image, unsigned int channel)
+   {
+      double sum = 0.0;
+      for (size_t i = channel; i < image.texels.size(); i += 4) sum += image.texels[i];
+      return (float)(sum / (image.width * image.height));
+   }
+
+   // Evsm.h's moment math checked like unit tests would, then the synthetic
+   // map filtered with EVSM against PCF on a magnified receiver and on a
+   // minified one, where the ground truth is the average of the point
+   // comparisons under each pixel and only the prefiltered moments follow it
+   void RunEvsmBenchmark(ostream &out)
+   {
+      out << "evsm: moment math and prefiltered EVSM against PCF\n";
+
+      EvsmSettings settings;
+      GetDefaultEvsmSettings(&settings);
+      EvsmSettings unreduced = settings;
+      unreduced.lightBleedReduction = 0.0f;
+
+      CheckResults results = { 0, 0 };
+      float occluder[4];
+      ComputeEvsmMoments(0.4f, settings, occluder);
+      Check(EvsmVisibility(occluder, 0.4f, unreduced) == 1.0f, "receiver at the occluder's depth is lit", &results, out);
+      Check(EvsmVisibility(occluder, 0.2f, unreduced) == 1.0f, "receiver in front of the occluder is lit", &results, out);
+      Check(EvsmVisibility(occluder, 0.6f, unreduced) < 0.01f, "receiver behind the occluder is shadowed", &results, out);
+      Check(EvsmVisibility(occluder, 0.41f, settings) <= EvsmVisibility(occluder, 0.41f, unreduced),
+         "light bleeding reduction only darkens", &results, out);
+
+      EvsmSettings overflowing = settings;
+      overflowing.positiveExponent = 100.0f;
+      float farthest[4];
+      ComputeEvsmMoments(1.0f, overflowing, farthest);
+      Check(farthest[1] <= FLT_MAX, "exponents are clamped so the squared moments stay finite", &results, out);
+
+      // Two depths mixed in random proportions, the bound can never be
+      // below the fraction actually in front of the receiver
+      unsigned int seed = 12345;
+      unsigned int numBelowBound = 0;
+      const unsigned int NUM_MIXTURES = 10000;
+      for (unsigned int i = 0; i < NUM_MIXTURES; i++)
+      {
+         float random[4];
+         for (unsigned int r = 0; r < 4; r++)
+         {
+            seed = seed * 1664525u + 1013904223u;
+            random[r] = (float)(seed >> 8) / 16777216.0f;
+         }
+         float nearDepth = 0.9f * random[0];
+         float farDepth = nearDepth + 0.02f + (0.98f - nearDepth) * random[1];
+         float receiver = nearDepth + 0.01f + (farDepth - nearDepth - 0.01f) * random[2];
+         float covered = random[3];
+
+         float nearMoments[4], farMoments[4], mixed[4];
+         ComputeEvsmMoments(nearDepth, settings, nearMoments);
+         ComputeEvsmMoments(farDepth, settings, farMoments);
+         for (unsigned int c = 0; c < 4; c++) mixed[c] = covered * nearMoments[c] + (1.0f - covered) * farMoments[c];
+         if (EvsmVisibility(mixed, receiver, unreduced) < 1.0f - covered - 1e-3f) numBelowBound++;
+      }
+      Check(numBelowBound == 0, "Chebyshev's bound holds for two depth mixtures", &results, out);
+
+      // A tile of occluders next to an empty one, blurring across the tile
+      // boundary would darken the empty tile
+      const unsigned int TILE_SIZE = BLUR_PASS_GROUP_SIZE;
+      ShadowDepthMap tiles;
+      tiles.width = 2 * TILE_SIZE;
+      tiles.height = TILE_SIZE;
+      tiles.depth.resize(tiles.width * tiles.height);
+      for (size_t i = 0; i < tiles.depth.size(); i++) tiles.depth[i] = (i % tiles.width) < TILE_SIZE ? 0.3f : 1.0f;
+
+      RgbaImage tileMoments, rows, blurredTiles;
+      ComputeEvsmMomentsImage(tiles, settings, &tileMoments);
+      BlurConstants blurConstants;
+      SetupBlurConstants(tiles.width, tiles.height, MAX_BLUR_RADIUS, 0.5f * MAX_BLUR_RADIUS, false, 1.0f, &blurConstants);
+      blurConstants.tileWidth = TILE_SIZE;
+      vector<float> noDepth;
+      BlurPass(tileMoments, noDepth, blurConstants, &rows);
+      blurConstants.horizontal = 0;
+      BlurPass(rows, noDepth, blurConstants, &blurredTiles);
+      float maxChange = 0.0f;
+      for (size_t i = 0; i < tileMoments.texels.size(); i++)
+      {
+         float change = fabsf(blurredTiles.texels[i] - tileMoments.texels[i]) / fabsf(tileMoments.texels[i]);
+         if (change > maxChange) maxChange = change;
+      }
+      Check(maxChange < 1e-5f, "blurs stay within their tile and keep constant moments", &results, out);
+
+      const unsigned int MAP_SIZE = 1024;
+      ShadowDepthMap map;
+      CreateSyntheticShadowMap(MAP_SIZE, &map);
+
+      CpuTimer filterTimer;
+      RgbaImage moments;
+      vector<RgbaImage> mips(1);
+      ComputeEvsmMomentsImage(map, settings, &moments);
+      SeparableBlur(moments, noDepth, settings.blurRadius, 0.5f * settings.blurRadius, false, 1.0f, &mips[0]);
+      while (mips.back().width > 1)
+      {
+         mips.push_back(RgbaImage());
+         DownsampleMoments(mips[mips.size() - 2], &mips.back());
+      }
+      double filterMs = filterTimer.GetElapsedMs();
+
+      float maxMeanError = 0.0f;
+      for (size_t mip = 1; mip < mips.size(); mip++)
+      {
+         for (unsigned int c = 0; c < 4; c++)
+         {
+            float error = fabsf(ComputeMean(mips[mip], c) / ComputeMean(mips[0], c) - 1.0f);
+            if (error > maxMeanError) maxMeanError = error;
+         }
+      }
+      Check(maxMeanError < 1e-4f, "mips keep the mean of the moments", &results, out);
+
+      out << "  checks passed=" << results.numChecks - results.numFailed << " of " << results.numChecks
+          << " moments+blur+mips ms=" << filterMs << " mips=" << mips.size() << "\n";
+
+      // Centered on an edge of the box like shadow_filter, the minified
+      // receiver sees the whole map
+      const unsigned int IMAGE_SIZE = 256;
+      const float RECEIVER_DEPTH = 0.5f;
+      const float TEXELS_PER_PIXEL[2] = { 0.3f, 4.0f };
+      for (unsigned int scale = 0; scale < 2; scale++)
+      {
+         float texelsPerPixel = TEXELS_PER_PIXEL[scale];
+         unsigned int mip = 0;
+         while ((float)(2 << mip) <= texelsPerPixel) mip++;
+         float mipScale = 1.0f / (1 << mip);
+         float originX = 0.66f * MAP_SIZE - 0.5f * IMAGE_SIZE * texelsPerPixel;
+         float originY = 0.62f * MAP_SIZE - 0.5f * IMAGE_SIZE * texelsPerPixel;
+         if (originX < 0.0f) originX = 0.0f;
+         if (originY < 0.0f) originY = 0.0f;
+
+         double evsmError = 0.0, pcfError = 0.0;
+         unsigned int numBleeding = 0, numShadowed = 0;
+         for (unsigned int y = 0; y < IMAGE_SIZE; y++)
+         {
+            for (unsigned int x = 0; x < IMAGE_SIZE; x++)
+            {
+               float texelX = originX + (x + 0.5f) * texelsPerPixel;
+               float texelY = originY + (y + 0.5f) * texelsPerPixel;
+
+               // Every texel under the pixel, or the texel it magnifies
+               int firstX = (int)floorf(texelX - 0.5f * texelsPerPixel);
+               int firstY = (int)floorf(texelY - 0.5f * texelsPerPixel);
+               int size = texelsPerPixel > 1.0f ? (int)texelsPerPixel : 1;
+               float truth = 0.0f;
+               for (int ty = firstY; ty < firstY + size; ty++)
+               {
+                  for (int tx = firstX; tx < firstX + size; tx++)
+                  {
+                     truth += FilterShadowPointTaps(map, tx + 0.5f, ty + 0.5f, RECEIVER_DEPTH, 1);
+                  }
+               }
+               truth /= (float)(size * size);
+
+               float sample[4];
+               SampleMoments(mips[mip], texelX * mipScale, texelY * mipScale, sample);
+               float evsm = EvsmVisibility(sample, RECEIVER_DEPTH, settings);
+               float pcf = FilterShadowPcf(map, texelX, texelY, RECEIVER_DEPTH, DEFAULT_SHADOW_PCF_TAPS_SQRT);
+               evsmError += fabsf(evsm - truth);
+               pcfError += fabsf(pcf - truth);
+               if (truth == 0.0f)
+               {
+                  numShadowed++;
+                  if (evsm > 0.05f) numBleeding++;
+               }
+            }
+         }
+
+         unsigned int numPixels = IMAGE_SIZE * IMAGE_SIZE;
+         out << "  " << texelsPerPixel << " texels/pixel: mip=" << mip << " mean error evsm=" << evsmError / numPixels
+             << " pcf " << DEFAULT_SHADOW_PCF_TAPS_SQRT << "x" << DEFAULT_SHADOW_PCF_TAPS_SQRT << "=" << pcfError / numPixels
+             << " light bleeding=" << (numShadowed ? 100.0f * numBleeding / numShadowed : 0.0f) << "% of shadowed pixels\n";
+      }
+   }
+
+   // Orthographic light looking straight down on a square of the given
+   // size around the origin, depth grows from top down over range
+   void SetupTopDownLight(float size, float top, float range, float viewProj[16])
+   {
+      memset(viewProj, 0, 16 * sizeof(float));
+      viewProj[0] = 2.0f / size;
+      viewProj[9] = 2.0f / size;
+      viewProj[6] = -1.0f / range;
+      viewProj[14] = top / range;
+      viewProj[15] = 1.0f;
+   }
+
+   // Stand-in for the shadow pass' rasterization, spheres are drawn as
+   // discs at their nearest depth into the texels inside rect
+   void DrawSphereDepths(const vector<CullInstance> &instances, const vector<unsigned int> &draws,
+      const float viewProj[16], float range, const ShadowRect &rect, ShadowDepthMap *pMap)
+   {
+      for (unsigned int y = rect.top; y < rect.bottom; y++)
+      {
+         for (unsigned int x = rect.left; x < rect.right; x++) pMap->depth[y * pMap->width + x] = 1.0f;
+      }
+
+      vector<bool> drawn(instances.size(), false);
+      for (size_t d = 0; d < draws.size(); d++)
+      {
+         for (size_t i = 0; i < instances.size(); i++)
+         {
+            if (instances[i].drawIndex != draws[d]) continue;
+
+            const BoundingSphere &sphere = instances[i].bounds;
+            float center[3];
+            for (unsigned int c = 0; c < 3; c++)
+            {
+               center[c] = sphere.center[0] * viewProj[c] + sphere.center[1] * viewProj[4 + c] +
+                  sphere.center[2] * viewProj[8 + c] + viewProj[12 + c];
+            }
+            float radius = sphere.radius * viewProj[0];
+            float depth = center[2] - sphere.radius / range;
+
+            for (unsigned int y = rect.top; y < rect.bottom; y++)
+            {
+               for (unsigned int x = rect.left; x < rect.right; x++)
+               {
+                  float dx = (x + 0.5f) / pMap->width * 2.0f - 1.0f - center[0];
+                  float dy = 1.0f - (y + 0.5f) / pMap->height * 2.0f - center[1];
+                  float &texel = pMap->depth[y * pMap->width + x];
+                  if (dx * dx + dy * dy <= radius * radius && depth < texel) texel = depth;
+               }
+            }
+         }
+      }
+   }
+
+   void RunShadowCacheBenchmark(ostream &out)
+   {
+      out << "shadow_cache: shadow map caching with partial updates for dynamic casters\n";
+
+      // A grid of static spheres on the floor with a few dynamic ones
+      // floating above them, each instance is its own draw
+      const unsigned int MAP_SIZE = 512;
+      const unsigned int GRID_SIZE = 16;
+      const unsigned int NUM_DYNAMIC = 4;
+      const float SCENE_SIZE = 160.0f;
+      const float LIGHT_TOP = 100.0f;
+      const float LIGHT_RANGE = 200.0f;
+      float viewProj[16];
+      SetupTopDownLight(SCENE_SIZE, LIGHT_TOP, LIGHT_RANGE, viewProj);
+
+      const unsigned int firstDynamic = GRID_SIZE * GRID_SIZE;
+      vector<CullInstance> instances(firstDynamic + NUM_DYNAMIC);
+      for (unsigned int i = 0; i < instances.size(); i++)
+      {
+         CullInstance &instance = instances[i];
+         memset(&instance, 0, sizeof(instance));
+         instance.drawIndex = i;
+         if (i < firstDynamic)
+         {
+            float spacing = SCENE_SIZE / GRID_SIZE;
+            instance.bounds.center[0] = ((i % GRID_SIZE) + 0.5f) * spacing - 0.5f * SCENE_SIZE;
+            instance.bounds.center[1] = 0.0f;
+            instance.bounds.center[2] = ((i / GRID_SIZE) + 0.5f) * spacing - 0.5f * SCENE_SIZE;
+            instance.bounds.radius = 0.3f * spacing;
+         }
+         else
+         {
+            instance.bounds.center[0] = -40.0f + 20.0f * (i - firstDynamic);
+            instance.bounds.center[1] = 20.0f;
+            instance.bounds.radius = 4.0f;
+         }
+      }
+
+      vector<unsigned int> allDraws(instances.size());
+      for (unsigned int i = 0; i < allDraws.size(); i++) allDraws[i] = i;
+      ShadowRect wholeMap = { 0, 0, MAP_SIZE, MAP_SIZE };
+
+      // The cache is handed the dynamic casters' bounds every frame
+      vector<BoundingSphere> dynamicCasters(NUM_DYNAMIC);
+      auto moveCaster = [&instances, firstDynamic](unsigned int c, float x, float z)
+      {
+         BoundingSphere &bounds = instances[firstDynamic + c].bounds;
+         bounds.center[0] = x;
+         bounds.center[2] = z;
+      };
+      auto gatherCasters = [&instances, &dynamicCasters, firstDynamic]()
+      {
+         for (size_t c = 0; c < dynamicCasters.size(); c++) dynamicCasters[c] = instances[firstDynamic + c].bounds;
+      };
+
+      CheckResults results = { 0, 0 };
+      ShadowCache cache(MAP_SIZE, MAP_SIZE);
+      gatherCasters();
+      Check(cache.Update(viewProj, dynamicCasters) == SHADOW_CACHE_FULL, "first frame draws everything", &results, out);
+      Check(cache.Update(viewProj, dynamicCasters) == SHADOW_CACHE_SKIP, "still frame skips the shadow pass", &results, out);
+
+      BoundingSphere before = dynamicCasters[1];
+      moveCaster(1, before.center[0] + 3.0f, before.center[2] + 2.0f);
+      gatherCasters();
+      ShadowCacheUpdate update = cache.Update(viewProj, dynamicCasters);
+      ShadowRect oldRect = ProjectSphereRect(viewProj, before, MAP_SIZE, MAP_SIZE);
+      ShadowRect newRect = ProjectSphereRect(viewProj, dynamicCasters[1], MAP_SIZE, MAP_SIZE);
+      const ShadowRect &dirty = cache.GetDirtyRect();
+      bool coversBoth = GetRectArea(UnionRects(dirty, UnionRects(oldRect, newRect))) == GetRectArea(dirty);
+      Check(update == SHADOW_CACHE_PARTIAL && coversBoth, "moved caster dirties its old and new texels", &results, out);
+
+      // Redrawing only the dirty rectangle has to give the same map as
+      // drawing everything again
+      ShadowDepthMap cached, reference;
+      cached.width = cached.height = reference.width = reference.height = MAP_SIZE;
+      cached.depth.resize(MAP_SIZE * MAP_SIZE);
+      reference.depth.resize(MAP_SIZE * MAP_SIZE);
+      moveCaster(1, before.center[0], before.center[2]);
+      DrawSphereDepths(instances, allDraws, viewProj, LIGHT_RANGE, wholeMap, &cached);
+      moveCaster(1, before.center[0] + 3.0f, before.center[2] + 2.0f);
+      vector<unsigned int> regionDraws;
+      SelectDrawsInRect(instances, viewProj, MAP_SIZE, MAP_SIZE, dirty, &regionDraws);
+      DrawSphereDepths(instances, regionDraws, viewProj, LIGHT_RANGE, dirty, &cached);
+      DrawSphereDepths(instances, allDraws, viewProj, LIGHT_RANGE, wholeMap, &reference);
+      Check(cached.depth == reference.depth, "partial update matches a full redraw", &results, out);
+      Check(regionDraws.size() < instances.size() / 4, "partial update only redraws nearby draws", &results, out);
+
+      moveCaster(1, 70.0f, 70.0f);
+      moveCaster(2, -70.0f, -70.0f);
+      gatherCasters();
+      Check(cache.Update(viewProj, dynamicCasters) == SHADOW_CACHE_FULL, "casters jumping across the map redraw it all",
+         &results, out);
+
+      float turnedLight[16];
+      memcpy(turnedLight, viewProj, sizeof(turnedLight));
+      turnedLight[4] = 0.01f;
+      Check(cache.Update(turnedLight, dynamicCasters) == SHADOW_CACHE_FULL, "turning the light redraws it all", &results, out);
+      dynamicCasters.pop_back();
+      Check(cache.Update(turnedLight, dynamicCasters) == SHADOW_CACHE_FULL, "adding or removing casters redraws it all",
+         &results, out);
+      dynamicCasters.resize(NUM_DYNAMIC);
+      gatherCasters();
+
+      // Session of a still light with one caster drifting every fourth
+      // frame, recorded through the frame graph with the modes the renderer
+      // sets against recording every pass each frame
+      ScenePassResources res;
+      vector<SceneDrawItem> items;
+      CreateSyntheticScene((unsigned int)instances.size(), &res, &items);
+      SetSyntheticShadowSizes(MAP_SIZE, MAP_SIZE, DEFAULT_SHADOW_CASCADE_SIZE, &res);
+
+      RenderGraph graph;
+      SceneGraphPasses passes;
+      DeclareSceneGraph(&graph, res, &passes);
+      ShadowCacheUpdate frameUpdate = SHADOW_CACHE_FULL;
+      vector<SceneDrawItem> regionItems;
+      DrawChunk allItems = { 0, (unsigned int)items.size() };
+      graph.SetPassCallback(passes.scenePasses[SHADOW_PASS],
+         [&res, &items, &regionItems, &frameUpdate, &cache, allItems](CommandBuffer *pCmds)
+      {
+         if (frameUpdate == SHADOW_CACHE_PARTIAL) RecordShadowRegionUpdate(pCmds, res, regionItems, cache.GetDirtyRect());
+         else RecordScenePass(pCmds, res, items, SHADOW_PASS, allItems);
+      });
+      string errors;
+      bool compiled = graph.Compile(&errors);
+      AssignSyntheticViews(&graph, 500000);
+
+      cache.Invalidate();
+      cache.ResetStats();
+      unsigned long long cachedDraws = 0, uncachedDraws = 0;
+      unsigned int numCachedClears = 0, numUncachedClears = 0;
+      CommandBuffer cmds;
+      NullCommandBackend backend;
+      double updateMs = 0.0;
+      const unsigned int NUM_FRAMES = 256;
+      for (unsigned int frame = 0; frame < NUM_FRAMES; frame++)
+      {
+         if (frame % 4 == 3)
+         {
+            const BoundingSphere &bounds = instances[firstDynamic].bounds;
+            moveCaster(0, bounds.center[0] + 0.25f, bounds.center[2]);
+            gatherCasters();
+         }
+
+         for (unsigned int cached = 0; cached < 2; cached++)
+         {
+            CpuTimer updateTimer;
+            frameUpdate = cached ? cache.Update(viewProj, dynamicCasters) : SHADOW_CACHE_FULL;
+            if (frameUpdate == SHADOW_CACHE_PARTIAL)
+            {
+               SelectDrawsInRect(instances, viewProj, MAP_SIZE, MAP_SIZE, cache.GetDirtyRect(), &regionDraws);
+               regionItems.clear();
+               for (size_t i = 0; i < regionDraws.size(); i++) regionItems.push_back(items[regionDraws[i]]);
+            }
+            if (cached) updateMs += updateTimer.GetElapsedMs();
+
+            graph.SetPassMode(passes.culling[SHADOW_PASS],
+               frameUpdate == SHADOW_CACHE_FULL ? GRAPH_PASS_RUN : GRAPH_PASS_SKIP);
+            graph.SetPassMode(passes.scenePasses[SHADOW_PASS], frameUpdate == SHADOW_CACHE_FULL ? GRAPH_PASS_RUN :
+               (frameUpdate == SHADOW_CACHE_PARTIAL ? GRAPH_PASS_RUN_WITHOUT_CLEARS : GRAPH_PASS_SKIP));
+            RenderGraphPassMode vplMode = frameUpdate == SHADOW_CACHE_SKIP ? GRAPH_PASS_SKIP : GRAPH_PASS_RUN;
+            graph.SetPassMode(passes.vplFlux, vplMode);
+            graph.SetPassMode(passes.lightBuffer, vplMode);
+            graph.SetPassMode(passes.lightBinning, vplMode);
+
+            cmds.Reset();
+            backend.ResetStats();
+            graph.Execute(&cmds);
+            backend.Execute(cmds);
+            (cached ? cachedDraws : uncachedDraws) += backend.GetStats().numDraws;
+            (cached ? numCachedClears : numUncachedClears) += backend.GetStats().commandCounts[CMD_CLEAR_DEPTH];
+         }
+      }
+      const ShadowCacheStats &stats = cache.GetStats();
+      Check(compiled, "frame graph compiles with the persistent shadow maps", &results, out);
+      Check(stats.partialFrames == NUM_FRAMES / 4 && stats.skippedFrames == NUM_FRAMES - 1 - stats.partialFrames,
+         "frames where nothing moved skip the shadow pass", &results, out);
+      Check(numCachedClears < numUncachedClears, "skipped and partial frames keep the cached depth", &results, out);
+
+      out << "  checks passed=" << results.numChecks - results.numFailed << " of " << results.numChecks << "\n" << errors;
+      out << "  frames=" << NUM_FRAMES << " skipped=" << stats.skippedFrames << " partial=" << stats.partialFrames
+          << " full=" << stats.fullFrames
+          << " texels updated=" << 100.0 * stats.updatedTexels / ((double)NUM_FRAMES * MAP_SIZE * MAP_SIZE) << "%"
+          << " shadow draws/frame cached=" << (double)cachedDraws / NUM_FRAMES
+          << " uncached=" << (double)uncachedDraws / NUM_FRAMES
+          << " cache update us/frame=" << 1000.0 * updateMs / NUM_FRAMES << "\n";
+   }
+
+   // Thread groups of the compute passes that depend on the light map or
+   // on the cascades
+   unsigned long long CountShadowMapThreadGroups(const ScenePassResources &res, bool cascades)
+   {
+      CommandBuffer cmds;
+      if (cascades)
+      {
+         BlurConstants blurConstants;
+         SetupBlurConstants(res.cascadeSize * NUM_SHADOW_CASCADES, res.cascadeSize, DEFAULT_EVSM_BLUR_RADIUS, 1.0f,
+            false, 1.0f, &blurConstants);
+         blurConstants.tileWidth = res.cascadeSize;
+         RecordEvsmMoments(&cmds, res);
+         RecordBlurPass(&cmds, res, blurConstants);
+         blurConstants.horizontal = 0;
+         RecordBlurPass(&cmds, res, blurConstants);
+      }
+      else
+      {
+         VplConstants vplConstants;
+         SetupVplConstants(res.shadowMapWidth, res.shadowMapHeight, DEFAULT_VPLS, 0, &vplConstants);
+         RecordVplFlux(&cmds, res, vplConstants);
+         RecordLightBufferGeneration(&cmds, res, vplConstants);
+      }
+
+      NullCommandBackend backend;
+      backend.Execute(cmds);
+      return backend.GetStats().numThreadGroups;
+   }
+
+   // Sum of the VPLs' luminance, the lighting they add up to
+   double SumVplLuminance(const vector<VirtualPointLight> &lights)
+   {
+      double sum = 0.0;
+      for (size_t i = 0; i < lights.size(); i++)
+      {
+         sum += 0.2126 * lights[i].color[0] + 0.7152 * lights[i].color[1] + 0.0722 * lights[i].color[2];
+      }
+      return sum;
+   }
+
+   // Light map and cascade sizes swept separately behind a fixed 1920x1080
+   // back buffer. The shadow transients and the thread groups of the shadow
+   // passes have to follow the shadow sizes alone, the VPLs of the same
+   // scene have to carry the same light at every light map size, and the
+   // light map's flux sum must not overflow at the largest sizes.
+   void RunShadowResolutionBenchmark(ostream &out)
+   {
+      out << "shadow_resolution: light map and cascade sizes independent of the back buffer\n";
+
+      CheckResults results = { 0, 0 };
+      const double MB = 1024.0 * 1024.0;
+      const unsigned int rsmSizes[][2] = { { 512, 384 }, { 1024, 768 }, { 2048, 1536 }, { 4096, 3072 } };
+      const unsigned int cascadeSizes[] = { 512, 1024, 2048, MAX_SHADOW_CASCADE_SIZE };
+      const unsigned int NUM_RSM_SIZES = sizeof(rsmSizes) / sizeof(rsmSizes[0]);
+      const unsigned int NUM_CASCADE_SIZES = sizeof(cascadeSizes) / sizeof(cascadeSizes[0]);
+      const unsigned int NUM_SIZES = NUM_RSM_SIZES + NUM_CASCADE_SIZES;
+
+      bool allCompiled = true;
+      unsigned long long declaredBytes[NUM_SIZES];
+      unsigned long long threadGroups[NUM_SIZES];
+      string errors;
+      for (unsigned int i = 0; i < NUM_SIZES; i++)
+      {
+         bool sweepCascades = i >= NUM_RSM_SIZES;
+         ScenePassResources res;
+         vector<SceneDrawItem> items;
+         CreateSyntheticScene(256, &res, &items);
+         SetSyntheticResolution(1920, 1080, &res);
+         if (sweepCascades)
+         {
+            SetSyntheticShadowSizes(REFERENCE_RSM_WIDTH, REFERENCE_RSM_HEIGHT, cascadeSizes[i - NUM_RSM_SIZES], &res);
+         }
+         else
+         {
+            SetSyntheticShadowSizes(rsmSizes[i][0], rsmSizes[i][1], DEFAULT_SHADOW_CASCADE_SIZE, &res);
+         }
+
+         RenderGraph graph;
+         SceneGraphPasses passes;
+         DeclareSceneGraph(&graph, res, &passes);
+         bool compiled = graph.Compile(&errors);
+         allCompiled = allCompiled && compiled;
+
+         const RenderGraphMemoryStats &stats = graph.GetMemoryStats();
+         declaredBytes[i] = stats.declaredBytes;
+         threadGroups[i] = CountShadowMapThreadGroups(res, sweepCascades);
+
+         VplConstants vplConstants;
+         SetupVplConstants(res.shadowMapWidth, res.shadowMapHeight, DEFAULT_VPLS, 0, &vplConstants);
+         out << "  " << (sweepCascades ? "cascades " : "light map ");
+         if (sweepCascades) out << res.cascadeSize << "x" << res.cascadeSize;
+         else out << res.shadowMapWidth << "x" << res.shadowMapHeight;
+         out << " declared MB=" << stats.declaredBytes / MB << " committed MB=" << stats.committedBytes / MB
+             << " thread groups=" << threadGroups[i];
+         if (!sweepCascades) out << " texel weight=" << vplConstants.texelWeight << " flux scale=" << vplConstants.fluxScale;
+         out << "\n";
+      }
+      Check(allCompiled, "frame graph compiles at every shadow size", &results, out);
+
+      // Depth and light map per light map texel
+      unsigned long long rsmTexelBytes = 4 + 16;
+      bool rsmMemory = true, cascadeMemory = true, rsmGroups = true, cascadeGroups = true;
+      for (unsigned int i = 1; i < NUM_RSM_SIZES; i++)
+      {
+         unsigned long long addedTexels = (unsigned long long)rsmSizes[i][0] * rsmSizes[i][1] -
+            (unsigned long long)rsmSizes[i - 1][0] * rsmSizes[i - 1][1];
+         rsmMemory = rsmMemory && declaredBytes[i] - declaredBytes[i - 1] == addedTexels * rsmTexelBytes;
+         rsmGroups = rsmGroups && threadGroups[i] == 4 * threadGroups[i - 1];
+      }
+      for (unsigned int i = NUM_RSM_SIZES + 1; i < NUM_SIZES; i++)
+      {
+         cascadeMemory = cascadeMemory && declaredBytes[i] > declaredBytes[i - 1];
+         double ratio = (double)threadGroups[i] / threadGroups[i - 1];
+         cascadeGroups = cascadeGroups && ratio > 3.9 && ratio < 4.1;
+      }
+      Check(rsmMemory, "the light map's transients follow its size and nothing else", &results, out);
+      Check(cascadeMemory, "the cascade transients grow with the cascade size", &results, out);
+      Check(rsmGroups, "the VPL passes' thread groups scale with the light map", &results, out);
+      Check(cascadeGroups, "the EVSM passes' thread groups scale with the cascades", &results, out);
+
+      // The same made up scene rendered into light maps up to 2048x1536.
+      // The texels of a larger map split the same light, so the exact sum
+      // has to match the reference size's and the importance sampled
+      // estimate the exact sum.
+      const unsigned int NUM_SEEDS = 32;
+      const unsigned int NUM_VPL_SIZES = NUM_RSM_SIZES - 1;
+      double exactSums[NUM_VPL_SIZES];
+      double referenceSum = 0.0;
+      bool estimateUnbiased = true;
+      for (unsigned int i = 0; i < NUM_VPL_SIZES; i++)
+      {
+         ReflectiveShadowMap rsm;
+         CreateSyntheticReflectiveShadowMap(rsmSizes[i][0], rsmSizes[i][1], &rsm);
+
+         vector<VirtualPointLight> texels;
+         SampleVplsUniform(rsm, 1, &texels);
+         exactSums[i] = SumVplLuminance(texels);
+         if (rsm.width == REFERENCE_RSM_WIDTH && rsm.height == REFERENCE_RSM_HEIGHT) referenceSum = exactSums[i];
+
+         double sampledSum = 0.0;
+         size_t numVpls = 0;
+         for (unsigned int seed = 0; seed < NUM_SEEDS; seed++)
+         {
+            vector<VirtualPointLight> lights;
+            SampleVplsReference(rsm, DEFAULT_VPLS, seed, &lights);
+            sampledSum += SumVplLuminance(lights) / NUM_SEEDS;
+            numVpls += lights.size();
+         }
+         estimateUnbiased = estimateUnbiased && fabs(sampledSum - exactSums[i]) < 0.05 * exactSums[i];
+
+         // What the VPLs added up to when every texel carried the same share
+         // regardless of the map's size
+         double unweightedSum = exactSums[i] / (ComputeVplTexelWeight(rsm.width, rsm.height) * VPL_REFERENCE_TEXELS);
+         out << "  vpls " << rsm.width << "x" << rsm.height << " count=" << numVpls / NUM_SEEDS
+             << " luminance exact=" << exactSums[i] << " sampled=" << sampledSum << " unweighted=" << unweightedSum
+             << "\n";
+      }
+      bool energyConsistent = referenceSum > 0.0;
+      for (unsigned int i = 0; i < NUM_VPL_SIZES; i++)
+      {
+         energyConsistent = energyConsistent && fabs(exactSums[i] - referenceSum) < 0.01 * referenceSum;
+      }
+      Check(energyConsistent, "the VPLs carry the same light at every light map size", &results, out);
+      Check(estimateUnbiased, "importance sampled VPLs match the exact sum at every size", &results, out);
+
+      // Every texel at MAX_TEXEL_LUMINANCE, the most a map can sum to
+      bool fitsInUint = true;
+      for (unsigned int i = 0; i < NUM_RSM_SIZES; i++)
+      {
+         unsigned long long texels = (unsigned long long)rsmSizes[i][0] * rsmSizes[i][1];
+         double scale = ComputeFluxScale(rsmSizes[i][0], rsmSizes[i][1]);
+         fitsInUint = fitsInUint && texels * MAX_TEXEL_LUMINANCE * (unsigned long long)scale <= 0xffffffffull;
+      }
+      Check(fitsInUint, "a saturated light map's flux sum fits in 32 bits at every size", &results, out);
+      Check(ComputeFluxScale(REFERENCE_RSM_WIDTH, REFERENCE_RSM_HEIGHT) == FLUX_FIXED_POINT_SCALE,
+         "the reference light map keeps the full fixed point precision", &results, out);
+
+      out << "  checks passed=" << results.numChecks - results.numFailed << " of " << results.numChecks << "\n" << errors;
+   }
+
+   // Mean absolute difference of two occlusion images, over the pixels
+   // where mask is set or all of them when it is empty
+   double MeanAoError(const vector<float> &ao, const vector<float> &reference, const vector<bool> &mask)
+   {
+      double sum = 0.0;
+      size_t count = 0;
+      for (size_t i = 0; i < ao.size(); i++)
+      {
+         if (!mask.empty() && !mask[i]) continue;
+         sum += fabs(ao[i] - reference[i]);
+         count++;
+      }
+      return count ? sum / count : 0.0;
+   }
+
+   // Row vector matrix from view space to clip space of the buffer's camera
+   void GetSsaoProjection(const NormalDepthBuffer &buffer, float projection[16])
+   {
+      memset(projection, 0, 16 * sizeof(float));
+      projection[0] = 1.0f / buffer.tanHalfFovX;
+      projection[5] = 1.0f / buffer.tanHalfFovY;
+      projection[10] = 1.0f;
+      projection[11] = 1.0f;
+   }
+
+   // Occlusion of the made up scene's open floor and corners, temporal
+   // accumulation against a converged reference and the upsample at
+   // silhouettes. Accumulation runs on SSAO_CAPTURE_FILE if the renderer
+   // captured one, the rest needs the made up scene's known geometry.
+   void RunSsaoBenchmark(ostream &out)
+   {
+      out << "ssao: half resolution occlusion, temporal accumulation and depth-aware upsampling\n";
+
+      const unsigned int WIDTH = 640, HEIGHT = 480;
+      const float CAMERA_DISTANCE = 6.0f;
+      CheckResults results = { 0, 0 };
+
+      SsaoSettings settings;
+      GetDefaultSsaoSettings(&settings);
+      settings.radius = 0.5f;
+
+      NormalDepthBuffer scene;
+      CreateSyntheticNormalDepth(WIDTH, HEIGHT, CAMERA_DISTANCE, &scene);
+      SsaoConstants constants;
+      SetupSsaoConstants(settings, scene.width, scene.height, scene.tanHalfFovX, scene.tanHalfFovY, NULL, 0, &constants);
+      vector<float> ao;
+      ComputeSsaoReference(scene, constants, &ao);
+
+      // Floor pixels close to the camera, next to the back wall and off to
+      // the side of the box
+      double openSum = 0.0, cornerSum = 0.0, minOpen = 1.0;
+      unsigned int numOpen = 0, numCorner = 0;
+      for (unsigned int y = 0; y < constants.halfHeight; y++)
+      {
+         for (unsigned int x = 0; x < constants.halfWidth; x++)
+         {
+            const float *texel = &scene.texels[(y * 2 * scene.width + x * 2) * 4];
+            if (texel[1] != 1.0f) continue;
+            float p[3];
+            GetViewPosition(constants, x * 2, y * 2, texel[3], p);
+            float value = ao[y * constants.halfWidth + x];
+            if (p[2] < CAMERA_DISTANCE - 2.5f - 2.0f * settings.radius)
+            {
+               openSum += value;
+               if (value < minOpen) minOpen = value;
+               numOpen++;
+            }
+            else if (p[2] > CAMERA_DISTANCE - 0.5f * settings.radius && fabsf(p[0]) > 0.5f + settings.radius)
+            {
+               cornerSum += value;
+               numCorner++;
+            }
+         }
+      }
+      double openAo = numOpen ? openSum / numOpen : 0.0;
+      double cornerAo = numCorner ? cornerSum / numCorner : 1.0;
+      out << "  open floor ao=" << openAo << " corner ao=" << cornerAo << "\n";
+      Check(numOpen > 0 && minOpen > 0.99, "an open plane is unoccluded", &results, out);
+      Check(numCorner > 0 && cornerAo < openAo - 0.1, "the corner under the wall is darker than the open floor",
+         &results, out);
+
+      // Known occlusion on each surface, 0 on the box and 1 elsewhere, so
+      // anything else at a pixel leaked across a silhouette
+      vector<float> surfaces(constants.halfWidth * constants.halfHeight * 2);
+      for (unsigned int y = 0; y < constants.halfHeight; y++)
+      {
+         for (unsigned int x = 0; x < constants.halfWidth; x++)
+         {
+            const float *texel = &scene.texels[(y * 2 * scene.width + x * 2) * 4];
+            float p[3];
+            GetViewPosition(constants, x * 2, y * 2, texel[3], p);
+            unsigned int index = (y * constants.halfWidth + x) * 2;
+            surfaces[index] = texel[3] != 0.0f && p[2] < CAMERA_DISTANCE - 1.5f + 1e-3f && p[1] > -1.0f + 1e-3f ?
+               0.0f : 1.0f;
+            surfaces[index + 1] = texel[3];
+         }
+      }
+      vector<float> truth(scene.width * scene.height, 1.0f);
+      vector<bool> edges(scene.width * scene.height, false);
+      for (unsigned int y = 0; y < scene.height; y++)
+      {
+         for (unsigned int x = 0; x < scene.width; x++)
+         {
+            const float *texel = &scene.texels[(y * scene.width + x) * 4];
+            if (texel[3] == 0.0f) continue;
+            float p[3];
+            GetViewPosition(constants, x, y, texel[3], p);
+            if (p[2] < CAMERA_DISTANCE - 1.5f + 1e-3f && p[1] > -1.0f + 1e-3f) truth[y * scene.width + x] = 0.0f;
+
+            // Silhouettes, pixels with a half resolution neighbour on
+            // another surface at a different depth. Where the box touches
+            // the floor the depths agree and so does the occlusion.
+            unsigned int x0 = x / 2, y0 = y / 2;
+            unsigned int x1 = x0 + 1 < constants.halfWidth ? x0 + 1 : x0;
+            unsigned int y1 = y0 + 1 < constants.halfHeight ? y0 + 1 : y0;
+            unsigned int neighbours[4] = { y0 * constants.halfWidth + x0, y0 * constants.halfWidth + x1,
+               y1 * constants.halfWidth + x0, y1 * constants.halfWidth + x1 };
+            for (unsigned int i = 0; i < 4; i++)
+            {
+               const float *neighbour = &surfaces[neighbours[i] * 2];
+               if (neighbour[0] != truth[y * scene.width + x] &&
+                  fabsf(neighbour[1] - texel[3]) > settings.depthTolerance * texel[3])
+               {
+                  edges[y * scene.width + x] = true;
+               }
+            }
+         }
+      }
+      vector<float> depthAware, bilinear;
+      UpsampleSsao(scene, surfaces, constants, &depthAware);
+      UpsampleSsaoBilinear(scene, surfaces, constants, &bilinear);
+      double depthAwareError = MeanAoError(depthAware, truth, edges);
+      double bilinearError = MeanAoError(bilinear, truth, edges);
+      out << "  silhouette error depth aware=" << depthAwareError << " bilinear=" << bilinearError << "\n";
+      Check(depthAwareError < 0.25 * bilinearError, "the depth-aware upsample keeps occlusion on its own surface",
+         &results, out);
+
+      // History of a surface half again as far away, as if the box had
+      // moved, has to be rejected everywhere
+      float projection[16];
+      GetSsaoProjection(scene, projection);
+      SsaoConstants temporal;
+      SetupSsaoConstants(settings, scene.width, scene.height, scene.tanHalfFovX, scene.tanHalfFovY, projection, 0,
+         &temporal);
+      vector<float> moved(surfaces.size()), resolved, raw;
+      for (size_t i = 0; i < moved.size(); i += 2)
+      {
+         moved[i] = 0.0f;
+         moved[i + 1] = surfaces[i + 1] * 1.5f;
+      }
+      AccumulateSsao(scene, ao, moved, temporal, &resolved);
+      bool rejected = true;
+      for (size_t i = 0; i < ao.size(); i++) rejected = rejected && resolved[i * 2] == ao[i];
+      Check(rejected, "history of a different surface is rejected", &results, out);
+      for (size_t i = 0; i < moved.size(); i += 2) moved[i + 1] = surfaces[i + 1];
+      AccumulateSsao(scene, ao, moved, temporal, &resolved);
+      bool blended = true;
+      for (size_t i = 0; i < ao.size(); i++)
+      {
+         if (surfaces[i * 2 + 1] != 0.0f) blended = blended && fabsf(resolved[i * 2] - ao[i] * (1.0f - settings.historyWeight)) < 1e-5f;
+      }
+      Check(blended, "history of the same surface is blended in", &results, out);
+
+      // A static camera accumulating the default sample count, against many
+      // more samples over many rotations
+      NormalDepthBuffer buffer;
+      bool captured = LoadNormalDepthBuffer(SSAO_CAPTURE_FILE, &buffer);
+      if (!captured)
+      {
+         buffer = scene;
+      }
+      else
+      {
+         // Captured scenes are not in the made up scene's units
+         double depthSum = 0.0;
+         size_t numDepths = 0;
+         for (size_t i = 3; i < buffer.texels.size(); i += 4)
+         {
+            if (buffer.texels[i] == 0.0f) continue;
+            depthSum += buffer.texels[i];
+            numDepths++;
+         }
+         if (numDepths) settings.radius = (float)(0.1 * depthSum / numDepths);
+      }
+      out << "  buffer=" << (captured ? SSAO_CAPTURE_FILE : "synthetic") << " " << buffer.width << "x" << buffer.height
+          << "\n";
+
+      const unsigned int NUM_REFERENCE_FRAMES = 16;
+      SsaoSettings referenceSettings = settings;
+      referenceSettings.numSamples = MAX_SSAO_SAMPLES;
+      vector<float> reference;
+      for (unsigned int frame = 0; frame < NUM_REFERENCE_FRAMES; frame++)
+      {
+         SetupSsaoConstants(referenceSettings, buffer.width, buffer.height, buffer.tanHalfFovX, buffer.tanHalfFovY,
+            NULL, frame, &constants);
+         ComputeSsaoReference(buffer, constants, &ao);
+         if (reference.empty()) reference.assign(ao.size(), 0.0f);
+         for (size_t i = 0; i < ao.size(); i++) reference[i] += ao[i] / NUM_REFERENCE_FRAMES;
+      }
+
+      const unsigned int NUM_FRAMES = 16;
+      GetSsaoProjection(buffer, projection);
+      vector<float> history, accumulated(reference.size());
+      double firstError = 0.0, lastError = 0.0;
+      for (unsigned int frame = 0; frame < NUM_FRAMES; frame++)
+      {
+         SetupSsaoConstants(settings, buffer.width, buffer.height, buffer.tanHalfFovX, buffer.tanHalfFovY,
+            frame ? projection : NULL, frame, &constants);
+         ComputeSsaoReference(buffer, constants, &ao);
+         AccumulateSsao(buffer, ao, history, constants, &resolved);
+         history.swap(resolved);
+
+         for (size_t i = 0; i < accumulated.size(); i++) accumulated[i] = history[i * 2];
+         double error = MeanAoError(accumulated, reference, vector<bool>());
+         if (frame == 0) firstError = error;
+         lastError = error;
+      }
+      out << "  error against " << MAX_SSAO_SAMPLES << "x" << NUM_REFERENCE_FRAMES << " samples one frame="
+          << firstError << " accumulated=" << lastError << "\n";
+      Check(lastError < 0.6 * firstError, "temporal accumulation converges towards the reference", &results, out);
+
+      // Half resolution against every pixel of the view, the same kernel on
+      // a grid twice the size
+      NormalDepthBuffer doubled;
+      CreateSyntheticNormalDepth(WIDTH * 2, HEIGHT * 2, CAMERA_DISTANCE, &doubled);
+      SetupSsaoConstants(settings, scene.width, scene.height, scene.tanHalfFovX, scene.tanHalfFovY, NULL, 0, &constants);
+      CpuTimer halfTimer;
+      ComputeSsaoReference(scene, constants, &ao);
+      double halfMs = halfTimer.GetElapsedMs();
+      SetupSsaoConstants(settings, doubled.width, doubled.height, doubled.tanHalfFovX, doubled.tanHalfFovY, NULL, 0,
+         &constants);
+      CpuTimer fullTimer;
+      ComputeSsaoReference(doubled, constants, &ao);
+      double fullMs = fullTimer.GetElapsedMs();
+      out << "  " << WIDTH << "x" << HEIGHT << " ms half resolution=" << halfMs << " full resolution=" << fullMs << "\n";
+      Check(fullMs > 2.0 * halfMs, "half resolution costs a fraction of full resolution", &results, out);
+
+      out << "  checks passed=" << results.numChecks - results.numFailed << " of " << results.numChecks << "\n";
+   }
+
+   bool IsScheduled(const RenderGraph &graph, RenderGraphPass pass)
+   {
+      const vector<RenderGraphPass> &schedule = graph.GetSchedule();
+      for (size_t i = 0; i < schedule.size(); i++)
+      {
+         if (schedule[i] == pass) return true;
+      }
+      return false;
+   }
+
+   // Bandwidth of the G-buffer layouts against forward shading, the normal
+   // encoding's precision and the tile light culling of the lighting pass
+   // against every pixel tested with every light
+   void RunDeferredBenchmark(ostream &out)
+   {
+      out << "deferred: G-buffer layouts, octahedral normals and tiled light culling\n";
+
+      CheckResults results = { 0, 0 };
+
+      const float overdraws[] = { 1.0f, 2.0f, 4.0f };
+      ShadingBandwidth forward[3], deferred[NUM_GBUFFER_LAYOUTS][3];
+      for (unsigned int i = 0; i < 3; i++)
+      {
+         ComputeForwardBandwidth(overdraws[i], &forward[i]);
+         out << "  overdraw=" << overdraws[i] << " forward bytes/pixel=" << forward[i].totalBytes;
+         for (unsigned int type = 0; type < NUM_GBUFFER_LAYOUTS; type++)
+         {
+            GBufferLayout layout;
+            GetGBufferLayout((GBufferLayoutType)type, &layout);
+            ComputeDeferredBandwidth(layout, overdraws[i], &deferred[type][i]);
+            out << " " << layout.name << " bytes/pixel=" << deferred[type][i].totalBytes
+                << " (gbuffer=" << deferred[type][i].gbufferBytes
+                << " geometry=" << deferred[type][i].geometryBytes
+                << " lighting=" << deferred[type][i].lightingBytes << ")";
+         }
+         out << "\n";
+      }
+      Check(deferred[GBUFFER_LAYOUT_COMPACT][0].gbufferBytes * 4 < deferred[GBUFFER_LAYOUT_WIDE][0].gbufferBytes,
+         "the compact layout is under a quarter of the wide one", &results, out);
+      Check(deferred[GBUFFER_LAYOUT_COMPACT][2].totalBytes < 2.0 * forward[2].totalBytes,
+         "the compact layout stays within twice forward at high overdraw", &results, out);
+
+      // Normals over the sphere, including the poles and the fold's edges
+      double maxErrorDegrees = 0.0;
+      const unsigned int RINGS = 64, SEGMENTS = 128;
+      for (unsigned int ring = 0; ring <= RINGS; ring++)
+      {
+         for (unsigned int segment = 0; segment < SEGMENTS; segment++)
+         {
+            float theta = 3.14159265f * ring / RINGS;
+            float phi = 2.0f * 3.14159265f * segment / SEGMENTS;
+            float normal[3] = { sinf(theta) * cosf(phi), sinf(theta) * sinf(phi), cosf(theta) };
+            float decoded[3];
+            DecodeOctahedralNormal(EncodeOctahedralNormal(normal), decoded);
+            double dot = (double)normal[0] * decoded[0] + (double)normal[1] * decoded[1] + (double)normal[2] * decoded[2];
+            if (dot > 1.0) dot = 1.0;
+            double errorDegrees = acos(dot) * 180.0 / 3.14159265;
+            if (errorDegrees > maxErrorDegrees) maxErrorDegrees = errorDegrees;
+         }
+      }
+      out << "  octahedral normal max error degrees=" << maxErrorDegrees << "\n";
+      Check(maxErrorDegrees < 0.05, "32 bit octahedral normals are within 0.05 degrees", &results, out);
+
+      // Lights scattered through the made up SSAO scene's room
+      const unsigned int WIDTH = 640, HEIGHT = 480;
+      const float CAMERA_DISTANCE = 6.0f;
+      NormalDepthBuffer scene;
+      CreateSyntheticNormalDepth(WIDTH, HEIGHT, CAMERA_DISTANCE, &scene);
+
+      const float NEAR_Z = 0.1f, FAR_Z = 100.0f;
+      float identity[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+      DeferredConstants constants;
+      SetupDeferredConstants(identity, 2.0f * atanf(scene.tanHalfFovY), scene.tanHalfFovX / scene.tanHalfFovY, NEAR_Z,
+         FAR_Z, WIDTH, HEIGHT, MAX_CLUSTER_LIGHTS, &constants);
+
+      float boundsMin[3] = { -3.0f, -1.5f, 1.0f }, boundsMax[3] = { 3.0f, 2.5f, CAMERA_DISTANCE + 0.5f };
+      vector<ClusterLight> lights;
+      CreateRandomLights(boundsMin, boundsMax, 256, 0.75f, 11, &lights);
+      constants.numLights = (unsigned int)lights.size();
+
+      unsigned int tilesY = (HEIGHT + DEFERRED_TILE_SIZE - 1) / DEFERRED_TILE_SIZE;
+      unsigned long long listedLights = 0, neededLights = 0, missedLights = 0;
+      unsigned int numTiles = 0;
+      double depthError = 0.0;
+      vector<unsigned int> indices;
+      vector<bool> listed(lights.size());
+      CpuTimer cullTimer;
+      double cullMs = 0.0;
+      for (unsigned int tileY = 0; tileY < tilesY; tileY++)
+      {
+         for (unsigned int tileX = 0; tileX < constants.tilesX; tileX++)
+         {
+            // The depth range goes through the depth buffer's encoding like
+            // the lighting pass's does
+            unsigned int x0 = tileX * DEFERRED_TILE_SIZE, y0 = tileY * DEFERRED_TILE_SIZE;
+            float minZ = FLT_MAX, maxZ = -FLT_MAX;
+            for (unsigned int y = y0; y < y0 + DEFERRED_TILE_SIZE && y < HEIGHT; y++)
+            {
+               for (unsigned int x = x0; x < x0 + DEFERRED_TILE_SIZE && x < WIDTH; x++)
+               {
+                  float z = scene.texels[(y * WIDTH + x) * 4 + 3];
+                  if (z <= 0.0f) continue;
+                  float depth = FAR_Z * (z - NEAR_Z) / (z * (FAR_Z - NEAR_Z));
+                  float viewZ = GetViewDepth(constants, depth);
+                  if (fabs(viewZ - z) / z > depthError) depthError = fabs(viewZ - z) / z;
+                  if (viewZ < minZ) minZ = viewZ;
+                  if (viewZ > maxZ) maxZ = viewZ;
+               }
+            }
+
+            CpuTimer tileTimer;
+            CullTileLights(constants, lights, tileX, tileY, minZ, maxZ, &indices);
+            cullMs += tileTimer.GetElapsedMs();
+            listedLights += indices.size();
+            numTiles++;
+
+            listed.assign(lights.size(), false);
+            for (size_t i = 0; i < indices.size(); i++) listed[indices[i]] = true;
+            for (size_t light = 0; light < lights.size(); light++)
+            {
+               bool needed = false;
+               const float *p = lights[light].position;
+               float rangeSq = lights[light].range * lights[light].range;
+               for (unsigned int y = y0; y < y0 + DEFERRED_TILE_SIZE && y < HEIGHT && !needed; y++)
+               {
+                  for (unsigned int x = x0; x < x0 + DEFERRED_TILE_SIZE && x < WIDTH && !needed; x++)
+                  {
+                     float z = scene.texels[(y * WIDTH + x) * 4 + 3];
+                     if (z <= 0.0f) continue;
+                     float ndcX = (x + 0.5f) / WIDTH * 2.0f - 1.0f;
+                     float ndcY = 1.0f - (y + 0.5f) / HEIGHT * 2.0f;
+                     float d[3] = { ndcX * scene.tanHalfFovX * z - p[0], ndcY * scene.tanHalfFovY * z - p[1], z - p[2] };
+                     needed = d[0] * d[0] + d[1] * d[1] + d[2] * d[2] < rangeSq;
+                  }
+               }
+               if (!needed) continue;
+               neededLights++;
+               if (!listed[light]) missedLights++;
+            }
+         }
+      }
+      double totalMs = cullTimer.GetElapsedMs();
+      out << "  " << WIDTH << "x" << HEIGHT << " tiles=" << numTiles << " lights=" << lights.size()
+          << " listed/tile=" << (double)listedLights / numTiles << " lit/tile=" << (double)neededLights / numTiles
+          << " missed=" << missedLights << " cull ms=" << cullMs << " (with reference " << totalMs << ")\n";
+      Check(depthError < 1e-3, "view depth survives the depth buffer encoding", &results, out);
+      Check(missedLights == 0, "tile lists hold every light reaching a pixel of the tile", &results, out);
+      Check(listedLights < (unsigned long long)numTiles * lights.size() / 4, "tiles list a fraction of the lights",
+         &results, out);
+
+      // Both modes compile, only deferred shading schedules its passes
+      for (unsigned int mode = 0; mode < 2; mode++)
+      {
+         ScenePassResources res;
+         vector<SceneDrawItem> items;
+         CreateSyntheticScene(64, &res, &items);
+         res.deferredShading = mode == 1;
+
+         RenderGraph graph;
+         SceneGraphPasses passes;
+         DeclareSceneGraph(&graph, res, &passes);
+         string errors;
+         bool compiled = graph.Compile(&errors);
+
+         const double MB = 1024.0 * 1024.0;
+         out << "  " << (res.deferredShading ? "deferred" : "forward") << " passes=" << graph.GetSchedule().size()
+             << " committed MB=" << graph.GetMemoryStats().committedBytes / MB << "\n" << errors;
+         if (res.deferredShading)
+         {
+            Check(compiled && IsScheduled(graph, passes.deferredLighting) && IsScheduled(graph, passes.deferredComposite),
+               "the deferred graph compiles with its lighting and composite passes", &results, out);
+         }
+         else
+         {
+            Check(compiled && passes.deferredLighting == (RenderGraphPass)-1, "the forward graph compiles without them",
+               &results, out);
+         }
+      }
+
+      out << "  checks passed=" << results.numChecks - results.numFailed << " of " << results.numChecks << "\n";
+   }
+
+   // Quad around center spanned by u and v, front facing for a camera it is
+   // drawn clockwise for: the side u x v points away from
+   void AddOverdrawQuad(const float center[3], const float u[3], const float v[3], OverdrawMesh *pMesh)
+   {
+      unsigned int first = (unsigned int)pMesh->positions.size() / 3;
+      const float signs[4][2] = { { -1.0f, 1.0f }, { 1.0f, 1.0f }, { 1.0f, -1.0f }, { -1.0f, -1.0f } };
+      for (unsigned int corner = 0; corner < 4; corner++)
+      {
+         for (unsigned int c = 0; c < 3; c++)
+         {
+            pMesh->positions.push_back(center[c] + signs[corner][0] * u[c] + signs[corner][1] * v[c]);
+         }
+      }
+      const unsigned int indices[6] = { 0, 1, 2, 0, 2, 3 };
+      for (unsigned int i = 0; i < 6; i++) pMesh->indices.push_back(first + indices[i]);
+   }
+
+   void AddOverdrawBox(const float center[3], const float halfSize[3], OverdrawMesh *pMesh)
+   {
+      for (unsigned int axis = 0; axis < 3; axis++)
+      {
+         for (int side = -1; side <= 1; side += 2)
+         {
+            // u x v points inwards, the face is seen from outside
+            unsigned int uAxis = (axis + 1) % 3, vAxis = (axis + 2) % 3;
+            float faceCenter[3] = { center[0], center[1], center[2] };
+            faceCenter[axis] += side * halfSize[axis];
+            float u[3] = { 0.0f, 0.0f, 0.0f }, v[3] = { 0.0f, 0.0f, 0.0f };
+            u[uAxis] = -side * halfSize[uAxis];
+            v[vAxis] = halfSize[vAxis];
+            AddOverdrawQuad(faceCenter, u, v, pMesh);
+         }
+      }
+   }
+
+   // Row vector matrix of XMMatrixPerspectiveFovLH
+   void GetOverdrawProjection(float fovY, float aspect, float nearZ, float farZ, float projection[16])
+   {
+      memset(projection, 0, 16 * sizeof(float));
+      projection[5] = 1.0f / tanf(fovY * 0.5f);
+      projection[0] = projection[5] / aspect;
+      projection[10] = farZ / (farZ - nearZ);
+      projection[11] = 1.0f;
+      projection[14] = -nearZ * farZ / (farZ - nearZ);
+   }
+
+   void DrawOverdrawMeshes(const vector<OverdrawMesh> &meshes, const vector<unsigned int> &order,
+      const float viewProj[16], unsigned int width, unsigned int height, OverdrawEstimate *pEstimate)
+   {
+      const float identity[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+      OverdrawEstimator estimator;
+      estimator.Begin(width, height);
+      for (size_t i = 0; i < order.size(); i++) estimator.DrawMesh(meshes[order[i]], identity, viewProj);
+      estimator.Finish(pEstimate);
+   }
+
+   // Overdraw of a few stacked quads and of a colonnade in the spirit of
+   // Sponza's atrium seen down its length, in different submission orders,
+   // and the frame graph with the pre-pass in front of the main pass
+   void RunDepthPrepassBenchmark(ostream &out)
+   {
+      out << "depth_prepass: overdraw estimate and depth pre-pass\n";
+
+      CheckResults results = { 0, 0 };
+      const unsigned int WIDTH = 160, HEIGHT = 90;
+      float viewProj[16];
+      GetOverdrawProjection(3.14159265f / 3.0f, (float)WIDTH / HEIGHT, 0.1f, 100.0f, viewProj);
+
+      // Screen filling quads, the first is the farthest
+      const unsigned int NUM_LAYERS = 4;
+      vector<OverdrawMesh> layers(NUM_LAYERS);
+      for (unsigned int layer = 0; layer < NUM_LAYERS; layer++)
+      {
+         float center[3] = { 0.0f, 0.0f, 10.0f - 2.0f * layer };
+         float u[3] = { 20.0f, 0.0f, 0.0f }, v[3] = { 0.0f, 20.0f, 0.0f };
+         AddOverdrawQuad(center, u, v, &layers[layer]);
+      }
+      vector<unsigned int> backToFront, frontToBack;
+      for (unsigned int layer = 0; layer < NUM_LAYERS; layer++)
+      {
+         backToFront.push_back(layer);
+         frontToBack.push_back(NUM_LAYERS - 1 - layer);
+      }
+      OverdrawEstimate stacked, sorted;
+      DrawOverdrawMeshes(layers, backToFront, viewProj, WIDTH, HEIGHT, &stacked);
+      DrawOverdrawMeshes(layers, frontToBack, viewProj, WIDTH, HEIGHT, &sorted);
+      out << "  " << NUM_LAYERS << " layers back to front overdraw=" << GetOverdraw(stacked)
+          << " front to back=" << GetOverdraw(sorted) << "\n";
+      Check(stacked.coveredPixels == WIDTH * HEIGHT && stacked.rasterizedFragments == NUM_LAYERS * WIDTH * HEIGHT,
+         "every layer covers every pixel once, shared edges included", &results, out);
+      Check(GetOverdraw(stacked) == NUM_LAYERS && GetOverdraw(sorted) == 1.0,
+         "back to front shades every layer, front to back only the nearest", &results, out);
+
+      // The same quad wound the other way faces away
+      vector<OverdrawMesh> flipped(1);
+      {
+         float center[3] = { 0.0f, 0.0f, 5.0f };
+         float u[3] = { -1.0f, 0.0f, 0.0f }, v[3] = { 0.0f, 1.0f, 0.0f };
+         AddOverdrawQuad(center, u, v, &flipped[0]);
+      }
+      OverdrawEstimate culled;
+      DrawOverdrawMeshes(flipped, vector<unsigned int>(1, 0), viewProj, WIDTH, HEIGHT, &culled);
+      Check(culled.rasterizedFragments == 0, "back faces are culled", &results, out);
+
+      // A floor running from behind the camera is clipped at the near plane
+      vector<OverdrawMesh> floorMesh(1);
+      {
+         float center[3] = { 0.0f, -2.0f, 15.0f };
+         float u[3] = { 10.0f, 0.0f, 0.0f }, v[3] = { 0.0f, 0.0f, 20.0f };
+         AddOverdrawQuad(center, u, v, &floorMesh[0]);
+      }
+      OverdrawEstimate floorEstimate;
+      DrawOverdrawMeshes(floorMesh, vector<unsigned int>(1, 0), viewProj, WIDTH, HEIGHT, &floorEstimate);
+      Check(floorEstimate.coveredPixels > WIDTH * HEIGHT / 4 && floorEstimate.coveredPixels < WIDTH * HEIGHT / 2 &&
+         floorEstimate.shadedFragments == floorEstimate.coveredPixels, "geometry behind the camera is clipped",
+         &results, out);
+
+      // Two rows of columns between a floor and the far wall, with arches
+      // of boxes spanning every other pair
+      vector<OverdrawMesh> atrium;
+      atrium.push_back(floorMesh[0]);
+      atrium.push_back(OverdrawMesh());
+      {
+         float center[3] = { 0.0f, 4.0f, 35.0f };
+         float u[3] = { 12.0f, 0.0f, 0.0f }, v[3] = { 0.0f, 6.0f, 0.0f };
+         AddOverdrawQuad(center, u, v, &atrium.back());
+      }
+      const unsigned int NUM_COLUMNS = 8;
+      for (unsigned int column = 0; column < NUM_COLUMNS; column++)
+      {
+         for (int side = -1; side <= 1; side += 2)
+         {
+            atrium.push_back(OverdrawMesh());
+            float center[3] = { side * 4.0f, 1.0f, 3.0f + 4.0f * column };
+            float halfSize[3] = { 0.5f, 3.0f, 0.5f };
+            AddOverdrawBox(center, halfSize, &atrium.back());
+            if (column % 2 == 0)
+            {
+               float archCenter[3] = { side * 4.0f, 4.5f, 5.0f + 4.0f * column };
+               float archHalfSize[3] = { 0.5f, 0.5f, 2.5f };
+               AddOverdrawBox(archCenter, archHalfSize, &atrium.back());
+            }
+         }
+      }
+      vector<unsigned int> sceneOrder, farFirst, nearFirst;
+      for (unsigned int mesh = 0; mesh < atrium.size(); mesh++) sceneOrder.push_back(mesh);
+      farFirst.push_back(1);
+      farFirst.push_back(0);
+      for (unsigned int mesh = (unsigned int)atrium.size() - 1; mesh >= 2; mesh--) farFirst.push_back(mesh);
+      for (unsigned int mesh = 2; mesh < atrium.size(); mesh++) nearFirst.push_back(mesh);
+      nearFirst.push_back(0);
+      nearFirst.push_back(1);
+
+      const vector<unsigned int> *orders[3] = { &sceneOrder, &farFirst, &nearFirst };
+      const char *orderNames[3] = { "scene order", "far first", "near first" };
+      DepthPrepassSettings settings;
+      GetDefaultDepthPrepassSettings(&settings);
+      OverdrawEstimate estimates[3];
+      for (unsigned int order = 0; order < 3; order++)
+      {
+         CpuTimer timer;
+         for (unsigned int frame = 0; frame < NUM_BENCHMARK_FRAMES; frame++)
+         {
+            DrawOverdrawMeshes(atrium, *orders[order], viewProj, WIDTH, HEIGHT, &estimates[order]);
+         }
+         double ms = timer.GetElapsedMs() / NUM_BENCHMARK_FRAMES;
+         bool prepass = ChooseDepthPrepass(DEPTH_PREPASS_AUTO, settings, estimates[order], false);
+         out << "  atrium " << orderNames[order] << " overdraw=" << GetOverdraw(estimates[order])
+             << " rasterized/pixel=" << (double)estimates[order].rasterizedFragments / estimates[order].coveredPixels
+             << " pre-pass saves=" << 100.0 * GetSavedShadingFraction(estimates[order]) << "% of shading"
+             << " auto=" << (prepass ? "on" : "off") << " estimate ms=" << ms << "\n";
+      }
+      Check(GetOverdraw(estimates[1]) > GetOverdraw(estimates[0]) && GetOverdraw(estimates[0]) > GetOverdraw(estimates[2]),
+         "the estimate follows the submission order", &results, out);
+      Check(estimates[1].coveredPixels == estimates[2].coveredPixels &&
+         estimates[1].rasterizedFragments == estimates[2].rasterizedFragments,
+         "the order only changes what is shaded", &results, out);
+
+      // Hysteresis around the thresholds
+      OverdrawEstimate between = estimates[0];
+      between.coveredPixels = 1000;
+      between.shadedFragments = (unsigned long long)(1000 * (settings.enableOverdraw + settings.disableOverdraw) / 2);
+      Check(ChooseDepthPrepass(DEPTH_PREPASS_AUTO, settings, between, true) &&
+         !ChooseDepthPrepass(DEPTH_PREPASS_AUTO, settings, between, false) &&
+         ChooseDepthPrepass(DEPTH_PREPASS_ON, settings, sorted, false) &&
+         !ChooseDepthPrepass(DEPTH_PREPASS_OFF, settings, stacked, true),
+         "the automatic mode keeps its choice between the thresholds", &results, out);
+
+      // The pre-pass runs before the main pass in both shading modes
+      for (unsigned int mode = 0; mode < 2; mode++)
+      {
+         ScenePassResources res;
+         vector<SceneDrawItem> items;
+         CreateSyntheticScene(64, &res, &items);
+         res.deferredShading = mode == 1;
+         res.depthPrepass = true;
+
+         RenderGraph graph;
+         SceneGraphPasses passes;
+         DeclareSceneGraph(&graph, res, &passes);
+         string errors;
+         bool compiled = graph.Compile(&errors);
+         out << errors;
+
+         const vector<RenderGraphPass> &schedule = graph.GetSchedule();
+         size_t prepassIndex = schedule.size(), mainIndex = schedule.size();
+         for (size_t i = 0; i < schedule.size(); i++)
+         {
+            if (schedule[i] == passes.depthPrepass) prepassIndex = i;
+            if (schedule[i] == passes.scenePasses[MAIN_PASS]) mainIndex = i;
+         }
+         Check(compiled && prepassIndex < mainIndex && mainIndex < schedule.size(),
+            res.deferredShading ? "the pre-pass runs before the G-buffer pass" : "the pre-pass runs before the main pass",
+            &results, out);
+      }
+
+      out << "  checks passed=" << results.numChecks - results.numFailed << " of " << results.numChecks << "\n";
+   }
+
+   // Blends a pixel's fragments like the resolve should, in double: sorted
+   // front to back, the nearest MAX_OIT_FRAGMENTS_PER_PIXEL back to front
+   void ResolveOitReference(vector<OitNode> fragments, double color[3], double *pTransmittance)
+   {
+      for (size_t i = 1; i < fragments.size(); i++)
+      {
+         OitNode fragment = fragments[i];
+         size_t j = i;
+         for (; j > 0 && fragments[j - 1].depth > fragment.depth; j--) fragments[j] = fragments[j - 1];
+         fragments[j] = fragment;
+      }
+      if (fragments.size() > MAX_OIT_FRAGMENTS_PER_PIXEL) fragments.resize(MAX_OIT_FRAGMENTS_PER_PIXEL);
+
+      color[0] = color[1] = color[2] = 0.0;
+      *pTransmittance = 1.0;
+      for (size_t i = fragments.size(); i > 0; i--)
+      {
+         float fragmentColor[4];
+         UnpackOitColor(fragments[i - 1].color, fragmentColor);
+         for (unsigned int c = 0; c < 3; c++)
+         {
+            color[c] = fragmentColor[c] * fragmentColor[3] + color[c] * (1.0 - fragmentColor[3]);
+         }
+         *pTransmittance *= 1.0 - fragmentColor[3];
+      }
+   }
+
+   // Random transparent fragments inserted into the per-pixel lists in a
+   // shuffled order and resolved against a sorted reference, the lists
+   // running out of nodes, the buffer sized to the counted fragments and
+   // its memory against the per-pixel color buffer it replaced
+   void RunABufferBenchmark(ostream &out)
+   {
+      out << "abuffer: per-pixel linked lists of transparent fragments\n";
+
+      CheckResults results = { 0, 0 };
+      const unsigned int WIDTH = 64, HEIGHT = 48;
+
+      // Up to half again as many fragments as the resolve keeps, a third of
+      // the pixels have none
+      unsigned int seed = 2024;
+      vector<unsigned int> fragmentPixels;
+      vector<OitNode> fragments;
+      vector<vector<OitNode> > pixelFragments(WIDTH * HEIGHT);
+      for (unsigned int pixel = 0; pixel < WIDTH * HEIGHT; pixel++)
+      {
+         seed = seed * 1664525u + 1013904223u;
+         unsigned int count = (seed >> 8) % (MAX_OIT_FRAGMENTS_PER_PIXEL * 3 / 2 + 1);
+         if (pixel % 3 == 0) count = 0;
+         for (unsigned int f = 0; f < count; f++)
+         {
+            float color[4];
+            for (unsigned int c = 0; c < 4; c++)
+            {
+               seed = seed * 1664525u + 1013904223u;
+               color[c] = (float)(seed >> 8) / 16777216.0f;
+            }
+            seed = seed * 1664525u + 1013904223u;
+            OitNode fragment;
+            fragment.color = PackOitColor(color);
+            fragment.depth = (float)(seed >> 8) / 16777216.0f;
+            fragment.next = 0;
+            fragments.push_back(fragment);
+            fragmentPixels.push_back(pixel);
+            pixelFragments[pixel].push_back(fragment);
+         }
+      }
+      vector<unsigned int> order(fragments.size());
+      for (size_t i = 0; i < order.size(); i++) order[i] = (unsigned int)i;
+      for (size_t i = order.size(); i > 1; i--)
+      {
+         seed = seed * 1664525u + 1013904223u;
+         size_t j = (seed >> 8) % i;
+         unsigned int swapped = order[i - 1];
+         order[i - 1] = order[j];
+         order[j] = swapped;
+      }
+
+      ABuffer buffer;
+      unsigned int numFragments = (unsigned int)fragments.size();
+      CpuTimer insertTimer;
+      bool allInserted = true;
+      for (unsigned int frame = 0; frame < NUM_BENCHMARK_FRAMES; frame++)
+      {
+         buffer.Begin(WIDTH, HEIGHT, numFragments);
+         for (size_t i = 0; i < order.size(); i++)
+         {
+            const OitNode &fragment = fragments[order[i]];
+            unsigned int pixel = fragmentPixels[order[i]];
+            float color[4];
+            UnpackOitColor(fragment.color, color);
+            allInserted &= buffer.Insert(pixel % WIDTH, pixel / WIDTH, color, fragment.depth);
+         }
+      }
+      double insertMs = insertTimer.GetElapsedMs() / NUM_BENCHMARK_FRAMES;
+
+      bool countsMatch = buffer.GetNodeCount() == numFragments;
+      double maxError = 0.0;
+      unsigned int numTruncated = 0;
+      CpuTimer resolveTimer;
+      for (unsigned int pixel = 0; pixel < WIDTH * HEIGHT; pixel++)
+      {
+         unsigned int x = pixel % WIDTH, y = pixel / WIDTH;
+         countsMatch &= buffer.GetFragmentCount(x, y) == pixelFragments[pixel].size();
+         if (pixelFragments[pixel].size() > MAX_OIT_FRAGMENTS_PER_PIXEL) numTruncated++;
+
+         float color[3], transmittance;
+         buffer.Resolve(x, y, color, &transmittance);
+         double referenceColor[3], referenceTransmittance;
+         ResolveOitReference(pixelFragments[pixel], referenceColor, &referenceTransmittance);
+         double error = fabs(transmittance - referenceTransmittance);
+         for (unsigned int c = 0; c < 3; c++)
+         {
+            if (fabs(color[c] - referenceColor[c]) > error) error = fabs(color[c] - referenceColor[c]);
+         }
+         if (error > maxError) maxError = error;
+      }
+      double resolveMs = resolveTimer.GetElapsedMs();
+      out << "  " << WIDTH << "x" << HEIGHT << " fragments=" << numFragments << " truncated pixels=" << numTruncated
+          << " insert ms=" << insertMs << " resolve ms=" << resolveMs << " max error=" << maxError << "\n";
+      Check(allInserted && countsMatch, "every fragment lands in its pixel's list", &results, out);
+      Check(maxError < 1e-5, "the resolve matches sorted blending of the nearest fragments", &results, out);
+
+      // Past the capacity fragments are dropped but still counted
+      const unsigned int capacity = numFragments / 2;
+      buffer.Begin(WIDTH, HEIGHT, capacity);
+      unsigned int numDropped = 0;
+      for (size_t i = 0; i < order.size(); i++)
+      {
+         const OitNode &fragment = fragments[order[i]];
+         unsigned int pixel = fragmentPixels[order[i]];
+         float color[4];
+         UnpackOitColor(fragment.color, color);
+         if (!buffer.Insert(pixel % WIDTH, pixel / WIDTH, color, fragment.depth)) numDropped++;
+      }
+      unsigned int numListed = 0;
+      for (unsigned int pixel = 0; pixel < WIDTH * HEIGHT; pixel++)
+      {
+         numListed += buffer.GetFragmentCount(pixel % WIDTH, pixel / WIDTH);
+      }
+      out << "  capacity=" << capacity << " dropped=" << numDropped << " counted=" << buffer.GetNodeCount() << "\n";
+      Check(numDropped == numFragments - capacity && numListed == capacity && buffer.GetNodeCount() == numFragments,
+         "an overflow drops the fragments past the capacity and counts them", &results, out);
+
+      // Sizing at 1024x768 from the measured fragments, a pane of glass over
+      // a third of the screen seen through another over half of it
+      ABufferSettings settings;
+      GetDefaultABufferSettings(&settings);
+      const unsigned int SCREEN_WIDTH = 1024, SCREEN_HEIGHT = 768;
+      unsigned int measured = SCREEN_WIDTH * SCREEN_HEIGHT / 3 + SCREEN_WIDTH * SCREEN_HEIGHT / 2;
+      unsigned int sized = ChooseABufferCapacity(settings, measured, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
+      unsigned int kept = ChooseABufferCapacity(settings, measured * 3 / 4, sized, SCREEN_WIDTH, SCREEN_HEIGHT);
+      unsigned int shrunk = ChooseABufferCapacity(settings, measured / 8, sized, SCREEN_WIDTH, SCREEN_HEIGHT);
+      unsigned int grown = ChooseABufferCapacity(settings, sized + 1, sized, SCREEN_WIDTH, SCREEN_HEIGHT);
+      unsigned int capped = ChooseABufferCapacity(settings, SCREEN_WIDTH * SCREEN_HEIGHT * 100, sized, SCREEN_WIDTH,
+         SCREEN_HEIGHT);
+      unsigned int empty = ChooseABufferCapacity(settings, 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
+      out << "  measured=" << measured << " capacity=" << sized << " at 3/4=" << kept << " at 1/8=" << shrunk
+          << " past it=" << grown << " capped=" << capped << "\n";
+      Check(sized >= measured && sized % settings.granularity == 0 && kept == sized && shrunk < sized &&
+         shrunk >= measured / 8 && grown > sized + 1, "the capacity follows the measured fragments with hysteresis",
+         &results, out);
+      Check(capped >= SCREEN_WIDTH * SCREEN_HEIGHT * MAX_OIT_FRAGMENTS_PER_PIXEL && capped < SCREEN_WIDTH * SCREEN_HEIGHT *
+         MAX_OIT_FRAGMENTS_PER_PIXEL + settings.granularity && empty == settings.granularity,
+         "the capacity stays between one step and the fragments the resolve can use", &results, out);
+
+      // The color buffer had room for eight fragments per pixel
+      const double MB = 1024.0 * 1024.0;
+      unsigned long long listBytes = GetABufferBytes(SCREEN_WIDTH, SCREEN_HEIGHT, sized);
+      unsigned long long emptyBytes = GetABufferBytes(SCREEN_WIDTH, SCREEN_HEIGHT, empty);
+      unsigned long long colorBufferBytes = GetColorBufferBytes(SCREEN_WIDTH, SCREEN_HEIGHT, 8);
+      out << "  MB lists=" << listBytes / MB << " without transparency=" << emptyBytes / MB
+          << " color buffer=" << colorBufferBytes / MB << "\n";
+      Check(listBytes < colorBufferBytes && emptyBytes < colorBufferBytes / 4,
+         "the lists take a fraction of the color buffer's memory", &results, out);
+
+      // The main view's passes split the draws and the transparent ones are
+      // resolved over the opaque color in both shading modes. Deferred
+      // lighting may run after the transparent pass, it only needs the
+      // G-buffer's depth.
+      for (unsigned int mode = 0; mode < 2; mode++)
+      {
+         ScenePassResources res;
+         vector<SceneDrawItem> items;
+         CreateSyntheticScene(64, &res, &items);
+         res.deferredShading = mode == 1;
+         unsigned int numTransparent = 0;
+         for (size_t i = 0; i < items.size(); i++)
+         {
+            items[i].transparent = i % 4 == 0;
+            if (items[i].transparent) numTransparent++;
+         }
+
+         DrawChunk allDraws = { 0, (unsigned int)items.size() };
+         CommandBuffer opaqueCmds, transparentCmds;
+         RecordScenePass(&opaqueCmds, res, items, MAIN_PASS, allDraws);
+         RecordTransparentPass(&transparentCmds, res, items, allDraws);
+         NullCommandBackend opaqueBackend, transparentBackend;
+         opaqueBackend.Execute(opaqueCmds);
+         transparentBackend.Execute(transparentCmds);
+         unsigned int opaqueDraws = opaqueBackend.GetStats().commandCounts[CMD_DRAW_INDEXED_INSTANCED_INDIRECT];
+         unsigned int transparentDraws = transparentBackend.GetStats().commandCounts[CMD_DRAW_INDEXED_INSTANCED_INDIRECT];
+
+         RenderGraph graph;
+         SceneGraphPasses passes;
+         DeclareSceneGraph(&graph, res, &passes);
+         string errors;
+         bool compiled = graph.Compile(&errors);
+         out << errors;
+
+         const vector<RenderGraphPass> &schedule = graph.GetSchedule();
+         RenderGraphPass lastOpaque = res.deferredShading ? passes.deferredComposite : passes.scenePasses[MAIN_PASS];
+         size_t mainIndex = schedule.size(), opaqueIndex = schedule.size(), transparentIndex = schedule.size();
+         size_t resolveIndex = schedule.size();
+         for (size_t i = 0; i < schedule.size(); i++)
+         {
+            if (schedule[i] == passes.scenePasses[MAIN_PASS]) mainIndex = i;
+            if (schedule[i] == lastOpaque) opaqueIndex = i;
+            if (schedule[i] == passes.transparent) transparentIndex = i;
+            if (schedule[i] == passes.oitResolve) resolveIndex = i;
+         }
+         Check(compiled && opaqueDraws == items.size() - numTransparent && transparentDraws == numTransparent &&
+            mainIndex < transparentIndex && transparentIndex < resolveIndex && opaqueIndex < resolveIndex &&
+            resolveIndex < schedule.size(),
+            res.deferredShading ? "the lists are resolved over the deferred composite" :
+            "the lists are resolved over the main pass", &results, out);
+
+         // The renderer skips the list passes without transparent draws or
+         // while the weighted technique is chosen, OitHeads is then unused
+         graph.SetPassMode(passes.transparent, GRAPH_PASS_SKIP);
+         graph.SetPassMode(passes.oitResolve, GRAPH_PASS_SKIP);
+         bool bothSkipped = graph.ValidatePassModes(NULL);
+         graph.SetPassMode(passes.oitResolve, GRAPH_PASS_RUN);
+         bool resolveOnly = graph.ValidatePassModes(NULL);
+         Check(compiled && bothSkipped && !resolveOnly,
+            "the list passes can be skipped together but not the writer alone", &results, out);
+      }
+
+      out << "  checks passed=" << results.numChecks - results.numFailed << " of " << results.numChecks << "\n";
+   }
+
+   // The weighted blending against the sorted lists on the same random
+   // fragments: the transmittance is exact, the color an approximation that
+   // favours the nearer fragments. Its memory and traffic are compared to
+   // the lists' at a few depth complexities, and the graph runs it in both
+   // shading modes.
+   void RunWeightedOitBenchmark(ostream &out)
+   {
+      out << "weighted_oit: weighted blended transparency against the per-pixel lists\n";
+
+      CheckResults results = { 0, 0 };
+      const unsigned int WIDTH = 64, HEIGHT = 48;
+
+      // No more fragments than the lists keep so they are exact
+      unsigned int seed = 4242;
+      vector<unsigned int> fragmentPixels;
+      vector<OitNode> fragments;
+      vector<vector<OitNode> > pixelFragments(WIDTH * HEIGHT);
+      for (unsigned int pixel = 0; pixel < WIDTH * HEIGHT; pixel++)
+      {
+         seed = seed * 1664525u + 1013904223u;
+         unsigned int count = 1 + (seed >> 8) % MAX_OIT_FRAGMENTS_PER_PIXEL;
+         for (unsigned int f = 0; f < count; f++)
+         {
+            float color[4];
+            for (unsigned int c = 0; c < 4; c++)
+            {
+               seed = seed * 1664525u + 1013904223u;
+               color[c] = (float)(seed >> 8) / 16777216.0f;
+            }
+            seed = seed * 1664525u + 1013904223u;
+            OitNode fragment;
+            fragment.color = PackOitColor(color);
+            fragment.depth = (float)(seed >> 8) / 16777216.0f;
+            fragment.next = 0;
+            fragments.push_back(fragment);
+            fragmentPixels.push_back(pixel);
+            pixelFragments[pixel].push_back(fragment);
+         }
+      }
+
+      WeightedOitBuffer weighted, reversed;
+      CpuTimer accumulateTimer;
+      for (unsigned int frame = 0; frame < NUM_BENCHMARK_FRAMES; frame++)
+      {
+         weighted.Begin(WIDTH, HEIGHT);
+         for (size_t i = 0; i < fragments.size(); i++)
+         {
+            float color[4];
+            UnpackOitColor(fragments[i].color, color);
+            weighted.Accumulate(fragmentPixels[i] % WIDTH, fragmentPixels[i] / WIDTH, color, fragments[i].depth);
+         }
+      }
+      double accumulateMs = accumulateTimer.GetElapsedMs() / NUM_BENCHMARK_FRAMES;
+      reversed.Begin(WIDTH, HEIGHT);
+      for (size_t i = fragments.size(); i > 0; i--)
+      {
+         float color[4];
+         UnpackOitColor(fragments[i - 1].color, color);
+         reversed.Accumulate(fragmentPixels[i - 1] % WIDTH, fragmentPixels[i - 1] / WIDTH, color, fragments[i - 1].depth);
+      }
+
+      double maxTransmittanceError = 0.0, maxOrderError = 0.0, singleError = 0.0;
+      double sumColorError = 0.0, maxColorError = 0.0;
+      for (unsigned int pixel = 0; pixel < WIDTH * HEIGHT; pixel++)
+      {
+         unsigned int x = pixel % WIDTH, y = pixel / WIDTH;
+         float color[3], transmittance, reversedColor[3], reversedTransmittance;
+         weighted.Resolve(x, y, color, &transmittance);
+         reversed.Resolve(x, y, reversedColor, &reversedTransmittance);
+         double referenceColor[3], referenceTransmittance;
+         ResolveOitReference(pixelFragments[pixel], referenceColor, &referenceTransmittance);
+
+         double transmittanceError = fabs(transmittance - referenceTransmittance);
+         if (transmittanceError > maxTransmittanceError) maxTransmittanceError = transmittanceError;
+         double colorError = 0.0, orderError = fabs(transmittance - reversedTransmittance);
+         for (unsigned int c = 0; c < 3; c++)
+         {
+            if (fabs(color[c] - referenceColor[c]) > colorError) colorError = fabs(color[c] - referenceColor[c]);
+            if (fabs(color[c] - reversedColor[c]) > orderError) orderError = fabs(color[c] - reversedColor[c]);
+         }
+         sumColorError += colorError;
+         if (colorError > maxColorError) maxColorError = colorError;
+         if (orderError > maxOrderError) maxOrderError = orderError;
+         if (pixelFragments[pixel].size() == 1 && colorError > singleError) singleError = colorError;
+      }
+      double meanColorError = sumColorError / (WIDTH * HEIGHT);
+      out << "  " << WIDTH << "x" << HEIGHT << " fragments=" << fragments.size() << " accumulate ms=" << accumulateMs
+          << " transmittance error=" << maxTransmittanceError << " color error mean=" << meanColorError
+          << " max=" << maxColorError << " single fragment=" << singleError << " order=" << maxOrderError << "\n";
+
+      // The revealage is rounded to 8 bits after every blend
+      Check(maxTransmittanceError < MAX_OIT_FRAGMENTS_PER_PIXEL * 0.5 / 255.0 + 1e-4 && maxOrderError < 0.01,
+         "the transmittance is the product of the fragments' in any order", &results, out);
+      Check(singleError < 0.01 && meanColorError < 0.1,
+         "single fragments are exact and overlapping ones close to sorted blending", &results, out);
+
+      // A near red fragment in front of a far blue one of the same alpha
+      const float NEAR_RED[4] = { 1.0f, 0.0f, 0.0f, 0.5f };
+      const float FAR_BLUE[4] = { 0.0f, 0.0f, 1.0f, 0.5f };
+      weighted.Begin(1, 1);
+      weighted.Accumulate(0, 0, FAR_BLUE, 0.95f);
+      weighted.Accumulate(0, 0, NEAR_RED, 0.2f);
+      float pairColor[3], pairTransmittance;
+      weighted.Resolve(0, 0, pairColor, &pairTransmittance);
+      out << "  near red over far blue=" << pairColor[0] << "," << pairColor[2] << "\n";
+      Check(pairColor[0] > 0.5f * pairColor[2] + 0.5f && pairColor[0] + pairColor[2] < 0.76f,
+         "the weights favour the nearer fragment", &results, out);
+
+      // Memory and traffic at 1024x768, the lists sized to the fragments
+      const unsigned int SCREEN_WIDTH = 1024, SCREEN_HEIGHT = 768;
+      const double MB = 1024.0 * 1024.0;
+      ABufferSettings settings;
+      GetDefaultABufferSettings(&settings);
+      const float COMPLEXITIES[] = { 0.25f, 1.0f, 4.0f };
+      bool weightedCheaper = true;
+      for (unsigned int i = 0; i < sizeof(COMPLEXITIES) / sizeof(COMPLEXITIES[0]); i++)
+      {
+         unsigned int numFragments = (unsigned int)(SCREEN_WIDTH * SCREEN_HEIGHT * COMPLEXITIES[i]);
+         unsigned int capacity = ChooseABufferCapacity(settings, numFragments, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
+         OitTraffic listTraffic, weightedTraffic;
+         EstimateABufferTraffic(SCREEN_WIDTH, SCREEN_HEIGHT, numFragments, &listTraffic);
+         EstimateWeightedOitTraffic(SCREEN_WIDTH, SCREEN_HEIGHT, numFragments, &weightedTraffic);
+         double listMB = GetABufferBytes(SCREEN_WIDTH, SCREEN_HEIGHT, capacity) / MB;
+         double weightedMB = GetWeightedOitBytes(SCREEN_WIDTH, SCREEN_HEIGHT) / MB;
+         out << "  fragments/pixel=" << COMPLEXITIES[i] << " MB lists=" << listMB << " weighted=" << weightedMB
+             << " traffic MB lists=" << listTraffic.totalBytes / MB << " weighted=" << weightedTraffic.totalBytes / MB << "\n";
+         if (COMPLEXITIES[i] >= 1.0f)
+         {
+            weightedCheaper &= weightedMB < listMB && weightedTraffic.totalBytes < listTraffic.totalBytes;
+         }
+      }
+      Check(weightedCheaper, "from one fragment per pixel on the weighted targets take less memory and traffic",
+         &results, out);
+
+      // Both techniques' passes are declared in both shading modes, the
+      // weighted pass draws the transparent draws with its own blend state
+      for (unsigned int mode = 0; mode < 2; mode++)
+      {
+         ScenePassResources res;
+         vector<SceneDrawItem> items;
+         CreateSyntheticScene(64, &res, &items);
+         res.deferredShading = mode == 1;
+         unsigned int numTransparent = 0;
+         for (size_t i = 0; i < items.size(); i++)
+         {
+            items[i].transparent = i % 5 == 0;
+            if (items[i].transparent) numTransparent++;
+         }
+
+         DrawChunk allDraws = { 0, (unsigned int)items.size() };
+         CommandBuffer cmds;
+         RecordWeightedTransparentPass(&cmds, res, items, allDraws);
+         NullCommandBackend backend;
+         backend.Execute(cmds);
+         unsigned int weightedDraws = backend.GetStats().commandCounts[CMD_DRAW_INDEXED_INSTANCED_INDIRECT];
+         bool blended = !cmds.GetCommands().empty() && cmds.GetCommands().front().type == CMD_BIND_BLEND_STATE &&
+            cmds.GetCommands().back().type == CMD_BIND_BLEND_STATE;
+
+         RenderGraph graph;
+         SceneGraphPasses passes;
+         DeclareSceneGraph(&graph, res, &passes);
+         string errors;
+         bool compiled = graph.Compile(&errors);
+         out << errors;
+
+         const vector<RenderGraphPass> &schedule = graph.GetSchedule();
+         RenderGraphPass lastOpaque = res.deferredShading ? passes.deferredComposite : passes.scenePasses[MAIN_PASS];
+         size_t mainIndex = schedule.size(), opaqueIndex = schedule.size(), weightedIndex = schedule.size();
+         size_t compositeIndex = schedule.size();
+         for (size_t i = 0; i < schedule.size(); i++)
+         {
+            if (schedule[i] == passes.scenePasses[MAIN_PASS]) mainIndex = i;
+            if (schedule[i] == lastOpaque) opaqueIndex = i;
+            if (schedule[i] == passes.weightedTransparent) weightedIndex = i;
+            if (schedule[i] == passes.weightedComposite) compositeIndex = i;
+         }
+         Check(compiled && blended && weightedDraws == numTransparent && mainIndex < weightedIndex &&
+            weightedIndex < compositeIndex && opaqueIndex < compositeIndex && compositeIndex < schedule.size(),
+            res.deferredShading ? "the weighted targets are composited over the deferred composite" :
+            "the weighted targets are composited over the main pass", &results, out);
+
+         // Exactly one technique runs, so the renderer always skips the
+         // other's passes along with their transients
+         graph.SetPassMode(passes.transparent, GRAPH_PASS_SKIP);
+         graph.SetPassMode(passes.oitResolve, GRAPH_PASS_SKIP);
+         bool listsSkipped = graph.ValidatePassModes(NULL);
+         graph.SetPassMode(passes.transparent, GRAPH_PASS_RUN);
+         graph.SetPassMode(passes.oitResolve, GRAPH_PASS_RUN);
+         graph.SetPassMode(passes.weightedTransparent, GRAPH_PASS_SKIP);
+         graph.SetPassMode(passes.weightedComposite, GRAPH_PASS_SKIP);
+         bool weightedSkipped = graph.ValidatePassModes(NULL);
+         graph.SetPassMode(passes.weightedComposite, GRAPH_PASS_RUN);
+         bool compositeOnly = graph.ValidatePassModes(NULL);
+         Check(compiled && listsSkipped && weightedSkipped && !compositeOnly,
+            "either technique's passes can be skipped but not the weighted pass alone", &results, out);
+      }
+
+      out << "  checks passed=" << results.numChecks - results.numFailed << " of " << results.numChecks << "\n";
+   }
+
+   // Row vector clip position of p under m, divided by w
+   void ProjectPoint(const float m[16], const float p[3], float ndc[2])
+   {
+      float clip[4];
+      for (unsigned int c = 0; c < 4; c++)
+      {
+         clip[c] = p[0] * m[c] + p[1] * m[4 + c] + p[2] * m[8 + c] + m[12 + c];
+      }
+      ndc[0] = clip[0] / clip[3];
+      ndc[1] = clip[1] / clip[3];
+   }
+
+   size_t GetSchedulePosition(const RenderGraph &graph, RenderGraphPass pass)
+   {
+      const vector<RenderGraphPass> &schedule = graph.GetSchedule();
+      for (size_t i = 0; i < schedule.size(); i++)
+      {
+         if (schedule[i] == pass) return i;
+      }
+      return schedule.size();
+   }
+
+   // Taa's jitter and reprojection math and the resolve on a made up edge.
+   // The checks stand in for unit tests: the jitter stays within the pixel,
+   // a still camera has no motion whatever the jitter, a moving one matches
+   // projecting the point with both cameras, and the accumulated edge comes
+   // close to its coverage while stale history is clamped away.
+   void RunTaaBenchmark(ostream &out)
+   {
+      out << "taa: Halton jitter, reprojection, history clamping and sharpening\n";
+
+      CheckResults results = { 0, 0 };
+      TaaSettings settings;
+      GetDefaultTaaSettings(&settings);
+
+      const unsigned int WIDTH = 1280, HEIGHT = 720;
+      double meanX = 0.0, meanY = 0.0;
+      bool withinPixel = true, distinct = true;
+      float offsets[64][2];
+      unsigned int numOffsets = settings.numSamples < 64 ? settings.numSamples : 64;
+      for (unsigned int frame = 0; frame < numOffsets; frame++)
+      {
+         float jitter[2];
+         GetTaaJitter(settings, frame, WIDTH, HEIGHT, jitter);
+         offsets[frame][0] = jitter[0] * WIDTH * 0.5f;
+         offsets[frame][1] = -jitter[1] * HEIGHT * 0.5f;
+         meanX += offsets[frame][0] / numOffsets;
+         meanY += offsets[frame][1] / numOffsets;
+         for (unsigned int c = 0; c < 2; c++) withinPixel &= fabsf(offsets[frame][c]) <= 0.5f;
+         for (unsigned int other = 0; other < frame; other++)
+         {
+            distinct &= offsets[other][0] != offsets[frame][0] || offsets[other][1] != offsets[frame][1];
+         }
+      }
+      float repeated[2];
+      GetTaaJitter(settings, numOffsets, WIDTH, HEIGHT, repeated);
+      bool repeats = repeated[0] * WIDTH * 0.5f == offsets[0][0] && -repeated[1] * HEIGHT * 0.5f == offsets[0][1];
+
+      out << "  jitter samples=" << numOffsets << " mean pixels=(" << meanX << ", " << meanY << ")\n";
+      Check(withinPixel && distinct && repeats, "the jitter offsets are distinct, within half a pixel and repeat",
+         &results, out);
+      Check(fabs(meanX) < 0.1 && fabs(meanY) < 0.1, "the jitter offsets are centered on the pixel", &results, out);
+
+      // The jittered projection moves every point by the jitter in NDC
+      const float FOV_Y = 0.785f, NEAR_Z = 0.1f, FAR_Z = 100.0f;
+      float projection[16], jittered[16], jitter[2];
+      GetOverdrawProjection(FOV_Y, (float)WIDTH / HEIGHT, NEAR_Z, FAR_Z, projection);
+      GetTaaJitter(settings, 3, WIDTH, HEIGHT, jitter);
+      JitterProjection(projection, jitter, jittered);
+      const float POINTS[3][3] = { { 1.2f, -0.7f, 5.0f }, { -3.0f, 2.0f, 40.0f }, { 0.0f, 0.0f, 0.5f } };
+      double maxShiftError = 0.0;
+      for (unsigned int i = 0; i < 3; i++)
+      {
+         float ndc[2], jitteredNdc[2];
+         ProjectPoint(projection, POINTS[i], ndc);
+         ProjectPoint(jittered, POINTS[i], jitteredNdc);
+         for (unsigned int c = 0; c < 2; c++)
+         {
+            double error = fabs(jitteredNdc[c] - ndc[c] - jitter[c]);
+            if (error > maxShiftError) maxShiftError = error;
+         }
+      }
+      Check(maxShiftError < 1e-5, "the jittered projection moves points by the jitter at any depth", &results, out);
+
+      // A still camera reprojects with the projection alone
+      float tanHalfFovY = tanf(FOV_Y * 0.5f), tanHalfFovX = tanHalfFovY * WIDTH / HEIGHT;
+      TaaConstants constants;
+      SetupTaaConstants(settings, WIDTH, HEIGHT, tanHalfFovX, tanHalfFovY, FAR_Z, jitter, projection, &constants);
+      const float DEPTHS[4] = { 0.0f, 0.5f, 7.0f, 90.0f };
+      double maxStillMotion = 0.0;
+      for (unsigned int y = 0; y < HEIGHT; y += 37)
+      {
+         for (unsigned int x = 0; x < WIDTH; x += 53)
+         {
+            for (unsigned int d = 0; d < 4; d++)
+            {
+               float motion[2];
+               ComputeTaaMotion(constants, x, y, DEPTHS[d], motion);
+               for (unsigned int c = 0; c < 2; c++)
+               {
+                  if (fabs(motion[c]) > maxStillMotion) maxStillMotion = fabs(motion[c]);
+               }
+            }
+         }
+      }
+      out << "  still camera max motion=" << maxStillMotion << "\n";
+      Check(maxStillMotion < 1e-5, "a still camera has no motion whatever the jitter", &results, out);
+
+      // The camera moved from previous to current, the reprojection is the
+      // current camera to world then the previous world to clip
+      const float PREVIOUS[3] = { 0.0f, 0.0f, 0.0f }, CURRENT[3] = { 0.3f, 0.1f, -0.2f };
+      float reprojection[16];
+      memcpy(reprojection, projection, sizeof(reprojection));
+      for (unsigned int c = 0; c < 4; c++)
+      {
+         for (unsigned int i = 0; i < 3; i++) reprojection[12 + c] += (CURRENT[i] - PREVIOUS[i]) * projection[i * 4 + c];
+      }
+      SetupTaaConstants(settings, WIDTH, HEIGHT, tanHalfFovX, tanHalfFovY, FAR_Z, jitter, reprojection, &constants);
+      double maxMotionError = 0.0;
+      bool leftward = true;
+      for (unsigned int y = 0; y < HEIGHT; y += 37)
+      {
+         for (unsigned int x = 0; x < WIDTH; x += 53)
+         {
+            for (unsigned int d = 1; d < 4; d++)
+            {
+               float motion[2];
+               ComputeTaaMotion(constants, x, y, DEPTHS[d], motion);
+
+               float ndc[2] = { (x + 0.5f) / WIDTH * 2.0f - 1.0f - jitter[0],
+                  1.0f - (y + 0.5f) / HEIGHT * 2.0f - jitter[1] };
+               float previousView[3] = { ndc[0] * tanHalfFovX * DEPTHS[d], ndc[1] * tanHalfFovY * DEPTHS[d], DEPTHS[d] };
+               for (unsigned int i = 0; i < 3; i++) previousView[i] += CURRENT[i] - PREVIOUS[i];
+               float previousNdc[2];
+               ProjectPoint(projection, previousView, previousNdc);
+               double expected[2] = { (ndc[0] - previousNdc[0]) * 0.5, (previousNdc[1] - ndc[1]) * 0.5 };
+               for (unsigned int c = 0; c < 2; c++)
+               {
+                  if (fabs(motion[c] - expected[c]) > maxMotionError) maxMotionError = fabs(motion[c] - expected[c]);
+               }
+               leftward &= motion[0] < 0.0f;
+            }
+         }
+      }
+      out << "  moving camera max motion error=" << maxMotionError << "\n";
+      Check(maxMotionError < 1e-5 && leftward,
+         "a moving camera's motion matches projecting with both cameras, the scene moves against the camera",
+         &results, out);
+
+      // A vertical edge covering EDGE of pixel EDGE_PIXEL, accumulated over
+      // frames with the jitter and a still camera
+      const unsigned int EDGE_WIDTH = 32, EDGE_HEIGHT = 8, EDGE_PIXEL = 12, NUM_FRAMES = 64;
+      const float COVERAGE = 0.3f, EDGE = EDGE_PIXEL + COVERAGE;
+      vector<float> motion(EDGE_WIDTH * EDGE_HEIGHT * 2, 0.0f), color(EDGE_WIDTH * EDGE_HEIGHT * 4);
+      vector<float> history, resolved;
+      float edgeSum = 0.0f, edgeMin = 1.0f, edgeMax = 0.0f;
+      for (unsigned int frame = 0; frame < NUM_FRAMES; frame++)
+      {
+         GetTaaJitter(settings, frame, EDGE_WIDTH, EDGE_HEIGHT, jitter);
+         SetupTaaConstants(settings, EDGE_WIDTH, EDGE_HEIGHT, tanHalfFovX, tanHalfFovY, FAR_Z, jitter,
+            frame > 0 ? projection : NULL, &constants);
+
+         // Pixel centers see the scene against the jitter
+         float jitterPixels = jitter[0] * EDGE_WIDTH * 0.5f;
+         for (unsigned int y = 0; y < EDGE_HEIGHT; y++)
+         {
+            for (unsigned int x = 0; x < EDGE_WIDTH; x++)
+            {
+               float value = x + 0.5f - jitterPixels < EDGE ? 1.0f : 0.0f;
+               float *pixel = &color[(y * EDGE_WIDTH + x) * 4];
+               pixel[0] = pixel[1] = pixel[2] = value;
+               pixel[3] = 1.0f;
+            }
+         }
+         ResolveTaa(constants, color, motion, history, &resolved);
+         history.swap(resolved);
+
+         if (frame + settings.numSamples >= NUM_FRAMES)
+         {
+            float value = history[(EDGE_HEIGHT / 2 * EDGE_WIDTH + EDGE_PIXEL) * 4];
+            edgeSum += value;
+            if (value < edgeMin) edgeMin = value;
+            if (value > edgeMax) edgeMax = value;
+         }
+      }
+      float edgeMean = edgeSum / settings.numSamples;
+      out << "  edge coverage=" << COVERAGE << " resolved mean=" << edgeMean << " range=[" << edgeMin << ", "
+          << edgeMax << "]\n";
+      Check(fabsf(edgeMean - COVERAGE) < 0.1f && edgeMax - edgeMin < 0.5f,
+         "the resolved edge converges to its coverage without flickering between 0 and 1", &results, out);
+
+      // History the current neighborhood does not contain is clamped to it,
+      // history off screen is ignored
+      vector<float> gray(EDGE_WIDTH * EDGE_HEIGHT * 4, 0.2f), white(EDGE_WIDTH * EDGE_HEIGHT * 4, 1.0f);
+      SetupTaaConstants(settings, EDGE_WIDTH, EDGE_HEIGHT, tanHalfFovX, tanHalfFovY, FAR_Z, jitter, projection,
+         &constants);
+      ResolveTaa(constants, gray, motion, white, &resolved);
+      bool clamped = true;
+      for (size_t i = 0; i < resolved.size(); i++) clamped &= fabsf(resolved[i] - 0.2f) < 1e-6f;
+      vector<float> offscreen(motion.size(), 2.0f);
+      ResolveTaa(constants, gray, offscreen, white, &resolved);
+      bool ignored = resolved == gray;
+      Check(clamped && ignored, "stale history is clamped to the neighborhood, history off screen is ignored",
+         &results, out);
+
+      // Sharpening keeps flat areas and steepens the converged edge
+      vector<float> sharpened;
+      SharpenTaa(constants, gray, &sharpened);
+      bool flat = true;
+      for (size_t i = 0; i < sharpened.size(); i++)
+      {
+         flat &= fabsf(sharpened[i] - (i % 4 == 3 ? 1.0f : 0.2f)) < 1e-6f;
+      }
+      SharpenTaa(constants, history, &sharpened);
+      unsigned int edgeIndex = (EDGE_HEIGHT / 2 * EDGE_WIDTH + EDGE_PIXEL) * 4;
+      float contrast = history[edgeIndex - 4] - history[edgeIndex];
+      float sharpenedContrast = sharpened[edgeIndex - 4] - sharpened[edgeIndex];
+      out << "  edge contrast=" << contrast << " sharpened=" << sharpenedContrast << "\n";
+      Check(flat && sharpenedContrast > contrast, "the sharpen keeps flat areas and steepens edges", &results, out);
+
+      // In both shading modes the scene color is resolved after everything
+      // drew into it, the sharpen writes the back buffer last
+      for (unsigned int mode = 0; mode < 2; mode++)
+      {
+         ScenePassResources res;
+         vector<SceneDrawItem> items;
+         CreateSyntheticScene(64, &res, &items);
+         res.deferredShading = mode == 1;
+         res.temporalAA = true;
+
+         RenderGraph graph;
+         SceneGraphPasses passes;
+         DeclareSceneGraph(&graph, res, &passes);
+         string errors;
+         bool compiled = graph.Compile(&errors);
+         out << errors;
+
+         size_t end = graph.GetSchedule().size();
+         size_t normalIndex = GetSchedulePosition(graph, passes.normalDepth);
+         size_t motionIndex = GetSchedulePosition(graph, passes.taaMotion);
+         size_t resolveIndex = GetSchedulePosition(graph, passes.taaResolve);
+         size_t sharpenIndex = GetSchedulePosition(graph, passes.taaSharpen);
+         RenderGraphPass drawsColor[] = { res.deferredShading ? passes.deferredComposite : passes.scenePasses[MAIN_PASS],
+            passes.oitResolve, passes.weightedComposite };
+         bool colorFirst = true;
+         for (unsigned int i = 0; i < 3; i++) colorFirst &= GetSchedulePosition(graph, drawsColor[i]) < resolveIndex;
+         Check(compiled && normalIndex < motionIndex && motionIndex < resolveIndex && colorFirst &&
+            resolveIndex < sharpenIndex && sharpenIndex < end,
+            res.deferredShading ? "the deferred graph resolves the scene color and sharpens it into the back buffer" :
+            "the forward graph resolves the scene color and sharpens it into the back buffer", &results, out);
+      }
+
+      out << "  checks passed=" << results.numChecks - results.numFailed << " of " << results.numChecks << "\n";
+   }
+
+   // Frames of the resolution controller against a made up GPU whose time is
+   // a fixed cost plus pixelMs[frame] at full resolution, scaled by the
+   // pixel count, with a little noise. The times reach the controller
+   // GpuTimer's latency late, like the renderer's readback.
+   void SimulateResolution(const vector<float> &pixelMs, float fixedMs, ResolutionController *pController,
+      vector<float> *pScales, vector<float> *pGpuMs)
+   {
+      const unsigned int LATENCY = 4;
+      unsigned int seed = 12345u;
+      pScales->clear();
+      pGpuMs->clear();
+      for (size_t frame = 0; frame < pixelMs.size(); frame++)
+      {
+         float scale = pController->GetScale();
+         seed = seed * 1664525u + 1013904223u;
+         float noise = 0.95f + 0.1f * ((seed >> 8) / 16777216.0f);
+         pScales->push_back(scale);
+         pGpuMs->push_back((fixedMs + pixelMs[frame] * scale * scale) * noise);
+         if (frame >= LATENCY) pController->Update((*pGpuMs)[frame - LATENCY], (*pScales)[frame - LATENCY]);
+      }
+   }
+
+   unsigned int CountScaleChanges(const vector<float> &scales, size_t first, size_t end)
+   {
+      unsigned int changes = 0;
+      for (size_t i = first + 1; i < end; i++)
+      {
+         if (scales[i] != scales[i - 1]) changes++;
+      }
+      return changes;
+   }
+
+   // The resolution controller on simulated frame times. The checks stand in
+   // for unit tests: a light load keeps full resolution, a heavy one settles
+   // just under the target without oscillating, a load step is followed
+   // within a few frames both ways, single slow frames are ignored and the
+   // scale stays in its quantized range.
+   void RunDynamicResolutionBenchmark(ostream &out)
+   {
+      out << "dynamic_resolution: resolution controller on simulated GPU frame times\n";
+
+      CheckResults results = { 0, 0 };
+      DynamicResolutionSettings settings;
+      GetDefaultDynamicResolutionSettings(&settings);
+      const float FIXED_MS = 2.0f;
+      vector<float> scales, gpuMs;
+
+      // Light load
+      {
+         ResolutionController controller(settings);
+         SimulateResolution(vector<float>(300, 8.0f), FIXED_MS, &controller, &scales, &gpuMs);
+         bool full = true;
+         for (size_t i = 0; i < scales.size(); i++) full &= scales[i] == settings.maxScale;
+         Check(full, "a load under the target keeps full resolution", &results, out);
+      }
+
+      // Heavy load, full resolution takes 26 ms
+      {
+         ResolutionController controller(settings);
+         SimulateResolution(vector<float>(400, 24.0f), FIXED_MS, &controller, &scales, &gpuMs);
+         double meanMs = 0.0;
+         const size_t SETTLED = 200;
+         for (size_t i = SETTLED; i < gpuMs.size(); i++) meanMs += gpuMs[i] / (gpuMs.size() - SETTLED);
+         unsigned int changes = CountScaleChanges(scales, SETTLED, scales.size());
+         out << "  heavy load settled scale=" << scales.back() << " mean ms=" << meanMs << " target="
+             << settings.targetMs << " changes=" << changes << "\n";
+         Check(meanMs <= settings.targetMs && meanMs >= 0.75 * settings.targetMs && changes <= 2,
+            "a heavy load settles under the target without oscillating", &results, out);
+      }
+
+      // The load triples for a while and goes back
+      {
+         vector<float> pixelMs(200, 10.0f);
+         pixelMs.resize(400, 30.0f);
+         pixelMs.resize(800, 10.0f);
+         ResolutionController controller(settings);
+         SimulateResolution(pixelMs, FIXED_MS, &controller, &scales, &gpuMs);
+         unsigned int slowFrames = 0;
+         for (size_t i = 200; i < 400; i++)
+         {
+            if (gpuMs[i] > settings.targetMs * 1.1f) slowFrames++;
+         }
+         size_t recovered = 400;
+         while (recovered < scales.size() && scales[recovered] < settings.maxScale) recovered++;
+         out << "  load step frames over target=" << slowFrames << " frames back to full resolution="
+             << recovered - 400 << "\n";
+         Check(slowFrames <= 12 && recovered < scales.size(),
+            "a load step is followed within a few frames and full resolution comes back after it", &results, out);
+      }
+
+      // Single slow frames
+      {
+         vector<float> pixelMs(400, 10.0f);
+         for (size_t i = 20; i < pixelMs.size(); i += 40) pixelMs[i] = 40.0f;
+         ResolutionController controller(settings);
+         SimulateResolution(pixelMs, FIXED_MS, &controller, &scales, &gpuMs);
+         Check(CountScaleChanges(scales, 0, scales.size()) == 0, "single slow frames do not move the scale",
+            &results, out);
+      }
+
+      // A fixed cost over the target can not be scaled away
+      {
+         ResolutionController controller(settings);
+         SimulateResolution(vector<float>(200, 10.0f), 20.0f, &controller, &scales, &gpuMs);
+         bool quantized = true;
+         for (size_t i = 0; i < scales.size(); i++)
+         {
+            float steps = scales[i] / settings.scaleStep;
+            quantized &= scales[i] >= settings.minScale && scales[i] <= settings.maxScale &&
+               (fabsf(steps - floorf(steps + 0.5f)) < 1e-3f || scales[i] == settings.minScale);
+         }
+         Check(quantized && scales.back() == settings.minScale,
+            "the scale is a multiple of the step within its range and stops at the minimum", &results, out);
+      }
+
+      unsigned int renderWidth, renderHeight, tinyWidth, tinyHeight;
+      GetDynamicResolutionSize(0.5f, 1280, 720, &renderWidth, &renderHeight);
+      GetDynamicResolutionSize(0.0f, 1280, 720, &tinyWidth, &tinyHeight);
+      UpscaleConstants upscale;
+      SetupUpscaleConstants(renderWidth, renderHeight, 1280, 720, &upscale);
+      Check(renderWidth == 640 && renderHeight == 360 && tinyWidth == 1 && tinyHeight == 1 &&
+         upscale.scaleX == 0.5f && upscale.scaleY == 0.5f, "the scaled size and the upscale follow the scale",
+         &results, out);
+
+      // The upscale runs last in both shading modes, after the sharpen when
+      // the anti-aliasing is on
+      for (unsigned int mode = 0; mode < 4; mode++)
+      {
+         ScenePassResources res;
+         vector<SceneDrawItem> items;
+         CreateSyntheticScene(64, &res, &items);
+         res.deferredShading = (mode & 1) != 0;
+         res.temporalAA = (mode & 2) != 0;
+         res.dynamicResolution = true;
+         res.mainViewport.width = floorf(res.outputViewport.width * 0.7f);
+         res.mainViewport.height = floorf(res.outputViewport.height * 0.7f);
+
+         RenderGraph graph;
+         SceneGraphPasses passes;
+         DeclareSceneGraph(&graph, res, &passes);
+         string errors;
+         bool compiled = graph.Compile(&errors);
+         out << errors;
+
+         size_t upscaleIndex = GetSchedulePosition(graph, passes.upscale);
+         RenderGraphPass finish = res.temporalAA ? passes.taaSharpen :
+            (res.deferredShading ? passes.deferredComposite : passes.scenePasses[MAIN_PASS]);
+         Check(compiled && upscaleIndex + 1 == graph.GetSchedule().size() &&
+            GetSchedulePosition(graph, finish) < upscaleIndex,
+            "the scaled frame is upscaled into the back buffer after it is finished", &results, out);
+      }
+
+      out << "  checks passed=" << results.numChecks - results.numFailed << " of " << results.numChecks << "\n";
+   }
+
+   // Light space of the made up normal pass' scene, VPL_RANGE_SCALE scene
+   // units to a light space unit the same way on every axis so the VPLs'
+   // reach is a sphere
+   const float VPL_RANGE_SCALE = 10.0f;
+
+   void GetSyntheticViewToLight(float viewToLight[16])
+   {
+      memset(viewToLight, 0, 16 * sizeof(float));
+      viewToLight[0] = 2.0f / VPL_RANGE_SCALE;
+      viewToLight[5] = 2.0f / VPL_RANGE_SCALE;
+      viewToLight[10] = 1.0f / VPL_RANGE_SCALE;
+      viewToLight[15] = 1.0f;
+   }
+
+   // VPLs on random pixels of the buffer with random colors, lighting the
+   // surfaces around them
+   void CreateSyntheticVpls(const NormalDepthBuffer &buffer, const CoarseVplConstants &constants,
+      unsigned int numLights, vector<VirtualPointLight> *pLights)
+   {
+      unsigned int seed = 777u;
+      pLights->clear();
+      while (pLights->size() < numLights)
+      {
+         seed = seed * 1664525u + 1013904223u;
+         unsigned int pixel = (seed >> 8) % (buffer.width * buffer.height);
+         float z = buffer.texels[pixel * 4 + 3];
+         if (z == 0.0f) continue;
+
+         unsigned int x = pixel % buffer.width, y = pixel / buffer.width;
+         float p[3] = { ((x + 0.5f) / buffer.width * 2.0f - 1.0f) * buffer.tanHalfFovX * z,
+            (1.0f - (y + 0.5f) / buffer.height * 2.0f) * buffer.tanHalfFovY * z, z };
+         float clip[3];
+         TransformPoint(constants.viewToLight, p, clip);
+
+         VirtualPointLight light;
+         light.position[0] = clip[0] * 0.5f + 0.5f;
+         light.position[1] = clip[1] * -0.5f + 0.5f;
+         light.position[2] = clip[2];
+         light.position[3] = 1.0f;
+         for (unsigned int c = 0; c < 3; c++)
+         {
+            seed = seed * 1664525u + 1013904223u;
+            light.color[c] = 0.05f * ((seed >> 8) / 16777216.0f);
+         }
+         light.color[3] = 1.0f;
+         pLights->push_back(light);
+      }
+   }
+
+   // Coarse VPL shading against texMain's per pixel VPL light. The checks
+   // stand in for unit tests: one pixel per block reproduces the reference,
+   // quarter resolution stays close to it, the edge-aware upsample beats a
+   // bilinear one, coarser blocks trade quality for cost and the cost model
+   // counts what each pass shades. Runs on the captured normals, light map
+   // and constants if the renderer saved all three.
+   void RunCoarseVplBenchmark(ostream &out)
+   {
+      out << "coarse_vpl: VPL light shaded per block with an edge-aware upsample\n";
+
+      const unsigned int WIDTH = 640, HEIGHT = 480;
+      const float CAMERA_DISTANCE = 6.0f;
+      const unsigned int NUM_LIGHTS = 256;
+      CheckResults results = { 0, 0 };
+
+      CoarseVplSettings settings;
+      GetDefaultCoarseVplSettings(&settings);
+
+      NormalDepthBuffer buffer;
+      ReflectiveShadowMap rsm;
+      CoarseVplConstants captured;
+      bool loaded = LoadNormalDepthBuffer(SSAO_CAPTURE_FILE, &buffer) && LoadReflectiveShadowMap(RSM_CAPTURE_FILE, &rsm) &&
+         LoadCoarseVplConstants(COARSE_VPL_CAPTURE_FILE, &captured) && captured.width == buffer.width &&
+         captured.height == buffer.height;
+      float viewToLight[16];
+      vector<VirtualPointLight> lights;
+      CoarseVplConstants constants;
+      if (loaded)
+      {
+         memcpy(viewToLight, captured.viewToLight, sizeof(viewToLight));
+         SetupCoarseVplConstants(settings, buffer.width, buffer.height, buffer.tanHalfFovX, buffer.tanHalfFovY,
+            viewToLight, &constants);
+         SampleVplsReference(rsm, DEFAULT_VPLS, 0, &lights);
+      }
+      else
+      {
+         CreateSyntheticNormalDepth(WIDTH, HEIGHT, CAMERA_DISTANCE, &buffer);
+         GetSyntheticViewToLight(viewToLight);
+         SetupCoarseVplConstants(settings, buffer.width, buffer.height, buffer.tanHalfFovX, buffer.tanHalfFovY,
+            viewToLight, &constants);
+         CreateSyntheticVpls(buffer, constants, NUM_LIGHTS, &lights);
+      }
+      out << "  buffer=" << (loaded ? SSAO_CAPTURE_FILE : "synthetic") << " " << buffer.width << "x" << buffer.height
+          << " vpls=" << lights.size() << "\n";
+
+      CpuTimer referenceTimer;
+      vector<float> reference;
+      ShadeVplsReference(buffer, constants, lights, &reference);
+      double referenceMs = referenceTimer.GetElapsedMs();
+
+      // One pixel per block is the reference itself
+      CoarseVplSettings perPixel = settings;
+      perPixel.factor = 1;
+      CoarseVplConstants perPixelConstants;
+      SetupCoarseVplConstants(perPixel, buffer.width, buffer.height, buffer.tanHalfFovX, buffer.tanHalfFovY,
+         viewToLight, &perPixelConstants);
+      vector<float> coarse, upsampled, bilinear;
+      ShadeVplsCoarse(buffer, perPixelConstants, lights, &coarse);
+      UpsampleVplLight(buffer, coarse, perPixelConstants, lights, &upsampled, NULL);
+      Check(ComputePsnr(reference, upsampled) == std::numeric_limits<double>::infinity(),
+         "blocks of one pixel reproduce the per pixel light", &results, out);
+
+      const unsigned int FACTORS[] = { 2, 4 };
+      const unsigned int NUM_FACTORS = sizeof(FACTORS) / sizeof(FACTORS[0]);
+      double psnr[NUM_FACTORS], bilinearPsnr[NUM_FACTORS];
+      float relativeCost[NUM_FACTORS];
+      VplShadingCost costs[NUM_FACTORS];
+      for (unsigned int i = 0; i < NUM_FACTORS; i++)
+      {
+         CoarseVplSettings factorSettings = settings;
+         factorSettings.factor = FACTORS[i];
+         CoarseVplConstants factorConstants;
+         SetupCoarseVplConstants(factorSettings, buffer.width, buffer.height, buffer.tanHalfFovX, buffer.tanHalfFovY,
+            viewToLight, &factorConstants);
+
+         CpuTimer timer;
+         ShadeVplsCoarse(buffer, factorConstants, lights, &coarse);
+         UpsampleVplLight(buffer, coarse, factorConstants, lights, &upsampled, &costs[i]);
+         double ms = timer.GetElapsedMs();
+         UpsampleVplLightBilinear(buffer, coarse, factorConstants, &bilinear);
+
+         psnr[i] = ComputePsnr(reference, upsampled);
+         bilinearPsnr[i] = ComputePsnr(reference, bilinear);
+         relativeCost[i] = GetRelativeVplShadingCost(costs[i], settings.upsampleCost);
+         out << "  factor=" << FACTORS[i] << " psnr=" << psnr[i] << " dB bilinear=" << bilinearPsnr[i]
+             << " dB coarse pixels=" << costs[i].coarsePixels << " fallback pixels=" << costs[i].fallbackPixels
+             << " of " << costs[i].fullPixels << " relative cost=" << relativeCost[i] << " cpu ms=" << ms
+             << " (per pixel " << referenceMs << ")\n";
+      }
+
+      Check(psnr[0] > 40.0, "quarter resolution VPL light stays within 40 dB of the per pixel light", &results, out);
+      Check(psnr[0] > bilinearPsnr[0] && psnr[1] > bilinearPsnr[1],
+         "the edge-aware upsample beats a bilinear one at every block size", &results, out);
+      Check(psnr[1] < psnr[0] && relativeCost[1] < relativeCost[0],
+         "larger blocks cost less and lose quality", &results, out);
+      Check(relativeCost[0] < 0.4f && costs[0].fallbackPixels < costs[0].fullPixels / 20 &&
+         costs[0].upsampledPixels == costs[0].fullPixels,
+         "at quarter resolution the light loop runs for well under half the pixels", &results, out);
+
+      // The coarse passes only exist on the forward path, between the light
+      // binning and the main pass
+      for (unsigned int deferred = 0; deferred < 2; deferred++)
+      {
+         ScenePassResources res;
+         vector<SceneDrawItem> items;
+         CreateSyntheticScene(64, &res, &items);
+         res.deferredShading = deferred != 0;
+         res.coarseVpl = true;
+
+         RenderGraph graph;
+         SceneGraphPasses passes;
+         DeclareSceneGraph(&graph, res, &passes);
+         string errors;
+         bool compiled = graph.Compile(&errors);
+         out << errors;
+
+         if (deferred)
+         {
+            Check(compiled && passes.coarseVpl == (RenderGraphPass)-1 && passes.vplUpsample == (RenderGraphPass)-1,
+               "the deferred graph keeps shading the VPLs per pixel", &results, out);
+            continue;
+         }
+         size_t coarseIndex = GetSchedulePosition(graph, passes.coarseVpl);
+         size_t upsampleIndex = GetSchedulePosition(graph, passes.vplUpsample);
+         Check(compiled && GetSchedulePosition(graph, passes.normalDepth) < coarseIndex &&
+            GetSchedulePosition(graph, passes.lightBinning) < coarseIndex && coarseIndex < upsampleIndex &&
+            upsampleIndex < GetSchedulePosition(graph, passes.scenePasses[MAIN_PASS]),
+            "the forward graph shades the coarse VPL light before the main pass reads it", &results, out);
+      }
+
+      out << "  checks passed=" << results.numChecks - results.numFailed << " of " << results.numChecks << "\n";
+   }
+
+   void AddProbeBakeQuad(ProbeBakeScene *pScene, const float corners[4][3], const float albedo[3])
+   {
+      AddProbeBakeTriangle(pScene, corners[0], corners[1], corners[2], albedo);
+      AddProbeBakeTriangle(pScene, corners[0], corners[2], corners[3], albedo);
+   }
+
+   // Floor, back wall and a red and a green side wall of a box two units
+   // wide and high, open at the top and front like a Cornell box without
+   // its ceiling
+   void CreateOpenBoxScene(ProbeBakeScene *pScene)
+   {
+      const float white[3] = { 0.75f, 0.75f, 0.75f };
+      const float red[3] = { 0.75f, 0.1f, 0.1f };
+      const float green[3] = { 0.1f, 0.75f, 0.1f };
+      const float floor[4][3] = { { -1, 0, -1 }, { 1, 0, -1 }, { 1, 0, 1 }, { -1, 0, 1 } };
+      const float back[4][3] = { { -1, 0, -1 }, { -1, 2, -1 }, { 1, 2, -1 }, { 1, 0, -1 } };
+      const float left[4][3] = { { -1, 0, -1 }, { -1, 0, 1 }, { -1, 2, 1 }, { -1, 2, -1 } };
+      const float right[4][3] = { { 1, 0, -1 }, { 1, 2, -1 }, { 1, 2, 1 }, { 1, 0, 1 } };
+
+      pScene->triangles.clear();
+      AddProbeBakeQuad(pScene, floor, white);
+      AddProbeBakeQuad(pScene, back, white);
+      AddProbeBakeQuad(pScene, left, red);
+      AddProbeBakeQuad(pScene, right, green);
+      ComputeProbeBakeBounds(pScene);
+   }
+
+   // Irradiance probe baking. The checks stand in for unit tests: a probe
+   // under an open sky sees the sky from every side, one over an infinite
+   // lit floor matches the analytic irradiance, the walls of the open box
+   // bleed their color, the bake does not depend on the number of threads,
+   // the file keeps the probes to half precision, the lookup is trilinear,
+   // the OBJ loader reads what the baker needs and the graph culls the VPL
+   // passes the probes replace.
+   void RunIrradianceProbesBenchmark(ostream &out)
+   {
+      out << "irradiance_probes: L2 spherical harmonics probes path traced on the CPU\n";
+
+      CheckResults results = { 0, 0 };
+      const float AXES[6][3] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+      const float DOWN[3] = { 0.0f, -1.0f, 0.0f };
+      const float UP[3] = { 0.0f, 1.0f, 0.0f };
+      const float SIDE[3] = { 1.0f, 0.0f, 0.0f };
+
+      ProbeBakeSettings settings;
+      GetDefaultProbeBakeSettings(&settings);
+
+      // Nothing but sky
+      {
+         ProbeBakeScene scene;
+         ComputeProbeBakeBounds(&scene);
+         const float boundsMin[3] = { -1.0f, -1.0f, -1.0f }, boundsMax[3] = { 1.0f, 1.0f, 1.0f };
+         IrradianceProbeGrid grid;
+         SetupIrradianceProbeGrid(boundsMin, boundsMax, 2, &grid);
+
+         ProbeBakeSettings skySettings = settings;
+         skySettings.skyColor[0] = 0.3f;
+         skySettings.skyColor[1] = 0.5f;
+         skySettings.skyColor[2] = 0.8f;
+         BakeIrradianceProbes(scene, skySettings, &grid, NULL);
+
+         float worstError = 0.0f;
+         const float center[3] = { 0.0f, 0.0f, 0.0f };
+         for (unsigned int a = 0; a < 6; a++)
+         {
+            float color[3];
+            SampleIrradianceProbes(grid, center, AXES[a], color);
+            for (unsigned int c = 0; c < 3; c++)
+            {
+               float error = fabsf(color[c] - skySettings.skyColor[c]) / skySettings.skyColor[c];
+               if (error > worstError) worstError = error;
+            }
+         }
+         out << "  open sky: worst relative error=" << worstError << "\n";
+         Check(worstError < 0.02f, "an open sky lights every normal with the sky's color", &results, out);
+      }
+
+      // A floor reflecting albedo * sun straight up fills the lower half of
+      // the probe's view. Irradiance / pi is the floor's radiance facing
+      // down, half of it facing sideways and none facing up, which L1 is
+      // enough for.
+      {
+         const float albedo[3] = { 0.5f, 0.5f, 0.5f };
+         const float floor[4][3] = { { -1000, 0, -1000 }, { 1000, 0, -1000 }, { 1000, 0, 1000 }, { -1000, 0, 1000 } };
+         ProbeBakeScene scene;
+         AddProbeBakeQuad(&scene, floor, albedo);
+         ComputeProbeBakeBounds(&scene);
+
+         const float boundsMin[3] = { -1.0f, 0.0f, -1.0f }, boundsMax[3] = { 1.0f, 2.0f, 1.0f };
+         IrradianceProbeGrid grid;
+         SetupIrradianceProbeGrid(boundsMin, boundsMax, 2, &grid);
+         ProbeBakeSettings floorSettings = settings;
+         floorSettings.maxBounces = 0;
+         BakeIrradianceProbes(scene, floorSettings, &grid, NULL);
+
+         const float position[3] = { 0.0f, 1.0f, 0.0f };
+         float down[3], up[3], side[3];
+         SampleIrradianceProbes(grid, position, DOWN, down);
+         SampleIrradianceProbes(grid, position, UP, up);
+         SampleIrradianceProbes(grid, position, SIDE, side);
+         out << "  lit floor: down=" << down[0] << " (0.5) side=" << side[0] << " (0.25) up=" << up[0] << " (0)\n";
+         Check(fabsf(down[0] - 0.5f) < 0.02f && fabsf(side[0] - 0.25f) < 0.02f && up[0] < 0.01f,
+            "a lit floor matches the analytic irradiance", &results, out);
+      }
+
+      // The open box, lit from above and the right so the red wall gets
+      // direct light and the green one only what bounces
+      ProbeBakeScene box;
+      CreateOpenBoxScene(&box);
+      ProbeBakeSettings boxSettings = settings;
+      boxSettings.sunDirection[0] = 0.5f;
+      boxSettings.sunDirection[1] = 1.0f;
+      boxSettings.sunDirection[2] = 0.2f;
+
+      IrradianceProbeGrid singleThreaded, multithreaded;
+      SetupIrradianceProbeGrid(box.boundsMin, box.boundsMax, 4, &singleThreaded);
+      SetupIrradianceProbeGrid(box.boundsMin, box.boundsMax, 4, &multithreaded);
+      ProbeBakeStats singleStats, multiStats;
+      boxSettings.numThreads = 1;
+      BakeIrradianceProbes(box, boxSettings, &singleThreaded, &singleStats);
+      boxSettings.numThreads = 4;
+      BakeIrradianceProbes(box, boxSettings, &multithreaded, &multiStats);
+      out << "  open box: " << singleThreaded.dims[0] << "x" << singleThreaded.dims[1] << "x" << singleThreaded.dims[2]
+          << " probes, " << singleStats.numRays << " rays, 1 thread " << singleStats.ms << " ms, "
+          << multiStats.numThreads << " threads " << multiStats.ms << " ms\n";
+      Check(singleThreaded.coefficients == multithreaded.coefficients && singleStats.numRays == multiStats.numRays,
+         "the bake gives the same probes on any number of threads", &results, out);
+
+      const float nearRed[3] = { -0.75f, 0.75f, 0.0f }, nearGreen[3] = { 0.75f, 0.75f, 0.0f };
+      const float towardsRed[3] = { -1.0f, 0.0f, 0.0f }, towardsGreen[3] = { 1.0f, 0.0f, 0.0f };
+      float red[3], green[3];
+      SampleIrradianceProbes(multithreaded, nearRed, towardsRed, red);
+      SampleIrradianceProbes(multithreaded, nearGreen, towardsGreen, green);
+      out << "  facing the red wall=(" << red[0] << ", " << red[1] << ", " << red[2] << ") facing the green wall=("
+          << green[0] << ", " << green[1] << ", " << green[2] << ")\n";
+      Check(red[0] > 2.0f * red[1] && green[1] > 2.0f * green[0], "the walls bleed their color into the probes",
+         &results, out);
+
+      // Halfway between two probes is the average of both
+      float cornerA[3], cornerB[3], midpoint[3], sampleA[3], sampleB[3], sampleMid[3];
+      for (unsigned int c = 0; c < 3; c++)
+      {
+         cornerA[c] = multithreaded.boundsMin[c];
+         cornerB[c] = multithreaded.boundsMin[c];
+      }
+      cornerB[0] += (multithreaded.boundsMax[0] - multithreaded.boundsMin[0]) / (multithreaded.dims[0] - 1);
+      for (unsigned int c = 0; c < 3; c++) midpoint[c] = (cornerA[c] + cornerB[c]) * 0.5f;
+      SampleIrradianceProbes(multithreaded, cornerA, DOWN, sampleA);
+      SampleIrradianceProbes(multithreaded, cornerB, DOWN, sampleB);
+      SampleIrradianceProbes(multithreaded, midpoint, DOWN, sampleMid);
+      Check(fabsf(sampleMid[0] - (sampleA[0] + sampleB[0]) * 0.5f) < 1e-5f && sampleA[0] > 0.0f,
+         "the lookup blends the probes linearly", &results, out);
+
+      vector<float> packed;
+      PackIrradianceProbes(multithreaded, &packed);
+      unsigned int numProbes = multithreaded.dims[0] * multithreaded.dims[1] * multithreaded.dims[2];
+      Check(packed.size() == numProbes * IRRADIANCE_PROBE_VECTORS * 4 && packed[IRRADIANCE_PROBE_VECTORS * 4 - 1] == 0.0f &&
+         packed[IRRADIANCE_PROBE_VECTORS * 4] == multithreaded.coefficients[IRRADIANCE_SH_COEFFICIENTS * 3],
+         "the packed probes match the shader's layout", &results, out);
+
+      const char *PROBE_TEST_FILE = "irradiance_probes_benchmark.bin";
+      IrradianceProbeGrid loaded;
+      bool saved = SaveIrradianceProbes(PROBE_TEST_FILE, multithreaded);
+      bool read = LoadIrradianceProbes(PROBE_TEST_FILE, &loaded);
+      std::ifstream file(PROBE_TEST_FILE, std::ios::binary | std::ios::ate);
+      size_t fileSize = file ? (size_t)file.tellg() : 0;
+      file.close();
+      remove(PROBE_TEST_FILE);
+
+      float largest = 0.0f, worstError = 0.0f;
+      for (size_t i = 0; read && i < loaded.coefficients.size(); i++)
+      {
+         float error = fabsf(loaded.coefficients[i] - multithreaded.coefficients[i]);
+         if (error > worstError) worstError = error;
+         if (fabsf(multithreaded.coefficients[i]) > largest) largest = fabsf(multithreaded.coefficients[i]);
+      }
+      out << "  file=" << fileSize << " bytes for " << numProbes << " probes, worst error=" << worstError << " of "
+          << largest << "\n";
+      Check(saved && read && memcmp(loaded.dims, multithreaded.dims, sizeof(loaded.dims)) == 0 &&
+         memcmp(loaded.boundsMin, multithreaded.boundsMin, sizeof(loaded.boundsMin)) == 0 &&
+         loaded.coefficients.size() == multithreaded.coefficients.size() && worstError <= largest / 1024.0f &&
+         fileSize == 40 + numProbes * IRRADIANCE_SH_COEFFICIENTS * 3 * 2,
+         "the probe file keeps half precision coefficients", &results, out);
+
+      // A quad, a triangle through negative indices and a material
+      const char *OBJ_TEST_FILE = "irradiance_probes_benchmark.obj";
+      const char *MTL_TEST_FILE = "irradiance_probes_benchmark.mtl";
+      {
+         std::ofstream mtl(MTL_TEST_FILE);
+         mtl << "newmtl wall\nKd 0.25 0.5 0.75\n";
+         std::ofstream obj(OBJ_TEST_FILE);
+         obj << "mtllib " << MTL_TEST_FILE << "\nv 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\nvt 0 0\nvn 0 0 1\n"
+             << "usemtl wall\nf 1/1/1 2/1/1 3/1/1 4/1/1\nusemtl missing\nf -4//1 -3//1 -1//1\n";
+      }
+      ProbeBakeScene objScene;
+      bool objLoaded = LoadProbeBakeSceneObj(OBJ_TEST_FILE, &objScene);
+      remove(OBJ_TEST_FILE);
+      remove(MTL_TEST_FILE);
+      Check(objLoaded && objScene.triangles.size() == 3 && objScene.triangles[1].albedo[1] == 0.5f &&
+         objScene.triangles[2].albedo[0] == 0.8f && objScene.triangles[2].positions[2][1] == 1.0f &&
+         objScene.boundsMax[0] == 1.0f && objScene.boundsMin[2] == 0.0f,
+         "the OBJ loader splits polygons and reads the materials' albedo", &results, out);
+
+      // The forward passes stop reading the VPLs, so everything producing
+      // them is culled. The deferred lighting still shades them.
+      for (unsigned int deferred = 0; deferred < 2; deferred++)
+      {
+         ScenePassResources res;
+         vector<SceneDrawItem> items;
+         CreateSyntheticScene(64, &res, &items);
+         res.deferredShading = deferred != 0;
+         res.irradianceProbes = true;
+         res.coarseVpl = true;
+
+         RenderGraph graph;
+         SceneGraphPasses passes;
+         DeclareSceneGraph(&graph, res, &passes);
+         string errors;
+         bool compiled = graph.Compile(&errors);
+         out << errors;
+
+         bool vplPassesRun = IsScheduled(graph, passes.vplFlux) && IsScheduled(graph, passes.lightBuffer) &&
+            IsScheduled(graph, passes.lightBinning) && IsScheduled(graph, passes.scenePasses[SHADOW_PASS]);
+         if (deferred)
+         {
+            Check(compiled && vplPassesRun, "the deferred lighting keeps the VPLs with probes", &results, out);
+            continue;
+         }
+         bool vplPassesCulled = !IsScheduled(graph, passes.vplFlux) && !IsScheduled(graph, passes.lightBuffer) &&
+            !IsScheduled(graph, passes.lightBinning) && !IsScheduled(graph, passes.scenePasses[SHADOW_PASS]);
+         out << "  forward graph with probes: " << graph.GetSchedule().size() << " passes scheduled\n";
+         Check(compiled && vplPassesCulled && passes.coarseVpl == (RenderGraphPass)-1 &&
+            IsScheduled(graph, passes.scenePasses[MAIN_PASS]),
+            "the forward graph culls the light map and VPL passes the probes replace", &results, out);
+      }
+
+      out << "  checks passed=" << results.numChecks - results.numFailed << " of " << results.numChecks << "\n";
+   }
+
+   struct Benchmark
+   {
+      const char *name;
+      void (*pRun)(ostream &out);
+   };
+
+   const Benchmark g_benchmarks[] =
+   {
+      { "command_stream", RunCommandStreamBenchmark },
+      { "parallel_recorder", RunParallelRecorderBenchmark },
+      { "render_graph", RunRenderGraphBenchmark },
+      { "transient_memory", RunTransientMemoryBenchmark },
+      { "instancing", RunInstancingBenchmark },
+      { "gpu_culling", RunGpuCullingBenchmark },
+      { "light_binning", RunLightBinningBenchmark },
+      { "clustered_lighting", RunClusteredLightingBenchmark },
+      { "vpl_sampling", RunVplSamplingBenchmark },
+      { "separable_blur", RunSeparableBlurBenchmark },
+      { "shadow_cascades", RunShadowCascadesBenchmark },
+      { "shadow_filter", RunShadowFilterBenchmark },
+      { "evsm", RunEvsmBenchmark },
+      { "shadow_cache", RunShadowCacheBenchmark },
+      { "shadow_resolution", RunShadowResolutionBenchmark },
+      { "ssao", RunSsaoBenchmark },
+      { "deferred", RunDeferredBenchmark },
+      { "depth_prepass", RunDepthPrepassBenchmark },
+      { "abuffer", RunABufferBenchmark },
+      { "weighted_oit", RunWeightedOitBenchmark },
+      { "taa", RunTaaBenchmark },
+      { "dynamic_resolution", RunDynamicResolutionBenchmark },
+      { "coarse_vpl", RunCoarseVplBenchmark },
+      { "irradiance_probes", RunIrradianceProbesBenchmark },
+   };
+}
+
+void RunBenchmarks(const string &filter, ostream &out)
+{
+   for (unsigned int i = 0; i < sizeof(g_benchmarks) / sizeof(g_benchmarks[0]); i++)
+   {
+      if (filter.empty() || string(g_benchmarks[i].name).find(filter) != string::npos)
+      {
+         g_benchmarks[i].pRun(out);
+      }
+   }
+}
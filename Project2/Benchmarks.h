@@ -0,0 +1,9 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+
+// Headless CPU benchmarks, these never touch a device. Runs every benchmark
+// whose name contains filter (all of them for an empty filter) and writes
+// the results to out.
+void RunBenchmarks(const std::string &filter, std::ostream &out);
@@ -1,67 +1,97 @@
 #include "ShaderDefines.h"
 
+// Must match VirtualPointLight in LightBinning.h, the position is in light
+// space (shadow map UV and depth)
 struct PointLight
 {
    float4 pos;
-   float4 posView;
    float4 col;
-   float4 screenPos;
-   float4  screenRad;
 };
 
 Texture2D m_ShadowMap : register(t0);
 Texture2D m_ColorMap : register(t1);
-Texture2D m_ShadowWorldPosMap : register(t2);
 
+// Light map luminance summed by VplFluxCS.hlsl
+StructuredBuffer<uint> m_TotalFlux : register(t2);
 
-RWTexture2D<float4>  m_BlurredMap;
-AppendStructuredBuffer<PointLight> m_LightBuffer;
+// Appends past MAX_VPLS are dropped, the readers clamp the count
+AppendStructuredBuffer<PointLight> m_LightBuffer : register(u0);
 
-cbuffer Lights : register(b0)
+// Must match VplConstants in VplSampling.h
+cbuffer VplConstants : register(b0)
 {
-   float4 lightDir;
-   float4x4 lightMvp;
-   float4x4 lightInvMvp;
+   uint targetVpls;
+   uint vplSeed;
+   float texelWeight;
+   float fluxScale;
 };
 
-cbuffer ConstBuffer : register(b1)
+// Same as QuantizeFlux in VplFluxCS.hlsl
+uint QuantizeFlux(float3 rgb)
 {
-   float4x4 mvpMat;
-   float4x4 invProj;
-   float4x4 mvMat;
-   float4x4 proj;
-};
-
-#define BLUR_BLOCK_LENGTH 1
-#define NUM_SAMPLES BLUR_BLOCK_LENGTH * BLUR_BLOCK_LENGTH
+   float luminance = dot(rgb, float3(0.2126, 0.7152, 0.0722));
+   return uint(clamp(luminance, 0.0, MAX_TEXEL_LUMINANCE) * fluxScale);
+}
 
-[numthreads(1, 1, 1)]
-void main( uint3 DTid : SV_DispatchThreadID )
+// Must match VplThreshold in VplSampling.cpp
+float VplThreshold(uint2 texel, uint seed)
 {
-   if(DTid.x % TILE_WIDTH == 0 && DTid.y % TILE_HEIGHT == 0)
+   uint bayer = 0;
+   [unroll]
+   for (uint bit = 0; bit < VPL_DITHER_BITS; bit++)
    {
-      PointLight p;
-      p.pos = m_ShadowWorldPosMap[DTid.xy];
-      p.posView = mul(mvMat, p.pos);
-      p.col = m_ColorMap[DTid.xy];
-      
-      p.screenPos = mul(mvpMat, p.pos);
-      float4 offsetPos = p.posView + float4(MAX_LIGHT_RADIUS, 0, 0, 0);
-      float4 screenOffset = mul(proj, offsetPos);
-      p.screenRad = float4(0, 0, 0, 0);
-      p.screenRad.x = abs(length(p.screenPos.xyz - screenOffset.xyz));
-      m_LightBuffer.Append(p);
+      bayer = (bayer << 2) | ((((texel.x ^ texel.y) >> bit) & 1) << 1) | ((texel.y >> bit) & 1);
    }
 
-   float4 blurColor = float4(0, 0, 0, 0);
-   for( int x = -BLUR_BLOCK_LENGTH / 2; x < BLUR_BLOCK_LENGTH / 2 + 1; x++ )
+   uint h = seed * 26699;
+   h = (h ^ 61) ^ (h >> 16);
+   h *= 9;
+   h ^= h >> 4;
+   h *= 0x27d4eb2d;
+   h ^= h >> 15;
+   float offset = float(h >> 8) * (1.0 / 16777216.0);
+
+   float threshold = (bayer + 0.5) / (1 << (2 * VPL_DITHER_BITS)) + offset;
+   return threshold >= 1.0 ? threshold - 1.0 : threshold;
+}
+
+#define BLUR_GROUP_THREADS (BLUR_THREAD_GROUP_SIZE * BLUR_THREAD_GROUP_SIZE)
+
+// VPLs the group found, appended together once the group is done
+groupshared uint groupNumVpls;
+groupshared PointLight groupVpls[BLUR_GROUP_THREADS];
+
+// One thread per texel of the light map, the VPL sits at the texel's shadow
+// map depth
+[numthreads(BLUR_THREAD_GROUP_SIZE, BLUR_THREAD_GROUP_SIZE, 1)]
+void main( uint3 DTid : SV_DispatchThreadID, uint GI : SV_GroupIndex )
+{
+   uint width, height;
+   m_ShadowMap.GetDimensions(width, height);
+
+   if (GI == 0) groupNumVpls = 0;
+   GroupMemoryBarrierWithGroupSync();
+
+   // Texels are picked in proportion to their flux so bright parts of the
+   // light map get more VPLs, the weight keeps the sum unbiased. Dithering
+   // the choice spreads the VPLs out like a grid would.
+   bool inside = DTid.x < width && DTid.y < height;
+   float3 flux = inside ? m_ColorMap[DTid.xy].rgb : float3(0, 0, 0);
+   uint totalFlux = m_TotalFlux[0];
+   float p = totalFlux > 0 ? min(1.0, float(targetVpls) * float(QuantizeFlux(flux)) / float(totalFlux)) : 0.0;
+   if (VplThreshold(DTid.xy, vplSeed) < p)
    {
-      for( int y = -BLUR_BLOCK_LENGTH / 2; y < BLUR_BLOCK_LENGTH / 2 + 1; y++ )
-      {
-         x = clamp(x, 0, WIDTH - 1);
-         y = clamp(y, 0, HEIGHT - 1);
-         blurColor += m_ShadowMap[DTid.xy + int2(x, y)] / float(NUM_SAMPLES);
-      }
+      PointLight l;
+      l.pos = float4((DTid.x + 0.5) / width, (DTid.y + 0.5) / height, m_ShadowMap[DTid.xy].r, 1.0);
+      l.col = float4(flux * (texelWeight / p), 1.0);
+
+      uint slot;
+      InterlockedAdd(groupNumVpls, 1, slot);
+      groupVpls[slot] = l;
    }
-   m_BlurredMap[DTid.xy] = blurColor;
-}
\ No newline at end of file
+   GroupMemoryBarrierWithGroupSync();
+
+   // The group's VPLs go out from its first threads, so the appends are
+   // issued together instead of scattered over the group
+   if (GI < groupNumVpls) m_LightBuffer.Append(groupVpls[GI]);
+}
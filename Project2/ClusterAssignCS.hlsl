@@ -0,0 +1,113 @@
+#include "ShaderDefines.h"
+
+// Must match ClusterLight in ClusteredLighting.h
+struct ClusterLight
+{
+   float3 position;
+   float range;
+   float3 color;
+   float spotCosOuter;
+   float3 direction;
+   float spotCosInner;
+};
+
+struct ClusterHeader
+{
+   uint offset;
+   uint numLights;
+};
+
+cbuffer ClusterConstants : register(b0)
+{
+   float4x4 clusterView;
+   float4 clusterProjection; // tanHalfFovX, tanHalfFovY, near, far
+   float2 clusterScreenSize;
+   float clusterLogDepthScale;
+   uint numClusterLights;
+};
+
+StructuredBuffer<ClusterLight> m_Lights : register(t0);
+
+RWStructuredBuffer<ClusterHeader> m_Clusters : register(u0);
+RWStructuredBuffer<uint> m_LightIndices : register(u1);
+
+// Cleared to 0 before the dispatch, the groups allocate their lists from it
+RWStructuredBuffer<uint> m_IndexCounter : register(u2);
+
+groupshared uint clusterNumLights;
+groupshared uint clusterOffset;
+groupshared uint clusterLights[MAX_LIGHTS_PER_CLUSTER];
+
+float AxisDistance(float c, float minValue, float maxValue)
+{
+   return max(max(minValue - c, c - maxValue), 0.0);
+}
+
+// One group per cluster, same bounds as ComputeClusterBounds
+[numthreads(CLUSTER_THREAD_GROUP_SIZE, 1, 1)]
+void main( uint3 Gid : SV_GroupID, uint GI : SV_GroupIndex )
+{
+   uint cluster = Gid.x;
+   uint x = cluster % CLUSTER_GRID_X;
+   uint y = (cluster / CLUSTER_GRID_X) % CLUSTER_GRID_Y;
+   uint z = cluster / (CLUSTER_GRID_X * CLUSTER_GRID_Y);
+
+   if (GI == 0) clusterNumLights = 0;
+   GroupMemoryBarrierWithGroupSync();
+
+   float nearZ = clusterProjection.z;
+   float depthRatio = clusterProjection.w / nearZ;
+   float zNear = nearZ * pow(depthRatio, float(z) / CLUSTER_GRID_Z);
+   float zFar = nearZ * pow(depthRatio, float(z + 1) / CLUSTER_GRID_Z);
+
+   float ndcLeft = (-1.0 + 2.0 * x / CLUSTER_GRID_X) * clusterProjection.x;
+   float ndcRight = (-1.0 + 2.0 * (x + 1) / CLUSTER_GRID_X) * clusterProjection.x;
+   float ndcTop = (1.0 - 2.0 * y / CLUSTER_GRID_Y) * clusterProjection.y;
+   float ndcBottom = (1.0 - 2.0 * (y + 1) / CLUSTER_GRID_Y) * clusterProjection.y;
+
+   float3 boundsMin = float3(ndcLeft * (ndcLeft < 0.0 ? zFar : zNear),
+                             ndcBottom * (ndcBottom < 0.0 ? zFar : zNear),
+                             zNear);
+   float3 boundsMax = float3(ndcRight * (ndcRight > 0.0 ? zFar : zNear),
+                             ndcTop * (ndcTop > 0.0 ? zFar : zNear),
+                             zFar);
+
+   for (uint light = GI; light < numClusterLights; light += CLUSTER_THREAD_GROUP_SIZE)
+   {
+      ClusterLight l = m_Lights[light];
+      float3 d = float3(AxisDistance(l.position.x, boundsMin.x, boundsMax.x),
+                        AxisDistance(l.position.y, boundsMin.y, boundsMax.y),
+                        AxisDistance(l.position.z, boundsMin.z, boundsMax.z));
+      if (dot(d, d) < l.range * l.range)
+      {
+         uint slot;
+         InterlockedAdd(clusterNumLights, 1, slot);
+         if (slot < MAX_LIGHTS_PER_CLUSTER) clusterLights[slot] = light;
+      }
+   }
+   GroupMemoryBarrierWithGroupSync();
+
+   if (GI == 0)
+   {
+      uint numLights = min(clusterNumLights, MAX_LIGHTS_PER_CLUSTER);
+      uint offset;
+      InterlockedAdd(m_IndexCounter[0], numLights, offset);
+
+      // Past the budget the cluster keeps what is left of it
+      offset = min(offset, MAX_CLUSTER_LIGHT_INDICES);
+      numLights = min(numLights, MAX_CLUSTER_LIGHT_INDICES - offset);
+
+      ClusterHeader header;
+      header.offset = offset;
+      header.numLights = numLights;
+      m_Clusters[cluster] = header;
+      clusterOffset = offset;
+      clusterNumLights = numLights;
+   }
+   GroupMemoryBarrierWithGroupSync();
+
+   for (uint i = GI; i < clusterNumLights; i += CLUSTER_THREAD_GROUP_SIZE)
+   {
+      m_LightIndices[clusterOffset + i] = clusterLights[i];
+   }
+}
@@ -0,0 +1,276 @@
+#include "ClusteredLighting.h"
+
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE__)
+#define CLUSTER_ASSIGNMENT_SSE
+#include <xmmintrin.h>
+#endif
+
+using std::vector;
+
+namespace
+{
+   inline float Max(float a, float b)
+   {
+      return a > b ? a : b;
+   }
+
+   // Distance from c to the interval along one axis, 0 inside. Written the
+   // way the SSE path computes it so both round the same.
+   inline float AxisDistance(float c, float minValue, float maxValue)
+   {
+      return Max(Max(minValue - c, c - maxValue), 0.0f);
+   }
+
+   bool SphereIntersectsCluster(const ClusterBounds &bounds, unsigned int cluster, const ClusterLight &light)
+   {
+      float dx = AxisDistance(light.position[0], bounds.minX[cluster], bounds.maxX[cluster]);
+      float dy = AxisDistance(light.position[1], bounds.minY[cluster], bounds.maxY[cluster]);
+      float dz = AxisDistance(light.position[2], bounds.minZ[cluster], bounds.maxZ[cluster]);
+      return dx * dx + dy * dy + dz * dz < light.range * light.range;
+   }
+
+   // Builds the compact lists from (cluster, light) pairs given in light
+   // order, which keeps every cluster's list in light order
+   void CompactClusterLists(const vector<unsigned int> &hitClusters, const vector<unsigned int> &hitLights,
+      unsigned int maxIndices, ClusterAssignment *pAssignment)
+   {
+      vector<ClusterHeader> &clusters = pAssignment->clusters;
+      clusters.resize(NUM_CLUSTERS);
+      for (unsigned int cluster = 0; cluster < NUM_CLUSTERS; cluster++)
+      {
+         clusters[cluster].offset = 0;
+         clusters[cluster].numLights = 0;
+      }
+      for (size_t hit = 0; hit < hitClusters.size(); hit++)
+      {
+         clusters[hitClusters[hit]].numLights++;
+      }
+
+      unsigned int offset = 0;
+      for (unsigned int cluster = 0; cluster < NUM_CLUSTERS; cluster++)
+      {
+         unsigned int numLights = clusters[cluster].numLights;
+         if (numLights > MAX_LIGHTS_PER_CLUSTER) numLights = MAX_LIGHTS_PER_CLUSTER;
+         if (numLights > maxIndices - offset) numLights = maxIndices - offset;
+         clusters[cluster].offset = offset;
+         clusters[cluster].numLights = numLights;
+         offset += numLights;
+      }
+
+      pAssignment->lightIndices.resize(offset);
+      vector<unsigned int> written(NUM_CLUSTERS, 0);
+      unsigned int numWritten = 0;
+      for (size_t hit = 0; hit < hitClusters.size(); hit++)
+      {
+         unsigned int cluster = hitClusters[hit];
+         if (written[cluster] == clusters[cluster].numLights) continue;
+         pAssignment->lightIndices[clusters[cluster].offset + written[cluster]++] = hitLights[hit];
+         numWritten++;
+      }
+      pAssignment->numDroppedLights = (unsigned int)hitClusters.size() - numWritten;
+   }
+}
+
+void SetupClusterConstants(const float view[16], float fovY, float aspect, float nearZ, float farZ,
+   unsigned int screenWidth, unsigned int screenHeight, unsigned int numLights, ClusterConstants *pConstants)
+{
+   for (unsigned int i = 0; i < 16; i++) pConstants->view[i] = view[i];
+   pConstants->tanHalfFovY = tanf(fovY * 0.5f);
+   pConstants->tanHalfFovX = pConstants->tanHalfFovY * aspect;
+   pConstants->nearZ = nearZ;
+   pConstants->farZ = farZ;
+   pConstants->screenWidth = (float)screenWidth;
+   pConstants->screenHeight = (float)screenHeight;
+   pConstants->logDepthScale = CLUSTER_GRID_Z / logf(farZ / nearZ);
+   pConstants->numLights = numLights;
+}
+
+unsigned int GetClusterSlice(const ClusterConstants &constants, float viewZ)
+{
+   if (viewZ <= constants.nearZ) return 0;
+   float slice = logf(viewZ / constants.nearZ) * constants.logDepthScale;
+   if (slice >= CLUSTER_GRID_Z - 1) return CLUSTER_GRID_Z - 1;
+   return (unsigned int)slice;
+}
+
+void ComputeClusterBounds(const ClusterConstants &constants, ClusterBounds *pBounds)
+{
+   vector<float> *pArrays[] = { &pBounds->minX, &pBounds->minY, &pBounds->minZ,
+                                &pBounds->maxX, &pBounds->maxY, &pBounds->maxZ };
+   for (unsigned int i = 0; i < 6; i++) pArrays[i]->resize(NUM_CLUSTERS);
+
+   float depthRatio = constants.farZ / constants.nearZ;
+   for (unsigned int z = 0; z < CLUSTER_GRID_Z; z++)
+   {
+      float zNear = constants.nearZ * powf(depthRatio, (float)z / CLUSTER_GRID_Z);
+      float zFar = constants.nearZ * powf(depthRatio, (float)(z + 1) / CLUSTER_GRID_Z);
+      for (unsigned int y = 0; y < CLUSTER_GRID_Y; y++)
+      {
+         // Rows start at the top of the screen, NDC y points up
+         float ndcTop = (1.0f - 2.0f * y / CLUSTER_GRID_Y) * constants.tanHalfFovY;
+         float ndcBottom = (1.0f - 2.0f * (y + 1) / CLUSTER_GRID_Y) * constants.tanHalfFovY;
+         for (unsigned int x = 0; x < CLUSTER_GRID_X; x++)
+         {
+            float ndcLeft = (-1.0f + 2.0f * x / CLUSTER_GRID_X) * constants.tanHalfFovX;
+            float ndcRight = (-1.0f + 2.0f * (x + 1) / CLUSTER_GRID_X) * constants.tanHalfFovX;
+
+            unsigned int cluster = GetClusterIndex(x, y, z);
+            pBounds->minX[cluster] = ndcLeft * (ndcLeft < 0.0f ? zFar : zNear);
+            pBounds->maxX[cluster] = ndcRight * (ndcRight > 0.0f ? zFar : zNear);
+            pBounds->minY[cluster] = ndcBottom * (ndcBottom < 0.0f ? zFar : zNear);
+            pBounds->maxY[cluster] = ndcTop * (ndcTop > 0.0f ? zFar : zNear);
+            pBounds->minZ[cluster] = zNear;
+            pBounds->maxZ[cluster] = zFar;
+         }
+      }
+   }
+}
+
+void TransformLightsToView(const vector<ClusterLight> &lights, unsigned int numLights, const float view[16],
+   vector<ClusterLight> *pViewLights)
+{
+   assert(numLights <= lights.size());
+   pViewLights->resize(numLights);
+   for (unsigned int i = 0; i < numLights; i++)
+   {
+      const ClusterLight &light = lights[i];
+      ClusterLight &viewLight = (*pViewLights)[i];
+      viewLight = light;
+      for (unsigned int c = 0; c < 3; c++)
+      {
+         viewLight.position[c] = light.position[0] * view[c] + light.position[1] * view[4 + c] +
+            light.position[2] * view[8 + c] + view[12 + c];
+         viewLight.direction[c] = light.direction[0] * view[c] + light.direction[1] * view[4 + c] +
+            light.direction[2] * view[8 + c];
+      }
+   }
+}
+
+void AssignLightsToClusters(const ClusterBounds &bounds, const ClusterConstants &constants,
+   const vector<ClusterLight> &viewLights, unsigned int maxIndices, ClusterAssignment *pAssignment)
+{
+   vector<unsigned int> hitClusters;
+   vector<unsigned int> hitLights;
+
+   for (unsigned int light = 0; light < viewLights.size(); light++)
+   {
+      const ClusterLight &viewLight = viewLights[light];
+      const float *pos = viewLight.position;
+      float radius = viewLight.range;
+      float radiusSq = radius * radius;
+      if (pos[2] + radius < constants.nearZ || pos[2] - radius > constants.farZ) continue;
+
+      // Each axis on its own is a necessary condition of the full test, so
+      // skipping slices and rows that fail it never loses a cluster
+      unsigned int firstSlice = GetClusterSlice(constants, pos[2] - radius);
+      unsigned int lastSlice = GetClusterSlice(constants, pos[2] + radius);
+      if (firstSlice > 0) firstSlice--;
+      if (lastSlice < CLUSTER_GRID_Z - 1) lastSlice++;
+
+      for (unsigned int z = firstSlice; z <= lastSlice; z++)
+      {
+         unsigned int sliceStart = GetClusterIndex(0, 0, z);
+         float dz = AxisDistance(pos[2], bounds.minZ[sliceStart], bounds.maxZ[sliceStart]);
+         if (dz * dz >= radiusSq) continue;
+
+         for (unsigned int y = 0; y < CLUSTER_GRID_Y; y++)
+         {
+            unsigned int rowStart = GetClusterIndex(0, y, z);
+            float dy = AxisDistance(pos[1], bounds.minY[rowStart], bounds.maxY[rowStart]);
+            if (dy * dy >= radiusSq) continue;
+
+#ifdef CLUSTER_ASSIGNMENT_SSE
+            __m128 zero = _mm_setzero_ps();
+            __m128 centerX = _mm_set1_ps(pos[0]);
+            __m128 yzDistSq = _mm_set1_ps(dy * dy);
+            __m128 dzSq = _mm_set1_ps(dz * dz);
+            __m128 radiusSq4 = _mm_set1_ps(radiusSq);
+            for (unsigned int x = 0; x < CLUSTER_GRID_X; x += 4)
+            {
+               __m128 minX = _mm_loadu_ps(&bounds.minX[rowStart + x]);
+               __m128 maxX = _mm_loadu_ps(&bounds.maxX[rowStart + x]);
+               __m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(minX, centerX), _mm_sub_ps(centerX, maxX)), zero);
+               __m128 distSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), yzDistSq), dzSq);
+               int mask = _mm_movemask_ps(_mm_cmplt_ps(distSq, radiusSq4));
+               for (unsigned int lane = 0; mask != 0; lane++, mask >>= 1)
+               {
+                  if (mask & 1)
+                  {
+                     hitClusters.push_back(rowStart + x + lane);
+                     hitLights.push_back(light);
+                  }
+               }
+            }
+#else
+            for (unsigned int x = 0; x < CLUSTER_GRID_X; x++)
+            {
+               if (SphereIntersectsCluster(bounds, rowStart + x, viewLight))
+               {
+                  hitClusters.push_back(rowStart + x);
+                  hitLights.push_back(light);
+               }
+            }
+#endif
+         }
+      }
+   }
+
+   CompactClusterLists(hitClusters, hitLights, maxIndices, pAssignment);
+}
+
+void AssignLightsToClustersBruteForce(const ClusterBounds &bounds, const vector<ClusterLight> &viewLights,
+   unsigned int maxIndices, ClusterAssignment *pAssignment)
+{
+   vector<unsigned int> hitClusters;
+   vector<unsigned int> hitLights;
+   for (unsigned int light = 0; light < viewLights.size(); light++)
+   {
+      for (unsigned int cluster = 0; cluster < NUM_CLUSTERS; cluster++)
+      {
+         if (SphereIntersectsCluster(bounds, cluster, viewLights[light]))
+         {
+            hitClusters.push_back(cluster);
+            hitLights.push_back(light);
+         }
+      }
+   }
+   CompactClusterLists(hitClusters, hitLights, maxIndices, pAssignment);
+}
+
+void CreateRandomLights(const float boundsMin[3], const float boundsMax[3], unsigned int numLights, float range,
+   unsigned int seed, vector<ClusterLight> *pLights)
+{
+   const float SPOT_COS_OUTER = 0.82f;
+   const float SPOT_COS_INNER = 0.9f;
+
+   unsigned int state = seed;
+   pLights->resize(numLights);
+   for (unsigned int i = 0; i < numLights; i++)
+   {
+      float random[6];
+      for (unsigned int r = 0; r < 6; r++)
+      {
+         state = state * 1664525u + 1013904223u;
+         random[r] = (float)(state >> 8) / (float)(1 << 24);
+      }
+
+      ClusterLight &light = (*pLights)[i];
+      for (unsigned int c = 0; c < 3; c++)
+      {
+         light.position[c] = boundsMin[c] + random[c] * (boundsMax[c] - boundsMin[c]);
+         light.color[c] = 0.25f + 0.75f * random[3 + c];
+      }
+      light.range = range;
+      light.direction[0] = 0.0f;
+      light.direction[1] = -1.0f;
+      light.direction[2] = 0.0f;
+
+      bool isSpot = i % 3 == 0;
+      light.spotCosOuter = isSpot ? SPOT_COS_OUTER : -2.0f;
+      light.spotCosInner = isSpot ? SPOT_COS_INNER : -1.0f;
+   }
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <vector>
+
+#include "ShaderDefines.h"
+
+// Point or spot light, spotCosOuter <= -1 makes it a point light. The
+// layout matches ClusterLight in the shaders, which read the lights in view
+// space.
+struct ClusterLight
+{
+   float position[3];
+   float range;
+   float color[3];
+   float spotCosOuter;
+   float direction[3];
+   float spotCosInner;
+};
+
+// Range of a cluster's lights in the compact index list
+struct ClusterHeader
+{
+   unsigned int offset;
+   unsigned int numLights;
+};
+
+// Constant buffer shared by ClusterAssignCS.hlsl and PlainPixel.hlsl. view
+// is the row vector world to view matrix stored row major.
+struct ClusterConstants
+{
+   float view[16];
+   float tanHalfFovX;
+   float tanHalfFovY;
+   float nearZ;
+   float farZ;
+   float screenWidth;
+   float screenHeight;
+   float logDepthScale;
+   unsigned int numLights;
+};
+
+// View space bounding boxes of the clusters, structure of arrays so the
+// assignment can test several clusters at once
+struct ClusterBounds
+{
+   std::vector<float> minX, minY, minZ;
+   std::vector<float> maxX, maxY, maxZ;
+};
+
+struct ClusterAssignment
+{
+   std::vector<ClusterHeader> clusters;
+   std::vector<unsigned int> lightIndices;
+   unsigned int numDroppedLights;
+};
+
+// Clusters are stored x fastest, then y (top row first), then depth
+inline unsigned int GetClusterIndex(unsigned int x, unsigned int y, unsigned int z)
+{
+   return (z * CLUSTER_GRID_Y + y) * CLUSTER_GRID_X + x;
+}
+
+// fovY in radians, the perspective matches XMMatrixPerspectiveFovLH
+void SetupClusterConstants(const float view[16], float fovY, float aspect, float nearZ, float farZ,
+   unsigned int screenWidth, unsigned int screenHeight, unsigned int numLights, ClusterConstants *pConstants);
+
+// Depth slice of a view space depth, clamped to the grid
+unsigned int GetClusterSlice(const ClusterConstants &constants, float viewZ);
+
+void ComputeClusterBounds(const ClusterConstants &constants, ClusterBounds *pBounds);
+
+// Moves the first numLights lights from world into view space
+void TransformLightsToView(const std::vector<ClusterLight> &lights, unsigned int numLights, const float view[16],
+   std::vector<ClusterLight> *pViewLights);
+
+// Sphere against box test of every light with the clusters its screen and
+// depth extent can touch, four clusters per SSE instruction where
+// available. Lights are listed in light order within a cluster, at most
+// MAX_LIGHTS_PER_CLUSTER each and maxIndices in total.
+void AssignLightsToClusters(const ClusterBounds &bounds, const ClusterConstants &constants,
+   const std::vector<ClusterLight> &viewLights, unsigned int maxIndices, ClusterAssignment *pAssignment);
+
+// Tests every light against every cluster, the reference the fast path
+// has to match exactly
+void AssignLightsToClustersBruteForce(const ClusterBounds &bounds, const std::vector<ClusterLight> &viewLights,
+   unsigned int maxIndices, ClusterAssignment *pAssignment);
+
+// Scatters lights inside a box, a third of them spot lights pointing down.
+// The same seed gives the same lights.
+void CreateRandomLights(const float boundsMin[3], const float boundsMax[3], unsigned int numLights, float range,
+   unsigned int seed, std::vector<ClusterLight> *pLights);
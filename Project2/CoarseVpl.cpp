@@ -0,0 +1,273 @@
+#include "CoarseVpl.h"
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+using std::vector;
+
+namespace
+{
+   const char COARSE_VPL_FILE_MAGIC[4] = { 'C', 'V', 'P', '1' };
+
+   const float *GetTexel(const NormalDepthBuffer &buffer, unsigned int x, unsigned int y)
+   {
+      return &buffer.texels[(y * buffer.width + x) * 4];
+   }
+
+   void GetViewPosition(const CoarseVplConstants &constants, unsigned int x, unsigned int y, float z,
+      float position[3])
+   {
+      position[0] = ((x + 0.5f) / constants.width * 2.0f - 1.0f) * constants.tanHalfFovX * z;
+      position[1] = (1.0f - (y + 0.5f) / constants.height * 2.0f) * constants.tanHalfFovY * z;
+      position[2] = z;
+   }
+
+   // Position on the coarse grid the pixel's light is interpolated at and
+   // the bilinear fraction towards the next coarse pixel, samples sit at
+   // the centers of their blocks
+   void GetCoarsePosition(unsigned int pixel, unsigned int factor, unsigned int coarseSize, unsigned int *pBase,
+      unsigned int *pNext, float *pFraction)
+   {
+      float position = ((float)pixel - (float)(factor / 2)) / factor;
+      unsigned int base = position > 0.0f ? (unsigned int)position : 0;
+      if (base > coarseSize - 1) base = coarseSize - 1;
+      float fraction = position - base;
+      if (fraction < 0.0f) fraction = 0.0f;
+      if (fraction > 1.0f) fraction = 1.0f;
+      *pBase = base;
+      *pNext = base + 1 < coarseSize ? base + 1 : base;
+      *pFraction = fraction;
+   }
+
+   void Upsample(const NormalDepthBuffer &buffer, const vector<float> &coarse, const CoarseVplConstants &constants,
+      const vector<VirtualPointLight> *pLights, vector<float> *pLight, VplShadingCost *pCost)
+   {
+      VplShadingCost cost = { 0, 0, 0, 0 };
+      for (size_t i = 3; i < coarse.size(); i += 4)
+      {
+         if (coarse[i] != 0.0f) cost.coarsePixels++;
+      }
+
+      pLight->assign(constants.width * constants.height * 4, 0.0f);
+      for (unsigned int y = 0; y < constants.height; y++)
+      {
+         for (unsigned int x = 0; x < constants.width; x++)
+         {
+            const float *texel = GetTexel(buffer, x, y);
+            float z = texel[3];
+            if (z == 0.0f) continue;
+            cost.fullPixels++;
+            cost.upsampledPixels++;
+
+            unsigned int x0, x1, y0, y1;
+            float tx, ty;
+            GetCoarsePosition(x, constants.factor, constants.coarseWidth, &x0, &x1, &tx);
+            GetCoarsePosition(y, constants.factor, constants.coarseHeight, &y0, &y1, &ty);
+            unsigned int tapsX[4] = { x0, x1, x0, x1 };
+            unsigned int tapsY[4] = { y0, y0, y1, y1 };
+            float bilinear[4] = { (1.0f - tx) * (1.0f - ty), tx * (1.0f - ty), (1.0f - tx) * ty, tx * ty };
+
+            float sum[3] = { 0.0f, 0.0f, 0.0f };
+            float totalWeight = 0.0f;
+            for (unsigned int i = 0; i < 4; i++)
+            {
+               const float *tap = &coarse[(tapsY[i] * constants.coarseWidth + tapsX[i]) * 4];
+               float weight = bilinear[i];
+               if (pLights)
+               {
+                  unsigned int sampleX, sampleY;
+                  GetCoarseVplSample(constants, tapsX[i], tapsY[i], &sampleX, &sampleY);
+                  const float *normal = GetTexel(buffer, sampleX, sampleY);
+                  float agreement = texel[0] * normal[0] + texel[1] * normal[1] + texel[2] * normal[2];
+                  if (agreement < 0.0f) agreement = 0.0f;
+                  float depthWeight = 1.0f - fabsf(tap[3] - z) / (constants.depthTolerance * z);
+                  if (depthWeight < 0.0f) depthWeight = 0.0f;
+                  weight *= depthWeight * powf(agreement, constants.normalPower);
+               }
+               for (unsigned int c = 0; c < 3; c++) sum[c] += tap[c] * weight;
+               totalWeight += weight;
+            }
+
+            float *light = &(*pLight)[(y * constants.width + x) * 4];
+            if (totalWeight > 1e-4f)
+            {
+               for (unsigned int c = 0; c < 3; c++) light[c] = sum[c] / totalWeight;
+            }
+            else if (pLights)
+            {
+               float p[3];
+               GetViewPosition(constants, x, y, z, p);
+               ShadeVpls(constants, *pLights, p, light);
+               cost.fallbackPixels++;
+            }
+         }
+      }
+      if (pCost) *pCost = cost;
+   }
+}
+
+void GetDefaultCoarseVplSettings(CoarseVplSettings *pSettings)
+{
+   pSettings->factor = 2;
+   pSettings->depthTolerance = 0.1f;
+   pSettings->normalPower = 8.0f;
+   pSettings->upsampleCost = 0.1f;
+}
+
+void SetupCoarseVplConstants(const CoarseVplSettings &settings, unsigned int width, unsigned int height,
+   float tanHalfFovX, float tanHalfFovY, const float viewToLight[16], CoarseVplConstants *pConstants)
+{
+   unsigned int factor = settings.factor > 0 ? settings.factor : 1;
+
+   memset(pConstants, 0, sizeof(*pConstants));
+   memcpy(pConstants->viewToLight, viewToLight, sizeof(pConstants->viewToLight));
+   pConstants->tanHalfFovX = tanHalfFovX;
+   pConstants->tanHalfFovY = tanHalfFovY;
+   pConstants->depthTolerance = settings.depthTolerance;
+   pConstants->normalPower = settings.normalPower;
+   pConstants->width = width;
+   pConstants->height = height;
+   pConstants->coarseWidth = (width + factor - 1) / factor;
+   pConstants->coarseHeight = (height + factor - 1) / factor;
+   pConstants->factor = factor;
+}
+
+void GetCoarseVplSample(const CoarseVplConstants &constants, unsigned int x, unsigned int y, unsigned int *pPixelX,
+   unsigned int *pPixelY)
+{
+   unsigned int pixelX = x * constants.factor + constants.factor / 2;
+   unsigned int pixelY = y * constants.factor + constants.factor / 2;
+   *pPixelX = pixelX < constants.width ? pixelX : constants.width - 1;
+   *pPixelY = pixelY < constants.height ? pixelY : constants.height - 1;
+}
+
+void ShadeVpls(const CoarseVplConstants &constants, const vector<VirtualPointLight> &lights,
+   const float viewPosition[3], float color[3])
+{
+   color[0] = color[1] = color[2] = 0.0f;
+
+   const float *m = constants.viewToLight;
+   float clip[4];
+   for (unsigned int i = 0; i < 4; i++)
+   {
+      clip[i] = viewPosition[0] * m[i] + viewPosition[1] * m[4 + i] + viewPosition[2] * m[8 + i] + m[12 + i];
+   }
+   if (clip[3] <= 0.0f) return;
+
+   // Light map UV and depth, the space the VPLs are placed in
+   float lightPosition[3] = { clip[0] / clip[3] * 0.5f + 0.5f, clip[1] / clip[3] * -0.5f + 0.5f, clip[2] / clip[3] };
+   for (size_t i = 0; i < lights.size(); i++)
+   {
+      float d[3];
+      for (unsigned int c = 0; c < 3; c++) d[c] = lightPosition[c] - lights[i].position[c];
+      float dist = sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+      if (dist < (float)MAX_LIGHT_RADIUS)
+      {
+         float lightFactor = ((float)MAX_LIGHT_RADIUS - dist) / (float)MAX_LIGHT_RADIUS;
+         float falloff = lightFactor * lightFactor * lightFactor;
+         for (unsigned int c = 0; c < 3; c++) color[c] += falloff * lights[i].color[c];
+      }
+   }
+}
+
+void ShadeVplsReference(const NormalDepthBuffer &buffer, const CoarseVplConstants &constants,
+   const vector<VirtualPointLight> &lights, vector<float> *pLight)
+{
+   pLight->assign(constants.width * constants.height * 4, 0.0f);
+   for (unsigned int y = 0; y < constants.height; y++)
+   {
+      for (unsigned int x = 0; x < constants.width; x++)
+      {
+         float z = GetTexel(buffer, x, y)[3];
+         if (z == 0.0f) continue;
+         float p[3];
+         GetViewPosition(constants, x, y, z, p);
+         ShadeVpls(constants, lights, p, &(*pLight)[(y * constants.width + x) * 4]);
+      }
+   }
+}
+
+void ShadeVplsCoarse(const NormalDepthBuffer &buffer, const CoarseVplConstants &constants,
+   const vector<VirtualPointLight> &lights, vector<float> *pCoarse)
+{
+   pCoarse->assign(constants.coarseWidth * constants.coarseHeight * 4, 0.0f);
+   for (unsigned int y = 0; y < constants.coarseHeight; y++)
+   {
+      for (unsigned int x = 0; x < constants.coarseWidth; x++)
+      {
+         unsigned int sampleX, sampleY;
+         GetCoarseVplSample(constants, x, y, &sampleX, &sampleY);
+         float z = GetTexel(buffer, sampleX, sampleY)[3];
+         if (z == 0.0f) continue;
+
+         float p[3];
+         GetViewPosition(constants, sampleX, sampleY, z, p);
+         float *coarse = &(*pCoarse)[(y * constants.coarseWidth + x) * 4];
+         ShadeVpls(constants, lights, p, coarse);
+         coarse[3] = z;
+      }
+   }
+}
+
+void UpsampleVplLight(const NormalDepthBuffer &buffer, const vector<float> &coarse,
+   const CoarseVplConstants &constants, const vector<VirtualPointLight> &lights, vector<float> *pLight,
+   VplShadingCost *pCost)
+{
+   Upsample(buffer, coarse, constants, &lights, pLight, pCost);
+}
+
+void UpsampleVplLightBilinear(const NormalDepthBuffer &buffer, const vector<float> &coarse,
+   const CoarseVplConstants &constants, vector<float> *pLight)
+{
+   Upsample(buffer, coarse, constants, NULL, pLight, NULL);
+}
+
+float GetRelativeVplShadingCost(const VplShadingCost &cost, float upsampleCost)
+{
+   if (cost.fullPixels == 0) return 0.0f;
+   float shaded = (float)(cost.coarsePixels + cost.fallbackPixels) + upsampleCost * cost.upsampledPixels;
+   return shaded / cost.fullPixels;
+}
+
+double ComputePsnr(const vector<float> &reference, const vector<float> &image)
+{
+   double peak = 0.0, squaredError = 0.0;
+   size_t numValues = 0;
+   for (size_t i = 0; i + 3 < reference.size() && i + 3 < image.size(); i += 4)
+   {
+      for (unsigned int c = 0; c < 3; c++)
+      {
+         double error = (double)image[i + c] - reference[i + c];
+         squaredError += error * error;
+         if (reference[i + c] > peak) peak = reference[i + c];
+         numValues++;
+      }
+   }
+   if (numValues == 0 || squaredError == 0.0) return std::numeric_limits<double>::infinity();
+   if (peak <= 0.0) return 0.0;
+   return 10.0 * log10(peak * peak / (squaredError / numValues));
+}
+
+bool SaveCoarseVplConstants(const char *pPath, const CoarseVplConstants &constants)
+{
+   std::ofstream out(pPath, std::ios::binary);
+   if (!out) return false;
+
+   out.write(COARSE_VPL_FILE_MAGIC, sizeof(COARSE_VPL_FILE_MAGIC));
+   out.write((const char *)&constants, sizeof(constants));
+   return out.good();
+}
+
+bool LoadCoarseVplConstants(const char *pPath, CoarseVplConstants *pConstants)
+{
+   std::ifstream in(pPath, std::ios::binary);
+   if (!in) return false;
+
+   char magic[sizeof(COARSE_VPL_FILE_MAGIC)];
+   in.read(magic, sizeof(magic));
+   in.read((char *)pConstants, sizeof(*pConstants));
+   if (!in || memcmp(magic, COARSE_VPL_FILE_MAGIC, sizeof(magic)) != 0) return false;
+   return pConstants->factor > 0 && pConstants->width > 0 && pConstants->height > 0;
+}
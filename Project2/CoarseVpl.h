@@ -0,0 +1,111 @@
+#pragma once
+
+#include <vector>
+
+#include "LightBinning.h"
+#include "ShaderDefines.h"
+#include "Ssao.h"
+
+// Where the renderer saves the constants of the frame it captures, the
+// coarse_vpl benchmark shades the captured normals and light map with them
+#define COARSE_VPL_CAPTURE_FILE "coarse_vpl_capture.bin"
+
+// Runtime options of the coarse VPL shading
+struct CoarseVplSettings
+{
+   // Side of the block of pixels one coarse pixel covers, 2 shades a
+   // quarter of the pixels. Changing it needs the graph declared again.
+   unsigned int factor;
+
+   // Relative view depth difference past which a coarse pixel belongs to a
+   // different surface
+   float depthTolerance;
+
+   // Exponent of the normals' dot product in the upsample's weights
+   float normalPower;
+
+   // GPU time of an upsampled pixel relative to one running the light loop,
+   // for the cost model
+   float upsampleCost;
+};
+
+// Constant buffer of VplShadingCS.hlsl
+struct CoarseVplConstants
+{
+   // Row vector matrix from the main view's view space to the light's clip
+   // space, stored row major
+   float viewToLight[16];
+
+   float tanHalfFovX;
+   float tanHalfFovY;
+   float depthTolerance;
+   float normalPower;
+
+   unsigned int width;
+   unsigned int height;
+   unsigned int coarseWidth;
+   unsigned int coarseHeight;
+
+   unsigned int factor;
+   unsigned int padding[3];
+};
+
+// Pixels the VPL light loop and the upsample run for. Coarse pixels and the
+// full resolution pixels the upsample finds no coarse pixel on their
+// surface for run the loop, fullPixels is what texMain's loop runs for.
+// Pixels without geometry are not counted.
+struct VplShadingCost
+{
+   unsigned int fullPixels;
+   unsigned int coarsePixels;
+   unsigned int fallbackPixels;
+   unsigned int upsampledPixels;
+};
+
+void GetDefaultCoarseVplSettings(CoarseVplSettings *pSettings);
+
+void SetupCoarseVplConstants(const CoarseVplSettings &settings, unsigned int width, unsigned int height,
+   float tanHalfFovX, float tanHalfFovY, const float viewToLight[16], CoarseVplConstants *pConstants);
+
+// Full resolution pixel coarse pixel (x, y) is shaded at, the center of its
+// block clamped to the screen
+void GetCoarseVplSample(const CoarseVplConstants &constants, unsigned int x, unsigned int y, unsigned int *pPixelX,
+   unsigned int *pPixelY);
+
+// VPL light at a view space position, the sum over the lights within
+// MAX_LIGHT_RADIUS of its light space position like texMain's loop. The
+// light grid only skips lights out of reach, so every light is tried here.
+void ShadeVpls(const CoarseVplConstants &constants, const std::vector<VirtualPointLight> &lights,
+   const float viewPosition[3], float color[3]);
+
+// texMain's VPL light at every pixel, RGBA per pixel with w 0
+void ShadeVplsReference(const NormalDepthBuffer &buffer, const CoarseVplConstants &constants,
+   const std::vector<VirtualPointLight> &lights, std::vector<float> *pLight);
+
+// VplShadingCS.hlsl's coarse pass, RGBA per coarse pixel with the view
+// depth of its sample in w, 0 where nothing was drawn
+void ShadeVplsCoarse(const NormalDepthBuffer &buffer, const CoarseVplConstants &constants,
+   const std::vector<VirtualPointLight> &lights, std::vector<float> *pCoarse);
+
+// VplShadingCS.hlsl's upsample. The four nearest coarse pixels are weighted
+// bilinearly, by how close their depth is to the pixel's and by how much
+// their normals agree. Pixels left without a coarse pixel on their surface
+// run the light loop themselves. pCost may be NULL.
+void UpsampleVplLight(const NormalDepthBuffer &buffer, const std::vector<float> &coarse,
+   const CoarseVplConstants &constants, const std::vector<VirtualPointLight> &lights, std::vector<float> *pLight,
+   VplShadingCost *pCost);
+
+// Same as UpsampleVplLight with bilinear weights only, for comparison
+void UpsampleVplLightBilinear(const NormalDepthBuffer &buffer, const std::vector<float> &coarse,
+   const CoarseVplConstants &constants, std::vector<float> *pLight);
+
+// GPU time of the coarse shading relative to texMain's per pixel loop
+float GetRelativeVplShadingCost(const VplShadingCost &cost, float upsampleCost);
+
+// Peak signal to noise ratio of the RGB of two RGBA images in dB, the peak
+// being the reference's largest channel. Infinite for identical images.
+double ComputePsnr(const std::vector<float> &reference, const std::vector<float> &image);
+
+// Raw dump of the constants behind a small header
+bool SaveCoarseVplConstants(const char *pPath, const CoarseVplConstants &constants);
+bool LoadCoarseVplConstants(const char *pPath, CoarseVplConstants *pConstants);
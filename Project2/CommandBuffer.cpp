@@ -0,0 +1,293 @@
+#include "CommandBuffer.h"
+
+#include <cassert>
+#include <cstring>
+
+void CommandBuffer::Reset()
+{
+   m_commands.clear();
+   m_payload.clear();
+}
+
+Command *CommandBuffer::AddCommand(CommandType type, unsigned int stage, unsigned int slot)
+{
+   Command cmd;
+   memset(&cmd, 0, sizeof(cmd));
+   cmd.type = (unsigned short)type;
+   cmd.stage = (unsigned short)stage;
+   cmd.slot = slot;
+   m_commands.push_back(cmd);
+   return &m_commands.back();
+}
+
+unsigned int CommandBuffer::AddPayload(const void *pData, unsigned int size)
+{
+   unsigned int offset = (unsigned int)m_payload.size();
+   unsigned int numWords = (size + sizeof(unsigned int) - 1) / sizeof(unsigned int);
+   if (numWords == 0) return offset;
+
+   m_payload.resize(offset + numWords, 0);
+   if (pData)
+   {
+      memcpy(&m_payload[offset], pData, size);
+   }
+   return offset;
+}
+
+unsigned int CommandBuffer::AsBits(float value)
+{
+   unsigned int bits;
+   memcpy(&bits, &value, sizeof(bits));
+   return bits;
+}
+
+float CommandBuffer::AsFloat(unsigned int bits)
+{
+   float value;
+   memcpy(&value, &bits, sizeof(value));
+   return value;
+}
+
+void CommandBuffer::BindShader(ShaderStage stage, ResourceHandle shader)
+{
+   AddCommand(CMD_BIND_SHADER, stage)->args[0] = shader;
+}
+
+void CommandBuffer::BindInputLayout(ResourceHandle layout)
+{
+   AddCommand(CMD_BIND_INPUT_LAYOUT)->args[0] = layout;
+}
+
+void CommandBuffer::BindRasterState(ResourceHandle state)
+{
+   AddCommand(CMD_BIND_RASTER_STATE)->args[0] = state;
+}
+
+void CommandBuffer::SetViewport(const Viewport &viewport)
+{
+   Command *pCmd = AddCommand(CMD_SET_VIEWPORT);
+   pCmd->args[0] = AsBits(viewport.topLeftX);
+   pCmd->args[1] = AsBits(viewport.topLeftY);
+   pCmd->args[2] = AsBits(viewport.width);
+   pCmd->args[3] = AsBits(viewport.height);
+   pCmd->args[4] = AsBits(viewport.minDepth);
+   pCmd->args[5] = AsBits(viewport.maxDepth);
+}
+
+void CommandBuffer::SetScissor(int left, int top, int right, int bottom)
+{
+   Command *pCmd = AddCommand(CMD_SET_SCISSOR);
+   pCmd->args[0] = (unsigned int)left;
+   pCmd->args[1] = (unsigned int)top;
+   pCmd->args[2] = (unsigned int)right;
+   pCmd->args[3] = (unsigned int)bottom;
+}
+
+void CommandBuffer::BindDepthState(ResourceHandle state)
+{
+   AddCommand(CMD_BIND_DEPTH_STATE)->args[0] = state;
+}
+
+void CommandBuffer::BindBlendState(ResourceHandle state)
+{
+   AddCommand(CMD_BIND_BLEND_STATE)->args[0] = state;
+}
+
+void CommandBuffer::BindConstantBuffers(ShaderStage stage, unsigned int startSlot, unsigned int count, const ResourceHandle *pBuffers)
+{
+   unsigned int offset = AddPayload(pBuffers, count * sizeof(ResourceHandle));
+   Command *pCmd = AddCommand(CMD_BIND_CONSTANT_BUFFERS, stage, startSlot);
+   pCmd->args[0] = count;
+   pCmd->args[1] = offset;
+}
+
+void CommandBuffer::BindShaderResources(ShaderStage stage, unsigned int startSlot, unsigned int count, const ResourceHandle *pViews)
+{
+   unsigned int offset = AddPayload(pViews, count * sizeof(ResourceHandle));
+   Command *pCmd = AddCommand(CMD_BIND_SHADER_RESOURCES, stage, startSlot);
+   pCmd->args[0] = count;
+   pCmd->args[1] = offset;
+}
+
+void CommandBuffer::BindSamplers(ShaderStage stage, unsigned int startSlot, unsigned int count, const ResourceHandle *pSamplers)
+{
+   unsigned int offset = AddPayload(pSamplers, count * sizeof(ResourceHandle));
+   Command *pCmd = AddCommand(CMD_BIND_SAMPLERS, stage, startSlot);
+   pCmd->args[0] = count;
+   pCmd->args[1] = offset;
+}
+
+void CommandBuffer::BindComputeUavs(unsigned int startSlot, unsigned int count, const ResourceHandle *pViews, const unsigned int *pInitialCounts)
+{
+   unsigned int offset = AddPayload(pViews, count * sizeof(ResourceHandle));
+   unsigned int countsOffset = AddPayload(pInitialCounts, count * sizeof(unsigned int));
+   Command *pCmd = AddCommand(CMD_BIND_COMPUTE_UAVS, STAGE_COMPUTE, startSlot);
+   pCmd->args[0] = count;
+   pCmd->args[1] = offset;
+   pCmd->args[2] = pInitialCounts ? 1 : 0;
+   pCmd->args[3] = countsOffset;
+}
+
+void CommandBuffer::BindOutputs(unsigned int numTargets, const ResourceHandle *pTargets, ResourceHandle depthView,
+   unsigned int uavStartSlot, unsigned int numUavs, const ResourceHandle *pUavs)
+{
+   unsigned int targetsOffset = AddPayload(pTargets, numTargets * sizeof(ResourceHandle));
+   unsigned int uavsOffset = AddPayload(pUavs, numUavs * sizeof(ResourceHandle));
+   Command *pCmd = AddCommand(CMD_BIND_OUTPUTS, STAGE_PIXEL);
+   pCmd->args[0] = numTargets;
+   pCmd->args[1] = targetsOffset;
+   pCmd->args[2] = depthView;
+   pCmd->args[3] = uavStartSlot;
+   pCmd->args[4] = numUavs;
+   pCmd->args[5] = uavsOffset;
+}
+
+void CommandBuffer::BindVertexBuffer(unsigned int slot, ResourceHandle buffer, unsigned int stride, unsigned int offset)
+{
+   Command *pCmd = AddCommand(CMD_BIND_VERTEX_BUFFER, STAGE_VERTEX, slot);
+   pCmd->args[0] = buffer;
+   pCmd->args[1] = stride;
+   pCmd->args[2] = offset;
+}
+
+void CommandBuffer::BindIndexBuffer(ResourceHandle buffer)
+{
+   AddCommand(CMD_BIND_INDEX_BUFFER, STAGE_VERTEX)->args[0] = buffer;
+}
+
+void CommandBuffer::UpdateBuffer(ResourceHandle buffer, const void *pData, unsigned int size)
+{
+   assert(pData != NULL);
+   unsigned int offset = AddPayload(pData, size);
+   Command *pCmd = AddCommand(CMD_UPDATE_BUFFER);
+   pCmd->args[0] = buffer;
+   pCmd->args[1] = offset;
+   pCmd->args[2] = size;
+}
+
+void CommandBuffer::Draw(unsigned int vertexCount, unsigned int startVertex)
+{
+   Command *pCmd = AddCommand(CMD_DRAW);
+   pCmd->args[0] = vertexCount;
+   pCmd->args[1] = startVertex;
+}
+
+void CommandBuffer::DrawIndexed(unsigned int indexCount, unsigned int startIndex, int baseVertex)
+{
+   Command *pCmd = AddCommand(CMD_DRAW_INDEXED);
+   pCmd->args[0] = indexCount;
+   pCmd->args[1] = startIndex;
+   pCmd->args[2] = (unsigned int)baseVertex;
+}
+
+void CommandBuffer::DrawIndexedInstanced(unsigned int indexCount, unsigned int instanceCount, unsigned int startIndex,
+   int baseVertex, unsigned int startInstance)
+{
+   Command *pCmd = AddCommand(CMD_DRAW_INDEXED_INSTANCED);
+   pCmd->args[0] = indexCount;
+   pCmd->args[1] = instanceCount;
+   pCmd->args[2] = startIndex;
+   pCmd->args[3] = (unsigned int)baseVertex;
+   pCmd->args[4] = startInstance;
+}
+
+void CommandBuffer::DrawIndexedInstancedIndirect(ResourceHandle argsBuffer, unsigned int argsOffset)
+{
+   Command *pCmd = AddCommand(CMD_DRAW_INDEXED_INSTANCED_INDIRECT);
+   pCmd->args[0] = argsBuffer;
+   pCmd->args[1] = argsOffset;
+}
+
+void CommandBuffer::Dispatch(unsigned int groupsX, unsigned int groupsY, unsigned int groupsZ)
+{
+   Command *pCmd = AddCommand(CMD_DISPATCH, STAGE_COMPUTE);
+   pCmd->args[0] = groupsX;
+   pCmd->args[1] = groupsY;
+   pCmd->args[2] = groupsZ;
+}
+
+void CommandBuffer::ClearRenderTarget(ResourceHandle view, const float color[4])
+{
+   Command *pCmd = AddCommand(CMD_CLEAR_RENDER_TARGET);
+   pCmd->args[0] = view;
+   for (unsigned int i = 0; i < 4; i++) pCmd->args[i + 1] = AsBits(color[i]);
+}
+
+void CommandBuffer::ClearDepth(ResourceHandle view, float depth)
+{
+   Command *pCmd = AddCommand(CMD_CLEAR_DEPTH);
+   pCmd->args[0] = view;
+   pCmd->args[1] = AsBits(depth);
+}
+
+void CommandBuffer::ClearUavFloat(ResourceHandle view, const float values[4])
+{
+   Command *pCmd = AddCommand(CMD_CLEAR_UAV_FLOAT);
+   pCmd->args[0] = view;
+   for (unsigned int i = 0; i < 4; i++) pCmd->args[i + 1] = AsBits(values[i]);
+}
+
+void CommandBuffer::ClearUavUint(ResourceHandle view, const unsigned int values[4])
+{
+   Command *pCmd = AddCommand(CMD_CLEAR_UAV_UINT);
+   pCmd->args[0] = view;
+   for (unsigned int i = 0; i < 4; i++) pCmd->args[i + 1] = values[i];
+}
+
+void CommandBuffer::CopyResource(ResourceHandle dest, ResourceHandle source)
+{
+   Command *pCmd = AddCommand(CMD_COPY_RESOURCE);
+   pCmd->args[0] = dest;
+   pCmd->args[1] = source;
+}
+
+void CommandBuffer::CopyStructureCount(ResourceHandle dest, unsigned int destOffset, ResourceHandle sourceUav)
+{
+   Command *pCmd = AddCommand(CMD_COPY_STRUCTURE_COUNT);
+   pCmd->args[0] = dest;
+   pCmd->args[1] = destOffset;
+   pCmd->args[2] = sourceUav;
+}
+
+void CommandBuffer::GenerateMips(ResourceHandle srv)
+{
+   Command *pCmd = AddCommand(CMD_GENERATE_MIPS);
+   pCmd->args[0] = srv;
+}
+
+void CommandBuffer::TiledResourceBarrier(ResourceHandle view)
+{
+   Command *pCmd = AddCommand(CMD_TILED_RESOURCE_BARRIER);
+   pCmd->args[0] = view;
+}
+
+void CommandBuffer::Append(const CommandBuffer &other)
+{
+   unsigned int payloadBase = (unsigned int)m_payload.size();
+   m_payload.insert(m_payload.end(), other.m_payload.begin(), other.m_payload.end());
+
+   for (size_t i = 0; i < other.m_commands.size(); i++)
+   {
+      Command cmd = other.m_commands[i];
+      switch (cmd.type)
+      {
+      case CMD_BIND_CONSTANT_BUFFERS:
+      case CMD_BIND_SHADER_RESOURCES:
+      case CMD_BIND_SAMPLERS:
+      case CMD_UPDATE_BUFFER:
+         cmd.args[1] += payloadBase;
+         break;
+      case CMD_BIND_COMPUTE_UAVS:
+         cmd.args[1] += payloadBase;
+         cmd.args[3] += payloadBase;
+         break;
+      case CMD_BIND_OUTPUTS:
+         cmd.args[1] += payloadBase;
+         cmd.args[5] += payloadBase;
+         break;
+      default:
+         break;
+      }
+      m_commands.push_back(cmd);
+   }
+}
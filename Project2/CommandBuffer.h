@@ -0,0 +1,155 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// API agnostic handle to a GPU object (shader, view, buffer, state), 0 is
+// the null object. Backends map handles to their own objects.
+typedef unsigned int ResourceHandle;
+const ResourceHandle NULL_HANDLE = 0;
+
+enum ShaderStage
+{
+   STAGE_VERTEX = 0,
+   STAGE_PIXEL,
+   STAGE_COMPUTE,
+   NUM_SHADER_STAGES
+};
+
+enum CommandType
+{
+   CMD_BIND_SHADER = 0,
+   CMD_BIND_INPUT_LAYOUT,
+   CMD_BIND_RASTER_STATE,
+   CMD_SET_VIEWPORT,
+   CMD_BIND_CONSTANT_BUFFERS,
+   CMD_BIND_SHADER_RESOURCES,
+   CMD_BIND_SAMPLERS,
+   CMD_BIND_COMPUTE_UAVS,
+   CMD_BIND_OUTPUTS,
+   CMD_BIND_VERTEX_BUFFER,
+   CMD_BIND_INDEX_BUFFER,
+   CMD_UPDATE_BUFFER,
+   CMD_DRAW,
+   CMD_DRAW_INDEXED,
+   CMD_DRAW_INDEXED_INSTANCED,
+   CMD_DRAW_INDEXED_INSTANCED_INDIRECT,
+   CMD_DISPATCH,
+   CMD_CLEAR_RENDER_TARGET,
+   CMD_CLEAR_DEPTH,
+   CMD_CLEAR_UAV_FLOAT,
+   CMD_CLEAR_UAV_UINT,
+   CMD_COPY_RESOURCE,
+   CMD_COPY_STRUCTURE_COUNT,
+   CMD_GENERATE_MIPS,
+   CMD_SET_SCISSOR,
+   CMD_BIND_DEPTH_STATE,
+   CMD_BIND_BLEND_STATE,
+   CMD_TILED_RESOURCE_BARRIER,
+   NUM_COMMAND_TYPES
+};
+
+// Fixed size POD command. The meaning of args depends on the type, lists of
+// handles and constant data live in the owning buffer's payload.
+struct Command
+{
+   unsigned short type;
+   unsigned short stage;
+   unsigned int slot;
+   unsigned int args[6];
+};
+
+struct Viewport
+{
+   float topLeftX;
+   float topLeftY;
+   float width;
+   float height;
+   float minDepth;
+   float maxDepth;
+};
+
+// Linear stream of commands recorded by the render passes and replayed by a
+// backend. Buffers are reused between frames, Reset keeps the allocations.
+class CommandBuffer
+{
+public:
+   void Reset();
+
+   void BindShader(ShaderStage stage, ResourceHandle shader);
+   void BindInputLayout(ResourceHandle layout);
+   void BindRasterState(ResourceHandle state);
+   void SetViewport(const Viewport &viewport);
+
+   // Only clips when the bound raster state enables scissoring, right and
+   // bottom are exclusive
+   void SetScissor(int left, int top, int right, int bottom);
+
+   // NULL_HANDLE restores the default depth test
+   void BindDepthState(ResourceHandle state);
+
+   // NULL_HANDLE restores writing the pixel shader's output as it is
+   void BindBlendState(ResourceHandle state);
+   void BindConstantBuffers(ShaderStage stage, unsigned int startSlot, unsigned int count, const ResourceHandle *pBuffers);
+   void BindShaderResources(ShaderStage stage, unsigned int startSlot, unsigned int count, const ResourceHandle *pViews);
+   void BindSamplers(ShaderStage stage, unsigned int startSlot, unsigned int count, const ResourceHandle *pSamplers);
+
+   // pInitialCounts may be NULL to keep the append counters
+   void BindComputeUavs(unsigned int startSlot, unsigned int count, const ResourceHandle *pViews, const unsigned int *pInitialCounts);
+
+   // Binds the render targets, depth view and pixel shader UAVs in one go
+   void BindOutputs(unsigned int numTargets, const ResourceHandle *pTargets, ResourceHandle depthView,
+      unsigned int uavStartSlot = 0, unsigned int numUavs = 0, const ResourceHandle *pUavs = NULL);
+
+   void BindVertexBuffer(unsigned int slot, ResourceHandle buffer, unsigned int stride, unsigned int offset);
+   void BindIndexBuffer(ResourceHandle buffer);
+
+   // The data is copied into the command buffer. Constant buffers are always
+   // updated whole, other buffers only in their first size bytes.
+   void UpdateBuffer(ResourceHandle buffer, const void *pData, unsigned int size);
+
+   void Draw(unsigned int vertexCount, unsigned int startVertex);
+   void DrawIndexed(unsigned int indexCount, unsigned int startIndex, int baseVertex);
+   void DrawIndexedInstanced(unsigned int indexCount, unsigned int instanceCount, unsigned int startIndex,
+      int baseVertex, unsigned int startInstance);
+
+   // The arguments are read from argsBuffer at the byte offset when the
+   // draw executes
+   void DrawIndexedInstancedIndirect(ResourceHandle argsBuffer, unsigned int argsOffset);
+   void Dispatch(unsigned int groupsX, unsigned int groupsY, unsigned int groupsZ);
+
+   void ClearRenderTarget(ResourceHandle view, const float color[4]);
+   void ClearDepth(ResourceHandle view, float depth);
+   void ClearUavFloat(ResourceHandle view, const float values[4]);
+   void ClearUavUint(ResourceHandle view, const unsigned int values[4]);
+   void CopyResource(ResourceHandle dest, ResourceHandle source);
+
+   // Writes the hidden counter of an append or counter UAV to dest at the
+   // byte offset, so GPU generated counts can feed later passes
+   void CopyStructureCount(ResourceHandle dest, unsigned int destOffset, ResourceHandle sourceUav);
+
+   // Fills the lower mips of a texture from its top mip, the texture needs
+   // render target binding and the view has to cover every mip
+   void GenerateMips(ResourceHandle srv);
+
+   // Accesses through the view of a tiled resource wait for every earlier
+   // access to tiled resources, e.g. when it maps tiles another one used
+   void TiledResourceBarrier(ResourceHandle view);
+
+   // Appends the commands of another buffer
+   void Append(const CommandBuffer &other);
+
+   const std::vector<Command> &GetCommands() const { return m_commands; }
+   const unsigned int *GetPayload(unsigned int offset) const { return &m_payload[offset]; }
+   unsigned int GetPayloadSize() const { return (unsigned int)m_payload.size() * sizeof(unsigned int); }
+
+   static float AsFloat(unsigned int bits);
+
+private:
+   Command *AddCommand(CommandType type, unsigned int stage = 0, unsigned int slot = 0);
+   unsigned int AddPayload(const void *pData, unsigned int size);
+   static unsigned int AsBits(float value);
+
+   std::vector<Command> m_commands;
+   std::vector<unsigned int> m_payload;
+};
@@ -0,0 +1,61 @@
+#pragma once
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <chrono>
+#endif
+
+// Wall clock timer used for the CPU side frame measurements. Uses the
+// performance counter on Windows since the VS2012 high_resolution_clock
+// only has millisecond precision.
+class CpuTimer
+{
+public:
+   CpuTimer()
+   {
+#ifdef _WIN32
+      LARGE_INTEGER frequency;
+      QueryPerformanceFrequency(&frequency);
+      m_msPerCount = 1000.0 / (double)frequency.QuadPart;
+#endif
+      Start();
+   }
+
+   void Start()
+   {
+      m_start = Now();
+   }
+
+   double GetElapsedMs() const
+   {
+#ifdef _WIN32
+      return (double)(Now() - m_start) * m_msPerCount;
+#else
+      return std::chrono::duration<double, std::milli>(Now() - m_start).count();
+#endif
+   }
+
+private:
+#ifdef _WIN32
+   typedef __int64 TimePoint;
+
+   static TimePoint Now()
+   {
+      LARGE_INTEGER counter;
+      QueryPerformanceCounter(&counter);
+      return counter.QuadPart;
+   }
+
+   double m_msPerCount;
+#else
+   typedef std::chrono::steady_clock::time_point TimePoint;
+
+   static TimePoint Now()
+   {
+      return std::chrono::steady_clock::now();
+   }
+#endif
+
+   TimePoint m_start;
+};
@@ -0,0 +1,56 @@
+// Must match CULL_THREAD_GROUP_SIZE in GpuCulling.h
+#define CULL_THREAD_GROUP_SIZE 64
+
+// Size of DrawIndexedInstancedIndirect's arguments in uints
+#define DRAW_ARGS_SIZE 5
+#define DRAW_ARGS_INSTANCE_COUNT 1
+#define DRAW_ARGS_START_INSTANCE 4
+
+struct CullInstance
+{
+   float4 bounds;
+   uint drawIndex;
+   uint3 padding;
+   float4 world0;
+   float4 world1;
+   float4 world2;
+   float4 world3;
+};
+
+cbuffer CullConstants : register(b0)
+{
+   float4 frustumPlanes[6];
+   uint numInstances;
+};
+
+StructuredBuffer<CullInstance> m_Instances : register(t0);
+
+// Reset to the argument template before the dispatch, instance counts at 0
+RWBuffer<uint> m_DrawArgs : register(u0);
+
+// Per-instance vertex stream of the scene passes, four float4s per instance
+RWBuffer<float4> m_VisibleInstances : register(u1);
+
+[numthreads(CULL_THREAD_GROUP_SIZE, 1, 1)]
+void main( uint3 DTid : SV_DispatchThreadID )
+{
+   if (DTid.x >= numInstances) return;
+
+   CullInstance instance = m_Instances[DTid.x];
+
+   [unroll]
+   for (uint i = 0; i < 6; i++)
+   {
+      if (dot(frustumPlanes[i].xyz, instance.bounds.xyz) + frustumPlanes[i].w < -instance.bounds.w) return;
+   }
+
+   uint argsOffset = instance.drawIndex * DRAW_ARGS_SIZE;
+   uint slot;
+   InterlockedAdd(m_DrawArgs[argsOffset + DRAW_ARGS_INSTANCE_COUNT], 1, slot);
+
+   uint dst = (m_DrawArgs[argsOffset + DRAW_ARGS_START_INSTANCE] + slot) * 4;
+   m_VisibleInstances[dst] = instance.world0;
+   m_VisibleInstances[dst + 1] = instance.world1;
+   m_VisibleInstances[dst + 2] = instance.world2;
+   m_VisibleInstances[dst + 3] = instance.world3;
+}
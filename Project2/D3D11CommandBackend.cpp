@@ -0,0 +1,264 @@
+#include "D3D11CommandBackend.h"
+
+#include <cassert>
+
+D3D11CommandBackend::D3D11CommandBackend()
+{
+   // Handle 0 is always the null object
+   m_objects.push_back(NULL);
+}
+
+ResourceHandle D3D11CommandBackend::Register(ID3D11DeviceChild *pObject)
+{
+   if (pObject == NULL) return NULL_HANDLE;
+
+   m_objects.push_back(pObject);
+   return (ResourceHandle)(m_objects.size() - 1);
+}
+
+void D3D11CommandBackend::Replace(ResourceHandle handle, ID3D11DeviceChild *pObject)
+{
+   assert(handle != NULL_HANDLE && handle < m_objects.size());
+   m_objects[handle] = pObject;
+}
+
+template<typename T>
+void D3D11CommandBackend::GetList(const CommandBuffer &buffer, UINT offset, UINT count, T **ppObjects) const
+{
+   assert(count <= MAX_BOUND_OBJECTS);
+   if (count == 0) return;
+
+   const ResourceHandle *pHandles = buffer.GetPayload(offset);
+   for (UINT i = 0; i < count; i++)
+   {
+      ppObjects[i] = Get<T>(pHandles[i]);
+   }
+}
+
+void D3D11CommandBackend::Execute(ID3D11DeviceContext *pContext, const CommandBuffer &buffer) const
+{
+   // All of the geometry in the renderer is triangle lists
+   pContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+   const std::vector<Command> &commands = buffer.GetCommands();
+   for (size_t i = 0; i < commands.size(); i++)
+   {
+      const Command &cmd = commands[i];
+      const UINT *args = cmd.args;
+
+      switch (cmd.type)
+      {
+      case CMD_BIND_SHADER:
+         switch (cmd.stage)
+         {
+         case STAGE_VERTEX:
+            pContext->VSSetShader(Get<ID3D11VertexShader>(args[0]), NULL, 0);
+            break;
+         case STAGE_PIXEL:
+            pContext->PSSetShader(Get<ID3D11PixelShader>(args[0]), NULL, 0);
+            break;
+         case STAGE_COMPUTE:
+            pContext->CSSetShader(Get<ID3D11ComputeShader>(args[0]), NULL, 0);
+            break;
+         }
+         break;
+      case CMD_BIND_INPUT_LAYOUT:
+         pContext->IASetInputLayout(Get<ID3D11InputLayout>(args[0]));
+         break;
+      case CMD_BIND_RASTER_STATE:
+         pContext->RSSetState(Get<ID3D11RasterizerState>(args[0]));
+         break;
+      case CMD_SET_VIEWPORT:
+      {
+         D3D11_VIEWPORT viewport;
+         viewport.TopLeftX = CommandBuffer::AsFloat(args[0]);
+         viewport.TopLeftY = CommandBuffer::AsFloat(args[1]);
+         viewport.Width = CommandBuffer::AsFloat(args[2]);
+         viewport.Height = CommandBuffer::AsFloat(args[3]);
+         viewport.MinDepth = CommandBuffer::AsFloat(args[4]);
+         viewport.MaxDepth = CommandBuffer::AsFloat(args[5]);
+         pContext->RSSetViewports(1, &viewport);
+         break;
+      }
+      case CMD_SET_SCISSOR:
+      {
+         D3D11_RECT rect = { (LONG)args[0], (LONG)args[1], (LONG)args[2], (LONG)args[3] };
+         pContext->RSSetScissorRects(1, &rect);
+         break;
+      }
+      case CMD_BIND_DEPTH_STATE:
+         pContext->OMSetDepthStencilState(Get<ID3D11DepthStencilState>(args[0]), 0);
+         break;
+      case CMD_BIND_BLEND_STATE:
+         pContext->OMSetBlendState(Get<ID3D11BlendState>(args[0]), NULL, 0xffffffff);
+         break;
+      case CMD_BIND_CONSTANT_BUFFERS:
+      {
+         ID3D11Buffer *pBuffers[MAX_BOUND_OBJECTS];
+         GetList(buffer, args[1], args[0], pBuffers);
+         switch (cmd.stage)
+         {
+         case STAGE_VERTEX:
+            pContext->VSSetConstantBuffers(cmd.slot, args[0], pBuffers);
+            break;
+         case STAGE_PIXEL:
+            pContext->PSSetConstantBuffers(cmd.slot, args[0], pBuffers);
+            break;
+         case STAGE_COMPUTE:
+            pContext->CSSetConstantBuffers(cmd.slot, args[0], pBuffers);
+            break;
+         }
+         break;
+      }
+      case CMD_BIND_SHADER_RESOURCES:
+      {
+         ID3D11ShaderResourceView *pViews[MAX_BOUND_OBJECTS];
+         GetList(buffer, args[1], args[0], pViews);
+         switch (cmd.stage)
+         {
+         case STAGE_VERTEX:
+            pContext->VSSetShaderResources(cmd.slot, args[0], pViews);
+            break;
+         case STAGE_PIXEL:
+            pContext->PSSetShaderResources(cmd.slot, args[0], pViews);
+            break;
+         case STAGE_COMPUTE:
+            pContext->CSSetShaderResources(cmd.slot, args[0], pViews);
+            break;
+         }
+         break;
+      }
+      case CMD_BIND_SAMPLERS:
+      {
+         ID3D11SamplerState *pSamplers[MAX_BOUND_OBJECTS];
+         GetList(buffer, args[1], args[0], pSamplers);
+         switch (cmd.stage)
+         {
+         case STAGE_VERTEX:
+            pContext->VSSetSamplers(cmd.slot, args[0], pSamplers);
+            break;
+         case STAGE_PIXEL:
+            pContext->PSSetSamplers(cmd.slot, args[0], pSamplers);
+            break;
+         case STAGE_COMPUTE:
+            pContext->CSSetSamplers(cmd.slot, args[0], pSamplers);
+            break;
+         }
+         break;
+      }
+      case CMD_BIND_COMPUTE_UAVS:
+      {
+         ID3D11UnorderedAccessView *pViews[MAX_BOUND_OBJECTS];
+         GetList(buffer, args[1], args[0], pViews);
+         const UINT *pInitialCounts = (args[2] && args[0] > 0) ? buffer.GetPayload(args[3]) : NULL;
+         pContext->CSSetUnorderedAccessViews(cmd.slot, args[0], pViews, pInitialCounts);
+         break;
+      }
+      case CMD_BIND_OUTPUTS:
+      {
+         ID3D11RenderTargetView *pTargets[MAX_BOUND_OBJECTS];
+         ID3D11UnorderedAccessView *pUavs[MAX_BOUND_OBJECTS];
+         GetList(buffer, args[1], args[0], pTargets);
+         GetList(buffer, args[5], args[4], pUavs);
+
+         ID3D11DepthStencilView *pDepthView = Get<ID3D11DepthStencilView>(args[2]);
+         if (args[4] > 0)
+         {
+            pContext->OMSetRenderTargetsAndUnorderedAccessViews(args[0], args[0] ? pTargets : NULL, pDepthView,
+               args[3], args[4], pUavs, NULL);
+         }
+         else
+         {
+            pContext->OMSetRenderTargets(args[0], args[0] ? pTargets : NULL, pDepthView);
+         }
+         break;
+      }
+      case CMD_BIND_VERTEX_BUFFER:
+      {
+         ID3D11Buffer *pBuffer = Get<ID3D11Buffer>(args[0]);
+         pContext->IASetVertexBuffers(cmd.slot, 1, &pBuffer, &args[1], &args[2]);
+         break;
+      }
+      case CMD_BIND_INDEX_BUFFER:
+         pContext->IASetIndexBuffer(Get<ID3D11Buffer>(args[0]), DXGI_FORMAT_R32_UINT, 0);
+         break;
+      case CMD_UPDATE_BUFFER:
+      {
+         ID3D11Buffer *pBuffer = Get<ID3D11Buffer>(args[0]);
+         D3D11_BUFFER_DESC desc;
+         pBuffer->GetDesc(&desc);
+         if (desc.BindFlags & D3D11_BIND_CONSTANT_BUFFER)
+         {
+            pContext->UpdateSubresource(pBuffer, 0, NULL, buffer.GetPayload(args[1]), 0, 0);
+         }
+         else
+         {
+            D3D11_BOX box = { 0, 0, 0, args[2], 1, 1 };
+            pContext->UpdateSubresource(pBuffer, 0, &box, buffer.GetPayload(args[1]), 0, 0);
+         }
+         break;
+      }
+      case CMD_DRAW:
+         pContext->Draw(args[0], args[1]);
+         break;
+      case CMD_DRAW_INDEXED:
+         pContext->DrawIndexed(args[0], args[1], (INT)args[2]);
+         break;
+      case CMD_DRAW_INDEXED_INSTANCED:
+         pContext->DrawIndexedInstanced(args[0], args[1], args[2], (INT)args[3], args[4]);
+         break;
+      case CMD_DRAW_INDEXED_INSTANCED_INDIRECT:
+         pContext->DrawIndexedInstancedIndirect(Get<ID3D11Buffer>(args[0]), args[1]);
+         break;
+      case CMD_DISPATCH:
+         pContext->Dispatch(args[0], args[1], args[2]);
+         break;
+      case CMD_CLEAR_RENDER_TARGET:
+      {
+         FLOAT color[4];
+         for (UINT c = 0; c < 4; c++) color[c] = CommandBuffer::AsFloat(args[c + 1]);
+         pContext->ClearRenderTargetView(Get<ID3D11RenderTargetView>(args[0]), color);
+         break;
+      }
+      case CMD_CLEAR_DEPTH:
+         pContext->ClearDepthStencilView(Get<ID3D11DepthStencilView>(args[0]), D3D11_CLEAR_DEPTH,
+            CommandBuffer::AsFloat(args[1]), 0);
+         break;
+      case CMD_CLEAR_UAV_FLOAT:
+      {
+         FLOAT values[4];
+         for (UINT c = 0; c < 4; c++) values[c] = CommandBuffer::AsFloat(args[c + 1]);
+         pContext->ClearUnorderedAccessViewFloat(Get<ID3D11UnorderedAccessView>(args[0]), values);
+         break;
+      }
+      case CMD_CLEAR_UAV_UINT:
+         pContext->ClearUnorderedAccessViewUint(Get<ID3D11UnorderedAccessView>(args[0]), &args[1]);
+         break;
+      case CMD_COPY_RESOURCE:
+         pContext->CopyResource(Get<ID3D11Resource>(args[0]), Get<ID3D11Resource>(args[1]));
+         break;
+      case CMD_COPY_STRUCTURE_COUNT:
+         pContext->CopyStructureCount(Get<ID3D11Buffer>(args[0]), args[1], Get<ID3D11UnorderedAccessView>(args[2]));
+         break;
+      case CMD_GENERATE_MIPS:
+         pContext->GenerateMips(Get<ID3D11ShaderResourceView>(args[0]));
+         break;
+#ifdef BACKEND_TILED_RESOURCES
+      case CMD_TILED_RESOURCE_BARRIER:
+      {
+         ID3D11DeviceContext2 *pContext2 = NULL;
+         // The graph only records these on devices with tiled resources
+         if (SUCCEEDED(pContext->QueryInterface(__uuidof(ID3D11DeviceContext2), (void **)&pContext2)))
+         {
+            pContext2->TiledResourceBarrier(NULL, Get<ID3D11View>(args[0]));
+            pContext2->Release();
+         }
+         break;
+      }
+#endif
+      default:
+         assert(false);
+         break;
+      }
+   }
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <d3d11.h>
+#include <d3dx11.h>
+#include <DxErr.h>
+#include <sdkddkver.h>
+#include <vector>
+
+// Tiled resources need the D3D11.2 headers of the Windows 8.1 SDK, built
+// with an older SDK the render graph's transients stay committed
+#if defined(NTDDI_WINBLUE)
+#include <d3d11_2.h>
+#define BACKEND_TILED_RESOURCES
+#endif
+
+#include "CommandBuffer.h"
+
+// Replays command buffers on a D3D11 context. Objects are registered once
+// and referred to by handle from then on, the backend does not own them.
+// Execute only reads the handle table so several deferred contexts can be
+// replayed into concurrently.
+class D3D11CommandBackend
+{
+public:
+   D3D11CommandBackend();
+
+   ResourceHandle Register(ID3D11DeviceChild *pObject);
+
+   // Points an existing handle at a different object, e.g. after a resize
+   void Replace(ResourceHandle handle, ID3D11DeviceChild *pObject);
+
+   void Execute(ID3D11DeviceContext *pContext, const CommandBuffer &buffer) const;
+
+private:
+   static const UINT MAX_BOUND_OBJECTS = 16;
+
+   template<typename T>
+   T *Get(ResourceHandle handle) const
+   {
+      return static_cast<T *>(m_objects[handle]);
+   }
+
+   template<typename T>
+   void GetList(const CommandBuffer &buffer, UINT offset, UINT count, T **ppObjects) const;
+
+   std::vector<ID3D11DeviceChild *> m_objects;
+};
@@ -0,0 +1,168 @@
+#include "Deferred.h"
+
+#include <cmath>
+
+using std::vector;
+
+namespace
+{
+   inline float SignNotZero(float x)
+   {
+      return x >= 0.0f ? 1.0f : -1.0f;
+   }
+
+   inline float Abs(float x)
+   {
+      return x >= 0.0f ? x : -x;
+   }
+
+   unsigned int PackSnorm16(float x)
+   {
+      if (x < -1.0f) x = -1.0f;
+      if (x > 1.0f) x = 1.0f;
+      int value = (int)floorf(x * 32767.0f + 0.5f);
+      return (unsigned int)value & 0xffff;
+   }
+
+   float UnpackSnorm16(unsigned int bits)
+   {
+      int value = (int)(bits & 0xffff);
+      if (value >= 0x8000) value -= 0x10000;
+      float x = value / 32767.0f;
+      return x < -1.0f ? -1.0f : x;
+   }
+
+   // Signed distance of the sphere's center from the side plane through the
+   // eye where x = slope * z, positive on the side of larger x
+   inline float SideDistance(float x, float z, float slope)
+   {
+      return (x - slope * z) / sqrtf(1.0f + slope * slope);
+   }
+}
+
+void GetGBufferLayout(GBufferLayoutType type, GBufferLayout *pLayout)
+{
+   if (type == GBUFFER_LAYOUT_WIDE)
+   {
+      pLayout->name = "wide";
+      pLayout->numTargets = 3;
+      pLayout->targets[0] = GRAPH_FORMAT_RGBA32_FLOAT;
+      pLayout->targets[1] = GRAPH_FORMAT_RGBA32_FLOAT;
+      pLayout->targets[2] = GRAPH_FORMAT_RGBA32_FLOAT;
+   }
+   else
+   {
+      pLayout->name = "compact";
+      pLayout->numTargets = 2;
+      pLayout->targets[0] = GRAPH_FORMAT_RGBA8_UNORM;
+      pLayout->targets[1] = GRAPH_FORMAT_R32_UINT;
+   }
+}
+
+void ComputeDeferredBandwidth(const GBufferLayout &layout, float overdraw, ShadingBandwidth *pBandwidth)
+{
+   unsigned int gbufferBytes = GetFormatSize(GRAPH_FORMAT_DEPTH32);
+   for (unsigned int i = 0; i < layout.numTargets; i++) gbufferBytes += GetFormatSize(layout.targets[i]);
+
+   // Every fragment reads the depth for its test and writes the G-buffer.
+   // The lighting pass reads it all once and writes the lit color, which
+   // the composite reads and writes to the back buffer.
+   unsigned int colorBytes = GetFormatSize(GRAPH_FORMAT_RGBA8_UNORM);
+   pBandwidth->gbufferBytes = gbufferBytes;
+   pBandwidth->geometryBytes = overdraw * (gbufferBytes + GetFormatSize(GRAPH_FORMAT_DEPTH32));
+   pBandwidth->lightingBytes = gbufferBytes + 3 * colorBytes;
+   pBandwidth->totalBytes = pBandwidth->geometryBytes + pBandwidth->lightingBytes;
+}
+
+void ComputeForwardBandwidth(float overdraw, ShadingBandwidth *pBandwidth)
+{
+   unsigned int depthBytes = GetFormatSize(GRAPH_FORMAT_DEPTH32);
+   pBandwidth->gbufferBytes = 0;
+   pBandwidth->geometryBytes = overdraw * (GetFormatSize(GRAPH_FORMAT_RGBA8_UNORM) + 2 * depthBytes);
+   pBandwidth->lightingBytes = 0.0;
+   pBandwidth->totalBytes = pBandwidth->geometryBytes;
+}
+
+void SetupDeferredConstants(const float invViewProj[16], float fovY, float aspect, float nearZ, float farZ,
+   unsigned int width, unsigned int height, unsigned int numLights, DeferredConstants *pConstants)
+{
+   for (unsigned int i = 0; i < 16; i++) pConstants->invViewProj[i] = invViewProj[i];
+   pConstants->tanHalfFovY = tanf(fovY * 0.5f);
+   pConstants->tanHalfFovX = pConstants->tanHalfFovY * aspect;
+   pConstants->nearZ = nearZ;
+   pConstants->farZ = farZ;
+   pConstants->width = width;
+   pConstants->height = height;
+   pConstants->tilesX = (width + DEFERRED_TILE_SIZE - 1) / DEFERRED_TILE_SIZE;
+   pConstants->numLights = numLights;
+}
+
+float GetViewDepth(const DeferredConstants &constants, float depth)
+{
+   return constants.nearZ * constants.farZ / (constants.farZ - depth * (constants.farZ - constants.nearZ));
+}
+
+unsigned int EncodeOctahedralNormal(const float normal[3])
+{
+   float length = Abs(normal[0]) + Abs(normal[1]) + Abs(normal[2]);
+   float u = normal[0] / length;
+   float v = normal[1] / length;
+
+   // The lower half is folded over the diagonals onto the corners
+   if (normal[2] < 0.0f)
+   {
+      float foldedU = (1.0f - Abs(v)) * SignNotZero(u);
+      float foldedV = (1.0f - Abs(u)) * SignNotZero(v);
+      u = foldedU;
+      v = foldedV;
+   }
+   return PackSnorm16(u) | (PackSnorm16(v) << 16);
+}
+
+void DecodeOctahedralNormal(unsigned int packed, float normal[3])
+{
+   float u = UnpackSnorm16(packed);
+   float v = UnpackSnorm16(packed >> 16);
+   float z = 1.0f - Abs(u) - Abs(v);
+   if (z < 0.0f)
+   {
+      float unfoldedU = (1.0f - Abs(v)) * SignNotZero(u);
+      float unfoldedV = (1.0f - Abs(u)) * SignNotZero(v);
+      u = unfoldedU;
+      v = unfoldedV;
+   }
+
+   float length = sqrtf(u * u + v * v + z * z);
+   normal[0] = u / length;
+   normal[1] = v / length;
+   normal[2] = z / length;
+}
+
+void CullTileLights(const DeferredConstants &constants, const vector<ClusterLight> &viewLights, unsigned int tileX,
+   unsigned int tileY, float minZ, float maxZ, vector<unsigned int> *pIndices)
+{
+   pIndices->clear();
+   if (minZ > maxZ) return;
+
+   unsigned int x0 = tileX * DEFERRED_TILE_SIZE, y0 = tileY * DEFERRED_TILE_SIZE;
+   unsigned int x1 = x0 + DEFERRED_TILE_SIZE < constants.width ? x0 + DEFERRED_TILE_SIZE : constants.width;
+   unsigned int y1 = y0 + DEFERRED_TILE_SIZE < constants.height ? y0 + DEFERRED_TILE_SIZE : constants.height;
+
+   // Slopes of the tile's sides, rows start at the top of the screen
+   float left = (-1.0f + 2.0f * x0 / constants.width) * constants.tanHalfFovX;
+   float right = (-1.0f + 2.0f * x1 / constants.width) * constants.tanHalfFovX;
+   float top = (1.0f - 2.0f * y0 / constants.height) * constants.tanHalfFovY;
+   float bottom = (1.0f - 2.0f * y1 / constants.height) * constants.tanHalfFovY;
+
+   for (size_t i = 0; i < viewLights.size() && i < constants.numLights; i++)
+   {
+      const ClusterLight &light = viewLights[i];
+      const float *p = light.position;
+      if (p[2] + light.range <= minZ || p[2] - light.range >= maxZ) continue;
+      if (SideDistance(p[0], p[2], left) <= -light.range || -SideDistance(p[0], p[2], right) <= -light.range) continue;
+      if (SideDistance(p[1], p[2], bottom) <= -light.range || -SideDistance(p[1], p[2], top) <= -light.range) continue;
+
+      if (pIndices->size() == MAX_LIGHTS_PER_DEFERRED_TILE) break;
+      pIndices->push_back((unsigned int)i);
+   }
+}
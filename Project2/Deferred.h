@@ -0,0 +1,85 @@
+#pragma once
+
+#include <vector>
+
+#include "ClusteredLighting.h"
+#include "RenderGraph.h"
+#include "ShaderDefines.h"
+
+#define MAX_GBUFFER_TARGETS 4
+
+enum GBufferLayoutType
+{
+   // Position, normal and color in RGBA32F targets, what the old GI pass
+   // expected
+   GBUFFER_LAYOUT_WIDE = 0,
+
+   // The depth buffer, an octahedral normal packed in a 32 bit target and
+   // the albedo with the material in alpha. What deferred shading draws.
+   GBUFFER_LAYOUT_COMPACT,
+   NUM_GBUFFER_LAYOUTS
+};
+
+struct GBufferLayout
+{
+   const char *name;
+   unsigned int numTargets;
+   RenderGraphFormat targets[MAX_GBUFFER_TARGETS];
+};
+
+// Bytes moved per pixel of the main view by the geometry pass writing its
+// targets and the passes shading from them. Reads of the light lists and
+// shadow maps are the same for every layout and left out.
+struct ShadingBandwidth
+{
+   unsigned int gbufferBytes;
+   double geometryBytes;
+   double lightingBytes;
+   double totalBytes;
+};
+
+// Constant buffer of DeferredLightingCS.hlsl. invViewProj is the row vector
+// clip to world matrix of the main view stored row major.
+struct DeferredConstants
+{
+   float invViewProj[16];
+   float tanHalfFovX;
+   float tanHalfFovY;
+   float nearZ;
+   float farZ;
+   unsigned int width;
+   unsigned int height;
+   unsigned int tilesX;
+   unsigned int numLights;
+};
+
+void GetGBufferLayout(GBufferLayoutType type, GBufferLayout *pLayout);
+
+// overdraw is the average number of fragments drawn per pixel, each is
+// assumed to pass the depth test and write everything, the worst case.
+// Deferred lighting reads the layout once, writes the lit color and the
+// composite copies it to the back buffer.
+void ComputeDeferredBandwidth(const GBufferLayout &layout, float overdraw, ShadingBandwidth *pBandwidth);
+
+// Forward shading writes the color and depth of every fragment
+void ComputeForwardBandwidth(float overdraw, ShadingBandwidth *pBandwidth);
+
+// fovY in radians, the perspective matches XMMatrixPerspectiveFovLH
+void SetupDeferredConstants(const float invViewProj[16], float fovY, float aspect, float nearZ, float farZ,
+   unsigned int width, unsigned int height, unsigned int numLights, DeferredConstants *pConstants);
+
+// View space depth of a depth buffer value, 0 becomes nearZ
+float GetViewDepth(const DeferredConstants &constants, float depth);
+
+// Unit normal folded onto an octahedron and stored as two 16 bit signed
+// normalized values, x in the low half. Same as GBufferPS.hlsl and
+// DeferredLightingCS.hlsl.
+unsigned int EncodeOctahedralNormal(const float normal[3]);
+void DecodeOctahedralNormal(unsigned int packed, float normal[3]);
+
+// The view space lights whose sphere touches the tile's frustum between
+// minZ and maxZ, in light order and at most MAX_LIGHTS_PER_DEFERRED_TILE.
+// Same test as DeferredLightingCS.hlsl, whose threads list them in no
+// particular order.
+void CullTileLights(const DeferredConstants &constants, const std::vector<ClusterLight> &viewLights, unsigned int tileX,
+   unsigned int tileY, float minZ, float maxZ, std::vector<unsigned int> *pIndices);
@@ -0,0 +1,8 @@
+// The lit color of DeferredLightingCS.hlsl, copied to the back buffer with
+// PlaneVertexShader.hlsl's full screen triangle
+Texture2D<float4> m_litColor : register(t0);
+
+float4 main( float4 pos : SV_POSITION ) : SV_TARGET
+{
+   return m_litColor[uint2(pos.xy)];
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <d3d11.h>
+#include <d3dx11.h>
+#include <DxErr.h>
+#include <cassert>
+#include <vector>
+
+// One deferred context per recording worker along with the command lists
+// each worker produced for every pass of the frame.
+class DeferredContextPool
+{
+public:
+   DeferredContextPool() :
+      m_numPasses(0), m_driverCommandLists(FALSE)
+   {
+   }
+
+   ~DeferredContextPool()
+   {
+      for (UINT i = 0; i < m_commandLists.size(); i++)
+      {
+         if (m_commandLists[i]) m_commandLists[i]->Release();
+      }
+      for (UINT i = 0; i < m_contexts.size(); i++)
+      {
+         if (m_contexts[i]) m_contexts[i]->Release();
+      }
+   }
+
+   // Creates a deferred context per worker, the pool must not be used if
+   // this fails. Contexts created before the failure are released by the
+   // destructor.
+   HRESULT Create(ID3D11Device *pDevice, UINT numContexts, UINT numPasses)
+   {
+      m_numPasses = numPasses;
+      m_commandLists.resize(numContexts * numPasses, NULL);
+      for (UINT i = 0; i < numContexts; i++)
+      {
+         ID3D11DeviceContext *pContext = NULL;
+         HRESULT result = pDevice->CreateDeferredContext(0, &pContext);
+         if (FAILED(result)) return result;
+         m_contexts.push_back(pContext);
+      }
+
+      // Without driver support the runtime emulates command lists, recording
+      // still happens in parallel but the driver work is serialized
+      D3D11_FEATURE_DATA_THREADING threading;
+      if (SUCCEEDED(pDevice->CheckFeatureSupport(D3D11_FEATURE_THREADING, &threading, sizeof(threading))))
+      {
+         m_driverCommandLists = threading.DriverCommandLists;
+      }
+      return S_OK;
+   }
+
+   UINT GetNumContexts() const
+   {
+      return (UINT)m_contexts.size();
+   }
+
+   BOOL HasDriverCommandLists() const
+   {
+      return m_driverCommandLists;
+   }
+
+   ID3D11DeviceContext *GetContext(UINT worker) const
+   {
+      return m_contexts[worker];
+   }
+
+   // Closes the commands recorded on the worker's context since the last
+   // call. On failure the pass has no list and ExecuteCommandList skips it.
+   HRESULT FinishCommandList(UINT worker, UINT pass)
+   {
+      ID3D11CommandList **ppList = &m_commandLists[worker * m_numPasses + pass];
+      assert(*ppList == NULL);
+      HRESULT result = m_contexts[worker]->FinishCommandList(FALSE, ppList);
+      if (FAILED(result)) *ppList = NULL;
+      return result;
+   }
+
+   // Plays back and releases a finished command list, does nothing if the
+   // worker recorded nothing for the pass
+   void ExecuteCommandList(ID3D11DeviceContext *pImmediateContext, UINT worker, UINT pass)
+   {
+      ID3D11CommandList **ppList = &m_commandLists[worker * m_numPasses + pass];
+      if (*ppList == NULL) return;
+
+      pImmediateContext->ExecuteCommandList(*ppList, FALSE);
+      (*ppList)->Release();
+      *ppList = NULL;
+   }
+
+private:
+   std::vector<ID3D11DeviceContext *> m_contexts;
+   std::vector<ID3D11CommandList *> m_commandLists;
+   UINT m_numPasses;
+   BOOL m_driverCommandLists;
+};
@@ -0,0 +1,324 @@
+#include "ShaderDefines.h"
+
+struct PointLight
+{
+   float4 pos;
+   float4 col;
+};
+
+struct ClusterLight
+{
+   float3 position;
+   float range;
+   float3 color;
+   float spotCosOuter;
+   float3 direction;
+   float spotCosInner;
+};
+
+struct LightTile
+{
+   uint numLights;
+   float minDepth;
+   float maxDepth;
+   uint padding;
+};
+
+// Same slots as PlainPixel.hlsl, the G-buffer follows them
+Texture2D<float> m_shadowMap : register(t1);
+StructuredBuffer<PointLight> m_lightBuffer : register(t2);
+StructuredBuffer<LightTile> m_lightTiles : register(t3);
+StructuredBuffer<uint> m_lightIndices : register(t4);
+StructuredBuffer<ClusterLight> m_clusterLights : register(t5);
+Texture2D<float4> m_shadowMoments : register(t8);
+Texture2D<float> m_ambientOcclusion : register(t9);
+Texture2D<float4> m_albedo : register(t10);
+Texture2D<uint> m_normals : register(t11);
+Texture2D<float> m_depth : register(t12);
+
+RWTexture2D<float4> m_litColor : register(u0);
+
+SamplerComparisonState m_shadowSampler : register(s1);
+SamplerState m_momentsSampler : register(s2);
+
+// Must match DeferredConstants in Deferred.h
+cbuffer DeferredConstants : register(b0)
+{
+   float4x4 invViewProj;
+   float2 tanHalfFov;
+   float nearZ;
+   float farZ;
+   uint2 screenSize;
+   uint tilesX;
+   uint numLights;
+};
+
+cbuffer Lights : register(b1)
+{
+   float4 lightDir;
+   float4x4 lightMvp;
+};
+
+cbuffer ClusterConstants : register(b2)
+{
+   float4x4 clusterView;
+   float4 clusterProjection; // tanHalfFovX, tanHalfFovY, near, far
+   float2 clusterScreenSize;
+   float clusterLogDepthScale;
+   uint numClusterLights;
+};
+
+// Must match CascadeConstants in ShadowCascades.h
+cbuffer CascadeConstants : register(b3)
+{
+   float4x4 cascadeViewProj[NUM_SHADOW_CASCADES];
+   float4 cascadeSplits; // view space far depth of each cascade
+   float4 cascadeDepthBias;
+   uint pcfTapsSqrt;
+   uint shadowFilter;    // SHADOW_FILTER_PCF or SHADOW_FILTER_EVSM
+   float2 evsmExponents; // positive, negative
+   float lightBleedReduction;
+   float varianceBias;
+   float cascadeSize;    // side of each cascade in the atlas, in texels
+};
+
+groupshared uint g_minZ;
+groupshared uint g_maxZ;
+groupshared uint g_numTileLights;
+groupshared uint g_tileLights[MAX_LIGHTS_PER_DEFERRED_TILE];
+
+float unpackSnorm16( uint bits )
+{
+    int value = int(bits << 16) >> 16;
+    return max(value / 32767.0, -1.0);
+}
+
+// Same as DecodeOctahedralNormal in Deferred.cpp
+float3 decodeOctahedral( uint packed )
+{
+    float2 uv = float2(unpackSnorm16(packed), unpackSnorm16(packed >> 16));
+    float z = 1.0 - abs(uv.x) - abs(uv.y);
+    if (z < 0.0)
+    {
+        float2 signs = float2(uv.x >= 0.0 ? 1.0 : -1.0, uv.y >= 0.0 ? 1.0 : -1.0);
+        uv = (1.0 - abs(uv.yx)) * signs;
+    }
+    return normalize(float3(uv, z));
+}
+
+float3 phong( float3 norm, float3 lightDir, float3 lightColor, float3 dif )
+{
+    return dif * max(dot(norm, lightDir), 0.0) * lightColor;
+}
+
+float chebyshevUpperBound( float2 moments, float value, float minVariance )
+{
+    float variance = max(moments.y - moments.x * moments.x, minVariance);
+    float distance = value - moments.x;
+    return value <= moments.x ? 1.0 : variance / (variance + distance * distance);
+}
+
+float evsmVisibility( float4 moments, float depth )
+{
+    float warpedDepth = 2.0 * depth - 1.0;
+    float2 warped = float2(exp(evsmExponents.x * warpedDepth), -exp(-evsmExponents.y * warpedDepth));
+    float2 depthScale = varianceBias * evsmExponents * warped;
+    float2 minVariance = depthScale * depthScale;
+    float visibility = min(chebyshevUpperBound(moments.xy, warped.x, minVariance.x),
+                           chebyshevUpperBound(moments.zw, warped.y, minVariance.y));
+    return saturate((visibility - lightBleedReduction) / (1.0 - lightBleedReduction));
+}
+
+// PlainPixel.hlsl's shadowFactor. Compute shaders have no derivatives, so
+// EVSM reads the blurred top mip of the moments.
+float shadowFactor( float3 worldPos, float viewZ )
+{
+    uint cascade = uint(dot(float4(viewZ > cascadeSplits), float4(1, 1, 1, 1)));
+    if (cascade >= NUM_SHADOW_CASCADES) return 1.0;
+
+    float4 lightPos = mul(cascadeViewProj[cascade], float4(worldPos, 1.0));
+    float2 uv = lightPos.xy * float2(0.5, -0.5) + 0.5;
+    float2 texel = uv * cascadeSize;
+    float depth = lightPos.z - cascadeDepthBias[cascade];
+
+    float2 atlasScale = 1.0 / float2(cascadeSize * NUM_SHADOW_CASCADES, cascadeSize);
+
+    if (shadowFilter == SHADOW_FILTER_EVSM)
+    {
+        float2 tap = clamp(texel, 0.5, cascadeSize - 0.5);
+        tap.x += cascade * cascadeSize;
+        float4 moments = m_shadowMoments.SampleLevel(m_momentsSampler, tap * atlasScale, 0);
+        return evsmVisibility(moments, lightPos.z);
+    }
+
+    float start = 1.0 - float(pcfTapsSqrt);
+    float lit = 0.0;
+    for (uint y = 0; y < pcfTapsSqrt; y++)
+    {
+      for (uint x = 0; x < pcfTapsSqrt; x++)
+      {
+         float2 tap = clamp(texel + float2(start + 2.0 * x, start + 2.0 * y), 0.5, cascadeSize - 0.5);
+         tap.x += cascade * cascadeSize;
+         lit += m_shadowMap.SampleCmpLevelZero(m_shadowSampler, tap * atlasScale, depth);
+      }
+    }
+    return lit / float(pcfTapsSqrt * pcfTapsSqrt);
+}
+
+// The tile's lights instead of the cluster's, same falloff as PlainPixel.hlsl
+float3 tileLights( float3 viewPos, float3 viewNorm, float3 dif )
+{
+    float3 color = float3(0, 0, 0);
+    for (uint i = 0; i < g_numTileLights; i++)
+    {
+       ClusterLight light = m_clusterLights[g_tileLights[i]];
+       float3 toLight = light.position - viewPos;
+       float dist = length(toLight);
+       if (dist < light.range)
+       {
+          float3 l = toLight / dist;
+          float attenuation = 1.0 - dist / light.range;
+          attenuation *= attenuation;
+          if (light.spotCosOuter > -1.0)
+          {
+             attenuation *= smoothstep(light.spotCosOuter, light.spotCosInner, dot(-l, light.direction));
+          }
+          color += dif * saturate(dot(viewNorm, l)) * light.color * attenuation;
+       }
+    }
+    return color;
+}
+
+// VPL light of PlainPixel.hlsl's texMain, from the light grid tile the
+// pixel falls in
+float3 vplLights( float3 worldPos )
+{
+    float4 lPos = mul(lightMvp, float4(worldPos, 1.0));
+    lPos.xyz /= lPos.w;
+    lPos.x = lPos.x / 2.0 + 0.5;
+    lPos.y = lPos.y / -2.0 + 0.5;
+
+    int2 cell = clamp(int2(floor(lPos.xy * float2(LIGHT_GRID_WIDTH, LIGHT_GRID_HEIGHT))),
+                      int2(0, 0), int2(LIGHT_GRID_WIDTH - 1, LIGHT_GRID_HEIGHT - 1));
+    uint tile = cell.y * LIGHT_GRID_WIDTH + cell.x;
+    LightTile lightTile = m_lightTiles[tile];
+
+    float3 color = float3(0, 0, 0);
+    if (lPos.z >= lightTile.minDepth && lPos.z <= lightTile.maxDepth)
+    {
+       for (uint i = 0; i < lightTile.numLights; i++)
+       {
+          uint light = m_lightIndices[tile * MAX_LIGHTS_PER_TILE + i];
+          float dist = distance(lPos.xyz, m_lightBuffer[light].pos.xyz);
+          if (dist < MAX_LIGHT_RADIUS)
+          {
+             float lightFactor = (MAX_LIGHT_RADIUS - dist) / MAX_LIGHT_RADIUS;
+             color += lightFactor * lightFactor * lightFactor * m_lightBuffer[light].col.xyz;
+          }
+       }
+    }
+    return color;
+}
+
+// Signed distance from the side plane through the eye where x = slope * z.
+// Same as SideDistance in Deferred.cpp.
+float sideDistance( float x, float z, float slope )
+{
+    return (x - slope * z) * rsqrt(1.0 + slope * slope);
+}
+
+// Lights the G-buffer one DEFERRED_TILE_SIZE squared tile per group. The
+// group finds the tile's view depth range, culls the clustered lights
+// against the tile's frustum within it and every pixel then loops over
+// the tile's list only.
+[numthreads(DEFERRED_TILE_SIZE, DEFERRED_TILE_SIZE, 1)]
+void main( uint3 DTid : SV_DispatchThreadID, uint3 Gid : SV_GroupID, uint GI : SV_GroupIndex )
+{
+   if (GI == 0)
+   {
+      g_minZ = 0x7f7fffff;
+      g_maxZ = 0;
+      g_numTileLights = 0;
+   }
+   GroupMemoryBarrierWithGroupSync();
+
+   bool inside = DTid.x < screenSize.x && DTid.y < screenSize.y;
+   float depth = inside ? m_depth[DTid.xy] : 1.0;
+   float viewZ = nearZ * farZ / (farZ - depth * (farZ - nearZ));
+
+   // Positive floats order the same as their bits
+   if (depth < 1.0)
+   {
+      InterlockedMin(g_minZ, asuint(viewZ));
+      InterlockedMax(g_maxZ, asuint(viewZ));
+   }
+   GroupMemoryBarrierWithGroupSync();
+
+   float minZ = asfloat(g_minZ);
+   float maxZ = asfloat(g_maxZ);
+   if (minZ <= maxZ)
+   {
+      uint2 tileMin = Gid.xy * DEFERRED_TILE_SIZE;
+      uint2 tileMax = min(tileMin + DEFERRED_TILE_SIZE, screenSize);
+      float left = (-1.0 + 2.0 * tileMin.x / screenSize.x) * tanHalfFov.x;
+      float right = (-1.0 + 2.0 * tileMax.x / screenSize.x) * tanHalfFov.x;
+      float top = (1.0 - 2.0 * tileMin.y / screenSize.y) * tanHalfFov.y;
+      float bottom = (1.0 - 2.0 * tileMax.y / screenSize.y) * tanHalfFov.y;
+
+      for (uint i = GI; i < numLights; i += DEFERRED_TILE_SIZE * DEFERRED_TILE_SIZE)
+      {
+         float3 p = m_clusterLights[i].position;
+         float r = m_clusterLights[i].range;
+         if (p.z + r > minZ && p.z - r < maxZ &&
+             sideDistance(p.x, p.z, left) > -r && -sideDistance(p.x, p.z, right) > -r &&
+             sideDistance(p.y, p.z, bottom) > -r && -sideDistance(p.y, p.z, top) > -r)
+         {
+            uint slot;
+            InterlockedAdd(g_numTileLights, 1, slot);
+            if (slot < MAX_LIGHTS_PER_DEFERRED_TILE) g_tileLights[slot] = i;
+         }
+      }
+   }
+   GroupMemoryBarrierWithGroupSync();
+   if (GI == 0) g_numTileLights = min(g_numTileLights, MAX_LIGHTS_PER_DEFERRED_TILE);
+   GroupMemoryBarrierWithGroupSync();
+
+   if (!inside) return;
+   if (depth >= 1.0)
+   {
+      m_litColor[DTid.xy] = float4(0.2, 0.2, 0.2, 1.0);
+      return;
+   }
+
+   float2 ndc = (float2(DTid.xy) + 0.5) / float2(screenSize) * float2(2.0, -2.0) + float2(-1.0, 1.0);
+   float4 world = mul(invViewProj, float4(ndc, depth, 1.0));
+   float3 worldPos = world.xyz / world.w;
+   float3 viewPos = mul(clusterView, float4(worldPos, 1.0)).xyz;
+
+   float4 albedo = m_albedo[DTid.xy];
+   float3 dif = albedo.xyz;
+   float3 n = decodeOctahedral(m_normals[DTid.xy]);
+   float3 viewNorm = normalize(mul(clusterView, float4(n, 0.0)).xyz);
+   float3 lightClr = float3(1, 1, 1);
+
+   float3 color;
+   if (uint(round(albedo.w * 255.0)) == GBUFFER_MATERIAL_SOLID)
+   {
+      color = phong(n, lightDir.xyz, lightClr, dif) + tileLights(viewPos, viewNorm, dif);
+   }
+   else
+   {
+      float3 amb = dif * 0.2;
+      float ao = m_ambientOcclusion[DTid.xy];
+      color = vplLights(worldPos) * ao;
+      color += tileLights(viewPos, viewNorm, dif);
+
+      float lit = shadowFactor(worldPos, viewPos.z);
+      if (lit > 0.0)
+      {
+         color += lerp(amb * ao, phong(n, lightDir.xyz, lightClr, dif), lit);
+      }
+   }
+
+   m_litColor[DTid.xy] = float4(color, 1.0);
+}
@@ -0,0 +1,247 @@
+#include "DepthPrepass.h"
+
+#include <cmath>
+#include <cstddef>
+
+using std::vector;
+
+namespace
+{
+   // Point where the edge from a to b crosses the near plane z = 0
+   void IntersectNearPlane(const float a[4], const float b[4], float result[4])
+   {
+      float t = a[2] / (a[2] - b[2]);
+      for (unsigned int c = 0; c < 4; c++) result[c] = a[c] + t * (b[c] - a[c]);
+   }
+
+   // Screen positions are snapped to 1/256 of a pixel like a GPU does, the
+   // edge functions are then exact and pixels on an edge shared by two
+   // triangles land in exactly one of them
+   const int SUBPIXEL_BITS = 8;
+   const float SUBPIXEL_SCALE = (float)(1 << SUBPIXEL_BITS);
+
+   inline long long Snap(float x)
+   {
+      return (long long)floor(x * SUBPIXEL_SCALE + 0.5f);
+   }
+
+   inline long long EdgeFunction(const long long a[2], const long long b[2], long long x, long long y)
+   {
+      return (b[0] - a[0]) * (y - a[1]) - (b[1] - a[1]) * (x - a[0]);
+   }
+
+   // Pixels exactly on an edge belong to the triangle the edge runs down or
+   // to the left in
+   inline bool OwnsEdge(const long long a[2], const long long b[2])
+   {
+      long long dx = b[0] - a[0], dy = b[1] - a[1];
+      return dy > 0 || (dy == 0 && dx < 0);
+   }
+
+   inline bool IsInside(long long edge, bool ownsEdge)
+   {
+      return edge > 0 || (edge == 0 && ownsEdge);
+   }
+}
+
+void GetDefaultDepthPrepassSettings(DepthPrepassSettings *pSettings)
+{
+   // The pre-pass costs the main view's vertex work a second time and a
+   // depth only raster, the textured shader loops over hundreds of VPLs
+   // per fragment so saving an eighth of its fragments pays for it
+   pSettings->enableOverdraw = 1.15f;
+   pSettings->disableOverdraw = 1.05f;
+   pSettings->estimateResolution = 160;
+}
+
+double GetOverdraw(const OverdrawEstimate &estimate)
+{
+   if (estimate.coveredPixels == 0) return 1.0;
+   return (double)estimate.shadedFragments / estimate.coveredPixels;
+}
+
+double GetSavedShadingFraction(const OverdrawEstimate &estimate)
+{
+   if (estimate.shadedFragments == 0) return 0.0;
+   return 1.0 - (double)estimate.coveredPixels / estimate.shadedFragments;
+}
+
+bool ChooseDepthPrepass(DepthPrepassMode mode, const DepthPrepassSettings &settings, const OverdrawEstimate &estimate,
+   bool enabled)
+{
+   if (mode == DEPTH_PREPASS_OFF) return false;
+   if (mode == DEPTH_PREPASS_ON) return true;
+
+   double overdraw = GetOverdraw(estimate);
+   if (enabled) return overdraw >= settings.disableOverdraw;
+   return overdraw >= settings.enableOverdraw;
+}
+
+OverdrawEstimator::OverdrawEstimator() :
+   m_width(0), m_height(0), m_rasterizedFragments(0), m_shadedFragments(0)
+{
+}
+
+void OverdrawEstimator::Begin(unsigned int width, unsigned int height)
+{
+   m_width = width;
+   m_height = height;
+   m_depth.assign(width * height, 1.0f);
+   m_rasterizedFragments = 0;
+   m_shadedFragments = 0;
+}
+
+void OverdrawEstimator::DrawMesh(const OverdrawMesh &mesh, const float world[16], const float viewProj[16])
+{
+   float worldViewProj[16];
+   for (unsigned int row = 0; row < 4; row++)
+   {
+      for (unsigned int col = 0; col < 4; col++)
+      {
+         float sum = 0.0f;
+         for (unsigned int k = 0; k < 4; k++) sum += world[row * 4 + k] * viewProj[k * 4 + col];
+         worldViewProj[row * 4 + col] = sum;
+      }
+   }
+
+   size_t numVertices = mesh.positions.size() / 3;
+   m_clipPositions.resize(numVertices * 4);
+   for (size_t v = 0; v < numVertices; v++)
+   {
+      const float *p = &mesh.positions[v * 3];
+      for (unsigned int col = 0; col < 4; col++)
+      {
+         m_clipPositions[v * 4 + col] = p[0] * worldViewProj[col] + p[1] * worldViewProj[4 + col] +
+            p[2] * worldViewProj[8 + col] + worldViewProj[12 + col];
+      }
+   }
+
+   for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+   {
+      DrawTriangle(&m_clipPositions[mesh.indices[i] * 4], &m_clipPositions[mesh.indices[i + 1] * 4],
+         &m_clipPositions[mesh.indices[i + 2] * 4]);
+   }
+}
+
+void OverdrawEstimator::Finish(OverdrawEstimate *pEstimate) const
+{
+   pEstimate->width = m_width;
+   pEstimate->height = m_height;
+   pEstimate->coveredPixels = 0;
+   for (size_t i = 0; i < m_depth.size(); i++)
+   {
+      if (m_depth[i] < 1.0f) pEstimate->coveredPixels++;
+   }
+   pEstimate->rasterizedFragments = m_rasterizedFragments;
+   pEstimate->shadedFragments = m_shadedFragments;
+}
+
+void OverdrawEstimator::DrawTriangle(const float clip0[4], const float clip1[4], const float clip2[4])
+{
+   const float *vertices[3] = { clip0, clip1, clip2 };
+   unsigned int numBehind = 0;
+   for (unsigned int v = 0; v < 3; v++)
+   {
+      if (vertices[v][2] < 0.0f) numBehind++;
+   }
+   if (numBehind == 3) return;
+
+   // Clipping against the near plane leaves a triangle or a quad
+   float polygon[4][4];
+   unsigned int numPoints = 0;
+   for (unsigned int v = 0; v < 3; v++)
+   {
+      const float *a = vertices[v];
+      const float *b = vertices[(v + 1) % 3];
+      if (a[2] >= 0.0f)
+      {
+         for (unsigned int c = 0; c < 4; c++) polygon[numPoints][c] = a[c];
+         numPoints++;
+      }
+      if ((a[2] >= 0.0f) != (b[2] >= 0.0f)) IntersectNearPlane(a, b, polygon[numPoints++]);
+   }
+
+   float screen[4][3];
+   for (unsigned int p = 0; p < numPoints; p++)
+   {
+      float invW = 1.0f / polygon[p][3];
+      screen[p][0] = (polygon[p][0] * invW * 0.5f + 0.5f) * m_width;
+      screen[p][1] = (0.5f - polygon[p][1] * invW * 0.5f) * m_height;
+      screen[p][2] = polygon[p][2] * invW;
+   }
+   for (unsigned int p = 2; p < numPoints; p++)
+   {
+      RasterizeTriangle(screen[0], screen[p - 1], screen[p]);
+   }
+}
+
+void OverdrawEstimator::RasterizeTriangle(const float screen0[3], const float screen1[3], const float screen2[3])
+{
+   // Far outside the target the snapped positions could overflow, those
+   // triangles are skipped. Nothing but a tiny sliver of the screen is lost
+   // with them at the estimate's resolution.
+   const float GUARD_BAND = 16384.0f;
+   const float *screen[3] = { screen0, screen1, screen2 };
+   long long points[3][2];
+   for (unsigned int v = 0; v < 3; v++)
+   {
+      if (screen[v][0] < -GUARD_BAND || screen[v][0] > GUARD_BAND || screen[v][1] < -GUARD_BAND ||
+         screen[v][1] > GUARD_BAND) return;
+      points[v][0] = Snap(screen[v][0]);
+      points[v][1] = Snap(screen[v][1]);
+   }
+
+   // Clockwise on screen is a positive area with y pointing down, the rest
+   // is back facing
+   long long area = EdgeFunction(points[0], points[1], points[2][0], points[2][1]);
+   if (area <= 0) return;
+
+   long long minX = points[0][0], maxX = points[0][0], minY = points[0][1], maxY = points[0][1];
+   for (unsigned int v = 1; v < 3; v++)
+   {
+      if (points[v][0] < minX) minX = points[v][0];
+      if (points[v][0] > maxX) maxX = points[v][0];
+      if (points[v][1] < minY) minY = points[v][1];
+      if (points[v][1] > maxY) maxY = points[v][1];
+   }
+
+   // Pixels whose centers fall in the bounds, clamped to the target
+   const long long HALF_PIXEL = 1 << (SUBPIXEL_BITS - 1);
+   long long x0 = (minX - HALF_PIXEL + (1 << SUBPIXEL_BITS) - 1) >> SUBPIXEL_BITS;
+   long long x1 = (maxX - HALF_PIXEL) >> SUBPIXEL_BITS;
+   long long y0 = (minY - HALF_PIXEL + (1 << SUBPIXEL_BITS) - 1) >> SUBPIXEL_BITS;
+   long long y1 = (maxY - HALF_PIXEL) >> SUBPIXEL_BITS;
+   if (x0 < 0) x0 = 0;
+   if (y0 < 0) y0 = 0;
+   if (x1 >= (long long)m_width) x1 = (long long)m_width - 1;
+   if (y1 >= (long long)m_height) y1 = (long long)m_height - 1;
+
+   bool owns0 = OwnsEdge(points[1], points[2]);
+   bool owns1 = OwnsEdge(points[2], points[0]);
+   bool owns2 = OwnsEdge(points[0], points[1]);
+   float invArea = 1.0f / (float)area;
+   for (long long y = y0; y <= y1; y++)
+   {
+      long long py = (y << SUBPIXEL_BITS) + HALF_PIXEL;
+      for (long long x = x0; x <= x1; x++)
+      {
+         long long px = (x << SUBPIXEL_BITS) + HALF_PIXEL;
+         long long w0 = EdgeFunction(points[1], points[2], px, py);
+         long long w1 = EdgeFunction(points[2], points[0], px, py);
+         long long w2 = EdgeFunction(points[0], points[1], px, py);
+         if (!IsInside(w0, owns0) || !IsInside(w1, owns1) || !IsInside(w2, owns2)) continue;
+
+         // Depth is linear in screen space, past the far plane is clipped
+         float z = ((float)w0 * screen0[2] + (float)w1 * screen1[2] + (float)w2 * screen2[2]) * invArea;
+         if (z > 1.0f) continue;
+
+         m_rasterizedFragments++;
+         float &depth = m_depth[y * m_width + x];
+         if (z < depth)
+         {
+            depth = z;
+            m_shadedFragments++;
+         }
+      }
+   }
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <vector>
+
+// Whether the main pass is preceded by a depth only pass, after which it
+// only shades the fragments that end up visible
+enum DepthPrepassMode
+{
+   DEPTH_PREPASS_OFF = 0,
+   DEPTH_PREPASS_ON,
+
+   // Follows the estimated overdraw of the current view
+   DEPTH_PREPASS_AUTO,
+   NUM_DEPTH_PREPASS_MODES
+};
+
+struct DepthPrepassSettings
+{
+   // Shaded fragments per covered pixel past which the automatic mode turns
+   // the pre-pass on, and below which it turns it off again. The gap keeps
+   // it from flipping every estimate on views close to the threshold.
+   float enableOverdraw;
+   float disableOverdraw;
+
+   // Side of the estimator's target, in pixels of the longer axis
+   unsigned int estimateResolution;
+};
+
+// Positions of one of the scene's unique meshes, three floats per vertex
+struct OverdrawMesh
+{
+   std::vector<float> positions;
+   std::vector<unsigned int> indices;
+};
+
+struct OverdrawEstimate
+{
+   unsigned int width;
+   unsigned int height;
+
+   // Pixels some triangle was drawn to, what the main pass shades with a
+   // pre-pass in front of it
+   unsigned long long coveredPixels;
+
+   // Every fragment inside a front facing triangle
+   unsigned long long rasterizedFragments;
+
+   // Fragments passing the depth test in submission order, what the main
+   // pass shades without a pre-pass if early depth testing rejects all the
+   // rest
+   unsigned long long shadedFragments;
+};
+
+void GetDefaultDepthPrepassSettings(DepthPrepassSettings *pSettings);
+
+// Shaded fragments per covered pixel, 1 when nothing was drawn
+double GetOverdraw(const OverdrawEstimate &estimate);
+
+// Fraction of the main pass' shaded fragments a pre-pass saves
+double GetSavedShadingFraction(const OverdrawEstimate &estimate);
+
+// Whether the next frames draw the pre-pass, enabled is what the current
+// ones do
+bool ChooseDepthPrepass(DepthPrepassMode mode, const DepthPrepassSettings &settings, const OverdrawEstimate &estimate,
+   bool enabled);
+
+// Software rasterizer counting the fragments the main pass draws at a low
+// resolution. Triangles are culled and rasterized like the main pass' raster
+// state does it: clockwise triangles are front facing, shared edges are
+// only drawn once and the depth test is LESS.
+class OverdrawEstimator
+{
+public:
+   OverdrawEstimator();
+
+   void Begin(unsigned int width, unsigned int height);
+
+   // world and viewProj are row vector matrices stored row major, the
+   // instance's world transform and the main view's
+   void DrawMesh(const OverdrawMesh &mesh, const float world[16], const float viewProj[16]);
+
+   void Finish(OverdrawEstimate *pEstimate) const;
+
+private:
+   void DrawTriangle(const float clip0[4], const float clip1[4], const float clip2[4]);
+   void RasterizeTriangle(const float screen0[3], const float screen1[3], const float screen2[3]);
+
+   unsigned int m_width;
+   unsigned int m_height;
+   std::vector<float> m_depth;
+   std::vector<float> m_clipPositions;
+   unsigned long long m_rasterizedFragments;
+   unsigned long long m_shadedFragments;
+};
@@ -0,0 +1,114 @@
+#include "DynamicResolution.h"
+
+#include <algorithm>
+#include <cmath>
+
+using std::vector;
+
+void GetDefaultDynamicResolutionSettings(DynamicResolutionSettings *pSettings)
+{
+   pSettings->targetMs = 16.0f;
+   pSettings->minScale = 0.5f;
+   pSettings->maxScale = 1.0f;
+   pSettings->scaleStep = 0.05f;
+   pSettings->historyLength = 9;
+   pSettings->headroom = 0.85f;
+   pSettings->cooldownFrames = 8;
+}
+
+void GetDynamicResolutionSize(float scale, unsigned int width, unsigned int height, unsigned int *pRenderWidth,
+   unsigned int *pRenderHeight)
+{
+   unsigned int renderWidth = (unsigned int)(width * scale + 0.5f);
+   unsigned int renderHeight = (unsigned int)(height * scale + 0.5f);
+   if (renderWidth < 1) renderWidth = 1;
+   if (renderWidth > width) renderWidth = width;
+   if (renderHeight < 1) renderHeight = 1;
+   if (renderHeight > height) renderHeight = height;
+   *pRenderWidth = renderWidth;
+   *pRenderHeight = renderHeight;
+}
+
+void SetupUpscaleConstants(unsigned int renderWidth, unsigned int renderHeight, unsigned int width,
+   unsigned int height, UpscaleConstants *pConstants)
+{
+   pConstants->scaleX = (float)renderWidth / width;
+   pConstants->scaleY = (float)renderHeight / height;
+   pConstants->renderWidth = renderWidth;
+   pConstants->renderHeight = renderHeight;
+}
+
+ResolutionController::ResolutionController(const DynamicResolutionSettings &settings) :
+   m_settings(settings)
+{
+   if (m_settings.historyLength < 1) m_settings.historyLength = 1;
+   Reset();
+}
+
+void ResolutionController::Reset()
+{
+   m_costs.clear();
+   m_nextCost = 0;
+   m_cooldown = 0;
+   m_scale = Quantize(m_settings.maxScale);
+   m_cost = 0.0f;
+}
+
+float ResolutionController::Update(float gpuMs, float frameScale)
+{
+   float pixels = frameScale * frameScale;
+   if (pixels <= 0.0f) return m_scale;
+
+   float cost = gpuMs / pixels;
+   if (m_costs.size() < m_settings.historyLength)
+   {
+      m_costs.push_back(cost);
+   }
+   else
+   {
+      m_costs[m_nextCost] = cost;
+   }
+   m_nextCost = (m_nextCost + 1) % m_settings.historyLength;
+
+   vector<float> sorted(m_costs);
+   std::nth_element(sorted.begin(), sorted.begin() + sorted.size() / 2, sorted.end());
+   m_cost = sorted[sorted.size() / 2];
+
+   if (m_cooldown > 0) m_cooldown--;
+   if (m_cost * m_scale * m_scale > m_settings.targetMs)
+   {
+      float fit = Quantize(sqrtf(m_settings.targetMs / m_cost));
+      if (fit < m_scale)
+      {
+         m_scale = fit;
+         m_cooldown = m_settings.cooldownFrames;
+      }
+   }
+   else if (m_cooldown == 0)
+   {
+      float up = Quantize(m_scale + m_settings.scaleStep);
+      if (up > m_scale && m_cost * up * up <= m_settings.targetMs * m_settings.headroom)
+      {
+         m_scale = up;
+         m_cooldown = m_settings.cooldownFrames;
+      }
+   }
+   return m_scale;
+}
+
+float ResolutionController::GetPredictedMs() const
+{
+   return m_costs.empty() ? 0.0f : m_cost * m_scale * m_scale;
+}
+
+float ResolutionController::Quantize(float scale) const
+{
+   // The small bias keeps exact multiples from rounding down a step
+   if (m_settings.scaleStep > 0.0f)
+   {
+      scale = floorf(scale / m_settings.scaleStep + 1e-3f) * m_settings.scaleStep;
+   }
+   if (scale < m_settings.minScale) scale = m_settings.minScale;
+   if (scale > m_settings.maxScale) scale = m_settings.maxScale;
+   return scale;
+}
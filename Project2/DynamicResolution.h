@@ -0,0 +1,84 @@
+#pragma once
+
+#include <vector>
+
+// Runtime options of the dynamic resolution
+struct DynamicResolutionSettings
+{
+   // GPU time per frame the controller holds the scale to
+   float targetMs;
+
+   // Range of the scale applied to both sides of the frame
+   float minScale;
+   float maxScale;
+
+   // Scales are multiples of the step, so the scale only changes when the
+   // load changes by more than a step's worth of pixels
+   float scaleStep;
+
+   // Frames the cost estimate is the median of, single slow frames do not
+   // move the scale
+   unsigned int historyLength;
+
+   // The scale only goes up once the estimate at the higher scale is under
+   // this fraction of the target, so it does not flip between two steps
+   float headroom;
+
+   // Frames after a change before the scale goes up again, covers the
+   // frames already in flight at the old scale
+   unsigned int cooldownFrames;
+};
+
+// Constant buffer of UpscalePS.hlsl
+struct UpscaleConstants
+{
+   // Scaled pixels per back buffer pixel
+   float scaleX;
+   float scaleY;
+   unsigned int renderWidth;
+   unsigned int renderHeight;
+};
+
+void GetDefaultDynamicResolutionSettings(DynamicResolutionSettings *pSettings);
+
+// Size of the part of the width x height targets drawn at scale, at least
+// one pixel
+void GetDynamicResolutionSize(float scale, unsigned int width, unsigned int height, unsigned int *pRenderWidth,
+   unsigned int *pRenderHeight);
+
+void SetupUpscaleConstants(unsigned int renderWidth, unsigned int renderHeight, unsigned int width,
+   unsigned int height, UpscaleConstants *pConstants);
+
+// Picks the scale of the next frame from the GPU times of earlier ones. The
+// times arrive frames late, so each comes with the scale its frame was
+// drawn at. The cost is taken to grow with the pixel count, the median
+// time per scaled pixel over the history predicts the time at any scale.
+// Over the target the scale drops straight to the largest step predicted to
+// fit, under it the scale goes up a step at a time.
+class ResolutionController
+{
+public:
+   explicit ResolutionController(const DynamicResolutionSettings &settings);
+
+   // Starts over at the largest scale with no history
+   void Reset();
+
+   // gpuMs is a frame's GPU time and frameScale the scale it was drawn at.
+   // Returns the scale for the next frame.
+   float Update(float gpuMs, float frameScale);
+
+   float GetScale() const { return m_scale; }
+
+   // Time the median cost predicts at the current scale, 0 without history
+   float GetPredictedMs() const;
+
+private:
+   float Quantize(float scale) const;
+
+   DynamicResolutionSettings m_settings;
+   std::vector<float> m_costs;
+   unsigned int m_nextCost;
+   unsigned int m_cooldown;
+   float m_scale;
+   float m_cost;
+};
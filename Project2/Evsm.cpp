@@ -0,0 +1,127 @@
+#include "Evsm.h"
+
+#include <cmath>
+
+namespace
+{
+   float ClampExponent(float exponent)
+   {
+      if (exponent < 0.0f) return 0.0f;
+      if (exponent > (float)EVSM_MAX_EXPONENT) return (float)EVSM_MAX_EXPONENT;
+      return exponent;
+   }
+
+   int ClampTexel(int value, unsigned int size)
+   {
+      if (value < 0) return 0;
+      if (value >= (int)size) return (int)size - 1;
+      return value;
+   }
+}
+
+void GetDefaultEvsmSettings(EvsmSettings *pSettings)
+{
+   pSettings->positiveExponent = (float)DEFAULT_EVSM_POSITIVE_EXPONENT;
+   pSettings->negativeExponent = (float)DEFAULT_EVSM_NEGATIVE_EXPONENT;
+   pSettings->lightBleedReduction = 0.2f;
+   pSettings->varianceBias = 0.0001f;
+   pSettings->blurRadius = DEFAULT_EVSM_BLUR_RADIUS;
+}
+
+void ComputeEvsmMoments(float depth, const EvsmSettings &settings, float moments[4])
+{
+   float warpedDepth = 2.0f * depth - 1.0f;
+   float positive = expf(ClampExponent(settings.positiveExponent) * warpedDepth);
+   float negative = -expf(-ClampExponent(settings.negativeExponent) * warpedDepth);
+   moments[0] = positive;
+   moments[1] = positive * positive;
+   moments[2] = negative;
+   moments[3] = negative * negative;
+}
+
+float ChebyshevUpperBound(float mean, float meanSquared, float value, float minVariance)
+{
+   if (value <= mean) return 1.0f;
+
+   float variance = meanSquared - mean * mean;
+   if (variance < minVariance) variance = minVariance;
+   float distance = value - mean;
+   return variance / (variance + distance * distance);
+}
+
+float EvsmVisibility(const float moments[4], float depth, const EvsmSettings &settings)
+{
+   float warped[4];
+   ComputeEvsmMoments(depth, settings, warped);
+
+   // The variance floor follows the slope of each warp at the receiver
+   float positiveScale = settings.varianceBias * ClampExponent(settings.positiveExponent) * warped[0];
+   float negativeScale = settings.varianceBias * ClampExponent(settings.negativeExponent) * warped[2];
+   float positive = ChebyshevUpperBound(moments[0], moments[1], warped[0], positiveScale * positiveScale);
+   float negative = ChebyshevUpperBound(moments[2], moments[3], warped[2], negativeScale * negativeScale);
+   float visibility = positive < negative ? positive : negative;
+
+   float reduced = (visibility - settings.lightBleedReduction) / (1.0f - settings.lightBleedReduction);
+   if (reduced < 0.0f) return 0.0f;
+   if (reduced > 1.0f) return 1.0f;
+   return reduced;
+}
+
+void ComputeEvsmMomentsImage(const ShadowDepthMap &map, const EvsmSettings &settings, RgbaImage *pMoments)
+{
+   pMoments->width = map.width;
+   pMoments->height = map.height;
+   pMoments->texels.resize(map.depth.size() * 4);
+   for (size_t i = 0; i < map.depth.size(); i++)
+   {
+      ComputeEvsmMoments(map.depth[i], settings, &pMoments->texels[i * 4]);
+   }
+}
+
+void DownsampleMoments(const RgbaImage &source, RgbaImage *pDest)
+{
+   pDest->width = source.width > 1 ? source.width / 2 : 1;
+   pDest->height = source.height > 1 ? source.height / 2 : 1;
+   pDest->texels.resize(pDest->width * pDest->height * 4);
+
+   for (unsigned int y = 0; y < pDest->height; y++)
+   {
+      for (unsigned int x = 0; x < pDest->width; x++)
+      {
+         int x0 = ClampTexel(2 * x, source.width);
+         int x1 = ClampTexel(2 * x + 1, source.width);
+         int y0 = ClampTexel(2 * y, source.height);
+         int y1 = ClampTexel(2 * y + 1, source.height);
+         for (unsigned int c = 0; c < 4; c++)
+         {
+            float sum = source.texels[(y0 * source.width + x0) * 4 + c] + source.texels[(y0 * source.width + x1) * 4 + c] +
+               source.texels[(y1 * source.width + x0) * 4 + c] + source.texels[(y1 * source.width + x1) * 4 + c];
+            pDest->texels[(y * pDest->width + x) * 4 + c] = 0.25f * sum;
+         }
+      }
+   }
+}
+
+void SampleMoments(const RgbaImage &moments, float x, float y, float result[4])
+{
+   float fx = x - 0.5f;
+   float fy = y - 0.5f;
+   int x0 = (int)floorf(fx);
+   int y0 = (int)floorf(fy);
+   float ax = fx - x0;
+   float ay = fy - y0;
+
+   const float *pTexels[4] =
+   {
+      &moments.texels[(ClampTexel(y0, moments.height) * moments.width + ClampTexel(x0, moments.width)) * 4],
+      &moments.texels[(ClampTexel(y0, moments.height) * moments.width + ClampTexel(x0 + 1, moments.width)) * 4],
+      &moments.texels[(ClampTexel(y0 + 1, moments.height) * moments.width + ClampTexel(x0, moments.width)) * 4],
+      &moments.texels[(ClampTexel(y0 + 1, moments.height) * moments.width + ClampTexel(x0 + 1, moments.width)) * 4]
+   };
+   for (unsigned int c = 0; c < 4; c++)
+   {
+      float top = pTexels[0][c] * (1.0f - ax) + pTexels[1][c] * ax;
+      float bottom = pTexels[2][c] * (1.0f - ax) + pTexels[3][c] * ax;
+      result[c] = top * (1.0f - ay) + bottom * ay;
+   }
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "GaussianBlur.h"
+#include "ShaderDefines.h"
+#include "ShadowFilter.h"
+
+// Runtime options of the EVSM cascade filter
+struct EvsmSettings
+{
+   // Warp exponents, clamped to [0, EVSM_MAX_EXPONENT]. Larger ones bleed
+   // less light but lose precision.
+   float positiveExponent;
+   float negativeExponent;
+
+   // Visibilities below this fraction go to 0 and the rest are rescaled,
+   // trades light bleeding for darker penumbrae
+   float lightBleedReduction;
+
+   // Minimum variance as a depth offset, scaled by the warp's slope
+   float varianceBias;
+
+   // Of the moments' blur, 0 keeps the moments unfiltered
+   unsigned int blurRadius;
+};
+
+void GetDefaultEvsmSettings(EvsmSettings *pSettings);
+
+// (p, p * p, n, n * n) with p = exp(cp * d') and n = -exp(-cn * d'), d' =
+// 2 * depth - 1. Both warps grow with depth. What EvsmMomentsCS.hlsl
+// writes per texel.
+void ComputeEvsmMoments(float depth, const EvsmSettings &settings, float moments[4]);
+
+// Chebyshev's upper bound on the fraction of a distribution with the given
+// first two moments at or past value, 1 where value <= mean
+float ChebyshevUpperBound(float mean, float meanSquared, float value, float minVariance);
+
+// PlainPixel.hlsl's EVSM lookup: the lower of both warps' bounds for the
+// receiver's depth, after the light bleeding reduction
+float EvsmVisibility(const float moments[4], float depth, const EvsmSettings &settings);
+
+// Moments of every texel of the map
+void ComputeEvsmMomentsImage(const ShadowDepthMap &map, const EvsmSettings &settings, RgbaImage *pMoments);
+
+// Next mip level, the 2x2 box GenerateMips uses. Odd sizes round down and
+// drop the last row or column.
+void DownsampleMoments(const RgbaImage &source, RgbaImage *pDest);
+
+// Bilinear fetch of one mip at a position in its texels with clamped edges
+void SampleMoments(const RgbaImage &moments, float x, float y, float result[4]);
@@ -0,0 +1,36 @@
+#include "ShaderDefines.h"
+
+// Depth of the directional light's cascades side by side
+Texture2D<float> m_ShadowCascades : register(t0);
+
+RWTexture2D<float4> m_Moments : register(u0);
+
+// Must match CascadeConstants in ShadowCascades.h
+cbuffer CascadeConstants : register(b0)
+{
+   float4x4 cascadeViewProj[NUM_SHADOW_CASCADES];
+   float4 cascadeSplits;
+   float4 cascadeDepthBias;
+   uint pcfTapsSqrt;
+   uint shadowFilter;
+   float2 evsmExponents;
+   float lightBleedReduction;
+   float varianceBias;
+   float cascadeSize;
+};
+
+// Warps every depth of the atlas with both exponentials and stores the
+// warped depths and their squares, which can be filtered like colors.
+// ComputeEvsmMoments in Evsm.cpp does the same on the CPU.
+[numthreads(EVSM_THREAD_GROUP_SIZE, EVSM_THREAD_GROUP_SIZE, 1)]
+void main( uint3 DTid : SV_DispatchThreadID )
+{
+   // The dispatch is rounded up to whole groups
+   uint size = uint(cascadeSize);
+   if (DTid.x >= size * NUM_SHADOW_CASCADES || DTid.y >= size) return;
+
+   float warpedDepth = 2.0 * m_ShadowCascades[DTid.xy] - 1.0;
+   float positive = exp(evsmExponents.x * warpedDepth);
+   float negative = -exp(-evsmExponents.y * warpedDepth);
+   m_Moments[DTid.xy] = float4(positive, positive * positive, negative, negative * negative);
+}
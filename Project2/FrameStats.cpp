@@ -0,0 +1,80 @@
+#include "FrameStats.h"
+
+#include <iomanip>
+#include <sstream>
+
+using std::string;
+
+FrameStats::FrameStats(unsigned int reportInterval) :
+   m_reportInterval(reportInterval > 0 ? reportInterval : 1), m_frameCount(0)
+{
+}
+
+FrameStats::Entry *FrameStats::FindEntry(const char *name, bool isTime)
+{
+   for (size_t i = 0; i < m_entries.size(); i++)
+   {
+      if (m_entries[i].name.compare(name) == 0) return &m_entries[i];
+   }
+
+   Entry entry;
+   entry.name = name;
+   entry.frameValue = 0.0;
+   entry.sum = 0.0;
+   entry.isTime = isTime;
+   m_entries.push_back(entry);
+   return &m_entries.back();
+}
+
+void FrameStats::AddTime(const char *name, double ms)
+{
+   FindEntry(name, true)->frameValue += ms;
+}
+
+void FrameStats::SetCounter(const char *name, double value)
+{
+   FindEntry(name, false)->frameValue = value;
+}
+
+bool FrameStats::EndFrame(string *pReport)
+{
+   for (size_t i = 0; i < m_entries.size(); i++)
+   {
+      m_entries[i].sum += m_entries[i].frameValue;
+      m_entries[i].frameValue = 0.0;
+   }
+
+   m_frameCount++;
+   if (m_frameCount < m_reportInterval) return false;
+
+   std::ostringstream report;
+   report << std::fixed;
+   for (size_t i = 0; i < m_entries.size(); i++)
+   {
+      const Entry &entry = m_entries[i];
+      double average = entry.sum / (double)m_frameCount;
+      if (entry.isTime)
+      {
+         report << entry.name << "=" << std::setprecision(3) << average << "ms ";
+      }
+      else
+      {
+         report << entry.name << "=" << std::setprecision(1) << average << " ";
+      }
+   }
+   report << "\n";
+
+   if (pReport) *pReport = report.str();
+   Reset();
+   return true;
+}
+
+void FrameStats::Reset()
+{
+   for (size_t i = 0; i < m_entries.size(); i++)
+   {
+      m_entries[i].frameValue = 0.0;
+      m_entries[i].sum = 0.0;
+   }
+   m_frameCount = 0;
+}
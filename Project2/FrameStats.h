@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Accumulates per frame timings and counters and produces a text report
+// averaged over a fixed number of frames.
+class FrameStats
+{
+public:
+   explicit FrameStats(unsigned int reportInterval);
+
+   // Adds to a timing for the current frame, reported as an average in ms
+   void AddTime(const char *name, double ms);
+
+   // Sets a counter for the current frame, reported as an average
+   void SetCounter(const char *name, double value);
+
+   // Returns true and fills in pReport once every reportInterval frames
+   bool EndFrame(std::string *pReport);
+
+   void Reset();
+
+private:
+   struct Entry
+   {
+      std::string name;
+      double frameValue;
+      double sum;
+      bool isTime;
+   };
+
+   Entry *FindEntry(const char *name, bool isTime);
+
+   std::vector<Entry> m_entries;
+   unsigned int m_reportInterval;
+   unsigned int m_frameCount;
+};
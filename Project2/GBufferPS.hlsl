@@ -0,0 +1,58 @@
+#include "ShaderDefines.h"
+
+Texture2D m_colorMap : register(t0);
+SamplerState m_colorSampler : register(s0);
+
+struct PixelShaderInput
+{
+  float4 pos : SV_POSITION;
+  float3 worldPos : POSITIONT;
+  float2 tex0 : TEXCOORD0;
+  float4 norm : NORMAL0;
+  float4 lPos : TEXCOORD1;
+};
+
+// The compact G-buffer, the depth comes from the depth buffer
+struct GBufferOutput
+{
+  float4 albedo : SV_TARGET0; // material in alpha
+  uint normal : SV_TARGET1;   // octahedral world space normal
+};
+
+uint packSnorm16( float x )
+{
+    return uint(int(round(clamp(x, -1.0, 1.0) * 32767.0))) & 0xffff;
+}
+
+// Same as EncodeOctahedralNormal in Deferred.cpp
+uint encodeOctahedral( float3 n )
+{
+    float2 uv = n.xy / (abs(n.x) + abs(n.y) + abs(n.z));
+    if (n.z < 0.0)
+    {
+        float2 signs = float2(uv.x >= 0.0 ? 1.0 : -1.0, uv.y >= 0.0 ? 1.0 : -1.0);
+        uv = (1.0 - abs(uv.yx)) * signs;
+    }
+    return packSnorm16(uv.x) | (packSnorm16(uv.y) << 16);
+}
+
+GBufferOutput gbuffer( PixelShaderInput input, uint material )
+{
+    GBufferOutput output;
+    float3 albedo = m_colorMap.Sample(m_colorSampler, input.tex0).xyz;
+    output.albedo = float4(albedo, material / 255.0);
+    output.normal = encodeOctahedral(normalize(input.norm.xyz));
+    return output;
+}
+
+// The entry points match PlainPixel.hlsl's, DeferredLightingCS.hlsl shades
+// each material the way they do
+GBufferOutput main( PixelShaderInput input )
+{
+    return gbuffer(input, GBUFFER_MATERIAL_SOLID);
+}
+
+GBufferOutput texMain( PixelShaderInput input )
+{
+    return gbuffer(input, GBUFFER_MATERIAL_TEXTURED);
+}
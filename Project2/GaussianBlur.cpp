@@ -0,0 +1,204 @@
+#include "GaussianBlur.h"
+
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE__)
+#define BLUR_PASS_SSE
+#include <xmmintrin.h>
+#endif
+
+using std::vector;
+
+namespace
+{
+   int Clamp(int value, int maxValue)
+   {
+      if (value < 0) return 0;
+      if (value > maxValue) return maxValue;
+      return value;
+   }
+
+   // Column of a horizontal tap, clamped to the tile of the center column x
+   int ClampColumn(int column, int x, const BlurConstants &constants)
+   {
+      int tileStart = x - x % (int)constants.tileWidth;
+      int tileEnd = tileStart + (int)constants.tileWidth - 1;
+      if (tileEnd > (int)constants.width - 1) tileEnd = (int)constants.width - 1;
+      if (column < tileStart) return tileStart;
+      if (column > tileEnd) return tileEnd;
+      return column;
+   }
+
+   // Weight of texel's tap for the center texel. Both passes compute the
+   // depth term the same way so they round the same.
+   float GetTapWeight(const BlurConstants &constants, unsigned int offset, const vector<float> &depth,
+      unsigned int center, unsigned int texel)
+   {
+      float weight = constants.weights[offset];
+      if (constants.bilateral)
+      {
+         float depthDelta = depth[texel] - depth[center];
+         weight *= expf(constants.depthFalloff * depthDelta * depthDelta);
+      }
+      return weight;
+   }
+
+   unsigned int GetTapOffset(int tap)
+   {
+      return tap < 0 ? (unsigned int)-tap : (unsigned int)tap;
+   }
+}
+
+void ComputeGaussianWeights(unsigned int radius, float sigma, vector<float> *pWeights, float *pWeightSum)
+{
+   pWeights->resize(2 * radius + 1);
+   *pWeightSum = 0.0f;
+   for (int tap = -(int)radius; tap <= (int)radius; tap++)
+   {
+      float weight = expf(-(float)(tap * tap) / (2.0f * sigma * sigma));
+      (*pWeights)[tap + radius] = weight;
+      *pWeightSum += weight;
+   }
+}
+
+void SetupBlurConstants(unsigned int width, unsigned int height, unsigned int radius, float sigma, bool bilateral,
+   float depthSigma, BlurConstants *pConstants)
+{
+   memset(pConstants, 0, sizeof(*pConstants));
+   if (radius > MAX_BLUR_RADIUS) radius = MAX_BLUR_RADIUS;
+   pConstants->width = width;
+   pConstants->height = height;
+   pConstants->radius = radius;
+   pConstants->horizontal = 1;
+   pConstants->bilateral = bilateral ? 1 : 0;
+   pConstants->depthFalloff = -1.0f / (2.0f * depthSigma * depthSigma);
+   pConstants->tileWidth = width;
+
+   vector<float> weights;
+   float weightSum;
+   ComputeGaussianWeights(radius, sigma, &weights, &weightSum);
+   for (unsigned int offset = 0; offset <= radius; offset++)
+   {
+      pConstants->weights[offset] = weights[radius + offset] / weightSum;
+   }
+}
+
+void BlurPassReference(const RgbaImage &source, const vector<float> &depth, const BlurConstants &constants,
+   RgbaImage *pDest)
+{
+   pDest->width = source.width;
+   pDest->height = source.height;
+   pDest->texels.resize(source.texels.size());
+
+   int radius = (int)constants.radius;
+   int maxX = (int)source.width - 1;
+   int maxY = (int)source.height - 1;
+   for (int y = 0; y <= maxY; y++)
+   {
+      for (int x = 0; x <= maxX; x++)
+      {
+         unsigned int center = y * source.width + x;
+         float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+         float weightSum = 0.0f;
+         for (int tap = -radius; tap <= radius; tap++)
+         {
+            unsigned int texel = constants.horizontal ? y * source.width + ClampColumn(x + tap, x, constants) :
+               Clamp(y + tap, maxY) * source.width + x;
+            float weight = GetTapWeight(constants, GetTapOffset(tap), depth, center, texel);
+            for (unsigned int c = 0; c < 4; c++) sum[c] += weight * source.texels[texel * 4 + c];
+            weightSum += weight;
+         }
+         for (unsigned int c = 0; c < 4; c++)
+         {
+            pDest->texels[center * 4 + c] = constants.bilateral ? sum[c] / weightSum : sum[c];
+         }
+      }
+   }
+}
+
+#ifdef BLUR_PASS_SSE
+void BlurPass(const RgbaImage &source, const vector<float> &depth, const BlurConstants &constants, RgbaImage *pDest)
+{
+   pDest->width = source.width;
+   pDest->height = source.height;
+   pDest->texels.resize(source.texels.size());
+
+   int radius = (int)constants.radius;
+   int maxX = (int)source.width - 1;
+   int maxY = (int)source.height - 1;
+   const float *pSource = source.texels.empty() ? NULL : &source.texels[0];
+   float *pOutput = pDest->texels.empty() ? NULL : &pDest->texels[0];
+
+   if (constants.horizontal)
+   {
+      for (int y = 0; y <= maxY; y++)
+      {
+         for (int x = 0; x <= maxX; x++)
+         {
+            unsigned int center = y * source.width + x;
+            __m128 sum = _mm_setzero_ps();
+            float weightSum = 0.0f;
+            for (int tap = -radius; tap <= radius; tap++)
+            {
+               unsigned int texel = y * source.width + ClampColumn(x + tap, x, constants);
+               float weight = GetTapWeight(constants, GetTapOffset(tap), depth, center, texel);
+               sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weight), _mm_loadu_ps(pSource + texel * 4)));
+               weightSum += weight;
+            }
+            if (constants.bilateral) sum = _mm_div_ps(sum, _mm_set1_ps(weightSum));
+            _mm_storeu_ps(pOutput + center * 4, sum);
+         }
+      }
+      return;
+   }
+
+   // Vertical passes add whole source rows into the output row, the taps
+   // of each texel are still summed in the same order
+   vector<float> weightSums(source.width);
+   for (int y = 0; y <= maxY; y++)
+   {
+      float *pRow = pOutput + y * source.width * 4;
+      memset(pRow, 0, source.width * 4 * sizeof(float));
+      for (unsigned int x = 0; x < source.width; x++) weightSums[x] = 0.0f;
+
+      for (int tap = -radius; tap <= radius; tap++)
+      {
+         unsigned int sourceRow = Clamp(y + tap, maxY) * source.width;
+         for (unsigned int x = 0; x < source.width; x++)
+         {
+            float weight = GetTapWeight(constants, GetTapOffset(tap), depth, y * source.width + x, sourceRow + x);
+            __m128 sum = _mm_loadu_ps(pRow + x * 4);
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weight), _mm_loadu_ps(pSource + (sourceRow + x) * 4)));
+            _mm_storeu_ps(pRow + x * 4, sum);
+            weightSums[x] += weight;
+         }
+      }
+
+      if (constants.bilateral)
+      {
+         for (unsigned int x = 0; x < source.width; x++)
+         {
+            _mm_storeu_ps(pRow + x * 4, _mm_div_ps(_mm_loadu_ps(pRow + x * 4), _mm_set1_ps(weightSums[x])));
+         }
+      }
+   }
+}
+#else
+void BlurPass(const RgbaImage &source, const vector<float> &depth, const BlurConstants &constants, RgbaImage *pDest)
+{
+   BlurPassReference(source, depth, constants, pDest);
+}
+#endif
+
+void SeparableBlur(const RgbaImage &source, const vector<float> &depth, unsigned int radius, float sigma,
+   bool bilateral, float depthSigma, RgbaImage *pDest)
+{
+   BlurConstants constants;
+   SetupBlurConstants(source.width, source.height, radius, sigma, bilateral, depthSigma, &constants);
+
+   RgbaImage rows;
+   BlurPass(source, depth, constants, &rows);
+   constants.horizontal = 0;
+   BlurPass(rows, depth, constants, pDest);
+}
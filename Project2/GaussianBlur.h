@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+
+#include "ShaderDefines.h"
+
+// Unnormalized weights of the 2 * radius + 1 taps
+void ComputeGaussianWeights(unsigned int radius, float sigma, std::vector<float> *pWeights, float *pWeightSum);
+
+// RGBA image, row major, four floats per texel
+struct RgbaImage
+{
+   unsigned int width;
+   unsigned int height;
+   std::vector<float> texels;
+};
+
+// Constant buffer of GaussianBlurCS.hlsl. weights[i] is the normalized
+// weight of the taps i texels away from the center. Horizontal taps are
+// clamped to columns of tileWidth texels so atlases blur their tiles
+// separately, tileWidth has to be a multiple of BLUR_PASS_GROUP_SIZE or the
+// whole width.
+struct BlurConstants
+{
+   unsigned int width;
+   unsigned int height;
+   unsigned int radius;
+   unsigned int horizontal;
+   unsigned int bilateral;
+   float depthFalloff;
+   unsigned int tileWidth;
+   unsigned int padding;
+   float weights[BLUR_WEIGHT_VECTORS * 4];
+};
+
+// radius is clamped to MAX_BLUR_RADIUS. Bilateral blurs scale the weights
+// by a Gaussian of the depth difference to the center with depthSigma.
+// tileWidth starts out as the whole width.
+void SetupBlurConstants(unsigned int width, unsigned int height, unsigned int radius, float sigma, bool bilateral,
+   float depthSigma, BlurConstants *pConstants);
+
+// One pass of GaussianBlurCS.hlsl in the direction of
+// constants.horizontal, one texel at a time. depth is only read by
+// bilateral blurs and has one float per texel.
+void BlurPassReference(const RgbaImage &source, const std::vector<float> &depth, const BlurConstants &constants,
+   RgbaImage *pDest);
+
+// Same result as BlurPassReference bit for bit, a texel per SSE register
+// where available and vertical passes streaming whole rows
+void BlurPass(const RgbaImage &source, const std::vector<float> &depth, const BlurConstants &constants,
+   RgbaImage *pDest);
+
+// Horizontal then vertical BlurPass, e.g. for filtering light maps offline
+void SeparableBlur(const RgbaImage &source, const std::vector<float> &depth, unsigned int radius, float sigma,
+   bool bilateral, float depthSigma, RgbaImage *pDest);
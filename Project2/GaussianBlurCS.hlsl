@@ -0,0 +1,78 @@
+#include "ShaderDefines.h"
+
+Texture2D<float4> m_Source : register(t0);
+
+// Only read by bilateral blurs
+Texture2D<float> m_Depth : register(t1);
+
+RWTexture2D<float4> m_Dest : register(u0);
+
+// Must match BlurConstants in GaussianBlur.h
+cbuffer BlurConstants : register(b0)
+{
+   uint blurWidth;
+   uint blurHeight;
+   uint blurRadius;
+   uint blurHorizontal;
+   uint blurBilateral;
+   float blurDepthFalloff;
+   uint blurTileWidth;
+   float4 blurWeights[BLUR_WEIGHT_VECTORS];
+};
+
+// The group's line of texels with an apron of blurRadius on both ends
+groupshared float4 lineTexels[BLUR_PASS_GROUP_SIZE + 2 * MAX_BLUR_RADIUS];
+groupshared float lineDepths[BLUR_PASS_GROUP_SIZE + 2 * MAX_BLUR_RADIUS];
+
+float GetBlurWeight(uint offset)
+{
+   return blurWeights[offset >> 2][offset & 3];
+}
+
+// One pass of a separable Gaussian, the same shader does both directions.
+// Groups cover BLUR_PASS_GROUP_SIZE texels along the blur direction, x
+// indexes the segment and y the line. Edges are clamped. BlurPassReference
+// in GaussianBlur.cpp does the same on the CPU. Horizontal passes clamp to
+// the group's blurTileWidth wide column, groups never straddle two.
+[numthreads(BLUR_PASS_GROUP_SIZE, 1, 1)]
+void main( uint3 Gid : SV_GroupID, uint GI : SV_GroupIndex )
+{
+   int2 axis = blurHorizontal ? int2(1, 0) : int2(0, 1);
+   int2 lineStart = Gid.x * BLUR_PASS_GROUP_SIZE * axis + Gid.y * (int2(1, 1) - axis);
+   int2 maxTexel = int2(blurWidth, blurHeight) - 1;
+   int2 minTexel = int2(0, 0);
+   if (blurHorizontal)
+   {
+      minTexel.x = lineStart.x - lineStart.x % int(blurTileWidth);
+      maxTexel.x = min(minTexel.x + int(blurTileWidth) - 1, maxTexel.x);
+   }
+
+   for (uint i = GI; i < BLUR_PASS_GROUP_SIZE + 2 * blurRadius; i += BLUR_PASS_GROUP_SIZE)
+   {
+      int2 texel = clamp(lineStart + (int(i) - int(blurRadius)) * axis, minTexel, maxTexel);
+      lineTexels[i] = m_Source[texel];
+      if (blurBilateral) lineDepths[i] = m_Depth[texel];
+   }
+   GroupMemoryBarrierWithGroupSync();
+
+   int2 texel = lineStart + GI * axis;
+   if (texel.x > maxTexel.x || texel.y > maxTexel.y) return;
+
+   // Bilateral blurs let texels at other depths fade out so edges stay
+   // sharp, which means renormalizing per texel
+   uint center = GI + blurRadius;
+   float4 sum = float4(0, 0, 0, 0);
+   float weightSum = 0.0;
+   for (uint tap = 0; tap <= 2 * blurRadius; tap++)
+   {
+      float weight = GetBlurWeight(tap > blurRadius ? tap - blurRadius : blurRadius - tap);
+      if (blurBilateral)
+      {
+         float depthDelta = lineDepths[GI + tap] - lineDepths[center];
+         weight *= exp(blurDepthFalloff * depthDelta * depthDelta);
+      }
+      sum += weight * lineTexels[GI + tap];
+      weightSum += weight;
+   }
+   m_Dest[texel] = blurBilateral ? sum / weightSum : sum;
+}
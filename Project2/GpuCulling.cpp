@@ -0,0 +1,140 @@
+#include "GpuCulling.h"
+
+#include <cassert>
+#include <cmath>
+
+using std::vector;
+
+void ExtractFrustumPlanes(const float viewProj[16], FrustumPlanes *pFrustum)
+{
+   // With row vectors clip = v * M, so each clip coordinate is the dot
+   // product with a column of the matrix
+   float columns[4][4];
+   for (unsigned int c = 0; c < 4; c++)
+   {
+      for (unsigned int r = 0; r < 4; r++)
+      {
+         columns[c][r] = viewProj[r * 4 + c];
+      }
+   }
+
+   for (unsigned int i = 0; i < 4; i++)
+   {
+      pFrustum->planes[0][i] = columns[3][i] + columns[0][i];
+      pFrustum->planes[1][i] = columns[3][i] - columns[0][i];
+      pFrustum->planes[2][i] = columns[3][i] + columns[1][i];
+      pFrustum->planes[3][i] = columns[3][i] - columns[1][i];
+      pFrustum->planes[4][i] = columns[2][i];
+      pFrustum->planes[5][i] = columns[3][i] - columns[2][i];
+   }
+
+   for (unsigned int p = 0; p < 6; p++)
+   {
+      float *plane = pFrustum->planes[p];
+      float length = sqrtf(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+      if (length > 0.0f)
+      {
+         for (unsigned int i = 0; i < 4; i++) plane[i] /= length;
+      }
+   }
+}
+
+BoundingSphere ComputeBoundingSphere(const float *pPositions, unsigned int stride, unsigned int numVertices)
+{
+   BoundingSphere sphere = { { 0.0f, 0.0f, 0.0f }, 0.0f };
+   if (numVertices == 0) return sphere;
+
+   float minCorner[3] = { pPositions[0], pPositions[1], pPositions[2] };
+   float maxCorner[3] = { pPositions[0], pPositions[1], pPositions[2] };
+   for (unsigned int v = 1; v < numVertices; v++)
+   {
+      const float *pPos = pPositions + v * stride;
+      for (unsigned int i = 0; i < 3; i++)
+      {
+         if (pPos[i] < minCorner[i]) minCorner[i] = pPos[i];
+         if (pPos[i] > maxCorner[i]) maxCorner[i] = pPos[i];
+      }
+   }
+
+   for (unsigned int i = 0; i < 3; i++)
+   {
+      sphere.center[i] = 0.5f * (minCorner[i] + maxCorner[i]);
+   }
+
+   float radiusSq = 0.0f;
+   for (unsigned int v = 0; v < numVertices; v++)
+   {
+      const float *pPos = pPositions + v * stride;
+      float dx = pPos[0] - sphere.center[0];
+      float dy = pPos[1] - sphere.center[1];
+      float dz = pPos[2] - sphere.center[2];
+      float distSq = dx * dx + dy * dy + dz * dz;
+      if (distSq > radiusSq) radiusSq = distSq;
+   }
+   sphere.radius = sqrtf(radiusSq);
+   return sphere;
+}
+
+BoundingSphere TransformBoundingSphere(const BoundingSphere &sphere, const InstanceTransform &world)
+{
+   const float *m = world.m;
+   BoundingSphere result;
+   for (unsigned int c = 0; c < 3; c++)
+   {
+      result.center[c] = sphere.center[0] * m[c] + sphere.center[1] * m[4 + c] + sphere.center[2] * m[8 + c] + m[12 + c];
+   }
+
+   float maxScaleSq = 0.0f;
+   for (unsigned int r = 0; r < 3; r++)
+   {
+      float scaleSq = m[r * 4] * m[r * 4] + m[r * 4 + 1] * m[r * 4 + 1] + m[r * 4 + 2] * m[r * 4 + 2];
+      if (scaleSq > maxScaleSq) maxScaleSq = scaleSq;
+   }
+   result.radius = sphere.radius * sqrtf(maxScaleSq);
+   return result;
+}
+
+bool SphereInFrustum(const FrustumPlanes &frustum, const BoundingSphere &sphere)
+{
+   for (unsigned int p = 0; p < 6; p++)
+   {
+      const float *plane = frustum.planes[p];
+      float distance = plane[0] * sphere.center[0] + plane[1] * sphere.center[1] + plane[2] * sphere.center[2] + plane[3];
+      if (distance < -sphere.radius) return false;
+   }
+   return true;
+}
+
+void BuildCullInstances(const vector<InstanceBatch> &batches, const vector<InstanceTransform> &transforms,
+   const vector<BoundingSphere> &meshBounds, vector<CullInstance> *pInstances)
+{
+   pInstances->resize(transforms.size());
+   for (unsigned int draw = 0; draw < batches.size(); draw++)
+   {
+      const InstanceBatch &batch = batches[draw];
+      for (unsigned int i = batch.firstInstance; i < batch.firstInstance + batch.numInstances; i++)
+      {
+         CullInstance &instance = (*pInstances)[i];
+         instance.bounds = TransformBoundingSphere(meshBounds[batch.mesh], transforms[i]);
+         instance.drawIndex = draw;
+         instance.padding[0] = instance.padding[1] = instance.padding[2] = 0;
+         instance.world = transforms[i];
+      }
+   }
+}
+
+void CullInstancesReference(const vector<CullInstance> &instances, const FrustumPlanes &frustum,
+   vector<IndirectDrawArgs> *pArgs, vector<InstanceTransform> *pVisible)
+{
+   pVisible->resize(instances.size());
+   for (size_t i = 0; i < instances.size(); i++)
+   {
+      const CullInstance &instance = instances[i];
+      if (!SphereInFrustum(frustum, instance.bounds)) continue;
+
+      assert(instance.drawIndex < pArgs->size());
+      IndirectDrawArgs &args = (*pArgs)[instance.drawIndex];
+      (*pVisible)[args.startInstanceLocation + args.instanceCount] = instance.world;
+      args.instanceCount++;
+   }
+}
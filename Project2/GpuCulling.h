@@ -0,0 +1,74 @@
+#pragma once
+
+#include <vector>
+
+#include "MeshInstancing.h"
+
+// Threads per group of CullCS.hlsl
+const unsigned int CULL_THREAD_GROUP_SIZE = 64;
+
+// Plane equations (xyz normal pointing inside, w distance), left, right,
+// bottom, top, near, far
+struct FrustumPlanes
+{
+   float planes[6][4];
+};
+
+struct BoundingSphere
+{
+   float center[3];
+   float radius;
+};
+
+// Layout of DrawIndexedInstancedIndirect's arguments
+struct IndirectDrawArgs
+{
+   unsigned int indexCountPerInstance;
+   unsigned int instanceCount;
+   unsigned int startIndexLocation;
+   int baseVertexLocation;
+   unsigned int startInstanceLocation;
+};
+
+// Element of the structured buffer CullCS.hlsl reads, one per instance
+struct CullInstance
+{
+   BoundingSphere bounds;
+   unsigned int drawIndex;
+   unsigned int padding[3];
+   InstanceTransform world;
+};
+
+// Constant buffer of CullCS.hlsl
+struct CullConstants
+{
+   FrustumPlanes frustum;
+   unsigned int numInstances;
+   unsigned int padding[3];
+};
+
+// Planes of a row vector view projection matrix stored row major (the
+// XMMATRIX layout), with D3D's 0 to 1 clip depth
+void ExtractFrustumPlanes(const float viewProj[16], FrustumPlanes *pFrustum);
+
+// Sphere around the center of the positions' bounding box. pPositions
+// points at the first vertex' xyz, stride is in floats.
+BoundingSphere ComputeBoundingSphere(const float *pPositions, unsigned int stride, unsigned int numVertices);
+
+// Conservative for non-uniform scale, the largest axis scale is used
+BoundingSphere TransformBoundingSphere(const BoundingSphere &sphere, const InstanceTransform &world);
+
+bool SphereInFrustum(const FrustumPlanes &frustum, const BoundingSphere &sphere);
+
+// Builds the cull inputs from instance batches, transforms and the local
+// bounds of each mesh. Draw i covers batch i.
+void BuildCullInstances(const std::vector<InstanceBatch> &batches, const std::vector<InstanceTransform> &transforms,
+   const std::vector<BoundingSphere> &meshBounds, std::vector<CullInstance> *pInstances);
+
+// CPU version of CullCS.hlsl. pArgs holds the frame's argument template on
+// input (instance counts at 0), visible transforms are written compacted per
+// draw starting at each draw's startInstanceLocation. Instances are visited
+// in order, the GPU's atomics may order the transforms within a draw
+// differently.
+void CullInstancesReference(const std::vector<CullInstance> &instances, const FrustumPlanes &frustum,
+   std::vector<IndirectDrawArgs> *pArgs, std::vector<InstanceTransform> *pVisible);
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <d3d11.h>
+#include <cstring>
+
+// GPU time between Begin and End with timestamp queries. Each frame gets its
+// own queries and is read back NUM_FRAMES frames later, when the queries are
+// about to be reused, so the CPU never waits for the GPU.
+class GpuTimer
+{
+public:
+   static const UINT NUM_FRAMES = 4;
+
+   GpuTimer() :
+      m_frame(0)
+   {
+      memset(m_frames, 0, sizeof(m_frames));
+   }
+
+   ~GpuTimer()
+   {
+      for (UINT i = 0; i < NUM_FRAMES; i++)
+      {
+         if (m_frames[i].pDisjoint) m_frames[i].pDisjoint->Release();
+         if (m_frames[i].pBegin) m_frames[i].pBegin->Release();
+         if (m_frames[i].pEnd) m_frames[i].pEnd->Release();
+      }
+   }
+
+   // Creates the queries of every frame, the timer must not be used if this
+   // fails. Queries created before the failure are released by the
+   // destructor.
+   HRESULT Create(ID3D11Device *pDevice)
+   {
+      D3D11_QUERY_DESC disjointDesc = { D3D11_QUERY_TIMESTAMP_DISJOINT, 0 };
+      D3D11_QUERY_DESC timestampDesc = { D3D11_QUERY_TIMESTAMP, 0 };
+      for (UINT i = 0; i < NUM_FRAMES; i++)
+      {
+         HRESULT result = pDevice->CreateQuery(&disjointDesc, &m_frames[i].pDisjoint);
+         if (SUCCEEDED(result)) result = pDevice->CreateQuery(&timestampDesc, &m_frames[i].pBegin);
+         if (SUCCEEDED(result)) result = pDevice->CreateQuery(&timestampDesc, &m_frames[i].pEnd);
+         if (FAILED(result)) return result;
+      }
+      return S_OK;
+   }
+
+   // Number of the frame the next Begin starts
+   UINT GetFrame() const { return m_frame; }
+
+   void Begin(ID3D11DeviceContext *pContext)
+   {
+      Frame &frame = m_frames[m_frame % NUM_FRAMES];
+      pContext->Begin(frame.pDisjoint);
+      pContext->End(frame.pBegin);
+   }
+
+   void End(ID3D11DeviceContext *pContext)
+   {
+      Frame &frame = m_frames[m_frame % NUM_FRAMES];
+      pContext->End(frame.pEnd);
+      pContext->End(frame.pDisjoint);
+      m_frame++;
+   }
+
+   // Reads the oldest frame in flight, the next Begin reuses its queries.
+   // pFrame is the frame's number, counting the End calls from 0. Returns
+   // false while the GPU has not got there or when its clock changed.
+   bool Read(ID3D11DeviceContext *pContext, double *pMs, UINT *pFrame)
+   {
+      if (m_frame < NUM_FRAMES) return false;
+
+      UINT oldest = m_frame - NUM_FRAMES;
+      Frame &frame = m_frames[oldest % NUM_FRAMES];
+      D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjoint;
+      UINT64 begin, end;
+      if (pContext->GetData(frame.pDisjoint, &disjoint, sizeof(disjoint), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK ||
+         pContext->GetData(frame.pBegin, &begin, sizeof(begin), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK ||
+         pContext->GetData(frame.pEnd, &end, sizeof(end), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)
+      {
+         return false;
+      }
+      if (disjoint.Disjoint || disjoint.Frequency == 0) return false;
+
+      *pMs = (double)(end - begin) * 1000.0 / (double)disjoint.Frequency;
+      *pFrame = oldest;
+      return true;
+   }
+
+private:
+   struct Frame
+   {
+      ID3D11Query *pDisjoint;
+      ID3D11Query *pBegin;
+      ID3D11Query *pEnd;
+   };
+
+   Frame m_frames[NUM_FRAMES];
+   UINT m_frame;
+};
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <d3d11.h>
+#include <d3dx11.h>
+#include <DxErr.h>
+#include <cassert>
+
+// DrawIndexedInstancedIndirect arguments a compute shader fills in through
+// a uint UAV. The initial arguments are kept in a second buffer so they can
+// be copied back over the arguments at the start of every frame.
+template<typename Args>
+class IndirectArgsBuffer
+{
+public:
+   IndirectArgsBuffer(ID3D11Device *pDevice, UINT numArgs, const Args *pInitialArgs)
+   {
+      D3D11_BUFFER_DESC bufDesc;
+      memset(&bufDesc, 0, sizeof(bufDesc));
+      bufDesc.Usage = D3D11_USAGE_DEFAULT;
+      bufDesc.ByteWidth = sizeof(Args) * numArgs;
+      bufDesc.BindFlags = 0;
+
+      D3D11_SUBRESOURCE_DATA initialData;
+      memset(&initialData, 0, sizeof(initialData));
+      initialData.pSysMem = pInitialArgs;
+
+      HRESULT result = pDevice->CreateBuffer(&bufDesc, &initialData, &m_pTemplate);
+      assert(result == S_OK);
+
+      bufDesc.BindFlags = D3D11_BIND_UNORDERED_ACCESS;
+      bufDesc.MiscFlags = D3D11_RESOURCE_MISC_DRAWINDIRECT_ARGS;
+      result = pDevice->CreateBuffer(&bufDesc, &initialData, &m_pArgs);
+      assert(result == S_OK);
+
+      D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc;
+      memset(&uavDesc, 0, sizeof(uavDesc));
+      uavDesc.Format = DXGI_FORMAT_R32_UINT;
+      uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+      uavDesc.Buffer.NumElements = sizeof(Args) * numArgs / sizeof(UINT);
+      result = pDevice->CreateUnorderedAccessView(m_pArgs, &uavDesc, &m_pUav);
+      assert(result == S_OK);
+   }
+
+   ~IndirectArgsBuffer()
+   {
+      m_pUav->Release();
+      m_pArgs->Release();
+      m_pTemplate->Release();
+   }
+
+   ID3D11Buffer *GetArgsBuffer() const
+   {
+      return m_pArgs;
+   }
+
+   ID3D11Buffer *GetTemplateBuffer() const
+   {
+      return m_pTemplate;
+   }
+
+   ID3D11UnorderedAccessView *GetUnorderedAccessView() const
+   {
+      return m_pUav;
+   }
+
+private:
+   ID3D11Buffer *m_pArgs;
+   ID3D11Buffer *m_pTemplate;
+   ID3D11UnorderedAccessView *m_pUav;
+};
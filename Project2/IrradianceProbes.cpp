@@ -0,0 +1,865 @@
+#include "IrradianceProbes.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include "CpuTimer.h"
+
+using std::string;
+using std::vector;
+
+namespace
+{
+   const char PROBE_FILE_MAGIC[4] = { 'I', 'R', 'P', '1' };
+   const float PI = 3.14159265f;
+   const unsigned int MAX_LEAF_TRIANGLES = 4;
+
+   // Albedo of faces before any usemtl, the default diffuse of ObjReader's
+   // materials
+   const float DEFAULT_ALBEDO = 0.8f;
+
+   // Cosine lobe convolution of each band over pi, turns radiance
+   // coefficients into irradiance / pi
+   const float BAND_SCALE[3] = { 1.0f, 2.0f / 3.0f, 0.25f };
+   const unsigned int COEFFICIENT_BAND[IRRADIANCE_SH_COEFFICIENTS] = { 0, 1, 1, 1, 2, 2, 2, 2, 2 };
+
+   void EvaluateShBasis(const float d[3], float basis[IRRADIANCE_SH_COEFFICIENTS])
+   {
+      basis[0] = 0.282095f;
+      basis[1] = 0.488603f * d[1];
+      basis[2] = 0.488603f * d[2];
+      basis[3] = 0.488603f * d[0];
+      basis[4] = 1.092548f * d[0] * d[1];
+      basis[5] = 1.092548f * d[1] * d[2];
+      basis[6] = 0.315392f * (3.0f * d[2] * d[2] - 1.0f);
+      basis[7] = 1.092548f * d[0] * d[2];
+      basis[8] = 0.546274f * (d[0] * d[0] - d[1] * d[1]);
+   }
+
+   float Dot(const float a[3], const float b[3])
+   {
+      return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+   }
+
+   void Cross(const float a[3], const float b[3], float result[3])
+   {
+      result[0] = a[1] * b[2] - a[2] * b[1];
+      result[1] = a[2] * b[0] - a[0] * b[2];
+      result[2] = a[0] * b[1] - a[1] * b[0];
+   }
+
+   void Normalize(float v[3])
+   {
+      float length = sqrtf(Dot(v, v));
+      if (length > 0.0f)
+      {
+         for (unsigned int c = 0; c < 3; c++) v[c] /= length;
+      }
+   }
+
+   float NextRandom(unsigned int *pSeed)
+   {
+      *pSeed = *pSeed * 1664525u + 1013904223u;
+      return (*pSeed >> 8) / 16777216.0f;
+   }
+
+   // Bounding volume hierarchy over the triangles, nodes split at the
+   // median centroid along their longest axis. Leaves own the range
+   // [first, first + count) of the sorted triangle indices, inner nodes
+   // have their left child next to them and the right one at first.
+   struct BvhNode
+   {
+      float boundsMin[3];
+      float boundsMax[3];
+      unsigned int first;
+      unsigned int count;
+   };
+
+   class Bvh
+   {
+   public:
+      explicit Bvh(const vector<ProbeBakeTriangle> &triangles);
+
+      // Nearest hit past minDistance, returns false if there is none
+      bool Intersect(const float origin[3], const float direction[3], float minDistance, float *pDistance,
+         unsigned int *pTriangle) const;
+      bool IsOccluded(const float origin[3], const float direction[3], float minDistance) const;
+
+   private:
+      void Build(unsigned int node, unsigned int first, unsigned int count);
+      bool Traverse(const float origin[3], const float direction[3], float minDistance, bool anyHit,
+         float *pDistance, unsigned int *pTriangle) const;
+
+      const vector<ProbeBakeTriangle> &m_triangles;
+      vector<unsigned int> m_indices;
+      vector<float> m_centroids;
+      vector<BvhNode> m_nodes;
+   };
+
+   struct CentroidLess
+   {
+      const vector<float> *pCentroids;
+      unsigned int axis;
+
+      bool operator()(unsigned int a, unsigned int b) const
+      {
+         return (*pCentroids)[a * 3 + axis] < (*pCentroids)[b * 3 + axis];
+      }
+   };
+
+   Bvh::Bvh(const vector<ProbeBakeTriangle> &triangles) : m_triangles(triangles)
+   {
+      m_indices.resize(triangles.size());
+      m_centroids.resize(triangles.size() * 3);
+      for (size_t i = 0; i < triangles.size(); i++)
+      {
+         m_indices[i] = (unsigned int)i;
+         for (unsigned int c = 0; c < 3; c++)
+         {
+            const float (*p)[3] = triangles[i].positions;
+            m_centroids[i * 3 + c] = (p[0][c] + p[1][c] + p[2][c]) / 3.0f;
+         }
+      }
+
+      m_nodes.reserve(triangles.size() * 2 + 1);
+      m_nodes.push_back(BvhNode());
+      Build(0, 0, (unsigned int)triangles.size());
+   }
+
+   void Bvh::Build(unsigned int node, unsigned int first, unsigned int count)
+   {
+      BvhNode bounds;
+      float centroidMin[3], centroidMax[3];
+      for (unsigned int c = 0; c < 3; c++)
+      {
+         bounds.boundsMin[c] = centroidMin[c] = 1e30f;
+         bounds.boundsMax[c] = centroidMax[c] = -1e30f;
+      }
+      for (unsigned int i = first; i < first + count; i++)
+      {
+         const ProbeBakeTriangle &triangle = m_triangles[m_indices[i]];
+         for (unsigned int c = 0; c < 3; c++)
+         {
+            for (unsigned int v = 0; v < 3; v++)
+            {
+               if (triangle.positions[v][c] < bounds.boundsMin[c]) bounds.boundsMin[c] = triangle.positions[v][c];
+               if (triangle.positions[v][c] > bounds.boundsMax[c]) bounds.boundsMax[c] = triangle.positions[v][c];
+            }
+            float centroid = m_centroids[m_indices[i] * 3 + c];
+            if (centroid < centroidMin[c]) centroidMin[c] = centroid;
+            if (centroid > centroidMax[c]) centroidMax[c] = centroid;
+         }
+      }
+      bounds.first = first;
+      bounds.count = count;
+
+      unsigned int axis = 0;
+      for (unsigned int c = 1; c < 3; c++)
+      {
+         if (centroidMax[c] - centroidMin[c] > centroidMax[axis] - centroidMin[axis]) axis = c;
+      }
+      if (count <= MAX_LEAF_TRIANGLES || centroidMax[axis] <= centroidMin[axis])
+      {
+         m_nodes[node] = bounds;
+         return;
+      }
+
+      unsigned int half = count / 2;
+      CentroidLess less = { &m_centroids, axis };
+      std::nth_element(m_indices.begin() + first, m_indices.begin() + first + half, m_indices.begin() + first + count,
+         less);
+
+      unsigned int left = (unsigned int)m_nodes.size();
+      m_nodes.push_back(BvhNode());
+      Build(left, first, half);
+
+      unsigned int right = (unsigned int)m_nodes.size();
+      m_nodes.push_back(BvhNode());
+      Build(right, first + half, count - half);
+
+      bounds.first = right;
+      bounds.count = 0;
+      m_nodes[node] = bounds;
+   }
+
+   bool IntersectBounds(const BvhNode &node, const float origin[3], const float invDirection[3], float maxDistance)
+   {
+      float tMin = 0.0f, tMax = maxDistance;
+      for (unsigned int c = 0; c < 3; c++)
+      {
+         float t0 = (node.boundsMin[c] - origin[c]) * invDirection[c];
+         float t1 = (node.boundsMax[c] - origin[c]) * invDirection[c];
+         if (t0 > t1) std::swap(t0, t1);
+         if (t0 > tMin) tMin = t0;
+         if (t1 < tMax) tMax = t1;
+         if (tMin > tMax) return false;
+      }
+      return true;
+   }
+
+   // Moller-Trumbore, both sides of the triangle are hit
+   bool IntersectTriangle(const ProbeBakeTriangle &triangle, const float origin[3], const float direction[3],
+      float *pDistance)
+   {
+      float edge1[3], edge2[3], toOrigin[3];
+      for (unsigned int c = 0; c < 3; c++)
+      {
+         edge1[c] = triangle.positions[1][c] - triangle.positions[0][c];
+         edge2[c] = triangle.positions[2][c] - triangle.positions[0][c];
+         toOrigin[c] = origin[c] - triangle.positions[0][c];
+      }
+
+      float p[3];
+      Cross(direction, edge2, p);
+      float determinant = Dot(edge1, p);
+      if (fabsf(determinant) < 1e-12f) return false;
+      float invDeterminant = 1.0f / determinant;
+
+      float u = Dot(toOrigin, p) * invDeterminant;
+      if (u < 0.0f || u > 1.0f) return false;
+
+      float q[3];
+      Cross(toOrigin, edge1, q);
+      float v = Dot(direction, q) * invDeterminant;
+      if (v < 0.0f || u + v > 1.0f) return false;
+
+      *pDistance = Dot(edge2, q) * invDeterminant;
+      return true;
+   }
+
+   bool Bvh::Traverse(const float origin[3], const float direction[3], float minDistance, bool anyHit,
+      float *pDistance, unsigned int *pTriangle) const
+   {
+      if (m_triangles.empty()) return false;
+
+      float invDirection[3];
+      for (unsigned int c = 0; c < 3; c++)
+      {
+         invDirection[c] = direction[c] != 0.0f ? 1.0f / direction[c] : 1e30f;
+      }
+
+      float nearest = 1e30f;
+      bool hit = false;
+      unsigned int stack[64];
+      unsigned int stackSize = 0;
+      stack[stackSize++] = 0;
+      while (stackSize > 0)
+      {
+         const BvhNode &node = m_nodes[stack[--stackSize]];
+         if (!IntersectBounds(node, origin, invDirection, nearest)) continue;
+
+         if (node.count > 0)
+         {
+            for (unsigned int i = node.first; i < node.first + node.count; i++)
+            {
+               float distance;
+               if (IntersectTriangle(m_triangles[m_indices[i]], origin, direction, &distance) &&
+                  distance > minDistance && distance < nearest)
+               {
+                  nearest = distance;
+                  *pTriangle = m_indices[i];
+                  hit = true;
+                  if (anyHit) return true;
+               }
+            }
+         }
+         else
+         {
+            unsigned int left = (unsigned int)(&node - &m_nodes[0]) + 1;
+            stack[stackSize++] = node.first;
+            stack[stackSize++] = left;
+         }
+      }
+      *pDistance = nearest;
+      return hit;
+   }
+
+   bool Bvh::Intersect(const float origin[3], const float direction[3], float minDistance, float *pDistance,
+      unsigned int *pTriangle) const
+   {
+      return Traverse(origin, direction, minDistance, false, pDistance, pTriangle);
+   }
+
+   bool Bvh::IsOccluded(const float origin[3], const float direction[3], float minDistance) const
+   {
+      float distance;
+      unsigned int triangle;
+      return Traverse(origin, direction, minDistance, true, &distance, &triangle);
+   }
+
+   struct BakeContext
+   {
+      const ProbeBakeScene *pScene;
+      const ProbeBakeSettings *pSettings;
+      const Bvh *pBvh;
+      IrradianceProbeGrid *pGrid;
+
+      float sunDirection[3];
+      float rayEpsilon;
+      unsigned int strataU;
+      unsigned int strataV;
+
+      std::mutex mutex;
+      unsigned int nextProbe;
+   };
+
+   void GetProbePosition(const IrradianceProbeGrid &grid, unsigned int probe, float position[3])
+   {
+      unsigned int coords[3] = { probe % grid.dims[0], (probe / grid.dims[0]) % grid.dims[1],
+         probe / (grid.dims[0] * grid.dims[1]) };
+      for (unsigned int c = 0; c < 3; c++)
+      {
+         float t = (float)coords[c] / (grid.dims[c] - 1);
+         position[c] = grid.boundsMin[c] + t * (grid.boundsMax[c] - grid.boundsMin[c]);
+      }
+   }
+
+   // Radiance arriving at origin from direction, the sky where the ray
+   // escapes and the light reflected off the first surface otherwise. Each
+   // surface adds the directional light it receives, and continues along a
+   // cosine distributed direction for the bounces it has left.
+   void TraceRadiance(const BakeContext &context, const float origin[3], const float direction[3],
+      unsigned int *pSeed, unsigned long long *pNumRays, float radiance[3])
+   {
+      const ProbeBakeSettings &settings = *context.pSettings;
+      float throughput[3] = { 1.0f, 1.0f, 1.0f };
+      float rayOrigin[3] = { origin[0], origin[1], origin[2] };
+      float rayDirection[3] = { direction[0], direction[1], direction[2] };
+      radiance[0] = radiance[1] = radiance[2] = 0.0f;
+
+      for (unsigned int bounce = 0; ; bounce++)
+      {
+         float distance;
+         unsigned int hit;
+         (*pNumRays)++;
+         if (!context.pBvh->Intersect(rayOrigin, rayDirection, 0.0f, &distance, &hit))
+         {
+            for (unsigned int c = 0; c < 3; c++) radiance[c] += throughput[c] * settings.skyColor[c];
+            return;
+         }
+
+         const ProbeBakeTriangle &triangle = context.pScene->triangles[hit];
+         float edge1[3], edge2[3], normal[3], position[3];
+         for (unsigned int c = 0; c < 3; c++)
+         {
+            edge1[c] = triangle.positions[1][c] - triangle.positions[0][c];
+            edge2[c] = triangle.positions[2][c] - triangle.positions[0][c];
+         }
+         Cross(edge1, edge2, normal);
+         Normalize(normal);
+         if (Dot(normal, rayDirection) > 0.0f)
+         {
+            for (unsigned int c = 0; c < 3; c++) normal[c] = -normal[c];
+         }
+         for (unsigned int c = 0; c < 3; c++)
+         {
+            position[c] = rayOrigin[c] + rayDirection[c] * distance + normal[c] * context.rayEpsilon;
+            throughput[c] *= triangle.albedo[c];
+         }
+
+         float cosSun = Dot(normal, context.sunDirection);
+         if (cosSun > 0.0f)
+         {
+            (*pNumRays)++;
+            if (!context.pBvh->IsOccluded(position, context.sunDirection, 0.0f))
+            {
+               for (unsigned int c = 0; c < 3; c++) radiance[c] += throughput[c] * settings.sunColor[c] * cosSun;
+            }
+         }
+         if (bounce >= settings.maxBounces) return;
+
+         // Cosine distributed around the normal, the albedo is all that is
+         // left of the Lambertian BRDF over the pdf
+         float tangent[3], bitangent[3];
+         float axis[3] = { 0.0f, 0.0f, 0.0f };
+         axis[fabsf(normal[0]) < 0.9f ? 0 : 1] = 1.0f;
+         Cross(normal, axis, tangent);
+         Normalize(tangent);
+         Cross(normal, tangent, bitangent);
+
+         float u = NextRandom(pSeed), v = NextRandom(pSeed);
+         float r = sqrtf(u), phi = 2.0f * PI * v;
+         float x = r * cosf(phi), y = r * sinf(phi), z = sqrtf(1.0f - u);
+         for (unsigned int c = 0; c < 3; c++)
+         {
+            rayOrigin[c] = position[c];
+            rayDirection[c] = tangent[c] * x + bitangent[c] * y + normal[c] * z;
+         }
+      }
+   }
+
+   void BakeProbe(const BakeContext &context, unsigned int probe, unsigned long long *pNumRays)
+   {
+      IrradianceProbeGrid &grid = *context.pGrid;
+      float origin[3];
+      GetProbePosition(grid, probe, origin);
+
+      unsigned int seed = context.pSettings->seed ^ (probe * 2654435761u);
+      NextRandom(&seed);
+
+      float sums[IRRADIANCE_SH_COEFFICIENTS * 3];
+      memset(sums, 0, sizeof(sums));
+      for (unsigned int su = 0; su < context.strataU; su++)
+      {
+         for (unsigned int sv = 0; sv < context.strataV; sv++)
+         {
+            // Uniform over the sphere, one sample per stratum of z and the
+            // angle around it
+            float z = 1.0f - 2.0f * (su + NextRandom(&seed)) / context.strataU;
+            float phi = 2.0f * PI * (sv + NextRandom(&seed)) / context.strataV;
+            float r = sqrtf(std::max(0.0f, 1.0f - z * z));
+            float direction[3] = { r * cosf(phi), r * sinf(phi), z };
+
+            float radiance[3];
+            TraceRadiance(context, origin, direction, &seed, pNumRays, radiance);
+
+            float basis[IRRADIANCE_SH_COEFFICIENTS];
+            EvaluateShBasis(direction, basis);
+            for (unsigned int k = 0; k < IRRADIANCE_SH_COEFFICIENTS; k++)
+            {
+               for (unsigned int c = 0; c < 3; c++) sums[k * 3 + c] += radiance[c] * basis[k];
+            }
+         }
+      }
+
+      float weight = 4.0f * PI / (context.strataU * context.strataV);
+      float *coefficients = &grid.coefficients[probe * IRRADIANCE_SH_COEFFICIENTS * 3];
+      for (unsigned int k = 0; k < IRRADIANCE_SH_COEFFICIENTS; k++)
+      {
+         for (unsigned int c = 0; c < 3; c++)
+         {
+            coefficients[k * 3 + c] = sums[k * 3 + c] * weight * BAND_SCALE[COEFFICIENT_BAND[k]];
+         }
+      }
+   }
+
+   void BakeWorker(BakeContext *pContext, unsigned long long *pNumRays)
+   {
+      unsigned int numProbes = pContext->pGrid->dims[0] * pContext->pGrid->dims[1] * pContext->pGrid->dims[2];
+      for (;;)
+      {
+         unsigned int probe;
+         {
+            std::lock_guard<std::mutex> lock(pContext->mutex);
+            probe = pContext->nextProbe++;
+         }
+         if (probe >= numProbes) return;
+         BakeProbe(*pContext, probe, pNumRays);
+      }
+   }
+
+   unsigned short FloatToHalf(float value)
+   {
+      unsigned int bits;
+      memcpy(&bits, &value, sizeof(bits));
+      unsigned int sign = (bits >> 16) & 0x8000;
+      unsigned int mantissa = bits & 0x7fffff;
+      int exponent = (int)((bits >> 23) & 0xff) - 127 + 15;
+
+      if (((bits >> 23) & 0xff) == 0xff) return (unsigned short)(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+      if (exponent >= 31) return (unsigned short)(sign | 0x7c00);
+      if (exponent <= 0)
+      {
+         // Denormal, or too small for one
+         if (exponent < -10) return (unsigned short)sign;
+         mantissa |= 0x800000;
+         unsigned int shift = (unsigned int)(14 - exponent);
+         unsigned int half = mantissa >> shift;
+         if ((mantissa >> (shift - 1)) & 1) half++;
+         return (unsigned short)(sign | half);
+      }
+
+      // Rounding may carry into the exponent, which is still the right
+      // result
+      unsigned int half = sign | ((unsigned int)exponent << 10) | (mantissa >> 13);
+      if (mantissa & 0x1000) half++;
+      return (unsigned short)half;
+   }
+
+   float HalfToFloat(unsigned short half)
+   {
+      unsigned int sign = (unsigned int)(half & 0x8000) << 16;
+      unsigned int exponent = (half >> 10) & 0x1f;
+      unsigned int mantissa = half & 0x3ff;
+
+      if (exponent == 0)
+      {
+         float value = ldexp((float)mantissa, -24);
+         return sign ? -value : value;
+      }
+
+      unsigned int bits = exponent == 31 ? sign | 0x7f800000 | (mantissa << 13) :
+         sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+      float value;
+      memcpy(&value, &bits, sizeof(value));
+      return value;
+   }
+
+   string GetDirectory(const string &path)
+   {
+      size_t slash = path.find_last_of("/\\");
+      return slash == string::npos ? string() : path.substr(0, slash + 1);
+   }
+
+   void LoadMaterialAlbedos(const string &path, std::map<string, vector<float> > *pAlbedos)
+   {
+      std::ifstream in(path.c_str());
+      string line, name;
+      while (std::getline(in, line))
+      {
+         std::istringstream words(line);
+         string word;
+         words >> word;
+         if (word == "newmtl")
+         {
+            words >> name;
+            (*pAlbedos)[name].assign(3, DEFAULT_ALBEDO);
+         }
+         else if (word == "Kd" && !name.empty())
+         {
+            vector<float> &albedo = (*pAlbedos)[name];
+            words >> albedo[0] >> albedo[1] >> albedo[2];
+         }
+      }
+   }
+}
+
+void GetDefaultProbeBakeSettings(ProbeBakeSettings *pSettings)
+{
+   pSettings->maxProbesPerAxis = 32;
+   pSettings->samplesPerProbe = 256;
+   pSettings->maxBounces = 2;
+   pSettings->numThreads = 0;
+
+   // LIGHT_DIRECTION in Renderer.cpp, with the color PlainPixel.hlsl lights
+   // with
+   pSettings->sunDirection[0] = 0.0f;
+   pSettings->sunDirection[1] = 1.0f;
+   pSettings->sunDirection[2] = 0.0f;
+   for (unsigned int c = 0; c < 3; c++)
+   {
+      pSettings->sunColor[c] = 1.0f;
+      pSettings->skyColor[c] = 0.0f;
+   }
+   pSettings->seed = 1;
+}
+
+bool LoadProbeBakeSceneObj(const string &path, ProbeBakeScene *pScene)
+{
+   std::ifstream in(path.c_str());
+   if (!in) return false;
+
+   pScene->triangles.clear();
+   std::map<string, vector<float> > albedos;
+   vector<float> positions;
+   float albedo[3] = { DEFAULT_ALBEDO, DEFAULT_ALBEDO, DEFAULT_ALBEDO };
+
+   string line;
+   while (std::getline(in, line))
+   {
+      std::istringstream words(line);
+      string word;
+      words >> word;
+      if (word == "v")
+      {
+         float p[3] = { 0.0f, 0.0f, 0.0f };
+         words >> p[0] >> p[1] >> p[2];
+         positions.insert(positions.end(), p, p + 3);
+      }
+      else if (word == "mtllib")
+      {
+         string library;
+         words >> library;
+         LoadMaterialAlbedos(GetDirectory(path) + library, &albedos);
+      }
+      else if (word == "usemtl")
+      {
+         string name;
+         words >> name;
+         std::map<string, vector<float> >::const_iterator material = albedos.find(name);
+         for (unsigned int c = 0; c < 3; c++)
+         {
+            albedo[c] = material != albedos.end() ? material->second[c] : DEFAULT_ALBEDO;
+         }
+      }
+      else if (word == "f")
+      {
+         // Only the position of each v/vt/vn corner, negative indices
+         // count back from the latest position
+         vector<unsigned int> corners;
+         unsigned int numPositions = (unsigned int)(positions.size() / 3);
+         string corner;
+         while (words >> corner)
+         {
+            int index = atoi(corner.c_str());
+            if (index < 0) index += (int)numPositions + 1;
+            if (index < 1 || index > (int)numPositions) return false;
+            corners.push_back((unsigned int)index - 1);
+         }
+         for (size_t i = 2; i < corners.size(); i++)
+         {
+            AddProbeBakeTriangle(pScene, &positions[corners[0] * 3], &positions[corners[i - 1] * 3],
+               &positions[corners[i] * 3], albedo);
+         }
+      }
+   }
+   ComputeProbeBakeBounds(pScene);
+   return !pScene->triangles.empty();
+}
+
+void AddProbeBakeTriangle(ProbeBakeScene *pScene, const float p0[3], const float p1[3], const float p2[3],
+   const float albedo[3])
+{
+   ProbeBakeTriangle triangle;
+   for (unsigned int c = 0; c < 3; c++)
+   {
+      triangle.positions[0][c] = p0[c];
+      triangle.positions[1][c] = p1[c];
+      triangle.positions[2][c] = p2[c];
+      triangle.albedo[c] = albedo[c];
+   }
+   pScene->triangles.push_back(triangle);
+}
+
+void ComputeProbeBakeBounds(ProbeBakeScene *pScene)
+{
+   for (unsigned int c = 0; c < 3; c++)
+   {
+      pScene->boundsMin[c] = pScene->triangles.empty() ? 0.0f : 1e30f;
+      pScene->boundsMax[c] = pScene->triangles.empty() ? 0.0f : -1e30f;
+   }
+   for (size_t i = 0; i < pScene->triangles.size(); i++)
+   {
+      for (unsigned int v = 0; v < 3; v++)
+      {
+         for (unsigned int c = 0; c < 3; c++)
+         {
+            float p = pScene->triangles[i].positions[v][c];
+            if (p < pScene->boundsMin[c]) pScene->boundsMin[c] = p;
+            if (p > pScene->boundsMax[c]) pScene->boundsMax[c] = p;
+         }
+      }
+   }
+}
+
+void SetupIrradianceProbeGrid(const float boundsMin[3], const float boundsMax[3], unsigned int maxProbesPerAxis,
+   IrradianceProbeGrid *pGrid)
+{
+   // The probes sit at the centers of equal cells splitting the bounds, so
+   // none lies on the walls and floor the bounds usually come from
+   float longest = 0.0f;
+   for (unsigned int c = 0; c < 3; c++)
+   {
+      if (boundsMax[c] - boundsMin[c] > longest) longest = boundsMax[c] - boundsMin[c];
+   }
+   unsigned int maxProbes = maxProbesPerAxis > 2 ? maxProbesPerAxis : 2;
+   float cellSize = longest / maxProbes;
+
+   unsigned int numProbes = 1;
+   for (unsigned int c = 0; c < 3; c++)
+   {
+      float extent = boundsMax[c] - boundsMin[c];
+      unsigned int dims = cellSize > 0.0f ? (unsigned int)ceilf(extent / cellSize - 1e-3f) : 0;
+      if (dims < 2) dims = 2;
+      float inset = extent / dims * 0.5f;
+      pGrid->dims[c] = dims;
+      pGrid->boundsMin[c] = boundsMin[c] + inset;
+      pGrid->boundsMax[c] = boundsMax[c] - inset;
+      numProbes *= dims;
+   }
+   pGrid->coefficients.assign(numProbes * IRRADIANCE_SH_COEFFICIENTS * 3, 0.0f);
+}
+
+void BakeIrradianceProbes(const ProbeBakeScene &scene, const ProbeBakeSettings &settings, IrradianceProbeGrid *pGrid,
+   ProbeBakeStats *pStats)
+{
+   CpuTimer timer;
+   Bvh bvh(scene.triangles);
+
+   BakeContext context;
+   context.pScene = &scene;
+   context.pSettings = &settings;
+   context.pBvh = &bvh;
+   context.pGrid = pGrid;
+   memcpy(context.sunDirection, settings.sunDirection, sizeof(context.sunDirection));
+   Normalize(context.sunDirection);
+
+   float diagonal[3];
+   for (unsigned int c = 0; c < 3; c++) diagonal[c] = scene.boundsMax[c] - scene.boundsMin[c];
+   context.rayEpsilon = sqrtf(Dot(diagonal, diagonal)) * 1e-5f;
+
+   unsigned int samples = settings.samplesPerProbe > 0 ? settings.samplesPerProbe : 1;
+   context.strataU = (unsigned int)sqrtf((float)samples);
+   if (context.strataU < 1) context.strataU = 1;
+   context.strataV = (samples + context.strataU - 1) / context.strataU;
+   context.nextProbe = 0;
+
+   unsigned int numThreads = settings.numThreads > 0 ? settings.numThreads : std::thread::hardware_concurrency();
+   if (numThreads < 1) numThreads = 1;
+
+   // The calling thread bakes too, like worker 0 of ParallelRecorder
+   vector<unsigned long long> numRays(numThreads, 0);
+   vector<std::thread> threads;
+   for (unsigned int worker = 1; worker < numThreads; worker++)
+   {
+      threads.push_back(std::thread(BakeWorker, &context, &numRays[worker]));
+   }
+   BakeWorker(&context, &numRays[0]);
+   for (size_t i = 0; i < threads.size(); i++)
+   {
+      threads[i].join();
+   }
+
+   if (pStats)
+   {
+      pStats->numProbes = pGrid->dims[0] * pGrid->dims[1] * pGrid->dims[2];
+      pStats->numThreads = numThreads;
+      pStats->numRays = 0;
+      for (unsigned int worker = 0; worker < numThreads; worker++) pStats->numRays += numRays[worker];
+      pStats->ms = timer.GetElapsedMs();
+   }
+}
+
+void SampleIrradianceProbes(const IrradianceProbeGrid &grid, const float position[3], const float normal[3],
+   float color[3])
+{
+   unsigned int base[3];
+   float t[3];
+   for (unsigned int c = 0; c < 3; c++)
+   {
+      float extent = grid.boundsMax[c] - grid.boundsMin[c];
+      float cell = extent > 0.0f ? (position[c] - grid.boundsMin[c]) / extent * (grid.dims[c] - 1) : 0.0f;
+      if (cell < 0.0f) cell = 0.0f;
+      if (cell > (float)(grid.dims[c] - 1)) cell = (float)(grid.dims[c] - 1);
+      base[c] = (unsigned int)cell;
+      if (base[c] > grid.dims[c] - 2) base[c] = grid.dims[c] - 2;
+      t[c] = cell - base[c];
+   }
+
+   float blended[IRRADIANCE_SH_COEFFICIENTS * 3];
+   memset(blended, 0, sizeof(blended));
+   for (unsigned int corner = 0; corner < 8; corner++)
+   {
+      float weight = 1.0f;
+      unsigned int coords[3];
+      for (unsigned int c = 0; c < 3; c++)
+      {
+         unsigned int offset = (corner >> c) & 1;
+         coords[c] = base[c] + offset;
+         weight *= offset ? t[c] : 1.0f - t[c];
+      }
+      unsigned int probe = (coords[2] * grid.dims[1] + coords[1]) * grid.dims[0] + coords[0];
+      const float *coefficients = &grid.coefficients[probe * IRRADIANCE_SH_COEFFICIENTS * 3];
+      for (unsigned int i = 0; i < IRRADIANCE_SH_COEFFICIENTS * 3; i++) blended[i] += coefficients[i] * weight;
+   }
+
+   float basis[IRRADIANCE_SH_COEFFICIENTS];
+   EvaluateShBasis(normal, basis);
+   for (unsigned int c = 0; c < 3; c++)
+   {
+      color[c] = 0.0f;
+      for (unsigned int k = 0; k < IRRADIANCE_SH_COEFFICIENTS; k++) color[c] += blended[k * 3 + c] * basis[k];
+      if (color[c] < 0.0f) color[c] = 0.0f;
+   }
+}
+
+void SetupIrradianceProbeConstants(const IrradianceProbeGrid &grid, bool enabled, IrradianceProbeConstants *pConstants)
+{
+   memset(pConstants, 0, sizeof(*pConstants));
+   for (unsigned int c = 0; c < 3; c++)
+   {
+      float extent = grid.boundsMax[c] - grid.boundsMin[c];
+      pConstants->gridMin[c] = grid.boundsMin[c];
+      pConstants->invSpacing[c] = extent > 0.0f ? (grid.dims[c] - 1) / extent : 0.0f;
+      pConstants->dims[c] = grid.dims[c];
+   }
+   pConstants->enabled = enabled ? 1 : 0;
+}
+
+void PackIrradianceProbes(const IrradianceProbeGrid &grid, vector<float> *pPacked)
+{
+   const unsigned int PROBE_FLOATS = IRRADIANCE_SH_COEFFICIENTS * 3;
+   size_t numProbes = grid.coefficients.size() / PROBE_FLOATS;
+   pPacked->assign(numProbes * IRRADIANCE_PROBE_VECTORS * 4, 0.0f);
+   for (size_t probe = 0; probe < numProbes; probe++)
+   {
+      memcpy(&(*pPacked)[probe * IRRADIANCE_PROBE_VECTORS * 4], &grid.coefficients[probe * PROBE_FLOATS],
+         PROBE_FLOATS * sizeof(float));
+   }
+}
+
+bool SaveIrradianceProbes(const char *pPath, const IrradianceProbeGrid &grid)
+{
+   std::ofstream out(pPath, std::ios::binary);
+   if (!out) return false;
+
+   vector<unsigned short> halves(grid.coefficients.size());
+   for (size_t i = 0; i < halves.size(); i++) halves[i] = FloatToHalf(grid.coefficients[i]);
+
+   out.write(PROBE_FILE_MAGIC, sizeof(PROBE_FILE_MAGIC));
+   out.write((const char *)grid.dims, sizeof(grid.dims));
+   out.write((const char *)grid.boundsMin, sizeof(grid.boundsMin));
+   out.write((const char *)grid.boundsMax, sizeof(grid.boundsMax));
+   if (!halves.empty()) out.write((const char *)&halves[0], halves.size() * sizeof(halves[0]));
+   return out.good();
+}
+
+bool LoadIrradianceProbes(const char *pPath, IrradianceProbeGrid *pGrid)
+{
+   std::ifstream in(pPath, std::ios::binary);
+   if (!in) return false;
+
+   char magic[sizeof(PROBE_FILE_MAGIC)];
+   in.read(magic, sizeof(magic));
+   in.read((char *)pGrid->dims, sizeof(pGrid->dims));
+   in.read((char *)pGrid->boundsMin, sizeof(pGrid->boundsMin));
+   in.read((char *)pGrid->boundsMax, sizeof(pGrid->boundsMax));
+   if (!in || memcmp(magic, PROBE_FILE_MAGIC, sizeof(magic)) != 0) return false;
+   if (pGrid->dims[0] < 2 || pGrid->dims[1] < 2 || pGrid->dims[2] < 2) return false;
+
+   size_t numValues = (size_t)pGrid->dims[0] * pGrid->dims[1] * pGrid->dims[2] * IRRADIANCE_SH_COEFFICIENTS * 3;
+   vector<unsigned short> halves(numValues);
+   in.read((char *)&halves[0], halves.size() * sizeof(halves[0]));
+   if (!in) return false;
+
+   pGrid->coefficients.resize(numValues);
+   for (size_t i = 0; i < numValues; i++) pGrid->coefficients[i] = HalfToFloat(halves[i]);
+   return true;
+}
+
+bool BakeIrradianceProbeFile(const string &objPath, const char *pOutPath, const ProbeBakeSettings &settings,
+   std::ostream &log)
+{
+   CpuTimer loadTimer;
+   ProbeBakeScene scene;
+   if (!LoadProbeBakeSceneObj(objPath, &scene))
+   {
+      log << "Could not load " << objPath << "\n";
+      return false;
+   }
+   log << "Loaded " << scene.triangles.size() << " triangles from " << objPath << " in " << loadTimer.GetElapsedMs()
+       << " ms, bounds (" << scene.boundsMin[0] << ", " << scene.boundsMin[1] << ", " << scene.boundsMin[2] << ") to ("
+       << scene.boundsMax[0] << ", " << scene.boundsMax[1] << ", " << scene.boundsMax[2] << ")\n";
+
+   IrradianceProbeGrid grid;
+   SetupIrradianceProbeGrid(scene.boundsMin, scene.boundsMax, settings.maxProbesPerAxis, &grid);
+   ProbeBakeStats stats;
+   BakeIrradianceProbes(scene, settings, &grid, &stats);
+   log << "Baked " << grid.dims[0] << "x" << grid.dims[1] << "x" << grid.dims[2] << " probes, " << stats.numRays
+       << " rays on " << stats.numThreads << " threads in " << stats.ms << " ms\n";
+
+   if (!SaveIrradianceProbes(pOutPath, grid))
+   {
+      log << "Could not write " << pOutPath << "\n";
+      return false;
+   }
+   log << "Saved " << pOutPath << "\n";
+   return true;
+}
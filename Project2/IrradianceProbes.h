@@ -0,0 +1,127 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "ShaderDefines.h"
+
+// Where the baker writes the probes and the renderer looks for them
+#define IRRADIANCE_PROBE_FILE "irradiance_probes.bin"
+
+// Triangle of the static scene the probes are baked from, in world space
+struct ProbeBakeTriangle
+{
+   float positions[3][3];
+   float albedo[3];
+};
+
+struct ProbeBakeScene
+{
+   std::vector<ProbeBakeTriangle> triangles;
+   float boundsMin[3];
+   float boundsMax[3];
+};
+
+// Options of the bake. The scene is lit by the directional light the
+// renderer shades per pixel plus a uniform sky, the probes keep the light
+// that bounced off the scene at least once and the sky.
+struct ProbeBakeSettings
+{
+   // Probes along the longest side of the scene's bounds, the other sides
+   // get as many as keeps the spacing even, at least 2
+   unsigned int maxProbesPerAxis;
+
+   unsigned int samplesPerProbe;
+
+   // Diffuse bounces after the first hit, 0 keeps single bounce light
+   unsigned int maxBounces;
+
+   // 0 uses one thread per hardware thread
+   unsigned int numThreads;
+
+   // Towards the light like lightDir in PlainPixel.hlsl, and the light's
+   // color. A surface facing it reflects albedo * color * cos.
+   float sunDirection[3];
+   float sunColor[3];
+   float skyColor[3];
+
+   unsigned int seed;
+};
+
+// Probes on a regular grid over the bounds, dims[i] >= 2 on every axis with
+// the outer probes on the bounds. Probe (x, y, z) is at index (z * dims[1]
+// + y) * dims[0] + x and holds IRRADIANCE_SH_COEFFICIENTS RGB coefficients
+// of the L2 spherical harmonics of irradiance / pi, so evaluating them at a
+// normal gives the light a white diffuse surface reflects.
+struct IrradianceProbeGrid
+{
+   unsigned int dims[3];
+   float boundsMin[3];
+   float boundsMax[3];
+   std::vector<float> coefficients;
+};
+
+// Constant buffer of PlainPixel.hlsl's probe lookup
+struct IrradianceProbeConstants
+{
+   float gridMin[3];
+   unsigned int enabled;
+
+   // Probes per world unit along each axis
+   float invSpacing[3];
+   float padding0;
+
+   unsigned int dims[3];
+   float padding1;
+};
+
+struct ProbeBakeStats
+{
+   unsigned int numProbes;
+   unsigned int numThreads;
+   unsigned long long numRays;
+   double ms;
+};
+
+void GetDefaultProbeBakeSettings(ProbeBakeSettings *pSettings);
+
+// Positions, faces, materials and their Kd of an OBJ file, polygons are
+// split into fans. Texture maps are not read, textured materials keep Kd.
+bool LoadProbeBakeSceneObj(const std::string &path, ProbeBakeScene *pScene);
+
+void AddProbeBakeTriangle(ProbeBakeScene *pScene, const float p0[3], const float p1[3], const float p2[3],
+   const float albedo[3]);
+void ComputeProbeBakeBounds(ProbeBakeScene *pScene);
+
+// Sizes the grid over the bounds and clears the coefficients
+void SetupIrradianceProbeGrid(const float boundsMin[3], const float boundsMax[3], unsigned int maxProbesPerAxis,
+   IrradianceProbeGrid *pGrid);
+
+// Path traces samplesPerProbe stratified directions from every probe on
+// settings.numThreads threads and projects their radiance on the
+// spherical harmonics. Every probe has its own random sequence, so the
+// result does not depend on the number of threads.
+void BakeIrradianceProbes(const ProbeBakeScene &scene, const ProbeBakeSettings &settings, IrradianceProbeGrid *pGrid,
+   ProbeBakeStats *pStats);
+
+// Trilinear blend of the eight probes around the position evaluated at the
+// normal, the same as PlainPixel.hlsl's probeIrradiance. Positions outside
+// the grid take the nearest probes.
+void SampleIrradianceProbes(const IrradianceProbeGrid &grid, const float position[3], const float normal[3],
+   float color[3]);
+
+void SetupIrradianceProbeConstants(const IrradianceProbeGrid &grid, bool enabled, IrradianceProbeConstants *pConstants);
+
+// Coefficients padded to IRRADIANCE_PROBE_VECTORS float4s per probe, the
+// layout of PlainPixel.hlsl's probe buffer
+void PackIrradianceProbes(const IrradianceProbeGrid &grid, std::vector<float> *pPacked);
+
+// The grid behind a small header, the coefficients as half floats
+bool SaveIrradianceProbes(const char *pPath, const IrradianceProbeGrid &grid);
+bool LoadIrradianceProbes(const char *pPath, IrradianceProbeGrid *pGrid);
+
+// Loads an OBJ, bakes a grid over its bounds and saves it, logging the
+// progress. Needs no GPU.
+bool BakeIrradianceProbeFile(const std::string &objPath, const char *pOutPath, const ProbeBakeSettings &settings,
+   std::ostream &log);
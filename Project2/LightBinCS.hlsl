@@ -0,0 +1,97 @@
+#include "ShaderDefines.h"
+
+struct PointLight
+{
+   float4 pos;
+   float4 col;
+};
+
+// Must match LightGridTile in LightBinning.h
+struct LightTile
+{
+   uint numLights;
+   float minDepth;
+   float maxDepth;
+   uint padding;
+};
+
+StructuredBuffer<PointLight> m_LightBuffer : register(t0);
+
+// Append count of the light buffer, copied in after BlurCS.hlsl ran. It can
+// be past the buffer's end when VPLs were dropped.
+cbuffer VplCount : register(b0)
+{
+   uint numAppendedVpls;
+};
+
+RWStructuredBuffer<LightTile> m_LightTiles : register(u0);
+
+// MAX_LIGHTS_PER_TILE entries per tile, only the first numLights are valid
+RWStructuredBuffer<uint> m_LightIndices : register(u1);
+
+groupshared uint tileNumLights;
+groupshared uint tileMinDepth;
+groupshared uint tileMaxDepth;
+
+// Maps floats to uints that compare in the same order, negative depths
+// included, so the atomics can track the bounds
+uint OrderedDepth(float depth)
+{
+   uint bits = asuint(depth);
+   return (bits & 0x80000000) ? ~bits : bits | 0x80000000;
+}
+
+float UnorderedDepth(uint bits)
+{
+   return asfloat((bits & 0x80000000) ? bits & 0x7fffffff : ~bits);
+}
+
+// One group per tile of the light grid
+[numthreads(LIGHT_BIN_THREAD_GROUP_SIZE, 1, 1)]
+void main( uint3 Gid : SV_GroupID, uint GI : SV_GroupIndex )
+{
+   if (GI == 0)
+   {
+      tileNumLights = 0;
+      tileMinDepth = 0xffffffff;
+      tileMaxDepth = 0;
+   }
+   GroupMemoryBarrierWithGroupSync();
+
+   float2 gridSize = float2(LIGHT_GRID_WIDTH, LIGHT_GRID_HEIGHT);
+   float2 tileMin = Gid.xy / gridSize;
+   float2 tileMax = (Gid.xy + 1) / gridSize;
+
+   // Edge tiles also take the pixels outside of the shadow map
+   if (Gid.x == 0) tileMin.x = -1e30;
+   if (Gid.y == 0) tileMin.y = -1e30;
+   if (Gid.x == LIGHT_GRID_WIDTH - 1) tileMax.x = 1e30;
+   if (Gid.y == LIGHT_GRID_HEIGHT - 1) tileMax.y = 1e30;
+
+   uint tile = Gid.y * LIGHT_GRID_WIDTH + Gid.x;
+   uint numVpls = min(numAppendedVpls, MAX_VPLS);
+   for (uint light = GI; light < numVpls; light += LIGHT_BIN_THREAD_GROUP_SIZE)
+   {
+      float3 pos = m_LightBuffer[light].pos.xyz;
+      float2 offset = pos.xy - clamp(pos.xy, tileMin, tileMax);
+      if (dot(offset, offset) < MAX_LIGHT_RADIUS * MAX_LIGHT_RADIUS)
+      {
+         uint slot;
+         InterlockedAdd(tileNumLights, 1, slot);
+         m_LightIndices[tile * MAX_LIGHTS_PER_TILE + slot] = light;
+         InterlockedMin(tileMinDepth, OrderedDepth(pos.z - MAX_LIGHT_RADIUS));
+         InterlockedMax(tileMaxDepth, OrderedDepth(pos.z + MAX_LIGHT_RADIUS));
+      }
+   }
+   GroupMemoryBarrierWithGroupSync();
+
+   if (GI == 0)
+   {
+      LightTile header;
+      header.numLights = tileNumLights;
+      header.minDepth = tileNumLights > 0 ? UnorderedDepth(tileMinDepth) : 1.0;
+      header.maxDepth = tileNumLights > 0 ? UnorderedDepth(tileMaxDepth) : 0.0;
+      header.padding = 0;
+      m_LightTiles[tile] = header;
+   }
+}
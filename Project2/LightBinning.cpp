@@ -0,0 +1,80 @@
+#include "LightBinning.h"
+
+#include <cfloat>
+#include <cstddef>
+
+using std::vector;
+
+unsigned int GetLightTile(float u, float v)
+{
+   int x = (int)(u * LIGHT_GRID_WIDTH);
+   int y = (int)(v * LIGHT_GRID_HEIGHT);
+   if (x < 0) x = 0;
+   if (x > LIGHT_GRID_WIDTH - 1) x = LIGHT_GRID_WIDTH - 1;
+   if (y < 0) y = 0;
+   if (y > LIGHT_GRID_HEIGHT - 1) y = LIGHT_GRID_HEIGHT - 1;
+   return y * LIGHT_GRID_WIDTH + x;
+}
+
+void GetLightTileBounds(unsigned int tile, float bounds[4])
+{
+   unsigned int x = tile % LIGHT_GRID_WIDTH;
+   unsigned int y = tile / LIGHT_GRID_WIDTH;
+   bounds[0] = x == 0 ? -FLT_MAX : (float)x / LIGHT_GRID_WIDTH;
+   bounds[1] = y == 0 ? -FLT_MAX : (float)y / LIGHT_GRID_HEIGHT;
+   bounds[2] = x == LIGHT_GRID_WIDTH - 1 ? FLT_MAX : (float)(x + 1) / LIGHT_GRID_WIDTH;
+   bounds[3] = y == LIGHT_GRID_HEIGHT - 1 ? FLT_MAX : (float)(y + 1) / LIGHT_GRID_HEIGHT;
+}
+
+bool LightReachesTile(const VirtualPointLight &light, unsigned int tile)
+{
+   float bounds[4];
+   GetLightTileBounds(tile, bounds);
+
+   // Distance to the closest point of the rectangle
+   float u = light.position[0];
+   float v = light.position[1];
+   float du = u < bounds[0] ? bounds[0] - u : (u > bounds[2] ? u - bounds[2] : 0.0f);
+   float dv = v < bounds[1] ? bounds[1] - v : (v > bounds[3] ? v - bounds[3] : 0.0f);
+   const float radius = (float)MAX_LIGHT_RADIUS;
+   return du * du + dv * dv < radius * radius;
+}
+
+void BinLightsReference(const vector<VirtualPointLight> &lights, vector<LightGridTile> *pTiles,
+   vector<unsigned int> *pIndices)
+{
+   const float radius = (float)MAX_LIGHT_RADIUS;
+   pTiles->resize(NUM_LIGHT_TILES);
+   pIndices->resize(NUM_LIGHT_TILES * MAX_LIGHTS_PER_TILE);
+
+   for (unsigned int tile = 0; tile < NUM_LIGHT_TILES; tile++)
+   {
+      LightGridTile &header = (*pTiles)[tile];
+      header.numLights = 0;
+      header.minDepth = 1.0f;
+      header.maxDepth = 0.0f;
+      header.padding = 0;
+
+      for (unsigned int light = 0; light < lights.size() && header.numLights < MAX_LIGHTS_PER_TILE; light++)
+      {
+         if (!LightReachesTile(lights[light], tile)) continue;
+
+         float depth = lights[light].position[2];
+         if (header.numLights == 0 || depth - radius < header.minDepth) header.minDepth = depth - radius;
+         if (header.numLights == 0 || depth + radius > header.maxDepth) header.maxDepth = depth + radius;
+         (*pIndices)[tile * MAX_LIGHTS_PER_TILE + header.numLights++] = light;
+      }
+   }
+}
+
+void BuildLightCountHistogram(const vector<LightGridTile> &tiles, unsigned int bucketSize,
+   vector<unsigned int> *pHistogram)
+{
+   pHistogram->clear();
+   for (size_t tile = 0; tile < tiles.size(); tile++)
+   {
+      unsigned int bucket = tiles[tile].numLights / bucketSize;
+      if (bucket >= pHistogram->size()) pHistogram->resize(bucket + 1, 0);
+      (*pHistogram)[bucket]++;
+   }
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <vector>
+
+#include "ShaderDefines.h"
+
+// Layout of the light buffer BlurCS.hlsl fills, position is in light space
+// (shadow map UV and depth)
+struct VirtualPointLight
+{
+   float position[4];
+   float color[4];
+};
+
+// Header of one light grid tile. The depth bounds cover every listed
+// light's reach, an empty tile has minDepth > maxDepth.
+struct LightGridTile
+{
+   unsigned int numLights;
+   float minDepth;
+   float maxDepth;
+   unsigned int padding;
+};
+
+const unsigned int NUM_LIGHT_TILES = LIGHT_GRID_WIDTH * LIGHT_GRID_HEIGHT;
+
+// Tile a light space position falls in, positions outside the shadow map
+// belong to the closest edge tile
+unsigned int GetLightTile(float u, float v);
+
+// UV rectangle of a tile as minU, minV, maxU, maxV. Edge tiles extend
+// outwards without limit so they match GetLightTile.
+void GetLightTileBounds(unsigned int tile, float bounds[4]);
+
+bool LightReachesTile(const VirtualPointLight &light, unsigned int tile);
+
+// CPU version of LightBinCS.hlsl. Tile t's lights are listed at
+// t * MAX_LIGHTS_PER_TILE in pIndices, in light order. The GPU's atomics may
+// order a tile's list differently.
+void BinLightsReference(const std::vector<VirtualPointLight> &lights, std::vector<LightGridTile> *pTiles,
+   std::vector<unsigned int> *pIndices);
+
+// Number of tiles per light count, bucket i counts the tiles with
+// i * bucketSize up to (i + 1) * bucketSize - 1 lights
+void BuildLightCountHistogram(const std::vector<LightGridTile> &tiles, unsigned int bucketSize,
+   std::vector<unsigned int> *pHistogram);
@@ -5,4 +5,9 @@ class Material
 public:
    ID3D11Buffer* m_materialConstantBuffer;
    ID3D11ShaderResourceView *m_texture;
+
+   // MATERIAL_FLAG_* of ShaderDefines.h, the opacity map (map_d) is NULL
+   // unless MATERIAL_FLAG_OPACITY_MAP is set
+   UINT m_flags;
+   ID3D11ShaderResourceView *m_opacityTexture;
 };
\ No newline at end of file
@@ -0,0 +1,128 @@
+#include "MeshInstancing.h"
+
+#include <cstring>
+
+using std::vector;
+
+namespace
+{
+   const unsigned long long FNV_OFFSET = 14695981039346656037ULL;
+   const unsigned long long FNV_PRIME = 1099511628211ULL;
+
+   unsigned long long HashBytes(unsigned long long hash, const void *pData, unsigned int size)
+   {
+      const unsigned char *pBytes = (const unsigned char *)pData;
+      for (unsigned int i = 0; i < size; i++)
+      {
+         hash = (hash ^ pBytes[i]) * FNV_PRIME;
+      }
+      return hash;
+   }
+}
+
+unsigned long long HashMesh(const void *pVertices, unsigned int vertexBytes, const unsigned int *pIndices,
+   unsigned int numIndices, unsigned int material)
+{
+   unsigned long long hash = FNV_OFFSET;
+   hash = HashBytes(hash, &material, sizeof(material));
+   hash = HashBytes(hash, &vertexBytes, sizeof(vertexBytes));
+   hash = HashBytes(hash, &numIndices, sizeof(numIndices));
+   hash = HashBytes(hash, pVertices, vertexBytes);
+   hash = HashBytes(hash, pIndices, numIndices * sizeof(unsigned int));
+   return hash;
+}
+
+MeshDeduplicator::MeshDeduplicator() : m_numSourceMeshes(0)
+{
+}
+
+unsigned int MeshDeduplicator::Add(const void *pVertices, unsigned int vertexBytes, const unsigned int *pIndices,
+   unsigned int numIndices, unsigned int material, bool *pIsNew)
+{
+   m_numSourceMeshes++;
+   unsigned long long hash = HashMesh(pVertices, vertexBytes, pIndices, numIndices, material);
+
+   for (unsigned int i = 0; i < m_meshes.size(); i++)
+   {
+      const UniqueMesh &mesh = m_meshes[i];
+      if (mesh.hash != hash || mesh.material != material) continue;
+      if (mesh.vertices.size() != vertexBytes || mesh.indices.size() != numIndices) continue;
+
+      if ((vertexBytes == 0 || memcmp(&mesh.vertices[0], pVertices, vertexBytes) == 0) &&
+         (numIndices == 0 || memcmp(&mesh.indices[0], pIndices, numIndices * sizeof(unsigned int)) == 0))
+      {
+         *pIsNew = false;
+         return i;
+      }
+   }
+
+   UniqueMesh mesh;
+   mesh.hash = hash;
+   mesh.material = material;
+   mesh.vertices.assign((const unsigned char *)pVertices, (const unsigned char *)pVertices + vertexBytes);
+   mesh.indices.assign(pIndices, pIndices + numIndices);
+   m_meshes.push_back(mesh);
+
+   *pIsNew = true;
+   return (unsigned int)(m_meshes.size() - 1);
+}
+
+void BuildInstanceBatches(const vector<MeshInstance> &instances, vector<InstanceTransform> *pTransforms,
+   vector<InstanceBatch> *pBatches)
+{
+   unsigned int numMeshes = 0;
+   for (size_t i = 0; i < instances.size(); i++)
+   {
+      if (instances[i].mesh + 1 > numMeshes) numMeshes = instances[i].mesh + 1;
+   }
+
+   // Counting sort, the batches come out in mesh order
+   vector<unsigned int> counts(numMeshes, 0);
+   for (size_t i = 0; i < instances.size(); i++)
+   {
+      counts[instances[i].mesh]++;
+   }
+
+   pBatches->clear();
+   vector<unsigned int> offsets(numMeshes, 0);
+   unsigned int offset = 0;
+   for (unsigned int mesh = 0; mesh < numMeshes; mesh++)
+   {
+      offsets[mesh] = offset;
+      if (counts[mesh] > 0)
+      {
+         InstanceBatch batch = { mesh, offset, counts[mesh] };
+         pBatches->push_back(batch);
+      }
+      offset += counts[mesh];
+   }
+
+   pTransforms->resize(instances.size());
+   for (size_t i = 0; i < instances.size(); i++)
+   {
+      (*pTransforms)[offsets[instances[i].mesh]++] = instances[i].world;
+   }
+}
+
+InstancingStats GetInstancingStats(const MeshDeduplicator &meshes, const vector<MeshInstance> &instances)
+{
+   InstancingStats stats;
+   stats.numSourceMeshes = meshes.GetNumSourceMeshes();
+   stats.numUniqueMeshes = meshes.GetNumUniqueMeshes();
+   stats.numInstances = (unsigned int)instances.size();
+   stats.pretransformedVertexBytes = 0;
+   stats.instancedVertexBytes = instances.size() * sizeof(InstanceTransform);
+
+   vector<bool> counted(meshes.GetNumUniqueMeshes(), false);
+   for (size_t i = 0; i < instances.size(); i++)
+   {
+      unsigned int mesh = instances[i].mesh;
+      stats.pretransformedVertexBytes += meshes.GetVertexBytes(mesh);
+      if (!counted[mesh])
+      {
+         stats.instancedVertexBytes += meshes.GetVertexBytes(mesh);
+         counted[mesh] = true;
+      }
+   }
+   return stats;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <vector>
+
+// Row major world matrix of one instance, stored the way the vertex shader
+// reads it from the per-instance stream
+struct InstanceTransform
+{
+   float m[16];
+};
+
+struct MeshInstance
+{
+   unsigned int mesh;
+   InstanceTransform world;
+};
+
+// Instances of one mesh, contiguous in the sorted transform stream
+struct InstanceBatch
+{
+   unsigned int mesh;
+   unsigned int firstInstance;
+   unsigned int numInstances;
+};
+
+struct InstancingStats
+{
+   unsigned int numSourceMeshes;
+   unsigned int numUniqueMeshes;
+   unsigned int numInstances;
+
+   // What pre-transforming every instance into its own vertex data costs
+   unsigned long long pretransformedVertexBytes;
+
+   // Vertex data of the unique meshes plus the transform stream
+   unsigned long long instancedVertexBytes;
+};
+
+// Content hash of a mesh, meshes with different materials never match
+unsigned long long HashMesh(const void *pVertices, unsigned int vertexBytes, const unsigned int *pIndices,
+   unsigned int numIndices, unsigned int material);
+
+// Collapses meshes with identical vertices, indices and material. Hash
+// matches are confirmed by comparing the data so a collision can not merge
+// two different meshes.
+class MeshDeduplicator
+{
+public:
+   MeshDeduplicator();
+
+   // Returns the unique mesh the data maps to and whether it was seen for
+   // the first time. The data is copied for later comparisons.
+   unsigned int Add(const void *pVertices, unsigned int vertexBytes, const unsigned int *pIndices,
+      unsigned int numIndices, unsigned int material, bool *pIsNew);
+
+   unsigned int GetNumSourceMeshes() const { return m_numSourceMeshes; }
+   unsigned int GetNumUniqueMeshes() const { return (unsigned int)m_meshes.size(); }
+   unsigned int GetVertexBytes(unsigned int mesh) const { return (unsigned int)m_meshes[mesh].vertices.size(); }
+
+private:
+   struct UniqueMesh
+   {
+      unsigned long long hash;
+      unsigned int material;
+      std::vector<unsigned char> vertices;
+      std::vector<unsigned int> indices;
+   };
+
+   std::vector<UniqueMesh> m_meshes;
+   unsigned int m_numSourceMeshes;
+};
+
+// Sorts the instances by mesh, stable so instances keep their scene order
+// within a batch, and emits one batch per mesh
+void BuildInstanceBatches(const std::vector<MeshInstance> &instances, std::vector<InstanceTransform> *pTransforms,
+   std::vector<InstanceBatch> *pBatches);
+
+InstancingStats GetInstancingStats(const MeshDeduplicator &meshes, const std::vector<MeshInstance> &instances);
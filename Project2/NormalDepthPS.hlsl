@@ -0,0 +1,37 @@
+#include "ShaderDefines.h"
+
+struct PixelShaderInput
+{
+  float4 pos : SV_POSITION;
+  float3 worldPos : POSITIONT;
+  float2 tex0 : TEXCOORD0;
+  float4 norm : NORMAL0;
+  float4 lPos : TEXCOORD1;
+};
+
+// Must match SsaoConstants in Ssao.h, only the view matrix is used here
+cbuffer SsaoConstants : register(b4)
+{
+   float4x4 ssaoReprojection;
+   float4x4 ssaoView;
+   float2 tanHalfFov;
+   float projScale;
+   float radius;
+   float intensity;
+   float bias;
+   float historyWeight;
+   float depthTolerance;
+   uint2 fullSize;
+   uint2 halfSize;
+   uint numSamples;
+   uint frameIndex;
+};
+
+// View space normal and depth of the main view for SsaoCS.hlsl, the
+// target is cleared to 0 so w is 0 where nothing was drawn
+float4 main( PixelShaderInput input ) : SV_TARGET
+{
+    float3 viewNorm = normalize(mul(ssaoView, float4(normalize(input.norm.xyz), 0.0)).xyz);
+    float viewZ = mul(ssaoView, float4(input.worldPos, 1.0)).z;
+    return float4(viewNorm, viewZ);
+}
@@ -0,0 +1,76 @@
+#include "NullCommandBackend.h"
+
+#include <cstring>
+
+NullCommandBackend::NullCommandBackend()
+{
+   ResetStats();
+}
+
+void NullCommandBackend::ResetStats()
+{
+   memset(&m_stats, 0, sizeof(m_stats));
+   memset(m_shaders, 0, sizeof(m_shaders));
+   m_inputLayout = NULL_HANDLE;
+   m_rasterState = NULL_HANDLE;
+   m_vertexBuffer = NULL_HANDLE;
+   m_indexBuffer = NULL_HANDLE;
+}
+
+void NullCommandBackend::TrackBind(ResourceHandle *pBound, ResourceHandle handle)
+{
+   if (*pBound == handle) m_stats.redundantBinds++;
+   *pBound = handle;
+}
+
+void NullCommandBackend::Execute(const CommandBuffer &buffer)
+{
+   const std::vector<Command> &commands = buffer.GetCommands();
+   for (size_t i = 0; i < commands.size(); i++)
+   {
+      const Command &cmd = commands[i];
+      m_stats.commandCounts[cmd.type]++;
+
+      switch (cmd.type)
+      {
+      case CMD_BIND_SHADER:
+         TrackBind(&m_shaders[cmd.stage], cmd.args[0]);
+         break;
+      case CMD_BIND_INPUT_LAYOUT:
+         TrackBind(&m_inputLayout, cmd.args[0]);
+         break;
+      case CMD_BIND_RASTER_STATE:
+         TrackBind(&m_rasterState, cmd.args[0]);
+         break;
+      case CMD_BIND_VERTEX_BUFFER:
+         TrackBind(&m_vertexBuffer, cmd.args[0]);
+         break;
+      case CMD_BIND_INDEX_BUFFER:
+         TrackBind(&m_indexBuffer, cmd.args[0]);
+         break;
+      case CMD_UPDATE_BUFFER:
+         m_stats.bytesUploaded += cmd.args[2];
+         break;
+      case CMD_DRAW:
+         m_stats.numDraws++;
+         break;
+      case CMD_DRAW_INDEXED:
+         m_stats.numDraws++;
+         m_stats.numIndices += cmd.args[0];
+         break;
+      case CMD_DRAW_INDEXED_INSTANCED:
+         m_stats.numDraws++;
+         m_stats.numIndices += (unsigned long long)cmd.args[0] * cmd.args[1];
+         break;
+      case CMD_DRAW_INDEXED_INSTANCED_INDIRECT:
+         // The index count is only known on the GPU
+         m_stats.numDraws++;
+         break;
+      case CMD_DISPATCH:
+         m_stats.numThreadGroups += (unsigned long long)cmd.args[0] * cmd.args[1] * cmd.args[2];
+         break;
+      default:
+         break;
+      }
+   }
+}
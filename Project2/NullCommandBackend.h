@@ -0,0 +1,39 @@
+#pragma once
+
+#include "CommandBuffer.h"
+
+struct CommandStats
+{
+   unsigned int commandCounts[NUM_COMMAND_TYPES];
+   unsigned int numDraws;
+   unsigned long long numIndices;
+   unsigned long long numThreadGroups;
+   unsigned long long bytesUploaded;
+
+   // Binds that set the same object that was already bound
+   unsigned int redundantBinds;
+};
+
+// Backend that walks the command stream without a device, tracking the
+// bound state so frame preparation can be profiled headless.
+class NullCommandBackend
+{
+public:
+   NullCommandBackend();
+
+   void Execute(const CommandBuffer &buffer);
+
+   const CommandStats &GetStats() const { return m_stats; }
+   void ResetStats();
+
+private:
+   void TrackBind(ResourceHandle *pBound, ResourceHandle handle);
+
+   CommandStats m_stats;
+
+   ResourceHandle m_shaders[NUM_SHADER_STAGES];
+   ResourceHandle m_inputLayout;
+   ResourceHandle m_rasterState;
+   ResourceHandle m_vertexBuffer;
+   ResourceHandle m_indexBuffer;
+};
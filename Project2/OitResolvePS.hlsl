@@ -0,0 +1,49 @@
+#include "ShaderDefines.h"
+
+// Blends each pixel's transparent fragments over the opaque color, drawn
+// with PlaneVertexShader.hlsl's full screen triangle. The blend state adds
+// the returned color to the target scaled by the returned alpha, the
+// transmittance of all fragments. Same as ABuffer::Resolve in ABuffer.h.
+
+// Must match OitNode in ABuffer.h
+struct OitNode
+{
+   uint color;
+   float depth;
+   uint next;
+};
+
+Texture2D<uint> m_oitHeads : register(t0);
+StructuredBuffer<OitNode> m_oitNodes : register(t1);
+
+float4 unpackColor( uint packed )
+{
+   return float4(packed & 0xff, (packed >> 8) & 0xff, (packed >> 16) & 0xff, packed >> 24) / 255.0;
+}
+
+float4 main( float4 pos : SV_POSITION ) : SV_TARGET
+{
+   // The nearest fragments sorted front to back, a nearer one pushes the
+   // farthest out once the list is full
+   OitNode nearest[MAX_OIT_FRAGMENTS_PER_PIXEL];
+   uint numNearest = 0;
+   for (uint node = m_oitHeads[uint2(pos.xy)]; node != 0; node = m_oitNodes[node - 1].next)
+   {
+      OitNode fragment = m_oitNodes[node - 1];
+      if (numNearest == MAX_OIT_FRAGMENTS_PER_PIXEL && fragment.depth >= nearest[numNearest - 1].depth) continue;
+
+      uint i = numNearest < MAX_OIT_FRAGMENTS_PER_PIXEL ? numNearest++ : numNearest - 1;
+      for (; i > 0 && nearest[i - 1].depth > fragment.depth; i--) nearest[i] = nearest[i - 1];
+      nearest[i] = fragment;
+   }
+
+   float3 color = float3(0, 0, 0);
+   float transmittance = 1.0;
+   for (uint j = numNearest; j > 0; j--)
+   {
+      float4 fragmentColor = unpackColor(nearest[j - 1].color);
+      color = lerp(color, fragmentColor.rgb, fragmentColor.a);
+      transmittance *= 1.0 - fragmentColor.a;
+   }
+   return float4(color, transmittance);
+}
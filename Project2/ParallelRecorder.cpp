@@ -0,0 +1,206 @@
+#include "ParallelRecorder.h"
+
+#include <algorithm>
+#include <cassert>
+
+using std::vector;
+
+vector<DrawChunk> PartitionDraws(const vector<unsigned int> &drawCosts, unsigned int numChunks)
+{
+   vector<DrawChunk> chunks;
+   unsigned int numDraws = (unsigned int)drawCosts.size();
+   if (numDraws == 0 || numChunks == 0) return chunks;
+
+   numChunks = std::min(numChunks, numDraws);
+
+   unsigned long long totalCost = 0;
+   for (unsigned int i = 0; i < numDraws; i++)
+   {
+      // Zero cost draws still cost a state change on the CPU
+      totalCost += std::max(drawCosts[i], 1u);
+   }
+
+   DrawChunk chunk = { 0, 0 };
+   unsigned long long accumulated = 0;
+   for (unsigned int i = 0; i < numDraws; i++)
+   {
+      accumulated += std::max(drawCosts[i], 1u);
+      chunk.numDraws++;
+
+      unsigned int chunksLeft = numChunks - (unsigned int)chunks.size() - 1;
+      unsigned int drawsLeft = numDraws - i - 1;
+      unsigned long long target = totalCost * (chunks.size() + 1) / numChunks;
+
+      // Close the chunk once it reaches its share of the cost, but never leave
+      // fewer draws than there are chunks left to fill
+      if (chunksLeft > 0 && (accumulated >= target || drawsLeft == chunksLeft))
+      {
+         chunks.push_back(chunk);
+         chunk.firstDraw = i + 1;
+         chunk.numDraws = 0;
+      }
+   }
+   chunks.push_back(chunk);
+
+   assert(chunks.size() == numChunks);
+   return chunks;
+}
+
+void RecordingChunkRecorder::RecordChunk(unsigned int worker, unsigned int pass, const DrawChunk &chunk)
+{
+   Event e = { false, worker, pass, chunk };
+   std::lock_guard<std::mutex> lock(m_mutex);
+   m_events.push_back(e);
+}
+
+void RecordingChunkRecorder::ExecuteChunk(unsigned int worker, unsigned int pass)
+{
+   std::lock_guard<std::mutex> lock(m_mutex);
+
+   // Look up which draws this worker recorded for the pass
+   DrawChunk chunk = { 0, 0 };
+   for (size_t i = 0; i < m_events.size(); i++)
+   {
+      if (!m_events[i].executed && m_events[i].worker == worker && m_events[i].pass == pass)
+      {
+         chunk = m_events[i].chunk;
+      }
+   }
+
+   Event e = { true, worker, pass, chunk };
+   m_events.push_back(e);
+}
+
+bool RecordingChunkRecorder::Validate(unsigned int numPasses, unsigned int numDraws) const
+{
+   std::lock_guard<std::mutex> lock(m_mutex);
+
+   for (unsigned int pass = 0; pass < numPasses; pass++)
+   {
+      vector<unsigned int> recordCount(numDraws, 0);
+      vector<unsigned int> executeOrder;
+      for (size_t i = 0; i < m_events.size(); i++)
+      {
+         const Event &e = m_events[i];
+         if (e.pass != pass) continue;
+
+         if (e.executed)
+         {
+            executeOrder.push_back(e.chunk.firstDraw);
+            continue;
+         }
+
+         if (e.chunk.firstDraw + e.chunk.numDraws > numDraws) return false;
+         for (unsigned int draw = 0; draw < e.chunk.numDraws; draw++)
+         {
+            recordCount[e.chunk.firstDraw + draw]++;
+         }
+      }
+
+      for (unsigned int draw = 0; draw < numDraws; draw++)
+      {
+         if (recordCount[draw] != 1) return false;
+      }
+
+      if (!std::is_sorted(executeOrder.begin(), executeOrder.end())) return false;
+   }
+
+   // Passes have to be executed one after another
+   unsigned int lastPass = 0;
+   for (size_t i = 0; i < m_events.size(); i++)
+   {
+      if (!m_events[i].executed) continue;
+      if (m_events[i].pass < lastPass) return false;
+      lastPass = m_events[i].pass;
+   }
+   return true;
+}
+
+ParallelRecorder::ParallelRecorder(unsigned int numWorkers) :
+   m_numWorkers(std::max(numWorkers, 1u)), m_generation(0), m_pendingWorkers(0), m_shutdown(false),
+   m_pRecorder(NULL), m_numPasses(0)
+{
+   for (unsigned int worker = 1; worker < m_numWorkers; worker++)
+   {
+      m_threads.push_back(std::thread(&ParallelRecorder::WorkerMain, this, worker));
+   }
+}
+
+ParallelRecorder::~ParallelRecorder()
+{
+   {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_shutdown = true;
+   }
+   m_workReady.notify_all();
+
+   for (size_t i = 0; i < m_threads.size(); i++)
+   {
+      m_threads[i].join();
+   }
+}
+
+void ParallelRecorder::WorkerMain(unsigned int worker)
+{
+   unsigned int seenGeneration = 0;
+   for (;;)
+   {
+      {
+         std::unique_lock<std::mutex> lock(m_mutex);
+         while (!m_shutdown && m_generation == seenGeneration)
+         {
+            m_workReady.wait(lock);
+         }
+         if (m_shutdown) return;
+         seenGeneration = m_generation;
+      }
+
+      RecordWorker(worker);
+
+      {
+         std::lock_guard<std::mutex> lock(m_mutex);
+         m_pendingWorkers--;
+      }
+      m_workDone.notify_one();
+   }
+}
+
+void ParallelRecorder::RecordWorker(unsigned int worker)
+{
+   if (worker >= m_chunks.size()) return;
+
+   for (unsigned int pass = 0; pass < m_numPasses; pass++)
+   {
+      m_pRecorder->RecordChunk(worker, pass, m_chunks[worker]);
+   }
+}
+
+void ParallelRecorder::Record(IChunkRecorder *pRecorder, unsigned int numPasses, const vector<unsigned int> &drawCosts)
+{
+   m_chunks = PartitionDraws(drawCosts, m_numWorkers);
+   m_pRecorder = pRecorder;
+   m_numPasses = numPasses;
+
+   {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_pendingWorkers = (unsigned int)m_threads.size();
+      m_generation++;
+   }
+   m_workReady.notify_all();
+
+   RecordWorker(0);
+
+   std::unique_lock<std::mutex> lock(m_mutex);
+   while (m_pendingWorkers > 0)
+   {
+      m_workDone.wait(lock);
+   }
+}
+
+void ParallelRecorder::ExecutePass(IChunkRecorder *pRecorder, unsigned int pass) const
+{
+   for (unsigned int worker = 0; worker < m_chunks.size(); worker++)
+   {
+      pRecorder->ExecuteChunk(worker, pass);
+   }
+}
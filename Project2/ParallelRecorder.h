@@ -0,0 +1,96 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A contiguous range of draws in a pass that is recorded by one worker
+struct DrawChunk
+{
+   unsigned int firstDraw;
+   unsigned int numDraws;
+};
+
+// Splits the draws into at most numChunks contiguous ranges with roughly
+// equal total cost (e.g. index count). Draw order is preserved so executing
+// the chunks in order matches a single threaded submission.
+std::vector<DrawChunk> PartitionDraws(const std::vector<unsigned int> &drawCosts, unsigned int numChunks);
+
+// Backend that turns chunks of draws into API command lists. RecordChunk is
+// called concurrently from worker threads (one chunk per worker and pass),
+// ExecuteChunk is called from the submitting thread in pass order.
+class IChunkRecorder
+{
+public:
+   virtual ~IChunkRecorder() {}
+
+   virtual void RecordChunk(unsigned int worker, unsigned int pass, const DrawChunk &chunk) = 0;
+   virtual void ExecuteChunk(unsigned int worker, unsigned int pass) = 0;
+};
+
+// Stub backend that only logs the calls made to it, used to validate the
+// partitioning and ordering without a device.
+class RecordingChunkRecorder : public IChunkRecorder
+{
+public:
+   struct Event
+   {
+      bool executed;
+      unsigned int worker;
+      unsigned int pass;
+      DrawChunk chunk;
+   };
+
+   void RecordChunk(unsigned int worker, unsigned int pass, const DrawChunk &chunk);
+   void ExecuteChunk(unsigned int worker, unsigned int pass);
+
+   // Checks that every pass recorded each of numDraws draws exactly once and
+   // that chunks were executed in pass then draw order.
+   bool Validate(unsigned int numPasses, unsigned int numDraws) const;
+
+   const std::vector<Event> &GetEvents() const { return m_events; }
+   void Clear() { m_events.clear(); }
+
+private:
+   std::vector<Event> m_events;
+   mutable std::mutex m_mutex;
+};
+
+// Records the passes of a frame on a fixed set of workers. The calling
+// thread acts as worker 0 so numWorkers - 1 threads are spawned.
+class ParallelRecorder
+{
+public:
+   explicit ParallelRecorder(unsigned int numWorkers);
+   ~ParallelRecorder();
+
+   unsigned int GetNumWorkers() const { return m_numWorkers; }
+
+   // Partitions the draws across the workers and records every pass. Returns
+   // once all workers have finished recording.
+   void Record(IChunkRecorder *pRecorder, unsigned int numPasses, const std::vector<unsigned int> &drawCosts);
+
+   // Executes the chunks recorded for a pass in draw order
+   void ExecutePass(IChunkRecorder *pRecorder, unsigned int pass) const;
+
+   const std::vector<DrawChunk> &GetChunks() const { return m_chunks; }
+
+private:
+   void WorkerMain(unsigned int worker);
+   void RecordWorker(unsigned int worker);
+
+   unsigned int m_numWorkers;
+   std::vector<std::thread> m_threads;
+
+   std::mutex m_mutex;
+   std::condition_variable m_workReady;
+   std::condition_variable m_workDone;
+   unsigned int m_generation;
+   unsigned int m_pendingWorkers;
+   bool m_shutdown;
+
+   IChunkRecorder *m_pRecorder;
+   unsigned int m_numPasses;
+   std::vector<DrawChunk> m_chunks;
+};
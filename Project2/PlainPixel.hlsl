@@ -1,18 +1,83 @@
+#include "ShaderDefines.h"
+
 struct PointLight
 {
    float4 pos;
    float4 col;
 };
 
+struct ClusterLight
+{
+   float3 position;
+   float range;
+   float3 color;
+   float spotCosOuter;
+   float3 direction;
+   float spotCosInner;
+};
+
+struct ClusterHeader
+{
+   uint offset;
+   uint numLights;
+};
+
+// Must match OitNode in ABuffer.h
+struct OitNode
+{
+   uint color;
+   float depth;
+   uint next;
+};
+
+struct LightTile
+{
+   uint numLights;
+   float minDepth;
+   float maxDepth;
+   uint padding;
+};
+
 Texture2D m_colorMap : register(t0);
-Texture2D m_shadowMap : register(t1);
+// Depth of the directional light's cascades side by side
+Texture2D<float> m_shadowMap : register(t1);
 StructuredBuffer<PointLight> m_lightBuffer : register(t2);
+StructuredBuffer<LightTile> m_lightTiles : register(t3);
+StructuredBuffer<uint> m_lightIndices : register(t4);
+
+// Clustered point and spot lights, in view space
+StructuredBuffer<ClusterLight> m_clusterLights : register(t5);
+StructuredBuffer<ClusterHeader> m_clusters : register(t6);
+StructuredBuffer<uint> m_clusterLightIndices : register(t7);
+
+// EVSM moments of the cascades, laid out like m_shadowMap with mips
+Texture2D<float4> m_shadowMoments : register(t8);
+
+// Screen space ambient occlusion of the main view, 1 is unoccluded
+Texture2D<float> m_ambientOcclusion : register(t9);
+
+// Opacity map (map_d) of materials with MATERIAL_FLAG_OPACITY_MAP, only
+// bound by the transparent passes
+Texture2D<float> m_opacityMap : register(t10);
 
-RWTexture3D<float4> m_colorBuffer : register(u3);
-RWTexture2D<uint> m_colorBufferCounter : register(u4);
+// VPL light of the main view upsampled from the coarse pixels, only bound
+// for texMainCoarseVpl
+Texture2D<float4> m_indirectLight : register(t11);
+
+// Baked irradiance probes, IRRADIANCE_PROBE_VECTORS float4s each. Same
+// layout as PackIrradianceProbes in IrradianceProbes.h.
+StructuredBuffer<float4> m_irradianceProbes : register(t12);
+
+// Per-pixel lists of the transparent fragments, the head holds the index
+// + 1 of the pixel's latest node. Nodes are taken from the count in order.
+// The weighted pass only adds to the count, so the two can be compared.
+RWStructuredBuffer<OitNode> m_oitNodes : register(u3);
+RWTexture2D<uint> m_oitHeads : register(u4);
+RWStructuredBuffer<uint> m_oitNodeCount : register(u5);
 
 SamplerState m_colorSampler : register(s0);
-SamplerState m_shadowSampler : register(s1);
+SamplerComparisonState m_shadowSampler : register(s1);
+SamplerState m_momentsSampler : register(s2);
 
 
 struct PixelShaderInput
@@ -30,6 +95,8 @@ cbuffer Material : register(b0)
    float4 diffuse;
    float4 specular;
    float shininess;
+   float opacity;
+   uint materialFlags;
 };
 
 cbuffer Lights : register(b1)
@@ -38,12 +105,42 @@ cbuffer Lights : register(b1)
    float4x4 lightMvp;
 };
 
-#define MAX_LIGHT_RADIUS 0.2
-#define MAX_DEPTH 8
+cbuffer ClusterConstants : register(b2)
+{
+   float4x4 clusterView;
+   float4 clusterProjection; // tanHalfFovX, tanHalfFovY, near, far
+   float2 clusterScreenSize;
+   float clusterLogDepthScale;
+   uint numClusterLights;
+};
+
+// Must match CascadeConstants in ShadowCascades.h
+cbuffer CascadeConstants : register(b3)
+{
+   float4x4 cascadeViewProj[NUM_SHADOW_CASCADES];
+   float4 cascadeSplits; // view space far depth of each cascade
+   float4 cascadeDepthBias;
+   uint pcfTapsSqrt;
+   uint shadowFilter;    // SHADOW_FILTER_PCF or SHADOW_FILTER_EVSM
+   float2 evsmExponents; // positive, negative
+   float lightBleedReduction;
+   float varianceBias;
+   float cascadeSize;    // side of each cascade in the atlas, in texels
+};
+
+// Must match IrradianceProbeConstants in IrradianceProbes.h
+cbuffer IrradianceProbeConstants : register(b5)
+{
+   float3 probeGridMin;
+   uint probesEnabled;
+   float3 probeGridInvSpacing; // probes per world unit
+   float probePadding0;
+   uint3 probeGridDims;
+   float probePadding1;
+};
+
 // TODO: Pass in via constant buffer
 #define LIGHT_POWER 0.5
-#define SHADOW_SAMPLES_SQRT 3
-#define SHADOW_SAMPLES (SHADOW_SAMPLES_SQRT * SHADOW_SAMPLES_SQRT)
 
 
 float3 phong( float3 norm, float3 eye, float3 lightDir, float3 lightColor, float3 amb, float3 dif, float3 spec, float shininess)
@@ -60,6 +157,112 @@ float3 phong( float3 norm, float3 eye, float3 lightDir, float3 lightColor, float
     return color * lightColor;
 }
 
+// Chebyshev's upper bound on the fraction of the moments' distribution at
+// or past value
+float chebyshevUpperBound( float2 moments, float value, float minVariance )
+{
+    float variance = max(moments.y - moments.x * moments.x, minVariance);
+    float distance = value - moments.x;
+    return value <= moments.x ? 1.0 : variance / (variance + distance * distance);
+}
+
+// Lit fraction of a receiver at depth from prefiltered EVSM moments, the
+// tighter of both warps' bounds. Same as EvsmVisibility in Evsm.h.
+float evsmVisibility( float4 moments, float depth )
+{
+    float warpedDepth = 2.0 * depth - 1.0;
+    float2 warped = float2(exp(evsmExponents.x * warpedDepth), -exp(-evsmExponents.y * warpedDepth));
+    float2 depthScale = varianceBias * evsmExponents * warped;
+    float2 minVariance = depthScale * depthScale;
+    float visibility = min(chebyshevUpperBound(moments.xy, warped.x, minVariance.x),
+                           chebyshevUpperBound(moments.zw, warped.y, minVariance.y));
+    return saturate((visibility - lightBleedReduction) / (1.0 - lightBleedReduction));
+}
+
+// Lit fraction of the pixel, 1 past the last cascade. pcfTapsSqrt squared
+// bilinear comparisons two texels apart, equally weighted, filter a square
+// twice as wide with soft edges. Same as FilterShadowPcf in ShadowFilter.h.
+// EVSM takes a single trilinear fetch of the moments instead.
+float shadowFactor( float3 worldPos )
+{
+    // Before any branch, the mip is picked from the gradients
+    float3 worldPosDx = ddx(worldPos);
+    float3 worldPosDy = ddy(worldPos);
+
+    float viewZ = mul(clusterView, float4(worldPos, 1.0)).z;
+    uint cascade = uint(dot(float4(viewZ > cascadeSplits), float4(1, 1, 1, 1)));
+    if (cascade >= NUM_SHADOW_CASCADES) return 1.0;
+
+    float4 lightPos = mul(cascadeViewProj[cascade], float4(worldPos, 1.0));
+    float2 uv = lightPos.xy * float2(0.5, -0.5) + 0.5;
+    float2 texel = uv * cascadeSize;
+    float depth = lightPos.z - cascadeDepthBias[cascade];
+
+    float2 atlasScale = 1.0 / float2(cascadeSize * NUM_SHADOW_CASCADES, cascadeSize);
+
+    if (shadowFilter == SHADOW_FILTER_EVSM)
+    {
+        // Gradients through this cascade's projection, so pixels next to a
+        // cascade border do not drop to the lowest mip
+        float2 gradScale = float2(0.5, -0.5) * cascadeSize * atlasScale;
+        float2 gradX = mul(cascadeViewProj[cascade], float4(worldPosDx, 0.0)).xy * gradScale;
+        float2 gradY = mul(cascadeViewProj[cascade], float4(worldPosDy, 0.0)).xy * gradScale;
+
+        float2 tap = clamp(texel, 0.5, cascadeSize - 0.5);
+        tap.x += cascade * cascadeSize;
+        float4 moments = m_shadowMoments.SampleGrad(m_momentsSampler, tap * atlasScale, gradX, gradY);
+        return evsmVisibility(moments, lightPos.z);
+    }
+
+    float start = 1.0 - float(pcfTapsSqrt);
+    float lit = 0.0;
+    for (uint y = 0; y < pcfTapsSqrt; y++)
+    {
+      for (uint x = 0; x < pcfTapsSqrt; x++)
+      {
+         // Clamped so the taps never reach into the next cascade
+         float2 tap = clamp(texel + float2(start + 2.0 * x, start + 2.0 * y), 0.5, cascadeSize - 0.5);
+         tap.x += cascade * cascadeSize;
+         lit += m_shadowMap.SampleCmpLevelZero(m_shadowSampler, tap * atlasScale, depth);
+      }
+    }
+    return lit / float(pcfTapsSqrt * pcfTapsSqrt);
+}
+
+// Diffuse light of the point and spot lights in the pixel's cluster
+float3 clusteredLights( float2 screenPos, float3 worldPos, float3 norm, float3 dif )
+{
+    float3 viewPos = mul(clusterView, float4(worldPos, 1.0)).xyz;
+    float3 viewNorm = normalize(mul(clusterView, float4(norm, 0.0)).xyz);
+
+    uint3 cell;
+    cell.xy = min(uint2(screenPos / clusterScreenSize * float2(CLUSTER_GRID_X, CLUSTER_GRID_Y)),
+                  uint2(CLUSTER_GRID_X - 1, CLUSTER_GRID_Y - 1));
+    cell.z = viewPos.z > clusterProjection.z ?
+             min(uint(log(viewPos.z / clusterProjection.z) * clusterLogDepthScale), CLUSTER_GRID_Z - 1) : 0;
+    ClusterHeader cluster = m_clusters[(cell.z * CLUSTER_GRID_Y + cell.y) * CLUSTER_GRID_X + cell.x];
+
+    float3 color = float3(0, 0, 0);
+    for (uint i = 0; i < cluster.numLights; i++)
+    {
+       ClusterLight light = m_clusterLights[m_clusterLightIndices[cluster.offset + i]];
+       float3 toLight = light.position - viewPos;
+       float dist = length(toLight);
+       if (dist < light.range)
+       {
+          float3 l = toLight / dist;
+          float attenuation = 1.0 - dist / light.range;
+          attenuation *= attenuation;
+          if (light.spotCosOuter > -1.0)
+          {
+             attenuation *= smoothstep(light.spotCosOuter, light.spotCosInner, dot(-l, light.direction));
+          }
+          color += dif * saturate(dot(viewNorm, l)) * light.color * attenuation;
+       }
+    }
+    return color;
+}
+
 float4 main( PixelShaderInput input ) : SV_TARGET
 {
     float3 n = normalize(input.norm.xyz);
@@ -72,67 +275,214 @@ float4 main( PixelShaderInput input ) : SV_TARGET
     float3 lightClr = float3(1, 1, 1);
 
     float3 color = phong(n, e, lightDir, lightClr, amb, dif, spec, shininess);
+    color += clusteredLights(input.pos.xy, input.worldPos, n, dif);
  
     return float4(color, 1.0f);
 }
 
-float4 texMain( PixelShaderInput input ) : SV_TARGET
+// VPL light at the pixel's light space position. Only the VPLs
+// LightBinCS.hlsl found in its light grid tile can reach it.
+float3 vplLights( float4 lPos )
+{
+    lPos.xyz /= lPos.w;
+    lPos.x = lPos.x / 2.0 + 0.5;
+    lPos.y = lPos.y / -2.0 + 0.5;
+
+    int2 cell = clamp(int2(floor(lPos.xy * float2(LIGHT_GRID_WIDTH, LIGHT_GRID_HEIGHT))),
+                      int2(0, 0), int2(LIGHT_GRID_WIDTH - 1, LIGHT_GRID_HEIGHT - 1));
+    uint tile = cell.y * LIGHT_GRID_WIDTH + cell.x;
+    LightTile lightTile = m_lightTiles[tile];
+
+    float3 color = float3(0, 0, 0);
+    if (lPos.z >= lightTile.minDepth && lPos.z <= lightTile.maxDepth)
+    {
+       for(uint i = 0; i < lightTile.numLights; i++)
+       {
+          uint light = m_lightIndices[tile * MAX_LIGHTS_PER_TILE + i];
+          float dist = distance(lPos.xyz,  m_lightBuffer[light].pos.xyz);
+          if ( dist < MAX_LIGHT_RADIUS )
+          {
+             float lightFactor = (MAX_LIGHT_RADIUS - dist) / MAX_LIGHT_RADIUS;
+             color += lightFactor * lightFactor * lightFactor * m_lightBuffer[light].col.xyz;
+          }
+       }
+    }
+    return color;
+}
+
+// Light a white diffuse surface reflects from the eight probes around the
+// position, positions outside the grid take the nearest probes. Same as
+// SampleIrradianceProbes in IrradianceProbes.h.
+float3 probeIrradiance( float3 worldPos, float3 n )
+{
+    float3 cell = clamp((worldPos - probeGridMin) * probeGridInvSpacing, 0.0, float3(probeGridDims - 1));
+    uint3 base = min(uint3(cell), probeGridDims - 2);
+    float3 t = cell - float3(base);
+
+    float4 coefficients[IRRADIANCE_PROBE_VECTORS];
+    [unroll]
+    for (uint v = 0; v < IRRADIANCE_PROBE_VECTORS; v++) coefficients[v] = float4(0, 0, 0, 0);
+
+    [unroll]
+    for (uint corner = 0; corner < 8; corner++)
+    {
+        uint3 offset = uint3(corner, corner >> 1, corner >> 2) & 1;
+        float3 weights = lerp(1.0 - t, t, float3(offset));
+        uint3 coords = base + offset;
+        uint probe = (coords.z * probeGridDims.y + coords.y) * probeGridDims.x + coords.x;
+        [unroll]
+        for (uint v = 0; v < IRRADIANCE_PROBE_VECTORS; v++)
+        {
+            coefficients[v] += m_irradianceProbes[probe * IRRADIANCE_PROBE_VECTORS + v] * weights.x * weights.y * weights.z;
+        }
+    }
+
+    float basis[IRRADIANCE_SH_COEFFICIENTS] =
+    {
+        0.282095,
+        0.488603 * n.y, 0.488603 * n.z, 0.488603 * n.x,
+        1.092548 * n.x * n.y, 1.092548 * n.y * n.z, 0.315392 * (3.0 * n.z * n.z - 1.0),
+        1.092548 * n.x * n.z, 0.546274 * (n.x * n.x - n.y * n.y)
+    };
+
+    float3 color = float3(0, 0, 0);
+    [unroll]
+    for (uint k = 0; k < IRRADIANCE_SH_COEFFICIENTS; k++)
+    {
+        float3 coefficient = float3(coefficients[(k * 3) / 4][(k * 3) % 4],
+                                    coefficients[(k * 3 + 1) / 4][(k * 3 + 1) % 4],
+                                    coefficients[(k * 3 + 2) / 4][(k * 3 + 2) % 4]);
+        color += coefficient * basis[k];
+    }
+    return max(color, 0.0);
+}
+
+// The pixel's VPL light, or the baked probes' light reflected by its
+// albedo where the probes replace the VPLs
+float3 indirectLight( PixelShaderInput input )
+{
+    if (probesEnabled)
+    {
+        float3 dif = m_colorMap.Sample(m_colorSampler, input.tex0).xyz;
+        return dif * probeIrradiance(input.worldPos, normalize(input.norm.xyz));
+    }
+    return vplLights(input.lPos);
+}
+
+// texMain's shading given the pixel's VPL light
+float4 texShade( PixelShaderInput input, float3 indirect )
 {
     float3 n = normalize(input.norm.xyz);
     float3 e = -normalize(input.pos.xyz);
-    float3 color = float3(0, 0, 0);
     float3 lightClr = float3(1, 1, 1);
 
     float4 texColor = m_colorMap.Sample(m_colorSampler, input.tex0);
     float3 dif = texColor.xyz;
     float3 spec = specular.xyz;
     float3 amb = dif.xyz * .2f;
-    
-
-    float depthValue = 1.0;
-    input.lPos.xyz /= input.lPos.w;
-    input.lPos.x = input.lPos.x / 2.0 + 0.5;
-    input.lPos.y = input.lPos.y / -2.0 + 0.5;
-    
-    for(int light = 0; light < 32 * 24; light++)
-    {
-       float dist = distance(input.lPos.xyz,  m_lightBuffer[light].pos.xyz);
-       if ( dist < MAX_LIGHT_RADIUS )
-       {
-          float lightFactor = (MAX_LIGHT_RADIUS - dist) / MAX_LIGHT_RADIUS;
-          color += lightFactor * lightFactor * lightFactor * m_lightBuffer[light].col;// phong(n, e, pointLightDir, m_lightBuffer[light].col, amb, dif, spec, shininess);
-       }
-    }
 
+    // Occlusion only darkens the indirect and ambient light
+    float ao = m_ambientOcclusion[uint2(input.pos.xy)];
+    float3 color = indirect * ao;
 
-    int samplesShadowed = 0;
-    for (int x = -(SHADOW_SAMPLES_SQRT / 2); x < SHADOW_SAMPLES_SQRT / 2 + 1; x++)
-    {
-      for (int y = -(SHADOW_SAMPLES_SQRT / 2); y < SHADOW_SAMPLES_SQRT / 2 + 1; y++)
-      {
-         float3 dx = float3( float(x) / 2048.0, float(y) / (2 * 768.0), 0.0);
-         float3 samplePt = input.lPos.xyz + dx;
-
-         // TODO: Replace this with a sampler
-         if (samplePt.x > 0 && samplePt.x < 1 && samplePt.y > 0 && samplePt.y < 1
-            && samplePt.z > 0.1 && samplePt.z < 1)
-         {
-            depthValue = m_shadowMap.Sample(m_colorSampler, samplePt.xy).r;
-            if ( input.lPos.z - 0.000001 > depthValue )
-            {
-              samplesShadowed++;
-            }
-         }
-      }
-    }
+    color += clusteredLights(input.pos.xy, input.worldPos, n, dif);
 
-    if (samplesShadowed < SHADOW_SAMPLES)
+    float lit = shadowFactor(input.worldPos);
+
+    if (lit > 0.0)
     {
-       float shadowFactor = float(samplesShadowed) / float(SHADOW_SAMPLES);
-       color += lerp(phong(n, e, lightDir, lightClr, amb, dif, spec, shininess), amb, shadowFactor);
+       color += lerp(amb * ao, phong(n, e, lightDir, lightClr, amb, dif, spec, shininess), lit);
     }
 
     return float4(color, 1.0f);
+}
 
+float4 texMain( PixelShaderInput input ) : SV_TARGET
+{
+    return texShade(input, indirectLight(input));
+}
+
+// The VPL light was shaded per block of pixels and upsampled by
+// VplShadingCS.hlsl, the direct light and shadows stay per pixel
+float4 texMainCoarseVpl( PixelShaderInput input ) : SV_TARGET
+{
+    return texShade(input, m_indirectLight[uint2(input.pos.xy)].rgb);
+}
+
+
+// Opacity of the material at the texture coordinate
+float materialAlpha( float2 tex0 )
+{
+    float alpha = opacity;
+    if (materialFlags & MATERIAL_FLAG_ALPHA_TEXTURE) alpha *= m_colorMap.Sample(m_colorSampler, tex0).a;
+    if (materialFlags & MATERIAL_FLAG_OPACITY_MAP) alpha *= m_opacityMap.Sample(m_colorSampler, tex0);
+    return alpha;
+}
+
+// Links the fragment in front of its pixel's list. Fragments past the
+// node buffer's end are dropped, the count keeps growing so the renderer
+// can size the buffer to it.
+void appendOitFragment( float4 pos, float4 color )
+{
+    uint numNodes, stride;
+    m_oitNodes.GetDimensions(numNodes, stride);
+
+    uint node;
+    InterlockedAdd(m_oitNodeCount[0], 1, node);
+    if (node >= numNodes) return;
+
+    uint4 bytes = uint4(saturate(color) * 255.0 + 0.5);
+    OitNode fragment;
+    fragment.color = bytes.x | (bytes.y << 8) | (bytes.z << 16) | (bytes.w << 24);
+    fragment.depth = pos.z;
+    InterlockedExchange(m_oitHeads[uint2(pos.xy)], node + 1, fragment.next);
+    m_oitNodes[node] = fragment;
+}
+
+// The transparent pass shades like the main pass and stores the result
+// instead, the depth test against the opaque surfaces runs first so hidden
+// fragments never take a node
+[earlydepthstencil]
+void oitMain( PixelShaderInput input )
+{
+    appendOitFragment(input.pos, float4(main(input).rgb, materialAlpha(input.tex0)));
 }
 
+[earlydepthstencil]
+void oitTexMain( PixelShaderInput input )
+{
+    appendOitFragment(input.pos, float4(texMain(input).rgb, materialAlpha(input.tex0)));
+}
+
+struct WeightedOitOutput
+{
+    float4 accumulation : SV_TARGET0;
+    float revealage : SV_TARGET1;
+};
+
+// The accumulation target adds the weighted color and weight, the
+// revealage target is multiplied by 1 - alpha
+WeightedOitOutput weightedOitFragment( float4 pos, float4 color )
+{
+    InterlockedAdd(m_oitNodeCount[0], 1);
+
+    float farness = 1.0 - pos.z;
+    float weight = color.a * clamp(WBOIT_WEIGHT_SCALE * farness * farness * farness, WBOIT_MIN_WEIGHT, WBOIT_WEIGHT_SCALE);
+
+    WeightedOitOutput output;
+    output.accumulation = float4(color.rgb, 1.0) * weight;
+    output.revealage = color.a;
+    return output;
+}
+
+[earlydepthstencil]
+WeightedOitOutput weightedOitMain( PixelShaderInput input )
+{
+    return weightedOitFragment(input.pos, float4(main(input).rgb, materialAlpha(input.tex0)));
+}
+
+[earlydepthstencil]
+WeightedOitOutput weightedOitTexMain( PixelShaderInput input )
+{
+    return weightedOitFragment(input.pos, float4(texMain(input).rgb, materialAlpha(input.tex0)));
+}
@@ -3,6 +3,12 @@ struct VertexShaderInput
   float4 pos : POSITION;
   float2 tex0 : TEXCOORD0;
   float4 norm : NORMAL0;
+
+  // Per-instance world transform
+  float4 world0 : WORLD0;
+  float4 world1 : WORLD1;
+  float4 world2 : WORLD2;
+  float4 world3 : WORLD3;
 };
 
 cbuffer ConstBuffer
@@ -26,14 +32,35 @@ struct PixelShaderInput
   float4 lPos : TEXCOORD1;
 };
 
+// Shared with the depth pre-pass, whose depths the main pass tests for
+// EQUAL. precise keeps the compiler from computing them differently.
+float4 clipPosition( VertexShaderInput input, out float4 worldPos )
+{
+    float4x4 world = float4x4(input.world0, input.world1, input.world2, input.world3);
+    worldPos = mul(input.pos, world);
+
+    precise float4 pos = mul(mvpMat, worldPos);
+    return pos;
+}
+
 PixelShaderInput main( VertexShaderInput input )
 {
     PixelShaderInput output;
-    output.pos = mul(mvpMat, input.pos);
-    output.worldPos = input.pos.xyz;
-    output.norm = input.norm;
-    output.lPos = mul(lightMvp, input.pos);
+    float4x4 world = float4x4(input.world0, input.world1, input.world2, input.world3);
+    float4 worldPos;
+
+    output.pos = clipPosition(input, worldPos);
+    output.worldPos = worldPos.xyz;
+    output.norm = float4(normalize(mul(input.norm, world).xyz), 0.0f);
+    output.lPos = mul(lightMvp, worldPos);
     output.tex0 = input.tex0;
 
     return output;
-}
\ No newline at end of file
+}
+
+// Position only path of the depth pre-pass
+float4 depthOnly( VertexShaderInput input ) : SV_POSITION
+{
+    float4 worldPos;
+    return clipPosition(input, worldPos);
+}
@@ -0,0 +1,32 @@
+// Command line irradiance probe baker for machines without a GPU, e.g. a
+// Linux build box. Only the portable probe code is needed:
+//
+//    g++ -std=c++11 -O2 -pthread ProbeBaker.cpp IrradianceProbes.cpp -o probebaker
+//    ./probebaker scene.obj [output] [probes per axis] [samples per probe] [bounces] [threads]
+//
+// The Windows build leaves this file out, the demo bakes with -bakeprobes.
+
+#include <cstdlib>
+#include <iostream>
+
+#include "IrradianceProbes.h"
+
+int main(int argc, char **argv)
+{
+   if (argc < 2)
+   {
+      std::cerr << "usage: " << argv[0]
+                << " scene.obj [output] [probes per axis] [samples per probe] [bounces] [threads]\n";
+      return 1;
+   }
+
+   ProbeBakeSettings settings;
+   GetDefaultProbeBakeSettings(&settings);
+   const char *pOutPath = argc > 2 ? argv[2] : IRRADIANCE_PROBE_FILE;
+   if (argc > 3) settings.maxProbesPerAxis = (unsigned int)atoi(argv[3]);
+   if (argc > 4) settings.samplesPerProbe = (unsigned int)atoi(argv[4]);
+   if (argc > 5) settings.maxBounces = (unsigned int)atoi(argv[5]);
+   if (argc > 6) settings.numThreads = (unsigned int)atoi(argv[6]);
+
+   return BakeIrradianceProbeFile(argv[1], pOutPath, settings, std::cout) ? 0 : 1;
+}
@@ -5,10 +5,13 @@
 #include <DxErr.h>
 #include <cassert>
 
+// mipLevels other than 1 make the surface mipmapped, 0 for the full chain.
+// The UAV writes the top mip, the SRV covers every mip and GenerateMips
+// fills the rest.
 class RWComputeSurface
 {
 public:
-   RWComputeSurface(ID3D11Device *pDevice, UINT width, UINT height)
+   RWComputeSurface(ID3D11Device *pDevice, UINT width, UINT height, UINT mipLevels = 1)
    {
       D3D11_TEXTURE2D_DESC texDesc;
       texDesc.ArraySize = 1;
@@ -16,8 +19,13 @@ public:
       texDesc.CPUAccessFlags = 0;
       texDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
       texDesc.Height = height;
-      texDesc.MipLevels = 1;
+      texDesc.MipLevels = mipLevels;
       texDesc.MiscFlags = 0;
+      if (mipLevels != 1)
+      {
+         texDesc.BindFlags |= D3D11_BIND_RENDER_TARGET;
+         texDesc.MiscFlags = D3D11_RESOURCE_MISC_GENERATE_MIPS;
+      }
       texDesc.SampleDesc.Count = 1;
       texDesc.SampleDesc.Quality = 0;
       texDesc.Usage = D3D11_USAGE_DEFAULT;
@@ -28,7 +36,7 @@ public:
 
       D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
       srvDesc.Format = texDesc.Format;
-      srvDesc.Texture2D.MipLevels = 1;
+      srvDesc.Texture2D.MipLevels = (UINT)-1;
       srvDesc.Texture2D.MostDetailedMip = 0;
       srvDesc.ViewDimension = D3D_SRV_DIMENSION_TEXTURE2D;
 
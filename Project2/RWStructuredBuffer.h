@@ -5,11 +5,14 @@
 #include <DxErr.h>
 #include <cassert>
 
+// Structured buffer readable through an SRV and writable through a UAV, the
+// UAV is an append buffer unless other flags are given
 template<typename Data>
 class RWStructuredBuffer
 {
 public:
-   RWStructuredBuffer(ID3D11Device *pDevice, UINT maxElements)
+   RWStructuredBuffer(ID3D11Device *pDevice, UINT maxElements, const Data *pInitialData = NULL,
+      UINT uavFlags = D3D11_BUFFER_UAV_FLAG_APPEND)
    {
       D3D11_BUFFER_DESC bufDesc;
       
@@ -21,14 +24,18 @@ public:
       bufDesc.StructureByteStride = sizeof(Data);
       bufDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
 
-      pDevice->CreateBuffer(&bufDesc, NULL, &pResource);
+      D3D11_SUBRESOURCE_DATA initialData;
+      memset(&initialData, 0, sizeof(initialData));
+      initialData.pSysMem = pInitialData;
+
+      pDevice->CreateBuffer(&bufDesc, pInitialData ? &initialData : NULL, &pResource);
 
       D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc;
       memset(&uavDesc, 0, sizeof(uavDesc));
       uavDesc.Format = DXGI_FORMAT_UNKNOWN;
       uavDesc.Buffer.FirstElement = 0;
       uavDesc.Buffer.NumElements = maxElements;
-      uavDesc.Buffer.Flags = D3D11_BUFFER_UAV_FLAG_APPEND;
+      uavDesc.Buffer.Flags = uavFlags;
       uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
       
       // TODO: Check the results and error handle
@@ -50,6 +57,11 @@ public:
       pSrv->Release();
    }
 
+   ID3D11Buffer *GetBuffer()
+   {
+      return pResource;
+   }
+
    ID3D11ShaderResourceView *GetShaderResourceView()
    {
       return pSrv;
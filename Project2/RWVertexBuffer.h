@@ -0,0 +1,53 @@
+#pragma once
+
+#include <d3d11.h>
+#include <d3dx11.h>
+#include <DxErr.h>
+#include <cassert>
+
+// Vertex buffer a compute shader writes through a float4 typed UAV, Vertex
+// has to be a multiple of 16 bytes
+template<typename Vertex>
+class RWVertexBuffer
+{
+public:
+   RWVertexBuffer(ID3D11Device *pDevice, UINT maxVertices)
+   {
+      D3D11_BUFFER_DESC bufDesc;
+      memset(&bufDesc, 0, sizeof(bufDesc));
+      bufDesc.Usage = D3D11_USAGE_DEFAULT;
+      bufDesc.ByteWidth = sizeof(Vertex) * maxVertices;
+      bufDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER | D3D11_BIND_UNORDERED_ACCESS;
+
+      HRESULT result = pDevice->CreateBuffer(&bufDesc, NULL, &m_pBuffer);
+      assert(result == S_OK);
+
+      D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc;
+      memset(&uavDesc, 0, sizeof(uavDesc));
+      uavDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+      uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+      uavDesc.Buffer.NumElements = sizeof(Vertex) * maxVertices / 16;
+      result = pDevice->CreateUnorderedAccessView(m_pBuffer, &uavDesc, &m_pUav);
+      assert(result == S_OK);
+   }
+
+   ~RWVertexBuffer()
+   {
+      m_pUav->Release();
+      m_pBuffer->Release();
+   }
+
+   ID3D11Buffer *GetBuffer() const
+   {
+      return m_pBuffer;
+   }
+
+   ID3D11UnorderedAccessView *GetUnorderedAccessView() const
+   {
+      return m_pUav;
+   }
+
+private:
+   ID3D11Buffer *m_pBuffer;
+   ID3D11UnorderedAccessView *m_pUav;
+};
@@ -0,0 +1,888 @@
+#include "RenderGraph.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <sstream>
+
+using std::string;
+using std::vector;
+
+namespace
+{
+   const char *STAGE_NAMES[NUM_SHADER_STAGES] = { "vs", "ps", "cs" };
+
+   bool SameDesc(const RenderGraphTextureDesc &a, const RenderGraphTextureDesc &b)
+   {
+      return a.width == b.width && a.height == b.height && a.depth == b.depth && a.format == b.format;
+   }
+
+   // Tiled texture being placed in the tile pool, in tiles
+   struct TileBlock
+   {
+      unsigned int texture;
+      unsigned int offset;
+      unsigned int size;
+      unsigned int first;
+      unsigned int last;
+   };
+
+   // Collects the handles bound to a contiguous range of slots
+   struct SlotRange
+   {
+      unsigned int first;
+      vector<ResourceHandle> handles;
+      vector<unsigned int> counts;
+      bool resetsCounter;
+
+      SlotRange() : first(0), resetsCounter(false) {}
+
+      void Set(unsigned int slot, ResourceHandle handle, bool resetCounter)
+      {
+         if (handles.empty())
+         {
+            first = slot;
+         }
+         else if (slot < first)
+         {
+            handles.insert(handles.begin(), first - slot, NULL_HANDLE);
+            counts.insert(counts.begin(), first - slot, (unsigned int)-1);
+            first = slot;
+         }
+
+         unsigned int index = slot - first;
+         if (index >= handles.size())
+         {
+            handles.resize(index + 1, NULL_HANDLE);
+            counts.resize(index + 1, (unsigned int)-1);
+         }
+         handles[index] = handle;
+         counts[index] = resetCounter ? 0 : (unsigned int)-1;
+         resetsCounter = resetsCounter || resetCounter;
+      }
+
+      unsigned int Count() const { return (unsigned int)handles.size(); }
+   };
+}
+
+unsigned int GetFormatSize(RenderGraphFormat format)
+{
+   switch (format)
+   {
+   case GRAPH_FORMAT_RGBA32_FLOAT: return 16;
+   case GRAPH_FORMAT_RGBA8_UNORM: return 4;
+   case GRAPH_FORMAT_R32_FLOAT: return 4;
+   case GRAPH_FORMAT_R32_UINT: return 4;
+   case GRAPH_FORMAT_DEPTH32: return 4;
+   case GRAPH_FORMAT_RGBA16_FLOAT: return 8;
+   case GRAPH_FORMAT_R8_UNORM: return 1;
+   case GRAPH_FORMAT_RG16_FLOAT: return 4;
+   default: assert(false); return 0;
+   }
+}
+
+unsigned long long GetTextureSize(const RenderGraphTextureDesc &desc)
+{
+   return (unsigned long long)desc.width * desc.height * desc.depth * GetFormatSize(desc.format);
+}
+
+unsigned int GetTextureTileCount(const RenderGraphTextureDesc &desc)
+{
+   assert(desc.depth == 1);
+
+   unsigned int tileWidth = 64, tileHeight = 64;
+   switch (GetFormatSize(desc.format))
+   {
+   case 1: tileWidth = 256; tileHeight = 256; break;
+   case 2: tileWidth = 256; tileHeight = 128; break;
+   case 4: tileWidth = 128; tileHeight = 128; break;
+   case 8: tileWidth = 128; tileHeight = 64; break;
+   }
+   return ((desc.width + tileWidth - 1) / tileWidth) * ((desc.height + tileHeight - 1) / tileHeight);
+}
+
+RenderGraph::RenderGraph() : m_tiledTransients(false), m_compiled(false)
+{
+   memset(&m_memoryStats, 0, sizeof(m_memoryStats));
+}
+
+void RenderGraph::Reset()
+{
+   m_passes.clear();
+   m_resources.clear();
+   m_schedule.clear();
+   m_physicalTextures.clear();
+   memset(&m_memoryStats, 0, sizeof(m_memoryStats));
+   m_compiled = false;
+}
+
+RenderGraphResource RenderGraph::ImportResource(const char *name, const RenderGraphViews &views)
+{
+   Resource resource;
+   resource.name = name;
+   resource.views = views;
+   resource.transient = false;
+   memset(&resource.desc, 0, sizeof(resource.desc));
+   resource.clear = GRAPH_CLEAR_NONE;
+   memset(resource.clearValues, 0, sizeof(resource.clearValues));
+   resource.output = false;
+   resource.persistent = false;
+   resource.clearPass = 0;
+   resource.physicalTexture = (unsigned int)-1;
+   m_resources.push_back(resource);
+
+   m_compiled = false;
+   return (RenderGraphResource)(m_resources.size() - 1);
+}
+
+RenderGraphResource RenderGraph::CreateTexture(const char *name, const RenderGraphTextureDesc &desc)
+{
+   RenderGraphViews noViews = { NULL_HANDLE, NULL_HANDLE, NULL_HANDLE, NULL_HANDLE };
+   RenderGraphResource resource = ImportResource(name, noViews);
+   m_resources[resource].transient = true;
+   m_resources[resource].desc = desc;
+   return resource;
+}
+
+void RenderGraph::SetPersistent(RenderGraphResource resource)
+{
+   assert(m_resources[resource].transient);
+   m_resources[resource].persistent = true;
+   m_compiled = false;
+}
+
+void RenderGraph::SetTiledTransients(bool tiled)
+{
+   m_tiledTransients = tiled;
+   m_compiled = false;
+}
+
+void RenderGraph::SetClear(RenderGraphResource resource, RenderGraphClear clear, const float values[4])
+{
+   m_resources[resource].clear = clear;
+   memcpy(m_resources[resource].clearValues, values, sizeof(m_resources[resource].clearValues));
+}
+
+void RenderGraph::MarkOutput(RenderGraphResource resource)
+{
+   m_resources[resource].output = true;
+   m_compiled = false;
+}
+
+RenderGraphPass RenderGraph::AddPass(const char *name)
+{
+   Pass pass;
+   pass.name = name;
+   pass.mode = GRAPH_PASS_RUN;
+   pass.active = false;
+   m_passes.push_back(pass);
+
+   m_compiled = false;
+   return (RenderGraphPass)(m_passes.size() - 1);
+}
+
+void RenderGraph::SetPassCallback(RenderGraphPass pass, const ExecuteCallback &callback)
+{
+   m_passes[pass].callback = callback;
+}
+
+void RenderGraph::AddAccess(RenderGraphPass pass, RenderGraphResource resource, AccessType type, ShaderStage stage,
+   unsigned int slot, bool resetCounter)
+{
+   assert(pass < m_passes.size() && resource < m_resources.size());
+
+   Access access;
+   access.resource = resource;
+   access.type = type;
+   access.stage = stage;
+   access.slot = slot;
+   access.resetCounter = resetCounter;
+   m_passes[pass].accesses.push_back(access);
+   m_compiled = false;
+}
+
+void RenderGraph::ReadTexture(RenderGraphPass pass, RenderGraphResource resource, ShaderStage stage, unsigned int slot)
+{
+   AddAccess(pass, resource, ACCESS_READ, stage, slot, false);
+}
+
+void RenderGraph::ReadInput(RenderGraphPass pass, RenderGraphResource resource)
+{
+   AddAccess(pass, resource, ACCESS_INPUT, STAGE_VERTEX, 0, false);
+}
+
+void RenderGraph::WriteRenderTarget(RenderGraphPass pass, RenderGraphResource resource, unsigned int slot)
+{
+   AddAccess(pass, resource, ACCESS_RENDER_TARGET, STAGE_PIXEL, slot, false);
+}
+
+void RenderGraph::WriteDepth(RenderGraphPass pass, RenderGraphResource resource)
+{
+   AddAccess(pass, resource, ACCESS_DEPTH, STAGE_PIXEL, 0, false);
+}
+
+void RenderGraph::WriteUav(RenderGraphPass pass, RenderGraphResource resource, ShaderStage stage, unsigned int slot,
+   bool resetCounter)
+{
+   assert(stage == STAGE_PIXEL || stage == STAGE_COMPUTE);
+   AddAccess(pass, resource, ACCESS_UAV, stage, slot, resetCounter);
+}
+
+void RenderGraph::WriteMips(RenderGraphPass pass, RenderGraphResource resource)
+{
+   AddAccess(pass, resource, ACCESS_MIPS, STAGE_PIXEL, 0, false);
+}
+
+void RenderGraph::SetPassMode(RenderGraphPass pass, RenderGraphPassMode mode)
+{
+   m_passes[pass].mode = mode;
+}
+
+bool RenderGraph::ValidatePassModes(string *pErrors) const
+{
+   // A pooled transient only holds what a pass wrote this frame, one whose
+   // writers are all skipped could be holding another transient's contents
+   vector<bool> used(m_resources.size(), false), written(m_resources.size(), false);
+   for (RenderGraphPass p = 0; p < m_passes.size(); p++)
+   {
+      if (!m_passes[p].active || m_passes[p].mode == GRAPH_PASS_SKIP) continue;
+
+      const vector<Access> &accesses = m_passes[p].accesses;
+      for (size_t a = 0; a < accesses.size(); a++)
+      {
+         used[accesses[a].resource] = true;
+         if (IsWrite(accesses[a].type)) written[accesses[a].resource] = true;
+      }
+   }
+
+   bool valid = true;
+   for (RenderGraphResource r = 0; r < m_resources.size(); r++)
+   {
+      const Resource &resource = m_resources[r];
+      if (!resource.transient || resource.persistent || !used[r] || written[r]) continue;
+
+      valid = false;
+      if (pErrors) *pErrors += resource.name + " is used this frame but every pass writing it is skipped\n";
+   }
+   return valid;
+}
+
+bool RenderGraph::Writes(const Pass &pass, RenderGraphResource resource) const
+{
+   for (size_t i = 0; i < pass.accesses.size(); i++)
+   {
+      if (pass.accesses[i].resource == resource && IsWrite(pass.accesses[i].type)) return true;
+   }
+   return false;
+}
+
+bool RenderGraph::Compile(string *pErrors)
+{
+   std::ostringstream errors;
+   unsigned int numPasses = (unsigned int)m_passes.size();
+
+   // Writers of a resource run in declaration order, readers see the result
+   // of every writer
+   vector<vector<RenderGraphPass> > dependencies(numPasses);
+   for (RenderGraphResource r = 0; r < m_resources.size(); r++)
+   {
+      vector<RenderGraphPass> writers;
+      for (RenderGraphPass p = 0; p < numPasses; p++)
+      {
+         if (Writes(m_passes[p], r))
+         {
+            if (!writers.empty()) dependencies[p].push_back(writers.back());
+            writers.push_back(p);
+         }
+      }
+
+      for (RenderGraphPass p = 0; p < numPasses; p++)
+      {
+         const Pass &pass = m_passes[p];
+         if (Writes(pass, r)) continue;
+
+         for (size_t a = 0; a < pass.accesses.size(); a++)
+         {
+            if (pass.accesses[a].resource == r)
+            {
+               dependencies[p].insert(dependencies[p].end(), writers.begin(), writers.end());
+               break;
+            }
+         }
+      }
+   }
+
+   // Everything reachable from a pass that writes an output survives
+   vector<RenderGraphPass> stack;
+   for (RenderGraphPass p = 0; p < numPasses; p++)
+   {
+      m_passes[p].active = false;
+      for (RenderGraphResource r = 0; r < m_resources.size(); r++)
+      {
+         if (m_resources[r].output && Writes(m_passes[p], r))
+         {
+            stack.push_back(p);
+            break;
+         }
+      }
+   }
+   while (!stack.empty())
+   {
+      RenderGraphPass p = stack.back();
+      stack.pop_back();
+      if (m_passes[p].active) continue;
+
+      m_passes[p].active = true;
+      stack.insert(stack.end(), dependencies[p].begin(), dependencies[p].end());
+   }
+
+   // Topological sort, ties are broken by declaration order so the schedule
+   // is stable from frame to frame
+   m_schedule.clear();
+   vector<bool> scheduled(numPasses, false);
+   bool progress = true;
+   while (progress)
+   {
+      progress = false;
+      for (RenderGraphPass p = 0; p < numPasses; p++)
+      {
+         if (!m_passes[p].active || scheduled[p]) continue;
+
+         bool ready = true;
+         for (size_t d = 0; d < dependencies[p].size(); d++)
+         {
+            if (!scheduled[dependencies[p][d]]) ready = false;
+         }
+
+         if (ready)
+         {
+            m_schedule.push_back(p);
+            scheduled[p] = true;
+            progress = true;
+            break;
+         }
+      }
+   }
+
+   bool success = true;
+   for (RenderGraphPass p = 0; p < numPasses; p++)
+   {
+      if (m_passes[p].active && !scheduled[p])
+      {
+         errors << "pass " << m_passes[p].name << " is part of a dependency cycle\n";
+         success = false;
+      }
+   }
+
+   vector<bool> written(m_resources.size(), false);
+   for (size_t s = 0; s < m_schedule.size(); s++)
+   {
+      const Pass &pass = m_passes[m_schedule[s]];
+      for (size_t a = 0; a < pass.accesses.size(); a++)
+      {
+         const Access &access = pass.accesses[a];
+         if (m_resources[access.resource].transient)
+         {
+            if (access.type == ACCESS_MIPS)
+            {
+               errors << "pass " << pass.name << " generates mips of the transient "
+                      << m_resources[access.resource].name << "\n";
+               success = false;
+            }
+
+            // Transients have no contents at the start of the frame
+            if (!IsWrite(access.type) && !written[access.resource] && !Writes(pass, access.resource))
+            {
+               errors << "pass " << pass.name << " reads " << m_resources[access.resource].name
+                      << " before any pass writes it\n";
+               success = false;
+            }
+            continue;
+         }
+
+         const RenderGraphViews &views = m_resources[access.resource].views;
+         ResourceHandle view = NULL_HANDLE;
+         switch (access.type)
+         {
+         case ACCESS_READ: view = views.srv; break;
+         case ACCESS_INPUT: continue;
+         case ACCESS_RENDER_TARGET: view = views.rtv; break;
+         case ACCESS_DEPTH: view = views.dsv; break;
+         case ACCESS_UAV: view = views.uav; break;
+         case ACCESS_MIPS: view = views.srv; break;
+         }
+
+         if (view == NULL_HANDLE)
+         {
+            errors << "pass " << pass.name << " uses " << m_resources[access.resource].name
+                   << " without a matching view\n";
+            success = false;
+         }
+      }
+
+      for (size_t a = 0; a < pass.accesses.size(); a++)
+      {
+         if (IsWrite(pass.accesses[a].type)) written[pass.accesses[a].resource] = true;
+      }
+   }
+
+   // The first scheduled writer clears the resource
+   for (RenderGraphResource r = 0; r < m_resources.size(); r++)
+   {
+      m_resources[r].clearPass = (RenderGraphPass)-1;
+      for (size_t s = 0; s < m_schedule.size(); s++)
+      {
+         if (Writes(m_passes[m_schedule[s]], r))
+         {
+            m_resources[r].clearPass = m_schedule[s];
+            break;
+         }
+      }
+   }
+
+   AllocateTransients();
+
+   if (pErrors) *pErrors = errors.str();
+   m_compiled = success;
+   return success;
+}
+
+void RenderGraph::AllocateTransients()
+{
+   m_physicalTextures.clear();
+   memset(&m_memoryStats, 0, sizeof(m_memoryStats));
+   for (size_t p = 0; p < m_passes.size(); p++) m_passes[p].tileBarriers.clear();
+
+   // Transients are assigned in the order they come alive so a texture can
+   // be handed on as soon as its previous user is done with it
+   vector<RenderGraphResource> order;
+   vector<unsigned int> firstUse(m_resources.size()), lastUse(m_resources.size());
+   for (RenderGraphResource r = 0; r < m_resources.size(); r++)
+   {
+      Resource &resource = m_resources[r];
+      resource.physicalTexture = (unsigned int)-1;
+      if (!resource.transient) continue;
+
+      m_memoryStats.numTransients++;
+      m_memoryStats.declaredBytes += GetTextureSize(resource.desc);
+      if (GetResourceLifetime(r, &firstUse[r], &lastUse[r]))
+      {
+         order.push_back(r);
+      }
+   }
+
+   for (size_t i = 1; i < order.size(); i++)
+   {
+      for (size_t j = i; j > 0 && firstUse[order[j]] < firstUse[order[j - 1]]; j--)
+      {
+         std::swap(order[j], order[j - 1]);
+      }
+   }
+
+   vector<TileBlock> tilePool;
+   for (size_t i = 0; i < order.size(); i++)
+   {
+      RenderGraphResource r = order[i];
+      Resource &resource = m_resources[r];
+
+      unsigned int bindFlags = 0;
+      for (size_t s = 0; s < m_schedule.size(); s++)
+      {
+         const Pass &pass = m_passes[m_schedule[s]];
+         for (size_t a = 0; a < pass.accesses.size(); a++)
+         {
+            if (pass.accesses[a].resource != r) continue;
+
+            switch (pass.accesses[a].type)
+            {
+            case ACCESS_READ: bindFlags |= GRAPH_BIND_SRV; break;
+            case ACCESS_INPUT: break;
+            case ACCESS_RENDER_TARGET: bindFlags |= GRAPH_BIND_RTV; break;
+            case ACCESS_DEPTH: bindFlags |= GRAPH_BIND_DSV; break;
+            case ACCESS_UAV: bindFlags |= GRAPH_BIND_UAV; break;
+            case ACCESS_MIPS: break;
+            }
+         }
+      }
+
+      bool tiled = m_tiledTransients && !resource.persistent && resource.desc.depth == 1 &&
+         !(bindFlags & GRAPH_BIND_DSV);
+      for (unsigned int p = 0; p < m_physicalTextures.size() && !resource.persistent && !tiled; p++)
+      {
+         PhysicalTexture &texture = m_physicalTextures[p];
+         if (texture.numTiles == 0 && texture.lastUse < firstUse[r] && SameDesc(texture.desc, resource.desc))
+         {
+            resource.physicalTexture = p;
+            texture.bindFlags |= bindFlags;
+            texture.lastUse = lastUse[r];
+            break;
+         }
+      }
+
+      if (resource.physicalTexture == (unsigned int)-1)
+      {
+         PhysicalTexture texture;
+         texture.desc = resource.desc;
+         texture.bindFlags = bindFlags;
+         memset(&texture.views, 0, sizeof(texture.views));
+         texture.firstTile = 0;
+         texture.numTiles = tiled ? GetTextureTileCount(resource.desc) : 0;
+         texture.lastUse = resource.persistent ? (unsigned int)-1 : lastUse[r];
+         resource.physicalTexture = (unsigned int)m_physicalTextures.size();
+         m_physicalTextures.push_back(texture);
+
+         if (tiled)
+         {
+            TileBlock block;
+            block.texture = resource.physicalTexture;
+            block.offset = 0;
+            block.size = texture.numTiles;
+            block.first = firstUse[r];
+            block.last = lastUse[r];
+            tilePool.push_back(block);
+         }
+         else
+         {
+            m_memoryStats.committedBytes += GetTextureSize(texture.desc);
+         }
+      }
+   }
+
+   // Largest first, each texture goes to the lowest tile that does not
+   // overlap a texture whose lifetime intersects its own
+   for (size_t i = 1; i < tilePool.size(); i++)
+   {
+      for (size_t j = i; j > 0 && tilePool[j].size > tilePool[j - 1].size; j--)
+      {
+         std::swap(tilePool[j], tilePool[j - 1]);
+      }
+   }
+
+   unsigned int numPoolTiles = 0;
+   for (size_t i = 0; i < tilePool.size(); i++)
+   {
+      TileBlock &block = tilePool[i];
+      bool placed = false;
+      while (!placed)
+      {
+         placed = true;
+         for (size_t b = 0; b < i; b++)
+         {
+            const TileBlock &other = tilePool[b];
+            bool liveTogether = other.first <= block.last && block.first <= other.last;
+            bool overlaps = other.offset < block.offset + block.size && block.offset < other.offset + other.size;
+            if (liveTogether && overlaps)
+            {
+               block.offset = other.offset + other.size;
+               placed = false;
+            }
+         }
+      }
+
+      m_physicalTextures[block.texture].firstTile = block.offset;
+      if (block.offset + block.size > numPoolTiles) numPoolTiles = block.offset + block.size;
+   }
+   m_memoryStats.tilePoolBytes = (unsigned long long)numPoolTiles * GRAPH_TILE_SIZE;
+
+   // A texture on tiles an earlier texture used has to wait for the earlier
+   // one's accesses to finish
+   for (size_t i = 0; i < tilePool.size(); i++)
+   {
+      const TileBlock &block = tilePool[i];
+      for (size_t b = 0; b < tilePool.size(); b++)
+      {
+         const TileBlock &other = tilePool[b];
+         bool overlaps = other.offset < block.offset + block.size && block.offset < other.offset + other.size;
+         if (overlaps && other.first < block.first)
+         {
+            m_passes[m_schedule[block.first]].tileBarriers.push_back(block.texture);
+            break;
+         }
+      }
+   }
+
+   m_memoryStats.numPhysicalTextures = (unsigned int)m_physicalTextures.size();
+}
+
+void RenderGraph::SetPhysicalTextureViews(unsigned int texture, const RenderGraphViews &views)
+{
+   m_physicalTextures[texture].views = views;
+}
+
+void RenderGraph::GetPhysicalTextureTiles(unsigned int texture, unsigned int *pFirstTile, unsigned int *pNumTiles) const
+{
+   *pFirstTile = m_physicalTextures[texture].firstTile;
+   *pNumTiles = m_physicalTextures[texture].numTiles;
+}
+
+const RenderGraphViews &RenderGraph::GetViews(RenderGraphResource resource) const
+{
+   const Resource &r = m_resources[resource];
+   if (r.transient)
+   {
+      assert(r.physicalTexture < m_physicalTextures.size());
+      return m_physicalTextures[r.physicalTexture].views;
+   }
+   return r.views;
+}
+
+bool RenderGraph::IsPassActive(RenderGraphPass pass) const
+{
+   return m_passes[pass].active;
+}
+
+bool RenderGraph::GetResourceLifetime(RenderGraphResource resource, unsigned int *pFirst, unsigned int *pLast) const
+{
+   bool used = false;
+   for (unsigned int s = 0; s < m_schedule.size(); s++)
+   {
+      const Pass &pass = m_passes[m_schedule[s]];
+      for (size_t a = 0; a < pass.accesses.size(); a++)
+      {
+         if (pass.accesses[a].resource != resource) continue;
+
+         if (!used) *pFirst = s;
+         *pLast = s;
+         used = true;
+         break;
+      }
+   }
+   return used;
+}
+
+void RenderGraph::RecordClears(RenderGraphPass pass, CommandBuffer *pCmds) const
+{
+   for (RenderGraphResource r = 0; r < m_resources.size(); r++)
+   {
+      const Resource &resource = m_resources[r];
+      if (resource.clearPass != pass) continue;
+
+      const RenderGraphViews &views = GetViews(r);
+      switch (resource.clear)
+      {
+      case GRAPH_CLEAR_RENDER_TARGET:
+         pCmds->ClearRenderTarget(views.rtv, resource.clearValues);
+         break;
+      case GRAPH_CLEAR_DEPTH:
+         pCmds->ClearDepth(views.dsv, resource.clearValues[0]);
+         break;
+      case GRAPH_CLEAR_UAV_FLOAT:
+         pCmds->ClearUavFloat(views.uav, resource.clearValues);
+         break;
+      case GRAPH_CLEAR_UAV_UINT:
+      {
+         unsigned int values[4];
+         for (unsigned int i = 0; i < 4; i++) values[i] = (unsigned int)resource.clearValues[i];
+         pCmds->ClearUavUint(views.uav, values);
+         break;
+      }
+      default:
+         break;
+      }
+   }
+}
+
+void RenderGraph::RecordBindings(RenderGraphPass p, CommandBuffer *pCmds) const
+{
+   const Pass &pass = m_passes[p];
+
+   SlotRange targets;
+   SlotRange pixelUavs;
+   SlotRange computeUavs;
+   SlotRange reads[NUM_SHADER_STAGES];
+   ResourceHandle depthView = NULL_HANDLE;
+   bool bindsOutputs = false;
+
+   for (size_t a = 0; a < pass.accesses.size(); a++)
+   {
+      const Access &access = pass.accesses[a];
+      const RenderGraphViews &views = GetViews(access.resource);
+      switch (access.type)
+      {
+      case ACCESS_READ:
+         reads[access.stage].Set(access.slot, views.srv, false);
+         break;
+      case ACCESS_INPUT:
+      case ACCESS_MIPS:
+         break;
+      case ACCESS_RENDER_TARGET:
+         // Render targets always start at slot 0
+         if (targets.handles.empty()) targets.Set(0, NULL_HANDLE, false);
+         targets.Set(access.slot, views.rtv, false);
+         bindsOutputs = true;
+         break;
+      case ACCESS_DEPTH:
+         depthView = views.dsv;
+         bindsOutputs = true;
+         break;
+      case ACCESS_UAV:
+         if (access.stage == STAGE_COMPUTE)
+         {
+            computeUavs.Set(access.slot, views.uav, access.resetCounter);
+         }
+         else
+         {
+            pixelUavs.Set(access.slot, views.uav, access.resetCounter);
+            bindsOutputs = true;
+         }
+         break;
+      }
+   }
+
+   if (bindsOutputs)
+   {
+      pCmds->BindOutputs(targets.Count(), targets.Count() ? &targets.handles[0] : NULL, depthView,
+         pixelUavs.first, pixelUavs.Count(), pixelUavs.Count() ? &pixelUavs.handles[0] : NULL);
+   }
+
+   if (computeUavs.Count() > 0)
+   {
+      pCmds->BindComputeUavs(computeUavs.first, computeUavs.Count(), &computeUavs.handles[0],
+         computeUavs.resetsCounter ? &computeUavs.counts[0] : NULL);
+   }
+
+   for (unsigned int stage = 0; stage < NUM_SHADER_STAGES; stage++)
+   {
+      if (reads[stage].Count() > 0)
+      {
+         pCmds->BindShaderResources((ShaderStage)stage, reads[stage].first, reads[stage].Count(), &reads[stage].handles[0]);
+      }
+   }
+}
+
+void RenderGraph::RecordUnbindings(RenderGraphPass p, CommandBuffer *pCmds) const
+{
+   const Pass &pass = m_passes[p];
+
+   SlotRange computeUavs;
+   SlotRange reads[NUM_SHADER_STAGES];
+   bool bindsOutputs = false;
+
+   for (size_t a = 0; a < pass.accesses.size(); a++)
+   {
+      const Access &access = pass.accesses[a];
+      if (access.type == ACCESS_READ)
+      {
+         reads[access.stage].Set(access.slot, NULL_HANDLE, false);
+      }
+      else if (access.type == ACCESS_UAV && access.stage == STAGE_COMPUTE)
+      {
+         computeUavs.Set(access.slot, NULL_HANDLE, false);
+      }
+      else if (access.type != ACCESS_INPUT && access.type != ACCESS_MIPS)
+      {
+         bindsOutputs = true;
+      }
+   }
+
+   // Unbind everything the pass bound so the next pass can use the
+   // resources through a different view
+   if (bindsOutputs)
+   {
+      pCmds->BindOutputs(0, NULL, NULL_HANDLE);
+   }
+
+   if (computeUavs.Count() > 0)
+   {
+      pCmds->BindComputeUavs(computeUavs.first, computeUavs.Count(), &computeUavs.handles[0], NULL);
+   }
+
+   for (unsigned int stage = 0; stage < NUM_SHADER_STAGES; stage++)
+   {
+      if (reads[stage].Count() > 0)
+      {
+         pCmds->BindShaderResources((ShaderStage)stage, reads[stage].first, reads[stage].Count(), &reads[stage].handles[0]);
+      }
+   }
+}
+
+void RenderGraph::Execute(CommandBuffer *pCmds) const
+{
+   assert(m_compiled);
+   assert(ValidatePassModes(NULL));
+
+   for (size_t s = 0; s < m_schedule.size(); s++)
+   {
+      RenderGraphPass p = m_schedule[s];
+
+      // Recorded for skipped passes too, a later pass may still write the
+      // texture this frame
+      for (size_t b = 0; b < m_passes[p].tileBarriers.size(); b++)
+      {
+         const RenderGraphViews &views = m_physicalTextures[m_passes[p].tileBarriers[b]].views;
+         pCmds->TiledResourceBarrier(views.rtv != NULL_HANDLE ? views.rtv : views.uav);
+      }
+
+      if (m_passes[p].mode == GRAPH_PASS_SKIP) continue;
+
+      if (m_passes[p].mode == GRAPH_PASS_RUN) RecordClears(p, pCmds);
+      RecordBindings(p, pCmds);
+      if (m_passes[p].callback)
+      {
+         m_passes[p].callback(pCmds);
+      }
+      RecordUnbindings(p, pCmds);
+   }
+}
+
+string RenderGraph::GetScheduleReport() const
+{
+   std::ostringstream report;
+   report << "RenderGraph: " << m_schedule.size() << " of " << m_passes.size() << " passes scheduled\n";
+
+   for (size_t s = 0; s < m_schedule.size(); s++)
+   {
+      const Pass &pass = m_passes[m_schedule[s]];
+      report << "  " << s << " " << pass.name << ":";
+
+      for (size_t a = 0; a < pass.accesses.size(); a++)
+      {
+         const Access &access = pass.accesses[a];
+         report << " " << m_resources[access.resource].name << "(";
+         switch (access.type)
+         {
+         case ACCESS_READ:
+            report << STAGE_NAMES[access.stage] << " t" << access.slot;
+            break;
+         case ACCESS_INPUT:
+            report << "input";
+            break;
+         case ACCESS_RENDER_TARGET:
+            report << "rt" << access.slot;
+            break;
+         case ACCESS_DEPTH:
+            report << "depth";
+            break;
+         case ACCESS_UAV:
+            report << STAGE_NAMES[access.stage] << " u" << access.slot;
+            break;
+         case ACCESS_MIPS:
+            report << "mips";
+            break;
+         }
+         if (m_resources[access.resource].clearPass == m_schedule[s] && m_resources[access.resource].clear != GRAPH_CLEAR_NONE)
+         {
+            report << " clear";
+         }
+         report << ")";
+      }
+      report << "\n";
+   }
+
+   bool anyCulled = false;
+   for (size_t p = 0; p < m_passes.size(); p++)
+   {
+      if (m_passes[p].active) continue;
+
+      report << (anyCulled ? ", " : "  culled: ") << m_passes[p].name;
+      anyCulled = true;
+   }
+   if (anyCulled) report << "\n";
+
+   const double MB = 1024.0 * 1024.0;
+   report << "  transients: " << m_memoryStats.numTransients << " in " << m_memoryStats.numPhysicalTextures
+          << " textures, declared " << m_memoryStats.declaredBytes / MB << " MB, committed "
+          << m_memoryStats.committedBytes / MB << " MB, tile pool " << m_memoryStats.tilePoolBytes / MB << " MB\n";
+
+   return report.str();
+}
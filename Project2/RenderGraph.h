@@ -0,0 +1,284 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "CommandBuffer.h"
+
+typedef unsigned int RenderGraphResource;
+typedef unsigned int RenderGraphPass;
+
+// Views a graph resource can be bound through, NULL_HANDLE where the
+// resource does not support the usage
+struct RenderGraphViews
+{
+   ResourceHandle srv;
+   ResourceHandle rtv;
+   ResourceHandle dsv;
+   ResourceHandle uav;
+};
+
+enum RenderGraphFormat
+{
+   GRAPH_FORMAT_RGBA32_FLOAT = 0,
+   GRAPH_FORMAT_RGBA8_UNORM,
+   GRAPH_FORMAT_R32_FLOAT,
+   GRAPH_FORMAT_R32_UINT,
+   GRAPH_FORMAT_DEPTH32,
+   GRAPH_FORMAT_RGBA16_FLOAT,
+   GRAPH_FORMAT_R8_UNORM,
+   GRAPH_FORMAT_RG16_FLOAT,
+   NUM_GRAPH_FORMATS
+};
+
+enum RenderGraphBindFlags
+{
+   GRAPH_BIND_SRV = 0x1,
+   GRAPH_BIND_RTV = 0x2,
+   GRAPH_BIND_DSV = 0x4,
+   GRAPH_BIND_UAV = 0x8
+};
+
+// Texture owned by the graph, a depth above 1 makes it a volume texture
+struct RenderGraphTextureDesc
+{
+   unsigned int width;
+   unsigned int height;
+   unsigned int depth;
+   RenderGraphFormat format;
+};
+
+unsigned int GetFormatSize(RenderGraphFormat format);
+unsigned long long GetTextureSize(const RenderGraphTextureDesc &desc);
+
+// Tiled resources are mapped in tiles of 64KB, whatever their format
+const unsigned int GRAPH_TILE_SIZE = 64 * 1024;
+
+// Standard tiles covering a 2D texture, e.g. 128x128 texels of a 4 byte
+// format per tile
+unsigned int GetTextureTileCount(const RenderGraphTextureDesc &desc);
+
+struct RenderGraphMemoryStats
+{
+   unsigned int numTransients;
+   unsigned int numPhysicalTextures;
+
+   // Every declared transient allocated for the whole session
+   unsigned long long declaredBytes;
+
+   // Physical textures created with their own memory, transients with the
+   // same description and disjoint lifetimes share one
+   unsigned long long committedBytes;
+
+   // Tile pool the tiled transients are mapped into, ones whose lifetimes do
+   // not intersect share tiles. 0 unless the graph compiled with
+   // SetTiledTransients. The renderer allocates committedBytes plus this.
+   unsigned long long tilePoolBytes;
+};
+
+enum RenderGraphClear
+{
+   GRAPH_CLEAR_NONE = 0,
+   GRAPH_CLEAR_RENDER_TARGET,
+   GRAPH_CLEAR_DEPTH,
+   GRAPH_CLEAR_UAV_FLOAT,
+   GRAPH_CLEAR_UAV_UINT
+};
+
+// How Execute treats a pass this frame, changing it does not need a
+// recompile. Skipped passes record nothing, not even their clears, so the
+// resources they write keep last frame's contents.
+enum RenderGraphPassMode
+{
+   GRAPH_PASS_RUN = 0,
+   GRAPH_PASS_RUN_WITHOUT_CLEARS,
+   GRAPH_PASS_SKIP
+};
+
+// Declarative description of the frame. Passes declare what they read and
+// write, Compile orders them by those dependencies, culls passes that do
+// not contribute to an output and works out the bindings. Execute then
+// records clears, bindings and unbindings around each pass' callback so the
+// passes only issue their own state and draws.
+class RenderGraph
+{
+public:
+   typedef std::function<void (CommandBuffer *pCmds)> ExecuteCallback;
+
+   RenderGraph();
+
+   void Reset();
+
+   RenderGraphResource ImportResource(const char *name, const RenderGraphViews &views);
+
+   // Transient textures only live for the passes that use them. Compile
+   // assigns them to physical textures, the caller creates those and hands
+   // their views back with SetPhysicalTextureViews before Execute.
+   RenderGraphResource CreateTexture(const char *name, const RenderGraphTextureDesc &desc);
+
+   // The transient keeps its contents from frame to frame, it gets a
+   // physical texture no other transient shares
+   void SetPersistent(RenderGraphResource resource);
+
+   // Non-persistent 2D transients without a depth view get a tiled texture
+   // each, mapped onto a tile pool so that the memory of one whose last pass
+   // has run goes to the next, whatever their descriptions. Needs D3D11.2
+   // tiled resources, the others stay committed. Applies from the next
+   // Compile and is kept across Reset.
+   void SetTiledTransients(bool tiled);
+
+   // The resource is cleared right before the first pass that writes it
+   void SetClear(RenderGraphResource resource, RenderGraphClear clear, const float values[4]);
+
+   // Passes writing an output are never culled, nor is anything they need
+   void MarkOutput(RenderGraphResource resource);
+
+   RenderGraphPass AddPass(const char *name);
+   void SetPassCallback(RenderGraphPass pass, const ExecuteCallback &callback);
+
+   // A pass can be skipped as long as every non-persistent transient a
+   // running pass uses is still written by a running pass. Execute checks
+   // this once every mode of the frame is set.
+   void SetPassMode(RenderGraphPass pass, RenderGraphPassMode mode);
+
+   // Returns false and names the transients a running pass uses while all
+   // of their writers are skipped
+   bool ValidatePassModes(std::string *pErrors) const;
+
+   void ReadTexture(RenderGraphPass pass, RenderGraphResource resource, ShaderStage stage, unsigned int slot);
+
+   // Vertex or draw argument input, the pass binds it itself
+   void ReadInput(RenderGraphPass pass, RenderGraphResource resource);
+   void WriteRenderTarget(RenderGraphPass pass, RenderGraphResource resource, unsigned int slot);
+   void WriteDepth(RenderGraphPass pass, RenderGraphResource resource);
+
+   // Pixel stage UAVs share the slot space with the render targets
+   void WriteUav(RenderGraphPass pass, RenderGraphResource resource, ShaderStage stage, unsigned int slot,
+      bool resetCounter = false);
+
+   // The pass fills the lower mips of an imported texture from its top mip
+   // through the SRV (e.g. GenerateMips), nothing is bound for it.
+   // Transients only have one mip.
+   void WriteMips(RenderGraphPass pass, RenderGraphResource resource);
+
+   // Returns false and describes the problem if the graph has a cycle, an
+   // active pass uses a resource without the view it needs or reads a
+   // transient nothing wrote. Invalidates the physical texture views.
+   bool Compile(std::string *pErrors);
+
+   unsigned int GetNumPhysicalTextures() const { return (unsigned int)m_physicalTextures.size(); }
+   const RenderGraphTextureDesc &GetPhysicalTextureDesc(unsigned int texture) const { return m_physicalTextures[texture].desc; }
+   unsigned int GetPhysicalTextureBindFlags(unsigned int texture) const { return m_physicalTextures[texture].bindFlags; }
+   void SetPhysicalTextureViews(unsigned int texture, const RenderGraphViews &views);
+
+   // A tiled texture is mapped onto numTiles tiles of the pool from
+   // firstTile, numTiles is 0 for committed textures
+   void GetPhysicalTextureTiles(unsigned int texture, unsigned int *pFirstTile, unsigned int *pNumTiles) const;
+
+   // Physical texture a transient was placed in, (unsigned int)-1 for
+   // imported resources and ones no active pass uses. Pooled textures and
+   // tiles are shared so the contents only belong to the resource during its
+   // lifetime.
+   unsigned int GetPhysicalTexture(RenderGraphResource resource) const { return m_resources[resource].physicalTexture; }
+
+   const RenderGraphMemoryStats &GetMemoryStats() const { return m_memoryStats; }
+
+   void Execute(CommandBuffer *pCmds) const;
+
+   // Records only the bindings of a pass, for passes that are recorded on
+   // their own (e.g. in chunks on deferred contexts)
+   void RecordBindings(RenderGraphPass pass, CommandBuffer *pCmds) const;
+
+   bool IsPassActive(RenderGraphPass pass) const;
+   const std::vector<RenderGraphPass> &GetSchedule() const { return m_schedule; }
+   unsigned int GetNumPasses() const { return (unsigned int)m_passes.size(); }
+   unsigned int GetNumResources() const { return (unsigned int)m_resources.size(); }
+   const char *GetPassName(RenderGraphPass pass) const { return m_passes[pass].name.c_str(); }
+   const char *GetResourceName(RenderGraphResource resource) const { return m_resources[resource].name.c_str(); }
+
+   // First and last position in the schedule at which an active pass uses
+   // the resource, returns false if no active pass uses it
+   bool GetResourceLifetime(RenderGraphResource resource, unsigned int *pFirst, unsigned int *pLast) const;
+
+   std::string GetScheduleReport() const;
+
+private:
+   enum AccessType
+   {
+      ACCESS_READ = 0,
+      ACCESS_INPUT,
+      ACCESS_RENDER_TARGET,
+      ACCESS_DEPTH,
+      ACCESS_UAV,
+      ACCESS_MIPS
+   };
+
+   struct Access
+   {
+      RenderGraphResource resource;
+      AccessType type;
+      ShaderStage stage;
+      unsigned int slot;
+      bool resetCounter;
+   };
+
+   struct Pass
+   {
+      std::string name;
+      ExecuteCallback callback;
+      std::vector<Access> accesses;
+      RenderGraphPassMode mode;
+      bool active;
+
+      // Tiled physical textures first used by the pass on tiles an earlier
+      // texture used, Execute puts a barrier in front of the pass for them
+      std::vector<unsigned int> tileBarriers;
+   };
+
+   struct Resource
+   {
+      std::string name;
+      RenderGraphViews views;
+      bool transient;
+      RenderGraphTextureDesc desc;
+      RenderGraphClear clear;
+      float clearValues[4];
+      bool output;
+      bool persistent;
+
+      // Filled in by Compile, physicalTexture is only valid for active
+      // transients
+      RenderGraphPass clearPass;
+      unsigned int physicalTexture;
+   };
+
+   struct PhysicalTexture
+   {
+      RenderGraphTextureDesc desc;
+      unsigned int bindFlags;
+      RenderGraphViews views;
+      unsigned int firstTile;
+      unsigned int numTiles;
+
+      // Last schedule position using the texture while it is being assigned
+      unsigned int lastUse;
+   };
+
+   void AddAccess(RenderGraphPass pass, RenderGraphResource resource, AccessType type, ShaderStage stage,
+      unsigned int slot, bool resetCounter);
+   static bool IsWrite(AccessType type) { return type != ACCESS_READ && type != ACCESS_INPUT; }
+   bool Writes(const Pass &pass, RenderGraphResource resource) const;
+   const RenderGraphViews &GetViews(RenderGraphResource resource) const;
+   void AllocateTransients();
+   void RecordClears(RenderGraphPass pass, CommandBuffer *pCmds) const;
+   void RecordUnbindings(RenderGraphPass pass, CommandBuffer *pCmds) const;
+
+   std::vector<Pass> m_passes;
+   std::vector<Resource> m_resources;
+   std::vector<RenderGraphPass> m_schedule;
+   std::vector<PhysicalTexture> m_physicalTextures;
+   RenderGraphMemoryStats m_memoryStats;
+   bool m_tiledTransients;
+   bool m_compiled;
+};
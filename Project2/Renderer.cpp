@@ -1,8 +1,13 @@
 #include "Renderer.h"
 #include "D3DUtils.h"
+#include "CpuTimer.h"
 
 #include <cassert>
+#include <cctype>
+#include <cfloat>
+#include <sstream>
 #include <string>
+#include <thread>
 
 #include <assimp/Importer.hpp>      // C++ importer interface
 #include <assimp/postprocess.h>     // Post processing flags
@@ -13,6 +18,26 @@ using std::string;
 const XMFLOAT4 LIGHT_DIRECTION(0.0f, 1.0f, 0.0f, 0.0f);
 const XMFLOAT4 LIGHT_UP(0.0f, 0.0f, 1.0f, 0.0f);
 
+const UINT FRAME_STATS_INTERVAL = 120;
+const UINT OVERDRAW_ESTIMATE_INTERVAL = 30;
+
+// Opacity of the material previewed as transparent
+const float OIT_PREVIEW_OPACITY = 0.4f;
+const UINT MAX_RECORDING_WORKERS = 8;
+const UINT MAX_DRAW_MULTIPLIER = 16;
+
+// Weight of the logarithmic cascade splits against uniform ones
+const float CASCADE_SPLIT_LAMBDA = 0.75f;
+
+// Light map and cascade sizes X and Y cycle through, the first ones are the
+// defaults
+const UINT NUM_RSM_SIZES = 3;
+const UINT RSM_SIZES[NUM_RSM_SIZES][2] = { { REFERENCE_RSM_WIDTH, REFERENCE_RSM_HEIGHT },
+   { 2 * REFERENCE_RSM_WIDTH, 2 * REFERENCE_RSM_HEIGHT }, { REFERENCE_RSM_WIDTH / 2, REFERENCE_RSM_HEIGHT / 2 } };
+const UINT NUM_CASCADE_SIZES = 3;
+const UINT CASCADE_SIZES[NUM_CASCADE_SIZES] = { DEFAULT_SHADOW_CASCADE_SIZE, 2 * DEFAULT_SHADOW_CASCADE_SIZE,
+   DEFAULT_SHADOW_CASCADE_SIZE / 2 };
+
 struct VertexPos 
 {
    XMFLOAT4 pos;
@@ -20,30 +45,128 @@ struct VertexPos
    XMFLOAT4 norm;
 };
 
-Renderer::Renderer() : D3DBase()
+// Whether the map is in a format D3DX11CreateShaderResourceViewFromFile
+// reads, compared case insensitively. Other maps (e.g. .tga) are skipped
+// rather than failing LoadContent.
+static bool IsLoadableTexture(const aiString &path)
+{
+   const char *loadable[] = { ".dds", ".bmp", ".jpg", ".jpeg", ".png", ".tif", ".tiff", ".gif" };
+   string name(path.C_Str());
+   size_t dot = name.find_last_of('.');
+   if (dot == string::npos) return false;
+
+   string extension = name.substr(dot);
+   for (size_t i = 0; i < extension.size(); i++) extension[i] = (char)tolower((unsigned char)extension[i]);
+   for (UINT i = 0; i < sizeof(loadable) / sizeof(loadable[0]); i++)
+   {
+      if (extension == loadable[i]) return true;
+   }
+   return false;
+}
+
+Renderer::Renderer() : D3DBase(), m_lightBinCS(NULL), m_instanceBuffer(NULL), m_cullCS(NULL), m_pCullInstances(NULL),
+   m_pCullConstants(NULL), m_numDynamicLights(0), m_clusterAssignCS(NULL), m_vplFluxCS(NULL), m_gaussianBlurCS(NULL),
+   m_captureRsm(FALSE), m_pCascadeConstants(NULL), m_pcfTapsSqrt(DEFAULT_SHADOW_PCF_TAPS_SQRT), m_evsmMomentsCS(NULL),
+   m_pShadowMoments(NULL), m_momentsSampler(NULL), m_pShadowCache(NULL), m_shadowUpdate(SHADOW_CACHE_FULL),
+   m_shadowCaching(TRUE), m_updateVpls(TRUE), m_cachedTargetVpls(0), m_shadowClearPS(NULL), m_scissorRasterState(NULL),
+   m_clearDepthState(NULL), m_normalDepthPS(NULL), m_ssaoCS(NULL), m_ssaoTemporalCS(NULL), m_ssaoUpsampleCS(NULL),
+   m_pSsaoConstants(NULL), m_ssaoEnabled(TRUE), m_ssaoTemporal(TRUE), m_ssaoHistoryValid(FALSE), m_ssaoFrame(0),
+   m_pNormalsStaging(NULL), m_normalsStagingHandle(NULL_HANDLE), m_gbufferPS(NULL), m_gbufferTexturePS(NULL),
+   m_deferredCompositePS(NULL), m_deferredLightingCS(NULL), m_pDeferredConstants(NULL), m_depthOnlyVS(NULL),
+   m_equalDepthState(NULL), m_depthPrepassMode(DEPTH_PREPASS_AUTO), m_overdrawFrame(0), m_oitPS(NULL),
+   m_oitTexturePS(NULL), m_oitResolvePS(NULL), m_testDepthState(NULL), m_oitBlendState(NULL), m_weightedOitPS(NULL),
+   m_weightedOitTexturePS(NULL), m_weightedOitCompositePS(NULL), m_weightedOitBlendState(NULL),
+   m_oitTechnique(OIT_TECHNIQUE_ABUFFER), m_pOitNodes(NULL),
+   m_pOitNodeCount(NULL), m_oitNodeCountHandle(NULL_HANDLE), m_oitFrame(0), m_oitCapacity(0), m_oitMeasuredNodes(0),
+   m_translucentMaterial(0), m_numTransparentDraws(0), m_taaMotionCS(NULL), m_taaResolveCS(NULL),
+   m_taaSharpenPS(NULL), m_pTaaConstants(NULL), m_taaHistoryValid(FALSE), m_taaFrame(0), m_upscalePS(NULL),
+   m_pUpscaleConstants(NULL), m_pGpuTimer(NULL), m_pResolutionController(NULL), m_renderWidth(0), m_renderHeight(0),
+   m_gpuFrameMs(0.0), m_tiledTransients(FALSE), m_coarseVplCS(NULL), m_vplUpsampleCS(NULL), m_coarseVplTexturePS(NULL),
+   m_pCoarseVplConstants(NULL), m_pIrradianceProbes(NULL), m_pIrradianceProbeConstants(NULL), m_sceneSize(0.0f),
+   m_frameStats(FRAME_STATS_INTERVAL)
 {
+   ZeroMemory(m_pCascadeTransformConstants, sizeof(m_pCascadeTransformConstants));
+   ZeroMemory(m_prevKeyInput, sizeof(m_prevKeyInput));
+   ZeroMemory(m_pDrawArgs, sizeof(m_pDrawArgs));
+   ZeroMemory(m_pVisibleInstances, sizeof(m_pVisibleInstances));
+   ZeroMemory(m_pRsmStaging, sizeof(m_pRsmStaging));
+   ZeroMemory(m_pSsaoSurfaces, sizeof(m_pSsaoSurfaces));
+   ZeroMemory(m_pTaaSurfaces, sizeof(m_pTaaSurfaces));
+   ZeroMemory(m_taaJitter, sizeof(m_taaJitter));
+   ZeroMemory(m_frameScales, sizeof(m_frameScales));
+   ZeroMemory(&m_prevViewProj, sizeof(m_prevViewProj));
+   ZeroMemory(&m_overdrawEstimate, sizeof(m_overdrawEstimate));
+   ZeroMemory(&m_irradianceProbeConstants, sizeof(m_irradianceProbeConstants));
+   ZeroMemory(m_pOitCountStaging, sizeof(m_pOitCountStaging));
+   ZeroMemory(m_oitCountStagingHandles, sizeof(m_oitCountStagingHandles));
+   m_rsmStagingHandles[0] = m_rsmStagingHandles[1] = NULL_HANDLE;
+   GetDefaultEvsmSettings(&m_evsmSettings);
+   GetDefaultSsaoSettings(&m_ssaoSettings);
+   GetDefaultTaaSettings(&m_taaSettings);
+   GetDefaultDynamicResolutionSettings(&m_resolutionSettings);
+   GetDefaultCoarseVplSettings(&m_coarseVplSettings);
+   GetDefaultDepthPrepassSettings(&m_depthPrepassSettings);
+   GetDefaultABufferSettings(&m_abufferSettings);
+}
 
+BOOL Renderer::WasKeyPressed(const BOOL *keyInputArray, UINT key) const
+{
+   return keyInputArray[key] && !m_prevKeyInput[key];
 }
 
 bool Renderer::InitializeMatMap(const aiScene *pAssimpScene)
 {
    m_matList.clear();
+   m_materialConstants.clear();
    for( UINT i = 0; i < pAssimpScene->mNumMaterials; i++ ) 
    {
       aiMaterial *pMat = pAssimpScene->mMaterials[i];
       aiColor3D ambient, diffuse, specular;
       float shininess;
+      float opacity = 1.0f;
 
       pMat->Get(AI_MATKEY_COLOR_AMBIENT, ambient);
       pMat->Get(AI_MATKEY_COLOR_DIFFUSE, diffuse);
       pMat->Get(AI_MATKEY_COLOR_SPECULAR, specular);
       pMat->Get(AI_MATKEY_SHININESS_STRENGTH, shininess);
+      pMat->Get(AI_MATKEY_OPACITY, opacity);
 
       PS_Material_Constant_Buffer psConstBuf;
       psConstBuf.ambient = XMFLOAT4(ambient.r, ambient.g, ambient.b, 1.0f);
       psConstBuf.diffuse = XMFLOAT4(diffuse.r, diffuse.g, diffuse.b, 1.0f);
       psConstBuf.specular = XMFLOAT4(specular.r, specular.g, specular.b, 1.0f);
       psConstBuf.shininess = shininess;
+      psConstBuf.opacity = opacity;
+      psConstBuf.flags = 0;
+      psConstBuf.padding = 0.0f;
+
+      // map_d naming the diffuse texture means its alpha channel, otherwise
+      // a separate opacity map
+      Material matInfo;
+      matInfo.m_texture = NULL;
+      matInfo.m_opacityTexture = NULL;
+      aiString diffusePath, opacityPath;
+      bool hasDiffuse = pMat->GetTexture(aiTextureType_DIFFUSE, 0, &diffusePath) == AI_SUCCESS;
+      if (pMat->GetTexture(aiTextureType_OPACITY, 0, &opacityPath) == AI_SUCCESS)
+      {
+         if (hasDiffuse && diffusePath == opacityPath)
+         {
+            // Only when the diffuse texture is loaded below
+            if (diffusePath.C_Str()[diffusePath.length - 1] == 'g') psConstBuf.flags |= MATERIAL_FLAG_ALPHA_TEXTURE;
+         }
+         else if (IsLoadableTexture(opacityPath))
+         {
+            HR(D3DX11CreateShaderResourceViewFromFile(m_d3dDevice, 
+                                                      opacityPath.C_Str(),
+                                                      0, 
+                                                      0, 
+                                                      &matInfo.m_opacityTexture, 
+                                                      0));
+            psConstBuf.flags |= MATERIAL_FLAG_OPACITY_MAP;
+         }
+      }
+      matInfo.m_flags = psConstBuf.flags;
+      m_materialConstants.push_back(psConstBuf);
 
       D3D11_BUFFER_DESC constBufDesc;
       ZeroMemory(&constBufDesc, sizeof( constBufDesc ));
@@ -55,7 +178,6 @@ bool Renderer::InitializeMatMap(const aiScene *pAssimpScene)
       ZeroMemory(&constResourceData, sizeof( constResourceData ));
       constResourceData.pSysMem = &psConstBuf;
 
-      Material matInfo;
       HRESULT d3dResult = m_d3dDevice->CreateBuffer( &constBufDesc, &constResourceData, &matInfo.m_materialConstantBuffer);
 
       if ( FAILED(d3dResult) ) return false;
@@ -97,11 +219,16 @@ void Renderer::DestroyMatMap()
       {
          m_matList[i].m_texture->Release();
       }
+      if( m_matList[i].m_opacityTexture )
+      {
+         m_matList[i].m_opacityTexture->Release();
+      }
    }
 }
 
 
-bool Renderer::CreateD3DMesh(const aiMesh *pMesh, const aiScene *pAssimpScene, Mesh *d3dMesh)
+bool Renderer::CreateD3DMesh(const aiMesh *pMesh, const aiScene *pAssimpScene, MeshDeduplicator *pMeshes,
+   UINT *pMeshIndex)
 {
    UINT numVerts = pMesh->mNumVertices;
    UINT numFaces = pMesh->mNumFaces;
@@ -110,6 +237,8 @@ bool Renderer::CreateD3DMesh(const aiMesh *pMesh, const aiScene *pAssimpScene, M
    UINT *indices = new UINT[numIndices]();
 
    assert(*pMesh->mNumUVComponents == 2 || *pMesh->mNumUVComponents == 0 );
+   Mesh mesh;
+   Mesh *d3dMesh = &mesh;
    memset(d3dMesh, 0, sizeof(Mesh));
    for (UINT vertIdx = 0; vertIdx < numVerts; vertIdx++)
    {
@@ -136,6 +265,27 @@ bool Renderer::CreateD3DMesh(const aiMesh *pMesh, const aiScene *pAssimpScene, M
       indices[i * 3 + 2] = pFace->mIndices[2];
    }
 
+   // Meshes the exporter duplicated share the buffers of the first copy
+   bool isNew = false;
+   *pMeshIndex = pMeshes->Add(vertices, sizeof(VertexPos) * numVerts, indices, numIndices, pMesh->mMaterialIndex, &isNew);
+   if (!isNew)
+   {
+      delete [] vertices;
+      delete [] indices;
+      return true;
+   }
+
+   OverdrawMesh overdrawMesh;
+   overdrawMesh.positions.resize(numVerts * 3);
+   for (UINT vertIdx = 0; vertIdx < numVerts; vertIdx++)
+   {
+      overdrawMesh.positions[vertIdx * 3] = vertices[vertIdx].pos.x;
+      overdrawMesh.positions[vertIdx * 3 + 1] = vertices[vertIdx].pos.y;
+      overdrawMesh.positions[vertIdx * 3 + 2] = vertices[vertIdx].pos.z;
+   }
+   overdrawMesh.indices.assign(indices, indices + numIndices);
+   m_overdrawMeshes.push_back(overdrawMesh);
+
    auto pMat = pAssimpScene->mMaterials[pMesh->mMaterialIndex];
    aiColor3D ambient, diffuse, specular;
    float shininess;
@@ -160,9 +310,11 @@ bool Renderer::CreateD3DMesh(const aiMesh *pMesh, const aiScene *pAssimpScene, M
 
    // Create the buffer with the device.
    HRESULT d3dResult = m_d3dDevice->CreateBuffer( &bufferDesc, &InitData, &d3dMesh->m_indexBuffer );
+   delete [] indices;
    if( FAILED( d3dResult ) ) 
    {
     	MessageBox(NULL, "CreateBuffer failed", "Error", MB_OK);
+      delete [] vertices;
       return false;
    }
    
@@ -177,14 +329,65 @@ bool Renderer::CreateD3DMesh(const aiMesh *pMesh, const aiScene *pAssimpScene, M
    resourceData.pSysMem = vertices;
 
    d3dResult = m_d3dDevice->CreateBuffer( &vertexDesc, &resourceData, &d3dMesh->m_vertexBuffer);
+   delete [] vertices;
 
    if ( FAILED(d3dResult) ) return false;
    
    d3dMesh->m_MaterialIndex = pMesh->mMaterialIndex;
+   scene.push_back(mesh);
+   m_meshBounds.push_back(ComputeBoundingSphere(&pMesh->mVertices[0].x, 3, numVerts));
 
    return true;
 }
 
+void Renderer::CollectInstances(const aiNode *pNode, const aiMatrix4x4 &parentTransform, const vector<UINT> &meshMap,
+   vector<MeshInstance> *pInstances)
+{
+   aiMatrix4x4 transform = parentTransform * pNode->mTransformation;
+
+   // Assimp matrices transform column vectors, the shaders multiply row
+   // vectors so the instance stream holds the transpose
+   MeshInstance instance;
+   for (UINT row = 0; row < 4; row++)
+   {
+      for (UINT col = 0; col < 4; col++)
+      {
+         instance.world.m[row * 4 + col] = transform[col][row];
+      }
+   }
+
+   for (UINT i = 0; i < pNode->mNumMeshes; i++)
+   {
+      instance.mesh = meshMap[pNode->mMeshes[i]];
+      pInstances->push_back(instance);
+   }
+
+   for (UINT i = 0; i < pNode->mNumChildren; i++)
+   {
+      CollectInstances(pNode->mChildren[i], transform, meshMap, pInstances);
+   }
+}
+
+
+void Renderer::EstimateOverdraw(const float viewProj[16])
+{
+   // The estimate keeps the back buffer's aspect ratio
+   UINT size = m_depthPrepassSettings.estimateResolution;
+   UINT width = m_width >= m_height ? size : size * m_width / m_height;
+   UINT height = m_width >= m_height ? size * m_height / m_width : size;
+   if (width == 0) width = 1;
+   if (height == 0) height = 1;
+
+   // Instances are drawn in the order the main pass submits them
+   m_overdrawEstimator.Begin(width, height);
+   for (size_t i = 0; i < m_cullInstances.size(); i++)
+   {
+      const CullInstance &instance = m_cullInstances[i];
+      const OverdrawMesh &mesh = m_overdrawMeshes[m_instanceBatches[instance.drawIndex].mesh];
+      m_overdrawEstimator.DrawMesh(mesh, instance.world.m, viewProj);
+   }
+   m_overdrawEstimator.Finish(&m_overdrawEstimate);
+}
 
 void Renderer::DestroyD3DMesh(Mesh *mesh) 
 {
@@ -254,6 +457,126 @@ void Renderer::Update(FLOAT dt, BOOL *keyInputArray)
       lightRotation -= LIGHT_ROTATE_SPEED;
    }
 
+   if( WasKeyPressed(keyInputArray, 'M'))
+   {
+      m_multithreadedSubmit = !m_multithreadedSubmit;
+   }
+   if( WasKeyPressed(keyInputArray, 'N'))
+   {
+      m_drawMultiplier = m_drawMultiplier < MAX_DRAW_MULTIPLIER ? m_drawMultiplier * 2 : 1;
+   }
+   if( WasKeyPressed(keyInputArray, 'G'))
+   {
+      m_passResources.gpuCulling = !m_passResources.gpuCulling;
+   }
+   if( WasKeyPressed(keyInputArray, 'O'))
+   {
+      m_numDynamicLights = m_numDynamicLights == 0 ? 64 : (m_numDynamicLights < MAX_CLUSTER_LIGHTS ? m_numDynamicLights * 4 : 0);
+   }
+   if( WasKeyPressed(keyInputArray, 'P'))
+   {
+      m_passResources.gpuClusterAssignment = !m_passResources.gpuClusterAssignment;
+   }
+   if( WasKeyPressed(keyInputArray, 'V'))
+   {
+      const UINT MIN_TARGET_VPLS = 256;
+      UINT targetVpls = m_vplConstants.targetVpls * 2;
+      if (m_vplConstants.targetVpls >= MAX_VPLS) targetVpls = MIN_TARGET_VPLS;
+      else if (targetVpls > MAX_VPLS) targetVpls = MAX_VPLS;
+      m_vplConstants.targetVpls = targetVpls;
+   }
+   if( WasKeyPressed(keyInputArray, 'F'))
+   {
+      m_pcfTapsSqrt = m_pcfTapsSqrt % MAX_SHADOW_PCF_TAPS_SQRT + 1;
+   }
+   if( WasKeyPressed(keyInputArray, 'T'))
+   {
+      m_passResources.shadowFilter = m_passResources.shadowFilter == SHADOW_FILTER_PCF ? SHADOW_FILTER_EVSM : SHADOW_FILTER_PCF;
+   }
+   if( WasKeyPressed(keyInputArray, 'H'))
+   {
+      m_evsmSettings.blurRadius = m_evsmSettings.blurRadius == 0 ? 1 :
+         (m_evsmSettings.blurRadius < MAX_BLUR_RADIUS / 2 ? m_evsmSettings.blurRadius * 2 : 0);
+   }
+   if( WasKeyPressed(keyInputArray, 'U'))
+   {
+      m_evsmSettings.lightBleedReduction = m_evsmSettings.lightBleedReduction < 0.5f ?
+         m_evsmSettings.lightBleedReduction + 0.1f : 0.0f;
+   }
+   if( WasKeyPressed(keyInputArray, 'B'))
+   {
+      m_shadowCaching = !m_shadowCaching;
+   }
+   if( WasKeyPressed(keyInputArray, 'X'))
+   {
+      UINT size = 0;
+      while (size < NUM_RSM_SIZES - 1 && RSM_SIZES[size][0] != m_shadowMapWidth) size++;
+      size = (size + 1) % NUM_RSM_SIZES;
+      ResizeShadowMaps(RSM_SIZES[size][0], RSM_SIZES[size][1], m_cascadeSize);
+   }
+   if( WasKeyPressed(keyInputArray, 'Y'))
+   {
+      UINT size = 0;
+      while (size < NUM_CASCADE_SIZES - 1 && CASCADE_SIZES[size] != m_cascadeSize) size++;
+      size = (size + 1) % NUM_CASCADE_SIZES;
+      ResizeShadowMaps(m_shadowMapWidth, m_shadowMapHeight, CASCADE_SIZES[size]);
+   }
+   if( WasKeyPressed(keyInputArray, '1'))
+   {
+      m_ssaoEnabled = !m_ssaoEnabled;
+   }
+   if( WasKeyPressed(keyInputArray, '2'))
+   {
+      m_ssaoTemporal = !m_ssaoTemporal;
+   }
+   if( WasKeyPressed(keyInputArray, '3'))
+   {
+      m_passResources.deferredShading = !m_passResources.deferredShading;
+      BuildRenderGraph();
+   }
+   if( WasKeyPressed(keyInputArray, '4'))
+   {
+      m_depthPrepassMode = (DepthPrepassMode)((m_depthPrepassMode + 1) % NUM_DEPTH_PREPASS_MODES);
+   }
+   if( WasKeyPressed(keyInputArray, '5'))
+   {
+      m_translucentMaterial = (m_translucentMaterial + 1) % ((UINT)m_matList.size() + 1);
+      UpdateTransparentDraws();
+   }
+   if( WasKeyPressed(keyInputArray, '6'))
+   {
+      m_oitTechnique = m_oitTechnique == OIT_TECHNIQUE_ABUFFER ? OIT_TECHNIQUE_WEIGHTED : OIT_TECHNIQUE_ABUFFER;
+   }
+   if( WasKeyPressed(keyInputArray, '7'))
+   {
+      m_passResources.temporalAA = !m_passResources.temporalAA;
+      m_taaHistoryValid = FALSE;
+      BuildRenderGraph();
+   }
+   if( WasKeyPressed(keyInputArray, '8'))
+   {
+      m_passResources.dynamicResolution = !m_passResources.dynamicResolution;
+      m_pResolutionController->Reset();
+      BuildRenderGraph();
+   }
+   if( WasKeyPressed(keyInputArray, '9'))
+   {
+      m_passResources.coarseVpl = !m_passResources.coarseVpl;
+      BuildRenderGraph();
+   }
+   if( WasKeyPressed(keyInputArray, '0') && m_pIrradianceProbes)
+   {
+      m_passResources.irradianceProbes = !m_passResources.irradianceProbes;
+      SetupIrradianceProbeConstants(m_irradianceProbeGrid, m_passResources.irradianceProbes,
+         &m_irradianceProbeConstants);
+      BuildRenderGraph();
+   }
+   if( WasKeyPressed(keyInputArray, 'R'))
+   {
+      m_captureRsm = TRUE;
+   }
+   memcpy(m_prevKeyInput, keyInputArray, sizeof(m_prevKeyInput));
+
    XMVECTOR xAxis(XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f));
    XMFLOAT3 pos(tx, ty, tz);
 
@@ -261,6 +584,22 @@ void Renderer::Update(FLOAT dt, BOOL *keyInputArray)
    m_pCamera->RotateCameraHorizontally(ry);
    m_pCamera->RotateCameraVertically(rx);
 
+   // The frame is drawn at the controller's scale into the top left of the
+   // full size targets
+   float renderScale = m_passResources.dynamicResolution ? m_pResolutionController->GetScale() : 1.0f;
+   UINT renderWidth, renderHeight;
+   GetDynamicResolutionSize(renderScale, m_width, m_height, &renderWidth, &renderHeight);
+   if (renderWidth != m_renderWidth || renderHeight != m_renderHeight)
+   {
+      m_renderWidth = renderWidth;
+      m_renderHeight = renderHeight;
+      m_passResources.mainViewport.width = (FLOAT)renderWidth;
+      m_passResources.mainViewport.height = (FLOAT)renderHeight;
+      m_ssaoHistoryValid = FALSE;
+      m_taaHistoryValid = FALSE;
+   }
+   SetupUpscaleConstants(m_renderWidth, m_renderHeight, m_width, m_height, &m_upscaleConstants);
+
    XMMATRIX perspective = XMMatrixPerspectiveFovLH(m_fieldOfView, (FLOAT)m_width / (FLOAT)m_height, m_nearPlane, m_farPlane);
 
    XMMATRIX view = *m_pCamera->GetViewMatrix();
@@ -272,245 +611,1261 @@ void Renderer::Update(FLOAT dt, BOOL *keyInputArray)
    XMFLOAT4 lookAtPoint = XMFLOAT4(0, 0, 0, 0);
    XMVECTOR lookAtPointVec = XMLoadFloat4(&lookAtPoint);
    
-   XMStoreFloat4(&m_lightDirection, lightDirVector);
-   XMStoreFloat4(&m_lightUp, lightUpVector);
+   // Only written back when the light turns, renormalizing every frame could
+   // nudge the direction and with it the cached shadow map's projection
+   if (lightRotation != 0.0f)
+   {
+      XMStoreFloat4(&m_lightDirection, lightDirVector);
+      XMStoreFloat4(&m_lightUp, lightUpVector);
+   }
 
 
    XMVECTOR shadowEye = XMVectorSetW(lightDirVector * 2000.0f, 1.0f);
    XMMATRIX lightView = XMMatrixLookAtLH(shadowEye, lookAtPointVec, lightUpVector);
 
-   m_vsTransConstBuf.mvp = view * perspective;
+   // The anti-aliasing moves the main view by a different sub-pixel offset
+   // every frame, the light's view and the reprojections stay unjittered
+   XMMATRIX mainPerspective = perspective;
+   m_taaJitter[0] = m_taaJitter[1] = 0.0f;
+   if (m_passResources.temporalAA)
+   {
+      XMFLOAT4X4 perspectiveFloats, jitteredFloats;
+      XMStoreFloat4x4(&perspectiveFloats, perspective);
+      GetTaaJitter(m_taaSettings, m_taaFrame, m_renderWidth, m_renderHeight, m_taaJitter);
+      JitterProjection(&perspectiveFloats._11, m_taaJitter, &jitteredFloats._11);
+      mainPerspective = XMLoadFloat4x4(&jitteredFloats);
+   }
+
+   m_vsTransConstBuf.mvp = view * mainPerspective;
    m_vsLightTransConstBuf.mvp = lightView * perspective;
    
    m_psLightConstBuf.direction = m_lightDirection;
    m_psLightConstBuf.mvp = m_vsLightTransConstBuf.mvp;
-}
 
-void Renderer::Render() 
-{
+   XMFLOAT4X4 viewProj;
+   XMStoreFloat4x4(&viewProj, m_vsLightTransConstBuf.mvp);
+   ExtractFrustumPlanes(&viewProj._11, &m_cullConstants[SHADOW_PASS].frustum);
+   XMStoreFloat4x4(&viewProj, m_vsTransConstBuf.mvp);
+   ExtractFrustumPlanes(&viewProj._11, &m_cullConstants[MAIN_PASS].frustum);
 
-   if (!m_d3dContext) return;
+   if (m_overdrawFrame++ % OVERDRAW_ESTIMATE_INTERVAL == 0)
+   {
+      CpuTimer overdrawTimer;
+      EstimateOverdraw(&viewProj._11);
+      m_frameStats.AddTime("overdraw estimate", overdrawTimer.GetElapsedMs());
+   }
+   bool depthPrepass = ChooseDepthPrepass(m_depthPrepassMode, m_depthPrepassSettings, m_overdrawEstimate,
+      m_passResources.depthPrepass);
+   if (depthPrepass != m_passResources.depthPrepass)
+   {
+      m_passResources.depthPrepass = depthPrepass;
+      BuildRenderGraph();
+   }
 
-   float clearColor[4] = { 0.2f, 0.2f, 0.2f, 1.0f };
-   float clearNormals[4] = { 0.5f, 0.5f, 0.5f, 0.0f };
-   float black[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
-   float clearDepth[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+   // The lists shrink to their smallest while the weighted blending is used
+   UINT listFragments = m_oitTechnique == OIT_TECHNIQUE_ABUFFER ? m_oitMeasuredNodes : 0;
+   UINT oitCapacity = ChooseABufferCapacity(m_abufferSettings, listFragments, m_oitCapacity, m_width, m_height);
+   if (oitCapacity != m_oitCapacity) ResizeOitNodes(oitCapacity);
+
+   // Without caching every frame is a full update. The light's projection is
+   // built from the same direction while it stands still so it compares
+   // exactly.
+   XMFLOAT4X4 lightViewProj;
+   XMStoreFloat4x4(&lightViewProj, m_vsLightTransConstBuf.mvp);
+   if (!m_shadowCaching) m_pShadowCache->Invalidate();
+   m_shadowUpdate = m_pShadowCache->Update(&lightViewProj._11, m_dynamicCasters);
+   if (m_shadowUpdate == SHADOW_CACHE_PARTIAL)
+   {
+      vector<UINT> regionDraws;
+      SelectDrawsInRect(m_cullInstances, &lightViewProj._11, m_shadowMapWidth, m_shadowMapHeight,
+         m_pShadowCache->GetDirtyRect(), &regionDraws);
+      m_shadowRegionItems.clear();
+      for (size_t i = 0; i < regionDraws.size(); i++) m_shadowRegionItems.push_back(m_drawItems[regionDraws[i]]);
+   }
 
+   // The VPLs only depend on the light map, the capture copies the map in
+   // the light buffer pass
+   m_updateVpls = m_shadowUpdate != SHADOW_CACHE_SKIP || m_vplConstants.targetVpls != m_cachedTargetVpls || m_captureRsm;
+   m_cachedTargetVpls = m_vplConstants.targetVpls;
+   SetupVplConstants(m_shadowMapWidth, m_shadowMapHeight, m_vplConstants.targetVpls, m_vplConstants.seed,
+      &m_vplConstants);
+
+   // The cascades cover the view up to the far plane or across the scene,
+   // whichever is closer, and catch casters up to a scene away
+   XMFLOAT4X4 invViewFloats;
+   XMStoreFloat4x4(&invViewFloats, XMMatrixInverse(NULL, view));
+   float shadowDistance = m_sceneSize < m_farPlane ? m_sceneSize : m_farPlane;
+   FitShadowCascades(&invViewFloats._11, m_fieldOfView, (FLOAT)m_width / (FLOAT)m_height, m_nearPlane, shadowDistance,
+      CASCADE_SPLIT_LAMBDA, &m_lightDirection.x, m_sceneSize, m_cascadeSize, m_shadowCascades);
+   SetupCascadeConstants(m_shadowCascades, m_passResources.shadowFilter, m_pcfTapsSqrt, m_evsmSettings,
+      &m_cascadeConstants);
+   SetupBlurConstants(m_cascadeSize * NUM_SHADOW_CASCADES, m_cascadeSize, m_evsmSettings.blurRadius,
+      m_evsmSettings.blurRadius > 0 ? 0.5f * m_evsmSettings.blurRadius : 1.0f, false, 1.0f, &m_evsmBlurConstants);
+   m_evsmBlurConstants.tileWidth = m_cascadeSize;
+   CullCascadeDraws(m_cullInstances, m_shadowCascades, (UINT)m_instanceBatches.size(), &m_cascadeDrawMasks);
+
+   XMFLOAT4X4 viewFloats;
+   XMStoreFloat4x4(&viewFloats, view);
+   TransformLightsToView(m_dynamicLights, m_numDynamicLights, &viewFloats._11, &m_viewLights);
+   SetupClusterConstants(&viewFloats._11, m_fieldOfView, (FLOAT)m_width / (FLOAT)m_height, m_nearPlane, m_farPlane,
+      m_renderWidth, m_renderHeight, m_numDynamicLights, &m_clusterConstants);
+   if (!m_passResources.gpuClusterAssignment)
+   {
+      ComputeClusterBounds(m_clusterConstants, &m_clusterBounds);
+      AssignLightsToClusters(m_clusterBounds, m_clusterConstants, m_viewLights, MAX_CLUSTER_LIGHT_INDICES, &m_clusterAssignment);
+   }
 
-   unsigned int zeroUints[4] = { 0, 0, 0, 0};
+   XMFLOAT4X4 invViewProj;
+   XMStoreFloat4x4(&invViewProj, XMMatrixInverse(NULL, m_vsTransConstBuf.mvp));
+   SetupDeferredConstants(&invViewProj._11, m_fieldOfView, (FLOAT)m_width / (FLOAT)m_height, m_nearPlane, m_farPlane,
+      m_renderWidth, m_renderHeight, m_numDynamicLights, &m_deferredConstants);
+
+   // The temporal passes follow each pixel from this frame's view space into
+   // last frame's clip space
+   XMFLOAT4X4 reprojection;
+   XMStoreFloat4x4(&reprojection, XMMatrixInverse(NULL, view) * XMLoadFloat4x4(&m_prevViewProj));
+   XMStoreFloat4x4(&m_prevViewProj, view * perspective);
+   SsaoSettings ssaoSettings = m_ssaoSettings;
+   if (!m_ssaoEnabled) ssaoSettings.intensity = 0.0f;
+   float tanHalfFovY = tanf(m_fieldOfView * 0.5f);
+   float tanHalfFovX = tanHalfFovY * (FLOAT)m_width / (FLOAT)m_height;
+   SetupSsaoConstants(ssaoSettings, m_renderWidth, m_renderHeight, tanHalfFovX, tanHalfFovY,
+      m_ssaoTemporal && m_ssaoHistoryValid ? &reprojection._11 : NULL, m_ssaoFrame, &m_ssaoConstants);
+   memcpy(m_ssaoConstants.view, &viewFloats._11, sizeof(m_ssaoConstants.view));
+   SetupTaaConstants(m_taaSettings, m_renderWidth, m_renderHeight, tanHalfFovX, tanHalfFovY, m_farPlane, m_taaJitter,
+      m_taaHistoryValid ? &reprojection._11 : NULL, &m_taaConstants);
+
+   // The coarse VPL passes find the light space position from the normal
+   // pass' view space
+   XMFLOAT4X4 viewToLight;
+   XMStoreFloat4x4(&viewToLight, XMMatrixInverse(NULL, view) * m_vsLightTransConstBuf.mvp);
+   SetupCoarseVplConstants(m_coarseVplSettings, m_renderWidth, m_renderHeight, tanHalfFovX, tanHalfFovY,
+      &viewToLight._11, &m_coarseVplConstants);
+}
 
-   m_d3dContext->ClearRenderTargetView(m_backBufferTarget, clearColor);
-   
-   m_d3dContext->ClearUnorderedAccessViewFloat(m_pBlurredShadowSurface->GetUnorderedAccessView(), clearDepth);
-   m_d3dContext->ClearUnorderedAccessViewFloat(m_uav, clearColor);
-   m_d3dContext->ClearUnorderedAccessViewUint(m_colorBufferDepthUAV, zeroUints);
+void Renderer::RecordChunk(unsigned int worker, unsigned int pass, const DrawChunk &chunk)
+{
+   // The shadow pass only replays the workers' command lists for full
+   // updates, the list stays empty otherwise
+   if (pass == SHADOW_PASS && m_shadowUpdate != SHADOW_CACHE_FULL) return;
 
-   // Clear the depth buffer to 1.0f and the stencil buffer to 0.
-   m_d3dContext->ClearDepthStencilView(m_DepthStencilView,
-     D3D11_CLEAR_DEPTH, 1.0f, 0);
+   CommandBuffer *pCmds = &m_workerCommands[worker];
+   pCmds->Reset();
+   m_renderGraph.RecordBindings(m_graphPasses.scenePasses[pass], pCmds);
+   RecordScenePass(pCmds, m_passResources, m_drawItems, pass, chunk);
 
-   m_d3dContext->ClearDepthStencilView(m_pShadowMap->GetDepthStencilView(),
-     D3D11_CLEAR_DEPTH, 1.0f, 0);
+   m_commandBackend.Execute(m_pContextPool->GetContext(worker), *pCmds);
+   if (FAILED(m_pContextPool->FinishCommandList(worker, pass)))
+   {
+      OutputDebugStringA("Could not close a recording worker's command list, its draws are dropped\n");
+   }
+}
 
-   unsigned int stride = sizeof(VertexPos);
-   unsigned int offset= 0;
+void Renderer::ExecuteChunk(unsigned int worker, unsigned int pass)
+{
+   m_pContextPool->ExecuteCommandList(m_d3dContext, worker, pass);
+}
 
+void Renderer::SubmitScenePass(CommandBuffer *pCmds, UINT pass, UINT numDraws)
+{
+   if (m_multithreadedSubmit)
+   {
+      // The clears and bindings recorded so far have to land before the
+      // command lists, which bring their own bindings along
+      m_commandBackend.Execute(m_d3dContext, *pCmds);
+      pCmds->Reset();
+      m_pRecorder->ExecutePass(this, pass);
+   }
+   else
+   {
+      DrawChunk allDraws = { 0, numDraws };
+      RecordScenePass(pCmds, m_passResources, m_drawItems, pass, allDraws);
+   }
+}
 
-   m_d3dContext->IASetPrimitiveTopology( D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST );
-   m_d3dContext->RSSetState(m_rasterState);
+void Renderer::Render() 
+{
 
-   m_pLightConstants->SetData(m_d3dContext, &m_psLightConstBuf);
-   ID3D11Buffer *pFirstPassCbs[] = { m_pLightConstants->GetConstantBuffer() };
-   m_d3dContext->PSSetConstantBuffers(1 , 1, pFirstPassCbs);
-   m_d3dContext->VSSetConstantBuffers(1 , 1, pFirstPassCbs);
+   if (!m_d3dContext) return;
 
-   ID3D11SamplerState *samplers[] = { m_colorMapSampler, m_shadowSampler };
-   m_d3dContext->PSSetSamplers(0 , 2, samplers);
-         
-   m_d3dContext->PSSetShader(m_solidColorPS, 0, 0);
-   ID3D11Buffer *pCbs[] = { m_pTransformConstants->GetConstantBuffer() };
-   m_d3dContext->VSSetConstantBuffers(0 , 1, pCbs);
+   m_numFrameDraws = (UINT)m_drawItems.size() * m_drawMultiplier;
 
-   for (UINT draw = 0; draw < 2; draw++)
+   CpuTimer recordTimer;
+   if (m_multithreadedSubmit)
    {
-      if (draw == 0)
+      m_drawCosts.resize(m_numFrameDraws);
+      for (UINT i = 0; i < m_numFrameDraws; i++)
       {
-         m_d3dContext->IASetInputLayout( m_inputLayout );
-         m_d3dContext->RSSetViewports(1, m_pShadowMap->GetViewport());
-         m_d3dContext->VSSetShader(m_solidColorVS, 0, 0);
-       
-         m_pTransformConstants->SetData(m_d3dContext, &m_vsLightTransConstBuf);
-         
-         ID3D11RenderTargetView *pLightMapRtv[] = { m_pLightMap->GetRenderTargetView() };
-         ID3D11ShaderResourceView *pNullSrv[] = { NULL };
-
-         m_d3dContext->PSSetShaderResources(1 , 1, pNullSrv);
-         m_d3dContext->OMSetRenderTargets(1, pLightMapRtv, m_pShadowMap->GetDepthStencilView());
+         const SceneDrawItem &item = m_drawItems[i % m_drawItems.size()];
+         m_drawCosts[i] = item.numIndices * item.numInstances;
       }
-      else
+      m_pRecorder->Record(this, NUM_SCENE_PASSES, m_drawCosts);
+   }
+   m_frameStats.AddTime("record", recordTimer.GetElapsedMs());
+
+   CpuTimer submitTimer;
+   m_frameCommands.Reset();
+
+   // Constant buffers are only updated on the immediate context so recorded
+   // command lists can reference them without copying the data
+   m_frameCommands.UpdateBuffer(m_passResources.lightConstants, &m_psLightConstBuf, sizeof(m_psLightConstBuf));
+   m_frameCommands.UpdateBuffer(m_passResources.lightTransformConstants, &m_vsLightTransConstBuf, sizeof(m_vsLightTransConstBuf));
+   m_frameCommands.UpdateBuffer(m_passResources.cameraTransformConstants, &m_vsTransConstBuf, sizeof(m_vsTransConstBuf));
+   for (UINT cascade = 0; cascade < NUM_SHADOW_CASCADES; cascade++)
+   {
+      m_frameCommands.UpdateBuffer(m_passResources.cascadeTransformConstants[cascade], m_shadowCascades[cascade].viewProj,
+         sizeof(m_shadowCascades[cascade].viewProj));
+   }
+   m_frameCommands.UpdateBuffer(m_passResources.cascadeConstants, &m_cascadeConstants, sizeof(m_cascadeConstants));
+   m_frameCommands.UpdateBuffer(m_passResources.ssaoConstants, &m_ssaoConstants, sizeof(m_ssaoConstants));
+   m_frameCommands.UpdateBuffer(m_passResources.deferredConstants, &m_deferredConstants, sizeof(m_deferredConstants));
+   m_frameCommands.UpdateBuffer(m_passResources.taaConstants, &m_taaConstants, sizeof(m_taaConstants));
+   m_frameCommands.UpdateBuffer(m_passResources.upscaleConstants, &m_upscaleConstants, sizeof(m_upscaleConstants));
+   m_frameCommands.UpdateBuffer(m_passResources.coarseVplConstants, &m_coarseVplConstants,
+      sizeof(m_coarseVplConstants));
+   m_frameCommands.UpdateBuffer(m_passResources.irradianceProbeConstants, &m_irradianceProbeConstants,
+      sizeof(m_irradianceProbeConstants));
+
+   // The occlusion resolves into one surface and reads the other as history
+   RWComputeSurface *pResolved = m_pSsaoSurfaces[m_ssaoFrame & 1];
+   RWComputeSurface *pHistory = m_pSsaoSurfaces[(m_ssaoFrame + 1) & 1];
+   m_commandBackend.Replace(m_passResources.ssaoResolvedSrv, pResolved->GetShaderResourceView());
+   m_commandBackend.Replace(m_passResources.ssaoResolvedUav, pResolved->GetUnorderedAccessView());
+   m_commandBackend.Replace(m_passResources.ssaoHistorySrv, pHistory->GetShaderResourceView());
+
+   // So does the anti-aliasing's color
+   RWComputeSurface *pTaaResolved = m_pTaaSurfaces[m_taaFrame & 1];
+   RWComputeSurface *pTaaHistory = m_pTaaSurfaces[(m_taaFrame + 1) & 1];
+   m_commandBackend.Replace(m_passResources.taaResolvedSrv, pTaaResolved->GetShaderResourceView());
+   m_commandBackend.Replace(m_passResources.taaResolvedUav, pTaaResolved->GetUnorderedAccessView());
+   m_commandBackend.Replace(m_passResources.taaHistorySrv, pTaaHistory->GetShaderResourceView());
+
+   RenderGraphPassMode shadowMode = m_shadowUpdate == SHADOW_CACHE_FULL ? GRAPH_PASS_RUN :
+      (m_shadowUpdate == SHADOW_CACHE_PARTIAL ? GRAPH_PASS_RUN_WITHOUT_CLEARS : GRAPH_PASS_SKIP);
+   RenderGraphPassMode vplMode = m_updateVpls ? GRAPH_PASS_RUN : GRAPH_PASS_SKIP;
+   m_renderGraph.SetPassMode(m_graphPasses.culling[SHADOW_PASS],
+      m_shadowUpdate == SHADOW_CACHE_FULL ? GRAPH_PASS_RUN : GRAPH_PASS_SKIP);
+   m_renderGraph.SetPassMode(m_graphPasses.scenePasses[SHADOW_PASS], shadowMode);
+   m_renderGraph.SetPassMode(m_graphPasses.vplFlux, vplMode);
+   m_renderGraph.SetPassMode(m_graphPasses.lightBuffer, vplMode);
+   m_renderGraph.SetPassMode(m_graphPasses.lightBinning, vplMode);
+
+   // Without transparent draws the lists would stay empty
+   RenderGraphPassMode listMode = m_numTransparentDraws > 0 && m_oitTechnique == OIT_TECHNIQUE_ABUFFER ?
+      GRAPH_PASS_RUN : GRAPH_PASS_SKIP;
+   RenderGraphPassMode weightedMode = m_numTransparentDraws > 0 && m_oitTechnique == OIT_TECHNIQUE_WEIGHTED ?
+      GRAPH_PASS_RUN : GRAPH_PASS_SKIP;
+   m_renderGraph.SetPassMode(m_graphPasses.transparent, listMode);
+   m_renderGraph.SetPassMode(m_graphPasses.oitResolve, listMode);
+   m_renderGraph.SetPassMode(m_graphPasses.weightedTransparent, weightedMode);
+   m_renderGraph.SetPassMode(m_graphPasses.weightedComposite, weightedMode);
+
+   // With multithreaded submit the graph's execution already sends the
+   // work before each scene pass and the passes' command lists to the
+   // immediate context, so the frame's timing starts ahead of it
+   m_frameScales[m_pGpuTimer->GetFrame() % GpuTimer::NUM_FRAMES] = (float)m_renderWidth / (float)m_width;
+   m_pGpuTimer->Begin(m_d3dContext);
+   m_renderGraph.Execute(&m_frameCommands);
+   m_commandBackend.Execute(m_d3dContext, m_frameCommands);
+   m_pGpuTimer->End(m_d3dContext);
+
+   // The time read back belongs to a frame a few frames old, the
+   // controller is told the scale that frame was drawn at
+   UINT timedFrame;
+   if (m_pGpuTimer->Read(m_d3dContext, &m_gpuFrameMs, &timedFrame) && m_passResources.dynamicResolution)
+   {
+      m_pResolutionController->Update((float)m_gpuFrameMs, m_frameScales[timedFrame % GpuTimer::NUM_FRAMES]);
+   }
+   if (m_numTransparentDraws > 0)
+   {
+      ReadOitNodeCount();
+   }
+   else
+   {
+      m_oitMeasuredNodes = 0;
+   }
+   if (m_captureRsm)
+   {
+      SaveRsmCapture();
+      SaveSsaoCapture();
+      SaveCoarseVplCapture();
+      m_captureRsm = FALSE;
+   }
+   m_ssaoFrame++;
+   m_ssaoHistoryValid = TRUE;
+   if (m_passResources.temporalAA)
+   {
+      m_taaFrame++;
+      m_taaHistoryValid = TRUE;
+   }
+   m_frameStats.AddTime("submit", submitTimer.GetElapsedMs());
+
+   m_swapChain->Present(0, 0);
+
+   m_frameStats.SetCounter("draws", (double)(m_numFrameDraws * NUM_SCENE_PASSES));
+   m_frameStats.SetCounter("workers", m_multithreadedSubmit ? (double)m_pRecorder->GetNumWorkers() : 1.0);
+   m_frameStats.SetCounter("gpu culling", m_passResources.gpuCulling ? 1.0 : 0.0);
+   m_frameStats.SetCounter("lights", (double)m_numDynamicLights);
+   m_frameStats.SetCounter("gpu clusters", m_passResources.gpuClusterAssignment ? 1.0 : 0.0);
+   m_frameStats.SetCounter("target vpls", (double)m_vplConstants.targetVpls);
+
+   UINT numCascadeDraws = 0;
+   for (size_t i = 0; i < m_cascadeDrawMasks.size(); i++)
+   {
+      for (UINT cascade = 0; cascade < NUM_SHADOW_CASCADES; cascade++)
       {
-         ID3D11RenderTargetView *pNullRtv[] = { NULL, NULL };
-
-         m_d3dContext->OMSetRenderTargets(2, pNullRtv, NULL);
-
-         ID3D11ShaderResourceView *pSrv[] = { 
-            m_pShadowMap->GetShaderResourceView(),
-            m_pLightMap->GetShaderResourceView() };
-         ID3D11UnorderedAccessView *pUav[] = { 
-            m_pBlurredShadowSurface->GetUnorderedAccessView(),
-            m_pLightBuffer->GetUnorderedAccessView() };
-
-         UINT initialCounts[] = {
-            0,
-            0 };
-
-         m_d3dContext->CSSetShader(m_blurCS, NULL, 0);
-         m_d3dContext->CSSetShaderResources(0, 2, pSrv);
-         m_d3dContext->CSSetUnorderedAccessViews(0, 2, pUav, initialCounts);
-         m_d3dContext->Dispatch(m_shadowMapWidth, m_shadowMapHeight, 1);
-
-         ID3D11UnorderedAccessView *pNullUav[] = { NULL, NULL };
-         ID3D11ShaderResourceView *pNullSrv[] = { NULL, NULL };
-
-         m_d3dContext->CSSetShaderResources(0, 2, pNullSrv);
-         m_d3dContext->CSSetUnorderedAccessViews(0, 2, pNullUav, NULL);
-
-         // Prepare the setup for actual rendering
-         ID3D11UnorderedAccessView *pFirstPassUav[] = { m_uav, m_colorBufferDepthUAV };
-         ID3D11RenderTargetView *pFirstPassRtv[] = { 
-            m_backBufferTarget };
-         
-         ID3D11ShaderResourceView *pShadowSrv[] = {
-            m_pBlurredShadowSurface->GetShaderResourceView(),
-            m_pLightBuffer->GetShaderResourceView()
-         };
-         
-         m_d3dContext->RSSetViewports(1, &m_viewport);
-         m_d3dContext->IASetInputLayout( m_inputLayout );
-         m_d3dContext->VSSetShader(m_solidColorVS, 0, 0);
-         m_d3dContext->OMSetRenderTargetsAndUnorderedAccessViews(1, pFirstPassRtv, m_DepthStencilView, 3, 2, pFirstPassUav, NULL);
-         m_d3dContext->PSSetShaderResources(1 , 2, pShadowSrv);
-         m_pTransformConstants->SetData(m_d3dContext, &m_vsTransConstBuf);
+         if (m_cascadeDrawMasks[i] & (1 << cascade)) numCascadeDraws++;
       }
+   }
+   m_frameStats.SetCounter("cascade draws", (double)numCascadeDraws);
+   m_frameStats.SetCounter("pcf taps", (double)(m_pcfTapsSqrt * m_pcfTapsSqrt));
+   m_frameStats.SetCounter("evsm", m_passResources.shadowFilter == SHADOW_FILTER_EVSM ? 1.0 : 0.0);
+   m_frameStats.SetCounter("evsm blur radius", (double)m_evsmSettings.blurRadius);
+   m_frameStats.SetCounter("light bleed reduction", (double)m_evsmSettings.lightBleedReduction);
+   m_frameStats.SetCounter("shadow skipped", m_shadowUpdate == SHADOW_CACHE_SKIP ? 1.0 : 0.0);
+   m_frameStats.SetCounter("shadow partial", m_shadowUpdate == SHADOW_CACHE_PARTIAL ? 1.0 : 0.0);
+   m_frameStats.SetCounter("shadow texels", (double)GetRectArea(m_pShadowCache->GetDirtyRect()));
+   m_frameStats.SetCounter("vpl skipped", m_updateVpls ? 0.0 : 1.0);
+   m_frameStats.SetCounter("light map width", (double)m_shadowMapWidth);
+   m_frameStats.SetCounter("cascade size", (double)m_cascadeSize);
+   m_frameStats.SetCounter("ssao", m_ssaoEnabled ? 1.0 : 0.0);
+   m_frameStats.SetCounter("ssao temporal", m_ssaoTemporal ? 1.0 : 0.0);
+   m_frameStats.SetCounter("taa", m_passResources.temporalAA ? 1.0 : 0.0);
+   m_frameStats.SetCounter("gpu ms", m_gpuFrameMs);
+   m_frameStats.SetCounter("dynamic resolution", m_passResources.dynamicResolution ? 1.0 : 0.0);
+   m_frameStats.SetCounter("render scale", (double)m_renderWidth / (double)m_width);
+   m_frameStats.SetCounter("coarse vpl", m_passResources.coarseVpl && !m_passResources.deferredShading &&
+      !m_passResources.irradianceProbes ? 1.0 : 0.0);
+   m_frameStats.SetCounter("irradiance probes", m_passResources.irradianceProbes ? 1.0 : 0.0);
+
+   ShadingBandwidth bandwidth;
+   GBufferLayout layout;
+   GetGBufferLayout(GBUFFER_LAYOUT_COMPACT, &layout);
+   if (m_passResources.deferredShading) ComputeDeferredBandwidth(layout, 1.0f, &bandwidth);
+   else ComputeForwardBandwidth(1.0f, &bandwidth);
+   m_frameStats.SetCounter("deferred", m_passResources.deferredShading ? 1.0 : 0.0);
+   m_frameStats.SetCounter("shading bytes/pixel", bandwidth.totalBytes);
+   m_frameStats.SetCounter("depth prepass", m_passResources.depthPrepass ? 1.0 : 0.0);
+   m_frameStats.SetCounter("overdraw", GetOverdraw(m_overdrawEstimate));
+   m_frameStats.SetCounter("prepass saved %", 100.0 * GetSavedShadingFraction(m_overdrawEstimate));
+   m_frameStats.SetCounter("transparent draws", (double)m_numTransparentDraws);
+   m_frameStats.SetCounter("oit fragments", (double)m_oitMeasuredNodes);
+   m_frameStats.SetCounter("oit MB", GetABufferBytes(m_width, m_height, m_oitCapacity) / (1024.0 * 1024.0));
+
+   // What either technique costs for the fragments of the current one, the
+   // lists at the capacity they would be sized to
+   OitTraffic listTraffic, weightedTraffic;
+   EstimateABufferTraffic(m_width, m_height, m_oitMeasuredNodes, &listTraffic);
+   EstimateWeightedOitTraffic(m_width, m_height, m_oitMeasuredNodes, &weightedTraffic);
+   UINT listCapacity = ChooseABufferCapacity(m_abufferSettings, m_oitMeasuredNodes, 0, m_width, m_height);
+   m_frameStats.SetCounter("weighted oit", m_oitTechnique == OIT_TECHNIQUE_WEIGHTED ? 1.0 : 0.0);
+   m_frameStats.SetCounter("abuffer sized MB", GetABufferBytes(m_width, m_height, listCapacity) / (1024.0 * 1024.0));
+   m_frameStats.SetCounter("wboit MB", GetWeightedOitBytes(m_width, m_height) / (1024.0 * 1024.0));
+   m_frameStats.SetCounter("abuffer traffic MB", listTraffic.totalBytes / (1024.0 * 1024.0));
+   m_frameStats.SetCounter("wboit traffic MB", weightedTraffic.totalBytes / (1024.0 * 1024.0));
+
+   string report;
+   if (m_frameStats.EndFrame(&report))
+   {
+      OutputDebugStringA(report.c_str());
+   }
+}
 
-      for (UINT i = 0; i < scene.size(); i++)
+void Renderer::RecordRsmCapture(CommandBuffer *pCmds)
+{
+   if (!m_pRsmStaging[0])
+   {
+      DXGI_FORMAT formats[2] = { DXGI_FORMAT_R32G32B32A32_FLOAT, DXGI_FORMAT_R32_TYPELESS };
+      for (UINT i = 0; i < 2; i++)
       {
-         auto pMat = &m_matList[scene[i].m_MaterialIndex];
-         if( pMat->m_texture )
+         D3D11_TEXTURE2D_DESC texDesc;
+         ZeroMemory(&texDesc, sizeof(texDesc));
+         texDesc.Width = m_shadowMapWidth;
+         texDesc.Height = m_shadowMapHeight;
+         texDesc.MipLevels = 1;
+         texDesc.ArraySize = 1;
+         texDesc.Format = formats[i];
+         texDesc.SampleDesc.Count = 1;
+         texDesc.Usage = D3D11_USAGE_STAGING;
+         texDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+         if (FAILED(m_d3dDevice->CreateTexture2D(&texDesc, NULL, &m_pRsmStaging[i])))
          {
-            m_d3dContext->PSSetShaderResources(0 , 1, &pMat->m_texture);
-            if( draw == 0)
-            {
-               m_d3dContext->PSSetShader(m_textureNoShadingPS, 0, 0);
-            }
-            else
+            // The next capture tries again from scratch
+            OutputDebugStringA("Could not create the staging textures of " RSM_CAPTURE_FILE "\n");
+            for (UINT j = 0; j < i; j++)
             {
-               m_d3dContext->PSSetShader(m_texturePS, 0, 0);
+               m_pRsmStaging[j]->Release();
+               m_pRsmStaging[j] = NULL;
             }
+            m_pRsmStaging[i] = NULL;
+            return;
+         }
+         if (m_rsmStagingHandles[i] == NULL_HANDLE)
+         {
+            m_rsmStagingHandles[i] = m_commandBackend.Register(m_pRsmStaging[i]);
          }
          else
          {
-            m_d3dContext->PSSetShaderResources(0 , 1, &pMat->m_texture);
-            m_d3dContext->PSSetShader(m_solidColorPS, 0, 0);
+            m_commandBackend.Replace(m_rsmStagingHandles[i], m_pRsmStaging[i]);
          }
-
-         m_d3dContext->IASetVertexBuffers( 0, 1, &scene[i].m_vertexBuffer, &stride,  &offset);
-         m_d3dContext->IASetIndexBuffer(scene[i].m_indexBuffer, DXGI_FORMAT_R32_UINT, 0);
-         m_d3dContext->PSSetConstantBuffers(0 , 1, &pMat->m_materialConstantBuffer);
-         m_d3dContext->DrawIndexed(scene[i].m_numIndices, 0, 0);
       }
    }
-   
-   // Clear our the SRVs
-   ID3D11ShaderResourceView *pNullSrv[] = { NULL, NULL, NULL, NULL };
-   m_d3dContext->PSSetShaderResources(1 , 4, pNullSrv);
-   m_swapChain->Present(0, 0);
+
+   // The light buffer pass always runs on a capture frame, even when the
+   // cached light map did not change
+   UINT lightMap = m_renderGraph.GetPhysicalTexture(m_graphPasses.lightMap);
+   UINT shadowDepth = m_renderGraph.GetPhysicalTexture(m_graphPasses.shadowDepth);
+   pCmds->CopyResource(m_rsmStagingHandles[0], m_transientTextures.GetTexture(lightMap));
+   pCmds->CopyResource(m_rsmStagingHandles[1], m_transientTextures.GetTexture(shadowDepth));
 }
 
-bool Renderer::LoadContent() 
+void Renderer::SaveRsmCapture()
 {
-	m_viewport.Width = static_cast<FLOAT>(m_width);
-	m_viewport.Height = static_cast<FLOAT>(m_height);
-	m_viewport.MinDepth = 0.0f;
-	m_viewport.MaxDepth = 1.0f;
-	m_viewport.TopLeftX = 0.0f;
-	m_viewport.TopLeftY = 0.0f;
+   if (!m_pRsmStaging[0]) return;
 
-   m_shadowMapHeight = m_height;
-   m_shadowMapWidth = m_width;
-   m_pShadowMap = new ShadowMap(m_d3dDevice, m_shadowMapWidth, m_shadowMapHeight);
-   m_pBlurredShadowMap = new RWRenderTarget(m_d3dDevice, m_shadowMapWidth, m_shadowMapHeight);
-   m_pBlurredShadowSurface = new RWComputeSurface(m_d3dDevice,  m_shadowMapWidth, m_shadowMapHeight);
-   m_pLightMap = new RWRenderTarget(m_d3dDevice, m_shadowMapWidth, m_shadowMapHeight);
-   m_pLightBuffer = new RWStructuredBuffer<PS_Point_Light>(m_d3dDevice, 24 * 32);
+   ReflectiveShadowMap rsm;
+   rsm.width = m_shadowMapWidth;
+   rsm.height = m_shadowMapHeight;
+   rsm.flux.resize(rsm.width * rsm.height * 4);
+   rsm.depth.resize(rsm.width * rsm.height);
 
-   m_pPlaneRenderer = new PlaneRenderer(m_d3dDevice);
+   float *pDest[2] = { &rsm.flux[0], &rsm.depth[0] };
+   UINT rowSize[2] = { rsm.width * 4 * sizeof(float), rsm.width * sizeof(float) };
+   for (UINT i = 0; i < 2; i++)
+   {
+      D3D11_MAPPED_SUBRESOURCE mapped;
+      if (FAILED(m_d3dContext->Map(m_pRsmStaging[i], 0, D3D11_MAP_READ, 0, &mapped)))
+      {
+         OutputDebugStringA("Could not read back " RSM_CAPTURE_FILE "\n");
+         return;
+      }
+      for (UINT y = 0; y < rsm.height; y++)
+      {
+         memcpy((char *)pDest[i] + y * rowSize[i], (const char *)mapped.pData + y * mapped.RowPitch, rowSize[i]);
+      }
+      m_d3dContext->Unmap(m_pRsmStaging[i], 0);
+   }
 
-   D3D11_RASTERIZER_DESC rasterizerDesc;
-   rasterizerDesc.FillMode = D3D11_FILL_SOLID;
-   rasterizerDesc.CullMode = D3D11_CULL_BACK;
-   rasterizerDesc.FrontCounterClockwise = FALSE;
-   rasterizerDesc.DepthBias = 0;
-   rasterizerDesc.SlopeScaledDepthBias = 0.0f;
-   rasterizerDesc.DepthBiasClamp = 0.0;
-   rasterizerDesc.DepthClipEnable = TRUE;
-   rasterizerDesc.ScissorEnable = FALSE;
-   rasterizerDesc.MultisampleEnable = FALSE;
-   rasterizerDesc.AntialiasedLineEnable = FALSE;
+   if (SaveReflectiveShadowMap(RSM_CAPTURE_FILE, rsm))
+   {
+      OutputDebugStringA("Saved the reflective shadow map to " RSM_CAPTURE_FILE "\n");
+   }
+   else
+   {
+      OutputDebugStringA("Could not write " RSM_CAPTURE_FILE "\n");
+   }
+}
 
-   HRESULT rasterResult = m_d3dDevice->CreateRasterizerState(&rasterizerDesc, &m_rasterState);
-	if (FAILED(rasterResult))
-	{
-		DXTRACE_MSG("Failed to create the rasterizer state");
-		return false;
-	}
-   
-   // Create an instance of the Importer class
-  Assimp::Importer importer;
-  // And have it read the given file with some example postprocessing
-  // Usually - if speed is not the most important aspect for you - you'll 
-  // propably to request more postprocessing than we do in this example.
-  const aiScene* AssimpScene = importer.ReadFile( "sponza.obj", 
-        aiProcess_CalcTangentSpace       | 
-        aiProcess_Triangulate            |
-        aiProcess_JoinIdenticalVertices  |
-        aiProcess_MakeLeftHanded         | 
-        aiProcess_FlipUVs                | 
-        aiProcess_FlipWindingOrder       | 
-        aiProcess_GenSmoothNormals       |
-        aiProcess_PreTransformVertices   |
-        aiProcess_SortByPType);
+void Renderer::RecordSsaoCapture(CommandBuffer *pCmds)
+{
+   if (!m_pNormalsStaging)
+   {
+      D3D11_TEXTURE2D_DESC texDesc;
+      ZeroMemory(&texDesc, sizeof(texDesc));
+      texDesc.Width = m_width;
+      texDesc.Height = m_height;
+      texDesc.MipLevels = 1;
+      texDesc.ArraySize = 1;
+      texDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+      texDesc.SampleDesc.Count = 1;
+      texDesc.Usage = D3D11_USAGE_STAGING;
+      texDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+      if (FAILED(m_d3dDevice->CreateTexture2D(&texDesc, NULL, &m_pNormalsStaging)))
+      {
+         OutputDebugStringA("Could not create the staging texture of " SSAO_CAPTURE_FILE "\n");
+         m_pNormalsStaging = NULL;
+         return;
+      }
+      m_normalsStagingHandle = m_commandBackend.Register(m_pNormalsStaging);
+   }
 
-  InitializeMatMap( AssimpScene );
-  for (UINT i = 0; i < AssimpScene->mNumMeshes; i++)
-  {
-     Mesh d3dMesh;
-     const aiMesh *pMesh = AssimpScene->mMeshes[i];
-     bool result = CreateD3DMesh(pMesh, AssimpScene, &d3dMesh);
-     if ( result != true ) return false;
-     scene.push_back(d3dMesh);
-  }
+   UINT sceneNormals = m_renderGraph.GetPhysicalTexture(m_graphPasses.sceneNormals);
+   pCmds->CopyResource(m_normalsStagingHandle, m_transientTextures.GetTexture(sceneNormals));
+}
 
-  if (AssimpScene->HasCameras())
-  {
-     assert(AssimpScene->mNumCameras == 1);
-     auto pCam = AssimpScene->mCameras[0];
-     auto pos = pCam->mPosition;
-     auto lookAt = pCam->mLookAt;
-     auto up = pCam->mUp;
-     
-     XMFLOAT3 fPos(pos.x, pos.y, pos.z);
-     XMFLOAT3 fLookAt(lookAt.x, lookAt.y, lookAt.z);
-     XMFLOAT3 fUp(up.x, up.y, up.z);
+void Renderer::SaveSsaoCapture()
+{
+   if (!m_pNormalsStaging) return;
+
+   NormalDepthBuffer buffer;
+   buffer.width = m_renderWidth;
+   buffer.height = m_renderHeight;
+   buffer.tanHalfFovX = m_ssaoConstants.tanHalfFovX;
+   buffer.tanHalfFovY = m_ssaoConstants.tanHalfFovY;
+   buffer.texels.resize(buffer.width * buffer.height * 4);
+
+   UINT rowSize = buffer.width * 4 * sizeof(float);
+   D3D11_MAPPED_SUBRESOURCE mapped;
+   if (FAILED(m_d3dContext->Map(m_pNormalsStaging, 0, D3D11_MAP_READ, 0, &mapped)))
+   {
+      OutputDebugStringA("Could not read back " SSAO_CAPTURE_FILE "\n");
+      return;
+   }
+   for (UINT y = 0; y < buffer.height; y++)
+   {
+      memcpy((char *)&buffer.texels[0] + y * rowSize, (const char *)mapped.pData + y * mapped.RowPitch, rowSize);
+   }
+   m_d3dContext->Unmap(m_pNormalsStaging, 0);
 
-     m_pCamera = new Camera(XMLoadFloat3(&fPos), XMLoadFloat3(&fLookAt), XMLoadFloat3(&fUp));
-     m_nearPlane = pCam->mClipPlaneNear;
-     m_farPlane = pCam->mClipPlaneFar;
-     m_cameraUnit = 50.0f;
-     m_fieldOfView = pCam->mHorizontalFOV * 2.0f / pCam->mAspect;
-  }
-  else
-  {
+   if (SaveNormalDepthBuffer(SSAO_CAPTURE_FILE, buffer))
+   {
+      OutputDebugStringA("Saved the scene normals to " SSAO_CAPTURE_FILE "\n");
+   }
+   else
+   {
+      OutputDebugStringA("Could not write " SSAO_CAPTURE_FILE "\n");
+   }
+}
+
+void Renderer::SaveCoarseVplCapture()
+{
+   if (SaveCoarseVplConstants(COARSE_VPL_CAPTURE_FILE, m_coarseVplConstants))
+   {
+      OutputDebugStringA("Saved the coarse VPL constants to " COARSE_VPL_CAPTURE_FILE "\n");
+   }
+   else
+   {
+      OutputDebugStringA("Could not write " COARSE_VPL_CAPTURE_FILE "\n");
+   }
+}
+
+void Renderer::BuildRenderGraph()
+{
+   m_renderGraph.Reset();
+   DeclareSceneGraph(&m_renderGraph, m_passResources, &m_graphPasses);
+
+   for (UINT pass = 0; pass < NUM_SCENE_PASSES; pass++)
+   {
+      m_renderGraph.SetPassCallback(m_graphPasses.scenePasses[pass], [this, pass](CommandBuffer *pCmds)
+      {
+         if (pass == SHADOW_PASS && m_shadowUpdate == SHADOW_CACHE_PARTIAL)
+         {
+            RecordShadowRegionUpdate(pCmds, m_passResources, m_shadowRegionItems, m_pShadowCache->GetDirtyRect());
+         }
+         else
+         {
+            SubmitScenePass(pCmds, pass, m_numFrameDraws);
+         }
+      });
+   }
+   for (UINT pass = 0; pass < NUM_SCENE_PASSES; pass++)
+   {
+      m_renderGraph.SetPassCallback(m_graphPasses.culling[pass], [this, pass](CommandBuffer *pCmds)
+      {
+         RecordInstanceCulling(pCmds, m_passResources, pass, m_cullConstants[pass]);
+      });
+   }
+   m_renderGraph.SetPassCallback(m_graphPasses.shadowCascades, [this](CommandBuffer *pCmds)
+   {
+      RecordShadowCascades(pCmds, m_passResources, m_drawItems, m_cascadeDrawMasks);
+   });
+   m_renderGraph.SetPassCallback(m_graphPasses.evsmMoments, [this](CommandBuffer *pCmds)
+   {
+      RecordEvsmMoments(pCmds, m_passResources);
+   });
+   m_renderGraph.SetPassCallback(m_graphPasses.evsmBlur.horizontal, [this](CommandBuffer *pCmds)
+   {
+      if (m_passResources.shadowFilter == SHADOW_FILTER_EVSM) RecordBlurPass(pCmds, m_passResources, m_evsmBlurConstants);
+   });
+   m_renderGraph.SetPassCallback(m_graphPasses.evsmBlur.vertical, [this](CommandBuffer *pCmds)
+   {
+      BlurConstants constants = m_evsmBlurConstants;
+      constants.horizontal = 0;
+      if (m_passResources.shadowFilter == SHADOW_FILTER_EVSM) RecordBlurPass(pCmds, m_passResources, constants);
+   });
+   m_renderGraph.SetPassCallback(m_graphPasses.evsmMips, [this](CommandBuffer *pCmds)
+   {
+      RecordEvsmMips(pCmds, m_passResources);
+   });
+   m_renderGraph.SetPassCallback(m_graphPasses.vplFlux, [this](CommandBuffer *pCmds)
+   {
+      RecordVplFlux(pCmds, m_passResources, m_vplConstants);
+   });
+   m_renderGraph.SetPassCallback(m_graphPasses.lightBuffer, [this](CommandBuffer *pCmds)
+   {
+      RecordLightBufferGeneration(pCmds, m_passResources, m_vplConstants);
+      if (m_captureRsm) RecordRsmCapture(pCmds);
+   });
+   m_renderGraph.SetPassCallback(m_graphPasses.lightBinning, [this](CommandBuffer *pCmds)
+   {
+      RecordLightBinning(pCmds, m_passResources);
+   });
+   m_renderGraph.SetPassCallback(m_graphPasses.clusterAssignment, [this](CommandBuffer *pCmds)
+   {
+      RecordClusterAssignment(pCmds, m_passResources, m_clusterConstants, m_viewLights, m_clusterAssignment);
+   });
+   m_renderGraph.SetPassCallback(m_graphPasses.normalDepth, [this](CommandBuffer *pCmds)
+   {
+      DrawChunk allDraws = { 0, (UINT)m_drawItems.size() };
+      RecordNormalDepthPass(pCmds, m_passResources, m_drawItems, allDraws);
+   });
+   m_renderGraph.SetPassCallback(m_graphPasses.ssao, [this](CommandBuffer *pCmds)
+   {
+      RecordSsao(pCmds, m_passResources);
+      if (m_captureRsm) RecordSsaoCapture(pCmds);
+   });
+   m_renderGraph.SetPassCallback(m_graphPasses.ssaoTemporal, [this](CommandBuffer *pCmds)
+   {
+      RecordSsaoTemporal(pCmds, m_passResources);
+   });
+   m_renderGraph.SetPassCallback(m_graphPasses.ssaoUpsample, [this](CommandBuffer *pCmds)
+   {
+      RecordSsaoUpsample(pCmds, m_passResources);
+   });
+   if (m_passResources.depthPrepass)
+   {
+      m_renderGraph.SetPassCallback(m_graphPasses.depthPrepass, [this](CommandBuffer *pCmds)
+      {
+         DrawChunk allDraws = { 0, m_numFrameDraws };
+         RecordDepthPrepass(pCmds, m_passResources, m_drawItems, allDraws);
+      });
+   }
+   m_renderGraph.SetPassCallback(m_graphPasses.transparent, [this](CommandBuffer *pCmds)
+   {
+      DrawChunk allDraws = { 0, m_numFrameDraws };
+      RecordTransparentPass(pCmds, m_passResources, m_drawItems, allDraws);
+   });
+   m_renderGraph.SetPassCallback(m_graphPasses.oitResolve, [this](CommandBuffer *pCmds)
+   {
+      RecordOitResolve(pCmds, m_passResources);
+      pCmds->CopyResource(m_oitCountStagingHandles[m_oitFrame % OIT_READBACK_FRAMES], m_oitNodeCountHandle);
+   });
+   m_renderGraph.SetPassCallback(m_graphPasses.weightedTransparent, [this](CommandBuffer *pCmds)
+   {
+      DrawChunk allDraws = { 0, m_numFrameDraws };
+      RecordWeightedTransparentPass(pCmds, m_passResources, m_drawItems, allDraws);
+   });
+   m_renderGraph.SetPassCallback(m_graphPasses.weightedComposite, [this](CommandBuffer *pCmds)
+   {
+      RecordWeightedOitComposite(pCmds, m_passResources);
+      pCmds->CopyResource(m_oitCountStagingHandles[m_oitFrame % OIT_READBACK_FRAMES], m_oitNodeCountHandle);
+   });
+   if (m_passResources.temporalAA)
+   {
+      m_renderGraph.SetPassCallback(m_graphPasses.taaMotion, [this](CommandBuffer *pCmds)
+      {
+         RecordTaaMotion(pCmds, m_passResources);
+      });
+      m_renderGraph.SetPassCallback(m_graphPasses.taaResolve, [this](CommandBuffer *pCmds)
+      {
+         RecordTaaResolve(pCmds, m_passResources);
+      });
+      m_renderGraph.SetPassCallback(m_graphPasses.taaSharpen, [this](CommandBuffer *pCmds)
+      {
+         RecordTaaSharpen(pCmds, m_passResources);
+      });
+   }
+   if (m_passResources.dynamicResolution)
+   {
+      m_renderGraph.SetPassCallback(m_graphPasses.upscale, [this](CommandBuffer *pCmds)
+      {
+         RecordUpscale(pCmds, m_passResources);
+      });
+   }
+   if (m_passResources.coarseVpl && !m_passResources.deferredShading && !m_passResources.irradianceProbes)
+   {
+      m_renderGraph.SetPassCallback(m_graphPasses.coarseVpl, [this](CommandBuffer *pCmds)
+      {
+         RecordCoarseVpl(pCmds, m_passResources);
+      });
+      m_renderGraph.SetPassCallback(m_graphPasses.vplUpsample, [this](CommandBuffer *pCmds)
+      {
+         RecordVplUpsample(pCmds, m_passResources);
+      });
+   }
+   if (m_passResources.deferredShading)
+   {
+      m_renderGraph.SetPassCallback(m_graphPasses.deferredLighting, [this](CommandBuffer *pCmds)
+      {
+         RecordDeferredLighting(pCmds, m_passResources);
+      });
+      m_renderGraph.SetPassCallback(m_graphPasses.deferredComposite, [this](CommandBuffer *pCmds)
+      {
+         RecordDeferredComposite(pCmds, m_passResources);
+      });
+   }
+
+   string errors;
+   m_renderGraph.SetTiledTransients(m_tiledTransients == TRUE);
+   if (!m_renderGraph.Compile(&errors))
+   {
+      OutputDebugStringA(errors.c_str());
+      assert(false);
+   }
+
+   HRESULT result = m_transientTextures.Allocate(m_d3dDevice, &m_commandBackend, &m_renderGraph);
+   if (FAILED(result) && m_tiledTransients)
+   {
+      OutputDebugStringA("Could not map the transients onto a tile pool, using committed textures\n");
+      m_tiledTransients = FALSE;
+      BuildRenderGraph();
+      return;
+   }
+   if (FAILED(result))
+   {
+      OutputDebugStringA("Could not create the render graph's transient textures\n");
+      assert(false);
+   }
+   m_pShadowCache->Invalidate();
+   OutputDebugStringA(m_renderGraph.GetScheduleReport().c_str());
+}
+
+void Renderer::ResizeShadowMaps(UINT shadowMapWidth, UINT shadowMapHeight, UINT cascadeSize)
+{
+   if (cascadeSize > MAX_SHADOW_CASCADE_SIZE) cascadeSize = MAX_SHADOW_CASCADE_SIZE;
+
+   // The staging copies are made again at the new size by the next capture
+   if (shadowMapWidth != m_shadowMapWidth || shadowMapHeight != m_shadowMapHeight)
+   {
+      for (UINT i = 0; i < 2; i++)
+      {
+         if (m_pRsmStaging[i]) m_pRsmStaging[i]->Release();
+         m_pRsmStaging[i] = NULL;
+      }
+      delete m_pShadowCache;
+      m_pShadowCache = new ShadowCache(shadowMapWidth, shadowMapHeight);
+   }
+
+   // The moments outlive the frame so they are not one of the graph's
+   // transients, the handles are pointed at the new surface
+   if (cascadeSize != m_cascadeSize)
+   {
+      delete m_pShadowMoments;
+      m_pShadowMoments = new RWComputeSurface(m_d3dDevice, cascadeSize * NUM_SHADOW_CASCADES, cascadeSize, 0);
+      m_commandBackend.Replace(m_passResources.shadowMomentsSrv, m_pShadowMoments->GetShaderResourceView());
+      m_commandBackend.Replace(m_passResources.shadowMomentsUav, m_pShadowMoments->GetUnorderedAccessView());
+   }
+
+   m_shadowMapWidth = shadowMapWidth;
+   m_shadowMapHeight = shadowMapHeight;
+   m_cascadeSize = cascadeSize;
+
+   Viewport shadowViewport = { 0.0f, 0.0f, (FLOAT)m_shadowMapWidth, (FLOAT)m_shadowMapHeight, 0.0f, 1.0f };
+   m_passResources.shadowViewport = shadowViewport;
+   m_passResources.shadowMapWidth = m_shadowMapWidth;
+   m_passResources.shadowMapHeight = m_shadowMapHeight;
+   m_passResources.cascadeSize = m_cascadeSize;
+
+   // The transients are allocated again at the new sizes
+   BuildRenderGraph();
+}
+
+void Renderer::UpdateTransparentDraws()
+{
+   for (UINT i = 0; i < m_matList.size(); i++)
+   {
+      PS_Material_Constant_Buffer constants = m_materialConstants[i];
+      if (i + 1 == m_translucentMaterial) constants.opacity = OIT_PREVIEW_OPACITY;
+      m_d3dContext->UpdateSubresource(m_matList[i].m_materialConstantBuffer, 0, NULL, &constants, 0, 0);
+   }
+
+   m_numTransparentDraws = 0;
+   for (UINT i = 0; i < m_drawItems.size(); i++)
+   {
+      UINT material = scene[m_instanceBatches[i].mesh].m_MaterialIndex;
+      float opacity = material + 1 == m_translucentMaterial ? OIT_PREVIEW_OPACITY : m_materialConstants[material].opacity;
+      m_drawItems[i].transparent = opacity < OIT_OPAQUE_ALPHA || m_matList[material].m_flags != 0;
+      if (m_drawItems[i].transparent) m_numTransparentDraws++;
+   }
+}
+
+void Renderer::ResizeOitNodes(UINT capacity)
+{
+   // The lists only live within a frame, nothing is copied over
+   delete m_pOitNodes;
+   m_pOitNodes = new RWStructuredBuffer<OitNode>(m_d3dDevice, capacity, NULL, 0);
+   m_commandBackend.Replace(m_passResources.oitNodesSrv, m_pOitNodes->GetShaderResourceView());
+   m_commandBackend.Replace(m_passResources.oitNodesUav, m_pOitNodes->GetUnorderedAccessView());
+   m_oitCapacity = capacity;
+}
+
+void Renderer::ReadOitNodeCount()
+{
+   // The next copy goes to the oldest staging buffer, written
+   // OIT_READBACK_FRAMES frames ago
+   m_oitFrame++;
+   if (m_oitFrame < OIT_READBACK_FRAMES) return;
+
+   ID3D11Buffer *pStaging = m_pOitCountStaging[m_oitFrame % OIT_READBACK_FRAMES];
+   D3D11_MAPPED_SUBRESOURCE mapped;
+   if (m_d3dContext->Map(pStaging, 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &mapped) == S_OK)
+   {
+      m_oitMeasuredNodes = *(const UINT *)mapped.pData;
+      m_d3dContext->Unmap(pStaging, 0);
+   }
+}
+
+void Renderer::RegisterPassResources()
+{
+   ScenePassResources &res = m_passResources;
+   D3D11CommandBackend &backend = m_commandBackend;
+
+   res.inputLayout = backend.Register(m_inputLayout);
+   res.rasterState = backend.Register(m_rasterState);
+   res.vertexShader = backend.Register(m_solidColorVS);
+   res.solidColorPS = backend.Register(m_solidColorPS);
+   res.texturePS = backend.Register(m_texturePS);
+   res.textureNoShadingPS = backend.Register(m_textureNoShadingPS);
+   res.blurCS = backend.Register(m_blurCS);
+   res.cullCS = backend.Register(m_cullCS);
+   res.lightBinCS = backend.Register(m_lightBinCS);
+   res.vplFluxCS = backend.Register(m_vplFluxCS);
+   res.gaussianBlurCS = backend.Register(m_gaussianBlurCS);
+   res.evsmMomentsCS = backend.Register(m_evsmMomentsCS);
+   res.clusterAssignCS = backend.Register(m_clusterAssignCS);
+   res.colorSampler = backend.Register(m_colorMapSampler);
+   res.shadowSampler = backend.Register(m_shadowSampler);
+   res.momentsSampler = backend.Register(m_momentsSampler);
+   res.planeVS = backend.Register(m_planeVS);
+   res.shadowClearPS = backend.Register(m_shadowClearPS);
+   res.scissorRasterState = backend.Register(m_scissorRasterState);
+   res.clearDepthState = backend.Register(m_clearDepthState);
+   res.normalDepthPS = backend.Register(m_normalDepthPS);
+   res.ssaoCS = backend.Register(m_ssaoCS);
+   res.ssaoTemporalCS = backend.Register(m_ssaoTemporalCS);
+   res.ssaoUpsampleCS = backend.Register(m_ssaoUpsampleCS);
+   res.gbufferPS = backend.Register(m_gbufferPS);
+   res.gbufferTexturePS = backend.Register(m_gbufferTexturePS);
+   res.deferredCompositePS = backend.Register(m_deferredCompositePS);
+   res.deferredLightingCS = backend.Register(m_deferredLightingCS);
+   res.taaMotionCS = backend.Register(m_taaMotionCS);
+   res.taaResolveCS = backend.Register(m_taaResolveCS);
+   res.taaSharpenPS = backend.Register(m_taaSharpenPS);
+   res.upscalePS = backend.Register(m_upscalePS);
+   res.coarseVplCS = backend.Register(m_coarseVplCS);
+   res.vplUpsampleCS = backend.Register(m_vplUpsampleCS);
+   res.coarseVplTexturePS = backend.Register(m_coarseVplTexturePS);
+
+   res.lightConstants = backend.Register(m_pLightConstants->GetConstantBuffer());
+   res.cameraTransformConstants = backend.Register(m_pTransformConstants->GetConstantBuffer());
+   res.lightTransformConstants = backend.Register(m_pLightTransformConstants->GetConstantBuffer());
+   res.instanceBuffer = backend.Register(m_instanceBuffer);
+   res.vplConstants = backend.Register(m_pVplConstants->GetConstantBuffer());
+   res.vplCount = backend.Register(m_pVplCount->GetConstantBuffer());
+   res.blurConstants = backend.Register(m_pBlurConstants->GetConstantBuffer());
+   for (UINT cascade = 0; cascade < NUM_SHADOW_CASCADES; cascade++)
+   {
+      res.cascadeTransformConstants[cascade] = backend.Register(m_pCascadeTransformConstants[cascade]->GetConstantBuffer());
+   }
+   res.cascadeConstants = backend.Register(m_pCascadeConstants->GetConstantBuffer());
+   res.shadowMomentsSrv = backend.Register(m_pShadowMoments->GetShaderResourceView());
+   res.shadowMomentsUav = backend.Register(m_pShadowMoments->GetUnorderedAccessView());
+   res.shadowFilter = SHADOW_FILTER_PCF;
+   res.ssaoConstants = backend.Register(m_pSsaoConstants->GetConstantBuffer());
+   res.ssaoHistorySrv = backend.Register(m_pSsaoSurfaces[1]->GetShaderResourceView());
+   res.ssaoResolvedSrv = backend.Register(m_pSsaoSurfaces[0]->GetShaderResourceView());
+   res.ssaoResolvedUav = backend.Register(m_pSsaoSurfaces[0]->GetUnorderedAccessView());
+   res.deferredConstants = backend.Register(m_pDeferredConstants->GetConstantBuffer());
+   res.deferredShading = false;
+   res.depthOnlyVS = backend.Register(m_depthOnlyVS);
+   res.equalDepthState = backend.Register(m_equalDepthState);
+   res.depthPrepass = false;
+   res.oitPS = backend.Register(m_oitPS);
+   res.oitTexturePS = backend.Register(m_oitTexturePS);
+   res.oitResolvePS = backend.Register(m_oitResolvePS);
+   res.testDepthState = backend.Register(m_testDepthState);
+   res.oitBlendState = backend.Register(m_oitBlendState);
+   res.oitNodesSrv = backend.Register(m_pOitNodes->GetShaderResourceView());
+   res.oitNodesUav = backend.Register(m_pOitNodes->GetUnorderedAccessView());
+   res.oitNodeCountUav = backend.Register(m_pOitNodeCount->GetUnorderedAccessView());
+   res.weightedOitPS = backend.Register(m_weightedOitPS);
+   res.weightedOitTexturePS = backend.Register(m_weightedOitTexturePS);
+   res.weightedOitCompositePS = backend.Register(m_weightedOitCompositePS);
+   res.weightedOitBlendState = backend.Register(m_weightedOitBlendState);
+   res.drawTransparent = false;
+   res.taaConstants = backend.Register(m_pTaaConstants->GetConstantBuffer());
+   res.taaHistorySrv = backend.Register(m_pTaaSurfaces[1]->GetShaderResourceView());
+   res.taaResolvedSrv = backend.Register(m_pTaaSurfaces[0]->GetShaderResourceView());
+   res.taaResolvedUav = backend.Register(m_pTaaSurfaces[0]->GetUnorderedAccessView());
+   res.temporalAA = true;
+   res.upscaleConstants = backend.Register(m_pUpscaleConstants->GetConstantBuffer());
+   res.dynamicResolution = true;
+   res.coarseVplConstants = backend.Register(m_pCoarseVplConstants->GetConstantBuffer());
+   res.coarseVpl = true;
+   res.coarseVplFactor = m_coarseVplSettings.factor;
+   res.irradianceProbeConstants = backend.Register(m_pIrradianceProbeConstants->GetConstantBuffer());
+   res.irradianceProbesSrv = m_pIrradianceProbes ? backend.Register(m_pIrradianceProbes->GetShaderResourceView()) :
+      NULL_HANDLE;
+   res.irradianceProbes = m_pIrradianceProbes != NULL;
+   m_oitNodeCountHandle = backend.Register(m_pOitNodeCount->GetBuffer());
+   for (UINT i = 0; i < OIT_READBACK_FRAMES; i++)
+   {
+      m_oitCountStagingHandles[i] = backend.Register(m_pOitCountStaging[i]);
+   }
+   res.cullConstants = backend.Register(m_pCullConstants->GetConstantBuffer());
+   res.cullInstancesSrv = backend.Register(m_pCullInstances->GetShaderResourceView());
+
+   res.backBufferTarget = backend.Register(m_backBufferTarget);
+   res.depthView = backend.Register(m_DepthStencilView);
+   res.lightBufferUav = backend.Register(m_pLightBuffer->GetUnorderedAccessView());
+   res.lightBufferSrv = backend.Register(m_pLightBuffer->GetShaderResourceView());
+   res.lightTilesUav = backend.Register(m_pLightTiles->GetUnorderedAccessView());
+   res.lightTilesSrv = backend.Register(m_pLightTiles->GetShaderResourceView());
+   res.lightIndicesUav = backend.Register(m_pLightIndices->GetUnorderedAccessView());
+   res.lightIndicesSrv = backend.Register(m_pLightIndices->GetShaderResourceView());
+   res.totalFluxUav = backend.Register(m_pTotalFlux->GetUnorderedAccessView());
+   res.totalFluxSrv = backend.Register(m_pTotalFlux->GetShaderResourceView());
+
+   res.clusterConstants = backend.Register(m_pClusterConstants->GetConstantBuffer());
+   res.clusterLights = backend.Register(m_pClusterLights->GetBuffer());
+   res.clusterLightsSrv = backend.Register(m_pClusterLights->GetShaderResourceView());
+   res.clusters = backend.Register(m_pClusters->GetBuffer());
+   res.clustersSrv = backend.Register(m_pClusters->GetShaderResourceView());
+   res.clustersUav = backend.Register(m_pClusters->GetUnorderedAccessView());
+   res.clusterLightIndices = backend.Register(m_pClusterLightIndices->GetBuffer());
+   res.clusterLightIndicesSrv = backend.Register(m_pClusterLightIndices->GetShaderResourceView());
+   res.clusterLightIndicesUav = backend.Register(m_pClusterLightIndices->GetUnorderedAccessView());
+   res.clusterIndexCounterUav = backend.Register(m_pClusterIndexCounter->GetUnorderedAccessView());
+   res.gpuClusterAssignment = true;
+
+   Viewport mainViewport = { m_viewport.TopLeftX, m_viewport.TopLeftY, m_viewport.Width, m_viewport.Height,
+      m_viewport.MinDepth, m_viewport.MaxDepth };
+   Viewport shadowViewport = { 0.0f, 0.0f, (FLOAT)m_shadowMapWidth, (FLOAT)m_shadowMapHeight, 0.0f, 1.0f };
+   res.mainViewport = mainViewport;
+   res.outputViewport = mainViewport;
+   res.shadowViewport = shadowViewport;
+   res.shadowMapWidth = m_shadowMapWidth;
+   res.shadowMapHeight = m_shadowMapHeight;
+   res.cascadeSize = m_cascadeSize;
+   res.vertexStride = sizeof(VertexPos);
+   res.instanceStride = sizeof(InstanceTransform);
+
+   // Materials are shared between meshes so only register them once
+   vector<ResourceHandle> materialConstants(m_matList.size());
+   vector<ResourceHandle> materialTextures(m_matList.size());
+   vector<ResourceHandle> opacityTextures(m_matList.size());
+   for (UINT i = 0; i < m_matList.size(); i++)
+   {
+      materialConstants[i] = backend.Register(m_matList[i].m_materialConstantBuffer);
+      materialTextures[i] = backend.Register(m_matList[i].m_texture);
+      opacityTextures[i] = backend.Register(m_matList[i].m_opacityTexture);
+   }
+
+   vector<ResourceHandle> vertexBuffers(scene.size());
+   vector<ResourceHandle> indexBuffers(scene.size());
+   for (UINT i = 0; i < scene.size(); i++)
+   {
+      vertexBuffers[i] = backend.Register(scene[i].m_vertexBuffer);
+      indexBuffers[i] = backend.Register(scene[i].m_indexBuffer);
+   }
+
+   // One draw per mesh covering all of its instances
+   m_drawItems.resize(m_instanceBatches.size());
+   for (UINT i = 0; i < m_instanceBatches.size(); i++)
+   {
+      const InstanceBatch &batch = m_instanceBatches[i];
+      const Mesh &mesh = scene[batch.mesh];
+      SceneDrawItem &item = m_drawItems[i];
+      item.vertexBuffer = vertexBuffers[batch.mesh];
+      item.indexBuffer = indexBuffers[batch.mesh];
+      item.materialConstants = materialConstants[mesh.m_MaterialIndex];
+      item.texture = materialTextures[mesh.m_MaterialIndex];
+      item.opacityTexture = opacityTextures[mesh.m_MaterialIndex];
+      item.numIndices = mesh.m_numIndices;
+      item.firstInstance = batch.firstInstance;
+      item.numInstances = batch.numInstances;
+   }
+   UpdateTransparentDraws();
+
+   // The argument template follows the draw items
+   vector<IndirectDrawArgs> drawArgs;
+   BuildIndirectDrawArgs(m_drawItems, &drawArgs);
+   for (UINT pass = 0; pass < NUM_SCENE_PASSES; pass++)
+   {
+      m_pDrawArgs[pass] = new IndirectArgsBuffer<IndirectDrawArgs>(m_d3dDevice, (UINT)drawArgs.size(), &drawArgs[0]);
+      res.drawArgs[pass] = backend.Register(m_pDrawArgs[pass]->GetArgsBuffer());
+      res.drawArgsTemplate[pass] = backend.Register(m_pDrawArgs[pass]->GetTemplateBuffer());
+      res.drawArgsUav[pass] = backend.Register(m_pDrawArgs[pass]->GetUnorderedAccessView());
+      res.visibleInstances[pass] = backend.Register(m_pVisibleInstances[pass]->GetBuffer());
+      res.visibleInstancesUav[pass] = backend.Register(m_pVisibleInstances[pass]->GetUnorderedAccessView());
+   }
+   res.numInstances = m_cullConstants[MAIN_PASS].numInstances;
+   res.gpuCulling = true;
+}
+
+bool Renderer::LoadContent() 
+{
+	m_viewport.Width = static_cast<FLOAT>(m_width);
+	m_viewport.Height = static_cast<FLOAT>(m_height);
+	m_viewport.MinDepth = 0.0f;
+	m_viewport.MaxDepth = 1.0f;
+	m_viewport.TopLeftX = 0.0f;
+	m_viewport.TopLeftY = 0.0f;
+
+   m_shadowMapWidth = RSM_SIZES[0][0];
+   m_shadowMapHeight = RSM_SIZES[0][1];
+   m_cascadeSize = CASCADE_SIZES[0];
+   m_pLightBuffer = new RWStructuredBuffer<PS_Point_Light>(m_d3dDevice, MAX_VPLS);
+   m_pLightTiles = new RWStructuredBuffer<LightGridTile>(m_d3dDevice, NUM_LIGHT_TILES, NULL, 0);
+   m_pLightIndices = new RWStructuredBuffer<UINT>(m_d3dDevice, NUM_LIGHT_TILES * MAX_LIGHTS_PER_TILE, NULL, 0);
+   m_pTotalFlux = new RWStructuredBuffer<UINT>(m_d3dDevice, 1, NULL, 0);
+   m_pVplConstants = new ConstantBuffer<VplConstants>(m_d3dDevice);
+   m_pVplCount = new ConstantBuffer<VplCount>(m_d3dDevice);
+   m_pBlurConstants = new ConstantBuffer<BlurConstants>(m_d3dDevice);
+   ZeroMemory(&m_vplConstants, sizeof(m_vplConstants));
+   m_vplConstants.targetVpls = DEFAULT_VPLS;
+
+   m_pClusterLights = new RWStructuredBuffer<ClusterLight>(m_d3dDevice, MAX_CLUSTER_LIGHTS, NULL, 0);
+   m_pClusters = new RWStructuredBuffer<ClusterHeader>(m_d3dDevice, NUM_CLUSTERS, NULL, 0);
+   m_pClusterLightIndices = new RWStructuredBuffer<UINT>(m_d3dDevice, MAX_CLUSTER_LIGHT_INDICES, NULL, 0);
+   m_pClusterIndexCounter = new RWStructuredBuffer<UINT>(m_d3dDevice, 1, NULL, 0);
+   m_pClusterConstants = new ConstantBuffer<ClusterConstants>(m_d3dDevice);
+
+   for (UINT cascade = 0; cascade < NUM_SHADOW_CASCADES; cascade++)
+   {
+      m_pCascadeTransformConstants[cascade] = new ConstantBuffer<VS_Transformation_Constant_Buffer>(m_d3dDevice);
+   }
+   m_pCascadeConstants = new ConstantBuffer<CascadeConstants>(m_d3dDevice);
+   m_pShadowMoments = new RWComputeSurface(m_d3dDevice, m_cascadeSize * NUM_SHADOW_CASCADES, m_cascadeSize, 0);
+   m_pShadowCache = new ShadowCache(m_shadowMapWidth, m_shadowMapHeight);
+   for (UINT i = 0; i < 2; i++)
+   {
+      m_pSsaoSurfaces[i] = new RWComputeSurface(m_d3dDevice, (m_width + 1) / 2, (m_height + 1) / 2);
+   }
+   m_pSsaoConstants = new ConstantBuffer<SsaoConstants>(m_d3dDevice);
+   m_pDeferredConstants = new ConstantBuffer<DeferredConstants>(m_d3dDevice);
+   for (UINT i = 0; i < 2; i++)
+   {
+      m_pTaaSurfaces[i] = new RWComputeSurface(m_d3dDevice, m_width, m_height);
+   }
+   m_pTaaConstants = new ConstantBuffer<TaaConstants>(m_d3dDevice);
+   m_pUpscaleConstants = new ConstantBuffer<UpscaleConstants>(m_d3dDevice);
+   m_pGpuTimer = new GpuTimer();
+   HR(m_pGpuTimer->Create(m_d3dDevice));
+   m_pResolutionController = new ResolutionController(m_resolutionSettings);
+   m_pCoarseVplConstants = new ConstantBuffer<CoarseVplConstants>(m_d3dDevice);
+
+   // The node buffer starts at the smallest capacity and follows the
+   // fragment counts read back from the count's staging copies
+   m_oitCapacity = ChooseABufferCapacity(m_abufferSettings, 0, 0, m_width, m_height);
+   m_pOitNodes = new RWStructuredBuffer<OitNode>(m_d3dDevice, m_oitCapacity, NULL, 0);
+   m_pOitNodeCount = new RWStructuredBuffer<UINT>(m_d3dDevice, 1, NULL, 0);
+   D3D11_BUFFER_DESC countStagingDesc;
+   m_pOitNodeCount->GetBuffer()->GetDesc(&countStagingDesc);
+   countStagingDesc.Usage = D3D11_USAGE_STAGING;
+   countStagingDesc.BindFlags = 0;
+   countStagingDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+   for (UINT i = 0; i < OIT_READBACK_FRAMES; i++)
+   {
+      HR(m_d3dDevice->CreateBuffer(&countStagingDesc, NULL, &m_pOitCountStaging[i]));
+   }
+
+   m_pPlaneRenderer = new PlaneRenderer(m_d3dDevice);
+
+   UINT numWorkers = std::thread::hardware_concurrency();
+   if (numWorkers == 0) numWorkers = 1;
+   if (numWorkers > MAX_RECORDING_WORKERS) numWorkers = MAX_RECORDING_WORKERS;
+   m_pRecorder = new ParallelRecorder(numWorkers);
+   m_pContextPool = new DeferredContextPool();
+   HR(m_pContextPool->Create(m_d3dDevice, numWorkers, NUM_SCENE_PASSES));
+   m_workerCommands.resize(numWorkers);
+   m_multithreadedSubmit = numWorkers > 1;
+   m_drawMultiplier = 1;
+   m_numFrameDraws = 0;
+
+   D3D11_RASTERIZER_DESC rasterizerDesc;
+   rasterizerDesc.FillMode = D3D11_FILL_SOLID;
+   rasterizerDesc.CullMode = D3D11_CULL_BACK;
+   rasterizerDesc.FrontCounterClockwise = FALSE;
+   rasterizerDesc.DepthBias = 0;
+   rasterizerDesc.SlopeScaledDepthBias = 0.0f;
+   rasterizerDesc.DepthBiasClamp = 0.0;
+   rasterizerDesc.DepthClipEnable = TRUE;
+   rasterizerDesc.ScissorEnable = FALSE;
+   rasterizerDesc.MultisampleEnable = FALSE;
+   rasterizerDesc.AntialiasedLineEnable = FALSE;
+
+   HRESULT rasterResult = m_d3dDevice->CreateRasterizerState(&rasterizerDesc, &m_rasterState);
+	if (FAILED(rasterResult))
+	{
+		DXTRACE_MSG("Failed to create the rasterizer state");
+		return false;
+	}
+
+   // Partial shadow updates clip everything to the dirty rectangle and
+   // overwrite its depth regardless of what is there
+   rasterizerDesc.ScissorEnable = TRUE;
+   HR(m_d3dDevice->CreateRasterizerState(&rasterizerDesc, &m_scissorRasterState));
+
+   D3D11_DEPTH_STENCIL_DESC clearDepthDesc;
+   ZeroMemory(&clearDepthDesc, sizeof(clearDepthDesc));
+   clearDepthDesc.DepthEnable = TRUE;
+   clearDepthDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ALL;
+   clearDepthDesc.DepthFunc = D3D11_COMPARISON_ALWAYS;
+   HR(m_d3dDevice->CreateDepthStencilState(&clearDepthDesc, &m_clearDepthState));
+
+   // After a depth pre-pass only the visible fragment of each pixel passes
+   D3D11_DEPTH_STENCIL_DESC equalDepthDesc;
+   ZeroMemory(&equalDepthDesc, sizeof(equalDepthDesc));
+   equalDepthDesc.DepthEnable = TRUE;
+   equalDepthDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
+   equalDepthDesc.DepthFunc = D3D11_COMPARISON_EQUAL;
+   HR(m_d3dDevice->CreateDepthStencilState(&equalDepthDesc, &m_equalDepthState));
+
+   // Transparent fragments behind the opaque surfaces are rejected, the
+   // visible ones leave the depth alone
+   D3D11_DEPTH_STENCIL_DESC testDepthDesc;
+   ZeroMemory(&testDepthDesc, sizeof(testDepthDesc));
+   testDepthDesc.DepthEnable = TRUE;
+   testDepthDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
+   testDepthDesc.DepthFunc = D3D11_COMPARISON_LESS;
+   HR(m_d3dDevice->CreateDepthStencilState(&testDepthDesc, &m_testDepthState));
+
+   // The resolve returns the transparent fragments' blended color and the
+   // fraction of the opaque color still showing through them
+   D3D11_BLEND_DESC oitBlendDesc;
+   ZeroMemory(&oitBlendDesc, sizeof(oitBlendDesc));
+   oitBlendDesc.RenderTarget[0].BlendEnable = TRUE;
+   oitBlendDesc.RenderTarget[0].SrcBlend = D3D11_BLEND_ONE;
+   oitBlendDesc.RenderTarget[0].DestBlend = D3D11_BLEND_SRC_ALPHA;
+   oitBlendDesc.RenderTarget[0].BlendOp = D3D11_BLEND_OP_ADD;
+   oitBlendDesc.RenderTarget[0].SrcBlendAlpha = D3D11_BLEND_ZERO;
+   oitBlendDesc.RenderTarget[0].DestBlendAlpha = D3D11_BLEND_ONE;
+   oitBlendDesc.RenderTarget[0].BlendOpAlpha = D3D11_BLEND_OP_ADD;
+   oitBlendDesc.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
+   HR(m_d3dDevice->CreateBlendState(&oitBlendDesc, &m_oitBlendState));
+
+   // The weighted pass adds the weighted colors and weights into the
+   // accumulation and multiplies the revealage by 1 - alpha
+   D3D11_BLEND_DESC weightedBlendDesc;
+   ZeroMemory(&weightedBlendDesc, sizeof(weightedBlendDesc));
+   weightedBlendDesc.IndependentBlendEnable = TRUE;
+   weightedBlendDesc.RenderTarget[0].BlendEnable = TRUE;
+   weightedBlendDesc.RenderTarget[0].SrcBlend = D3D11_BLEND_ONE;
+   weightedBlendDesc.RenderTarget[0].DestBlend = D3D11_BLEND_ONE;
+   weightedBlendDesc.RenderTarget[0].BlendOp = D3D11_BLEND_OP_ADD;
+   weightedBlendDesc.RenderTarget[0].SrcBlendAlpha = D3D11_BLEND_ONE;
+   weightedBlendDesc.RenderTarget[0].DestBlendAlpha = D3D11_BLEND_ONE;
+   weightedBlendDesc.RenderTarget[0].BlendOpAlpha = D3D11_BLEND_OP_ADD;
+   weightedBlendDesc.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
+   weightedBlendDesc.RenderTarget[1].BlendEnable = TRUE;
+   weightedBlendDesc.RenderTarget[1].SrcBlend = D3D11_BLEND_ZERO;
+   weightedBlendDesc.RenderTarget[1].DestBlend = D3D11_BLEND_INV_SRC_COLOR;
+   weightedBlendDesc.RenderTarget[1].BlendOp = D3D11_BLEND_OP_ADD;
+   weightedBlendDesc.RenderTarget[1].SrcBlendAlpha = D3D11_BLEND_ZERO;
+   weightedBlendDesc.RenderTarget[1].DestBlendAlpha = D3D11_BLEND_INV_SRC_ALPHA;
+   weightedBlendDesc.RenderTarget[1].BlendOpAlpha = D3D11_BLEND_OP_ADD;
+   weightedBlendDesc.RenderTarget[1].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
+   HR(m_d3dDevice->CreateBlendState(&weightedBlendDesc, &m_weightedOitBlendState));
+   
+   // Create an instance of the Importer class
+  Assimp::Importer importer;
+  // And have it read the given file with some example postprocessing
+  // Usually - if speed is not the most important aspect for you - you'll 
+  // propably to request more postprocessing than we do in this example.
+  const aiScene* AssimpScene = importer.ReadFile( "sponza.obj", 
+        aiProcess_CalcTangentSpace       | 
+        aiProcess_Triangulate            |
+        aiProcess_JoinIdenticalVertices  |
+        aiProcess_MakeLeftHanded         | 
+        aiProcess_FlipUVs                | 
+        aiProcess_FlipWindingOrder       | 
+        aiProcess_GenSmoothNormals       |
+        aiProcess_SortByPType);
+
+  // The node hierarchy is kept so meshes referenced by several nodes are
+  // drawn instanced instead of being baked into separate vertex data
+  InitializeMatMap( AssimpScene );
+  MeshDeduplicator meshes;
+  vector<UINT> meshMap(AssimpScene->mNumMeshes);
+  for (UINT i = 0; i < AssimpScene->mNumMeshes; i++)
+  {
+     const aiMesh *pMesh = AssimpScene->mMeshes[i];
+     bool result = CreateD3DMesh(pMesh, AssimpScene, &meshes, &meshMap[i]);
+     if ( result != true ) return false;
+  }
+
+  vector<MeshInstance> instances;
+  CollectInstances(AssimpScene->mRootNode, aiMatrix4x4(), meshMap, &instances);
+
+  vector<InstanceTransform> transforms;
+  BuildInstanceBatches(instances, &transforms, &m_instanceBatches);
+
+  D3D11_BUFFER_DESC instanceDesc;
+  ZeroMemory(&instanceDesc, sizeof(instanceDesc));
+  instanceDesc.Usage = D3D11_USAGE_IMMUTABLE;
+  instanceDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+  instanceDesc.ByteWidth = static_cast<UINT>(sizeof(InstanceTransform) * transforms.size());
+
+  D3D11_SUBRESOURCE_DATA instanceData;
+  ZeroMemory(&instanceData, sizeof(instanceData));
+  instanceData.pSysMem = &transforms[0];
+  HR(m_d3dDevice->CreateBuffer(&instanceDesc, &instanceData, &m_instanceBuffer));
+
+  BuildCullInstances(m_instanceBatches, transforms, m_meshBounds, &m_cullInstances);
+  const vector<CullInstance> &cullInstances = m_cullInstances;
+  m_pCullInstances = new RWStructuredBuffer<CullInstance>(m_d3dDevice, (UINT)cullInstances.size(), &cullInstances[0], 0);
+
+  // Probes baked from the same scene, without them the forward passes keep
+  // the VPL light
+  m_pIrradianceProbeConstants = new ConstantBuffer<IrradianceProbeConstants>(m_d3dDevice);
+  if (LoadIrradianceProbes(IRRADIANCE_PROBE_FILE, &m_irradianceProbeGrid))
+  {
+     vector<float> packedProbes;
+     PackIrradianceProbes(m_irradianceProbeGrid, &packedProbes);
+     m_pIrradianceProbes = new RWStructuredBuffer<XMFLOAT4>(m_d3dDevice, (UINT)(packedProbes.size() / 4),
+        (const XMFLOAT4 *)&packedProbes[0], 0);
+     SetupIrradianceProbeConstants(m_irradianceProbeGrid, true, &m_irradianceProbeConstants);
+  }
+  else
+  {
+     OutputDebugStringA("No " IRRADIANCE_PROBE_FILE ", run with -bakeprobes to bake the irradiance probes\n");
+  }
+
+  for (UINT pass = 0; pass < NUM_SCENE_PASSES; pass++)
+  {
+     m_pVisibleInstances[pass] = new RWVertexBuffer<InstanceTransform>(m_d3dDevice, (UINT)transforms.size());
+     m_cullConstants[pass].numInstances = (UINT)cullInstances.size();
+  }
+  m_pCullConstants = new ConstantBuffer<CullConstants>(m_d3dDevice);
+
+  // Dynamic lights fill the scene's bounding box
+  float sceneMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+  float sceneMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+  for (size_t i = 0; i < cullInstances.size(); i++)
+  {
+     const BoundingSphere &bounds = cullInstances[i].bounds;
+     for (UINT c = 0; c < 3; c++)
+     {
+        if (bounds.center[c] - bounds.radius < sceneMin[c]) sceneMin[c] = bounds.center[c] - bounds.radius;
+        if (bounds.center[c] + bounds.radius > sceneMax[c]) sceneMax[c] = bounds.center[c] + bounds.radius;
+     }
+  }
+  float sceneSize = sqrtf((sceneMax[0] - sceneMin[0]) * (sceneMax[0] - sceneMin[0]) +
+     (sceneMax[1] - sceneMin[1]) * (sceneMax[1] - sceneMin[1]) + (sceneMax[2] - sceneMin[2]) * (sceneMax[2] - sceneMin[2]));
+  CreateRandomLights(sceneMin, sceneMax, MAX_CLUSTER_LIGHTS, 0.1f * sceneSize, 1, &m_dynamicLights);
+  m_sceneSize = sceneSize;
+  m_ssaoSettings.radius = 0.01f * sceneSize;
+  m_numDynamicLights = 256;
+
+  InstancingStats instancingStats = GetInstancingStats(meshes, instances);
+  std::ostringstream instancingReport;
+  instancingReport << "Instancing: " << instancingStats.numSourceMeshes << " meshes, "
+     << instancingStats.numUniqueMeshes << " unique, " << instancingStats.numInstances << " instances in "
+     << m_instanceBatches.size() << " draws, vertex data " << instancingStats.instancedVertexBytes
+     << " bytes instead of " << instancingStats.pretransformedVertexBytes << "\n";
+  OutputDebugStringA(instancingReport.str().c_str());
+
+  if (AssimpScene->HasCameras())
+  {
+     assert(AssimpScene->mNumCameras == 1);
+     auto pCam = AssimpScene->mCameras[0];
+     auto pos = pCam->mPosition;
+     auto lookAt = pCam->mLookAt;
+     auto up = pCam->mUp;
+     
+     XMFLOAT3 fPos(pos.x, pos.y, pos.z);
+     XMFLOAT3 fLookAt(lookAt.x, lookAt.y, lookAt.z);
+     XMFLOAT3 fUp(up.x, up.y, up.z);
+
+     m_pCamera = new Camera(XMLoadFloat3(&fPos), XMLoadFloat3(&fLookAt), XMLoadFloat3(&fUp));
+     m_nearPlane = pCam->mClipPlaneNear;
+     m_farPlane = pCam->mClipPlaneFar;
+     m_cameraUnit = 50.0f;
+     m_fieldOfView = pCam->mHorizontalFOV * 2.0f / pCam->mAspect;
+  }
+  else
+  {
      XMFLOAT3 pos(0.0f, 1.0f, 0.0f);
      XMFLOAT3 lookAt(1.0f, 0.0f, 0.0f);
      XMFLOAT3 up(0.0f, 1.0f, 0.0f);
@@ -558,6 +1913,147 @@ bool Renderer::LoadContent()
    HR(m_d3dDevice->CreateComputeShader( csBuffer->GetBufferPointer(), 
 		                               csBuffer->GetBufferSize(), 
 		                               NULL, &m_blurCS));
+   csBuffer->Release();
+
+   if( !D3DUtils::CompileD3DShader( "VplFluxCS.hlsl", "main", "cs_5_0", &csBuffer) )
+   {
+      MessageBox(0, "Error loading compute shader!", "Compile Error", MB_OK);
+      return false;
+   }
+   HR(m_d3dDevice->CreateComputeShader( csBuffer->GetBufferPointer(), 
+		                               csBuffer->GetBufferSize(), 
+		                               NULL, &m_vplFluxCS));
+   csBuffer->Release();
+
+   if( !D3DUtils::CompileD3DShader( "GaussianBlurCS.hlsl", "main", "cs_5_0", &csBuffer) )
+   {
+      MessageBox(0, "Error loading compute shader!", "Compile Error", MB_OK);
+      return false;
+   }
+   HR(m_d3dDevice->CreateComputeShader( csBuffer->GetBufferPointer(), 
+		                               csBuffer->GetBufferSize(), 
+		                               NULL, &m_gaussianBlurCS));
+   csBuffer->Release();
+
+   if( !D3DUtils::CompileD3DShader( "EvsmMomentsCS.hlsl", "main", "cs_5_0", &csBuffer) )
+   {
+      MessageBox(0, "Error loading compute shader!", "Compile Error", MB_OK);
+      return false;
+   }
+   HR(m_d3dDevice->CreateComputeShader( csBuffer->GetBufferPointer(), 
+		                               csBuffer->GetBufferSize(), 
+		                               NULL, &m_evsmMomentsCS));
+   csBuffer->Release();
+
+   if( !D3DUtils::CompileD3DShader( "SsaoCS.hlsl", "main", "cs_5_0", &csBuffer) )
+   {
+      MessageBox(0, "Error loading compute shader!", "Compile Error", MB_OK);
+      return false;
+   }
+   HR(m_d3dDevice->CreateComputeShader( csBuffer->GetBufferPointer(), 
+		                               csBuffer->GetBufferSize(), 
+		                               NULL, &m_ssaoCS));
+   csBuffer->Release();
+
+   if( !D3DUtils::CompileD3DShader( "SsaoTemporalCS.hlsl", "main", "cs_5_0", &csBuffer) )
+   {
+      MessageBox(0, "Error loading compute shader!", "Compile Error", MB_OK);
+      return false;
+   }
+   HR(m_d3dDevice->CreateComputeShader( csBuffer->GetBufferPointer(), 
+		                               csBuffer->GetBufferSize(), 
+		                               NULL, &m_ssaoTemporalCS));
+   csBuffer->Release();
+
+   if( !D3DUtils::CompileD3DShader( "SsaoUpsampleCS.hlsl", "main", "cs_5_0", &csBuffer) )
+   {
+      MessageBox(0, "Error loading compute shader!", "Compile Error", MB_OK);
+      return false;
+   }
+   HR(m_d3dDevice->CreateComputeShader( csBuffer->GetBufferPointer(), 
+		                               csBuffer->GetBufferSize(), 
+		                               NULL, &m_ssaoUpsampleCS));
+   csBuffer->Release();
+
+   if( !D3DUtils::CompileD3DShader( "TaaMotionCS.hlsl", "main", "cs_5_0", &csBuffer) )
+   {
+      MessageBox(0, "Error loading compute shader!", "Compile Error", MB_OK);
+      return false;
+   }
+   HR(m_d3dDevice->CreateComputeShader( csBuffer->GetBufferPointer(), 
+		                               csBuffer->GetBufferSize(), 
+		                               NULL, &m_taaMotionCS));
+   csBuffer->Release();
+
+   if( !D3DUtils::CompileD3DShader( "TaaResolveCS.hlsl", "main", "cs_5_0", &csBuffer) )
+   {
+      MessageBox(0, "Error loading compute shader!", "Compile Error", MB_OK);
+      return false;
+   }
+   HR(m_d3dDevice->CreateComputeShader( csBuffer->GetBufferPointer(), 
+		                               csBuffer->GetBufferSize(), 
+		                               NULL, &m_taaResolveCS));
+   csBuffer->Release();
+
+   if( !D3DUtils::CompileD3DShader( "VplShadingCS.hlsl", "coarseMain", "cs_5_0", &csBuffer) )
+   {
+      MessageBox(0, "Error loading compute shader!", "Compile Error", MB_OK);
+      return false;
+   }
+   HR(m_d3dDevice->CreateComputeShader( csBuffer->GetBufferPointer(), 
+		                               csBuffer->GetBufferSize(), 
+		                               NULL, &m_coarseVplCS));
+   csBuffer->Release();
+
+   if( !D3DUtils::CompileD3DShader( "VplShadingCS.hlsl", "upsampleMain", "cs_5_0", &csBuffer) )
+   {
+      MessageBox(0, "Error loading compute shader!", "Compile Error", MB_OK);
+      return false;
+   }
+   HR(m_d3dDevice->CreateComputeShader( csBuffer->GetBufferPointer(), 
+		                               csBuffer->GetBufferSize(), 
+		                               NULL, &m_vplUpsampleCS));
+   csBuffer->Release();
+
+   if( !D3DUtils::CompileD3DShader( "DeferredLightingCS.hlsl", "main", "cs_5_0", &csBuffer) )
+   {
+      MessageBox(0, "Error loading compute shader!", "Compile Error", MB_OK);
+      return false;
+   }
+   HR(m_d3dDevice->CreateComputeShader( csBuffer->GetBufferPointer(), 
+		                               csBuffer->GetBufferSize(), 
+		                               NULL, &m_deferredLightingCS));
+   csBuffer->Release();
+
+   if( !D3DUtils::CompileD3DShader( "CullCS.hlsl", "main", "cs_5_0", &csBuffer) )
+   {
+      MessageBox(0, "Error loading compute shader!", "Compile Error", MB_OK);
+      return false;
+   }
+   HR(m_d3dDevice->CreateComputeShader( csBuffer->GetBufferPointer(), 
+		                               csBuffer->GetBufferSize(), 
+		                               NULL, &m_cullCS));
+   csBuffer->Release();
+
+   if( !D3DUtils::CompileD3DShader( "LightBinCS.hlsl", "main", "cs_5_0", &csBuffer) )
+   {
+      MessageBox(0, "Error loading compute shader!", "Compile Error", MB_OK);
+      return false;
+   }
+   HR(m_d3dDevice->CreateComputeShader( csBuffer->GetBufferPointer(), 
+		                               csBuffer->GetBufferSize(), 
+		                               NULL, &m_lightBinCS));
+   csBuffer->Release();
+
+   if( !D3DUtils::CompileD3DShader( "ClusterAssignCS.hlsl", "main", "cs_5_0", &csBuffer) )
+   {
+      MessageBox(0, "Error loading compute shader!", "Compile Error", MB_OK);
+      return false;
+   }
+   HR(m_d3dDevice->CreateComputeShader( csBuffer->GetBufferPointer(), 
+		                               csBuffer->GetBufferSize(), 
+		                               NULL, &m_clusterAssignCS));
+   csBuffer->Release();
 
    ID3DBlob* vsBuffer = 0;
    BOOL compileResult = D3DUtils::CompileD3DShader("PlainVert.hlsl", "main", "vs_5_0", &vsBuffer);
@@ -572,6 +2068,22 @@ bool Renderer::LoadContent()
          0, 
          &m_solidColorVS));
    
+   ID3DBlob* vsDepthOnlyBuffer = 0;
+   compileResult = D3DUtils::CompileD3DShader("PlainVert.hlsl", "depthOnly", "vs_5_0", &vsDepthOnlyBuffer);
+   if( compileResult == false )
+   {
+      MessageBox(0, "Error loading vertex shader!", "Compile Error", MB_OK);
+      return false;
+   }
+
+   HR(m_d3dDevice->CreateVertexShader(
+         vsDepthOnlyBuffer->GetBufferPointer(), 
+         vsDepthOnlyBuffer->GetBufferSize(), 
+         0,
+         &m_depthOnlyVS));
+
+   vsDepthOnlyBuffer->Release();
+
    ID3DBlob* vsPlaneBuffer = 0;
    compileResult = D3DUtils::CompileD3DShader("PlaneVertexShader.hlsl", "main", "vs_5_0", &vsPlaneBuffer);
    if( compileResult == false )
@@ -592,7 +2104,11 @@ bool Renderer::LoadContent()
    {
       {"POSITION", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0},
       {"TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 16, D3D11_INPUT_PER_VERTEX_DATA, 0},
-      {"NORMAL",   0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 24, D3D11_INPUT_PER_VERTEX_DATA, 0}
+      {"NORMAL",   0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 24, D3D11_INPUT_PER_VERTEX_DATA, 0},
+      {"WORLD",    0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 0, D3D11_INPUT_PER_INSTANCE_DATA, 1},
+      {"WORLD",    1, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 16, D3D11_INPUT_PER_INSTANCE_DATA, 1},
+      {"WORLD",    2, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 32, D3D11_INPUT_PER_INSTANCE_DATA, 1},
+      {"WORLD",    3, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 48, D3D11_INPUT_PER_INSTANCE_DATA, 1}
    };
 
    unsigned int totalLayoutElements = ARRAYSIZE( solidColorLayout );
@@ -610,18 +2126,89 @@ bool Renderer::LoadContent()
       &m_solidColorPS));
 
    HR(D3DUtils::CreatePixelShader(
-     m_d3dDevice,
-     "GIPixel.hlsl", 
-     "main", 
-     "ps_5_0", 
-     &m_globalIlluminationPS));
+      m_d3dDevice,
+      "NormalDepthPS.hlsl", 
+      "main", 
+      "ps_5_0", 
+      &m_normalDepthPS));
+
+   HR(D3DUtils::CreatePixelShader(
+      m_d3dDevice,
+      "GBufferPS.hlsl", 
+      "main", 
+      "ps_5_0", 
+      &m_gbufferPS));
+
+   HR(D3DUtils::CreatePixelShader(
+      m_d3dDevice,
+      "GBufferPS.hlsl", 
+      "texMain", 
+      "ps_5_0", 
+      &m_gbufferTexturePS));
 
    HR(D3DUtils::CreatePixelShader(
-     m_d3dDevice,
-     "BlurPixel.hlsl", 
-     "main", 
-     "ps_5_0", 
-     &m_blurPS));
+      m_d3dDevice,
+      "DeferredCompositePS.hlsl", 
+      "main", 
+      "ps_5_0", 
+      &m_deferredCompositePS));
+
+   HR(D3DUtils::CreatePixelShader(
+      m_d3dDevice,
+      "PlainPixel.hlsl", 
+      "oitMain", 
+      "ps_5_0", 
+      &m_oitPS));
+
+   HR(D3DUtils::CreatePixelShader(
+      m_d3dDevice,
+      "PlainPixel.hlsl", 
+      "oitTexMain", 
+      "ps_5_0", 
+      &m_oitTexturePS));
+
+   HR(D3DUtils::CreatePixelShader(
+      m_d3dDevice,
+      "OitResolvePS.hlsl", 
+      "main", 
+      "ps_5_0", 
+      &m_oitResolvePS));
+
+   HR(D3DUtils::CreatePixelShader(
+      m_d3dDevice,
+      "PlainPixel.hlsl", 
+      "weightedOitMain", 
+      "ps_5_0", 
+      &m_weightedOitPS));
+
+   HR(D3DUtils::CreatePixelShader(
+      m_d3dDevice,
+      "PlainPixel.hlsl", 
+      "weightedOitTexMain", 
+      "ps_5_0", 
+      &m_weightedOitTexturePS));
+
+   HR(D3DUtils::CreatePixelShader(
+      m_d3dDevice,
+      "WeightedOitCompositePS.hlsl", 
+      "main", 
+      "ps_5_0", 
+      &m_weightedOitCompositePS));
+
+   HR(D3DUtils::CreatePixelShader(
+      m_d3dDevice,
+      "TaaSharpenPS.hlsl", 
+      "main", 
+      "ps_5_0", 
+      &m_taaSharpenPS));
+
+   HR(D3DUtils::CreatePixelShader(
+      m_d3dDevice,
+      "UpscalePS.hlsl", 
+      "main", 
+      "ps_5_0", 
+      &m_upscalePS));
+
    
    HR(D3DUtils::CreatePixelShader(
       m_d3dDevice,
@@ -630,6 +2217,13 @@ bool Renderer::LoadContent()
       "ps_5_0", 
       &m_texturePS ));
 
+   HR(D3DUtils::CreatePixelShader(
+      m_d3dDevice,
+      "PlainPixel.hlsl", 
+      "texMainCoarseVpl", 
+      "ps_5_0", 
+      &m_coarseVplTexturePS ));
+
    HR(D3DUtils::CreatePixelShader(
       m_d3dDevice,
       "TextureShader.hlsl", 
@@ -637,10 +2231,18 @@ bool Renderer::LoadContent()
       "ps_5_0", 
       &m_textureNoShadingPS ));
 
+   HR(D3DUtils::CreatePixelShader(
+      m_d3dDevice,
+      "ShadowClearPS.hlsl", 
+      "main", 
+      "ps_5_0", 
+      &m_shadowClearPS ));
+
    VS_Transformation_Constant_Buffer vsConstBuf;
    vsConstBuf.mvp = XMMatrixIdentity();
 
    m_pTransformConstants = new ConstantBuffer<VS_Transformation_Constant_Buffer>(m_d3dDevice);
+   m_pLightTransformConstants = new ConstantBuffer<VS_Transformation_Constant_Buffer>(m_d3dDevice);
 
    D3D11_SAMPLER_DESC colorMapDesc;
    ZeroMemory( &colorMapDesc, sizeof( colorMapDesc ));
@@ -658,78 +2260,94 @@ bool Renderer::LoadContent()
    shadowSamplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
    shadowSamplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
    shadowSamplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
-   shadowSamplerDesc.ComparisonFunc = D3D11_COMPARISON_NEVER;
-   shadowSamplerDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+   shadowSamplerDesc.ComparisonFunc = D3D11_COMPARISON_LESS_EQUAL;
+   shadowSamplerDesc.Filter = D3D11_FILTER_COMPARISON_MIN_MAG_LINEAR_MIP_POINT;
    shadowSamplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
 
    HR(m_d3dDevice->CreateSamplerState( &shadowSamplerDesc, &m_shadowSampler));
 
+   D3D11_SAMPLER_DESC momentsSamplerDesc;
+   ZeroMemory( &momentsSamplerDesc, sizeof( momentsSamplerDesc ));
+   momentsSamplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
+   momentsSamplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
+   momentsSamplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+   momentsSamplerDesc.ComparisonFunc = D3D11_COMPARISON_NEVER;
+   momentsSamplerDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+   momentsSamplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
+
+   HR(m_d3dDevice->CreateSamplerState( &momentsSamplerDesc, &m_momentsSampler));
 
-   ID3D11Texture2D *colorBufferDepth;
-
-   D3D11_TEXTURE2D_DESC cbdDesc;
-   memset(&cbdDesc, 0, sizeof(cbdDesc));
-   cbdDesc.BindFlags = D3D11_BIND_UNORDERED_ACCESS;
-   cbdDesc.Format = DXGI_FORMAT_R32_UINT;
-   cbdDesc.Height = m_height;
-   cbdDesc.Width = m_width;
-   cbdDesc.MipLevels = 1;
-   cbdDesc.Usage = D3D11_USAGE_DEFAULT;
-   cbdDesc.SampleDesc.Count = 1;
-   cbdDesc.ArraySize = 1;
-   HR(m_d3dDevice->CreateTexture2D(&cbdDesc, NULL,  &colorBufferDepth));
-
-
-   D3D11_UNORDERED_ACCESS_VIEW_DESC cbdUavDesc;
-   cbdUavDesc.ViewDimension = D3D11_UAV_DIMENSION_TEXTURE2D;
-   cbdUavDesc.Format = cbdDesc.Format;
-   cbdUavDesc.Texture2D.MipSlice = 0;
-   HM(m_d3dDevice->CreateUnorderedAccessView(colorBufferDepth, &cbdUavDesc, &m_colorBufferDepthUAV),
-      "Failed to create the UAV for the color buffer depth");
-   ID3D11Texture3D *recordDepth;
-
-   D3D11_TEXTURE3D_DESC ctDesc;
-   memset(&ctDesc, 0, sizeof(ctDesc));
-   ctDesc.BindFlags = D3D11_BIND_UNORDERED_ACCESS | D3D11_BIND_SHADER_RESOURCE;
-   ctDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-   ctDesc.Depth = MAX_COLOR_BUFFER_DEPTH;
-   ctDesc.Height = m_height;
-   ctDesc.Width = m_width;
-   ctDesc.MipLevels = 1;
-   ctDesc.Usage = D3D11_USAGE_DEFAULT;
-   HR(m_d3dDevice->CreateTexture3D(&ctDesc, NULL,  &recordDepth));
-
-   D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc;
-   uavDesc.ViewDimension = D3D11_UAV_DIMENSION_TEXTURE3D;
-   uavDesc.Texture3D.MipSlice = 0;
-   uavDesc.Texture3D.FirstWSlice = 0;
-   uavDesc.Texture3D.WSize = -1;
-   uavDesc.Format = ctDesc.Format;
-   HR(m_d3dDevice->CreateUnorderedAccessView(recordDepth, &uavDesc, &m_uav));
-
-   D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
-   memset(&srvDesc, 0, sizeof(srvDesc));
-   srvDesc.Format = ctDesc.Format;
-   srvDesc.Texture3D.MipLevels = 1;
-   srvDesc.Texture3D.MostDetailedMip = 0;
-   srvDesc.ViewDimension = D3D_SRV_DIMENSION_TEXTURE3D;
-   HR(m_d3dDevice->CreateShaderResourceView(recordDepth, &srvDesc, &m_colorBufferSrv));
+   m_tiledTransients = TransientTextures::SupportsTiledResources(m_d3dDevice) ? TRUE : FALSE;
+   RegisterPassResources();
+   BuildRenderGraph();
 
    return true;
 }
 
 void Renderer::UnloadContent() 
 {
-   delete m_pShadowMap;
-   delete m_pLightMap;
-
+   m_transientTextures.Release();
    delete m_pLightBuffer;
-   
-   delete m_pBlurredShadowMap;
+   delete m_pLightTiles;
+   delete m_pLightIndices;
+   delete m_pTotalFlux;
+   delete m_pVplConstants;
+   delete m_pVplCount;
+   delete m_pBlurConstants;
+   for (UINT i = 0; i < 2; i++)
+   {
+      if( m_pRsmStaging[i] ) m_pRsmStaging[i]->Release();
+   }
+   delete m_pClusterLights;
+   delete m_pClusters;
+   delete m_pClusterLightIndices;
+   delete m_pClusterIndexCounter;
+   delete m_pClusterConstants;
+   for (UINT cascade = 0; cascade < NUM_SHADOW_CASCADES; cascade++)
+   {
+      delete m_pCascadeTransformConstants[cascade];
+   }
+   delete m_pCascadeConstants;
+   delete m_pShadowMoments;
+   delete m_pShadowCache;
+   for (UINT i = 0; i < 2; i++)
+   {
+      delete m_pSsaoSurfaces[i];
+   }
+   delete m_pSsaoConstants;
+   delete m_pDeferredConstants;
+   for (UINT i = 0; i < 2; i++)
+   {
+      delete m_pTaaSurfaces[i];
+   }
+   delete m_pTaaConstants;
+   delete m_pUpscaleConstants;
+   delete m_pGpuTimer;
+   delete m_pResolutionController;
+   delete m_pCoarseVplConstants;
+   delete m_pIrradianceProbes;
+   delete m_pIrradianceProbeConstants;
+   if( m_pNormalsStaging ) m_pNormalsStaging->Release();
+   delete m_pOitNodes;
+   delete m_pOitNodeCount;
+   for (UINT i = 0; i < OIT_READBACK_FRAMES; i++)
+   {
+      if( m_pOitCountStaging[i] ) m_pOitCountStaging[i]->Release();
+   }
+
+   delete m_pCullInstances;
+   delete m_pCullConstants;
+   for (UINT pass = 0; pass < NUM_SCENE_PASSES; pass++)
+   {
+      delete m_pDrawArgs[pass];
+      delete m_pVisibleInstances[pass];
+   }
 
-   delete m_pBlurredShadowSurface;
+   delete m_pRecorder;
+   delete m_pContextPool;
 
    delete m_pTransformConstants;
+   delete m_pLightTransformConstants;
    delete m_pLightConstants;
    delete m_pPlaneRenderer;
    delete m_pCamera;
@@ -743,6 +2361,42 @@ void Renderer::UnloadContent()
    if( m_solidColorPS ) m_solidColorPS->Release();
    if( m_solidColorVS ) m_solidColorVS->Release();
    if( m_inputLayout ) m_inputLayout->Release();
+   if( m_instanceBuffer ) m_instanceBuffer->Release();
+   if( m_cullCS ) m_cullCS->Release();
+   if( m_lightBinCS ) m_lightBinCS->Release();
+   if( m_vplFluxCS ) m_vplFluxCS->Release();
+   if( m_gaussianBlurCS ) m_gaussianBlurCS->Release();
+   if( m_evsmMomentsCS ) m_evsmMomentsCS->Release();
+   if( m_clusterAssignCS ) m_clusterAssignCS->Release();
    if( m_colorMapSampler ) m_colorMapSampler->Release();
-   if( m_uav ) m_uav->Release();
+   if( m_momentsSampler ) m_momentsSampler->Release();
+   if( m_shadowClearPS ) m_shadowClearPS->Release();
+   if( m_scissorRasterState ) m_scissorRasterState->Release();
+   if( m_clearDepthState ) m_clearDepthState->Release();
+   if( m_normalDepthPS ) m_normalDepthPS->Release();
+   if( m_ssaoCS ) m_ssaoCS->Release();
+   if( m_ssaoTemporalCS ) m_ssaoTemporalCS->Release();
+   if( m_ssaoUpsampleCS ) m_ssaoUpsampleCS->Release();
+   if( m_gbufferPS ) m_gbufferPS->Release();
+   if( m_gbufferTexturePS ) m_gbufferTexturePS->Release();
+   if( m_deferredCompositePS ) m_deferredCompositePS->Release();
+   if( m_deferredLightingCS ) m_deferredLightingCS->Release();
+   if( m_depthOnlyVS ) m_depthOnlyVS->Release();
+   if( m_equalDepthState ) m_equalDepthState->Release();
+   if( m_oitPS ) m_oitPS->Release();
+   if( m_oitTexturePS ) m_oitTexturePS->Release();
+   if( m_oitResolvePS ) m_oitResolvePS->Release();
+   if( m_testDepthState ) m_testDepthState->Release();
+   if( m_oitBlendState ) m_oitBlendState->Release();
+   if( m_weightedOitPS ) m_weightedOitPS->Release();
+   if( m_weightedOitTexturePS ) m_weightedOitTexturePS->Release();
+   if( m_weightedOitCompositePS ) m_weightedOitCompositePS->Release();
+   if( m_weightedOitBlendState ) m_weightedOitBlendState->Release();
+   if( m_taaMotionCS ) m_taaMotionCS->Release();
+   if( m_taaResolveCS ) m_taaResolveCS->Release();
+   if( m_taaSharpenPS ) m_taaSharpenPS->Release();
+   if( m_upscalePS ) m_upscalePS->Release();
+   if( m_coarseVplCS ) m_coarseVplCS->Release();
+   if( m_vplUpsampleCS ) m_vplUpsampleCS->Release();
+   if( m_coarseVplTexturePS ) m_coarseVplTexturePS->Release();
 }
\ No newline at end of file
@@ -6,12 +6,32 @@
 #include "Material.h"
 
 
-#include "ShadowMap.h"
 #include "ConstantBuffer.h"
-#include "RWRenderTarget.h"
-#include "RWComputeSurface.h"
 #include "RWStructuredBuffer.h"
+#include "RWVertexBuffer.h"
+#include "RWComputeSurface.h"
+#include "IndirectArgsBuffer.h"
 #include "PlaneRenderer.h"
+#include "DeferredContextPool.h"
+#include "TransientTextures.h"
+#include "D3D11CommandBackend.h"
+#include "ParallelRecorder.h"
+#include "ScenePasses.h"
+#include "FrameStats.h"
+#include "MeshInstancing.h"
+#include "GpuCulling.h"
+#include "LightBinning.h"
+#include "ClusteredLighting.h"
+#include "VplSampling.h"
+#include "ShadowCache.h"
+#include "ShadowCascades.h"
+#include "ABuffer.h"
+#include "WeightedOit.h"
+#include "Taa.h"
+#include "DynamicResolution.h"
+#include "GpuTimer.h"
+#include "CoarseVpl.h"
+#include "IrradianceProbes.h"
 #include "Camera.h"
 
 #include <assimp/scene.h>           // Output data structure
@@ -20,8 +40,6 @@
 #include <vector>
 #include <map>
 
-#define MAX_COLOR_BUFFER_DEPTH 8
-
 __declspec(align(16))
 struct PS_Point_Light
 {
@@ -48,9 +66,12 @@ struct PS_Material_Constant_Buffer
    XMFLOAT4 diffuse;
    XMFLOAT4 specular;
    FLOAT shininess;
+   FLOAT opacity;
+   UINT flags;
+   FLOAT padding;
 };
 
-class Renderer : public D3DBase
+class Renderer : public D3DBase, public IChunkRecorder
 {
 public:
    Renderer();
@@ -59,41 +80,107 @@ public:
    bool LoadContent();
    void UnloadContent();
 
+   // IChunkRecorder, called by the parallel recorder's workers
+   void RecordChunk(unsigned int worker, unsigned int pass, const DrawChunk &chunk);
+   void ExecuteChunk(unsigned int worker, unsigned int pass);
+
 private:
+   static const UINT NUM_INPUT_KEYS = 256;
+
+   BOOL WasKeyPressed(const BOOL *keyInputArray, UINT key) const;
+
+   // Registers the D3D objects with the command backend and builds the
+   // draw items the scene passes record from
+   void RegisterPassResources();
+
+   // Declares the frame in the render graph and hooks up the pass callbacks
+   void BuildRenderGraph();
+   void SubmitScenePass(CommandBuffer *pCmds, UINT pass, UINT numDraws);
+
+   // Copies the light map and shadow depth into staging textures within the
+   // frame and writes them to RSM_CAPTURE_FILE once the frame is submitted
+   void RecordRsmCapture(CommandBuffer *pCmds);
+   void SaveRsmCapture();
+
+   // Same for the normal pass' output, written to SSAO_CAPTURE_FILE
+   void RecordSsaoCapture(CommandBuffer *pCmds);
+   void SaveSsaoCapture();
+   void SaveCoarseVplCapture();
+
    bool InitializeMatMap(const aiScene *pAssimpScene);
    void DestroyMatMap();
 
-   bool CreateD3DMesh(const aiMesh *pMesh, const aiScene *pAssimpScene, Mesh *d3dMesh);
+   // Creates the buffers of a mesh unless an identical mesh already has
+   // them, pMeshIndex receives the index of the mesh in scene either way
+   bool CreateD3DMesh(const aiMesh *pMesh, const aiScene *pAssimpScene, MeshDeduplicator *pMeshes, UINT *pMeshIndex);
+   void CollectInstances(const aiNode *pNode, const aiMatrix4x4 &parentTransform, const std::vector<UINT> &meshMap,
+      std::vector<MeshInstance> *pInstances);
 
    void DestroyD3DMesh(Mesh *d3dMesh);
 
+   // Rasterizes the scene's instances with the estimator into
+   // m_overdrawEstimate, viewProj is the main view's stored row major
+   void EstimateOverdraw(const float viewProj[16]);
+
+   // The light map and the cascades are runtime settings independent of
+   // the window, changing either rebuilds the render graph
+   void ResizeShadowMaps(UINT shadowMapWidth, UINT shadowMapHeight, UINT cascadeSize);
+
+   // Uploads the materials' opacity with m_translucentMaterial's overridden
+   // and flags the draws of the materials below OIT_OPAQUE_ALPHA or with an
+   // alpha texture transparent
+   void UpdateTransparentDraws();
+
+   // Points the node buffer's handles at a new buffer of capacity nodes
+   void ResizeOitNodes(UINT capacity);
+
+   // Reads back the oldest staged fragment count into m_oitMeasuredNodes if
+   // the GPU is done with it
+   void ReadOitNodeCount();
+
    UINT m_shadowMapHeight;
    UINT m_shadowMapWidth;
+   UINT m_cascadeSize;
 
    D3D11_VIEWPORT m_viewport;
 
    ID3D11VertexShader* m_solidColorVS;
    ID3D11VertexShader* m_planeVS;
 
-   ID3D11PixelShader* m_globalIlluminationPS;
    ID3D11PixelShader* m_solidColorPS;
    ID3D11PixelShader* m_texturePS;
-   ID3D11PixelShader* m_blurPS;
    ID3D11PixelShader* m_textureNoShadingPS;
 
 
    ID3D11InputLayout* m_inputLayout;
 
    ConstantBuffer<VS_Transformation_Constant_Buffer> *m_pTransformConstants;
+   ConstantBuffer<VS_Transformation_Constant_Buffer> *m_pLightTransformConstants;
    ConstantBuffer<PS_Light_Constant_Buffer> *m_pLightConstants;
 
-   RWRenderTarget* m_pBlurredShadowMap;
-   RWRenderTarget* m_pLightMap;
-
    RWStructuredBuffer<PS_Point_Light> *m_pLightBuffer;
+   RWStructuredBuffer<LightGridTile> *m_pLightTiles;
+   RWStructuredBuffer<UINT> *m_pLightIndices;
 
    ID3D11ComputeShader* m_blurCS;
-   RWComputeSurface* m_pBlurredShadowSurface;
+   ID3D11ComputeShader* m_lightBinCS;
+
+   // VPL generation, m_vplConstants.targetVpls is changed at runtime
+   ID3D11ComputeShader* m_vplFluxCS;
+   RWStructuredBuffer<UINT> *m_pTotalFlux;
+   ConstantBuffer<VplConstants> *m_pVplConstants;
+   ConstantBuffer<VplCount> *m_pVplCount;
+   VplConstants m_vplConstants;
+
+   // Separable blur any pass can declare with DeclareSeparableBlur
+   ID3D11ComputeShader* m_gaussianBlurCS;
+   ConstantBuffer<BlurConstants> *m_pBlurConstants;
+
+   // Staging copies of the light map and shadow depth, created on the first
+   // capture after the light map is resized
+   BOOL m_captureRsm;
+   ID3D11Texture2D *m_pRsmStaging[2];
+   ResourceHandle m_rsmStagingHandles[2];
 
    PlaneRenderer* m_pPlaneRenderer;
 
@@ -101,14 +188,193 @@ private:
    ID3D11SamplerState* m_shadowSampler;
 
    ID3D11RasterizerState* m_rasterState;
-   ID3D11UnorderedAccessView* m_uav;
-   ID3D11UnorderedAccessView* m_colorBufferDepthUAV;
-   ID3D11ShaderResourceView *m_colorBufferSrv;
 
    std::vector<Mesh> scene;
+   std::vector<InstanceBatch> m_instanceBatches;
+   ID3D11Buffer *m_instanceBuffer;
+
+   // Local bounds of each mesh in scene
+   std::vector<BoundingSphere> m_meshBounds;
+
+   ID3D11ComputeShader* m_cullCS;
+   RWStructuredBuffer<CullInstance> *m_pCullInstances;
+   ConstantBuffer<CullConstants> *m_pCullConstants;
+   IndirectArgsBuffer<IndirectDrawArgs> *m_pDrawArgs[NUM_SCENE_PASSES];
+   RWVertexBuffer<InstanceTransform> *m_pVisibleInstances[NUM_SCENE_PASSES];
+   CullConstants m_cullConstants[NUM_SCENE_PASSES];
+
+   // World space point and spot lights, the first m_numDynamicLights are lit
+   std::vector<ClusterLight> m_dynamicLights;
+   std::vector<ClusterLight> m_viewLights;
+   UINT m_numDynamicLights;
+
+   ID3D11ComputeShader* m_clusterAssignCS;
+   RWStructuredBuffer<ClusterLight> *m_pClusterLights;
+   RWStructuredBuffer<ClusterHeader> *m_pClusters;
+   RWStructuredBuffer<UINT> *m_pClusterLightIndices;
+   RWStructuredBuffer<UINT> *m_pClusterIndexCounter;
+   ConstantBuffer<ClusterConstants> *m_pClusterConstants;
+   ClusterConstants m_clusterConstants;
+   ClusterBounds m_clusterBounds;
+   ClusterAssignment m_clusterAssignment;
+
+   // Shadow cascades of the directional light, fit every frame. The cull
+   // instances stay on the CPU to pick the draws of each cascade.
+   ConstantBuffer<VS_Transformation_Constant_Buffer> *m_pCascadeTransformConstants[NUM_SHADOW_CASCADES];
+   ConstantBuffer<CascadeConstants> *m_pCascadeConstants;
+   ShadowCascade m_shadowCascades[NUM_SHADOW_CASCADES];
+   CascadeConstants m_cascadeConstants;
+   std::vector<CullInstance> m_cullInstances;
+   std::vector<UINT> m_cascadeDrawMasks;
+
+   // Changed at runtime to compare the filter sizes
+   UINT m_pcfTapsSqrt;
+
+   // EVSM moments of the cascade atlas with a full mip chain, filtered with
+   // m_evsmSettings when m_passResources.shadowFilter picks EVSM
+   ID3D11ComputeShader* m_evsmMomentsCS;
+   RWComputeSurface *m_pShadowMoments;
+   ID3D11SamplerState* m_momentsSampler;
+   EvsmSettings m_evsmSettings;
+   BlurConstants m_evsmBlurConstants;
+
+   // The light map and shadow depth are cached across frames. m_pShadowCache
+   // decides each frame whether the shadow pass redraws all of it, the
+   // rectangle the dynamic casters moved in or nothing, and the VPLs are
+   // only generated again from a changed map.
+   ShadowCache *m_pShadowCache;
+   ShadowCacheUpdate m_shadowUpdate;
+   BOOL m_shadowCaching;
+   BOOL m_updateVpls;
+   UINT m_cachedTargetVpls;
+   std::vector<BoundingSphere> m_dynamicCasters;
+   std::vector<SceneDrawItem> m_shadowRegionItems;
+   ID3D11PixelShader* m_shadowClearPS;
+   ID3D11RasterizerState* m_scissorRasterState;
+   ID3D11DepthStencilState* m_clearDepthState;
+
+   // Half resolution ambient occlusion. The surfaces take turns holding
+   // this frame's resolved occlusion and last frame's, the history is only
+   // used once a frame has written it.
+   ID3D11PixelShader* m_normalDepthPS;
+   ID3D11ComputeShader* m_ssaoCS;
+   ID3D11ComputeShader* m_ssaoTemporalCS;
+   ID3D11ComputeShader* m_ssaoUpsampleCS;
+   RWComputeSurface *m_pSsaoSurfaces[2];
+   ConstantBuffer<SsaoConstants> *m_pSsaoConstants;
+   SsaoSettings m_ssaoSettings;
+   SsaoConstants m_ssaoConstants;
+   BOOL m_ssaoEnabled;
+   BOOL m_ssaoTemporal;
+   BOOL m_ssaoHistoryValid;
+   UINT m_ssaoFrame;
+   XMFLOAT4X4 m_prevViewProj;
+   ID3D11Texture2D *m_pNormalsStaging;
+   ResourceHandle m_normalsStagingHandle;
+
+   // Deferred shading, switched with the forward main pass at runtime
+   ID3D11PixelShader* m_gbufferPS;
+   ID3D11PixelShader* m_gbufferTexturePS;
+   ID3D11PixelShader* m_deferredCompositePS;
+   ID3D11ComputeShader* m_deferredLightingCS;
+   ConstantBuffer<DeferredConstants> *m_pDeferredConstants;
+   DeferredConstants m_deferredConstants;
+
+   // Depth pre-pass, turned on and off with the overdraw the CPU estimator
+   // finds every few frames in the automatic mode. The estimator draws the
+   // positions of each mesh in scene.
+   ID3D11VertexShader* m_depthOnlyVS;
+   ID3D11DepthStencilState* m_equalDepthState;
+   DepthPrepassMode m_depthPrepassMode;
+   DepthPrepassSettings m_depthPrepassSettings;
+   std::vector<OverdrawMesh> m_overdrawMeshes;
+   OverdrawEstimator m_overdrawEstimator;
+   OverdrawEstimate m_overdrawEstimate;
+   UINT m_overdrawFrame;
+
+   // Order independent transparency. The node buffer is resized to the
+   // fragment counts the transparent pass reports, which are copied to a
+   // ring of staging buffers and read back OIT_READBACK_FRAMES later so the
+   // CPU never waits for the GPU. m_translucentMaterial is 1 + the material
+   // previewed at OIT_PREVIEW_OPACITY, 0 for none. m_oitTechnique picks
+   // the lists or the cheaper weighted blending, OIT_TECHNIQUE_*, and both
+   // count their fragments so the frame statistics can compare the two.
+   static const UINT OIT_READBACK_FRAMES = 3;
+   ID3D11PixelShader* m_oitPS;
+   ID3D11PixelShader* m_oitTexturePS;
+   ID3D11PixelShader* m_oitResolvePS;
+   ID3D11DepthStencilState* m_testDepthState;
+   ID3D11BlendState* m_oitBlendState;
+   ID3D11PixelShader* m_weightedOitPS;
+   ID3D11PixelShader* m_weightedOitTexturePS;
+   ID3D11PixelShader* m_weightedOitCompositePS;
+   ID3D11BlendState* m_weightedOitBlendState;
+   UINT m_oitTechnique;
+   RWStructuredBuffer<OitNode> *m_pOitNodes;
+   RWStructuredBuffer<UINT> *m_pOitNodeCount;
+   ResourceHandle m_oitNodeCountHandle;
+   ID3D11Buffer *m_pOitCountStaging[OIT_READBACK_FRAMES];
+   ResourceHandle m_oitCountStagingHandles[OIT_READBACK_FRAMES];
+   UINT m_oitFrame;
+   UINT m_oitCapacity;
+   UINT m_oitMeasuredNodes;
+   ABufferSettings m_abufferSettings;
+   std::vector<PS_Material_Constant_Buffer> m_materialConstants;
+   UINT m_translucentMaterial;
+   UINT m_numTransparentDraws;
+
+   // Temporal anti-aliasing. The main view's projection is jittered by
+   // m_taaJitter, the surfaces take turns holding this frame's resolved
+   // color and last frame's like the occlusion's, and the history is only
+   // used once a frame with the anti-aliasing on has written it.
+   ID3D11ComputeShader* m_taaMotionCS;
+   ID3D11ComputeShader* m_taaResolveCS;
+   ID3D11PixelShader* m_taaSharpenPS;
+   RWComputeSurface *m_pTaaSurfaces[2];
+   ConstantBuffer<TaaConstants> *m_pTaaConstants;
+   TaaSettings m_taaSettings;
+   TaaConstants m_taaConstants;
+   float m_taaJitter[2];
+   BOOL m_taaHistoryValid;
+   UINT m_taaFrame;
+
+   // Dynamic resolution. The frame's GPU time is read back GpuTimer's
+   // latency later together with the scale it was drawn at, and the
+   // controller picks the scale of the frames to come. Moving to another
+   // size drops the temporal histories, which were drawn at the old one.
+   ID3D11PixelShader* m_upscalePS;
+   ConstantBuffer<UpscaleConstants> *m_pUpscaleConstants;
+   UpscaleConstants m_upscaleConstants;
+   GpuTimer *m_pGpuTimer;
+   DynamicResolutionSettings m_resolutionSettings;
+   ResolutionController *m_pResolutionController;
+   float m_frameScales[GpuTimer::NUM_FRAMES];
+   UINT m_renderWidth;
+   UINT m_renderHeight;
+   double m_gpuFrameMs;
+
+   // Coarse VPL shading, the forward main pass' VPL light is shaded per
+   // block and upsampled. The constants are saved with the 'R' capture so
+   // the benchmark can shade the captured frame.
+   ID3D11ComputeShader* m_coarseVplCS;
+   ID3D11ComputeShader* m_vplUpsampleCS;
+   ID3D11PixelShader* m_coarseVplTexturePS;
+   ConstantBuffer<CoarseVplConstants> *m_pCoarseVplConstants;
+   CoarseVplSettings m_coarseVplSettings;
+   CoarseVplConstants m_coarseVplConstants;
+
+   // Irradiance probes baked from the scene by -bakeprobes. When the file
+   // loads they replace the forward passes' VPL light, '0' switches back.
+   RWStructuredBuffer<XMFLOAT4> *m_pIrradianceProbes;
+   ConstantBuffer<IrradianceProbeConstants> *m_pIrradianceProbeConstants;
+   IrradianceProbeGrid m_irradianceProbeGrid;
+   IrradianceProbeConstants m_irradianceProbeConstants;
+
+   // Diagonal of the scene's bounding box
+   float m_sceneSize;
+
    std::vector<Material> m_matList;
 
-   ShadowMap *m_pShadowMap;
    VS_Transformation_Constant_Buffer m_shadowMapTransform;
 
    // At some point these should be encapsulated into a Mesh Object 
@@ -134,6 +400,32 @@ private:
    float m_fieldOfView; // vertical FOV in radians
 
    UINT m_numIndices;
+
+   D3D11CommandBackend m_commandBackend;
+   ScenePassResources m_passResources;
+   std::vector<SceneDrawItem> m_drawItems;
+   CommandBuffer m_frameCommands;
+   std::vector<CommandBuffer> m_workerCommands;
+
+   RenderGraph m_renderGraph;
+   SceneGraphPasses m_graphPasses;
+   TransientTextures m_transientTextures;
+
+   // Transients share a tile pool instead of being committed, when the
+   // device has tiled resources
+   BOOL m_tiledTransients;
+   UINT m_numFrameDraws;
+
+   ParallelRecorder *m_pRecorder;
+   DeferredContextPool *m_pContextPool;
+   std::vector<UINT> m_drawCosts;
+   BOOL m_multithreadedSubmit;
+
+   // Every mesh is drawn this many times to measure how submission scales
+   UINT m_drawMultiplier;
+
+   FrameStats m_frameStats;
+   BOOL m_prevKeyInput[NUM_INPUT_KEYS];
 };
 
 #endif //_BLANK_DEMO_H_
\ No newline at end of file
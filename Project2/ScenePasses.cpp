@@ -0,0 +1,900 @@
+#include "ScenePasses.h"
+
+#include "LightBinning.h"
+
+#include <string>
+
+using std::string;
+using std::vector;
+
+namespace
+{
+   RenderGraphResource ImportView(RenderGraph *pGraph, const char *name, ResourceHandle srv, ResourceHandle rtv,
+      ResourceHandle dsv, ResourceHandle uav)
+   {
+      RenderGraphViews views = { srv, rtv, dsv, uav };
+      return pGraph->ImportResource(name, views);
+   }
+
+   // PlainPixel.hlsl's light inputs from slot 1 on, inputs left at -1 are
+   // not read
+   void ReadForwardInputs(RenderGraph *pGraph, RenderGraphPass pass, const RenderGraphResource *pInputs,
+      unsigned int numInputs)
+   {
+      for (unsigned int i = 0; i < numInputs; i++)
+      {
+         if (pInputs[i] != (RenderGraphResource)-1) pGraph->ReadTexture(pass, pInputs[i], STAGE_PIXEL, i + 1);
+      }
+   }
+}
+
+void DeclareSeparableBlur(RenderGraph *pGraph, const char *name, RenderGraphResource source,
+   const RenderGraphResource *pDepth, RenderGraphResource dest, const RenderGraphTextureDesc &desc,
+   SeparableBlurPasses *pPasses)
+{
+   RenderGraphResource rows = pGraph->CreateTexture((string(name) + "BlurRows").c_str(), desc);
+
+   RenderGraphPass horizontal = pGraph->AddPass((string(name) + "BlurH").c_str());
+   pGraph->ReadTexture(horizontal, source, STAGE_COMPUTE, 0);
+   if (pDepth) pGraph->ReadTexture(horizontal, *pDepth, STAGE_COMPUTE, 1);
+   pGraph->WriteUav(horizontal, rows, STAGE_COMPUTE, 0);
+
+   RenderGraphPass vertical = pGraph->AddPass((string(name) + "BlurV").c_str());
+   pGraph->ReadTexture(vertical, rows, STAGE_COMPUTE, 0);
+   if (pDepth) pGraph->ReadTexture(vertical, *pDepth, STAGE_COMPUTE, 1);
+   pGraph->WriteUav(vertical, dest, STAGE_COMPUTE, 0);
+
+   pPasses->horizontal = horizontal;
+   pPasses->vertical = vertical;
+}
+
+void DeclareSceneGraph(RenderGraph *pGraph, const ScenePassResources &res, SceneGraphPasses *pPasses)
+{
+   float clearColor[4] = { 0.2f, 0.2f, 0.2f, 1.0f };
+   float clearDepth[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+   float zeroes[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+   RenderGraphResource backBuffer = ImportView(pGraph, "BackBuffer", NULL_HANDLE, res.backBufferTarget, NULL_HANDLE, NULL_HANDLE);
+   RenderGraphResource depth = ImportView(pGraph, "Depth", NULL_HANDLE, NULL_HANDLE, res.depthView, NULL_HANDLE);
+   RenderGraphResource lightBuffer = ImportView(pGraph, "LightBuffer", res.lightBufferSrv, NULL_HANDLE, NULL_HANDLE, res.lightBufferUav);
+   RenderGraphResource lightTiles = ImportView(pGraph, "LightTiles", res.lightTilesSrv, NULL_HANDLE, NULL_HANDLE, res.lightTilesUav);
+   RenderGraphResource lightIndices = ImportView(pGraph, "LightIndices", res.lightIndicesSrv, NULL_HANDLE, NULL_HANDLE,
+      res.lightIndicesUav);
+   RenderGraphResource totalFlux = ImportView(pGraph, "TotalFlux", res.totalFluxSrv, NULL_HANDLE, NULL_HANDLE, res.totalFluxUav);
+   RenderGraphResource clusterLights = ImportView(pGraph, "ClusterLights", res.clusterLightsSrv, NULL_HANDLE, NULL_HANDLE,
+      NULL_HANDLE);
+   RenderGraphResource clusters = ImportView(pGraph, "Clusters", res.clustersSrv, NULL_HANDLE, NULL_HANDLE, res.clustersUav);
+   RenderGraphResource clusterLightIndices = ImportView(pGraph, "ClusterLightIndices", res.clusterLightIndicesSrv,
+      NULL_HANDLE, NULL_HANDLE, res.clusterLightIndicesUav);
+   RenderGraphResource clusterIndexCounter = ImportView(pGraph, "ClusterIndexCounter", NULL_HANDLE, NULL_HANDLE,
+      NULL_HANDLE, res.clusterIndexCounterUav);
+   RenderGraphResource shadowMoments = ImportView(pGraph, "ShadowMoments", res.shadowMomentsSrv, NULL_HANDLE, NULL_HANDLE,
+      res.shadowMomentsUav);
+   RenderGraphResource oitNodes = ImportView(pGraph, "OitNodes", res.oitNodesSrv, NULL_HANDLE, NULL_HANDLE, res.oitNodesUav);
+   RenderGraphResource oitNodeCount = ImportView(pGraph, "OitNodeCount", NULL_HANDLE, NULL_HANDLE, NULL_HANDLE,
+      res.oitNodeCountUav);
+
+   unsigned int width = (unsigned int)res.outputViewport.width;
+   unsigned int height = (unsigned int)res.outputViewport.height;
+   RenderGraphTextureDesc shadowDepthDesc = { res.shadowMapWidth, res.shadowMapHeight, 1, GRAPH_FORMAT_DEPTH32 };
+   RenderGraphTextureDesc shadowColorDesc = { res.shadowMapWidth, res.shadowMapHeight, 1, GRAPH_FORMAT_RGBA32_FLOAT };
+   RenderGraphTextureDesc cascadeDesc = { res.cascadeSize * NUM_SHADOW_CASCADES, res.cascadeSize, 1,
+      GRAPH_FORMAT_DEPTH32 };
+   RenderGraphTextureDesc momentsDesc = { res.cascadeSize * NUM_SHADOW_CASCADES, res.cascadeSize, 1,
+      GRAPH_FORMAT_RGBA32_FLOAT };
+   RenderGraphTextureDesc oitHeadsDesc = { width, height, 1, GRAPH_FORMAT_R32_UINT };
+   RenderGraphTextureDesc accumulationDesc = { width, height, 1, GRAPH_FORMAT_RGBA16_FLOAT };
+   RenderGraphTextureDesc revealageDesc = { width, height, 1, GRAPH_FORMAT_R8_UNORM };
+   RenderGraphTextureDesc sceneNormalsDesc = { width, height, 1, GRAPH_FORMAT_RGBA32_FLOAT };
+   RenderGraphTextureDesc sceneDepthDesc = { width, height, 1, GRAPH_FORMAT_DEPTH32 };
+   RenderGraphTextureDesc ssaoDesc = { (width + 1) / 2, (height + 1) / 2, 1, GRAPH_FORMAT_R32_FLOAT };
+   RenderGraphTextureDesc ambientOcclusionDesc = { width, height, 1, GRAPH_FORMAT_R32_FLOAT };
+   RenderGraphTextureDesc albedoDesc = { width, height, 1, GRAPH_FORMAT_RGBA8_UNORM };
+   RenderGraphTextureDesc packedNormalsDesc = { width, height, 1, GRAPH_FORMAT_R32_UINT };
+   RenderGraphTextureDesc litColorDesc = { width, height, 1, GRAPH_FORMAT_RGBA8_UNORM };
+   RenderGraphTextureDesc sceneColorDesc = { width, height, 1, GRAPH_FORMAT_RGBA8_UNORM };
+   RenderGraphTextureDesc motionDesc = { width, height, 1, GRAPH_FORMAT_RG16_FLOAT };
+
+   RenderGraphResource shadowDepth = pGraph->CreateTexture("ShadowDepth", shadowDepthDesc);
+   RenderGraphResource lightMap = pGraph->CreateTexture("LightMap", shadowColorDesc);
+   RenderGraphResource cascadeAtlas = pGraph->CreateTexture("ShadowCascades", cascadeDesc);
+   RenderGraphResource rawMoments = pGraph->CreateTexture("RawShadowMoments", momentsDesc);
+   RenderGraphResource oitHeads = pGraph->CreateTexture("OitHeads", oitHeadsDesc);
+   RenderGraphResource accumulation = pGraph->CreateTexture("WeightedAccumulation", accumulationDesc);
+   RenderGraphResource revealage = pGraph->CreateTexture("WeightedRevealage", revealageDesc);
+   RenderGraphResource sceneNormals = pGraph->CreateTexture("SceneNormals", sceneNormalsDesc);
+   RenderGraphResource sceneDepth = pGraph->CreateTexture("SceneNormalsDepth", sceneDepthDesc);
+   RenderGraphResource rawOcclusion = pGraph->CreateTexture("RawOcclusion", ssaoDesc);
+   RenderGraphResource ambientOcclusion = pGraph->CreateTexture("AmbientOcclusion", ambientOcclusionDesc);
+   RenderGraphResource ssaoHistory = ImportView(pGraph, "OcclusionHistory", res.ssaoHistorySrv, NULL_HANDLE, NULL_HANDLE,
+      NULL_HANDLE);
+   RenderGraphResource ssaoResolved = ImportView(pGraph, "ResolvedOcclusion", res.ssaoResolvedSrv, NULL_HANDLE,
+      NULL_HANDLE, res.ssaoResolvedUav);
+
+   // The shadow pass is skipped while the light and casters stand still, the
+   // light map and depth carry over to the next frame
+   pGraph->SetPersistent(shadowDepth);
+   pGraph->SetPersistent(lightMap);
+
+   // With dynamic resolution the frame is finished in a full size target and
+   // upscaled into the back buffer. With temporal anti-aliasing the opaque
+   // and transparent passes draw the jittered frame into the scene color and
+   // the sharpen finishes it.
+   RenderGraphResource frameColor = backBuffer;
+   if (res.dynamicResolution)
+   {
+      frameColor = pGraph->CreateTexture("ScaledColor", sceneColorDesc);
+   }
+   RenderGraphResource sceneColor = frameColor;
+   if (res.temporalAA)
+   {
+      sceneColor = pGraph->CreateTexture("SceneColor", sceneColorDesc);
+   }
+
+   pGraph->SetClear(sceneColor, GRAPH_CLEAR_RENDER_TARGET, clearColor);
+   pGraph->SetClear(depth, GRAPH_CLEAR_DEPTH, clearDepth);
+   pGraph->SetClear(shadowDepth, GRAPH_CLEAR_DEPTH, clearDepth);
+   pGraph->SetClear(lightMap, GRAPH_CLEAR_RENDER_TARGET, zeroes);
+   pGraph->SetClear(cascadeAtlas, GRAPH_CLEAR_DEPTH, clearDepth);
+   pGraph->SetClear(oitHeads, GRAPH_CLEAR_UAV_UINT, zeroes);
+   pGraph->SetClear(oitNodeCount, GRAPH_CLEAR_UAV_UINT, zeroes);
+   pGraph->SetClear(accumulation, GRAPH_CLEAR_RENDER_TARGET, zeroes);
+   pGraph->SetClear(revealage, GRAPH_CLEAR_RENDER_TARGET, clearDepth);
+   pGraph->SetClear(clusterIndexCounter, GRAPH_CLEAR_UAV_UINT, zeroes);
+   pGraph->SetClear(totalFlux, GRAPH_CLEAR_UAV_UINT, zeroes);
+   pGraph->SetClear(sceneNormals, GRAPH_CLEAR_RENDER_TARGET, zeroes);
+   pGraph->SetClear(sceneDepth, GRAPH_CLEAR_DEPTH, clearDepth);
+   pGraph->MarkOutput(backBuffer);
+
+   // Each scene pass draws the instances its own culling pass kept
+   static const char *CULLING_NAMES[NUM_SCENE_PASSES] = { "ShadowCulling", "MainCulling" };
+   static const char *DRAW_ARGS_NAMES[NUM_SCENE_PASSES] = { "ShadowDrawArgs", "MainDrawArgs" };
+   static const char *VISIBLE_NAMES[NUM_SCENE_PASSES] = { "ShadowVisibleInstances", "MainVisibleInstances" };
+
+   RenderGraphResource cullInstances = ImportView(pGraph, "CullInstances", res.cullInstancesSrv, NULL_HANDLE, NULL_HANDLE, NULL_HANDLE);
+   RenderGraphResource drawArgs[NUM_SCENE_PASSES];
+   RenderGraphResource visibleInstances[NUM_SCENE_PASSES];
+   for (unsigned int pass = 0; pass < NUM_SCENE_PASSES; pass++)
+   {
+      drawArgs[pass] = ImportView(pGraph, DRAW_ARGS_NAMES[pass], NULL_HANDLE, NULL_HANDLE, NULL_HANDLE, res.drawArgsUav[pass]);
+      visibleInstances[pass] = ImportView(pGraph, VISIBLE_NAMES[pass], NULL_HANDLE, NULL_HANDLE, NULL_HANDLE,
+         res.visibleInstancesUav[pass]);
+
+      RenderGraphPass cullingPass = pGraph->AddPass(CULLING_NAMES[pass]);
+      pGraph->ReadTexture(cullingPass, cullInstances, STAGE_COMPUTE, 0);
+      pGraph->WriteUav(cullingPass, drawArgs[pass], STAGE_COMPUTE, 0);
+      pGraph->WriteUav(cullingPass, visibleInstances[pass], STAGE_COMPUTE, 1);
+      pPasses->culling[pass] = cullingPass;
+   }
+
+   RenderGraphPass shadowPass = pGraph->AddPass("Shadow");
+   pGraph->WriteRenderTarget(shadowPass, lightMap, 0);
+   pGraph->WriteDepth(shadowPass, shadowDepth);
+   pGraph->ReadInput(shadowPass, drawArgs[SHADOW_PASS]);
+   pGraph->ReadInput(shadowPass, visibleInstances[SHADOW_PASS]);
+
+   RenderGraphPass cascadePass = pGraph->AddPass("ShadowCascades");
+   pGraph->WriteDepth(cascadePass, cascadeAtlas);
+
+   // Only the top mip of the moments is blurred, the mips are filtered from
+   // it like any texture's
+   RenderGraphPass evsmMomentsPass = pGraph->AddPass("EvsmMoments");
+   pGraph->ReadTexture(evsmMomentsPass, cascadeAtlas, STAGE_COMPUTE, 0);
+   pGraph->WriteUav(evsmMomentsPass, rawMoments, STAGE_COMPUTE, 0);
+   DeclareSeparableBlur(pGraph, "ShadowMoments", rawMoments, NULL, shadowMoments, momentsDesc, &pPasses->evsmBlur);
+   RenderGraphPass evsmMipsPass = pGraph->AddPass("EvsmMips");
+   pGraph->WriteMips(evsmMipsPass, shadowMoments);
+
+   RenderGraphPass vplFluxPass = pGraph->AddPass("VplFlux");
+   pGraph->ReadTexture(vplFluxPass, lightMap, STAGE_COMPUTE, 0);
+   pGraph->WriteUav(vplFluxPass, totalFlux, STAGE_COMPUTE, 0);
+
+   RenderGraphPass lightBufferPass = pGraph->AddPass("LightBuffer");
+   pGraph->ReadTexture(lightBufferPass, shadowDepth, STAGE_COMPUTE, 0);
+   pGraph->ReadTexture(lightBufferPass, lightMap, STAGE_COMPUTE, 1);
+   pGraph->ReadTexture(lightBufferPass, totalFlux, STAGE_COMPUTE, 2);
+   pGraph->WriteUav(lightBufferPass, lightBuffer, STAGE_COMPUTE, 0, true);
+
+   RenderGraphPass lightBinningPass = pGraph->AddPass("LightBinning");
+   pGraph->ReadTexture(lightBinningPass, lightBuffer, STAGE_COMPUTE, 0);
+   pGraph->WriteUav(lightBinningPass, lightTiles, STAGE_COMPUTE, 0);
+   pGraph->WriteUav(lightBinningPass, lightIndices, STAGE_COMPUTE, 1);
+
+   RenderGraphPass clusterAssignmentPass = pGraph->AddPass("ClusterAssignment");
+   pGraph->ReadTexture(clusterAssignmentPass, clusterLights, STAGE_COMPUTE, 0);
+   pGraph->WriteUav(clusterAssignmentPass, clusters, STAGE_COMPUTE, 0);
+   pGraph->WriteUav(clusterAssignmentPass, clusterLightIndices, STAGE_COMPUTE, 1);
+   pGraph->WriteUav(clusterAssignmentPass, clusterIndexCounter, STAGE_COMPUTE, 2);
+
+   // Ambient occlusion of the main view, the history is last frame's
+   // resolved occlusion
+   RenderGraphPass normalDepthPass = pGraph->AddPass("NormalDepth");
+   pGraph->WriteRenderTarget(normalDepthPass, sceneNormals, 0);
+   pGraph->WriteDepth(normalDepthPass, sceneDepth);
+   pGraph->ReadInput(normalDepthPass, drawArgs[MAIN_PASS]);
+   pGraph->ReadInput(normalDepthPass, visibleInstances[MAIN_PASS]);
+
+   RenderGraphPass ssaoPass = pGraph->AddPass("Ssao");
+   pGraph->ReadTexture(ssaoPass, sceneNormals, STAGE_COMPUTE, 0);
+   pGraph->WriteUav(ssaoPass, rawOcclusion, STAGE_COMPUTE, 0);
+
+   RenderGraphPass ssaoTemporalPass = pGraph->AddPass("SsaoTemporal");
+   pGraph->ReadTexture(ssaoTemporalPass, rawOcclusion, STAGE_COMPUTE, 0);
+   pGraph->ReadTexture(ssaoTemporalPass, sceneNormals, STAGE_COMPUTE, 1);
+   pGraph->ReadTexture(ssaoTemporalPass, ssaoHistory, STAGE_COMPUTE, 2);
+   pGraph->WriteUav(ssaoTemporalPass, ssaoResolved, STAGE_COMPUTE, 0);
+
+   RenderGraphPass ssaoUpsamplePass = pGraph->AddPass("SsaoUpsample");
+   pGraph->ReadTexture(ssaoUpsamplePass, ssaoResolved, STAGE_COMPUTE, 0);
+   pGraph->ReadTexture(ssaoUpsamplePass, sceneNormals, STAGE_COMPUTE, 1);
+   pGraph->WriteUav(ssaoUpsamplePass, ambientOcclusion, STAGE_COMPUTE, 0);
+
+   // The forward main pass' VPL light, shaded per block from the normal
+   // pass' output and upsampled to every pixel. The light inputs keep
+   // PlainPixel.hlsl's slots.
+   bool coarseVpl = res.coarseVpl && !res.deferredShading && !res.irradianceProbes;
+   RenderGraphResource indirectLight = (RenderGraphResource)-1;
+   pPasses->coarseVpl = (RenderGraphPass)-1;
+   pPasses->vplUpsample = (RenderGraphPass)-1;
+   if (coarseVpl)
+   {
+      unsigned int factor = res.coarseVplFactor > 0 ? res.coarseVplFactor : 1;
+      RenderGraphTextureDesc coarseDesc = { (width + factor - 1) / factor, (height + factor - 1) / factor, 1,
+         GRAPH_FORMAT_RGBA32_FLOAT };
+      RenderGraphTextureDesc indirectDesc = { width, height, 1, GRAPH_FORMAT_RGBA16_FLOAT };
+      RenderGraphResource coarseLight = pGraph->CreateTexture("CoarseVplLight", coarseDesc);
+      indirectLight = pGraph->CreateTexture("IndirectLight", indirectDesc);
+
+      RenderGraphPass coarsePass = pGraph->AddPass("CoarseVpl");
+      pGraph->ReadTexture(coarsePass, sceneNormals, STAGE_COMPUTE, 0);
+      pGraph->ReadTexture(coarsePass, lightBuffer, STAGE_COMPUTE, 2);
+      pGraph->ReadTexture(coarsePass, lightTiles, STAGE_COMPUTE, 3);
+      pGraph->ReadTexture(coarsePass, lightIndices, STAGE_COMPUTE, 4);
+      pGraph->WriteUav(coarsePass, coarseLight, STAGE_COMPUTE, 0);
+
+      RenderGraphPass upsamplePass = pGraph->AddPass("VplUpsample");
+      pGraph->ReadTexture(upsamplePass, coarseLight, STAGE_COMPUTE, 0);
+      pGraph->ReadTexture(upsamplePass, sceneNormals, STAGE_COMPUTE, 1);
+      pGraph->ReadTexture(upsamplePass, lightBuffer, STAGE_COMPUTE, 2);
+      pGraph->ReadTexture(upsamplePass, lightTiles, STAGE_COMPUTE, 3);
+      pGraph->ReadTexture(upsamplePass, lightIndices, STAGE_COMPUTE, 4);
+      pGraph->WriteUav(upsamplePass, indirectLight, STAGE_COMPUTE, 0);
+
+      pPasses->coarseVpl = coarsePass;
+      pPasses->vplUpsample = upsamplePass;
+   }
+
+   // The pre-pass fills whichever depth the main pass tests against
+   RenderGraphResource mainDepth = depth;
+   if (res.deferredShading)
+   {
+      mainDepth = pGraph->CreateTexture("GBufferDepth", sceneDepthDesc);
+      pGraph->SetClear(mainDepth, GRAPH_CLEAR_DEPTH, clearDepth);
+   }
+   pPasses->depthPrepass = (RenderGraphPass)-1;
+   if (res.depthPrepass)
+   {
+      RenderGraphPass prepass = pGraph->AddPass("DepthPrepass");
+      pGraph->WriteDepth(prepass, mainDepth);
+      pGraph->ReadInput(prepass, drawArgs[MAIN_PASS]);
+      pGraph->ReadInput(prepass, visibleInstances[MAIN_PASS]);
+      pPasses->depthPrepass = prepass;
+   }
+
+   // PlainPixel.hlsl's light inputs, from slot 1 on. The probes take the
+   // VPLs' place.
+   RenderGraphResource forwardInputs[] = { cascadeAtlas, lightBuffer, lightTiles, lightIndices, clusterLights, clusters,
+      clusterLightIndices, shadowMoments, ambientOcclusion };
+   const unsigned int NUM_FORWARD_INPUTS = sizeof(forwardInputs) / sizeof(forwardInputs[0]);
+   RenderGraphResource irradianceProbes = (RenderGraphResource)-1;
+   if (res.irradianceProbes)
+   {
+      irradianceProbes = ImportView(pGraph, "IrradianceProbes", res.irradianceProbesSrv, NULL_HANDLE, NULL_HANDLE,
+         NULL_HANDLE);
+      forwardInputs[1] = forwardInputs[2] = forwardInputs[3] = (RenderGraphResource)-1;
+   }
+
+   RenderGraphPass mainPass;
+   if (!res.deferredShading)
+   {
+      mainPass = pGraph->AddPass("Main");
+      pGraph->WriteRenderTarget(mainPass, sceneColor, 0);
+      pGraph->WriteDepth(mainPass, mainDepth);
+      ReadForwardInputs(pGraph, mainPass, forwardInputs, NUM_FORWARD_INPUTS);
+      if (coarseVpl) pGraph->ReadTexture(mainPass, indirectLight, STAGE_PIXEL, 11);
+      if (res.irradianceProbes) pGraph->ReadTexture(mainPass, irradianceProbes, STAGE_PIXEL, 12);
+      pGraph->ReadInput(mainPass, drawArgs[MAIN_PASS]);
+      pGraph->ReadInput(mainPass, visibleInstances[MAIN_PASS]);
+
+      pPasses->deferredLighting = (RenderGraphPass)-1;
+      pPasses->deferredComposite = (RenderGraphPass)-1;
+   }
+   else
+   {
+      RenderGraphResource albedo = pGraph->CreateTexture("GBufferAlbedo", albedoDesc);
+      RenderGraphResource packedNormals = pGraph->CreateTexture("GBufferNormals", packedNormalsDesc);
+      RenderGraphResource litColor = pGraph->CreateTexture("LitColor", litColorDesc);
+
+      mainPass = pGraph->AddPass("GBuffer");
+      pGraph->WriteRenderTarget(mainPass, albedo, 0);
+      pGraph->WriteRenderTarget(mainPass, packedNormals, 1);
+      pGraph->WriteDepth(mainPass, mainDepth);
+      pGraph->ReadInput(mainPass, drawArgs[MAIN_PASS]);
+      pGraph->ReadInput(mainPass, visibleInstances[MAIN_PASS]);
+
+      // The light inputs keep PlainPixel.hlsl's slots
+      RenderGraphPass lightingPass = pGraph->AddPass("DeferredLighting");
+      pGraph->ReadTexture(lightingPass, cascadeAtlas, STAGE_COMPUTE, 1);
+      pGraph->ReadTexture(lightingPass, lightBuffer, STAGE_COMPUTE, 2);
+      pGraph->ReadTexture(lightingPass, lightTiles, STAGE_COMPUTE, 3);
+      pGraph->ReadTexture(lightingPass, lightIndices, STAGE_COMPUTE, 4);
+      pGraph->ReadTexture(lightingPass, clusterLights, STAGE_COMPUTE, 5);
+      pGraph->ReadTexture(lightingPass, shadowMoments, STAGE_COMPUTE, 8);
+      pGraph->ReadTexture(lightingPass, ambientOcclusion, STAGE_COMPUTE, 9);
+      pGraph->ReadTexture(lightingPass, albedo, STAGE_COMPUTE, 10);
+      pGraph->ReadTexture(lightingPass, packedNormals, STAGE_COMPUTE, 11);
+      pGraph->ReadTexture(lightingPass, mainDepth, STAGE_COMPUTE, 12);
+      pGraph->WriteUav(lightingPass, litColor, STAGE_COMPUTE, 0);
+
+      RenderGraphPass compositePass = pGraph->AddPass("DeferredComposite");
+      pGraph->ReadTexture(compositePass, litColor, STAGE_PIXEL, 0);
+      pGraph->WriteRenderTarget(compositePass, sceneColor, 0);
+
+      pPasses->deferredLighting = lightingPass;
+      pPasses->deferredComposite = compositePass;
+   }
+
+   // The transparent fragments are tested against the opaque depth and
+   // shaded like the forward main pass. Their lists' UAVs keep the slots of
+   // the per-pixel color buffer they replaced.
+   RenderGraphPass transparentPass = pGraph->AddPass("Transparent");
+   pGraph->WriteDepth(transparentPass, mainDepth);
+   pGraph->WriteUav(transparentPass, oitNodes, STAGE_PIXEL, 3);
+   pGraph->WriteUav(transparentPass, oitHeads, STAGE_PIXEL, 4);
+   pGraph->WriteUav(transparentPass, oitNodeCount, STAGE_PIXEL, 5);
+   ReadForwardInputs(pGraph, transparentPass, forwardInputs, NUM_FORWARD_INPUTS);
+   if (res.irradianceProbes) pGraph->ReadTexture(transparentPass, irradianceProbes, STAGE_PIXEL, 12);
+   pGraph->ReadInput(transparentPass, drawArgs[MAIN_PASS]);
+   pGraph->ReadInput(transparentPass, visibleInstances[MAIN_PASS]);
+
+   RenderGraphPass oitResolvePass = pGraph->AddPass("OitResolve");
+   pGraph->ReadTexture(oitResolvePass, oitHeads, STAGE_PIXEL, 0);
+   pGraph->ReadTexture(oitResolvePass, oitNodes, STAGE_PIXEL, 1);
+   pGraph->WriteRenderTarget(oitResolvePass, sceneColor, 0);
+
+   // The weighted pass counts its fragments like the lists do
+   RenderGraphPass weightedPass = pGraph->AddPass("WeightedTransparent");
+   pGraph->WriteRenderTarget(weightedPass, accumulation, 0);
+   pGraph->WriteRenderTarget(weightedPass, revealage, 1);
+   pGraph->WriteDepth(weightedPass, mainDepth);
+   pGraph->WriteUav(weightedPass, oitNodeCount, STAGE_PIXEL, 5);
+   ReadForwardInputs(pGraph, weightedPass, forwardInputs, NUM_FORWARD_INPUTS);
+   if (res.irradianceProbes) pGraph->ReadTexture(weightedPass, irradianceProbes, STAGE_PIXEL, 12);
+   pGraph->ReadInput(weightedPass, drawArgs[MAIN_PASS]);
+   pGraph->ReadInput(weightedPass, visibleInstances[MAIN_PASS]);
+
+   RenderGraphPass weightedCompositePass = pGraph->AddPass("WeightedComposite");
+   pGraph->ReadTexture(weightedCompositePass, accumulation, STAGE_PIXEL, 0);
+   pGraph->ReadTexture(weightedCompositePass, revealage, STAGE_PIXEL, 1);
+   pGraph->WriteRenderTarget(weightedCompositePass, sceneColor, 0);
+
+   // The motion comes from the normal pass' view depth, the resolve blends
+   // the scene color with the history and the sharpen draws the result
+   pPasses->taaMotion = (RenderGraphPass)-1;
+   pPasses->taaResolve = (RenderGraphPass)-1;
+   pPasses->taaSharpen = (RenderGraphPass)-1;
+   if (res.temporalAA)
+   {
+      RenderGraphResource motion = pGraph->CreateTexture("Motion", motionDesc);
+      RenderGraphResource taaHistory = ImportView(pGraph, "TaaHistory", res.taaHistorySrv, NULL_HANDLE, NULL_HANDLE,
+         NULL_HANDLE);
+      RenderGraphResource taaResolved = ImportView(pGraph, "TaaResolved", res.taaResolvedSrv, NULL_HANDLE, NULL_HANDLE,
+         res.taaResolvedUav);
+
+      RenderGraphPass motionPass = pGraph->AddPass("TaaMotion");
+      pGraph->ReadTexture(motionPass, sceneNormals, STAGE_COMPUTE, 0);
+      pGraph->WriteUav(motionPass, motion, STAGE_COMPUTE, 0);
+
+      RenderGraphPass resolvePass = pGraph->AddPass("TaaResolve");
+      pGraph->ReadTexture(resolvePass, sceneColor, STAGE_COMPUTE, 0);
+      pGraph->ReadTexture(resolvePass, motion, STAGE_COMPUTE, 1);
+      pGraph->ReadTexture(resolvePass, taaHistory, STAGE_COMPUTE, 2);
+      pGraph->WriteUav(resolvePass, taaResolved, STAGE_COMPUTE, 0);
+
+      RenderGraphPass sharpenPass = pGraph->AddPass("TaaSharpen");
+      pGraph->ReadTexture(sharpenPass, taaResolved, STAGE_PIXEL, 0);
+      pGraph->WriteRenderTarget(sharpenPass, frameColor, 0);
+
+      pPasses->taaMotion = motionPass;
+      pPasses->taaResolve = resolvePass;
+      pPasses->taaSharpen = sharpenPass;
+   }
+
+   pPasses->upscale = (RenderGraphPass)-1;
+   if (res.dynamicResolution)
+   {
+      RenderGraphPass upscalePass = pGraph->AddPass("Upscale");
+      pGraph->ReadTexture(upscalePass, frameColor, STAGE_PIXEL, 0);
+      pGraph->WriteRenderTarget(upscalePass, backBuffer, 0);
+      pPasses->upscale = upscalePass;
+   }
+
+   pPasses->scenePasses[SHADOW_PASS] = shadowPass;
+   pPasses->scenePasses[MAIN_PASS] = mainPass;
+   pPasses->shadowCascades = cascadePass;
+   pPasses->evsmMoments = evsmMomentsPass;
+   pPasses->evsmMips = evsmMipsPass;
+   pPasses->vplFlux = vplFluxPass;
+   pPasses->lightBuffer = lightBufferPass;
+   pPasses->lightBinning = lightBinningPass;
+   pPasses->clusterAssignment = clusterAssignmentPass;
+   pPasses->normalDepth = normalDepthPass;
+   pPasses->ssao = ssaoPass;
+   pPasses->ssaoTemporal = ssaoTemporalPass;
+   pPasses->ssaoUpsample = ssaoUpsamplePass;
+   pPasses->transparent = transparentPass;
+   pPasses->oitResolve = oitResolvePass;
+   pPasses->weightedTransparent = weightedPass;
+   pPasses->weightedComposite = weightedCompositePass;
+   pPasses->shadowDepth = shadowDepth;
+   pPasses->lightMap = lightMap;
+   pPasses->sceneNormals = sceneNormals;
+}
+
+void RecordScenePass(CommandBuffer *pCmds, const ScenePassResources &res, const vector<SceneDrawItem> &items,
+   unsigned int pass, const DrawChunk &chunk)
+{
+   if (items.empty()) return;
+
+   pCmds->BindInputLayout(res.inputLayout);
+   pCmds->BindRasterState(res.rasterState);
+
+   ResourceHandle lightCbs[] = { res.lightConstants };
+   pCmds->BindConstantBuffers(STAGE_PIXEL, 1, 1, lightCbs);
+   pCmds->BindConstantBuffers(STAGE_VERTEX, 1, 1, lightCbs);
+
+   ResourceHandle samplers[] = { res.colorSampler, res.shadowSampler, res.momentsSampler };
+   pCmds->BindSamplers(STAGE_PIXEL, 0, 3, samplers);
+   pCmds->BindShader(STAGE_VERTEX, res.vertexShader);
+   pCmds->BindVertexBuffer(1, res.gpuCulling ? res.visibleInstances[pass] : res.instanceBuffer, res.instanceStride, 0);
+
+   ResourceHandle texturePS = pass == SHADOW_PASS ? res.textureNoShadingPS : res.texturePS;
+   ResourceHandle solidColorPS = res.solidColorPS;
+   if (pass == MAIN_PASS && res.deferredShading)
+   {
+      texturePS = res.gbufferTexturePS;
+      solidColorPS = res.gbufferPS;
+   }
+   else if (pass == MAIN_PASS && res.coarseVpl && !res.irradianceProbes)
+   {
+      texturePS = res.coarseVplTexturePS;
+   }
+
+   if (pass == SHADOW_PASS)
+   {
+      pCmds->SetViewport(res.shadowViewport);
+
+      ResourceHandle cbs[] = { res.lightTransformConstants };
+      pCmds->BindConstantBuffers(STAGE_VERTEX, 0, 1, cbs);
+   }
+   else
+   {
+      pCmds->SetViewport(res.mainViewport);
+
+      ResourceHandle cbs[] = { res.cameraTransformConstants };
+      pCmds->BindConstantBuffers(STAGE_VERTEX, 0, 1, cbs);
+      pCmds->BindConstantBuffers(STAGE_PIXEL, 2, 1, &res.clusterConstants);
+      pCmds->BindConstantBuffers(STAGE_PIXEL, 3, 1, &res.cascadeConstants);
+      pCmds->BindConstantBuffers(STAGE_PIXEL, 5, 1, &res.irradianceProbeConstants);
+      if (res.depthPrepass) pCmds->BindDepthState(res.equalDepthState);
+   }
+
+   for (unsigned int draw = chunk.firstDraw; draw < chunk.firstDraw + chunk.numDraws; draw++)
+   {
+      const SceneDrawItem &item = items[draw % items.size()];
+      if (pass == MAIN_PASS && item.transparent != res.drawTransparent) continue;
+
+      pCmds->BindShaderResources(STAGE_PIXEL, 0, 1, &item.texture);
+      if (pass == MAIN_PASS && res.drawTransparent) pCmds->BindShaderResources(STAGE_PIXEL, 10, 1, &item.opacityTexture);
+      pCmds->BindShader(STAGE_PIXEL, item.texture != NULL_HANDLE ? texturePS : solidColorPS);
+
+      pCmds->BindVertexBuffer(0, item.vertexBuffer, res.vertexStride, 0);
+      pCmds->BindIndexBuffer(item.indexBuffer);
+      pCmds->BindConstantBuffers(STAGE_PIXEL, 0, 1, &item.materialConstants);
+      if (res.gpuCulling)
+      {
+         unsigned int argsOffset = (unsigned int)((draw % items.size()) * sizeof(IndirectDrawArgs));
+         pCmds->DrawIndexedInstancedIndirect(res.drawArgs[pass], argsOffset);
+      }
+      else
+      {
+         pCmds->DrawIndexedInstanced(item.numIndices, item.numInstances, 0, 0, item.firstInstance);
+      }
+   }
+   if (pass == MAIN_PASS && res.depthPrepass) pCmds->BindDepthState(NULL_HANDLE);
+}
+
+void RecordShadowRegionUpdate(CommandBuffer *pCmds, const ScenePassResources &res, const vector<SceneDrawItem> &items,
+   const ShadowRect &rect)
+{
+   pCmds->SetScissor((int)rect.left, (int)rect.top, (int)rect.right, (int)rect.bottom);
+
+   // The triangle sits at depth 0, collapsing the viewport's depth range
+   // writes it out at the far plane
+   Viewport farViewport = res.shadowViewport;
+   farViewport.minDepth = farViewport.maxDepth = 1.0f;
+   pCmds->SetViewport(farViewport);
+   pCmds->BindInputLayout(NULL_HANDLE);
+   pCmds->BindRasterState(res.scissorRasterState);
+   pCmds->BindDepthState(res.clearDepthState);
+   pCmds->BindShader(STAGE_VERTEX, res.planeVS);
+   pCmds->BindShader(STAGE_PIXEL, res.shadowClearPS);
+   pCmds->Draw(3, 0);
+   pCmds->BindDepthState(NULL_HANDLE);
+
+   // Only a few draws are left, they go straight to the instance buffer
+   ScenePassResources regionRes = res;
+   regionRes.rasterState = res.scissorRasterState;
+   regionRes.gpuCulling = false;
+   DrawChunk allDraws = { 0, (unsigned int)items.size() };
+   RecordScenePass(pCmds, regionRes, items, SHADOW_PASS, allDraws);
+}
+
+void RecordNormalDepthPass(CommandBuffer *pCmds, const ScenePassResources &res, const vector<SceneDrawItem> &items,
+   const DrawChunk &chunk)
+{
+   ScenePassResources normalRes = res;
+   normalRes.deferredShading = false;
+   normalRes.depthPrepass = false;
+   normalRes.coarseVpl = false;
+   normalRes.solidColorPS = res.normalDepthPS;
+   normalRes.texturePS = res.normalDepthPS;
+   pCmds->BindConstantBuffers(STAGE_PIXEL, 4, 1, &res.ssaoConstants);
+   RecordScenePass(pCmds, normalRes, items, MAIN_PASS, chunk);
+}
+
+void RecordDepthPrepass(CommandBuffer *pCmds, const ScenePassResources &res, const vector<SceneDrawItem> &items,
+   const DrawChunk &chunk)
+{
+   if (items.empty()) return;
+
+   pCmds->SetViewport(res.mainViewport);
+   pCmds->BindInputLayout(res.inputLayout);
+   pCmds->BindRasterState(res.rasterState);
+   pCmds->BindShader(STAGE_VERTEX, res.depthOnlyVS);
+   pCmds->BindShader(STAGE_PIXEL, NULL_HANDLE);
+   pCmds->BindConstantBuffers(STAGE_VERTEX, 0, 1, &res.cameraTransformConstants);
+   pCmds->BindVertexBuffer(1, res.gpuCulling ? res.visibleInstances[MAIN_PASS] : res.instanceBuffer, res.instanceStride, 0);
+
+   for (unsigned int draw = chunk.firstDraw; draw < chunk.firstDraw + chunk.numDraws; draw++)
+   {
+      const SceneDrawItem &item = items[draw % items.size()];
+      if (item.transparent) continue;
+
+      pCmds->BindVertexBuffer(0, item.vertexBuffer, res.vertexStride, 0);
+      pCmds->BindIndexBuffer(item.indexBuffer);
+      if (res.gpuCulling)
+      {
+         unsigned int argsOffset = (unsigned int)((draw % items.size()) * sizeof(IndirectDrawArgs));
+         pCmds->DrawIndexedInstancedIndirect(res.drawArgs[MAIN_PASS], argsOffset);
+      }
+      else
+      {
+         pCmds->DrawIndexedInstanced(item.numIndices, item.numInstances, 0, 0, item.firstInstance);
+      }
+   }
+}
+
+void RecordTransparentPass(CommandBuffer *pCmds, const ScenePassResources &res, const vector<SceneDrawItem> &items,
+   const DrawChunk &chunk)
+{
+   ScenePassResources transparentRes = res;
+   transparentRes.deferredShading = false;
+   transparentRes.depthPrepass = false;
+   transparentRes.coarseVpl = false;
+   transparentRes.drawTransparent = true;
+   transparentRes.solidColorPS = res.oitPS;
+   transparentRes.texturePS = res.oitTexturePS;
+   pCmds->BindDepthState(res.testDepthState);
+   RecordScenePass(pCmds, transparentRes, items, MAIN_PASS, chunk);
+   pCmds->BindDepthState(NULL_HANDLE);
+}
+
+void RecordOitResolve(CommandBuffer *pCmds, const ScenePassResources &res)
+{
+   pCmds->SetViewport(res.mainViewport);
+   pCmds->BindInputLayout(NULL_HANDLE);
+   pCmds->BindRasterState(res.rasterState);
+   pCmds->BindShader(STAGE_VERTEX, res.planeVS);
+   pCmds->BindShader(STAGE_PIXEL, res.oitResolvePS);
+   pCmds->BindBlendState(res.oitBlendState);
+   pCmds->Draw(3, 0);
+   pCmds->BindBlendState(NULL_HANDLE);
+}
+
+void RecordWeightedTransparentPass(CommandBuffer *pCmds, const ScenePassResources &res, const vector<SceneDrawItem> &items,
+   const DrawChunk &chunk)
+{
+   ScenePassResources weightedRes = res;
+   weightedRes.oitPS = res.weightedOitPS;
+   weightedRes.oitTexturePS = res.weightedOitTexturePS;
+   pCmds->BindBlendState(res.weightedOitBlendState);
+   RecordTransparentPass(pCmds, weightedRes, items, chunk);
+   pCmds->BindBlendState(NULL_HANDLE);
+}
+
+void RecordWeightedOitComposite(CommandBuffer *pCmds, const ScenePassResources &res)
+{
+   ScenePassResources compositeRes = res;
+   compositeRes.oitResolvePS = res.weightedOitCompositePS;
+   RecordOitResolve(pCmds, compositeRes);
+}
+
+void RecordSsao(CommandBuffer *pCmds, const ScenePassResources &res)
+{
+   unsigned int halfWidth = ((unsigned int)res.mainViewport.width + 1) / 2;
+   unsigned int halfHeight = ((unsigned int)res.mainViewport.height + 1) / 2;
+
+   pCmds->BindShader(STAGE_COMPUTE, res.ssaoCS);
+   pCmds->BindConstantBuffers(STAGE_COMPUTE, 0, 1, &res.ssaoConstants);
+   pCmds->Dispatch((halfWidth + SSAO_THREAD_GROUP_SIZE - 1) / SSAO_THREAD_GROUP_SIZE,
+      (halfHeight + SSAO_THREAD_GROUP_SIZE - 1) / SSAO_THREAD_GROUP_SIZE, 1);
+}
+
+void RecordSsaoTemporal(CommandBuffer *pCmds, const ScenePassResources &res)
+{
+   unsigned int halfWidth = ((unsigned int)res.mainViewport.width + 1) / 2;
+   unsigned int halfHeight = ((unsigned int)res.mainViewport.height + 1) / 2;
+
+   pCmds->BindShader(STAGE_COMPUTE, res.ssaoTemporalCS);
+   pCmds->BindConstantBuffers(STAGE_COMPUTE, 0, 1, &res.ssaoConstants);
+   pCmds->Dispatch((halfWidth + SSAO_THREAD_GROUP_SIZE - 1) / SSAO_THREAD_GROUP_SIZE,
+      (halfHeight + SSAO_THREAD_GROUP_SIZE - 1) / SSAO_THREAD_GROUP_SIZE, 1);
+}
+
+void RecordSsaoUpsample(CommandBuffer *pCmds, const ScenePassResources &res)
+{
+   unsigned int width = (unsigned int)res.mainViewport.width;
+   unsigned int height = (unsigned int)res.mainViewport.height;
+
+   pCmds->BindShader(STAGE_COMPUTE, res.ssaoUpsampleCS);
+   pCmds->BindConstantBuffers(STAGE_COMPUTE, 0, 1, &res.ssaoConstants);
+   pCmds->Dispatch((width + SSAO_THREAD_GROUP_SIZE - 1) / SSAO_THREAD_GROUP_SIZE,
+      (height + SSAO_THREAD_GROUP_SIZE - 1) / SSAO_THREAD_GROUP_SIZE, 1);
+}
+
+void RecordTaaMotion(CommandBuffer *pCmds, const ScenePassResources &res)
+{
+   unsigned int width = (unsigned int)res.mainViewport.width;
+   unsigned int height = (unsigned int)res.mainViewport.height;
+
+   pCmds->BindShader(STAGE_COMPUTE, res.taaMotionCS);
+   pCmds->BindConstantBuffers(STAGE_COMPUTE, 0, 1, &res.taaConstants);
+   pCmds->Dispatch((width + TAA_THREAD_GROUP_SIZE - 1) / TAA_THREAD_GROUP_SIZE,
+      (height + TAA_THREAD_GROUP_SIZE - 1) / TAA_THREAD_GROUP_SIZE, 1);
+}
+
+void RecordTaaResolve(CommandBuffer *pCmds, const ScenePassResources &res)
+{
+   unsigned int width = (unsigned int)res.mainViewport.width;
+   unsigned int height = (unsigned int)res.mainViewport.height;
+
+   pCmds->BindShader(STAGE_COMPUTE, res.taaResolveCS);
+   pCmds->BindConstantBuffers(STAGE_COMPUTE, 0, 1, &res.taaConstants);
+   pCmds->Dispatch((width + TAA_THREAD_GROUP_SIZE - 1) / TAA_THREAD_GROUP_SIZE,
+      (height + TAA_THREAD_GROUP_SIZE - 1) / TAA_THREAD_GROUP_SIZE, 1);
+}
+
+void RecordTaaSharpen(CommandBuffer *pCmds, const ScenePassResources &res)
+{
+   pCmds->SetViewport(res.mainViewport);
+   pCmds->BindInputLayout(NULL_HANDLE);
+   pCmds->BindRasterState(res.rasterState);
+   pCmds->BindShader(STAGE_VERTEX, res.planeVS);
+   pCmds->BindShader(STAGE_PIXEL, res.taaSharpenPS);
+   pCmds->BindConstantBuffers(STAGE_PIXEL, 0, 1, &res.taaConstants);
+   pCmds->Draw(3, 0);
+}
+
+void RecordUpscale(CommandBuffer *pCmds, const ScenePassResources &res)
+{
+   pCmds->SetViewport(res.outputViewport);
+   pCmds->BindInputLayout(NULL_HANDLE);
+   pCmds->BindRasterState(res.rasterState);
+   pCmds->BindShader(STAGE_VERTEX, res.planeVS);
+   pCmds->BindShader(STAGE_PIXEL, res.upscalePS);
+   pCmds->BindConstantBuffers(STAGE_PIXEL, 0, 1, &res.upscaleConstants);
+   pCmds->Draw(3, 0);
+}
+
+void RecordCoarseVpl(CommandBuffer *pCmds, const ScenePassResources &res)
+{
+   unsigned int factor = res.coarseVplFactor > 0 ? res.coarseVplFactor : 1;
+   unsigned int coarseWidth = ((unsigned int)res.mainViewport.width + factor - 1) / factor;
+   unsigned int coarseHeight = ((unsigned int)res.mainViewport.height + factor - 1) / factor;
+
+   pCmds->BindShader(STAGE_COMPUTE, res.coarseVplCS);
+   pCmds->BindConstantBuffers(STAGE_COMPUTE, 0, 1, &res.coarseVplConstants);
+   pCmds->Dispatch((coarseWidth + VPL_SHADING_THREAD_GROUP_SIZE - 1) / VPL_SHADING_THREAD_GROUP_SIZE,
+      (coarseHeight + VPL_SHADING_THREAD_GROUP_SIZE - 1) / VPL_SHADING_THREAD_GROUP_SIZE, 1);
+}
+
+void RecordVplUpsample(CommandBuffer *pCmds, const ScenePassResources &res)
+{
+   unsigned int width = (unsigned int)res.mainViewport.width;
+   unsigned int height = (unsigned int)res.mainViewport.height;
+
+   pCmds->BindShader(STAGE_COMPUTE, res.vplUpsampleCS);
+   pCmds->BindConstantBuffers(STAGE_COMPUTE, 0, 1, &res.coarseVplConstants);
+   pCmds->Dispatch((width + VPL_SHADING_THREAD_GROUP_SIZE - 1) / VPL_SHADING_THREAD_GROUP_SIZE,
+      (height + VPL_SHADING_THREAD_GROUP_SIZE - 1) / VPL_SHADING_THREAD_GROUP_SIZE, 1);
+}
+
+void RecordDeferredLighting(CommandBuffer *pCmds, const ScenePassResources &res)
+{
+   unsigned int width = (unsigned int)res.mainViewport.width;
+   unsigned int height = (unsigned int)res.mainViewport.height;
+
+   ResourceHandle cbs[] = { res.deferredConstants, res.lightConstants, res.clusterConstants, res.cascadeConstants };
+   ResourceHandle samplers[] = { res.shadowSampler, res.momentsSampler };
+   pCmds->BindShader(STAGE_COMPUTE, res.deferredLightingCS);
+   pCmds->BindConstantBuffers(STAGE_COMPUTE, 0, 4, cbs);
+   pCmds->BindSamplers(STAGE_COMPUTE, 1, 2, samplers);
+   pCmds->Dispatch((width + DEFERRED_TILE_SIZE - 1) / DEFERRED_TILE_SIZE,
+      (height + DEFERRED_TILE_SIZE - 1) / DEFERRED_TILE_SIZE, 1);
+}
+
+void RecordDeferredComposite(CommandBuffer *pCmds, const ScenePassResources &res)
+{
+   pCmds->SetViewport(res.mainViewport);
+   pCmds->BindInputLayout(NULL_HANDLE);
+   pCmds->BindRasterState(res.rasterState);
+   pCmds->BindShader(STAGE_VERTEX, res.planeVS);
+   pCmds->BindShader(STAGE_PIXEL, res.deferredCompositePS);
+   pCmds->Draw(3, 0);
+}
+
+void RecordShadowCascades(CommandBuffer *pCmds, const ScenePassResources &res, const vector<SceneDrawItem> &items,
+   const vector<unsigned int> &drawMasks)
+{
+   if (items.empty()) return;
+
+   pCmds->BindInputLayout(res.inputLayout);
+   pCmds->BindRasterState(res.rasterState);
+   pCmds->BindShader(STAGE_VERTEX, res.vertexShader);
+   pCmds->BindShader(STAGE_PIXEL, NULL_HANDLE);
+   pCmds->BindVertexBuffer(1, res.instanceBuffer, res.instanceStride, 0);
+
+   for (unsigned int cascade = 0; cascade < NUM_SHADOW_CASCADES; cascade++)
+   {
+      Viewport viewport = { (float)(cascade * res.cascadeSize), 0.0f, (float)res.cascadeSize,
+         (float)res.cascadeSize, 0.0f, 1.0f };
+      pCmds->SetViewport(viewport);
+      pCmds->BindConstantBuffers(STAGE_VERTEX, 0, 1, &res.cascadeTransformConstants[cascade]);
+
+      for (size_t draw = 0; draw < items.size(); draw++)
+      {
+         if (!(drawMasks[draw] & (1 << cascade))) continue;
+
+         const SceneDrawItem &item = items[draw];
+         pCmds->BindVertexBuffer(0, item.vertexBuffer, res.vertexStride, 0);
+         pCmds->BindIndexBuffer(item.indexBuffer);
+         pCmds->DrawIndexedInstanced(item.numIndices, item.numInstances, 0, 0, item.firstInstance);
+      }
+   }
+}
+
+void RecordEvsmMoments(CommandBuffer *pCmds, const ScenePassResources &res)
+{
+   if (res.shadowFilter != SHADOW_FILTER_EVSM) return;
+
+   pCmds->BindShader(STAGE_COMPUTE, res.evsmMomentsCS);
+   pCmds->BindConstantBuffers(STAGE_COMPUTE, 0, 1, &res.cascadeConstants);
+   unsigned int groups = (res.cascadeSize + EVSM_THREAD_GROUP_SIZE - 1) / EVSM_THREAD_GROUP_SIZE;
+   pCmds->Dispatch(groups * NUM_SHADOW_CASCADES, groups, 1);
+}
+
+void RecordEvsmMips(CommandBuffer *pCmds, const ScenePassResources &res)
+{
+   if (res.shadowFilter != SHADOW_FILTER_EVSM) return;
+
+   pCmds->GenerateMips(res.shadowMomentsSrv);
+}
+
+void BuildIndirectDrawArgs(const vector<SceneDrawItem> &items, vector<IndirectDrawArgs> *pArgs)
+{
+   pArgs->resize(items.size());
+   for (size_t i = 0; i < items.size(); i++)
+   {
+      IndirectDrawArgs &args = (*pArgs)[i];
+      args.indexCountPerInstance = items[i].numIndices;
+      args.instanceCount = 0;
+      args.startIndexLocation = 0;
+      args.baseVertexLocation = 0;
+      args.startInstanceLocation = items[i].firstInstance;
+   }
+}
+
+void RecordInstanceCulling(CommandBuffer *pCmds, const ScenePassResources &res, unsigned int pass,
+   const CullConstants &constants)
+{
+   if (!res.gpuCulling) return;
+
+   pCmds->CopyResource(res.drawArgs[pass], res.drawArgsTemplate[pass]);
+   pCmds->UpdateBuffer(res.cullConstants, &constants, sizeof(constants));
+
+   pCmds->BindShader(STAGE_COMPUTE, res.cullCS);
+   pCmds->BindConstantBuffers(STAGE_COMPUTE, 0, 1, &res.cullConstants);
+   pCmds->Dispatch((res.numInstances + CULL_THREAD_GROUP_SIZE - 1) / CULL_THREAD_GROUP_SIZE, 1, 1);
+}
+
+void RecordBlurPass(CommandBuffer *pCmds, const ScenePassResources &res, const BlurConstants &constants)
+{
+   pCmds->UpdateBuffer(res.blurConstants, &constants, sizeof(constants));
+
+   pCmds->BindShader(STAGE_COMPUTE, res.gaussianBlurCS);
+   pCmds->BindConstantBuffers(STAGE_COMPUTE, 0, 1, &res.blurConstants);
+   unsigned int lineLength = constants.horizontal ? constants.width : constants.height;
+   unsigned int numLines = constants.horizontal ? constants.height : constants.width;
+   pCmds->Dispatch((lineLength + BLUR_PASS_GROUP_SIZE - 1) / BLUR_PASS_GROUP_SIZE, numLines, 1);
+}
+
+void RecordVplFlux(CommandBuffer *pCmds, const ScenePassResources &res, const VplConstants &constants)
+{
+   pCmds->UpdateBuffer(res.vplConstants, &constants, sizeof(constants));
+
+   pCmds->BindShader(STAGE_COMPUTE, res.vplFluxCS);
+   pCmds->BindConstantBuffers(STAGE_COMPUTE, 0, 1, &res.vplConstants);
+   pCmds->Dispatch((res.shadowMapWidth + VPL_FLUX_GROUP_SIZE - 1) / VPL_FLUX_GROUP_SIZE,
+      (res.shadowMapHeight + VPL_FLUX_GROUP_SIZE - 1) / VPL_FLUX_GROUP_SIZE, 1);
+}
+
+void RecordLightBufferGeneration(CommandBuffer *pCmds, const ScenePassResources &res, const VplConstants &constants)
+{
+   pCmds->UpdateBuffer(res.vplConstants, &constants, sizeof(constants));
+
+   pCmds->BindShader(STAGE_COMPUTE, res.blurCS);
+   pCmds->BindConstantBuffers(STAGE_COMPUTE, 0, 1, &res.vplConstants);
+   pCmds->Dispatch((res.shadowMapWidth + BLUR_THREAD_GROUP_SIZE - 1) / BLUR_THREAD_GROUP_SIZE,
+      (res.shadowMapHeight + BLUR_THREAD_GROUP_SIZE - 1) / BLUR_THREAD_GROUP_SIZE, 1);
+
+   // The number of VPLs only exists on the GPU
+   pCmds->CopyStructureCount(res.vplCount, 0, res.lightBufferUav);
+}
+
+void RecordLightBinning(CommandBuffer *pCmds, const ScenePassResources &res)
+{
+   pCmds->BindShader(STAGE_COMPUTE, res.lightBinCS);
+   pCmds->BindConstantBuffers(STAGE_COMPUTE, 0, 1, &res.vplCount);
+   pCmds->Dispatch(LIGHT_GRID_WIDTH, LIGHT_GRID_HEIGHT, 1);
+}
+
+void RecordClusterAssignment(CommandBuffer *pCmds, const ScenePassResources &res, const ClusterConstants &constants,
+   const vector<ClusterLight> &viewLights, const ClusterAssignment &cpuAssignment)
+{
+   pCmds->UpdateBuffer(res.clusterConstants, &constants, sizeof(constants));
+   if (!viewLights.empty())
+   {
+      pCmds->UpdateBuffer(res.clusterLights, &viewLights[0], (unsigned int)(viewLights.size() * sizeof(ClusterLight)));
+   }
+
+   if (res.gpuClusterAssignment)
+   {
+      pCmds->BindShader(STAGE_COMPUTE, res.clusterAssignCS);
+      pCmds->BindConstantBuffers(STAGE_COMPUTE, 0, 1, &res.clusterConstants);
+      pCmds->Dispatch(NUM_CLUSTERS, 1, 1);
+   }
+   else
+   {
+      const vector<ClusterHeader> &headers = cpuAssignment.clusters;
+      const vector<unsigned int> &indices = cpuAssignment.lightIndices;
+      if (!headers.empty())
+      {
+         pCmds->UpdateBuffer(res.clusters, &headers[0], (unsigned int)(headers.size() * sizeof(ClusterHeader)));
+      }
+      if (!indices.empty())
+      {
+         pCmds->UpdateBuffer(res.clusterLightIndices, &indices[0], (unsigned int)(indices.size() * sizeof(unsigned int)));
+      }
+   }
+}
@@ -0,0 +1,415 @@
+#pragma once
+
+#include <vector>
+
+#include "ClusteredLighting.h"
+#include "CommandBuffer.h"
+#include "Deferred.h"
+#include "DepthPrepass.h"
+#include "GaussianBlur.h"
+#include "GpuCulling.h"
+#include "ParallelRecorder.h"
+#include "RenderGraph.h"
+#include "ShadowCache.h"
+#include "ShadowCascades.h"
+#include "Ssao.h"
+#include "VplSampling.h"
+
+enum ScenePass
+{
+   SHADOW_PASS = 0,
+   MAIN_PASS,
+   NUM_SCENE_PASSES
+};
+
+// Everything needed to issue the instances of one mesh, material included.
+// The instances' transforms are a range of the scene's instance buffer.
+struct SceneDrawItem
+{
+   ResourceHandle vertexBuffer;
+   ResourceHandle indexBuffer;
+   ResourceHandle materialConstants;
+   ResourceHandle texture;
+   unsigned int numIndices;
+   unsigned int firstInstance;
+   unsigned int numInstances;
+
+   // Drawn by the transparent passes instead of the main view's other
+   // passes. They also bind the material's opacity map, which may be null.
+   bool transparent;
+   ResourceHandle opacityTexture;
+};
+
+// Handles of the objects the frame's passes bind
+struct ScenePassResources
+{
+   ResourceHandle inputLayout;
+   ResourceHandle rasterState;
+   ResourceHandle vertexShader;
+   ResourceHandle solidColorPS;
+   ResourceHandle texturePS;
+   ResourceHandle textureNoShadingPS;
+   ResourceHandle blurCS;
+   ResourceHandle lightBinCS;
+   ResourceHandle vplFluxCS;
+   ResourceHandle gaussianBlurCS;
+   ResourceHandle colorSampler;
+   ResourceHandle shadowSampler;
+
+   ResourceHandle lightConstants;
+   ResourceHandle cameraTransformConstants;
+   ResourceHandle lightTransformConstants;
+   ResourceHandle instanceBuffer;
+   ResourceHandle vplConstants;
+
+   // Shared by all blur passes, each uploads its constants before it runs
+   ResourceHandle blurConstants;
+
+   // Constant buffer the light buffer's append count is copied into
+   ResourceHandle vplCount;
+
+   // Cascade c's view projection for the vertex shader, and all of them for
+   // the main pass' lookup
+   ResourceHandle cascadeTransformConstants[NUM_SHADOW_CASCADES];
+   ResourceHandle cascadeConstants;
+
+   // SHADOW_FILTER_PCF or SHADOW_FILTER_EVSM. The EVSM passes warp the
+   // cascade atlas into moments, blur them into the mipmapped moments
+   // texture and do nothing when the cascades are filtered with PCF.
+   unsigned int shadowFilter;
+   ResourceHandle evsmMomentsCS;
+   ResourceHandle momentsSampler;
+   ResourceHandle shadowMomentsSrv;
+   ResourceHandle shadowMomentsUav;
+
+   // Partial shadow map updates clear their rectangle with a full screen
+   // triangle and redraw the draws touching it with scissoring on
+   ResourceHandle planeVS;
+   ResourceHandle shadowClearPS;
+   ResourceHandle scissorRasterState;
+   ResourceHandle clearDepthState;
+
+   // Ambient occlusion at half resolution from the normal pass' view space
+   // normals and depth, accumulated over frames. The history and resolved
+   // surfaces swap every frame, the handles are pointed at this frame's.
+   ResourceHandle normalDepthPS;
+   ResourceHandle ssaoCS;
+   ResourceHandle ssaoTemporalCS;
+   ResourceHandle ssaoUpsampleCS;
+   ResourceHandle ssaoConstants;
+   ResourceHandle ssaoHistorySrv;
+   ResourceHandle ssaoResolvedSrv;
+   ResourceHandle ssaoResolvedUav;
+
+   // Deferred shading draws the main pass into the compact G-buffer with
+   // the G-buffer shaders instead, lights it in screen tiles with a compute
+   // pass and copies the result to the back buffer. Changing it needs the
+   // graph declared again.
+   bool deferredShading;
+   ResourceHandle gbufferPS;
+   ResourceHandle gbufferTexturePS;
+   ResourceHandle deferredLightingCS;
+   ResourceHandle deferredCompositePS;
+   ResourceHandle deferredConstants;
+
+   // The main pass' depth is laid down by a pass drawing positions only,
+   // the main pass then tests for EQUAL without writing so each pixel is
+   // shaded once. Changing it needs the graph declared again.
+   bool depthPrepass;
+   ResourceHandle depthOnlyVS;
+   ResourceHandle equalDepthState;
+
+   // Transparent draws are shaded after the opaque ones into a linked list
+   // per pixel, depth tested without writing, and the resolve blends the
+   // lists over the back buffer. The node buffer is owned by the renderer,
+   // which sizes it to the fragments counted on earlier frames.
+   // drawTransparent picks which of the draws the main view's passes issue.
+   bool drawTransparent;
+   ResourceHandle oitPS;
+   ResourceHandle oitTexturePS;
+   ResourceHandle oitResolvePS;
+   ResourceHandle testDepthState;
+   ResourceHandle oitBlendState;
+   ResourceHandle oitNodesSrv;
+   ResourceHandle oitNodesUav;
+   ResourceHandle oitNodeCountUav;
+
+   // Or blended in any order into the weighted accumulation and revealage
+   // targets and composited with the resolve's blend state. Which of the
+   // two runs is up to the renderer, the graph declares both.
+   ResourceHandle weightedOitPS;
+   ResourceHandle weightedOitTexturePS;
+   ResourceHandle weightedOitCompositePS;
+   ResourceHandle weightedOitBlendState;
+
+   // Temporal anti-aliasing: the opaque and transparent passes draw into a
+   // transient scene color with a jittered projection, which is resolved
+   // against last frame's result and sharpened into the back buffer. The
+   // history and resolved surfaces swap every frame like the ambient
+   // occlusion's. Changing it needs the graph declared again.
+   bool temporalAA;
+   ResourceHandle taaMotionCS;
+   ResourceHandle taaResolveCS;
+   ResourceHandle taaSharpenPS;
+   ResourceHandle taaConstants;
+   ResourceHandle taaHistorySrv;
+   ResourceHandle taaResolvedSrv;
+   ResourceHandle taaResolvedUav;
+
+   // Dynamic resolution draws the frame into the top left of the full size
+   // targets, mainViewport is the scaled part and outputViewport the back
+   // buffer, and the upscale stretches it over the back buffer. The scale
+   // changes with the viewport alone, turning it on and off needs the graph
+   // declared again.
+   bool dynamicResolution;
+   ResourceHandle upscalePS;
+   ResourceHandle upscaleConstants;
+
+   // Coarse VPL shading: the forward main pass' VPL light is shaded at one
+   // pixel per coarseVplFactor squared block of the normal pass' output,
+   // upsampled along the surfaces and read by coarseVplTexturePS. The
+   // deferred and transparent passes keep shading it per pixel. Changing it
+   // or the factor needs the graph declared again.
+   bool coarseVpl;
+   unsigned int coarseVplFactor;
+   ResourceHandle coarseVplCS;
+   ResourceHandle vplUpsampleCS;
+   ResourceHandle coarseVplTexturePS;
+   ResourceHandle coarseVplConstants;
+
+   // Baked irradiance probes replace the VPL light of the forward and
+   // transparent passes, which then leave the VPL buffers unread so the
+   // light map and VPL passes are culled. PlainPixel.hlsl picks the probes
+   // from irradianceProbeConstants, the deferred lighting keeps the VPLs.
+   // Changing it needs the graph declared again.
+   bool irradianceProbes;
+   ResourceHandle irradianceProbesSrv;
+   ResourceHandle irradianceProbeConstants;
+
+   // The render targets only used within the frame are transients owned by
+   // the render graph
+   ResourceHandle backBufferTarget;
+   ResourceHandle depthView;
+   ResourceHandle lightBufferUav;
+   ResourceHandle lightBufferSrv;
+   ResourceHandle lightTilesUav;
+   ResourceHandle lightTilesSrv;
+   ResourceHandle lightIndicesUav;
+   ResourceHandle lightIndicesSrv;
+   ResourceHandle totalFluxUav;
+   ResourceHandle totalFluxSrv;
+
+   // The light map and the cascades are sized independently of the back
+   // buffer, cascadeSize is the side of one cascade in the atlas. The main
+   // view's targets are sized to outputViewport.
+   Viewport mainViewport;
+   Viewport outputViewport;
+   Viewport shadowViewport;
+   unsigned int shadowMapWidth;
+   unsigned int shadowMapHeight;
+   unsigned int cascadeSize;
+   unsigned int vertexStride;
+   unsigned int instanceStride;
+
+   // GPU driven submission, the scene passes draw the instances a compute
+   // pass found visible with indirect draws. The argument and visible
+   // instance buffers exist once per scene pass.
+   bool gpuCulling;
+   ResourceHandle cullCS;
+   ResourceHandle cullConstants;
+   ResourceHandle cullInstancesSrv;
+   ResourceHandle drawArgs[NUM_SCENE_PASSES];
+   ResourceHandle drawArgsTemplate[NUM_SCENE_PASSES];
+   ResourceHandle drawArgsUav[NUM_SCENE_PASSES];
+   ResourceHandle visibleInstances[NUM_SCENE_PASSES];
+   ResourceHandle visibleInstancesUav[NUM_SCENE_PASSES];
+   unsigned int numInstances;
+
+   // Clustered lights, assigned to the froxels by a compute pass or on the
+   // CPU and uploaded. The buffer handles are the targets of the uploads.
+   bool gpuClusterAssignment;
+   ResourceHandle clusterAssignCS;
+   ResourceHandle clusterConstants;
+   ResourceHandle clusterLights;
+   ResourceHandle clusterLightsSrv;
+   ResourceHandle clusters;
+   ResourceHandle clustersSrv;
+   ResourceHandle clustersUav;
+   ResourceHandle clusterLightIndices;
+   ResourceHandle clusterLightIndicesSrv;
+   ResourceHandle clusterLightIndicesUav;
+   ResourceHandle clusterIndexCounterUav;
+};
+
+// The two passes of a separable blur
+struct SeparableBlurPasses
+{
+   RenderGraphPass horizontal;
+   RenderGraphPass vertical;
+};
+
+// Graph passes of the frame, scenePasses is indexed by ScenePass. With
+// deferred shading the main scene pass fills the G-buffer, the deferred
+// passes are only declared then and (RenderGraphPass)-1 otherwise. So is
+// the depth pre-pass, the temporal anti-aliasing, the upscale and the
+// coarse VPL passes. The transparent passes run after the opaque ones
+// either way.
+struct SceneGraphPasses
+{
+   RenderGraphPass scenePasses[NUM_SCENE_PASSES];
+   RenderGraphPass shadowCascades;
+   RenderGraphPass evsmMoments;
+   SeparableBlurPasses evsmBlur;
+   RenderGraphPass evsmMips;
+   RenderGraphPass culling[NUM_SCENE_PASSES];
+   RenderGraphPass vplFlux;
+   RenderGraphPass lightBuffer;
+   RenderGraphPass lightBinning;
+   RenderGraphPass clusterAssignment;
+   RenderGraphPass normalDepth;
+   RenderGraphPass ssao;
+   RenderGraphPass ssaoTemporal;
+   RenderGraphPass ssaoUpsample;
+   RenderGraphPass deferredLighting;
+   RenderGraphPass deferredComposite;
+   RenderGraphPass depthPrepass;
+   RenderGraphPass transparent;
+   RenderGraphPass oitResolve;
+   RenderGraphPass weightedTransparent;
+   RenderGraphPass weightedComposite;
+   RenderGraphPass taaMotion;
+   RenderGraphPass taaResolve;
+   RenderGraphPass taaSharpen;
+   RenderGraphPass upscale;
+   RenderGraphPass coarseVpl;
+   RenderGraphPass vplUpsample;
+
+   // Shadow pass outputs, for reading the reflective shadow map back
+   RenderGraphResource shadowDepth;
+   RenderGraphResource lightMap;
+
+   // Normal pass output, for capturing what the ambient occlusion sees
+   RenderGraphResource sceneNormals;
+};
+
+// Declares a GaussianBlurCS.hlsl blur of source into dest through a
+// transient with dest's description. pDepth is only needed for bilateral
+// blurs and may be NULL. The passes are named after name.
+void DeclareSeparableBlur(RenderGraph *pGraph, const char *name, RenderGraphResource source,
+   const RenderGraphResource *pDepth, RenderGraphResource dest, const RenderGraphTextureDesc &desc,
+   SeparableBlurPasses *pPasses);
+
+// Declares the frame's resources, clears and passes. The callbacks are left
+// to the caller since they depend on how the scene passes are submitted.
+void DeclareSceneGraph(RenderGraph *pGraph, const ScenePassResources &res, SceneGraphPasses *pPasses);
+
+// Sets up the pipeline state for a scene pass and issues the draws in the
+// chunk. Outputs and pass inputs are bound by the render graph, everything
+// else is set from scratch so the commands can be replayed on a fresh
+// deferred context. Draw indices wrap around the item list. The main view
+// only issues the draws whose transparent flag matches res.drawTransparent,
+// with res.coarseVpl its textured draws read the upsampled VPL light.
+// Draws of the main view bind res.irradianceProbeConstants.
+void RecordScenePass(CommandBuffer *pCmds, const ScenePassResources &res, const std::vector<SceneDrawItem> &items,
+   unsigned int pass, const DrawChunk &chunk);
+
+// Redraws the rectangle of the cached light map and shadow depth, items are
+// the draws that can touch it. Recorded in the shadow pass without its
+// clears, the rest of the map keeps its contents.
+void RecordShadowRegionUpdate(CommandBuffer *pCmds, const ScenePassResources &res, const std::vector<SceneDrawItem> &items,
+   const ShadowRect &rect);
+
+// Draws the chunk's draws of the main view with NormalDepthPS.hlsl, with the
+// main pass' culling results and state
+void RecordNormalDepthPass(CommandBuffer *pCmds, const ScenePassResources &res, const std::vector<SceneDrawItem> &items,
+   const DrawChunk &chunk);
+
+// Draws the chunk's draws of the main view into the main pass' depth with
+// PlainVert.hlsl's position only entry point and no pixel shader
+void RecordDepthPrepass(CommandBuffer *pCmds, const ScenePassResources &res, const std::vector<SceneDrawItem> &items,
+   const DrawChunk &chunk);
+
+// Draws the chunk's transparent draws of the main view into the per-pixel
+// lists with PlainPixel.hlsl's OIT entry points
+void RecordTransparentPass(CommandBuffer *pCmds, const ScenePassResources &res, const std::vector<SceneDrawItem> &items,
+   const DrawChunk &chunk);
+
+// Blends the per-pixel lists over the back buffer with OitResolvePS.hlsl
+void RecordOitResolve(CommandBuffer *pCmds, const ScenePassResources &res);
+
+// Draws the chunk's transparent draws of the main view into the weighted
+// targets with PlainPixel.hlsl's weighted OIT entry points
+void RecordWeightedTransparentPass(CommandBuffer *pCmds, const ScenePassResources &res,
+   const std::vector<SceneDrawItem> &items, const DrawChunk &chunk);
+
+// Composites the weighted targets over the back buffer with
+// WeightedOitCompositePS.hlsl
+void RecordWeightedOitComposite(CommandBuffer *pCmds, const ScenePassResources &res);
+
+// The ambient occlusion passes, all of them read res.ssaoConstants which
+// the frame uploads before the graph runs
+void RecordSsao(CommandBuffer *pCmds, const ScenePassResources &res);
+void RecordSsaoTemporal(CommandBuffer *pCmds, const ScenePassResources &res);
+void RecordSsaoUpsample(CommandBuffer *pCmds, const ScenePassResources &res);
+
+// The temporal anti-aliasing passes, all of them read res.taaConstants which
+// the frame uploads before the graph runs. The sharpen draws into the back
+// buffer with TaaSharpenPS.hlsl.
+void RecordTaaMotion(CommandBuffer *pCmds, const ScenePassResources &res);
+void RecordTaaResolve(CommandBuffer *pCmds, const ScenePassResources &res);
+void RecordTaaSharpen(CommandBuffer *pCmds, const ScenePassResources &res);
+
+// Stretches the scaled frame over the back buffer with UpscalePS.hlsl and
+// res.upscaleConstants
+void RecordUpscale(CommandBuffer *pCmds, const ScenePassResources &res);
+
+// The coarse VPL passes of VplShadingCS.hlsl, both read
+// res.coarseVplConstants which the frame uploads before the graph runs
+void RecordCoarseVpl(CommandBuffer *pCmds, const ScenePassResources &res);
+void RecordVplUpsample(CommandBuffer *pCmds, const ScenePassResources &res);
+
+// Lights the G-buffer with DeferredLightingCS.hlsl, one group per screen
+// tile, then draws the lit color to the back buffer
+void RecordDeferredLighting(CommandBuffer *pCmds, const ScenePassResources &res);
+void RecordDeferredComposite(CommandBuffer *pCmds, const ScenePassResources &res);
+
+// Draws the directional light's shadow cascades into their parts of the
+// atlas, depth only. Draw i is only issued for the cascades set in
+// drawMasks[i], all instances of a draw are drawn.
+void RecordShadowCascades(CommandBuffer *pCmds, const ScenePassResources &res, const std::vector<SceneDrawItem> &items,
+   const std::vector<unsigned int> &drawMasks);
+
+// Warps the cascade atlas' depths into EVSM moments with the exponents in
+// res.cascadeConstants
+void RecordEvsmMoments(CommandBuffer *pCmds, const ScenePassResources &res);
+
+// Fills the moments texture's mips from the blurred top mip
+void RecordEvsmMips(CommandBuffer *pCmds, const ScenePassResources &res);
+
+// Argument template of the indirect draws, one per draw item with the
+// instance count left at 0 for the culling pass to fill in
+void BuildIndirectDrawArgs(const std::vector<SceneDrawItem> &items, std::vector<IndirectDrawArgs> *pArgs);
+
+// Resets the pass' draw arguments and culls the instances against the
+// frustum, does nothing unless res.gpuCulling is set
+void RecordInstanceCulling(CommandBuffer *pCmds, const ScenePassResources &res, unsigned int pass,
+   const CullConstants &constants);
+
+// One pass of a separable blur, constants.horizontal picks the direction
+void RecordBlurPass(CommandBuffer *pCmds, const ScenePassResources &res, const BlurConstants &constants);
+
+// Sums the light map's flux the VPLs are importance sampled by, at the
+// constants' fixed point scale
+void RecordVplFlux(CommandBuffer *pCmds, const ScenePassResources &res, const VplConstants &constants);
+
+// Blurs the shadow map and generates the VPLs from the light map, then
+// copies their count to res.vplCount for the passes reading them
+void RecordLightBufferGeneration(CommandBuffer *pCmds, const ScenePassResources &res, const VplConstants &constants);
+
+// Sorts the VPLs into the light grid the main pass looks its lights up in
+void RecordLightBinning(CommandBuffer *pCmds, const ScenePassResources &res);
+
+// Uploads the frame's view space lights and assigns them to the clusters,
+// cpuAssignment is uploaded instead unless res.gpuClusterAssignment is set
+void RecordClusterAssignment(CommandBuffer *pCmds, const ScenePassResources &res, const ClusterConstants &constants,
+   const std::vector<ClusterLight> &viewLights, const ClusterAssignment &cpuAssignment);
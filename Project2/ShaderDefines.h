@@ -0,0 +1,152 @@
+#ifndef SHADER_DEFINES_H
+#define SHADER_DEFINES_H
+
+// Shared by the HLSL sources and the C++ code, only plain defines belong here
+
+// Light map size the VPL brightness is calibrated for. The light map's
+// size is a runtime setting, other sizes scale each texel's share of the
+// flux through VplConstants.
+#define REFERENCE_RSM_WIDTH 1024
+#define REFERENCE_RSM_HEIGHT 768
+
+// BlurCS.hlsl used to emit one VPL per TILE_WIDTH x TILE_HEIGHT block of
+// the shadow map. The VPLs are importance sampled now, DEFAULT_VPLS of them
+// unless changed at runtime, and keep the brightness a VPL had covering
+// VPL_REFERENCE_TEXELS texels.
+#define TILE_WIDTH 32
+#define TILE_HEIGHT 32
+#define DEFAULT_VPLS ((REFERENCE_RSM_WIDTH / TILE_WIDTH) * (REFERENCE_RSM_HEIGHT / TILE_HEIGHT))
+#define VPL_REFERENCE_TEXELS (TILE_WIDTH * TILE_HEIGHT)
+
+// Capacity of the light buffer, VPLs appended past it are dropped
+#define MAX_VPLS 4096
+
+// The VPLs are picked by the light map's luminance in fixed point so the
+// total can be summed with atomics. Texels are clamped to
+// MAX_TEXEL_LUMINANCE, and maps too large for FLUX_FIXED_POINT_SCALE use a
+// coarser scale so the sum cannot overflow.
+#define FLUX_FIXED_POINT_SCALE 256
+#define MAX_TEXEL_LUMINANCE 16
+#define VPL_FLUX_GROUP_SIZE 16
+
+// The VPLs are picked by thresholding with a 2^n x 2^n Bayer matrix
+#define VPL_DITHER_BITS 6
+
+// BlurCS.hlsl runs on BLUR_THREAD_GROUP_SIZE squared tiles of the light map
+#define BLUR_THREAD_GROUP_SIZE 16
+
+// GaussianBlurCS.hlsl blurs lines of BLUR_PASS_GROUP_SIZE texels per group.
+// The tap weights are packed four to a register.
+#define MAX_BLUR_RADIUS 16
+#define BLUR_PASS_GROUP_SIZE 128
+#define BLUR_WEIGHT_VECTORS ((MAX_BLUR_RADIUS + 4) / 4)
+
+// Reach of a VPL in light space (shadow map UV and depth)
+#define MAX_LIGHT_RADIUS 0.2
+
+// Light grid LightBinCS.hlsl sorts the VPLs into, tiles cover the shadow
+// map's UV space
+#define LIGHT_GRID_WIDTH 16
+#define LIGHT_GRID_HEIGHT 12
+#define LIGHT_BIN_THREAD_GROUP_SIZE 64
+
+// A tile's index list has room for every VPL so it can never overflow
+#define MAX_LIGHTS_PER_TILE MAX_VPLS
+
+// The VPL light can be shaded at a coarse pixel per block of the main view
+// and upsampled in VPL_SHADING_THREAD_GROUP_SIZE squared tiles
+#define VPL_SHADING_THREAD_GROUP_SIZE 8
+
+// Baked irradiance probes hold the L2 spherical harmonics of the static
+// indirect light, 9 RGB coefficients padded to IRRADIANCE_PROBE_VECTORS
+// float4s per probe
+#define IRRADIANCE_SH_COEFFICIENTS 9
+#define IRRADIANCE_PROBE_VECTORS 7
+
+// Cascaded shadow maps of the directional light. The cascades sit side by
+// side in one atlas, cascade c in the square of the cascade size at x =
+// c * size. The size is a runtime setting up to MAX_SHADOW_CASCADE_SIZE,
+// which keeps the atlas within D3D11's texture width. The depth bias is in
+// texels of the cascade.
+#define NUM_SHADOW_CASCADES 4
+#define DEFAULT_SHADOW_CASCADE_SIZE 1024
+#define MAX_SHADOW_CASCADE_SIZE 4096
+#define SHADOW_CASCADE_BIAS_TEXELS 1.5
+
+// The cascades are filtered with n x n bilinear comparison taps two texels
+// apart, n can be changed at runtime up to MAX_SHADOW_PCF_TAPS_SQRT
+#define DEFAULT_SHADOW_PCF_TAPS_SQRT 2
+#define MAX_SHADOW_PCF_TAPS_SQRT 4
+
+// Or with exponential variance shadow maps, the atlas' depths warped to
+// exp(c * (2d - 1)) moments in EVSM_THREAD_GROUP_SIZE squared tiles,
+// blurred and mipmapped. Exponents past EVSM_MAX_EXPONENT overflow the
+// squared moments in fp32.
+#define SHADOW_FILTER_PCF 0
+#define SHADOW_FILTER_EVSM 1
+#define EVSM_THREAD_GROUP_SIZE 16
+#define EVSM_MAX_EXPONENT 42.0
+#define DEFAULT_EVSM_POSITIVE_EXPONENT 40.0
+#define DEFAULT_EVSM_NEGATIVE_EXPONENT 5.0
+#define DEFAULT_EVSM_BLUR_RADIUS 2
+
+// Froxel grid of the clustered lights. x and y split the screen evenly, z
+// slices view depth exponentially between the near and far plane.
+#define CLUSTER_GRID_X 16
+#define CLUSTER_GRID_Y 12
+#define CLUSTER_GRID_Z 24
+#define NUM_CLUSTERS (CLUSTER_GRID_X * CLUSTER_GRID_Y * CLUSTER_GRID_Z)
+#define CLUSTER_THREAD_GROUP_SIZE 64
+
+// Ambient occlusion of the main view at half resolution, in
+// SSAO_THREAD_GROUP_SIZE squared tiles, from the view space normals and
+// depth of the normal pass. The samples spiral SSAO_SPIRAL_TURNS times
+// around the pixel and the spiral turns from pixel to pixel and frame to
+// frame, so the temporal accumulation sees different samples every frame.
+#define SSAO_THREAD_GROUP_SIZE 8
+#define SSAO_SPIRAL_TURNS 7
+#define MAX_SSAO_SAMPLES 32
+#define DEFAULT_SSAO_SAMPLES 12
+
+// Deferred shading lights the G-buffer in DEFERRED_TILE_SIZE squared
+// screen tiles, each culling the clustered lights against its depth bounds
+// and keeping at most MAX_LIGHTS_PER_DEFERRED_TILE. The G-buffer's alpha
+// holds the material, which of PlainPixel.hlsl's entry points shades it.
+#define DEFERRED_TILE_SIZE 16
+#define MAX_LIGHTS_PER_DEFERRED_TILE 256
+#define GBUFFER_MATERIAL_SOLID 0
+#define GBUFFER_MATERIAL_TEXTURED 1
+
+// Temporal anti-aliasing resolves the jittered scene color against the
+// reprojected history in TAA_THREAD_GROUP_SIZE squared tiles
+#define TAA_THREAD_GROUP_SIZE 8
+
+// Transparent surfaces are drawn after the opaque ones into a linked list
+// per pixel, the resolve blends the MAX_OIT_FRAGMENTS_PER_PIXEL nearest
+// fragments of each list back to front. Materials below OIT_OPAQUE_ALPHA
+// are drawn transparent.
+#define MAX_OIT_FRAGMENTS_PER_PIXEL 8
+#define OIT_OPAQUE_ALPHA 0.999
+
+// Or blended in any order into an accumulation and a revealage target,
+// each fragment weighted by alpha * clamp(WBOIT_WEIGHT_SCALE * (1 - z)^3,
+// WBOIT_MIN_WEIGHT, WBOIT_WEIGHT_SCALE) of its depth buffer value z so the
+// nearer ones dominate the average color
+#define OIT_TECHNIQUE_ABUFFER 0
+#define OIT_TECHNIQUE_WEIGHTED 1
+#define WBOIT_WEIGHT_SCALE 3000.0
+#define WBOIT_MIN_WEIGHT 0.01
+
+// Material flags in the material constants. Materials whose alpha comes
+// from the diffuse texture's alpha or from a separate opacity map (map_d)
+// are drawn transparent whatever their opacity.
+#define MATERIAL_FLAG_ALPHA_TEXTURE 0x1
+#define MATERIAL_FLAG_OPACITY_MAP 0x2
+
+// Capacity of the clustered light buffers, lights past a cluster's limit or
+// the index budget are dropped
+#define MAX_CLUSTER_LIGHTS 1024
+#define MAX_LIGHTS_PER_CLUSTER 256
+#define MAX_CLUSTER_LIGHT_INDICES (NUM_CLUSTERS * 32)
+
+#endif
@@ -0,0 +1,172 @@
+#include "ShadowCache.h"
+
+#include <cmath>
+#include <cstring>
+
+using std::vector;
+
+namespace
+{
+   const ShadowRect EMPTY_RECT = { 0, 0, 0, 0 };
+
+   bool SameSphere(const BoundingSphere &a, const BoundingSphere &b)
+   {
+      return a.center[0] == b.center[0] && a.center[1] == b.center[1] && a.center[2] == b.center[2] &&
+         a.radius == b.radius;
+   }
+
+   unsigned int ClampTexel(float texel, unsigned int size)
+   {
+      if (texel < 0.0f) return 0;
+      if (texel > (float)size) return size;
+      return (unsigned int)texel;
+   }
+}
+
+ShadowRect ProjectSphereRect(const float viewProj[16], const BoundingSphere &sphere, unsigned int width,
+   unsigned int height)
+{
+   ShadowRect wholeMap = { 0, 0, width, height };
+
+   // Bounds of the corners of the box around the sphere
+   float minX = 1e30f, minY = 1e30f, maxX = -1e30f, maxY = -1e30f;
+   for (unsigned int corner = 0; corner < 8; corner++)
+   {
+      float p[3];
+      for (unsigned int i = 0; i < 3; i++)
+      {
+         p[i] = sphere.center[i] + ((corner >> i) & 1 ? sphere.radius : -sphere.radius);
+      }
+
+      float clip[4];
+      for (unsigned int i = 0; i < 4; i++)
+      {
+         clip[i] = p[0] * viewProj[i] + p[1] * viewProj[4 + i] + p[2] * viewProj[8 + i] + viewProj[12 + i];
+      }
+      if (clip[3] <= 1e-6f) return wholeMap;
+
+      float x = clip[0] / clip[3];
+      float y = clip[1] / clip[3];
+      if (x < minX) minX = x;
+      if (x > maxX) maxX = x;
+      if (y < minY) minY = y;
+      if (y > maxY) maxY = y;
+   }
+
+   // Clip space y points up, texel rows go down
+   ShadowRect rect;
+   rect.left = ClampTexel(floorf((minX * 0.5f + 0.5f) * width) - 1.0f, width);
+   rect.right = ClampTexel(ceilf((maxX * 0.5f + 0.5f) * width) + 1.0f, width);
+   rect.top = ClampTexel(floorf((0.5f - maxY * 0.5f) * height) - 1.0f, height);
+   rect.bottom = ClampTexel(ceilf((0.5f - minY * 0.5f) * height) + 1.0f, height);
+   if (rect.left >= rect.right || rect.top >= rect.bottom) return EMPTY_RECT;
+   return rect;
+}
+
+bool RectsOverlap(const ShadowRect &a, const ShadowRect &b)
+{
+   return a.left < b.right && b.left < a.right && a.top < b.bottom && b.top < a.bottom;
+}
+
+ShadowRect UnionRects(const ShadowRect &a, const ShadowRect &b)
+{
+   if (GetRectArea(a) == 0) return b;
+   if (GetRectArea(b) == 0) return a;
+
+   ShadowRect rect;
+   rect.left = a.left < b.left ? a.left : b.left;
+   rect.top = a.top < b.top ? a.top : b.top;
+   rect.right = a.right > b.right ? a.right : b.right;
+   rect.bottom = a.bottom > b.bottom ? a.bottom : b.bottom;
+   return rect;
+}
+
+unsigned long long GetRectArea(const ShadowRect &rect)
+{
+   if (rect.left >= rect.right || rect.top >= rect.bottom) return 0;
+   return (unsigned long long)(rect.right - rect.left) * (rect.bottom - rect.top);
+}
+
+ShadowCache::ShadowCache(unsigned int width, unsigned int height) :
+   m_width(width), m_height(height), m_valid(false), m_dirtyRect(EMPTY_RECT)
+{
+   memset(m_viewProj, 0, sizeof(m_viewProj));
+   ResetStats();
+}
+
+void ShadowCache::Invalidate()
+{
+   m_valid = false;
+}
+
+ShadowCacheUpdate ShadowCache::Update(const float viewProj[16], const vector<BoundingSphere> &dynamicCasters)
+{
+   ShadowRect wholeMap = { 0, 0, m_width, m_height };
+   ShadowCacheUpdate update = SHADOW_CACHE_FULL;
+
+   if (m_valid && memcmp(viewProj, m_viewProj, sizeof(m_viewProj)) == 0 &&
+      dynamicCasters.size() == m_dynamicCasters.size())
+   {
+      // A moved caster uncovers what it shadowed last frame and covers
+      // something new
+      ShadowRect dirty = EMPTY_RECT;
+      for (size_t i = 0; i < dynamicCasters.size(); i++)
+      {
+         if (SameSphere(dynamicCasters[i], m_dynamicCasters[i])) continue;
+
+         dirty = UnionRects(dirty, ProjectSphereRect(viewProj, m_dynamicCasters[i], m_width, m_height));
+         dirty = UnionRects(dirty, ProjectSphereRect(viewProj, dynamicCasters[i], m_width, m_height));
+      }
+
+      unsigned long long area = GetRectArea(dirty);
+      if (area == 0)
+      {
+         update = SHADOW_CACHE_SKIP;
+         m_dirtyRect = EMPTY_RECT;
+      }
+      else if (area * 2 <= (unsigned long long)m_width * m_height)
+      {
+         update = SHADOW_CACHE_PARTIAL;
+         m_dirtyRect = dirty;
+      }
+   }
+
+   if (update == SHADOW_CACHE_FULL) m_dirtyRect = wholeMap;
+
+   memcpy(m_viewProj, viewProj, sizeof(m_viewProj));
+   m_dynamicCasters = dynamicCasters;
+   m_valid = true;
+
+   switch (update)
+   {
+   case SHADOW_CACHE_SKIP: m_stats.skippedFrames++; break;
+   case SHADOW_CACHE_PARTIAL: m_stats.partialFrames++; break;
+   case SHADOW_CACHE_FULL: m_stats.fullFrames++; break;
+   }
+   m_stats.updatedTexels += GetRectArea(m_dirtyRect);
+   return update;
+}
+
+void ShadowCache::ResetStats()
+{
+   memset(&m_stats, 0, sizeof(m_stats));
+}
+
+void SelectDrawsInRect(const vector<CullInstance> &instances, const float viewProj[16], unsigned int width,
+   unsigned int height, const ShadowRect &rect, vector<unsigned int> *pDraws)
+{
+   pDraws->clear();
+   vector<bool> selected;
+   for (size_t i = 0; i < instances.size(); i++)
+   {
+      const CullInstance &instance = instances[i];
+      if (instance.drawIndex >= selected.size()) selected.resize(instance.drawIndex + 1, false);
+      if (selected[instance.drawIndex]) continue;
+
+      if (RectsOverlap(rect, ProjectSphereRect(viewProj, instance.bounds, width, height)))
+      {
+         selected[instance.drawIndex] = true;
+         pDraws->push_back(instance.drawIndex);
+      }
+   }
+}
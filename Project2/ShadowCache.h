@@ -0,0 +1,86 @@
+#pragma once
+
+#include <vector>
+
+#include "GpuCulling.h"
+
+// What the shadow pass has to redraw this frame
+enum ShadowCacheUpdate
+{
+   SHADOW_CACHE_SKIP = 0,
+   SHADOW_CACHE_PARTIAL,
+   SHADOW_CACHE_FULL
+};
+
+// Texel rectangle of the shadow map, right and bottom are exclusive. Empty
+// when left >= right or top >= bottom.
+struct ShadowRect
+{
+   unsigned int left;
+   unsigned int top;
+   unsigned int right;
+   unsigned int bottom;
+};
+
+struct ShadowCacheStats
+{
+   unsigned int skippedFrames;
+   unsigned int partialFrames;
+   unsigned int fullFrames;
+
+   // Texels cleared and redrawn by full and partial updates
+   unsigned long long updatedTexels;
+};
+
+// Texels of a width x height map the sphere can cover through the row
+// vector viewProj, padded by a texel. The whole map when part of the sphere
+// is behind the projection's eye, empty when it is off the map.
+ShadowRect ProjectSphereRect(const float viewProj[16], const BoundingSphere &sphere, unsigned int width,
+   unsigned int height);
+
+bool RectsOverlap(const ShadowRect &a, const ShadowRect &b);
+
+// Smallest rectangle containing both, empty rectangles are ignored
+ShadowRect UnionRects(const ShadowRect &a, const ShadowRect &b);
+
+unsigned long long GetRectArea(const ShadowRect &rect);
+
+// Keeps track of what the cached shadow map was rendered with. Static
+// geometry only needs to be drawn again when the light's projection
+// changes, dynamic casters that moved only dirty the texels they covered
+// last frame and cover now.
+class ShadowCache
+{
+public:
+   ShadowCache(unsigned int width, unsigned int height);
+
+   // The next update is a full one, e.g. after the static geometry or the
+   // shadow map itself changed
+   void Invalidate();
+
+   // Compares the frame against the cached map. The dynamic casters are
+   // matched with last frame's by index, a different count redraws
+   // everything. A partial update covering more than half the map becomes
+   // a full one.
+   ShadowCacheUpdate Update(const float viewProj[16], const std::vector<BoundingSphere> &dynamicCasters);
+
+   // Texels the last update redraws, the whole map for full updates
+   const ShadowRect &GetDirtyRect() const { return m_dirtyRect; }
+
+   const ShadowCacheStats &GetStats() const { return m_stats; }
+   void ResetStats();
+
+private:
+   unsigned int m_width;
+   unsigned int m_height;
+   bool m_valid;
+   float m_viewProj[16];
+   std::vector<BoundingSphere> m_dynamicCasters;
+   ShadowRect m_dirtyRect;
+   ShadowCacheStats m_stats;
+};
+
+// Draws with an instance that can touch the rectangle, the draws a partial
+// update has to issue again. Draw indices come from the instances.
+void SelectDrawsInRect(const std::vector<CullInstance> &instances, const float viewProj[16], unsigned int width,
+   unsigned int height, const ShadowRect &rect, std::vector<unsigned int> *pDraws);
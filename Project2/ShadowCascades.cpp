@@ -0,0 +1,186 @@
+#include "ShadowCascades.h"
+
+#include <cmath>
+
+using std::vector;
+
+namespace
+{
+   float Dot(const float a[3], const float b[3])
+   {
+      return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+   }
+
+   void Cross(const float a[3], const float b[3], float result[3])
+   {
+      result[0] = a[1] * b[2] - a[2] * b[1];
+      result[1] = a[2] * b[0] - a[0] * b[2];
+      result[2] = a[0] * b[1] - a[1] * b[0];
+   }
+
+   void Normalize(float v[3])
+   {
+      float length = sqrtf(Dot(v, v));
+      if (length > 0.0f)
+      {
+         for (unsigned int i = 0; i < 3; i++) v[i] /= length;
+      }
+   }
+
+   // Axes of light space, z looks along the light. Only depends on the
+   // light's direction so the texel grid stays put while the camera moves.
+   void ComputeLightBasis(const float lightDir[3], float x[3], float y[3], float z[3])
+   {
+      for (unsigned int i = 0; i < 3; i++) z[i] = -lightDir[i];
+      Normalize(z);
+
+      float up[3] = { 0.0f, 1.0f, 0.0f };
+      if (fabsf(z[1]) > 0.99f)
+      {
+         up[1] = 0.0f;
+         up[2] = 1.0f;
+      }
+      Cross(up, z, x);
+      Normalize(x);
+      Cross(z, x, y);
+   }
+}
+
+void ComputeCascadeSplits(float nearZ, float farZ, float lambda, float splits[NUM_SHADOW_CASCADES])
+{
+   for (unsigned int i = 0; i < NUM_SHADOW_CASCADES; i++)
+   {
+      float t = (float)(i + 1) / NUM_SHADOW_CASCADES;
+      float logSplit = nearZ * powf(farZ / nearZ, t);
+      float uniformSplit = nearZ + (farZ - nearZ) * t;
+      splits[i] = lambda * logSplit + (1.0f - lambda) * uniformSplit;
+   }
+   splits[NUM_SHADOW_CASCADES - 1] = farZ;
+}
+
+void FitShadowCascade(const float invView[16], float tanHalfFovX, float tanHalfFovY, float nearSplit, float farSplit,
+   const float lightDir[3], float casterDistance, unsigned int resolution, ShadowCascade *pCascade)
+{
+   // Smallest sphere around the slice with its center on the view axis,
+   // equally far from the near and far corners unless that falls outside
+   // the slice
+   float cornerScale = tanHalfFovX * tanHalfFovX + tanHalfFovY * tanHalfFovY;
+   float nearExtent = nearSplit * nearSplit * cornerScale;
+   float farExtent = farSplit * farSplit * cornerScale;
+   float centerZ = ((farSplit * farSplit + farExtent) - (nearSplit * nearSplit + nearExtent)) /
+      (2.0f * (farSplit - nearSplit));
+   float radius;
+   if (centerZ >= farSplit)
+   {
+      centerZ = farSplit;
+      radius = sqrtf(farExtent);
+   }
+   else
+   {
+      radius = sqrtf((centerZ - nearSplit) * (centerZ - nearSplit) + nearExtent);
+   }
+
+   float center[3];
+   for (unsigned int i = 0; i < 3; i++) center[i] = centerZ * invView[8 + i] + invView[12 + i];
+
+   float x[3], y[3], z[3];
+   ComputeLightBasis(lightDir, x, y, z);
+
+   float texelSize = 2.0f * radius / resolution;
+   float lightX = floorf(Dot(center, x) / texelSize) * texelSize;
+   float lightY = floorf(Dot(center, y) / texelSize) * texelSize;
+   float lightZ = Dot(center, z);
+   float zNear = lightZ - radius - casterDistance;
+   float depthRange = 2.0f * radius + casterDistance;
+
+   float *m = pCascade->viewProj;
+   for (unsigned int i = 0; i < 3; i++)
+   {
+      m[i * 4 + 0] = x[i] / radius;
+      m[i * 4 + 1] = y[i] / radius;
+      m[i * 4 + 2] = z[i] / depthRange;
+      m[i * 4 + 3] = 0.0f;
+   }
+   m[12] = -lightX / radius;
+   m[13] = -lightY / radius;
+   m[14] = -zNear / depthRange;
+   m[15] = 1.0f;
+
+   ExtractFrustumPlanes(m, &pCascade->frustum);
+   pCascade->nearSplit = nearSplit;
+   pCascade->farSplit = farSplit;
+   pCascade->texelSize = texelSize;
+   pCascade->depthRange = depthRange;
+   pCascade->resolution = resolution;
+}
+
+void FitShadowCascades(const float invView[16], float fovY, float aspect, float nearZ, float shadowDistance,
+   float lambda, const float lightDir[3], float casterDistance, unsigned int resolution,
+   ShadowCascade cascades[NUM_SHADOW_CASCADES])
+{
+   float splits[NUM_SHADOW_CASCADES];
+   ComputeCascadeSplits(nearZ, shadowDistance, lambda, splits);
+
+   float tanHalfFovY = tanf(fovY * 0.5f);
+   float tanHalfFovX = tanHalfFovY * aspect;
+   float nearSplit = nearZ;
+   for (unsigned int c = 0; c < NUM_SHADOW_CASCADES; c++)
+   {
+      FitShadowCascade(invView, tanHalfFovX, tanHalfFovY, nearSplit, splits[c], lightDir, casterDistance, resolution,
+         &cascades[c]);
+      nearSplit = splits[c];
+   }
+}
+
+void SetupCascadeConstants(const ShadowCascade cascades[NUM_SHADOW_CASCADES], unsigned int shadowFilter,
+   unsigned int pcfTapsSqrt, const EvsmSettings &evsm, CascadeConstants *pConstants)
+{
+   if (pcfTapsSqrt < 1) pcfTapsSqrt = 1;
+   if (pcfTapsSqrt > MAX_SHADOW_PCF_TAPS_SQRT) pcfTapsSqrt = MAX_SHADOW_PCF_TAPS_SQRT;
+   pConstants->pcfTapsSqrt = pcfTapsSqrt;
+   pConstants->shadowFilter = shadowFilter;
+
+   float exponents[2] = { evsm.positiveExponent, evsm.negativeExponent };
+   for (unsigned int i = 0; i < 2; i++)
+   {
+      if (exponents[i] < 0.0f) exponents[i] = 0.0f;
+      if (exponents[i] > (float)EVSM_MAX_EXPONENT) exponents[i] = (float)EVSM_MAX_EXPONENT;
+      pConstants->evsmExponents[i] = exponents[i];
+   }
+   pConstants->lightBleedReduction = evsm.lightBleedReduction;
+   pConstants->varianceBias = evsm.varianceBias;
+   pConstants->cascadeSize = (float)cascades[0].resolution;
+   pConstants->padding = 0;
+
+   for (unsigned int c = 0; c < NUM_SHADOW_CASCADES; c++)
+   {
+      for (unsigned int i = 0; i < 16; i++) pConstants->viewProj[c][i] = cascades[c].viewProj[i];
+      pConstants->splits[c] = cascades[c].farSplit;
+      pConstants->depthBias[c] = SHADOW_CASCADE_BIAS_TEXELS * cascades[c].texelSize / cascades[c].depthRange;
+   }
+}
+
+void CullCascadeDraws(const vector<CullInstance> &instances, const ShadowCascade cascades[NUM_SHADOW_CASCADES],
+   unsigned int numDraws, vector<unsigned int> *pDrawMasks)
+{
+   pDrawMasks->assign(numDraws, 0);
+   for (size_t i = 0; i < instances.size(); i++)
+   {
+      const CullInstance &instance = instances[i];
+      unsigned int allCascades = (1 << NUM_SHADOW_CASCADES) - 1;
+      unsigned int &mask = (*pDrawMasks)[instance.drawIndex];
+      if (mask == allCascades) continue;
+
+      for (unsigned int c = 0; c < NUM_SHADOW_CASCADES; c++)
+      {
+         if (SphereInFrustum(cascades[c].frustum, instance.bounds)) mask |= 1 << c;
+      }
+   }
+}
+
+unsigned int GetShadowCascade(const ShadowCascade cascades[NUM_SHADOW_CASCADES], float viewZ)
+{
+   unsigned int c = 0;
+   while (c < NUM_SHADOW_CASCADES && viewZ > cascades[c].farSplit) c++;
+   return c;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <vector>
+
+#include "Evsm.h"
+#include "GpuCulling.h"
+#include "ShaderDefines.h"
+
+// Orthographic projection of the directional light covering one slice of
+// the view frustum. viewProj is the row vector world to clip matrix stored
+// row major, depth grows away from the light.
+struct ShadowCascade
+{
+   float viewProj[16];
+   FrustumPlanes frustum;
+
+   // View space depth range of the slice
+   float nearSplit;
+   float farSplit;
+
+   // World space size of a shadow map texel and depth range of the
+   // projection
+   float texelSize;
+   float depthRange;
+
+   // Side of the cascade's square in the atlas, in texels
+   unsigned int resolution;
+};
+
+// Constant buffer of PlainPixel.hlsl's cascade lookup, the matrices are the
+// cascades' viewProj
+struct CascadeConstants
+{
+   float viewProj[NUM_SHADOW_CASCADES][16];
+   float splits[NUM_SHADOW_CASCADES];
+   float depthBias[NUM_SHADOW_CASCADES];
+
+   // Square root of the PCF tap count
+   unsigned int pcfTapsSqrt;
+
+   // SHADOW_FILTER_PCF or SHADOW_FILTER_EVSM, the rest is EvsmSettings
+   unsigned int shadowFilter;
+   float evsmExponents[2];
+   float lightBleedReduction;
+   float varianceBias;
+
+   // Side of each cascade in the atlas, in texels
+   float cascadeSize;
+   unsigned int padding;
+};
+
+// Far split of each cascade, a blend of logarithmic and uniform splits.
+// lambda = 1 is purely logarithmic, which gives every cascade the same
+// ratio of far to near depth.
+void ComputeCascadeSplits(float nearZ, float farZ, float lambda, float splits[NUM_SHADOW_CASCADES]);
+
+// Fits a cascade around the slice of the view frustum between nearSplit and
+// farSplit. invView is the row vector view to world matrix, lightDir points
+// towards the light. The projection bounds a sphere around the slice so its
+// size does not change as the camera turns, and its origin is snapped to
+// whole texels so it only moves in texel steps as the camera moves. Casters
+// up to casterDistance towards the light from the sphere are kept.
+void FitShadowCascade(const float invView[16], float tanHalfFovX, float tanHalfFovY, float nearSplit, float farSplit,
+   const float lightDir[3], float casterDistance, unsigned int resolution, ShadowCascade *pCascade);
+
+// Splits the view frustum up to shadowDistance and fits every cascade
+void FitShadowCascades(const float invView[16], float fovY, float aspect, float nearZ, float shadowDistance,
+   float lambda, const float lightDir[3], float casterDistance, unsigned int resolution,
+   ShadowCascade cascades[NUM_SHADOW_CASCADES]);
+
+// pcfTapsSqrt is clamped to [1, MAX_SHADOW_PCF_TAPS_SQRT] and the EVSM
+// exponents to [0, EVSM_MAX_EXPONENT]
+void SetupCascadeConstants(const ShadowCascade cascades[NUM_SHADOW_CASCADES], unsigned int shadowFilter,
+   unsigned int pcfTapsSqrt, const EvsmSettings &evsm, CascadeConstants *pConstants);
+
+// Bit c of a draw's mask is set when any of its instances' bounds touch
+// cascade c, the cascade pass skips the draw everywhere else
+void CullCascadeDraws(const std::vector<CullInstance> &instances, const ShadowCascade cascades[NUM_SHADOW_CASCADES],
+   unsigned int numDraws, std::vector<unsigned int> *pDrawMasks);
+
+// Cascade of a view space depth, NUM_SHADOW_CASCADES past the last split
+unsigned int GetShadowCascade(const ShadowCascade cascades[NUM_SHADOW_CASCADES], float viewZ);
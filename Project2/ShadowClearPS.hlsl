@@ -0,0 +1,6 @@
+// Clears the light map inside the scissor rectangle of a partial shadow
+// update, drawn with PlaneVertexShader.hlsl's full screen triangle
+float4 main() : SV_TARGET
+{
+   return float4(0.0f, 0.0f, 0.0f, 0.0f);
+}
@@ -0,0 +1,126 @@
+#include "ShadowFilter.h"
+
+#include <cmath>
+
+using std::vector;
+
+namespace
+{
+   const float WEIGHT_FRACTION_SCALE = 256.0f;
+
+   int ClampTexel(int value, unsigned int size)
+   {
+      if (value < 0) return 0;
+      if (value >= (int)size) return (int)size - 1;
+      return value;
+   }
+
+   float ClampPosition(float value, unsigned int size)
+   {
+      if (value < 0.5f) return 0.5f;
+      if (value > size - 0.5f) return size - 0.5f;
+      return value;
+   }
+
+   float Compare(const ShadowDepthMap &map, int x, int y, float depth)
+   {
+      float stored = map.depth[ClampTexel(y, map.height) * map.width + ClampTexel(x, map.width)];
+      return depth <= stored ? 1.0f : 0.0f;
+   }
+
+   float Tent(float distance)
+   {
+      float weight = 1.0f - fabsf(distance);
+      return weight > 0.0f ? weight : 0.0f;
+   }
+}
+
+float SampleShadowCmp(const ShadowDepthMap &map, float x, float y, float depth)
+{
+   float fx = x - 0.5f;
+   float fy = y - 0.5f;
+   int x0 = (int)floorf(fx);
+   int y0 = (int)floorf(fy);
+   float ax = floorf((fx - x0) * WEIGHT_FRACTION_SCALE) / WEIGHT_FRACTION_SCALE;
+   float ay = floorf((fy - y0) * WEIGHT_FRACTION_SCALE) / WEIGHT_FRACTION_SCALE;
+
+   float top = Compare(map, x0, y0, depth) * (1.0f - ax) + Compare(map, x0 + 1, y0, depth) * ax;
+   float bottom = Compare(map, x0, y0 + 1, depth) * (1.0f - ax) + Compare(map, x0 + 1, y0 + 1, depth) * ax;
+   return top * (1.0f - ay) + bottom * ay;
+}
+
+float FilterShadowPcf(const ShadowDepthMap &map, float x, float y, float depth, unsigned int tapsSqrt)
+{
+   float start = 1.0f - (float)tapsSqrt;
+   float lit = 0.0f;
+   for (unsigned int j = 0; j < tapsSqrt; j++)
+   {
+      float tapY = ClampPosition(y + start + 2.0f * j, map.height);
+      for (unsigned int i = 0; i < tapsSqrt; i++)
+      {
+         float tapX = ClampPosition(x + start + 2.0f * i, map.width);
+         lit += SampleShadowCmp(map, tapX, tapY, depth);
+      }
+   }
+   return lit / (float)(tapsSqrt * tapsSqrt);
+}
+
+float FilterShadowPcfBruteForce(const ShadowDepthMap &map, float x, float y, float depth, unsigned int tapsSqrt)
+{
+   float start = 1.0f - (float)tapsSqrt;
+   vector<float> tapsX(tapsSqrt), tapsY(tapsSqrt);
+   for (unsigned int i = 0; i < tapsSqrt; i++)
+   {
+      tapsX[i] = ClampPosition(x + start + 2.0f * i, map.width);
+      tapsY[i] = ClampPosition(y + start + 2.0f * i, map.height);
+   }
+
+   // Every texel within a texel of a tap, weighted by the taps' tents
+   int minX = (int)floorf(tapsX[0]) - 1;
+   int maxX = (int)floorf(tapsX[tapsSqrt - 1]) + 1;
+   int minY = (int)floorf(tapsY[0]) - 1;
+   int maxY = (int)floorf(tapsY[tapsSqrt - 1]) + 1;
+   float lit = 0.0f;
+   for (int ty = minY; ty <= maxY; ty++)
+   {
+      float weightY = 0.0f;
+      for (unsigned int i = 0; i < tapsSqrt; i++) weightY += Tent(ty + 0.5f - tapsY[i]);
+      if (weightY == 0.0f) continue;
+
+      for (int tx = minX; tx <= maxX; tx++)
+      {
+         float weightX = 0.0f;
+         for (unsigned int i = 0; i < tapsSqrt; i++) weightX += Tent(tx + 0.5f - tapsX[i]);
+         lit += weightX * weightY * Compare(map, tx, ty, depth);
+      }
+   }
+   return lit / (float)(tapsSqrt * tapsSqrt);
+}
+
+float FilterShadowPointTaps(const ShadowDepthMap &map, float x, float y, float depth, unsigned int size)
+{
+   int centerX = (int)floorf(x);
+   int centerY = (int)floorf(y);
+   int first = -(int)(size / 2);
+   float lit = 0.0f;
+   for (int dy = first; dy < first + (int)size; dy++)
+   {
+      for (int dx = first; dx < first + (int)size; dx++)
+      {
+         lit += Compare(map, centerX + dx, centerY + dy, depth);
+      }
+   }
+   return lit / (float)(size * size);
+}
+
+float CompareShadowImages(const vector<float> &a, const vector<float> &b, float tolerance)
+{
+   if (a.size() != b.size() || a.empty()) return 1.0f;
+
+   size_t numDifferent = 0;
+   for (size_t i = 0; i < a.size(); i++)
+   {
+      if (fabsf(a[i] - b[i]) > tolerance) numDifferent++;
+   }
+   return (float)numDifferent / a.size();
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <vector>
+
+#include "ShaderDefines.h"
+
+// Depth of one shadow cascade, row major
+struct ShadowDepthMap
+{
+   unsigned int width;
+   unsigned int height;
+   std::vector<float> depth;
+};
+
+// The filters take positions in texels, (0.5, 0.5) is the center of the
+// first texel, and return the lit fraction, 1 where depth <= the stored
+// depth. Taps are clamped to the map like PlainPixel.hlsl clamps them to
+// their cascade.
+
+// SampleCmpLevelZero with a LESS_EQUAL comparison and bilinear comparison
+// filtering. The weights keep 8 bits of fraction, the filtering precision
+// D3D11 hardware has to provide, so GPU images diff within a 1/256 step.
+float SampleShadowCmp(const ShadowDepthMap &map, float x, float y, float depth);
+
+// CPU version of PlainPixel.hlsl's PCF. tapsSqrt squared bilinear
+// comparisons two texels apart, equally weighted, which filters a
+// 2 * tapsSqrt texels wide square with a one texel linear falloff.
+float FilterShadowPcf(const ShadowDepthMap &map, float x, float y, float depth, unsigned int tapsSqrt);
+
+// The same filter summed texel by texel with exact weights, what the taps
+// have to add up to
+float FilterShadowPcfBruteForce(const ShadowDepthMap &map, float x, float y, float depth, unsigned int tapsSqrt);
+
+// The size x size point comparisons the cascades were filtered with before
+float FilterShadowPointTaps(const ShadowDepthMap &map, float x, float y, float depth, unsigned int size);
+
+// Fraction of values further apart than tolerance, for diffing filtered
+// images against GPU captures
+float CompareShadowImages(const std::vector<float> &a, const std::vector<float> &b, float tolerance);
@@ -3,7 +3,10 @@
 #include<memory>
 #include<string>
 #include<assert.h>
+#include<fstream>
 #include"Renderer.h"
+#include"Benchmarks.h"
+#include"IrradianceProbes.h"
 
 const char *MAIN_WIN_CLASS_NAME = "Test Project";
 LONG UPDATES_PER_SECOND = 60;
@@ -15,13 +18,52 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam);
 
 const UINT NUM_KEYS = 256;
 
+const wchar_t *BENCHMARK_ARG = L"-benchmark";
+const char *BENCHMARK_RESULTS_FILE = "benchmark_results.txt";
+
+const wchar_t *BAKE_PROBES_ARG = L"-bakeprobes";
+const char *BAKE_PROBES_LOG_FILE = "bake_probes_log.txt";
+const char *BAKE_PROBES_DEFAULT_SCENE = "sponza.obj";
+
 D3DBase *g_demo;
 BOOL g_keyArray[NUM_KEYS];
 
 int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE prevInstance, LPWSTR cmdLine, int cmdShow) 
 {
 	UNREFERENCED_PARAMETER( prevInstance );
-	UNREFERENCED_PARAMETER( cmdLine );
+
+   // "-benchmark [filter]" runs the headless CPU benchmarks instead of the demo
+   const wchar_t *benchmarkArg = wcsstr(cmdLine, BENCHMARK_ARG);
+   if (benchmarkArg)
+   {
+      std::string filter;
+      for (const wchar_t *c = benchmarkArg + wcslen(BENCHMARK_ARG); *c; c++)
+      {
+         if (*c != L' ') filter += (char)*c;
+      }
+
+      std::ofstream out(BENCHMARK_RESULTS_FILE);
+      RunBenchmarks(filter, out);
+      return 0;
+   }
+
+   // "-bakeprobes [scene.obj]" bakes the irradiance probes of the scene on
+   // the CPU, the demo loads them on its next start
+   const wchar_t *bakeArg = wcsstr(cmdLine, BAKE_PROBES_ARG);
+   if (bakeArg)
+   {
+      std::string scene;
+      for (const wchar_t *c = bakeArg + wcslen(BAKE_PROBES_ARG); *c; c++)
+      {
+         if (*c != L' ') scene += (char)*c;
+      }
+      if (scene.empty()) scene = BAKE_PROBES_DEFAULT_SCENE;
+
+      ProbeBakeSettings settings;
+      GetDefaultProbeBakeSettings(&settings);
+      std::ofstream log(BAKE_PROBES_LOG_FILE);
+      return BakeIrradianceProbeFile(scene, IRRADIANCE_PROBE_FILE, settings, log) ? 0 : -1;
+   }
 
 	WNDCLASSEX wndClass = { 0 };
 	wndClass.cbSize = sizeof(WNDCLASSEX);
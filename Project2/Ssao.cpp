@@ -0,0 +1,378 @@
+#include "Ssao.h"
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+using std::vector;
+
+namespace
+{
+   const char NORMAL_DEPTH_FILE_MAGIC[4] = { 'N', 'R', 'M', '1' };
+   const float TWO_PI = 6.28318531f;
+
+   float Frac(float x)
+   {
+      return x - floorf(x);
+   }
+
+   float Dot(const float a[3], const float b[3])
+   {
+      return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+   }
+
+   const float *GetTexel(const NormalDepthBuffer &buffer, unsigned int x, unsigned int y)
+   {
+      return &buffer.texels[(y * buffer.width + x) * 4];
+   }
+
+   // Last frame's occlusion of the surface at view space position p, false
+   // when it was off screen or covered by something else
+   bool SampleHistory(const vector<float> &history, const SsaoConstants &constants, const float p[3], float *pAo)
+   {
+      if (history.empty() || constants.historyWeight <= 0.0f) return false;
+
+      const float *m = constants.reprojection;
+      float clip[4];
+      for (unsigned int i = 0; i < 4; i++)
+      {
+         clip[i] = p[0] * m[i] + p[1] * m[4 + i] + p[2] * m[8 + i] + m[12 + i];
+      }
+      if (clip[3] <= 1e-6f) return false;
+
+      float u = (clip[0] / clip[3]) * 0.5f + 0.5f;
+      float v = 0.5f - (clip[1] / clip[3]) * 0.5f;
+      if (u < 0.0f || u >= 1.0f || v < 0.0f || v >= 1.0f) return false;
+
+      unsigned int x = (unsigned int)(u * constants.halfWidth);
+      unsigned int y = (unsigned int)(v * constants.halfHeight);
+      if (x >= constants.halfWidth) x = constants.halfWidth - 1;
+      if (y >= constants.halfHeight) y = constants.halfHeight - 1;
+
+      unsigned int index = (y * constants.halfWidth + x) * 2;
+      float historyZ = history[index + 1];
+      if (historyZ <= 0.0f || fabsf(historyZ - clip[3]) > constants.depthTolerance * clip[3]) return false;
+
+      *pAo = history[index];
+      return true;
+   }
+
+   void Upsample(const NormalDepthBuffer &buffer, const vector<float> &resolved, const SsaoConstants &constants,
+      bool depthAware, vector<float> *pAo)
+   {
+      pAo->assign(buffer.width * buffer.height, 1.0f);
+      for (unsigned int y = 0; y < buffer.height; y++)
+      {
+         for (unsigned int x = 0; x < buffer.width; x++)
+         {
+            const float *texel = GetTexel(buffer, x, y);
+            if (texel[3] == 0.0f) continue;
+            float z = texel[3];
+
+            // Half resolution pixel (x, y) sits on full resolution pixel
+            // (2x, 2y)
+            unsigned int x0 = x / 2, y0 = y / 2;
+            unsigned int x1 = x0 + 1 < constants.halfWidth ? x0 + 1 : x0;
+            unsigned int y1 = y0 + 1 < constants.halfHeight ? y0 + 1 : y0;
+            float tx = (x & 1) ? 0.5f : 0.0f;
+            float ty = (y & 1) ? 0.5f : 0.0f;
+
+            unsigned int sampleX[4] = { x0, x1, x0, x1 };
+            unsigned int sampleY[4] = { y0, y0, y1, y1 };
+            float bilinear[4] = { (1.0f - tx) * (1.0f - ty), tx * (1.0f - ty), (1.0f - tx) * ty, tx * ty };
+
+            float sum = 0.0f, totalWeight = 0.0f;
+            float closestAo = 1.0f, closestDistance = 1e30f;
+            for (unsigned int i = 0; i < 4; i++)
+            {
+               unsigned int index = (sampleY[i] * constants.halfWidth + sampleX[i]) * 2;
+               float ao = resolved[index];
+               float weight = bilinear[i];
+               if (depthAware)
+               {
+                  float distance = fabsf(resolved[index + 1] - z);
+                  float depthWeight = 1.0f - distance / (constants.depthTolerance * z);
+                  weight *= depthWeight > 0.0f ? depthWeight : 0.0f;
+                  if (distance < closestDistance)
+                  {
+                     closestDistance = distance;
+                     closestAo = ao;
+                  }
+               }
+               sum += ao * weight;
+               totalWeight += weight;
+            }
+            (*pAo)[y * buffer.width + x] = totalWeight > 1e-4f ? sum / totalWeight : closestAo;
+         }
+      }
+   }
+}
+
+void GetDefaultSsaoSettings(SsaoSettings *pSettings)
+{
+   pSettings->radius = 1.0f;
+   pSettings->intensity = 1.0f;
+   pSettings->bias = 0.05f;
+   pSettings->numSamples = DEFAULT_SSAO_SAMPLES;
+   pSettings->historyWeight = 0.9f;
+   pSettings->depthTolerance = 0.05f;
+}
+
+void SetupSsaoConstants(const SsaoSettings &settings, unsigned int width, unsigned int height, float tanHalfFovX,
+   float tanHalfFovY, const float reprojection[16], unsigned int frameIndex, SsaoConstants *pConstants)
+{
+   memset(pConstants, 0, sizeof(*pConstants));
+   if (reprojection)
+   {
+      memcpy(pConstants->reprojection, reprojection, sizeof(pConstants->reprojection));
+   }
+   else
+   {
+      for (unsigned int i = 0; i < 4; i++) pConstants->reprojection[i * 5] = 1.0f;
+   }
+   for (unsigned int i = 0; i < 4; i++) pConstants->view[i * 5] = 1.0f;
+
+   pConstants->width = width;
+   pConstants->height = height;
+   pConstants->halfWidth = (width + 1) / 2;
+   pConstants->halfHeight = (height + 1) / 2;
+   pConstants->tanHalfFovX = tanHalfFovX;
+   pConstants->tanHalfFovY = tanHalfFovY;
+   pConstants->projScale = (float)pConstants->halfHeight / (2.0f * tanHalfFovY);
+
+   pConstants->radius = settings.radius;
+   pConstants->intensity = settings.intensity;
+   pConstants->bias = settings.bias;
+   pConstants->historyWeight = reprojection ? settings.historyWeight : 0.0f;
+   pConstants->depthTolerance = settings.depthTolerance;
+
+   unsigned int numSamples = settings.numSamples;
+   if (numSamples < 1) numSamples = 1;
+   if (numSamples > MAX_SSAO_SAMPLES) numSamples = MAX_SSAO_SAMPLES;
+   pConstants->numSamples = numSamples;
+   pConstants->frameIndex = frameIndex;
+}
+
+float SsaoRotation(unsigned int x, unsigned int y, unsigned int frameIndex)
+{
+   float noise = Frac(52.9829189f * Frac(0.06711056f * x + 0.00583715f * y));
+   return Frac(noise + 0.618034f * (frameIndex % 1024));
+}
+
+void GetViewPosition(const SsaoConstants &constants, unsigned int x, unsigned int y, float z, float position[3])
+{
+   float ndcX = (x + 0.5f) / constants.width * 2.0f - 1.0f;
+   float ndcY = 1.0f - (y + 0.5f) / constants.height * 2.0f;
+   position[0] = ndcX * constants.tanHalfFovX * z;
+   position[1] = ndcY * constants.tanHalfFovY * z;
+   position[2] = z;
+}
+
+void ComputeSsaoReference(const NormalDepthBuffer &buffer, const SsaoConstants &constants, vector<float> *pAo)
+{
+   pAo->assign(constants.halfWidth * constants.halfHeight, 1.0f);
+   if (constants.intensity <= 0.0f) return;
+
+   float radius2 = constants.radius * constants.radius;
+   for (unsigned int y = 0; y < constants.halfHeight; y++)
+   {
+      for (unsigned int x = 0; x < constants.halfWidth; x++)
+      {
+         const float *center = GetTexel(buffer, x * 2, y * 2);
+         if (center[3] == 0.0f) continue;
+
+         float p[3];
+         GetViewPosition(constants, x * 2, y * 2, center[3], p);
+         float screenRadius = constants.projScale * constants.radius / center[3];
+         float rotation = SsaoRotation(x, y, constants.frameIndex) * TWO_PI;
+
+         // Samples closer than the radius and above the tangent plane
+         // occlude, falling off with distance. Distances are in radii so
+         // the result does not depend on the scale of the scene.
+         float sum = 0.0f;
+         for (unsigned int i = 0; i < constants.numSamples; i++)
+         {
+            float alpha = (i + 0.5f) / constants.numSamples;
+            float angle = alpha * (SSAO_SPIRAL_TURNS * TWO_PI) + rotation;
+            int sampleX = (int)floorf(x + 0.5f + cosf(angle) * alpha * screenRadius);
+            int sampleY = (int)floorf(y + 0.5f + sinf(angle) * alpha * screenRadius);
+            if (sampleX < 0 || sampleY < 0 || sampleX >= (int)constants.halfWidth ||
+               sampleY >= (int)constants.halfHeight)
+            {
+               continue;
+            }
+
+            const float *texel = GetTexel(buffer, sampleX * 2, sampleY * 2);
+            if (texel[3] == 0.0f) continue;
+
+            float q[3];
+            GetViewPosition(constants, sampleX * 2, sampleY * 2, texel[3], q);
+            float v[3] = { q[0] - p[0], q[1] - p[1], q[2] - p[2] };
+            float vv = Dot(v, v) / radius2;
+            float vn = Dot(v, center) / constants.radius;
+
+            float f = 1.0f - vv;
+            if (f <= 0.0f) continue;
+            float occlusion = (vn - constants.bias) / (vv + 0.01f);
+            if (occlusion > 0.0f) sum += f * f * f * occlusion;
+         }
+
+         float ao = 1.0f - sum * constants.intensity / constants.numSamples;
+         (*pAo)[y * constants.halfWidth + x] = ao > 0.0f ? ao : 0.0f;
+      }
+   }
+}
+
+void AccumulateSsao(const NormalDepthBuffer &buffer, const vector<float> &ao, const vector<float> &history,
+   const SsaoConstants &constants, vector<float> *pResolved)
+{
+   pResolved->resize(constants.halfWidth * constants.halfHeight * 2);
+   for (unsigned int y = 0; y < constants.halfHeight; y++)
+   {
+      for (unsigned int x = 0; x < constants.halfWidth; x++)
+      {
+         unsigned int index = y * constants.halfWidth + x;
+         float *resolved = &(*pResolved)[index * 2];
+         const float *center = GetTexel(buffer, x * 2, y * 2);
+         if (center[3] == 0.0f)
+         {
+            resolved[0] = 1.0f;
+            resolved[1] = 0.0f;
+            continue;
+         }
+
+         float p[3];
+         GetViewPosition(constants, x * 2, y * 2, center[3], p);
+         float historyAo;
+         resolved[0] = ao[index];
+         if (SampleHistory(history, constants, p, &historyAo))
+         {
+            resolved[0] += (historyAo - ao[index]) * constants.historyWeight;
+         }
+         resolved[1] = center[3];
+      }
+   }
+}
+
+void UpsampleSsao(const NormalDepthBuffer &buffer, const vector<float> &resolved, const SsaoConstants &constants,
+   vector<float> *pAo)
+{
+   Upsample(buffer, resolved, constants, true, pAo);
+}
+
+void UpsampleSsaoBilinear(const NormalDepthBuffer &buffer, const vector<float> &resolved,
+   const SsaoConstants &constants, vector<float> *pAo)
+{
+   Upsample(buffer, resolved, constants, false, pAo);
+}
+
+void CreateSyntheticNormalDepth(unsigned int width, unsigned int height, float cameraDistance, NormalDepthBuffer *pBuffer)
+{
+   pBuffer->width = width;
+   pBuffer->height = height;
+   pBuffer->tanHalfFovY = 0.57735f;
+   pBuffer->tanHalfFovX = pBuffer->tanHalfFovY * width / height;
+   pBuffer->texels.assign(width * height * 4, 0.0f);
+
+   // View space scene: the floor at y = -1, the back wall up to y = 1 and a
+   // box on the floor in front of it
+   const float floorY = -1.0f, wallTop = 1.0f;
+   const float boxMin[3] = { -0.5f, -1.0f, cameraDistance - 2.5f };
+   const float boxMax[3] = { 0.5f, -0.4f, cameraDistance - 1.5f };
+
+   for (unsigned int y = 0; y < height; y++)
+   {
+      for (unsigned int x = 0; x < width; x++)
+      {
+         // Ray with a view depth of 1, so distances along it are view depths
+         float dir[3];
+         dir[0] = ((x + 0.5f) / width * 2.0f - 1.0f) * pBuffer->tanHalfFovX;
+         dir[1] = (1.0f - (y + 0.5f) / height * 2.0f) * pBuffer->tanHalfFovY;
+         dir[2] = 1.0f;
+
+         float nearest = 1e30f;
+         float normal[3] = { 0.0f, 0.0f, 0.0f };
+         if (dir[1] * cameraDistance >= floorY && dir[1] * cameraDistance <= wallTop)
+         {
+            nearest = cameraDistance;
+            normal[2] = -1.0f;
+         }
+         if (dir[1] < 0.0f && floorY / dir[1] < nearest)
+         {
+            nearest = floorY / dir[1];
+            normal[0] = 0.0f;
+            normal[1] = 1.0f;
+            normal[2] = 0.0f;
+         }
+
+         float tNear = 0.0f, tFar = 1e30f;
+         unsigned int entryAxis = 0;
+         float entrySign = 0.0f;
+         bool hitBox = true;
+         for (unsigned int i = 0; i < 3 && hitBox; i++)
+         {
+            float t0 = boxMin[i] / dir[i], t1 = boxMax[i] / dir[i];
+            float sign = -1.0f;
+            if (t0 > t1)
+            {
+               float t = t0;
+               t0 = t1;
+               t1 = t;
+               sign = 1.0f;
+            }
+            if (t0 > tNear)
+            {
+               tNear = t0;
+               entryAxis = i;
+               entrySign = sign;
+            }
+            if (t1 < tFar) tFar = t1;
+            hitBox = tNear <= tFar;
+         }
+         if (hitBox && entrySign != 0.0f && tNear < nearest)
+         {
+            nearest = tNear;
+            normal[0] = normal[1] = normal[2] = 0.0f;
+            normal[entryAxis] = entrySign;
+         }
+
+         if (nearest >= 1e30f) continue;
+         float *texel = &pBuffer->texels[(y * width + x) * 4];
+         for (unsigned int i = 0; i < 3; i++) texel[i] = normal[i];
+         texel[3] = nearest;
+      }
+   }
+}
+
+bool SaveNormalDepthBuffer(const char *pPath, const NormalDepthBuffer &buffer)
+{
+   std::ofstream out(pPath, std::ios::binary);
+   if (!out) return false;
+
+   out.write(NORMAL_DEPTH_FILE_MAGIC, sizeof(NORMAL_DEPTH_FILE_MAGIC));
+   out.write((const char *)&buffer.width, sizeof(buffer.width));
+   out.write((const char *)&buffer.height, sizeof(buffer.height));
+   out.write((const char *)&buffer.tanHalfFovX, sizeof(buffer.tanHalfFovX));
+   out.write((const char *)&buffer.tanHalfFovY, sizeof(buffer.tanHalfFovY));
+   out.write((const char *)&buffer.texels[0], buffer.texels.size() * sizeof(float));
+   return out.good();
+}
+
+bool LoadNormalDepthBuffer(const char *pPath, NormalDepthBuffer *pBuffer)
+{
+   std::ifstream in(pPath, std::ios::binary);
+   if (!in) return false;
+
+   char magic[sizeof(NORMAL_DEPTH_FILE_MAGIC)];
+   in.read(magic, sizeof(magic));
+   in.read((char *)&pBuffer->width, sizeof(pBuffer->width));
+   in.read((char *)&pBuffer->height, sizeof(pBuffer->height));
+   in.read((char *)&pBuffer->tanHalfFovX, sizeof(pBuffer->tanHalfFovX));
+   in.read((char *)&pBuffer->tanHalfFovY, sizeof(pBuffer->tanHalfFovY));
+   if (!in || memcmp(magic, NORMAL_DEPTH_FILE_MAGIC, sizeof(magic)) != 0) return false;
+   if (pBuffer->width == 0 || pBuffer->height == 0 || pBuffer->width > 16384 || pBuffer->height > 16384) return false;
+
+   pBuffer->texels.resize(pBuffer->width * pBuffer->height * 4);
+   in.read((char *)&pBuffer->texels[0], pBuffer->texels.size() * sizeof(float));
+   return in.good();
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <vector>
+
+#include "ShaderDefines.h"
+
+// Where the renderer saves the normal pass' output it captures, the ssao
+// benchmark picks it up from there
+#define SSAO_CAPTURE_FILE "ssao_capture.bin"
+
+// Runtime options of the ambient occlusion
+struct SsaoSettings
+{
+   // View space distance the samples reach, in scene units
+   float radius;
+
+   // Strength of the occlusion, 0 turns it off
+   float intensity;
+
+   // Fraction of the radius a sample has to stick out of the pixel's
+   // tangent plane to occlude it, hides the tessellation of curved surfaces
+   float bias;
+
+   // Clamped to [1, MAX_SSAO_SAMPLES]
+   unsigned int numSamples;
+
+   // Weight of last frame's occlusion in the accumulation, 0 turns it off
+   float historyWeight;
+
+   // Relative view depth difference past which a half resolution sample or
+   // last frame's occlusion belongs to a different surface
+   float depthTolerance;
+};
+
+// Constant buffer of SsaoCS.hlsl, SsaoTemporalCS.hlsl and
+// SsaoUpsampleCS.hlsl
+struct SsaoConstants
+{
+   // Row vector matrix from this frame's view space to last frame's clip
+   // space, stored row major
+   float reprojection[16];
+
+   // World to view matrix of the normal pass, left at identity by
+   // SetupSsaoConstants since the CPU kernels start from view space
+   float view[16];
+
+   float tanHalfFovX;
+   float tanHalfFovY;
+
+   // Half resolution pixels a unit covers at view depth 1
+   float projScale;
+   float radius;
+
+   float intensity;
+   float bias;
+
+   // 0 when last frame's occlusion is not usable
+   float historyWeight;
+   float depthTolerance;
+
+   unsigned int width;
+   unsigned int height;
+   unsigned int halfWidth;
+   unsigned int halfHeight;
+
+   unsigned int numSamples;
+   unsigned int frameIndex;
+   unsigned int padding[2];
+};
+
+// View space normal and depth of every pixel of the main view, what
+// NormalDepthPS.hlsl writes. RGBA per pixel, w is 0 where nothing was drawn.
+struct NormalDepthBuffer
+{
+   unsigned int width;
+   unsigned int height;
+   float tanHalfFovX;
+   float tanHalfFovY;
+   std::vector<float> texels;
+};
+
+void GetDefaultSsaoSettings(SsaoSettings *pSettings);
+
+// reprojection may be NULL when there is no usable history
+void SetupSsaoConstants(const SsaoSettings &settings, unsigned int width, unsigned int height, float tanHalfFovX,
+   float tanHalfFovY, const float reprojection[16], unsigned int frameIndex, SsaoConstants *pConstants);
+
+// Rotation of the sample spiral in turns, interleaved gradient noise over
+// the pixels shifted by the golden ratio every frame. Same as SsaoCS.hlsl.
+float SsaoRotation(unsigned int x, unsigned int y, unsigned int frameIndex);
+
+// View space position of a full resolution pixel's center at view depth z
+void GetViewPosition(const SsaoConstants &constants, unsigned int x, unsigned int y, float z, float position[3]);
+
+// SsaoCS.hlsl, the occlusion of every half resolution pixel. Half
+// resolution pixel (x, y) is full resolution pixel (2x, 2y), its samples
+// are taken from the half resolution grid as well. 1 is unoccluded.
+void ComputeSsaoReference(const NormalDepthBuffer &buffer, const SsaoConstants &constants, std::vector<float> *pAo);
+
+// SsaoTemporalCS.hlsl. Blends the frame's occlusion with last frame's where
+// the pixel reprojects onto the same surface. The history has two floats
+// per half resolution pixel, the occlusion and its view depth, as does the
+// result. An empty history is treated as unusable.
+void AccumulateSsao(const NormalDepthBuffer &buffer, const std::vector<float> &ao, const std::vector<float> &history,
+   const SsaoConstants &constants, std::vector<float> *pResolved);
+
+// SsaoUpsampleCS.hlsl. The four nearest half resolution pixels are weighted
+// bilinearly and by how close their depth is to the pixel's, so occlusion
+// does not bleed across silhouettes. Falls back to the closest depth when
+// no neighbour is on the same surface.
+void UpsampleSsao(const NormalDepthBuffer &buffer, const std::vector<float> &resolved, const SsaoConstants &constants,
+   std::vector<float> *pAo);
+
+// Same as UpsampleSsao with bilinear weights only, for comparison
+void UpsampleSsaoBilinear(const NormalDepthBuffer &buffer, const std::vector<float> &resolved,
+   const SsaoConstants &constants, std::vector<float> *pAo);
+
+// Floor running into a back wall with a box standing on it and a gap under
+// the sky at the top, seen through a camera at the given distance from the
+// back wall
+void CreateSyntheticNormalDepth(unsigned int width, unsigned int height, float cameraDistance, NormalDepthBuffer *pBuffer);
+
+// Raw dump of the buffer, a small header followed by the texels
+bool SaveNormalDepthBuffer(const char *pPath, const NormalDepthBuffer &buffer);
+bool LoadNormalDepthBuffer(const char *pPath, NormalDepthBuffer *pBuffer);
@@ -0,0 +1,82 @@
+#include "ShaderDefines.h"
+
+// View space normal in xyz and view depth in w, w is 0 where nothing was
+// drawn
+Texture2D<float4> m_SceneNormals : register(t0);
+
+RWTexture2D<float> m_Occlusion : register(u0);
+
+// Must match SsaoConstants in Ssao.h
+cbuffer SsaoConstants : register(b0)
+{
+   float4x4 ssaoReprojection;
+   float4x4 ssaoView;
+   float2 tanHalfFov;
+   float projScale;
+   float radius;
+   float intensity;
+   float bias;
+   float historyWeight;
+   float depthTolerance;
+   uint2 fullSize;
+   uint2 halfSize;
+   uint numSamples;
+   uint frameIndex;
+};
+
+#define TWO_PI 6.28318531
+
+float3 viewPosition( uint2 pixel, float z )
+{
+   float2 ndc = (float2(pixel) + 0.5) / float2(fullSize) * float2(2.0, -2.0) + float2(-1.0, 1.0);
+   return float3(ndc * tanHalfFov * z, z);
+}
+
+// Same as SsaoRotation in Ssao.cpp
+float rotation( uint2 pixel )
+{
+   float noise = frac(52.9829189 * frac(0.06711056 * pixel.x + 0.00583715 * pixel.y));
+   return frac(noise + 0.618034 * (frameIndex % 1024));
+}
+
+// Occlusion of every half resolution pixel from samples on a spiral around
+// it, scaled to the radius' size on screen. Half resolution pixel (x, y)
+// is full resolution pixel (2x, 2y). ComputeSsaoReference in Ssao.cpp does
+// the same on the CPU.
+[numthreads(SSAO_THREAD_GROUP_SIZE, SSAO_THREAD_GROUP_SIZE, 1)]
+void main( uint3 DTid : SV_DispatchThreadID )
+{
+   if (DTid.x >= halfSize.x || DTid.y >= halfSize.y) return;
+
+   float4 center = m_SceneNormals[DTid.xy * 2];
+   if (center.w == 0.0 || intensity <= 0.0)
+   {
+      m_Occlusion[DTid.xy] = 1.0;
+      return;
+   }
+
+   float3 p = viewPosition(DTid.xy * 2, center.w);
+   float screenRadius = projScale * radius / center.w;
+   float angleOffset = rotation(DTid.xy) * TWO_PI;
+
+   float sum = 0.0;
+   for (uint i = 0; i < numSamples; i++)
+   {
+      float alpha = (i + 0.5) / numSamples;
+      float angle = alpha * (SSAO_SPIRAL_TURNS * TWO_PI) + angleOffset;
+      int2 tap = int2(floor(float2(DTid.xy) + 0.5 + float2(cos(angle), sin(angle)) * alpha * screenRadius));
+      if (any(tap < 0) || any(tap >= int2(halfSize))) continue;
+
+      float4 texel = m_SceneNormals[tap * 2];
+      if (texel.w == 0.0) continue;
+
+      // In radii, so the result does not depend on the scale of the scene
+      float3 v = viewPosition(uint2(tap * 2), texel.w) - p;
+      float vv = dot(v, v) / (radius * radius);
+      float vn = dot(v, center.xyz) / radius;
+      float f = 1.0 - vv;
+      if (f > 0.0) sum += f * f * f * max((vn - bias) / (vv + 0.01), 0.0);
+   }
+
+   m_Occlusion[DTid.xy] = max(1.0 - sum * intensity / numSamples, 0.0);
+}
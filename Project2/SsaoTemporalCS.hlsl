@@ -0,0 +1,65 @@
+#include "ShaderDefines.h"
+
+Texture2D<float> m_Occlusion : register(t0);
+Texture2D<float4> m_SceneNormals : register(t1);
+
+// Last frame's result, occlusion in x and view depth in y
+Texture2D<float4> m_History : register(t2);
+
+RWTexture2D<float4> m_Resolved : register(u0);
+
+// Must match SsaoConstants in Ssao.h
+cbuffer SsaoConstants : register(b0)
+{
+   float4x4 ssaoReprojection;
+   float4x4 ssaoView;
+   float2 tanHalfFov;
+   float projScale;
+   float radius;
+   float intensity;
+   float bias;
+   float historyWeight;
+   float depthTolerance;
+   uint2 fullSize;
+   uint2 halfSize;
+   uint numSamples;
+   uint frameIndex;
+};
+
+// Blends the frame's occlusion with last frame's at the pixel's reprojected
+// position, unless it was off screen or its depth shows another surface
+// covered it. Same as AccumulateSsao in Ssao.cpp.
+[numthreads(SSAO_THREAD_GROUP_SIZE, SSAO_THREAD_GROUP_SIZE, 1)]
+void main( uint3 DTid : SV_DispatchThreadID )
+{
+   if (DTid.x >= halfSize.x || DTid.y >= halfSize.y) return;
+
+   float4 center = m_SceneNormals[DTid.xy * 2];
+   if (center.w == 0.0)
+   {
+      m_Resolved[DTid.xy] = float4(1.0, 0.0, 0.0, 0.0);
+      return;
+   }
+
+   float ao = m_Occlusion[DTid.xy];
+   if (historyWeight > 0.0)
+   {
+      float2 ndc = (float2(DTid.xy * 2) + 0.5) / float2(fullSize) * float2(2.0, -2.0) + float2(-1.0, 1.0);
+      float3 p = float3(ndc * tanHalfFov * center.w, center.w);
+      float4 prevClip = mul(ssaoReprojection, float4(p, 1.0));
+      if (prevClip.w > 1e-6)
+      {
+         float2 uv = prevClip.xy / prevClip.w * float2(0.5, -0.5) + 0.5;
+         if (all(uv >= 0.0) && all(uv < 1.0))
+         {
+            float4 history = m_History[min(uint2(uv * halfSize), halfSize - 1)];
+            if (history.y > 0.0 && abs(history.y - prevClip.w) <= depthTolerance * prevClip.w)
+            {
+               ao = lerp(ao, history.x, historyWeight);
+            }
+         }
+      }
+   }
+
+   m_Resolved[DTid.xy] = float4(ao, center.w, 0.0, 0.0);
+}
@@ -0,0 +1,66 @@
+#include "ShaderDefines.h"
+
+// Half resolution occlusion in x and its view depth in y
+Texture2D<float4> m_Resolved : register(t0);
+Texture2D<float4> m_SceneNormals : register(t1);
+
+RWTexture2D<float> m_AmbientOcclusion : register(u0);
+
+// Must match SsaoConstants in Ssao.h
+cbuffer SsaoConstants : register(b0)
+{
+   float4x4 ssaoReprojection;
+   float4x4 ssaoView;
+   float2 tanHalfFov;
+   float projScale;
+   float radius;
+   float intensity;
+   float bias;
+   float historyWeight;
+   float depthTolerance;
+   uint2 fullSize;
+   uint2 halfSize;
+   uint numSamples;
+   uint frameIndex;
+};
+
+// Bilinear upsample of the four nearest half resolution pixels, weighted
+// down by how far their depth is from the pixel's so occlusion stays on its
+// side of silhouettes. Same as UpsampleSsao in Ssao.cpp.
+[numthreads(SSAO_THREAD_GROUP_SIZE, SSAO_THREAD_GROUP_SIZE, 1)]
+void main( uint3 DTid : SV_DispatchThreadID )
+{
+   if (DTid.x >= fullSize.x || DTid.y >= fullSize.y) return;
+
+   float z = m_SceneNormals[DTid.xy].w;
+   if (z == 0.0)
+   {
+      m_AmbientOcclusion[DTid.xy] = 1.0;
+      return;
+   }
+
+   uint2 base = DTid.xy / 2;
+   uint2 next = min(base + 1, halfSize - 1);
+   float2 t = (DTid.xy & 1) * 0.5;
+
+   uint2 taps[4] = { base, uint2(next.x, base.y), uint2(base.x, next.y), next };
+   float bilinear[4] = { (1.0 - t.x) * (1.0 - t.y), t.x * (1.0 - t.y), (1.0 - t.x) * t.y, t.x * t.y };
+
+   float sum = 0.0, totalWeight = 0.0;
+   float closestAo = 1.0, closestDistance = 1e30;
+   for (uint i = 0; i < 4; i++)
+   {
+      float2 tap = m_Resolved[taps[i]].xy;
+      float distance = abs(tap.y - z);
+      float weight = bilinear[i] * max(1.0 - distance / (depthTolerance * z), 0.0);
+      if (distance < closestDistance)
+      {
+         closestDistance = distance;
+         closestAo = tap.x;
+      }
+      sum += tap.x * weight;
+      totalWeight += weight;
+   }
+
+   m_AmbientOcclusion[DTid.xy] = totalWeight > 1e-4 ? sum / totalWeight : closestAo;
+}
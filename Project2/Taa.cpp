@@ -0,0 +1,215 @@
+#include "Taa.h"
+
+#include <cstring>
+
+using std::vector;
+
+namespace
+{
+   const float *GetPixel(const vector<float> &image, unsigned int width, unsigned int x, unsigned int y)
+   {
+      return &image[(y * width + x) * 4];
+   }
+
+   // Samples the RGBA image between its pixel centers, the taps are clamped
+   // to the edges like the resolve's
+   void SampleBilinear(const vector<float> &image, unsigned int width, unsigned int height, float u, float v,
+      float color[4])
+   {
+      float px = u * width - 0.5f, py = v * height - 0.5f;
+      int x0 = (int)px, y0 = (int)py;
+      if (px < 0.0f) x0 = -1;
+      if (py < 0.0f) y0 = -1;
+      float fx = px - x0, fy = py - y0;
+
+      int xs[2] = { x0, x0 + 1 }, ys[2] = { y0, y0 + 1 };
+      for (unsigned int i = 0; i < 2; i++)
+      {
+         if (xs[i] < 0) xs[i] = 0;
+         if (xs[i] > (int)width - 1) xs[i] = (int)width - 1;
+         if (ys[i] < 0) ys[i] = 0;
+         if (ys[i] > (int)height - 1) ys[i] = (int)height - 1;
+      }
+
+      const float *p00 = GetPixel(image, width, xs[0], ys[0]);
+      const float *p10 = GetPixel(image, width, xs[1], ys[0]);
+      const float *p01 = GetPixel(image, width, xs[0], ys[1]);
+      const float *p11 = GetPixel(image, width, xs[1], ys[1]);
+      for (unsigned int c = 0; c < 4; c++)
+      {
+         float top = p00[c] + (p10[c] - p00[c]) * fx;
+         float bottom = p01[c] + (p11[c] - p01[c]) * fx;
+         color[c] = top + (bottom - top) * fy;
+      }
+   }
+}
+
+void GetDefaultTaaSettings(TaaSettings *pSettings)
+{
+   pSettings->numSamples = 8;
+   pSettings->feedback = 0.9f;
+   pSettings->sharpness = 0.2f;
+}
+
+float Halton(unsigned int index, unsigned int base)
+{
+   float result = 0.0f;
+   float fraction = 1.0f / base;
+   for (; index > 0; index /= base)
+   {
+      result += (index % base) * fraction;
+      fraction /= base;
+   }
+   return result;
+}
+
+void GetTaaJitter(const TaaSettings &settings, unsigned int frame, unsigned int width, unsigned int height,
+   float jitter[2])
+{
+   // The sequence starts at 1, its point 0 sits on the pixel's corner
+   unsigned int numSamples = settings.numSamples > 0 ? settings.numSamples : 1;
+   unsigned int index = frame % numSamples + 1;
+   float pixelX = Halton(index, 2) - 0.5f;
+   float pixelY = Halton(index, 3) - 0.5f;
+
+   // Pixel rows go down, NDC y goes up
+   jitter[0] = 2.0f * pixelX / width;
+   jitter[1] = -2.0f * pixelY / height;
+}
+
+void JitterProjection(const float projection[16], const float jitter[2], float jittered[16])
+{
+   // Clip x and y gain the jitter times w, which the third row carries over
+   // from view z
+   memcpy(jittered, projection, 16 * sizeof(float));
+   jittered[8] += jitter[0] * projection[11];
+   jittered[9] += jitter[1] * projection[11];
+}
+
+void SetupTaaConstants(const TaaSettings &settings, unsigned int width, unsigned int height, float tanHalfFovX,
+   float tanHalfFovY, float farZ, const float jitter[2], const float reprojection[16], TaaConstants *pConstants)
+{
+   memset(pConstants, 0, sizeof(*pConstants));
+   if (reprojection)
+   {
+      memcpy(pConstants->reprojection, reprojection, sizeof(pConstants->reprojection));
+   }
+   else
+   {
+      for (unsigned int i = 0; i < 4; i++) pConstants->reprojection[i * 5] = 1.0f;
+   }
+
+   pConstants->tanHalfFovX = tanHalfFovX;
+   pConstants->tanHalfFovY = tanHalfFovY;
+   pConstants->farZ = farZ;
+   pConstants->feedback = reprojection ? settings.feedback : 0.0f;
+   pConstants->jitterX = jitter[0];
+   pConstants->jitterY = jitter[1];
+   pConstants->sharpness = settings.sharpness;
+   pConstants->width = width;
+   pConstants->height = height;
+}
+
+void ComputeTaaMotion(const TaaConstants &constants, unsigned int x, unsigned int y, float viewDepth,
+   float motion[2])
+{
+   float z = viewDepth > 0.0f ? viewDepth : constants.farZ;
+   float ndcX = (x + 0.5f) / constants.width * 2.0f - 1.0f - constants.jitterX;
+   float ndcY = 1.0f - (y + 0.5f) / constants.height * 2.0f - constants.jitterY;
+   float p[3] = { ndcX * constants.tanHalfFovX * z, ndcY * constants.tanHalfFovY * z, z };
+
+   const float *m = constants.reprojection;
+   float clip[4];
+   for (unsigned int i = 0; i < 4; i++)
+   {
+      clip[i] = p[0] * m[i] + p[1] * m[4 + i] + p[2] * m[8 + i] + m[12 + i];
+   }
+
+   // Behind last frame's camera, the motion puts the history off screen
+   if (clip[3] <= 1e-6f)
+   {
+      motion[0] = motion[1] = 2.0f;
+      return;
+   }
+
+   motion[0] = (ndcX - clip[0] / clip[3]) * 0.5f;
+   motion[1] = (clip[1] / clip[3] - ndcY) * 0.5f;
+}
+
+void ResolveTaa(const TaaConstants &constants, const vector<float> &color, const vector<float> &motion,
+   const vector<float> &history, vector<float> *pResolved)
+{
+   unsigned int width = constants.width, height = constants.height;
+   pResolved->assign(color.begin(), color.end());
+   if (history.empty() || constants.feedback <= 0.0f) return;
+
+   for (unsigned int y = 0; y < height; y++)
+   {
+      for (unsigned int x = 0; x < width; x++)
+      {
+         unsigned int index = y * width + x;
+         float u = (x + 0.5f) / width - motion[index * 2];
+         float v = (y + 0.5f) / height - motion[index * 2 + 1];
+         if (u < 0.0f || u >= 1.0f || v < 0.0f || v >= 1.0f) continue;
+
+         // The history is clamped to the box of the colors around the
+         // pixel, what is outside belongs to a surface no longer there
+         float lo[4], hi[4];
+         memcpy(lo, GetPixel(color, width, x, y), sizeof(lo));
+         memcpy(hi, lo, sizeof(hi));
+         for (int dy = -1; dy <= 1; dy++)
+         {
+            for (int dx = -1; dx <= 1; dx++)
+            {
+               int nx = (int)x + dx, ny = (int)y + dy;
+               if (nx < 0 || ny < 0 || nx >= (int)width || ny >= (int)height) continue;
+               const float *neighbor = GetPixel(color, width, nx, ny);
+               for (unsigned int c = 0; c < 4; c++)
+               {
+                  if (neighbor[c] < lo[c]) lo[c] = neighbor[c];
+                  if (neighbor[c] > hi[c]) hi[c] = neighbor[c];
+               }
+            }
+         }
+
+         float previous[4];
+         SampleBilinear(history, width, height, u, v, previous);
+         float *resolved = &(*pResolved)[index * 4];
+         for (unsigned int c = 0; c < 4; c++)
+         {
+            float clamped = previous[c];
+            if (clamped < lo[c]) clamped = lo[c];
+            if (clamped > hi[c]) clamped = hi[c];
+            resolved[c] += (clamped - resolved[c]) * constants.feedback;
+         }
+      }
+   }
+}
+
+void SharpenTaa(const TaaConstants &constants, const vector<float> &resolved, vector<float> *pSharpened)
+{
+   unsigned int width = constants.width, height = constants.height;
+   pSharpened->resize(resolved.size());
+   for (unsigned int y = 0; y < height; y++)
+   {
+      for (unsigned int x = 0; x < width; x++)
+      {
+         unsigned int left = x > 0 ? x - 1 : x, right = x + 1 < width ? x + 1 : x;
+         unsigned int up = y > 0 ? y - 1 : y, down = y + 1 < height ? y + 1 : y;
+         const float *center = GetPixel(resolved, width, x, y);
+         const float *neighbors[4] = { GetPixel(resolved, width, left, y), GetPixel(resolved, width, right, y),
+            GetPixel(resolved, width, x, up), GetPixel(resolved, width, x, down) };
+
+         float *sharpened = &(*pSharpened)[(y * width + x) * 4];
+         for (unsigned int c = 0; c < 3; c++)
+         {
+            float value = center[c] * (1.0f + 4.0f * constants.sharpness);
+            for (unsigned int i = 0; i < 4; i++) value -= neighbors[i][c] * constants.sharpness;
+            if (value < 0.0f) value = 0.0f;
+            if (value > 1.0f) value = 1.0f;
+            sharpened[c] = value;
+         }
+         sharpened[3] = 1.0f;
+      }
+   }
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <vector>
+
+#include "ShaderDefines.h"
+
+// Runtime options of the temporal anti-aliasing
+struct TaaSettings
+{
+   // Length of the Halton (2, 3) jitter sequence before it repeats
+   unsigned int numSamples;
+
+   // Weight of the reprojected history in the blend, 0 turns the
+   // accumulation off
+   float feedback;
+
+   // Strength of the sharpen after the resolve, 0 turns it off
+   float sharpness;
+};
+
+// Constant buffer of TaaMotionCS.hlsl, TaaResolveCS.hlsl and
+// TaaSharpenPS.hlsl
+struct TaaConstants
+{
+   // Row vector matrix from this frame's view space to last frame's
+   // unjittered clip space, stored row major
+   float reprojection[16];
+
+   float tanHalfFovX;
+   float tanHalfFovY;
+
+   // View depth pixels without geometry are reprojected at
+   float farZ;
+
+   // 0 when the history is not usable
+   float feedback;
+
+   // This frame's projection offset in NDC units
+   float jitterX;
+   float jitterY;
+   float sharpness;
+   unsigned int width;
+
+   unsigned int height;
+   unsigned int padding[3];
+};
+
+void GetDefaultTaaSettings(TaaSettings *pSettings);
+
+// Radical inverse of index in base, Halton(0, base) is 0
+float Halton(unsigned int index, unsigned int base);
+
+// Projection offset of the frame in NDC units, the frame's point of the
+// Halton (2, 3) sequence moved to be centered on the pixel, so each offset
+// stays within half a pixel
+void GetTaaJitter(const TaaSettings &settings, unsigned int frame, unsigned int width, unsigned int height,
+   float jitter[2]);
+
+// Offsets a row vector perspective projection (w is view z), stored row
+// major, so everything it projects moves by jitter in NDC
+void JitterProjection(const float projection[16], const float jitter[2], float jittered[16]);
+
+// reprojection as above, NULL when there is no history to blend with
+void SetupTaaConstants(const TaaSettings &settings, unsigned int width, unsigned int height, float tanHalfFovX,
+   float tanHalfFovY, float farZ, const float jitter[2], const float reprojection[16], TaaConstants *pConstants);
+
+// Screen UV offset from where the surface at pixel (x, y) was last frame to
+// where it is now, from the pixel's view depth (0 where nothing was drawn).
+// The jitter is taken out so a still camera has no motion. Same as
+// TaaMotionCS.hlsl.
+void ComputeTaaMotion(const TaaConstants &constants, unsigned int x, unsigned int y, float viewDepth,
+   float motion[2]);
+
+// What TaaResolveCS.hlsl does: blends each pixel of color (RGBA per pixel)
+// with the history sampled bilinearly at its uv minus its motion (two per
+// pixel), after clamping the history to the box of the pixel's 3x3
+// neighborhood. Pixels whose history is off screen keep their color.
+void ResolveTaa(const TaaConstants &constants, const std::vector<float> &color, const std::vector<float> &motion,
+   const std::vector<float> &history, std::vector<float> *pResolved);
+
+// What TaaSharpenPS.hlsl does: adds sharpness times the difference to the
+// four neighbors and saturates
+void SharpenTaa(const TaaConstants &constants, const std::vector<float> &resolved, std::vector<float> *pSharpened);
@@ -0,0 +1,41 @@
+#include "ShaderDefines.h"
+
+Texture2D<float4> m_SceneNormals : register(t0);
+
+RWTexture2D<float2> m_Motion : register(u0);
+
+// Must match TaaConstants in Taa.h
+cbuffer TaaConstants : register(b0)
+{
+   float4x4 taaReprojection;
+   float2 tanHalfFov;
+   float farZ;
+   float feedback;
+   float2 jitter;
+   float sharpness;
+   uint width;
+   uint height;
+};
+
+// Screen UV offset of each pixel's surface since last frame, from the view
+// depth of the normal pass. Only the camera moves, so reprojecting the
+// depth is all the motion there is. Same as ComputeTaaMotion in Taa.cpp.
+[numthreads(TAA_THREAD_GROUP_SIZE, TAA_THREAD_GROUP_SIZE, 1)]
+void main( uint3 DTid : SV_DispatchThreadID )
+{
+   uint2 size = uint2(width, height);
+   if (DTid.x >= size.x || DTid.y >= size.y) return;
+
+   float viewDepth = m_SceneNormals[DTid.xy].w;
+   float z = viewDepth > 0.0 ? viewDepth : farZ;
+   float2 ndc = (float2(DTid.xy) + 0.5) / float2(size) * float2(2.0, -2.0) + float2(-1.0, 1.0) - jitter;
+   float4 prevClip = mul(taaReprojection, float4(ndc * tanHalfFov * z, z, 1.0));
+
+   // Behind last frame's camera, the motion puts the history off screen
+   float2 motion = float2(2.0, 2.0);
+   if (prevClip.w > 1e-6)
+   {
+      motion = (ndc - prevClip.xy / prevClip.w) * float2(0.5, -0.5);
+   }
+   m_Motion[DTid.xy] = motion;
+}
@@ -0,0 +1,74 @@
+#include "ShaderDefines.h"
+
+Texture2D<float4> m_Color : register(t0);
+Texture2D<float2> m_Motion : register(t1);
+
+// Last frame's resolved color
+Texture2D<float4> m_History : register(t2);
+
+RWTexture2D<float4> m_Resolved : register(u0);
+
+// Must match TaaConstants in Taa.h
+cbuffer TaaConstants : register(b0)
+{
+   float4x4 taaReprojection;
+   float2 tanHalfFov;
+   float farZ;
+   float feedback;
+   float2 jitter;
+   float sharpness;
+   uint width;
+   uint height;
+};
+
+// Samples the history between its pixel centers, the taps are clamped to
+// the edges
+float4 sampleHistory( float2 uv )
+{
+   float2 size = float2(width, height);
+   float2 p = uv * size - 0.5;
+   float2 p0 = floor(p);
+   float2 f = p - p0;
+   int2 maxPixel = int2(size) - 1;
+   int2 t0 = clamp(int2(p0), int2(0, 0), maxPixel);
+   int2 t1 = clamp(int2(p0) + 1, int2(0, 0), maxPixel);
+
+   float4 top = lerp(m_History[int2(t0.x, t0.y)], m_History[int2(t1.x, t0.y)], f.x);
+   float4 bottom = lerp(m_History[int2(t0.x, t1.y)], m_History[int2(t1.x, t1.y)], f.x);
+   return lerp(top, bottom, f.y);
+}
+
+// Blends the jittered color with the history at the pixel's position last
+// frame, clamped to the box of the pixel's 3x3 neighborhood so what the
+// history shows of surfaces no longer there is rejected. Same as ResolveTaa
+// in Taa.cpp.
+[numthreads(TAA_THREAD_GROUP_SIZE, TAA_THREAD_GROUP_SIZE, 1)]
+void main( uint3 DTid : SV_DispatchThreadID )
+{
+   uint2 size = uint2(width, height);
+   if (DTid.x >= size.x || DTid.y >= size.y) return;
+
+   float4 color = m_Color[DTid.xy];
+   float4 resolved = color;
+   if (feedback > 0.0)
+   {
+      float2 uv = (float2(DTid.xy) + 0.5) / float2(size) - m_Motion[DTid.xy];
+      if (all(uv >= 0.0) && all(uv < 1.0))
+      {
+         float4 lo = color;
+         float4 hi = color;
+         int2 maxPixel = int2(size) - 1;
+         for (int dy = -1; dy <= 1; dy++)
+         {
+            for (int dx = -1; dx <= 1; dx++)
+            {
+               float4 neighbor = m_Color[clamp(int2(DTid.xy) + int2(dx, dy), int2(0, 0), maxPixel)];
+               lo = min(lo, neighbor);
+               hi = max(hi, neighbor);
+            }
+         }
+         resolved = lerp(color, clamp(sampleHistory(uv), lo, hi), feedback);
+      }
+   }
+   m_Resolved[DTid.xy] = resolved;
+}
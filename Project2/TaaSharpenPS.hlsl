@@ -0,0 +1,31 @@
+// Sharpens the resolved color into the back buffer, drawn with
+// PlaneVertexShader.hlsl's full screen triangle. The history stays
+// unsharpened so the sharpening does not build up. Same as SharpenTaa in
+// Taa.cpp.
+
+Texture2D<float4> m_Resolved : register(t0);
+
+// Must match TaaConstants in Taa.h
+cbuffer TaaConstants : register(b0)
+{
+   float4x4 taaReprojection;
+   float2 tanHalfFov;
+   float farZ;
+   float feedback;
+   float2 jitter;
+   float sharpness;
+   uint width;
+   uint height;
+};
+
+float4 main( float4 pos : SV_POSITION ) : SV_TARGET
+{
+   int2 pixel = int2(pos.xy);
+   int2 maxPixel = int2(width, height) - 1;
+   float3 center = m_Resolved[pixel].rgb;
+   float3 neighbors = m_Resolved[max(pixel - int2(1, 0), int2(0, 0))].rgb +
+      m_Resolved[min(pixel + int2(1, 0), maxPixel)].rgb +
+      m_Resolved[max(pixel - int2(0, 1), int2(0, 0))].rgb +
+      m_Resolved[min(pixel + int2(0, 1), maxPixel)].rgb;
+   return float4(saturate(center * (1.0 + 4.0 * sharpness) - neighbors * sharpness), 1.0);
+}
@@ -0,0 +1,264 @@
+#pragma once
+
+#include <d3d11.h>
+#include <d3dx11.h>
+#include <DxErr.h>
+#include <cassert>
+#include <vector>
+
+#include "D3D11CommandBackend.h"
+#include "RenderGraph.h"
+
+// Creates the physical textures of a compiled render graph and hands their
+// views back to the graph. Tiled textures are mapped onto the graph's tile
+// pool, where transients that do not live at the same time share memory.
+class TransientTextures
+{
+public:
+   TransientTextures() : m_pTilePool(NULL) {}
+
+   ~TransientTextures()
+   {
+      Release();
+   }
+
+   // Whether the graph can be compiled with SetTiledTransients for the device
+   static bool SupportsTiledResources(ID3D11Device *pDevice)
+   {
+#ifdef BACKEND_TILED_RESOURCES
+      D3D11_FEATURE_DATA_D3D11_OPTIONS1 options;
+      memset(&options, 0, sizeof(options));
+      if (FAILED(pDevice->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS1, &options, sizeof(options)))) return false;
+      return options.TiledResourcesTier != D3D11_TILED_RESOURCES_NOT_SUPPORTED;
+#else
+      return false;
+#endif
+   }
+
+   HRESULT Allocate(ID3D11Device *pDevice, D3D11CommandBackend *pBackend, RenderGraph *pGraph)
+   {
+      Release();
+
+      HRESULT result = S_OK;
+      unsigned long long tilePoolBytes = pGraph->GetMemoryStats().tilePoolBytes;
+      if (tilePoolBytes > 0)
+      {
+#ifdef BACKEND_TILED_RESOURCES
+         D3D11_BUFFER_DESC poolDesc;
+         memset(&poolDesc, 0, sizeof(poolDesc));
+         poolDesc.ByteWidth = (UINT)tilePoolBytes;
+         poolDesc.Usage = D3D11_USAGE_DEFAULT;
+         poolDesc.MiscFlags = D3D11_RESOURCE_MISC_TILE_POOL;
+         result = pDevice->CreateBuffer(&poolDesc, NULL, &m_pTilePool);
+         if (FAILED(result)) return result;
+#else
+         return E_NOTIMPL;
+#endif
+      }
+
+      for (UINT i = 0; i < pGraph->GetNumPhysicalTextures(); i++)
+      {
+         const RenderGraphTextureDesc &desc = pGraph->GetPhysicalTextureDesc(i);
+         UINT bindFlags = pGraph->GetPhysicalTextureBindFlags(i);
+         UINT firstTile, numTiles;
+         pGraph->GetPhysicalTextureTiles(i, &firstTile, &numTiles);
+
+         // Depth is created typeless so it can be sampled as well
+         DXGI_FORMAT format = GetFormat(desc.format);
+         DXGI_FORMAT textureFormat = desc.format == GRAPH_FORMAT_DEPTH32 ? DXGI_FORMAT_R32_TYPELESS : format;
+
+         UINT d3dBindFlags = 0;
+         if (bindFlags & GRAPH_BIND_SRV) d3dBindFlags |= D3D11_BIND_SHADER_RESOURCE;
+         if (bindFlags & GRAPH_BIND_RTV) d3dBindFlags |= D3D11_BIND_RENDER_TARGET;
+         if (bindFlags & GRAPH_BIND_DSV) d3dBindFlags |= D3D11_BIND_DEPTH_STENCIL;
+         if (bindFlags & GRAPH_BIND_UAV) d3dBindFlags |= D3D11_BIND_UNORDERED_ACCESS;
+
+         ID3D11Resource *pTexture = NULL;
+         if (desc.depth > 1)
+         {
+            D3D11_TEXTURE3D_DESC texDesc;
+            memset(&texDesc, 0, sizeof(texDesc));
+            texDesc.Width = desc.width;
+            texDesc.Height = desc.height;
+            texDesc.Depth = desc.depth;
+            texDesc.MipLevels = 1;
+            texDesc.Format = textureFormat;
+            texDesc.Usage = D3D11_USAGE_DEFAULT;
+            texDesc.BindFlags = d3dBindFlags;
+            result = pDevice->CreateTexture3D(&texDesc, NULL, (ID3D11Texture3D **)&pTexture);
+         }
+         else
+         {
+            D3D11_TEXTURE2D_DESC texDesc;
+            memset(&texDesc, 0, sizeof(texDesc));
+            texDesc.Width = desc.width;
+            texDesc.Height = desc.height;
+            texDesc.MipLevels = 1;
+            texDesc.ArraySize = 1;
+            texDesc.Format = textureFormat;
+            texDesc.SampleDesc.Count = 1;
+            texDesc.Usage = D3D11_USAGE_DEFAULT;
+            texDesc.BindFlags = d3dBindFlags;
+#ifdef BACKEND_TILED_RESOURCES
+            if (numTiles > 0) texDesc.MiscFlags = D3D11_RESOURCE_MISC_TILED;
+#endif
+            result = pDevice->CreateTexture2D(&texDesc, NULL, (ID3D11Texture2D **)&pTexture);
+         }
+         if (FAILED(result)) return result;
+         m_textures.push_back(pTexture);
+         m_textureHandles.push_back(pBackend->Register(pTexture));
+
+#ifdef BACKEND_TILED_RESOURCES
+         if (numTiles > 0)
+         {
+            result = MapTiles(pDevice, pTexture, firstTile, numTiles);
+            if (FAILED(result)) return result;
+         }
+#endif
+
+         RenderGraphViews views = { NULL_HANDLE, NULL_HANDLE, NULL_HANDLE, NULL_HANDLE };
+         bool volume = desc.depth > 1;
+         DXGI_FORMAT viewFormat = desc.format == GRAPH_FORMAT_DEPTH32 ? DXGI_FORMAT_R32_FLOAT : format;
+
+         if (bindFlags & GRAPH_BIND_SRV)
+         {
+            D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
+            memset(&srvDesc, 0, sizeof(srvDesc));
+            srvDesc.Format = viewFormat;
+            srvDesc.ViewDimension = volume ? D3D11_SRV_DIMENSION_TEXTURE3D : D3D11_SRV_DIMENSION_TEXTURE2D;
+            if (volume) srvDesc.Texture3D.MipLevels = 1;
+            else srvDesc.Texture2D.MipLevels = 1;
+
+            ID3D11ShaderResourceView *pSrv = NULL;
+            result = pDevice->CreateShaderResourceView(pTexture, &srvDesc, &pSrv);
+            if (FAILED(result)) return result;
+            views.srv = AddView(pBackend, pSrv);
+         }
+
+         if (bindFlags & GRAPH_BIND_RTV)
+         {
+            D3D11_RENDER_TARGET_VIEW_DESC rtvDesc;
+            memset(&rtvDesc, 0, sizeof(rtvDesc));
+            rtvDesc.Format = viewFormat;
+            rtvDesc.ViewDimension = volume ? D3D11_RTV_DIMENSION_TEXTURE3D : D3D11_RTV_DIMENSION_TEXTURE2D;
+            if (volume) rtvDesc.Texture3D.WSize = -1;
+
+            ID3D11RenderTargetView *pRtv = NULL;
+            result = pDevice->CreateRenderTargetView(pTexture, &rtvDesc, &pRtv);
+            if (FAILED(result)) return result;
+            views.rtv = AddView(pBackend, pRtv);
+         }
+
+         if (bindFlags & GRAPH_BIND_DSV)
+         {
+            assert(desc.format == GRAPH_FORMAT_DEPTH32 && !volume);
+
+            D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc;
+            memset(&dsvDesc, 0, sizeof(dsvDesc));
+            dsvDesc.Format = DXGI_FORMAT_D32_FLOAT;
+            dsvDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
+
+            ID3D11DepthStencilView *pDsv = NULL;
+            result = pDevice->CreateDepthStencilView(pTexture, &dsvDesc, &pDsv);
+            if (FAILED(result)) return result;
+            views.dsv = AddView(pBackend, pDsv);
+         }
+
+         if (bindFlags & GRAPH_BIND_UAV)
+         {
+            D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc;
+            memset(&uavDesc, 0, sizeof(uavDesc));
+            uavDesc.Format = viewFormat;
+            uavDesc.ViewDimension = volume ? D3D11_UAV_DIMENSION_TEXTURE3D : D3D11_UAV_DIMENSION_TEXTURE2D;
+            if (volume) uavDesc.Texture3D.WSize = -1;
+
+            ID3D11UnorderedAccessView *pUav = NULL;
+            result = pDevice->CreateUnorderedAccessView(pTexture, &uavDesc, &pUav);
+            if (FAILED(result)) return result;
+            views.uav = AddView(pBackend, pUav);
+         }
+
+         pGraph->SetPhysicalTextureViews(i, views);
+      }
+      return S_OK;
+   }
+
+   void Release()
+   {
+      for (UINT i = 0; i < m_views.size(); i++) m_views[i]->Release();
+      for (UINT i = 0; i < m_textures.size(); i++) m_textures[i]->Release();
+      if (m_pTilePool) m_pTilePool->Release();
+      m_pTilePool = NULL;
+      m_views.clear();
+      m_textures.clear();
+      m_textureHandles.clear();
+   }
+
+   // Handle of a physical texture for copies, see RenderGraph::GetPhysicalTexture
+   ResourceHandle GetTexture(UINT physicalTexture) const
+   {
+      return m_textureHandles[physicalTexture];
+   }
+
+private:
+   static DXGI_FORMAT GetFormat(RenderGraphFormat format)
+   {
+      switch (format)
+      {
+      case GRAPH_FORMAT_RGBA32_FLOAT: return DXGI_FORMAT_R32G32B32A32_FLOAT;
+      case GRAPH_FORMAT_RGBA8_UNORM: return DXGI_FORMAT_R8G8B8A8_UNORM;
+      case GRAPH_FORMAT_R32_FLOAT: return DXGI_FORMAT_R32_FLOAT;
+      case GRAPH_FORMAT_R32_UINT: return DXGI_FORMAT_R32_UINT;
+      case GRAPH_FORMAT_DEPTH32: return DXGI_FORMAT_R32_FLOAT;
+      case GRAPH_FORMAT_RGBA16_FLOAT: return DXGI_FORMAT_R16G16B16A16_FLOAT;
+      case GRAPH_FORMAT_R8_UNORM: return DXGI_FORMAT_R8_UNORM;
+      case GRAPH_FORMAT_RG16_FLOAT: return DXGI_FORMAT_R16G16_FLOAT;
+      default: assert(false); return DXGI_FORMAT_UNKNOWN;
+      }
+   }
+
+   ResourceHandle AddView(D3D11CommandBackend *pBackend, ID3D11View *pView)
+   {
+      m_views.push_back(pView);
+      return pBackend->Register(pView);
+   }
+
+#ifdef BACKEND_TILED_RESOURCES
+   // Maps the whole texture onto the tiles of the pool from firstTile
+   HRESULT MapTiles(ID3D11Device *pDevice, ID3D11Resource *pTexture, UINT firstTile, UINT numTiles)
+   {
+      ID3D11Device2 *pDevice2 = NULL;
+      HRESULT result = pDevice->QueryInterface(__uuidof(ID3D11Device2), (void **)&pDevice2);
+      if (FAILED(result)) return result;
+
+      // The graph counted the tiles with the standard tile shapes
+      UINT numTextureTiles = 0;
+      pDevice2->GetResourceTiling(pTexture, &numTextureTiles, NULL, NULL, NULL, 0, NULL);
+      pDevice2->Release();
+      if (numTextureTiles > numTiles) return E_FAIL;
+
+      ID3D11DeviceContext *pContext = NULL;
+      pDevice->GetImmediateContext(&pContext);
+      ID3D11DeviceContext2 *pContext2 = NULL;
+      result = pContext->QueryInterface(__uuidof(ID3D11DeviceContext2), (void **)&pContext2);
+      pContext->Release();
+      if (FAILED(result)) return result;
+
+      D3D11_TILED_RESOURCE_COORDINATE coordinate;
+      memset(&coordinate, 0, sizeof(coordinate));
+      D3D11_TILE_REGION_SIZE region;
+      memset(&region, 0, sizeof(region));
+      region.NumTiles = numTextureTiles;
+      UINT rangeFlags = 0;
+      result = pContext2->UpdateTileMappings(pTexture, 1, &coordinate, &region, m_pTilePool, 1, &rangeFlags,
+         &firstTile, &numTextureTiles, 0);
+      pContext2->Release();
+      return result;
+   }
+#endif
+
+   ID3D11Buffer *m_pTilePool;
+   std::vector<ID3D11Resource *> m_textures;
+   std::vector<ResourceHandle> m_textureHandles;
+   std::vector<ID3D11View *> m_views;
+};
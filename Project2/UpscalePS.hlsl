@@ -0,0 +1,28 @@
+// Stretches the frame drawn at the dynamic resolution scale over the back
+// buffer, drawn with PlaneVertexShader.hlsl's full screen triangle. The
+// frame sits in the top left of a full size target, the taps are clamped to
+// its drawn part.
+
+Texture2D<float4> m_frame : register(t0);
+
+// Must match UpscaleConstants in DynamicResolution.h
+cbuffer UpscaleConstants : register(b0)
+{
+   float2 scale;
+   uint renderWidth;
+   uint renderHeight;
+};
+
+float4 main( float4 pos : SV_POSITION ) : SV_TARGET
+{
+   float2 p = pos.xy * scale - 0.5;
+   float2 p0 = floor(p);
+   float2 f = p - p0;
+   int2 maxPixel = int2(renderWidth, renderHeight) - 1;
+   int2 t0 = clamp(int2(p0), int2(0, 0), maxPixel);
+   int2 t1 = clamp(int2(p0) + 1, int2(0, 0), maxPixel);
+
+   float4 top = lerp(m_frame[int2(t0.x, t0.y)], m_frame[int2(t1.x, t0.y)], f.x);
+   float4 bottom = lerp(m_frame[int2(t0.x, t1.y)], m_frame[int2(t1.x, t1.y)], f.x);
+   return float4(lerp(top, bottom, f.y).rgb, 1.0);
+}
@@ -0,0 +1,42 @@
+#include "ShaderDefines.h"
+
+Texture2D m_LightMap : register(t0);
+
+// Cleared to 0 before the dispatch, must match ComputeTotalFlux in
+// VplSampling.cpp
+RWStructuredBuffer<uint> m_TotalFlux : register(u0);
+
+// Must match VplConstants in VplSampling.h, only the scale is used here
+cbuffer VplConstants : register(b0)
+{
+   uint targetVpls;
+   uint vplSeed;
+   float texelWeight;
+   float fluxScale;
+};
+
+groupshared uint groupFlux;
+
+uint QuantizeFlux(float3 rgb)
+{
+   float luminance = dot(rgb, float3(0.2126, 0.7152, 0.0722));
+   return uint(clamp(luminance, 0.0, MAX_TEXEL_LUMINANCE) * fluxScale);
+}
+
+// Each group sums its block of the light map and adds it to the total
+[numthreads(VPL_FLUX_GROUP_SIZE, VPL_FLUX_GROUP_SIZE, 1)]
+void main( uint3 DTid : SV_DispatchThreadID, uint GI : SV_GroupIndex )
+{
+   if (GI == 0) groupFlux = 0;
+   GroupMemoryBarrierWithGroupSync();
+
+   uint width, height;
+   m_LightMap.GetDimensions(width, height);
+   if (DTid.x < width && DTid.y < height)
+   {
+      InterlockedAdd(groupFlux, QuantizeFlux(m_LightMap[DTid.xy].rgb));
+   }
+   GroupMemoryBarrierWithGroupSync();
+
+   if (GI == 0) InterlockedAdd(m_TotalFlux[0], groupFlux);
+}
@@ -0,0 +1,209 @@
+#include "VplSampling.h"
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+using std::vector;
+
+namespace
+{
+   const char RSM_FILE_MAGIC[4] = { 'R', 'S', 'M', '1' };
+
+   void SetLight(const ReflectiveShadowMap &rsm, unsigned int x, unsigned int y, float weight, VirtualPointLight *pLight)
+   {
+      unsigned int texel = y * rsm.width + x;
+      pLight->position[0] = (x + 0.5f) / rsm.width;
+      pLight->position[1] = (y + 0.5f) / rsm.height;
+      pLight->position[2] = rsm.depth[texel];
+      pLight->position[3] = 1.0f;
+      for (unsigned int c = 0; c < 3; c++) pLight->color[c] = rsm.flux[texel * 4 + c] * weight;
+      pLight->color[3] = 1.0f;
+   }
+}
+
+float ComputeFluxScale(unsigned int width, unsigned int height)
+{
+   double maxTotal = (double)width * height * MAX_TEXEL_LUMINANCE;
+   double scale = floor(4294967295.0 / maxTotal);
+   if (scale > FLUX_FIXED_POINT_SCALE) scale = FLUX_FIXED_POINT_SCALE;
+   if (scale < 1.0) scale = 1.0;
+   return (float)scale;
+}
+
+float ComputeVplTexelWeight(unsigned int width, unsigned int height)
+{
+   double referenceTexels = (double)REFERENCE_RSM_WIDTH * REFERENCE_RSM_HEIGHT;
+   return (float)(referenceTexels / ((double)width * height) / VPL_REFERENCE_TEXELS);
+}
+
+void SetupVplConstants(unsigned int width, unsigned int height, unsigned int targetVpls, unsigned int seed,
+   VplConstants *pConstants)
+{
+   pConstants->targetVpls = targetVpls;
+   pConstants->seed = seed;
+   pConstants->texelWeight = ComputeVplTexelWeight(width, height);
+   pConstants->fluxScale = ComputeFluxScale(width, height);
+}
+
+unsigned int QuantizeFlux(const float rgb[3], float fluxScale)
+{
+   float luminance = 0.2126f * rgb[0] + 0.7152f * rgb[1] + 0.0722f * rgb[2];
+   if (luminance <= 0.0f) return 0;
+   if (luminance > MAX_TEXEL_LUMINANCE) luminance = MAX_TEXEL_LUMINANCE;
+   return (unsigned int)(luminance * fluxScale);
+}
+
+float VplThreshold(unsigned int x, unsigned int y, unsigned int seed)
+{
+   // Bayer matrix entry, the bits of x ^ y and y interleaved and reversed
+   unsigned int bayer = 0;
+   for (unsigned int bit = 0; bit < VPL_DITHER_BITS; bit++)
+   {
+      bayer = (bayer << 2) | ((((x ^ y) >> bit) & 1) << 1) | ((y >> bit) & 1);
+   }
+
+   // Wang hash of the seed
+   unsigned int h = seed * 26699u;
+   h = (h ^ 61u) ^ (h >> 16);
+   h *= 9u;
+   h ^= h >> 4;
+   h *= 0x27d4eb2du;
+   h ^= h >> 15;
+   float offset = (float)(h >> 8) * (1.0f / 16777216.0f);
+
+   float threshold = (bayer + 0.5f) / (1 << (2 * VPL_DITHER_BITS)) + offset;
+   return threshold >= 1.0f ? threshold - 1.0f : threshold;
+}
+
+unsigned int ComputeTotalFlux(const ReflectiveShadowMap &rsm)
+{
+   float fluxScale = ComputeFluxScale(rsm.width, rsm.height);
+   unsigned int total = 0;
+   unsigned int numTexels = rsm.width * rsm.height;
+   for (unsigned int texel = 0; texel < numTexels; texel++)
+   {
+      total += QuantizeFlux(&rsm.flux[texel * 4], fluxScale);
+   }
+   return total;
+}
+
+void SampleVplsReference(const ReflectiveShadowMap &rsm, unsigned int targetVpls, unsigned int seed,
+   vector<VirtualPointLight> *pLights)
+{
+   pLights->clear();
+   unsigned int totalFlux = ComputeTotalFlux(rsm);
+   if (totalFlux == 0) return;
+
+   float fluxScale = ComputeFluxScale(rsm.width, rsm.height);
+   float texelWeight = ComputeVplTexelWeight(rsm.width, rsm.height);
+
+   for (unsigned int y = 0; y < rsm.height; y++)
+   {
+      for (unsigned int x = 0; x < rsm.width; x++)
+      {
+         unsigned int flux = QuantizeFlux(&rsm.flux[(y * rsm.width + x) * 4], fluxScale);
+         float p = (float)targetVpls * (float)flux / (float)totalFlux;
+         if (p > 1.0f) p = 1.0f;
+         if (VplThreshold(x, y, seed) >= p) continue;
+         if (pLights->size() == MAX_VPLS) return;
+
+         VirtualPointLight light;
+         SetLight(rsm, x, y, texelWeight / p, &light);
+         pLights->push_back(light);
+      }
+   }
+}
+
+void SampleVplsUniform(const ReflectiveShadowMap &rsm, unsigned int blockSize, vector<VirtualPointLight> *pLights)
+{
+   pLights->clear();
+   float weight = (float)(blockSize * blockSize) * ComputeVplTexelWeight(rsm.width, rsm.height);
+   for (unsigned int y = 0; y < rsm.height; y += blockSize)
+   {
+      for (unsigned int x = 0; x < rsm.width; x += blockSize)
+      {
+         VirtualPointLight light;
+         SetLight(rsm, x, y, weight, &light);
+         pLights->push_back(light);
+      }
+   }
+}
+
+void CreateSyntheticReflectiveShadowMap(unsigned int width, unsigned int height, ReflectiveShadowMap *pRsm)
+{
+   pRsm->width = width;
+   pRsm->height = height;
+   pRsm->flux.resize(width * height * 4);
+   pRsm->depth.resize(width * height);
+
+   for (unsigned int y = 0; y < height; y++)
+   {
+      for (unsigned int x = 0; x < width; x++)
+      {
+         float u = (x + 0.5f) / width;
+         float v = (y + 0.5f) / height;
+         float albedo[3] = { 0.75f, 0.75f, 0.75f };
+         float depth = 0.5f + 0.4f * v;
+
+         if (u < 0.15f)
+         {
+            albedo[1] = albedo[2] = 0.1f;
+            depth = 0.4f + u;
+         }
+         else if (u > 0.85f)
+         {
+            albedo[0] = albedo[2] = 0.1f;
+            depth = 0.4f + (1.0f - u);
+         }
+         else if (u > 0.4f && u < 0.6f && v > 0.45f && v < 0.65f)
+         {
+            albedo[0] = albedo[1] = albedo[2] = 0.95f;
+            depth = 0.3f;
+         }
+
+         // Spot light cone centered slightly off the box
+         float du = u - 0.45f;
+         float dv = v - 0.5f;
+         float spot = 1.0f - sqrtf(du * du + dv * dv) / 0.35f;
+         float intensity = spot > 0.0f ? 0.05f + 3.0f * spot * spot : 0.05f;
+
+         unsigned int texel = y * width + x;
+         for (unsigned int c = 0; c < 3; c++) pRsm->flux[texel * 4 + c] = albedo[c] * intensity;
+         pRsm->flux[texel * 4 + 3] = 1.0f;
+         pRsm->depth[texel] = depth;
+      }
+   }
+}
+
+bool SaveReflectiveShadowMap(const char *pPath, const ReflectiveShadowMap &rsm)
+{
+   std::ofstream out(pPath, std::ios::binary);
+   if (!out) return false;
+
+   out.write(RSM_FILE_MAGIC, sizeof(RSM_FILE_MAGIC));
+   out.write((const char *)&rsm.width, sizeof(rsm.width));
+   out.write((const char *)&rsm.height, sizeof(rsm.height));
+   out.write((const char *)&rsm.flux[0], rsm.flux.size() * sizeof(float));
+   out.write((const char *)&rsm.depth[0], rsm.depth.size() * sizeof(float));
+   return out.good();
+}
+
+bool LoadReflectiveShadowMap(const char *pPath, ReflectiveShadowMap *pRsm)
+{
+   std::ifstream in(pPath, std::ios::binary);
+   if (!in) return false;
+
+   char magic[sizeof(RSM_FILE_MAGIC)];
+   in.read(magic, sizeof(magic));
+   in.read((char *)&pRsm->width, sizeof(pRsm->width));
+   in.read((char *)&pRsm->height, sizeof(pRsm->height));
+   if (!in || memcmp(magic, RSM_FILE_MAGIC, sizeof(magic)) != 0) return false;
+   if (pRsm->width == 0 || pRsm->height == 0 || pRsm->width > 16384 || pRsm->height > 16384) return false;
+
+   pRsm->flux.resize(pRsm->width * pRsm->height * 4);
+   pRsm->depth.resize(pRsm->width * pRsm->height);
+   in.read((char *)&pRsm->flux[0], pRsm->flux.size() * sizeof(float));
+   in.read((char *)&pRsm->depth[0], pRsm->depth.size() * sizeof(float));
+   return in.good();
+}
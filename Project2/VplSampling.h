@@ -0,0 +1,91 @@
+#pragma once
+
+#include <vector>
+
+#include "LightBinning.h"
+#include "ShaderDefines.h"
+
+// Where the renderer saves the reflective shadow map it captures, the
+// vpl_sampling benchmark picks it up from there
+#define RSM_CAPTURE_FILE "rsm_capture.bin"
+
+// Constant buffer of BlurCS.hlsl's VPL generation and VplFluxCS.hlsl's sum
+struct VplConstants
+{
+   unsigned int targetVpls;
+   unsigned int seed;
+
+   // Share of the light's flux one light map texel carries, relative to a
+   // VPL_REFERENCE_TEXELS block of the reference map
+   float texelWeight;
+
+   // Fixed point scale of the quantized flux, FLUX_FIXED_POINT_SCALE unless
+   // the map is too large for the total to fit in 32 bits
+   float fluxScale;
+};
+
+// Constant buffer the light buffer's append count is copied into, can be
+// past MAX_VPLS when VPLs were dropped
+struct VplCount
+{
+   unsigned int numVpls;
+   unsigned int padding[3];
+};
+
+// Light map and depth of the shadow pass on the CPU, the light map is RGBA
+// per texel. Read back from the GPU or made up for the benchmarks.
+struct ReflectiveShadowMap
+{
+   unsigned int width;
+   unsigned int height;
+   std::vector<float> flux;
+   std::vector<float> depth;
+};
+
+// Largest fixed point scale up to FLUX_FIXED_POINT_SCALE at which a
+// width x height map of MAX_TEXEL_LUMINANCE texels still sums to a uint
+float ComputeFluxScale(unsigned int width, unsigned int height);
+
+// A light map texel covers more of the scene on smaller maps, weighting it
+// by the texel area relative to the REFERENCE_RSM_WIDTH x
+// REFERENCE_RSM_HEIGHT map keeps the VPLs' total brightness the same at
+// every light map size
+float ComputeVplTexelWeight(unsigned int width, unsigned int height);
+
+// Constants for a width x height light map
+void SetupVplConstants(unsigned int width, unsigned int height, unsigned int targetVpls, unsigned int seed,
+   VplConstants *pConstants);
+
+// Luminance of a light map texel in fixed point, rounded the same way as the
+// shaders so the totals match
+unsigned int QuantizeFlux(const float rgb[3], float fluxScale);
+
+// Threshold a texel's VPL probability is compared against, in [0, 1).
+// An ordered dither matrix shifted by the seed, so the picked texels spread
+// out evenly where white noise would clump. Same bits as BlurCS.hlsl.
+float VplThreshold(unsigned int x, unsigned int y, unsigned int seed);
+
+// Sum of every texel's quantized flux at the map's ComputeFluxScale, what
+// VplFluxCS.hlsl computes
+unsigned int ComputeTotalFlux(const ReflectiveShadowMap &rsm);
+
+// CPU version of BlurCS.hlsl's VPL generation. Texel i becomes a VPL when
+// its threshold is below p = min(1, targetVpls * flux_i / totalFlux), so
+// with probability p over the seeds, and its color is scaled by
+// ComputeVplTexelWeight / p, so the sum of the VPLs is an unbiased estimate
+// of the lighting from every texel. At most MAX_VPLS are kept, in texel
+// order, the GPU appends them in any order.
+void SampleVplsReference(const ReflectiveShadowMap &rsm, unsigned int targetVpls, unsigned int seed,
+   std::vector<VirtualPointLight> *pLights);
+
+// One VPL at the corner of every blockSize x blockSize block, the fixed
+// layout BlurCS.hlsl used before the VPLs were importance sampled
+void SampleVplsUniform(const ReflectiveShadowMap &rsm, unsigned int blockSize, std::vector<VirtualPointLight> *pLights);
+
+// Floor lit by a spot light with a red and a green wall on the sides and a
+// bright box in the middle, most of the flux sits in a small part of the map
+void CreateSyntheticReflectiveShadowMap(unsigned int width, unsigned int height, ReflectiveShadowMap *pRsm);
+
+// Raw dump of the map, a small header followed by the flux and depth
+bool SaveReflectiveShadowMap(const char *pPath, const ReflectiveShadowMap &rsm);
+bool LoadReflectiveShadowMap(const char *pPath, ReflectiveShadowMap *pRsm);
@@ -0,0 +1,143 @@
+#include "ShaderDefines.h"
+
+struct PointLight
+{
+   float4 pos;
+   float4 col;
+};
+
+struct LightTile
+{
+   uint numLights;
+   float minDepth;
+   float maxDepth;
+   uint padding;
+};
+
+// View space normal in xyz and view depth in w, w is 0 where nothing was
+// drawn. The coarse pass reads the normals in t0, the upsample its coarse
+// light there and the normals in t1.
+Texture2D<float4> m_Input : register(t0);
+Texture2D<float4> m_SceneNormals : register(t1);
+
+// Same slots as PlainPixel.hlsl
+StructuredBuffer<PointLight> m_lightBuffer : register(t2);
+StructuredBuffer<LightTile> m_lightTiles : register(t3);
+StructuredBuffer<uint> m_lightIndices : register(t4);
+
+// Coarse light with the view depth of its sample in w, or the upsampled
+// light
+RWTexture2D<float4> m_Output : register(u0);
+
+// Must match CoarseVplConstants in CoarseVpl.h
+cbuffer CoarseVplConstants : register(b0)
+{
+   float4x4 viewToLight;
+   float2 tanHalfFov;
+   float depthTolerance;
+   float normalPower;
+   uint2 fullSize;
+   uint2 coarseSize;
+   uint factor;
+};
+
+float3 viewPosition( uint2 pixel, float z )
+{
+   float2 ndc = (float2(pixel) + 0.5) / float2(fullSize) * float2(2.0, -2.0) + float2(-1.0, 1.0);
+   return float3(ndc * tanHalfFov * z, z);
+}
+
+// VPL light of PlainPixel.hlsl's texMain at a view space position. Same as
+// ShadeVpls in CoarseVpl.cpp.
+float3 vplLights( float3 viewPos )
+{
+   float4 lPos = mul(viewToLight, float4(viewPos, 1.0));
+   if (lPos.w <= 0.0) return float3(0, 0, 0);
+   lPos.xyz /= lPos.w;
+   lPos.x = lPos.x / 2.0 + 0.5;
+   lPos.y = lPos.y / -2.0 + 0.5;
+
+   int2 cell = clamp(int2(floor(lPos.xy * float2(LIGHT_GRID_WIDTH, LIGHT_GRID_HEIGHT))),
+                     int2(0, 0), int2(LIGHT_GRID_WIDTH - 1, LIGHT_GRID_HEIGHT - 1));
+   uint tile = cell.y * LIGHT_GRID_WIDTH + cell.x;
+   LightTile lightTile = m_lightTiles[tile];
+
+   float3 color = float3(0, 0, 0);
+   if (lPos.z >= lightTile.minDepth && lPos.z <= lightTile.maxDepth)
+   {
+      for (uint i = 0; i < lightTile.numLights; i++)
+      {
+         uint light = m_lightIndices[tile * MAX_LIGHTS_PER_TILE + i];
+         float dist = distance(lPos.xyz, m_lightBuffer[light].pos.xyz);
+         if (dist < MAX_LIGHT_RADIUS)
+         {
+            float lightFactor = (MAX_LIGHT_RADIUS - dist) / MAX_LIGHT_RADIUS;
+            color += lightFactor * lightFactor * lightFactor * m_lightBuffer[light].col.xyz;
+         }
+      }
+   }
+   return color;
+}
+
+// Same as GetCoarseVplSample in CoarseVpl.cpp
+uint2 coarseSample( uint2 coarse )
+{
+   return min(coarse * factor + factor / 2, fullSize - 1);
+}
+
+// The light of one pixel per factor x factor block, at the block's center.
+// Same as ShadeVplsCoarse in CoarseVpl.cpp.
+[numthreads(VPL_SHADING_THREAD_GROUP_SIZE, VPL_SHADING_THREAD_GROUP_SIZE, 1)]
+void coarseMain( uint3 DTid : SV_DispatchThreadID )
+{
+   if (DTid.x >= coarseSize.x || DTid.y >= coarseSize.y) return;
+
+   uint2 pixel = coarseSample(DTid.xy);
+   float z = m_Input[pixel].w;
+   if (z == 0.0)
+   {
+      m_Output[DTid.xy] = float4(0, 0, 0, 0);
+      return;
+   }
+   m_Output[DTid.xy] = float4(vplLights(viewPosition(pixel, z)), z);
+}
+
+// Bilinear upsample of the four nearest coarse pixels, weighted down by how
+// far their depth is from the pixel's and how far their normal turns away.
+// Pixels with no coarse pixel on their surface, along silhouettes, run the
+// light loop themselves. Same as UpsampleVplLight in CoarseVpl.cpp.
+[numthreads(VPL_SHADING_THREAD_GROUP_SIZE, VPL_SHADING_THREAD_GROUP_SIZE, 1)]
+void upsampleMain( uint3 DTid : SV_DispatchThreadID )
+{
+   if (DTid.x >= fullSize.x || DTid.y >= fullSize.y) return;
+
+   float4 center = m_SceneNormals[DTid.xy];
+   if (center.w == 0.0)
+   {
+      m_Output[DTid.xy] = float4(0, 0, 0, 0);
+      return;
+   }
+
+   float2 position = (float2(DTid.xy) - float(factor / 2)) / float(factor);
+   uint2 base = min(uint2(max(position, 0.0)), coarseSize - 1);
+   uint2 next = min(base + 1, coarseSize - 1);
+   float2 t = saturate(position - float2(base));
+
+   uint2 taps[4] = { base, uint2(next.x, base.y), uint2(base.x, next.y), next };
+   float bilinear[4] = { (1.0 - t.x) * (1.0 - t.y), t.x * (1.0 - t.y), (1.0 - t.x) * t.y, t.x * t.y };
+
+   float3 sum = float3(0, 0, 0);
+   float totalWeight = 0.0;
+   for (uint i = 0; i < 4; i++)
+   {
+      float4 tap = m_Input[taps[i]];
+      float3 normal = m_SceneNormals[coarseSample(taps[i])].xyz;
+      float weight = bilinear[i] * max(1.0 - abs(tap.w - center.w) / (depthTolerance * center.w), 0.0);
+      weight *= pow(saturate(dot(center.xyz, normal)), normalPower);
+      sum += tap.rgb * weight;
+      totalWeight += weight;
+   }
+
+   float3 light = totalWeight > 1e-4 ? sum / totalWeight : vplLights(viewPosition(DTid.xy, center.w));
+   m_Output[DTid.xy] = float4(light, 1.0);
+}
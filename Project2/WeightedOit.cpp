@@ -0,0 +1,104 @@
+#include "WeightedOit.h"
+
+#include <cmath>
+
+#include "ABuffer.h"
+
+namespace
+{
+   const float MAX_HALF = 65504.0f;
+
+   // Rounds to the nearest value a 16 bit float holds, subnormals aside
+   float RoundToHalf(float value)
+   {
+      if (value >= MAX_HALF) return MAX_HALF;
+      if (value <= 0.0f) return 0.0f;
+      int exponent;
+      float mantissa = frexpf(value, &exponent);
+      return ldexpf(floorf(mantissa * 2048.0f + 0.5f) / 2048.0f, exponent);
+   }
+
+   float RoundToUnorm8(float value)
+   {
+      if (value < 0.0f) value = 0.0f;
+      if (value > 1.0f) value = 1.0f;
+      return floorf(value * 255.0f + 0.5f) / 255.0f;
+   }
+}
+
+float GetWeightedOitWeight(float alpha, float depth)
+{
+   float farness = 1.0f - depth;
+   float weight = (float)WBOIT_WEIGHT_SCALE * farness * farness * farness;
+   if (weight < (float)WBOIT_MIN_WEIGHT) weight = (float)WBOIT_MIN_WEIGHT;
+   if (weight > (float)WBOIT_WEIGHT_SCALE) weight = (float)WBOIT_WEIGHT_SCALE;
+   return alpha * weight;
+}
+
+unsigned long long GetWeightedOitBytes(unsigned int width, unsigned int height)
+{
+   // RGBA16F accumulation and R8 revealage
+   return (unsigned long long)width * height * (8 + 1);
+}
+
+void EstimateABufferTraffic(unsigned int width, unsigned int height, unsigned int fragments, OitTraffic *pTraffic)
+{
+   double pixels = (double)width * height;
+
+   // A fragment writes its node, the count and the head are read and
+   // written by their atomics
+   pTraffic->clearBytes = pixels * sizeof(unsigned int);
+   pTraffic->fragmentBytes = fragments * (double)(sizeof(OitNode) + 4 * sizeof(unsigned int));
+
+   // Every pixel reads its head and blends into the RGBA8 back buffer
+   pTraffic->resolveBytes = pixels * (sizeof(unsigned int) + 2 * 4) + fragments * (double)sizeof(OitNode);
+   pTraffic->totalBytes = pTraffic->clearBytes + pTraffic->fragmentBytes + pTraffic->resolveBytes;
+}
+
+void EstimateWeightedOitTraffic(unsigned int width, unsigned int height, unsigned int fragments, OitTraffic *pTraffic)
+{
+   double pixels = (double)width * height;
+   double targetBytes = (double)GetWeightedOitBytes(1, 1);
+
+   // Blending reads and writes both targets
+   pTraffic->clearBytes = pixels * targetBytes;
+   pTraffic->fragmentBytes = fragments * 2.0 * targetBytes;
+   pTraffic->resolveBytes = pixels * (targetBytes + 2 * 4);
+   pTraffic->totalBytes = pTraffic->clearBytes + pTraffic->fragmentBytes + pTraffic->resolveBytes;
+}
+
+WeightedOitBuffer::WeightedOitBuffer() :
+   m_width(0), m_height(0)
+{
+}
+
+void WeightedOitBuffer::Begin(unsigned int width, unsigned int height)
+{
+   m_width = width;
+   m_height = height;
+   m_accumulation.assign(width * height * 4, 0.0f);
+   m_revealage.assign(width * height, 1.0f);
+}
+
+void WeightedOitBuffer::Accumulate(unsigned int x, unsigned int y, const float color[4], float depth)
+{
+   unsigned int pixel = y * m_width + x;
+   float alpha = color[3];
+   float weight = GetWeightedOitWeight(alpha, depth);
+
+   // The targets blend with ONE, ONE and ZERO, INV_SRC_COLOR
+   float *pAccumulation = &m_accumulation[pixel * 4];
+   for (unsigned int c = 0; c < 3; c++) pAccumulation[c] = RoundToHalf(pAccumulation[c] + color[c] * weight);
+   pAccumulation[3] = RoundToHalf(pAccumulation[3] + weight);
+   m_revealage[pixel] = RoundToUnorm8(m_revealage[pixel] * (1.0f - alpha));
+}
+
+void WeightedOitBuffer::Resolve(unsigned int x, unsigned int y, float color[3], float *pTransmittance) const
+{
+   unsigned int pixel = y * m_width + x;
+   const float *pAccumulation = &m_accumulation[pixel * 4];
+   float totalWeight = pAccumulation[3] > 1e-5f ? pAccumulation[3] : 1e-5f;
+   float revealage = m_revealage[pixel];
+   for (unsigned int c = 0; c < 3; c++) color[c] = pAccumulation[c] / totalWeight * (1.0f - revealage);
+   *pTransmittance = revealage;
+}
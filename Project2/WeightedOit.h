@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vector>
+
+#include "ShaderDefines.h"
+
+// Bytes the transparent passes of one technique move in a frame. The
+// shading and depth testing are the same for both and left out.
+struct OitTraffic
+{
+   double clearBytes;
+   double fragmentBytes;
+   double resolveBytes;
+   double totalBytes;
+};
+
+// Weight of a fragment in the weighted average, depth is its depth buffer
+// value. Same as PlainPixel.hlsl.
+float GetWeightedOitWeight(float alpha, float depth);
+
+// Bytes of the accumulation and revealage targets
+unsigned long long GetWeightedOitBytes(unsigned int width, unsigned int height);
+
+// fragments is the number of transparent fragments passing the depth test.
+// The lists write a node and update the shared count and the pixel's head
+// per fragment, the resolve walks them.
+void EstimateABufferTraffic(unsigned int width, unsigned int height, unsigned int fragments, OitTraffic *pTraffic);
+
+// The weighted targets are blended per fragment and read once by the
+// composite
+void EstimateWeightedOitTraffic(unsigned int width, unsigned int height, unsigned int fragments, OitTraffic *pTraffic);
+
+// What the weighted transparent pass and WeightedOitCompositePS.hlsl do on
+// the GPU, with the targets' precision. The fragments may come in any
+// order, the color is a weighted average so overlapping fragments are only
+// approximately in order, the transmittance is exact.
+class WeightedOitBuffer
+{
+public:
+   WeightedOitBuffer();
+
+   // Clears the accumulation to 0 and the revealage to 1
+   void Begin(unsigned int width, unsigned int height);
+
+   void Accumulate(unsigned int x, unsigned int y, const float color[4], float depth);
+
+   // Returns the premultiplied color and the transmittance the background
+   // is scaled by, like ABuffer::Resolve
+   void Resolve(unsigned int x, unsigned int y, float color[3], float *pTransmittance) const;
+
+private:
+   unsigned int m_width;
+   unsigned int m_height;
+
+   // RGBA16F and R8 like the targets
+   std::vector<float> m_accumulation;
+   std::vector<float> m_revealage;
+};
@@ -0,0 +1,16 @@
+// Composites the weighted transparent fragments over the opaque color,
+// drawn with PlaneVertexShader.hlsl's full screen triangle and the blend
+// state of OitResolvePS.hlsl: the returned color is added to the target
+// scaled by the returned alpha, the revealage. Same as
+// WeightedOitBuffer::Resolve in WeightedOit.h.
+
+Texture2D<float4> m_accumulation : register(t0);
+Texture2D<float> m_revealage : register(t1);
+
+float4 main( float4 pos : SV_POSITION ) : SV_TARGET
+{
+   float4 accumulation = m_accumulation[uint2(pos.xy)];
+   float revealage = m_revealage[uint2(pos.xy)];
+   float3 average = accumulation.rgb / max(accumulation.a, 1e-5);
+   return float4(average * (1.0 - revealage), revealage);
+}